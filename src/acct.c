@@ -24,56 +24,172 @@
 /* includes */
 #include "pmacct.h"
 #include "imt_plugin.h"
-#include "crc32.h"
+#include "jhash.h"
 #include "bgp/bgp.h"
 
 /* functions */
-struct acc *search_accounting_structure(struct primitives_ptrs *prim_ptrs)
+static u_int32_t imt_hash(struct primitives_ptrs *prim_ptrs)
 {
-  struct pkt_data *data = prim_ptrs->data;
-  struct pkt_primitives *addr = &data->primitives;
-  struct pkt_bgp_primitives *pbgp = prim_ptrs->pbgp;
-  struct pkt_legacy_bgp_primitives *plbgp = prim_ptrs->plbgp;
-  struct pkt_nat_primitives *pnat = prim_ptrs->pnat;
-  struct pkt_mpls_primitives *pmpls = prim_ptrs->pmpls;
-  struct pkt_tunnel_primitives *ptun = prim_ptrs->ptun;
-  char *pcust = prim_ptrs->pcust;
-  struct pkt_vlen_hdr_primitives *pvlen = prim_ptrs->pvlen;
-  struct acc *elem_acc;
-  unsigned int hash, pos;
-  unsigned int pp_size = sizeof(struct pkt_primitives); 
-  unsigned int pb_size = sizeof(struct pkt_bgp_primitives);
-  unsigned int plb_size = sizeof(struct pkt_legacy_bgp_primitives);
-  unsigned int pn_size = sizeof(struct pkt_nat_primitives);
-  unsigned int pm_size = sizeof(struct pkt_mpls_primitives);
-  unsigned int pt_size = sizeof(struct pkt_tunnel_primitives);
-  unsigned int pc_size = config.cpptrs.len;
+  u_int32_t hash;
+
+  hash = primitives_key_hash(&prim_ptrs->data->primitives, 0);
+  if (prim_ptrs->pbgp) hash = jhash(prim_ptrs->pbgp, sizeof(struct pkt_bgp_primitives), hash);
+  if (prim_ptrs->plbgp) hash = jhash(prim_ptrs->plbgp, sizeof(struct pkt_legacy_bgp_primitives), hash);
+  if (prim_ptrs->pnat) hash = jhash(prim_ptrs->pnat, sizeof(struct pkt_nat_primitives), hash);
+  if (prim_ptrs->pmpls) hash = jhash(prim_ptrs->pmpls, sizeof(struct pkt_mpls_primitives), hash);
+  if (prim_ptrs->ptun) hash = jhash(prim_ptrs->ptun, sizeof(struct pkt_tunnel_primitives), hash);
+  if (prim_ptrs->pcust && config.cpptrs.len) hash = jhash(prim_ptrs->pcust, config.cpptrs.len, hash);
+
+  return hash;
+}
+
+static int imt_table_alloc(struct imt_table *t, u_int32_t size)
+{
+  t->tags = calloc(size, sizeof(u_int8_t));
+  t->slots = malloc(size * sizeof(struct imt_slot));
+
+  if (!t->tags || !t->slots) {
+    if (t->tags) free(t->tags);
+    if (t->slots) free(t->slots);
+    memset(t, 0, sizeof(struct imt_table));
+    return ERR;
+  }
+
+  t->size = size;
+  t->mask = size - 1;
+
+  return SUCCESS;
+}
+
+static void imt_table_free(struct imt_table *t)
+{
+  if (t->tags) free(t->tags);
+  if (t->slots) free(t->slots);
+  memset(t, 0, sizeof(struct imt_table));
+}
+
+/* the table is never filled beyond half of its size, so an empty
+   slot is always found; 'moved' tags only exist in the old table */
+static void imt_table_insert(struct imt_table *t, u_int32_t hash, struct acc *elem)
+{
+  u_int32_t pos = hash & t->mask;
+
+  while (t->tags[pos] != IMT_INDEX_EMPTY) pos = (pos + 1) & t->mask;
+
+  t->tags[pos] = IMT_INDEX_TAG(hash);
+  t->slots[pos].hash = hash;
+  t->slots[pos].elem = elem;
+}
 
-  hash = cache_crc32((unsigned char *)addr, pp_size);
-  if (pbgp) hash ^= cache_crc32((unsigned char *)pbgp, pb_size);
-  if (plbgp) hash ^= cache_crc32((unsigned char *)plbgp, plb_size);
-  if (pnat) hash ^= cache_crc32((unsigned char *)pnat, pn_size);
-  if (pmpls) hash ^= cache_crc32((unsigned char *)pmpls, pm_size);
-  if (ptun) hash ^= cache_crc32((unsigned char *)ptun, pt_size);
-  if (pcust && pc_size) hash ^= cache_crc32((unsigned char *)pcust, pc_size);
-  // if (pvlen) hash ^= cache_crc32((unsigned char *)pvlen, (PvhdrSz + pvlen->tot_len));
-  pos = hash % config.buckets;
-
-  Log(LOG_DEBUG, "DEBUG ( %s/%s ): Selecting bucket %u.\n", config.name, config.type, pos);
-
-  elem_acc = (struct acc *) a;
-  elem_acc += pos;  
-  
-  while (elem_acc) {
-    if (elem_acc->signature == hash) {
-      if (compare_accounting_structure(elem_acc, prim_ptrs) == 0) return elem_acc;
+static struct acc *imt_table_lookup(struct imt_table *t, u_int32_t hash, struct primitives_ptrs *prim_ptrs)
+{
+  u_int32_t pos = hash & t->mask;
+  u_int8_t tag = IMT_INDEX_TAG(hash);
+
+  while (t->tags[pos] != IMT_INDEX_EMPTY) {
+    if (t->tags[pos] == tag && t->slots[pos].hash == hash) {
+      if (compare_accounting_structure(t->slots[pos].elem, prim_ptrs) == 0) return t->slots[pos].elem;
     }
-    elem_acc = elem_acc->next;
-  } 
+    pos = (pos + 1) & t->mask;
+  }
 
   return NULL;
 }
 
+void imt_index_init(u_int32_t hint)
+{
+  u_int32_t size = IMT_INDEX_MIN_SIZE;
+
+  while (size < hint && size < (1U << 30)) size <<= 1;
+
+  memset(&imt_idx, 0, sizeof(imt_idx));
+  if (imt_table_alloc(&imt_idx.cur, size) == ERR) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate the memory table index. Exiting ..\n", config.name, config.type);
+    exit_plugin(1);
+  }
+}
+
+void imt_index_reset()
+{
+  imt_table_free(&imt_idx.old);
+  memset(imt_idx.cur.tags, 0, imt_idx.cur.size);
+  imt_idx.migrate_pos = 0;
+  imt_idx.count = 0;
+}
+
+/* moves up to 'steps' slots of the old table into the current one; the
+   old slot is tagged as moved, not emptied, not to break probe sequences */
+static void imt_index_migrate(u_int32_t steps)
+{
+  struct imt_table *old = &imt_idx.old;
+  u_int32_t pos;
+
+  for (; steps && imt_idx.migrate_pos < old->size; steps--) {
+    pos = imt_idx.migrate_pos++;
+    if (old->tags[pos] & IMT_INDEX_USED) {
+      imt_table_insert(&imt_idx.cur, old->slots[pos].hash, old->slots[pos].elem);
+      old->tags[pos] = IMT_INDEX_MOVED;
+    }
+  }
+
+  if (imt_idx.migrate_pos == old->size) imt_table_free(old);
+}
+
+void imt_index_complete()
+{
+  if (imt_idx.old.tags) imt_index_migrate(imt_idx.old.size);
+}
+
+/* makes room for one more element, doubling the table when it gets half
+   full. Existing slots are migrated incrementally by later insertions
+   so that no single packet has to pay for rehashing the whole table */
+static int imt_index_reserve()
+{
+  struct imt_table new_table;
+
+  if ((imt_idx.count + 1) * 2 <= imt_idx.cur.size) return SUCCESS;
+
+  imt_index_complete();
+  if (imt_idx.cur.size >= (1U << 30) || imt_table_alloc(&new_table, imt_idx.cur.size * 2) == ERR) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): Unable to grow the memory table index, clear stats manually!\n", config.name, config.type);
+    return ERR;
+  }
+
+  Log(LOG_DEBUG, "DEBUG ( %s/%s ): Growing memory table index to %u slots.\n", config.name, config.type, new_table.size);
+
+  memcpy(&imt_idx.old, &imt_idx.cur, sizeof(struct imt_table));
+  memcpy(&imt_idx.cur, &new_table, sizeof(struct imt_table));
+  imt_idx.migrate_pos = 0;
+
+  return SUCCESS;
+}
+
+static struct acc *imt_index_lookup(u_int32_t hash, struct primitives_ptrs *prim_ptrs)
+{
+  struct acc *elem_acc;
+
+  elem_acc = imt_table_lookup(&imt_idx.cur, hash, prim_ptrs);
+  if (!elem_acc && imt_idx.old.tags) elem_acc = imt_table_lookup(&imt_idx.old, hash, prim_ptrs);
+
+  return elem_acc;
+}
+
+/* returns the next element of the index starting from '*pos', NULL when
+   done; callers are expected to run imt_index_complete() beforehand */
+struct acc *imt_index_walk(u_int32_t *pos)
+{
+  for (; *pos < imt_idx.cur.size; (*pos)++) {
+    if (imt_idx.cur.tags[*pos] & IMT_INDEX_USED) return imt_idx.cur.slots[(*pos)++].elem;
+  }
+
+  return NULL;
+}
+
+struct acc *search_accounting_structure(struct primitives_ptrs *prim_ptrs)
+{
+  return imt_index_lookup(imt_hash(prim_ptrs), prim_ptrs);
+}
+
 int compare_accounting_structure(struct acc *elem, struct primitives_ptrs *prim_ptrs)
 {
   struct pkt_data *pdata = prim_ptrs->data;
@@ -88,7 +204,7 @@ int compare_accounting_structure(struct acc *elem, struct primitives_ptrs *prim_
   int res_data = TRUE, res_bgp = TRUE, res_nat = TRUE, res_mpls = TRUE, res_tun = TRUE;
   int res_cust = TRUE, res_vlen = TRUE, res_lbgp = TRUE;
 
-  res_data = memcmp(&elem->primitives, data, sizeof(struct pkt_primitives));
+  res_data = primitives_key_cmp(&elem->primitives, data);
 
   if (pbgp && elem->pbgp) res_bgp = memcmp(elem->pbgp, pbgp, sizeof(struct pkt_bgp_primitives));
   else res_bgp = FALSE;
@@ -133,12 +249,9 @@ void insert_accounting_structure(struct primitives_ptrs *prim_ptrs)
   char *pcust = prim_ptrs->pcust;
   struct pkt_vlen_hdr_primitives *pvlen = prim_ptrs->pvlen;
   struct acc *elem_acc;
-  unsigned char *elem, *new_elem;
-  int solved = FALSE;
-  unsigned int hash, pos;
-  unsigned int pp_size = sizeof(struct pkt_primitives);
+  unsigned char *new_elem;
+  u_int32_t hash;
   unsigned int pb_size = sizeof(struct pkt_bgp_primitives);
-  unsigned int plb_size = sizeof(struct pkt_legacy_bgp_primitives);
   unsigned int pn_size = sizeof(struct pkt_nat_primitives);
   unsigned int pm_size = sizeof(struct pkt_mpls_primitives);
   unsigned int pt_size = sizeof(struct pkt_tunnel_primitives);
@@ -172,318 +285,150 @@ void insert_accounting_structure(struct primitives_ptrs *prim_ptrs)
     else memset(&data->cst, 0, CSSz);
   } 
 
-  elem = a;
-
-  hash = cache_crc32((unsigned char *)addr, pp_size);
-  if (pbgp) hash ^= cache_crc32((unsigned char *)pbgp, pb_size);
-  if (plbgp) hash ^= cache_crc32((unsigned char *)plbgp, plb_size);
-  if (pnat) hash ^= cache_crc32((unsigned char *)pnat, pn_size);
-  if (pmpls) hash ^= cache_crc32((unsigned char *)pmpls, pm_size);
-  if (ptun) hash ^= cache_crc32((unsigned char *)ptun, pt_size);
-  if (pcust && pc_size) hash ^= cache_crc32((unsigned char *)pcust, pc_size);
-  // if (pvlen) hash ^= cache_crc32((unsigned char *)pvlen, (PvhdrSz + pvlen->tot_len));
-  pos = hash % config.buckets;
-      
-  Log(LOG_DEBUG, "DEBUG ( %s/%s ): Selecting bucket %u.\n", config.name, config.type, pos);
-  /* 
-     1st stage: compare data with last used element;
-     2nd stage: compare data with elements in the table, following chains
-  */
-  if (lru_elem_ptr[pos]) {
-    elem_acc = lru_elem_ptr[pos];
-    if (elem_acc->signature == hash) {
-      if (compare_accounting_structure(elem_acc, prim_ptrs) == 0) { 
-        if (elem_acc->reset_flag) reset_counters(elem_acc);
-        elem_acc->packet_counter += data->pkt_num;
-        elem_acc->flow_counter += data->flo_num;
-        elem_acc->bytes_counter += data->pkt_len;
-	elem_acc->tcp_flags |= data->tcp_flags;
-        elem_acc->flow_type = data->flow_type; 
-        if (config.what_to_count & COUNT_CLASS) {
-          elem_acc->packet_counter += data->cst.pa;
-          elem_acc->bytes_counter += data->cst.ba;
-          elem_acc->flow_counter += data->cst.fa;
-        }
-        return;
-      }
+  if (imt_idx.old.tags) imt_index_migrate(IMT_INDEX_MIGRATE_STEP);
+
+  hash = imt_hash(prim_ptrs);
+  elem_acc = imt_index_lookup(hash, prim_ptrs);
+
+  if (elem_acc) {
+    if (elem_acc->reset_flag) reset_counters(elem_acc);
+    elem_acc->packet_counter += data->pkt_num;
+    elem_acc->flow_counter += data->flo_num;
+    elem_acc->bytes_counter += data->pkt_len;
+    elem_acc->tcp_flags |= data->tcp_flags;
+    elem_acc->flow_type = data->flow_type;
+    if (config.what_to_count & COUNT_CLASS) {
+      elem_acc->packet_counter += data->cst.pa;
+      elem_acc->bytes_counter += data->cst.ba;
+      elem_acc->flow_counter += data->cst.fa;
     }
+    return;
   }
 
-  elem_acc = (struct acc *) elem;
-  elem_acc += pos;
-
-  while (solved == FALSE) {
-    if (elem_acc->signature == hash) {
-      if (compare_accounting_structure(elem_acc, prim_ptrs) == 0) {
-        if (elem_acc->reset_flag) reset_counters(elem_acc);
-        elem_acc->packet_counter += data->pkt_num;
-        elem_acc->flow_counter += data->flo_num;
-        elem_acc->bytes_counter += data->pkt_len;
-	elem_acc->tcp_flags |= data->tcp_flags;
-        elem_acc->flow_type = data->flow_type;
-	if (config.what_to_count & COUNT_CLASS) {
-	  elem_acc->packet_counter += data->cst.pa;
-	  elem_acc->bytes_counter += data->cst.ba;
-          elem_acc->flow_counter += data->cst.fa;
-	}
-        lru_elem_ptr[pos] = elem_acc;
-        return;
-      }
-    }
-    if (!elem_acc->bytes_counter && !elem_acc->packet_counter) { /* hmmm */
-      if (elem_acc->reset_flag) elem_acc->reset_flag = FALSE; 
-      memcpy(&elem_acc->primitives, addr, sizeof(struct pkt_primitives));
-
-      if (pbgp) {
-        if (!elem_acc->pbgp) {
-          elem_acc->pbgp = (struct pkt_bgp_primitives *) malloc(pb_size);
-          if (!elem_acc->pbgp) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-            exit_plugin(1);
-          }
-        }
-        memcpy(elem_acc->pbgp, pbgp, pb_size);
-      }
-      else {
-        if (elem_acc->pbgp) free(elem_acc->pbgp);
-        elem_acc->pbgp = NULL;
-      }
+  /* We have to know if there is enough space for a new element;
+     if not we are losing informations; conservative approach */
+  if (no_more_space) return;
 
-      if (plbgp) {
-        if (!elem_acc->clbgp) {
-          elem_acc->clbgp = (struct cache_legacy_bgp_primitives *) malloc(clb_size);
-          if (!elem_acc->clbgp) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-            exit_plugin(1);
-          }
-        }
-
-        memset(elem_acc->clbgp, 0, clb_size);
-        pkt_to_cache_legacy_bgp_primitives(elem_acc->clbgp, plbgp, config.what_to_count, config.what_to_count_2);
-      }
-      else free_cache_legacy_bgp_primitives(&elem_acc->clbgp);
-
-      if (pnat) {
-	if (!elem_acc->pnat) {
-	  elem_acc->pnat = (struct pkt_nat_primitives *) malloc(pn_size);
-	  if (!elem_acc->pnat) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-            exit_plugin(1);
-	  }
-	}
-	memcpy(elem_acc->pnat, pnat, pn_size);
-      }
-      else {
-	if (elem_acc->pnat) free(elem_acc->pnat);
-	elem_acc->pnat = NULL;
-      }
+  if (imt_index_reserve() == ERR) {
+    no_more_space = TRUE;
+    return;
+  }
 
-      if (pmpls) {
-	if (!elem_acc->pmpls) {
-	  elem_acc->pmpls = (struct pkt_mpls_primitives *) malloc(pm_size);
-	  if (!elem_acc->pmpls) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-            exit_plugin(1);
-	  }
-	}
-        memcpy(elem_acc->pmpls, pmpls, pm_size);
-      }
-      else {
-	if (elem_acc->pmpls) free(elem_acc->pmpls);
-	elem_acc->pmpls = NULL;
-      }
+  /* We have to allocate new space for this address */
+  Log(LOG_DEBUG, "DEBUG ( %s/%s ): Creating new element.\n", config.name, config.type);
 
-      if (ptun) {
-	if (!elem_acc->ptun) {
-	  elem_acc->ptun = (struct pkt_tunnel_primitives *) malloc(pt_size);
-	  if (!elem_acc->ptun) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-            exit_plugin(1);
-	  }
-	}
-	memcpy(elem_acc->ptun, ptun, pt_size);
-      }
-      else {
-	if (elem_acc->ptun) free(elem_acc->ptun);
-	elem_acc->ptun = NULL;
-      }
+  if (current_pool->space_left >= sizeof(struct acc)) {
+    new_elem = current_pool->ptr;
+    current_pool->space_left -= sizeof(struct acc);
+    current_pool->ptr += sizeof(struct acc);
+  }
+  else {
+    current_pool = request_memory_pool(config.memory_pool_size); 
+    if (current_pool == NULL) {
+      Log(LOG_WARNING, "WARN ( %s/%s ): Unable to allocate more memory pools, clear stats manually!\n", config.name, config.type);
+      no_more_space = TRUE;
+      return;
+    }
+    else {
+      new_elem = current_pool->ptr;
+      current_pool->space_left -= sizeof(struct acc);
+      current_pool->ptr += sizeof(struct acc);
+    }
+  }
 
-      if (pcust) {
-	if (!elem_acc->pcust) {
-	  elem_acc->pcust = (char *) malloc(pc_size);
-	  if (!elem_acc->pcust) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-            exit_plugin(1);
-	  }
-	}
-        memcpy(elem_acc->pcust, pcust, pc_size);
-      }
-      else {
-	if (elem_acc->pcust) free(elem_acc->pcust);
-	elem_acc->pcust = NULL;
-      }
+  elem_acc = (struct acc *) new_elem;
+  memcpy(&elem_acc->primitives, addr, sizeof(struct pkt_primitives));
 
-      /* if we have a pvlen from before let's free it up due to the vlen nature of the memory area */
-      if (elem_acc->pvlen) {
-        vlen_prims_free(elem_acc->pvlen);
-        elem_acc->pvlen = NULL;
-      }
+  if (pbgp) {
+    elem_acc->pbgp = (struct pkt_bgp_primitives *) malloc(pb_size);
+    if (!elem_acc->pbgp) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
+      exit_plugin(1);
+    }
+    memcpy(elem_acc->pbgp, pbgp, pb_size);
+  }
+  else elem_acc->pbgp = NULL;
 
-      if (pvlen) {
-        if (!elem_acc->pvlen) {
-          elem_acc->pvlen = (struct pkt_vlen_hdr_primitives *) vlen_prims_copy(pvlen);
-          if (!elem_acc->pvlen) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-            exit_plugin(1);
-          }
-        }
-      }
+  if (plbgp) {
+    elem_acc->clbgp = (struct cache_legacy_bgp_primitives *) malloc(clb_size);
+    if (!elem_acc->clbgp) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
+      exit_plugin(1);
+    }
+    memset(elem_acc->clbgp, 0, clb_size);
+    pkt_to_cache_legacy_bgp_primitives(elem_acc->clbgp, plbgp, config.what_to_count, config.what_to_count_2);
+  }
+  else elem_acc->clbgp = NULL;
 
-      elem_acc->packet_counter += data->pkt_num;
-      elem_acc->flow_counter += data->flo_num;
-      elem_acc->bytes_counter += data->pkt_len;
-      elem_acc->tcp_flags |= data->tcp_flags;
-      elem_acc->flow_type = data->flow_type;
-      elem_acc->signature = hash;
-      if (config.what_to_count & COUNT_CLASS) {
-        elem_acc->packet_counter += data->cst.pa;
-        elem_acc->bytes_counter += data->cst.ba;
-        elem_acc->flow_counter += data->cst.fa;
-      }
-      lru_elem_ptr[pos] = elem_acc;
-      return;
+  if (pnat) {
+    elem_acc->pnat = (struct pkt_nat_primitives *) malloc(pn_size);
+    if (!elem_acc->pnat) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
+      exit_plugin(1);
     }
+    memcpy(elem_acc->pnat, pnat, pn_size);
+  }
+  else elem_acc->pnat = NULL;
 
-    /* Handling collisions */
-    else if (elem_acc->next != NULL) {
-      Log(LOG_DEBUG, "DEBUG ( %s/%s ): Walking through the collision-chain.\n", config.name, config.type);
-      elem_acc = elem_acc->next;
-      solved = FALSE;
+  if (pmpls) {
+    elem_acc->pmpls = (struct pkt_mpls_primitives *) malloc(pm_size);
+    if (!elem_acc->pmpls) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
+      exit_plugin(1);
     }
-    else if (elem_acc->next == NULL) {
-      /* We have to know if there is enough space for a new element;
-         if not we are losing informations; conservative approach */
-      if (no_more_space) return;
-
-      /* We have to allocate new space for this address */
-      Log(LOG_DEBUG, "DEBUG ( %s/%s ): Creating new element.\n", config.name, config.type);
-
-      if (current_pool->space_left >= sizeof(struct acc)) {
-        new_elem = current_pool->ptr;
-	current_pool->space_left -= sizeof(struct acc);
-	current_pool->ptr += sizeof(struct acc);
-      }
-      else {
-        current_pool = request_memory_pool(config.memory_pool_size); 
-	if (current_pool == NULL) {
-          Log(LOG_WARNING, "WARN ( %s/%s ): Unable to allocate more memory pools, clear stats manually!\n", config.name, config.type);
-	  no_more_space = TRUE;
-	  return;
-        }
-        else {
-          new_elem = current_pool->ptr;
-          current_pool->space_left -= sizeof(struct acc);
-          current_pool->ptr += sizeof(struct acc);
-	}
-      }
+    memcpy(elem_acc->pmpls, pmpls, pm_size);
+  }
+  else elem_acc->pmpls = NULL;
 
-      elem_acc->next = (struct acc *) new_elem;
-      elem_acc = (struct acc *) new_elem;
-      memcpy(&elem_acc->primitives, addr, sizeof(struct pkt_primitives));
-
-      if (pbgp) {
-        elem_acc->pbgp = (struct pkt_bgp_primitives *) malloc(pb_size);
-        if (!elem_acc->pbgp) {
-          Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-          exit_plugin(1);
-        }
-        memcpy(elem_acc->pbgp, pbgp, pb_size);
-      }
-      else elem_acc->pbgp = NULL;
-
-      if (plbgp) {
-        elem_acc->clbgp = (struct cache_legacy_bgp_primitives *) malloc(clb_size);
-        if (!elem_acc->clbgp) {
-          Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-          exit_plugin(1);
-        }
-        memset(elem_acc->clbgp, 0, clb_size);
-        pkt_to_cache_legacy_bgp_primitives(elem_acc->clbgp, plbgp, config.what_to_count, config.what_to_count_2);
-      }
-      else elem_acc->clbgp = NULL;
-
-      if (pnat) {
-        elem_acc->pnat = (struct pkt_nat_primitives *) malloc(pn_size);
-	if (!elem_acc->pnat) {
-          Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-          exit_plugin(1);
-	}
-        memcpy(elem_acc->pnat, pnat, pn_size);
-      }
-      else elem_acc->pnat = NULL;
-
-      if (pmpls) {
-        elem_acc->pmpls = (struct pkt_mpls_primitives *) malloc(pm_size);
-	if (!elem_acc->pmpls) {
-          Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-          exit_plugin(1);
-	}
-        memcpy(elem_acc->pmpls, pmpls, pm_size);
-      }
-      else elem_acc->pmpls = NULL;
-
-      if (ptun) {
-        elem_acc->ptun = (struct pkt_tunnel_primitives *) malloc(pt_size);
-	if (!elem_acc->ptun) {
-          Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-          exit_plugin(1);
-	}
-        memcpy(elem_acc->ptun, ptun, pt_size);
-      }
-      else elem_acc->ptun = NULL;
-
-      if (pcust) {
-        elem_acc->pcust = (char *) malloc(pc_size);
-	if (!elem_acc->pcust) {
-          Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-          exit_plugin(1);
-	}
-        memcpy(elem_acc->pcust, pcust, pc_size);
-      }
-      else elem_acc->pcust = NULL;
+  if (ptun) {
+    elem_acc->ptun = (struct pkt_tunnel_primitives *) malloc(pt_size);
+    if (!elem_acc->ptun) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
+      exit_plugin(1);
+    }
+    memcpy(elem_acc->ptun, ptun, pt_size);
+  }
+  else elem_acc->ptun = NULL;
 
-      /* if we have a pvlen from before let's free it up due to the vlen nature of the memory area */
-      if (elem_acc->pvlen) {
-        vlen_prims_free(elem_acc->pvlen);
-        elem_acc->pvlen = NULL;
-      }
+  if (pcust) {
+    elem_acc->pcust = (char *) malloc(pc_size);
+    if (!elem_acc->pcust) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
+      exit_plugin(1);
+    }
+    memcpy(elem_acc->pcust, pcust, pc_size);
+  }
+  else elem_acc->pcust = NULL;
 
-      if (pvlen) {
-        if (!elem_acc->pvlen) {
-          elem_acc->pvlen = (struct pkt_vlen_hdr_primitives *) vlen_prims_copy(pvlen);
-          if (!elem_acc->pvlen) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
-            exit_plugin(1);
-          }
-        }
-      }
+  /* if we have a pvlen from before let's free it up due to the vlen nature of the memory area */
+  if (elem_acc->pvlen) {
+    vlen_prims_free(elem_acc->pvlen);
+    elem_acc->pvlen = NULL;
+  }
 
-      elem_acc->packet_counter += data->pkt_num;
-      elem_acc->flow_counter += data->flo_num;
-      elem_acc->bytes_counter += data->pkt_len;
-      elem_acc->tcp_flags = data->tcp_flags;
-      elem_acc->flow_type = data->flow_type;
-      elem_acc->signature = hash; 
-      if (config.what_to_count & COUNT_CLASS) {
-        elem_acc->packet_counter += data->cst.pa;
-        elem_acc->bytes_counter += data->cst.ba;
-        elem_acc->flow_counter += data->cst.fa;
+  if (pvlen) {
+    if (!elem_acc->pvlen) {
+      elem_acc->pvlen = (struct pkt_vlen_hdr_primitives *) vlen_prims_copy(pvlen);
+      if (!elem_acc->pvlen) {
+        Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (insert_accounting_structure). Exiting ..\n", config.name, config.type);
+        exit_plugin(1);
       }
-      elem_acc->next = NULL;
-      lru_elem_ptr[pos] = elem_acc;
-      return;
     }
   }
+
+  elem_acc->packet_counter += data->pkt_num;
+  elem_acc->flow_counter += data->flo_num;
+  elem_acc->bytes_counter += data->pkt_len;
+  elem_acc->tcp_flags = data->tcp_flags;
+  elem_acc->flow_type = data->flow_type;
+  elem_acc->signature = hash; 
+  if (config.what_to_count & COUNT_CLASS) {
+    elem_acc->packet_counter += data->cst.pa;
+    elem_acc->bytes_counter += data->cst.ba;
+    elem_acc->flow_counter += data->cst.fa;
+  }
+  imt_table_insert(&imt_idx.cur, hash, elem_acc);
+  imt_idx.count++;
 }
 
 void set_reset_flag(struct acc *elem)
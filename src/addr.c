@@ -111,7 +111,7 @@ unsigned int str_to_addr_mask(const char *str, struct host_addr *a, struct host_
         for (j = 0; j < 4 && index >= 32; j++, index -= 32) m->mask.m6[j] = 0xffffffffU;
 	if (j < 4 && index) m->mask.m6[j] = htonl(~(0xffffffffU >> index));
 
-        for (j = 0; j < 4; j++) a->address.ipv6.s6_addr[j] &= m->mask.m6[j];
+        host_addr_mask(a, m);
       }
 #endif
       else goto error;
@@ -267,7 +267,56 @@ int sa_port_cmp(struct sockaddr *sa, u_int16_t port)
 }
 
 /*
- * host_addr_mask_cmp() checks whether s1 falls in a1/m1
+ * host_addr_mask() applies mask m to address a, in place
+ */
+void host_addr_mask(struct host_addr *a, struct host_mask *m)
+{
+#if defined ENABLE_IPV6
+  u_int32_t addr6[4];
+  int j;
+#endif
+
+  if (a->family == AF_INET) a->address.ipv4.s_addr &= m->mask.m4;
+#if defined ENABLE_IPV6
+  else if (a->family == AF_INET6) {
+    memcpy(addr6, &a->address.ipv6, IP6AddrSz);
+    for (j = 0; j < 4; j++) addr6[j] &= m->mask.m6[j];
+    memcpy(&a->address.ipv6, addr6, IP6AddrSz);
+  }
+#endif
+}
+
+/*
+ * host_addr_mask_cmp() checks whether a2 falls in a1/m1
+ * returns 0 if positive; 1 if negative; -1 to signal a generic error
+ * (e.g. unsupported family).
+ */
+int host_addr_mask_cmp(struct host_addr *a1, struct host_mask *m1, struct host_addr *a2)
+{
+  struct host_addr a2_local;
+
+  if (!a1 || !m1 || !a2) return -1;
+  if (a1->family != a2->family || a1->family != m1->family) return -1;
+
+  memcpy(&a2_local, a2, sizeof(struct host_addr));
+  host_addr_mask(&a2_local, m1);
+
+  if (a1->family == AF_INET) {
+    if (a2_local.address.ipv4.s_addr == a1->address.ipv4.s_addr) return 0;
+    else return 1;
+  }
+#if defined ENABLE_IPV6
+  else if (a1->family == AF_INET6) {
+    if (!ip6_addr_cmp(&a1->address.ipv6, &a2_local.address.ipv6)) return 0;
+    else return 1;
+  }
+#endif
+
+  return -1;
+}
+
+/*
+ * host_addr_mask_sa_cmp() checks whether s1 falls in a1/m1
  * returns 0 if positive; 1 if negative; -1 to signal a generic error
  * (e.g. unsupported family).
  */
@@ -275,9 +324,8 @@ int host_addr_mask_sa_cmp(struct host_addr *a1, struct host_mask *m1, struct soc
 {
   struct sockaddr_in *sa4 = (struct sockaddr_in *)s1;
 #if defined ENABLE_IPV6
-  struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)s1;
-  struct sockaddr_in6 sa6_local;
-  int ret, j;
+  struct host_addr a2;
+  u_int16_t port;
 #endif
 
   if (!a1 || !m1 || !s1) return -1;
@@ -289,11 +337,8 @@ int host_addr_mask_sa_cmp(struct host_addr *a1, struct host_mask *m1, struct soc
   }
 #if defined ENABLE_IPV6
   else if (a1->family == AF_INET6) {
-    memcpy(&sa6_local, s1, sizeof(struct sockaddr));
-    for (j = 0; j < 4; j++) sa6_local.sin6_addr.s6_addr[j] &= m1->mask.m6[j];
-    ret = ip6_addr_cmp(a1, &sa6_local.sin6_addr);
-    if (!ret) return 0;
-    else return 1;
+    sa_to_addr(s1, &a2, &port);
+    return host_addr_mask_cmp(a1, m1, &a2);
   }
 #endif
 
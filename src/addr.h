@@ -40,6 +40,8 @@ EXT unsigned int addr_to_sa(struct sockaddr *, struct host_addr *, u_int16_t);
 EXT unsigned int sa_to_addr(struct sockaddr *, struct host_addr *, u_int16_t *);
 EXT int sa_addr_cmp(struct sockaddr *, struct host_addr *);
 EXT int sa_port_cmp(struct sockaddr *, u_int16_t);
+EXT void host_addr_mask(struct host_addr *, struct host_mask *);
+EXT int host_addr_mask_cmp(struct host_addr *, struct host_mask *, struct host_addr *);
 EXT int host_addr_mask_sa_cmp(struct host_addr *, struct host_mask *, struct sockaddr *);
 EXT unsigned int raw_to_sa(struct sockaddr *, char *, u_int8_t);
 EXT unsigned int sa_to_str(char *, const struct sockaddr *);
@@ -29,10 +29,21 @@
 #include "plugin_cmn_json.h"
 #include "plugin_cmn_avro.h"
 #include "amqp_plugin.h"
+#include "crc32.h"
 #ifndef WITH_JANSSON
 #error "--enable-rabbitmq requires --enable-jansson"
 #endif
 
+/* variables */
+static struct p_purge_pool amqp_purge_pool;
+static struct p_amqp_purge *amqp_purge;
+static char *amqp_purge_routing_key;
+
+/* prototypes */
+static void amqp_purge_set_host(struct p_amqp_host *);
+static u_int32_t amqp_purge_routing_key_key(struct chained_cache *);
+static void amqp_cache_purge_worker(struct p_purge_worker *);
+
 /* Functions */
 void amqp_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr) 
 {
@@ -121,6 +132,13 @@ void amqp_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
     exit_plugin(1);
   }
 
+  /* entries are split across connections by routing key: a static one
+     would be published from all of them at once, out of order */
+  if (config.dump_purge_threads > 1 && !(config.sql_table && strchr(config.sql_table, '$'))) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): 'amqp_purge_threads' ignored: it requires a dynamic 'amqp_routing_key'.\n", config.name, config.type);
+    config.dump_purge_threads = 1;
+  }
+
   p_amqp_init_host(&amqpp_amqp_host);
   p_amqp_set_user(&amqpp_amqp_host, config.sql_user);
   p_amqp_set_passwd(&amqpp_amqp_host, config.sql_passwd);
@@ -191,7 +209,7 @@ void amqp_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
     pfd.events = POLLIN;
     timeout = MIN(refresh_timeout, (amqp_timeout ? amqp_timeout : INT_MAX));
     timeout = MIN(timeout, (avro_schema_timeout ? avro_schema_timeout : INT_MAX));
-    ret = poll(&pfd, (pfd.fd == ERR ? 0 : 1), timeout);
+    ret = plugin_pipe_poll(&pfd, status, timeout);
 
     if (ret <= 0) {
       if (getppid() == 1) {
@@ -268,6 +286,7 @@ void amqp_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
         pollagain = FALSE;
         memcpy(pipebuf, rg->ptr, bufsz);
+        plugin_pipe_ring_release(status);
         rg->ptr += bufsz;
       }
       else {
@@ -325,34 +344,14 @@ void amqp_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
 void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 {
-  struct pkt_primitives *data = NULL;
-  struct pkt_bgp_primitives *pbgp = NULL;
-  struct pkt_nat_primitives *pnat = NULL;
-  struct pkt_mpls_primitives *pmpls = NULL;
-  struct pkt_tunnel_primitives *ptun = NULL;
-  char *pcust = NULL;
-  struct pkt_vlen_hdr_primitives *pvlen = NULL;
-  struct pkt_bgp_primitives empty_pbgp;
-  struct pkt_nat_primitives empty_pnat;
-  struct pkt_mpls_primitives empty_pmpls;
-  struct pkt_tunnel_primitives empty_ptun;
+  struct p_amqp_purge serial_purge, *purge;
+  struct p_purge_worker serial_worker;
   char *empty_pcust = NULL;
-  char src_mac[18], dst_mac[18], src_host[INET6_ADDRSTRLEN], dst_host[INET6_ADDRSTRLEN], ip_address[INET6_ADDRSTRLEN];
-  char rd_str[SRVBUFLEN], misc_str[SRVBUFLEN], dyn_amqp_routing_key[SRVBUFLEN], *orig_amqp_routing_key = NULL;
-  int i, j, stop, batch_idx, is_routing_key_dyn = FALSE, qn = 0, ret, saved_index = index;
-  int mv_num = 0, mv_num_save = 0;
+  char dyn_amqp_routing_key[SRVBUFLEN], *orig_amqp_routing_key = NULL;
+  int j, stop, is_routing_key_dyn = FALSE, qn = 0, ret, saved_index = index, workers, errors = 0;
   time_t start, duration;
   pid_t writer_pid = getpid();
 
-  char *json_buf = NULL;
-  int json_buf_off = 0;
-
-#ifdef WITH_AVRO
-  avro_writer_t avro_writer;
-  char *avro_buf = NULL;
-  int avro_buffer_full = FALSE;
-#endif
-
   /* setting some defaults */
   if (!config.sql_host) config.sql_host = default_amqp_host;
   if (!config.sql_db) config.sql_db = default_amqp_exchange;
@@ -372,23 +371,7 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
     config.sql_table = dyn_amqp_routing_key;
   }
 
-  p_amqp_set_exchange(&amqpp_amqp_host, config.sql_db);
-  p_amqp_set_routing_key(&amqpp_amqp_host, config.sql_table);
-  p_amqp_set_exchange_type(&amqpp_amqp_host, config.amqp_exchange_type);
-  p_amqp_set_host(&amqpp_amqp_host, config.sql_host);
-  p_amqp_set_vhost(&amqpp_amqp_host, config.amqp_vhost);
-  p_amqp_set_persistent_msg(&amqpp_amqp_host, config.amqp_persistent_msg);
-  p_amqp_set_frame_max(&amqpp_amqp_host, config.amqp_frame_max);
-
-  if (config.message_broker_output & PRINT_OUTPUT_JSON) p_amqp_set_content_type_json(&amqpp_amqp_host);
-  else if (config.message_broker_output & PRINT_OUTPUT_AVRO) p_amqp_set_content_type_binary(&amqpp_amqp_host);
-  else {
-    Log(LOG_ERR, "ERROR ( %s/%s ): Unsupported amqp_output value specified. Exiting.\n", config.name, config.type);
-    exit_plugin(1);
-  }
-
-  p_amqp_init_routing_key_rr(&amqpp_amqp_host);
-  p_amqp_set_routing_key_rr(&amqpp_amqp_host, config.amqp_routing_key_rr);
+  amqp_purge_set_host(&amqpp_amqp_host);
 
   empty_pcust = malloc(config.cpptrs.len);
   if (!empty_pcust) {
@@ -396,14 +379,13 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
     exit_plugin(1);
   }
 
-  memset(&empty_pbgp, 0, sizeof(struct pkt_bgp_primitives));
-  memset(&empty_pnat, 0, sizeof(struct pkt_nat_primitives));
-  memset(&empty_pmpls, 0, sizeof(struct pkt_mpls_primitives));
-  memset(&empty_ptun, 0, sizeof(struct pkt_tunnel_primitives));
   memset(empty_pcust, 0, config.cpptrs.len);
 
   ret = p_amqp_connect_to_publish(&amqpp_amqp_host);
-  if (ret) return;
+  if (ret) {
+    free(empty_pcust);
+    return;
+  }
 
   for (j = 0, stop = 0; (!stop) && P_preprocess_funcs[j]; j++)
     stop = P_preprocess_funcs[j](queue, &index, j);
@@ -429,13 +411,179 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
     }
   }
 
+  if ((workers = P_purge_pool_init(&amqp_purge_pool, amqp_cache_purge_worker))) {
+    if (!amqp_purge) {
+      amqp_purge = (struct p_amqp_purge *) pm_malloc(workers * sizeof(struct p_amqp_purge));
+      memset(amqp_purge, 0, workers * sizeof(struct p_amqp_purge));
+    }
+
+    /* each worker publishes over its own connection; records sharing a
+       dynamic routing key are kept on the same worker to preserve their order */
+    for (j = 0; j < workers; j++) {
+      purge = &amqp_purge[j];
+
+      p_amqp_init_host(&purge->host);
+      p_amqp_set_user(&purge->host, config.sql_user);
+      p_amqp_set_passwd(&purge->host, config.sql_passwd);
+      amqp_purge_set_host(&purge->host);
+
+      if (p_amqp_connect_to_publish(&purge->host)) {
+        Log(LOG_WARNING, "WARN ( %s/%s ): Unable to connect purge worker #%u. Purging serially.\n", config.name, config.type, j);
+
+        while (j--) p_amqp_close(&amqp_purge[j].host, FALSE);
+        workers = 0;
+        break;
+      }
+
+      purge->amqp_host = &purge->host;
+      purge->orig_amqp_routing_key = orig_amqp_routing_key;
+      purge->is_routing_key_dyn = is_routing_key_dyn;
+      purge->writer_pid = writer_pid;
+      purge->empty_pcust = empty_pcust;
+
+      amqp_purge_pool.worker[j].priv = purge;
+    }
+  }
+
+  if (workers) {
+    amqp_purge_routing_key = orig_amqp_routing_key;
+
+    P_purge_pool_partition(&amqp_purge_pool, queue, index, is_routing_key_dyn ? amqp_purge_routing_key_key : NULL);
+    P_purge_pool_run(&amqp_purge_pool);
+
+    for (j = 0; j < workers; j++) {
+      p_amqp_close(&amqp_purge[j].host, FALSE);
+      qn += amqp_purge_pool.worker[j].qn;
+      if (amqp_purge_pool.worker[j].ret == ERR) errors++;
+    }
+  }
+  else {
+    memset(&serial_purge, 0, sizeof(serial_purge));
+    serial_purge.amqp_host = &amqpp_amqp_host;
+    serial_purge.orig_amqp_routing_key = orig_amqp_routing_key;
+    serial_purge.is_routing_key_dyn = is_routing_key_dyn;
+    serial_purge.writer_pid = writer_pid;
+    serial_purge.empty_pcust = empty_pcust;
+
+    memset(&serial_worker, 0, sizeof(serial_worker));
+    serial_worker.queue = queue;
+    serial_worker.index = index;
+    serial_worker.priv = &serial_purge;
+
+    amqp_cache_purge_worker(&serial_worker);
+    qn = serial_worker.qn;
+    if (serial_worker.ret == ERR) errors++;
+  }
+
+  duration = time(NULL)-start;
+
+  if (config.print_markers) {
+    if (config.message_broker_output & PRINT_OUTPUT_JSON || config.message_broker_output & PRINT_OUTPUT_AVRO) {
+      void *json_obj;
+      char *json_str;
+
+      json_obj = compose_purge_close_json(config.name, writer_pid, qn, saved_index, duration);
+
+      if (json_obj) json_str = compose_json_str(json_obj);
+      if (json_str) {
+        Log(LOG_DEBUG, "DEBUG ( %s/%s ): %s\n\n", config.name, config.type, json_str);
+        ret = p_amqp_publish_string(&amqpp_amqp_host, json_str);
+
+        free(json_str);
+        json_str = NULL;
+      }
+    }
+  }
+
+  p_amqp_close(&amqpp_amqp_host, FALSE);
+
+  if (errors) Log(LOG_ERR, "ERROR ( %s/%s ): %u purge worker(s) aborted; cache purged partially.\n", config.name, config.type, errors);
+
+  Log(LOG_INFO, "INFO ( %s/%s ): *** Purging cache - END (PID: %u, QN: %u/%u, ET: %u) ***\n",
+		config.name, config.type, writer_pid, qn, saved_index, duration);
+
+  if (workers) P_purge_pool_report(&amqp_purge_pool);
+
+  if (config.sql_trigger_exec) P_trigger_exec(config.sql_trigger_exec); 
+
+  if (empty_pcust) free(empty_pcust);
+}
+
+static void amqp_purge_set_host(struct p_amqp_host *amqp_host)
+{
+  p_amqp_set_exchange(amqp_host, config.sql_db);
+  p_amqp_set_routing_key(amqp_host, config.sql_table);
+  p_amqp_set_exchange_type(amqp_host, config.amqp_exchange_type);
+  p_amqp_set_host(amqp_host, config.sql_host);
+  p_amqp_set_vhost(amqp_host, config.amqp_vhost);
+  p_amqp_set_persistent_msg(amqp_host, config.amqp_persistent_msg);
+  p_amqp_set_frame_max(amqp_host, config.amqp_frame_max);
+
+  if (config.message_broker_output & PRINT_OUTPUT_JSON) p_amqp_set_content_type_json(amqp_host);
+  else if (config.message_broker_output & PRINT_OUTPUT_AVRO) p_amqp_set_content_type_binary(amqp_host);
+  else {
+    Log(LOG_ERR, "ERROR ( %s/%s ): Unsupported amqp_output value specified. Exiting.\n", config.name, config.type);
+    exit_plugin(1);
+  }
+
+  p_amqp_init_routing_key_rr(amqp_host);
+  p_amqp_set_routing_key_rr(amqp_host, config.amqp_routing_key_rr);
+}
+
+static u_int32_t amqp_purge_routing_key_key(struct chained_cache *cache_ptr)
+{
+  char routing_key[SRVBUFLEN];
+
+  P_handle_table_dyn_strings(routing_key, SRVBUFLEN, amqp_purge_routing_key, cache_ptr);
+
+  return cache_crc32((unsigned char *) routing_key, strlen(routing_key));
+}
+
+static void amqp_cache_purge_worker(struct p_purge_worker *worker)
+{
+  struct p_amqp_purge *purge = (struct p_amqp_purge *) worker->priv;
+  struct p_amqp_host *amqp_host = purge->amqp_host;
+  struct chained_cache **queue = worker->queue;
+  struct pkt_primitives *data = NULL;
+  struct pkt_bgp_primitives *pbgp = NULL;
+  struct pkt_nat_primitives *pnat = NULL;
+  struct pkt_mpls_primitives *pmpls = NULL;
+  struct pkt_tunnel_primitives *ptun = NULL;
+  char *pcust = NULL;
+  struct pkt_vlen_hdr_primitives *pvlen = NULL;
+  struct pkt_bgp_primitives empty_pbgp;
+  struct pkt_nat_primitives empty_pnat;
+  struct pkt_mpls_primitives empty_pmpls;
+  struct pkt_tunnel_primitives empty_ptun;
+  char dyn_amqp_routing_key[SRVBUFLEN];
+  int j, index = worker->index, qn = 0, ret;
+  int mv_num = 0, mv_num_save = 0;
+
+  char *json_buf = NULL;
+  int json_buf_off = 0;
+
+#ifdef WITH_AVRO
+  avro_writer_t avro_writer = NULL;
+  char *avro_buf = NULL;
+  int avro_buffer_full = FALSE;
+#endif
+
+  /* in thread mode this runs in a writer thread: errors must not take
+     the plugin down, they abort this share of the purge instead */
+  worker->ret = SUCCESS;
+
+  memset(&empty_pbgp, 0, sizeof(struct pkt_bgp_primitives));
+  memset(&empty_pnat, 0, sizeof(struct pkt_nat_primitives));
+  memset(&empty_pmpls, 0, sizeof(struct pkt_mpls_primitives));
+  memset(&empty_ptun, 0, sizeof(struct pkt_tunnel_primitives));
+
   if (config.message_broker_output & PRINT_OUTPUT_JSON) {
     if (config.sql_multi_values) {
       json_buf = malloc(config.sql_multi_values);
 
       if (!json_buf) {
-	Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (json_buf). Exiting ..\n", config.name, config.type);
-	exit_plugin(1);
+	Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (json_buf). Purge aborted.\n", config.name, config.type);
+	goto error;
       }
       else memset(json_buf, 0, config.sql_multi_values);
     }
@@ -447,11 +595,15 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
     avro_buf = malloc(config.avro_buffer_size);
 
     if (!avro_buf) {
-      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (avro_buf). Exiting ..\n", config.name, config.type);
-      exit_plugin(1);
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (avro_buf). Purge aborted.\n", config.name, config.type);
+      goto error;
     }
 
     avro_writer = avro_writer_memory(avro_buf, config.avro_buffer_size);
+    if (!avro_writer) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): AVRO: unable to create writer. Purge aborted.\n", config.name, config.type);
+      goto error;
+    }
 #endif
   }
 
@@ -475,7 +627,7 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
     else ptun = &empty_ptun;
 
     if (queue[j]->pcust) pcust = queue[j]->pcust;
-    else pcust = empty_pcust;
+    else pcust = purge->empty_pcust;
 
     if (queue[j]->pvlen) pvlen = queue[j]->pvlen;
     else pvlen = NULL;
@@ -484,13 +636,7 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 
     if (config.message_broker_output & PRINT_OUTPUT_JSON) {
 #ifdef WITH_JANSSON
-      json_t *json_obj = json_object();
-      int idx;
-
-      for (idx = 0; idx < N_PRIMITIVES && cjhandler[idx]; idx++) cjhandler[idx](json_obj, queue[j]);
-      add_writer_name_and_pid_json(json_obj, config.name, writer_pid);
-
-      json_str = compose_json_str(json_obj);
+      json_str = compose_json_record(queue[j], config.name, purge->writer_pid);
 #endif
     }
     else if (config.message_broker_output & PRINT_OUTPUT_AVRO) {
@@ -502,7 +648,7 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
                            &queue[j]->basetime, queue[j]->stitch, avro_iface);
       size_t avro_value_size;
 
-      add_writer_name_and_pid_avro(avro_value, config.name, writer_pid);
+      add_writer_name_and_pid_avro(avro_value, config.name, purge->writer_pid);
       avro_value_sizeof(&avro_value, &avro_value_size);
 
       if (avro_value_size > config.avro_buffer_size) {
@@ -510,7 +656,7 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
             config.name, config.type, config.avro_buffer_size);
         Log(LOG_ERR, "ERROR ( %s/%s ): AVRO: increase value or look for avro_buffer_size in CONFIG-KEYS document.\n\n",
             config.name, config.type);
-        exit_plugin(1);
+        worker->ret = ERR;
       }
       else if (avro_value_size >= (config.avro_buffer_size - avro_writer_tell(avro_writer))) {
         avro_buffer_full = TRUE;
@@ -518,7 +664,7 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
       }
       else if (avro_value_write(avro_writer, &avro_value)) {
         Log(LOG_ERR, "ERROR ( %s/%s ): ARVO: unable to write value: %s\n", config.name, config.type, avro_strerror());
-        exit_plugin(1);
+        worker->ret = ERR;
       }
       else {
         mv_num++;
@@ -526,6 +672,8 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 
       avro_value_decref(&avro_value);
       avro_value_iface_decref(avro_iface);
+
+      if (worker->ret == ERR) goto error;
 #else
       if (config.debug) Log(LOG_DEBUG, "DEBUG ( %s/%s ): compose_avro(): AVRO object not created due to missing --enable-avro\n", config.name, config.type);
 #endif
@@ -539,8 +687,9 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 
 	if (json_strlen >= (config.sql_multi_values - json_buf_off)) {
 	  if (json_strlen >= config.sql_multi_values) {
-	    Log(LOG_ERR, "ERROR ( %s/%s ): kafka_multi_values not large enough to store JSON elements. Exiting ..\n", config.name, config.type);
-	    exit(1);
+	    Log(LOG_ERR, "ERROR ( %s/%s ): amqp_multi_values not large enough to store JSON elements. Purge aborted.\n", config.name, config.type);
+	    free(json_str);
+	    goto error;
 	  }
 
 	  tmp_str = json_str;
@@ -553,24 +702,23 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 	  string_add_newline(json_buf);
 	  json_buf_off = strlen(json_buf);
 
-	  free(json_str);
 	  json_str = NULL;
         }
       }
 
       if (json_str) {
-        if (is_routing_key_dyn) {
-          P_handle_table_dyn_strings(dyn_amqp_routing_key, SRVBUFLEN, orig_amqp_routing_key, queue[j]);
-          p_amqp_set_routing_key(&amqpp_amqp_host, dyn_amqp_routing_key);
+        if (purge->is_routing_key_dyn) {
+          P_handle_table_dyn_strings(dyn_amqp_routing_key, SRVBUFLEN, purge->orig_amqp_routing_key, queue[j]);
+          p_amqp_set_routing_key(amqp_host, dyn_amqp_routing_key);
         }
 
         if (config.amqp_routing_key_rr) {
-          P_handle_table_dyn_rr(dyn_amqp_routing_key, SRVBUFLEN, orig_amqp_routing_key, &amqpp_amqp_host.rk_rr);
-          p_amqp_set_routing_key(&amqpp_amqp_host, dyn_amqp_routing_key);
+          P_handle_table_dyn_rr(dyn_amqp_routing_key, SRVBUFLEN, purge->orig_amqp_routing_key, &amqp_host->rk_rr);
+          p_amqp_set_routing_key(amqp_host, dyn_amqp_routing_key);
         }
 
         Log(LOG_DEBUG, "DEBUG ( %s/%s ): %s\n\n", config.name, config.type, json_str);
-        ret = p_amqp_publish_string(&amqpp_amqp_host, json_str);
+        ret = p_amqp_publish_string(amqp_host, json_str);
 
 	if (config.sql_multi_values) {
 	  json_str = tmp_str;
@@ -583,7 +731,6 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 	  json_buf_off = strlen(json_buf);
         }
 
-        free(json_str);
         json_str = NULL;
 
         if (!ret) {
@@ -596,17 +743,17 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
     else if (config.message_broker_output & PRINT_OUTPUT_AVRO) {
 #ifdef WITH_AVRO
       if (!config.sql_multi_values || (mv_num >= config.sql_multi_values) || avro_buffer_full) {
-        if (is_routing_key_dyn) {
-          P_handle_table_dyn_strings(dyn_amqp_routing_key, SRVBUFLEN, orig_amqp_routing_key, queue[j]);
-          p_amqp_set_routing_key(&amqpp_amqp_host, dyn_amqp_routing_key);
+        if (purge->is_routing_key_dyn) {
+          P_handle_table_dyn_strings(dyn_amqp_routing_key, SRVBUFLEN, purge->orig_amqp_routing_key, queue[j]);
+          p_amqp_set_routing_key(amqp_host, dyn_amqp_routing_key);
         }
 
         if (config.amqp_routing_key_rr) {
-          P_handle_table_dyn_rr(dyn_amqp_routing_key, SRVBUFLEN, orig_amqp_routing_key, &amqpp_amqp_host.rk_rr);
-          p_amqp_set_routing_key(&amqpp_amqp_host, dyn_amqp_routing_key);
+          P_handle_table_dyn_rr(dyn_amqp_routing_key, SRVBUFLEN, purge->orig_amqp_routing_key, &amqp_host->rk_rr);
+          p_amqp_set_routing_key(amqp_host, dyn_amqp_routing_key);
         }
 
-        ret = p_amqp_publish_binary(&amqpp_amqp_host, avro_buf, avro_writer_tell(avro_writer));
+        ret = p_amqp_publish_binary(amqp_host, avro_buf, avro_writer_tell(avro_writer));
         avro_writer_reset(avro_writer);
         avro_buffer_full = FALSE;
         mv_num_save = mv_num;
@@ -624,7 +771,7 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
       if (json_buf && json_buf_off) {
 	/* no handling of dyn routing keys here: not compatible */
 	Log(LOG_DEBUG, "DEBUG ( %s/%s ): %s\n\n", config.name, config.type, json_buf);
-	ret = p_amqp_publish_string(&amqpp_amqp_host, json_buf);
+	ret = p_amqp_publish_string(amqp_host, json_buf);
 
 	if (!ret) qn += mv_num;
       }
@@ -632,8 +779,7 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
     else if (config.message_broker_output & PRINT_OUTPUT_AVRO) {
 #ifdef WITH_AVRO
       if (avro_writer_tell(avro_writer)) {
-        ret = p_amqp_publish_binary(&amqpp_amqp_host, avro_buf, avro_writer_tell(avro_writer));
-        avro_writer_free(avro_writer);
+        ret = p_amqp_publish_binary(amqp_host, avro_buf, avro_writer_tell(avro_writer));
 
         if (!ret) qn += mv_num;
       }
@@ -641,38 +787,18 @@ void amqp_cache_purge(struct chained_cache *queue[], int index, int safe_action)
     }
   }
 
-  duration = time(NULL)-start;
-
-  if (config.print_markers) {
-    if (config.message_broker_output & PRINT_OUTPUT_JSON || config.message_broker_output & PRINT_OUTPUT_AVRO) {
-      void *json_obj;
-      char *json_str;
-
-      json_obj = compose_purge_close_json(config.name, writer_pid, qn, saved_index, duration);
-
-      if (json_obj) json_str = compose_json_str(json_obj);
-      if (json_str) {
-        Log(LOG_DEBUG, "DEBUG ( %s/%s ): %s\n\n", config.name, config.type, json_str);
-        ret = p_amqp_publish_string(&amqpp_amqp_host, json_str);
-
-        free(json_str);
-        json_str = NULL;
-      }
-    }
-  }
-
-  p_amqp_close(&amqpp_amqp_host, FALSE);
-
-  Log(LOG_INFO, "INFO ( %s/%s ): *** Purging cache - END (PID: %u, QN: %u/%u, ET: %u) ***\n",
-		config.name, config.type, writer_pid, qn, saved_index, duration);
+  goto exit_lane;
 
-  if (config.sql_trigger_exec) P_trigger_exec(config.sql_trigger_exec); 
+  error:
+  worker->ret = ERR;
 
-  if (empty_pcust) free(empty_pcust);
+  exit_lane:
+  worker->qn = qn;
 
   if (json_buf) free(json_buf);
 
 #ifdef WITH_AVRO
+  if (avro_writer) avro_writer_free(avro_writer);
   if (avro_buf) free(avro_buf);
 #endif
 }
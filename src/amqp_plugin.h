@@ -27,6 +27,14 @@
 /* defines */
 
 /* structures */
+struct p_amqp_purge {
+  struct p_amqp_host host;
+  struct p_amqp_host *amqp_host;
+  char *orig_amqp_routing_key;
+  char *empty_pcust;
+  int is_routing_key_dyn;
+  pid_t writer_pid;
+};
 
 /* prototypes */
 #if (!defined __AMQP_PLUGIN_C)
@@ -37,6 +37,15 @@
 /* variables to be exported away */
 thread_pool_t *bgp_pool;
 
+/* BGP worker threads, see bgp_daemon_threads */
+static struct bgp_worker *bgp_workers;
+static int bgp_workers_num;
+#if defined ENABLE_THREADS
+static thread_pool_t *bgp_workers_pool;
+static pthread_mutex_t bgp_peers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t bgp_rib_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /* Functions */
 #if defined ENABLE_THREADS
 void nfacctd_bgp_wrapper()
@@ -63,13 +72,145 @@ void skinny_bgp_daemon()
     skinny_bgp_daemon_offline();
 }
 
+/* peers[] slots are shared between the acceptor and BGP workers */
+static void bgp_peers_lock()
+{
+#if defined ENABLE_THREADS
+  if (bgp_workers_num) pthread_mutex_lock(&bgp_peers_mutex);
+#endif
+}
+
+static void bgp_peers_unlock()
+{
+#if defined ENABLE_THREADS
+  if (bgp_workers_num) pthread_mutex_unlock(&bgp_peers_mutex);
+#endif
+}
+
+/*
+   Reads from a peer socket and processes complete messages; returns zero
+   if the session is to be kept up, ERR if it is to be closed silently or
+   the BGP NOTIFICATION error code to close it with otherwise.
+*/
+int bgp_peer_read(struct bgp_peer *peer, time_t now)
+{
+  char bgp_reply_pkt[BGP_BUFFER_SIZE], *bgp_reply_pkt_ptr;
+  int ret;
+
+  ret = recv(peer->fd, &peer->buf.base[peer->buf.truncated_len], (peer->buf.len - peer->buf.truncated_len), 0);
+  peer->msglen = (ret + peer->buf.truncated_len);
+
+  if (ret <= 0) {
+    Log(LOG_INFO, "INFO ( %s/%s ): [%s] BGP connection reset by peer (%d).\n", config.name, bgp_misc_db->log_str, bgp_peer_print(peer), errno);
+    return ERR;
+  }
+
+  /* Appears a valid peer with a valid BGP message: before
+     continuing let's see if it's time to send a KEEPALIVE
+     back */
+  if (peer->status == Established && ((now - peer->last_keepalive) > (peer->ht / 2))) {
+    bgp_reply_pkt_ptr = bgp_reply_pkt;
+    bgp_reply_pkt_ptr += bgp_write_keepalive_msg(bgp_reply_pkt_ptr);
+    ret = send(peer->fd, bgp_reply_pkt, bgp_reply_pkt_ptr - bgp_reply_pkt, 0);
+    peer->last_keepalive = now;
+  }
+
+  return bgp_parse_msg(peer, now, TRUE);
+}
+
+/* closes a session given the bgp_peer_read() outcome */
+void bgp_daemon_peer_close(struct bgp_peer *peer, int ret)
+{
+  bgp_peers_lock();
+
+  if (ret < 0) bgp_peer_close(peer, FUNC_TYPE_BGP, FALSE, FALSE, FALSE, FALSE, NULL);
+  else bgp_peer_close(peer, FUNC_TYPE_BGP, FALSE, TRUE, ret, BGP_NOTIFY_SUBCODE_UNSPECIFIC, NULL);
+
+  bgp_peers_unlock();
+}
+
+#if defined ENABLE_THREADS && defined HAVE_EPOLL_CREATE1
+void bgp_worker_loop(struct bgp_worker *bw)
+{
+  struct bgp_peer *peer;
+  int fd, ret, peers_idx;
+  time_t now;
+
+  for (;;) {
+    if (bgp_evloop_wait(&bw->evl, NULL) <= 0) continue;
+    now = time(NULL);
+
+    while ((fd = bgp_evloop_next(&bw->evl, (void **) &peer)) != ERR) {
+      /* new sessions handed over by the acceptor */
+      if (fd == bw->pipe[0]) {
+	while (read(fd, &peers_idx, sizeof(peers_idx)) == sizeof(peers_idx)) {
+	  peer = &peers[peers_idx];
+
+	  if (bgp_evloop_add(&bw->evl, peer->fd, peer) == ERR) {
+	    Log(LOG_ERR, "ERROR ( %s/%s ): Unable to watch BGP peer socket (errno: %d).\n", config.name, bgp_misc_db->log_str, errno);
+	    bgp_daemon_peer_close(peer, ERR);
+	  }
+	}
+
+	continue;
+      }
+
+      if (!peer || peer->fd != fd) continue;
+
+      ret = bgp_peer_read(peer, now);
+      if (ret) {
+	bgp_evloop_del(&bw->evl, fd);
+	bgp_daemon_peer_close(peer, ret);
+      }
+    }
+  }
+}
+
+int bgp_workers_init(int num)
+{
+  int idx;
+
+  bgp_workers = malloc(num * sizeof(struct bgp_worker));
+  if (!bgp_workers) return ERR;
+  memset(bgp_workers, 0, num * sizeof(struct bgp_worker));
+
+  for (idx = 0; idx < num; idx++) {
+    bgp_workers[idx].id = idx;
+
+    if (pipe(bgp_workers[idx].pipe) == ERR) return ERR;
+    if (fcntl(bgp_workers[idx].pipe[0], F_SETFL, O_NONBLOCK) == ERR) return ERR;
+
+    if (bgp_evloop_init(&bgp_workers[idx].evl, (config.nfacctd_bgp_max_peers / num + 1)) == ERR ||
+	bgp_evloop_add(&bgp_workers[idx].evl, bgp_workers[idx].pipe[0], NULL) == ERR) return ERR;
+  }
+
+  bgp_workers_pool = allocate_thread_pool(num);
+  if (!bgp_workers_pool) return ERR;
+
+  bgp_routing_db->lock = &bgp_rib_mutex;
+  bgp_workers_num = num;
+
+  for (idx = 0; idx < num; idx++) send_to_pool(bgp_workers_pool, bgp_worker_loop, &bgp_workers[idx]);
+
+  return SUCCESS;
+}
+#endif
+
+/* hands a new session over to a worker thread, round-robin on peers[] index */
+int bgp_worker_handoff(int peers_idx)
+{
+  struct bgp_worker *bw = &bgp_workers[peers_idx % bgp_workers_num];
+
+  if (write(bw->pipe[1], &peers_idx, sizeof(peers_idx)) != sizeof(peers_idx)) return ERR;
+
+  return SUCCESS;
+}
+
 void skinny_bgp_daemon_online()
 {
   int slen, ret, rc, peers_idx, allowed;
-  int peers_idx_rr = 0, max_peers_idx = 0;
   struct host_addr addr;
   struct bgp_peer *peer;
-  char bgp_reply_pkt[BGP_BUFFER_SIZE], *bgp_reply_pkt_ptr;
 #if defined ENABLE_IPV6
   struct sockaddr_storage server, client;
 #else
@@ -85,8 +226,8 @@ void skinny_bgp_daemon_online()
   struct bgp_peer_batch bp_batch;
 
   /* select() stuff */
-  fd_set read_descs, bkp_read_descs; 
-  int fd, select_fd, bkp_select_fd, recalc_fds, select_num;
+  struct bgp_evloop bgp_evl;
+  int fd, select_num;
 
   /* initial cleanups */
   reload_map_bgp_thread = FALSE;
@@ -256,16 +397,18 @@ void skinny_bgp_daemon_online()
     exit_all(1);
   }
 
-  rc = listen(config.bgp_sock, 1);
+  rc = listen(config.bgp_sock, SOMAXCONN);
   if (rc < 0) {
     Log(LOG_ERR, "ERROR ( %s/%s ): listen() failed (errno: %d).\n", config.name, bgp_misc_db->log_str, errno);
     exit_all(1);
   }
 
   /* Preparing for syncronous I/O multiplexing */
-  select_fd = 0;
-  FD_ZERO(&bkp_read_descs);
-  FD_SET(config.bgp_sock, &bkp_read_descs);
+  if (bgp_evloop_init(&bgp_evl, (config.nfacctd_bgp_max_peers + 1)) == ERR ||
+      bgp_evloop_add(&bgp_evl, config.bgp_sock, NULL) == ERR) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): I/O multiplexing setup failed (errno: %d).\n", config.name, bgp_misc_db->log_str, errno);
+    exit_all(1);
+  }
 
   {
     char srv_string[INET6_ADDRSTRLEN];
@@ -342,43 +485,45 @@ void skinny_bgp_daemon_online()
     if (config.bgp_table_dump_kafka_topic) bgp_table_dump_init_kafka_host();
   }
 
-  select_fd = bkp_select_fd = (config.bgp_sock + 1);
-  recalc_fds = FALSE;
-
   bgp_link_misc_structs(bgp_misc_db);
 
-  for (;;) {
-    select_again:
-
-    if (recalc_fds) { 
-      select_fd = config.bgp_sock;
-      max_peers_idx = -1; /* .. since valid indexes include 0 */
-
-      for (peers_idx = 0; peers_idx < config.nfacctd_bgp_max_peers; peers_idx++) {
-        if (select_fd < peers[peers_idx].fd) select_fd = peers[peers_idx].fd; 
-	if (peers[peers_idx].fd) max_peers_idx = peers_idx;
-      }
-      select_fd++;
-      max_peers_idx++;
-
-      bkp_select_fd = select_fd;
-      recalc_fds = FALSE;
+  if (config.nfacctd_bgp_threads > 1) {
+#if defined ENABLE_THREADS && defined HAVE_EPOLL_CREATE1
+    if (bgp_workers_init(config.nfacctd_bgp_threads) == ERR) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): Unable to start BGP worker threads (errno: %d). Terminating thread.\n", config.name, bgp_misc_db->log_str, errno);
+      exit_all(1);
     }
-    else select_fd = bkp_select_fd;
 
-    memcpy(&read_descs, &bkp_read_descs, sizeof(bkp_read_descs));
+    Log(LOG_INFO, "INFO ( %s/%s ): %d worker thread(s) initialized\n", config.name, bgp_misc_db->log_str, bgp_workers_num);
+#else
+    Log(LOG_WARNING, "WARN ( %s/%s ): 'bgp_daemon_threads' requires --enable-threads and epoll() support. Using 1.\n", config.name, bgp_misc_db->log_str);
+    config.nfacctd_bgp_threads = 1;
+#endif
+  }
+
+  for (;;) {
+    select_again:
 
     if (bgp_misc_db->dump_backend_methods) {
       int delta;
 
-      calc_refresh_timeout_sec(dump_refresh_deadline, bgp_misc_db->log_tstamp.tv_sec, &delta);
-      dump_refresh_timeout.tv_sec = delta;
-      dump_refresh_timeout.tv_usec = 0;
+      /* a table dump in progress is carried on in between reads; a short
+	 wait, rather than a zero one, keeps the thread from busy looping */
+      if (bgp_misc_db->table_dump && bgp_misc_db->table_dump->active) {
+	dump_refresh_timeout.tv_sec = 0;
+	dump_refresh_timeout.tv_usec = (BGP_TABLE_DUMP_PAUSE * 1000);
+      }
+      else {
+	calc_refresh_timeout_sec(dump_refresh_deadline, bgp_misc_db->log_tstamp.tv_sec, &delta);
+	dump_refresh_timeout.tv_sec = delta;
+	dump_refresh_timeout.tv_usec = 0;
+      }
+
       drt_ptr = &dump_refresh_timeout;
     }
     else drt_ptr = NULL;
 
-    select_num = select(select_fd, &read_descs, NULL, NULL, drt_ptr);
+    select_num = bgp_evloop_wait(&bgp_evl, drt_ptr);
     if (select_num < 0) goto select_again;
     now = time(NULL);
 
@@ -395,6 +540,8 @@ void skinny_bgp_daemon_online()
     }
 
     if (reload_log_bgp_thread) {
+      bgp_rib_lock(bgp_routing_db);
+
       for (peers_idx = 0; peers_idx < config.nfacctd_bgp_max_peers; peers_idx++) {
 	if (bgp_misc_db->peers_log[peers_idx].fd) {
 	  fclose(bgp_misc_db->peers_log[peers_idx].fd);
@@ -404,23 +551,46 @@ void skinny_bgp_daemon_online()
 	else break;
       }
 
+      bgp_rib_unlock(bgp_routing_db);
       reload_log_bgp_thread = FALSE;
     }
 
     if (bgp_misc_db->msglog_backend_methods || bgp_misc_db->dump_backend_methods) {
+      bgp_rib_lock(bgp_routing_db);
       gettimeofday(&bgp_misc_db->log_tstamp, NULL);
       compose_timestamp(bgp_misc_db->log_tstamp_str, SRVBUFLEN, &bgp_misc_db->log_tstamp, TRUE, config.timestamps_since_epoch);
+      bgp_rib_unlock(bgp_routing_db);
 
       if (bgp_misc_db->dump_backend_methods) {
 	while (bgp_misc_db->log_tstamp.tv_sec > dump_refresh_deadline) {
-	  bgp_misc_db->dump.tstamp.tv_sec = dump_refresh_deadline;
-	  bgp_misc_db->dump.tstamp.tv_usec = 0;
-	  compose_timestamp(bgp_misc_db->dump.tstamp_str, SRVBUFLEN, &bgp_misc_db->dump.tstamp, FALSE, config.timestamps_since_epoch);
-	  bgp_misc_db->dump.period = config.bgp_table_dump_refresh_time;
+	  if (bgp_misc_db->table_dump && bgp_misc_db->table_dump->active) {
+	    Log(LOG_WARNING, "WARN ( %s/%s ): BGP tables dump (%s) still in progress, skipping the next one\n",
+		config.name, bgp_misc_db->log_str, bgp_misc_db->dump.tstamp_str);
+	  }
+	  else {
+	    bgp_misc_db->dump.tstamp.tv_sec = dump_refresh_deadline;
+	    bgp_misc_db->dump.tstamp.tv_usec = 0;
+	    compose_timestamp(bgp_misc_db->dump.tstamp_str, SRVBUFLEN, &bgp_misc_db->dump.tstamp, FALSE, config.timestamps_since_epoch);
+	    bgp_misc_db->dump.period = config.bgp_table_dump_refresh_time;
+
+	    bgp_peers_lock();
+	    bgp_rib_lock(bgp_routing_db);
+	    bgp_handle_dump_event();
+	    bgp_rib_unlock(bgp_routing_db);
+	    bgp_peers_unlock();
+	  }
 
-	  bgp_handle_dump_event();
 	  dump_refresh_deadline += config.bgp_table_dump_refresh_time;
 	}
+
+	/* locks are held for one slice at a time only */
+	if (bgp_misc_db->table_dump && bgp_misc_db->table_dump->active) {
+	  bgp_peers_lock();
+	  bgp_rib_lock(bgp_routing_db);
+	  bgp_table_dump_slice();
+	  bgp_rib_unlock(bgp_routing_db);
+	  bgp_peers_unlock();
+	}
       }
 
 #ifdef WITH_RABBITMQ
@@ -451,8 +621,14 @@ void skinny_bgp_daemon_online()
     */ 
     if (!select_num) goto select_again;
 
+    /* Dispatching ready sockets, each one once per wakeup */
+    read_data:
+
+    fd = bgp_evloop_next(&bgp_evl, (void **) &peer);
+    if (fd == ERR) goto select_again;
+
     /* New connection is coming in */ 
-    if (FD_ISSET(config.bgp_sock, &read_descs)) {
+    if (fd == config.bgp_sock) {
       int peers_check_idx, peers_num;
 
       fd = accept(config.bgp_sock, (struct sockaddr *) &client, &clen);
@@ -471,6 +647,8 @@ void skinny_bgp_daemon_online()
         goto read_data;
       }
 
+      bgp_peers_lock();
+
       for (peer = NULL, peers_idx = 0; peers_idx < config.nfacctd_bgp_max_peers; peers_idx++) {
         if (!peers[peers_idx].fd) {
 	  /*
@@ -482,7 +660,6 @@ void skinny_bgp_daemon_online()
           if (bgp_batch_is_admitted(&bp_batch, now)) {
             peer = &peers[peers_idx];
             if (bgp_peer_init(peer, FUNC_TYPE_BGP)) peer = NULL;
-	    else recalc_fds = TRUE;
 
             log_notification_unset(&log_notifications.bgp_peers_throttling);
 
@@ -501,7 +678,7 @@ void skinny_bgp_daemon_online()
 	    }
 
             close(fd);
-            goto read_data;
+            goto accept_done;
           }
         }
 	/* XXX: replenish sessions with expired keepalives */
@@ -513,11 +690,15 @@ void skinny_bgp_daemon_online()
 			config.name, bgp_misc_db->log_str, config.nfacctd_bgp_max_peers);
 
 	close(fd);
-	goto read_data;
+	goto accept_done;
       }
 
       peer->fd = fd;
-      FD_SET(peer->fd, &bkp_read_descs);
+      if (!bgp_workers_num && bgp_evloop_add(&bgp_evl, peer->fd, peer) == ERR) {
+        Log(LOG_ERR, "ERROR ( %s/%s ): Unable to watch BGP peer socket (errno: %d).\n", config.name, bgp_misc_db->log_str, errno);
+        bgp_peer_close(peer, FUNC_TYPE_BGP, FALSE, FALSE, FALSE, FALSE, NULL);
+        goto accept_done;
+      }
       peer->addr.family = ((struct sockaddr *)&client)->sa_family;
       if (peer->addr.family == AF_INET) {
 	peer->addr.address.ipv4.s_addr = ((struct sockaddr_in *)&client)->sin_addr.s_addr;
@@ -530,8 +711,11 @@ void skinny_bgp_daemon_online()
       }
 #endif
 
-      if (bgp_misc_db->msglog_backend_methods)
+      if (bgp_misc_db->msglog_backend_methods) {
+	bgp_rib_lock(bgp_routing_db);
 	bgp_peer_log_init(peer, config.nfacctd_bgp_msglog_output, FUNC_TYPE_BGP);
+	bgp_rib_unlock(bgp_routing_db);
+      }
 
       /* Check: only one TCP connection is allowed per peer */
       /* XXX: fixme for NAT traversal scenarios */
@@ -540,79 +724,54 @@ void skinny_bgp_daemon_online()
 	  if ((now - peers[peers_check_idx].last_keepalive) > peers[peers_check_idx].ht) {
             Log(LOG_INFO, "INFO ( %s/%s ): [%s] Replenishing stale connection by peer.\n",
 				config.name, bgp_misc_db->log_str, bgp_peer_print(&peers[peers_check_idx]));
-            FD_CLR(peers[peers_check_idx].fd, &bkp_read_descs);
-            bgp_peer_close(&peers[peers_check_idx], FUNC_TYPE_BGP, FALSE, FALSE, FALSE, FALSE, NULL);
+	    /* a stale session owned by a worker is closed by the worker itself */
+	    if (bgp_workers_num) shutdown(peers[peers_check_idx].fd, SHUT_RDWR);
+	    else {
+              bgp_evloop_del(&bgp_evl, peers[peers_check_idx].fd);
+              bgp_peer_close(&peers[peers_check_idx], FUNC_TYPE_BGP, FALSE, FALSE, FALSE, FALSE, NULL);
+	    }
 	  }
 	  else {
 	    Log(LOG_ERR, "ERROR ( %s/%s ): [%s] Refusing new connection from existing peer (residual holdtime: %u).\n",
 				config.name, bgp_misc_db->log_str, bgp_peer_print(&peers[peers_check_idx]),
 				(peers[peers_check_idx].ht - (now - peers[peers_check_idx].last_keepalive)));
-	    FD_CLR(peer->fd, &bkp_read_descs);
+	    if (!bgp_workers_num) bgp_evloop_del(&bgp_evl, peer->fd);
 	    bgp_peer_close(peer, FUNC_TYPE_BGP, FALSE, FALSE, FALSE, FALSE, NULL);
 	    // bgp_batch_rollback(&bp_batch);
-	    goto read_data;
+	    goto accept_done;
 	  }
         }
 	else if (peers[peers_check_idx].fd) peers_num++;
       }
 
+      if (bgp_workers_num && bgp_worker_handoff(peers_idx) == ERR) {
+        Log(LOG_ERR, "ERROR ( %s/%s ): [%s] Unable to hand BGP peer over to a worker thread (errno: %d).\n",
+			config.name, bgp_misc_db->log_str, bgp_peer_print(peer), errno);
+        bgp_peer_close(peer, FUNC_TYPE_BGP, FALSE, FALSE, FALSE, FALSE, NULL);
+        goto accept_done;
+      }
+
       Log(LOG_INFO, "INFO ( %s/%s ): [%s] BGP peers usage: %u/%u\n", config.name, bgp_misc_db->log_str,
 		bgp_peer_print(peer), peers_num, config.nfacctd_bgp_max_peers);
 
       if (config.nfacctd_bgp_neighbors_file) write_neighbors_file(config.nfacctd_bgp_neighbors_file, FUNC_TYPE_BGP);
-    }
-
-    read_data:
 
-    /*
-       We have something coming in: let's lookup which peer is that.
-       FvD: To avoid starvation of the "later established" peers, we
-       offset the start of the search in a round-robin style.
-    */
-    for (peer = NULL, peers_idx = 0; peers_idx < max_peers_idx; peers_idx++) {
-      int loc_idx = (peers_idx + peers_idx_rr) % max_peers_idx;
-
-      if (peers[loc_idx].fd && FD_ISSET(peers[loc_idx].fd, &read_descs)) {
-        peer = &peers[loc_idx];
-        peers_idx_rr = (peers_idx_rr + 1) % max_peers_idx;
-	break;
-      }
-    } 
-
-    if (!peer) goto select_again;
+      accept_done:
+      bgp_peers_unlock();
 
-    ret = recv(peer->fd, &peer->buf.base[peer->buf.truncated_len], (peer->buf.len - peer->buf.truncated_len), 0);
-    peer->msglen = (ret + peer->buf.truncated_len);
-
-    if (ret <= 0) {
-      Log(LOG_INFO, "INFO ( %s/%s ): [%s] BGP connection reset by peer (%d).\n", config.name, bgp_misc_db->log_str, bgp_peer_print(peer), errno);
-      FD_CLR(peer->fd, &bkp_read_descs);
-      bgp_peer_close(peer, FUNC_TYPE_BGP, FALSE, FALSE, FALSE, FALSE, NULL);
-      recalc_fds = TRUE;
-      goto select_again;
+      goto read_data;
     }
-    else {
-      /* Appears a valid peer with a valid BGP message: before
-	 continuing let's see if it's time to send a KEEPALIVE
-	 back */
-      if (peer->status == Established && ((now - peer->last_keepalive) > (peer->ht / 2))) {
-        bgp_reply_pkt_ptr = bgp_reply_pkt;
-        bgp_reply_pkt_ptr += bgp_write_keepalive_msg(bgp_reply_pkt_ptr);
-        ret = send(peer->fd, bgp_reply_pkt, bgp_reply_pkt_ptr - bgp_reply_pkt, 0);
-	peer->last_keepalive = now;
-      } 
-
-      ret = bgp_parse_msg(peer, now, TRUE);
-      if (ret) {
-        FD_CLR(peer->fd, &bkp_read_descs);
 
-	if (ret < 0) bgp_peer_close(peer, FUNC_TYPE_BGP, FALSE, FALSE, FALSE, FALSE, NULL);
-	else bgp_peer_close(peer, FUNC_TYPE_BGP, FALSE, TRUE, ret, BGP_NOTIFY_SUBCODE_UNSPECIFIC, NULL);
+    /* We have something coming in: the peer is known straight from its fd */
+    if (!peer || peer->fd != fd) goto read_data;
 
-        recalc_fds = TRUE;
-        goto select_again;
-      }
+    ret = bgp_peer_read(peer, now);
+    if (ret) {
+      bgp_evloop_del(&bgp_evl, peer->fd);
+      bgp_daemon_peer_close(peer, ret);
     }
+
+    goto read_data;
   }
 }
 
@@ -21,6 +21,12 @@
 
 /* includes */
 #include <sys/poll.h>
+#if defined HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+#endif
+#if defined ENABLE_THREADS
+#include <pthread.h>
+#endif
 #include "bgp_prefix.h"
 #include "bgp_packet.h"
 #include "bgp_table.h"
@@ -102,6 +108,11 @@ struct bgp_rt_structs {
   struct hash *ecomhash;
   struct hash *lcomhash;
   struct bgp_table *rib[AFI_MAX][SAFI_MAX];
+  struct bgp_rib_limbo limbo;
+  u_int32_t gen; /* bumped by each table dump */
+#if defined ENABLE_THREADS
+  pthread_mutex_t *lock; /* set when more than one thread updates RIB and hashes */
+#endif
 };
 
 struct bgp_misc_structs {
@@ -110,6 +121,7 @@ struct bgp_misc_structs {
   struct timeval log_tstamp;
   char log_tstamp_str[SRVBUFLEN];
   struct bgp_dump_event dump;
+  struct bgp_table_dump *table_dump;
   char *peer_str; /* "bmp_router", "peer_src_ip", "peer_ip", etc. */
   char *peer_port_str; /* "bmp_router_port", "peer_src_ip_port", etc. */
   char *log_str; /* BGP, BMP, thread, daemon, etc. */
@@ -148,9 +160,11 @@ struct bgp_misc_structs {
   int table_per_peer_buckets;
   int table_attr_hash_buckets;
   int table_per_peer_hash;
+  int table_per_peer_index;
   u_int32_t (*route_info_modulo)(struct bgp_peer *, path_id_t *, int);
   struct bgp_peer *(*bgp_lookup_find_peer)(struct sockaddr *, struct xflow_status_entry *, u_int16_t, int);
   int (*bgp_lookup_node_match_cmp)(struct bgp_info *, struct node_match_cmp_term2 *);
+  struct bgp_peer *(*bgp_lookup_index_peer)(struct bgp_peer *);
 
   int msglog_backend_methods;
   int dump_backend_methods;
@@ -192,6 +206,10 @@ struct bgp_peer {
   struct bgp_peer_buf buf;
   struct bgp_peer_log *log;
 
+  /* per-(afi, safi) index of the RIB nodes holding paths of this peer,
+     see [bgp|bmp]_table_per_peer_index */
+  struct bgp_peer_rib **rib_index;
+
   /*
      bmp_peer.self.bmp_se:		pointer to struct bmp_dump_se_ll
      bmp_peer.bgp_peers[n].bmp_se:	backpointer to parent struct bmp_peer
@@ -219,6 +237,32 @@ struct bgp_peer_batch {
   int interval;
 };
 
+/* sockets readiness for the BGP, BMP and telemetry daemons: epoll()
+   where available, select() otherwise; 'ptr' maps a fd to its peer */
+struct bgp_evloop {
+  void **ptr;
+  int ptr_max;
+  int ready_idx;
+  int ready_num;
+#if defined HAVE_EPOLL_CREATE1
+  int epfd;
+  struct epoll_event *ready;
+  int ready_max;
+#else
+  fd_set read_descs;
+  fd_set bkp_read_descs;
+  int max_fd;
+#endif
+};
+
+/* BGP daemon worker threads (bgp_daemon_threads): peers are handed over
+   by the acceptor, as indexes in peers[], via 'pipe' */
+struct bgp_worker {
+  int id;
+  int pipe[2];
+  struct bgp_evloop evl;
+};
+
 struct bgp_nlri {
   afi_t afi;
   safi_t safi;
@@ -263,6 +307,13 @@ EXT void nfacctd_bgp_wrapper();
 EXT void skinny_bgp_daemon();
 EXT void skinny_bgp_daemon_online();
 EXT void skinny_bgp_daemon_offline();
+EXT int bgp_peer_read(struct bgp_peer *, time_t);
+EXT void bgp_daemon_peer_close(struct bgp_peer *, int);
+EXT int bgp_worker_handoff(int);
+#if defined ENABLE_THREADS && defined HAVE_EPOLL_CREATE1
+EXT void bgp_worker_loop(struct bgp_worker *);
+EXT int bgp_workers_init(int);
+#endif
 EXT void bgp_prepare_thread();
 EXT void bgp_prepare_daemon();
 
@@ -365,7 +365,7 @@ aspath_unintern(struct bgp_peer *peer, struct aspath *aspath)
     /* This aspath must exist in aspath hash table. */
     ret = hash_release(inter_domain_routing_db->ashash, aspath);
     assert (ret != NULL);
-    aspath_free (aspath);
+    bgp_rib_retire (inter_domain_routing_db, aspath, (void (*)(void *)) aspath_free);
   }
 }
 
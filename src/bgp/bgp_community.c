@@ -386,7 +386,7 @@ community_unintern (struct bgp_peer *peer, struct community *com)
     ret = (struct community *) hash_release(inter_domain_routing_db->comhash, com);
     assert (ret != NULL);
 
-    community_free (com);
+    bgp_rib_retire (inter_domain_routing_db, com, (void (*)(void *)) community_free);
   }
 }
 
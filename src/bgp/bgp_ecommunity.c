@@ -212,7 +212,7 @@ ecommunity_unintern (struct bgp_peer *peer, struct ecommunity *ecom)
     ret = (struct ecommunity *) hash_release(inter_domain_routing_db->ecomhash, ecom);
     assert (ret != NULL);
 
-    ecommunity_free(ecom);
+    bgp_rib_retire (inter_domain_routing_db, ecom, (void (*)(void *)) ecommunity_free);
   }
 }
 
@@ -209,7 +209,7 @@ lcommunity_unintern (struct bgp_peer *peer, struct lcommunity *lcom)
     ret = (struct lcommunity *) hash_release(inter_domain_routing_db->lcomhash, lcom);
     assert (ret != NULL);
 
-    lcommunity_free(lcom);
+    bgp_rib_retire (inter_domain_routing_db, lcom, (void (*)(void *)) lcommunity_free);
   }
 }
 
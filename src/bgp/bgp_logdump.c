@@ -569,185 +569,375 @@ int bgp_peer_dump_close(struct bgp_peer *peer, struct bgp_dump_stats *bds, int o
   return (ret | amqp_ret | kafka_ret);
 }
 
-void bgp_handle_dump_event()
+/* Order of two prefixes of the same table in a bgp_route_next() walk */
+static int bgp_table_dump_node_cmp(struct prefix *a, struct prefix *b)
 {
-  struct bgp_misc_structs *bms = bgp_select_misc_db(FUNC_TYPE_BGP);
-  char current_filename[SRVBUFLEN], last_filename[SRVBUFLEN], tmpbuf[SRVBUFLEN];
-  char latest_filename[SRVBUFLEN], event_type[] = "dump", *fd_buf = NULL;
-  int ret, peers_idx, duration, tables_num;
-  struct bgp_rt_structs *inter_domain_routing_db;
-  struct bgp_peer *peer, *saved_peer;
-  struct bgp_table *table;
-  struct bgp_node *node;
-  struct bgp_peer_log peer_log;
-  struct bgp_dump_stats bds;
-  afi_t afi;
-  safi_t safi;
-  pid_t dumper_pid;
-  time_t start;
-  u_int64_t dump_elems;
+  u_char *pa = (u_char *) &a->u.prefix, *pb = (u_char *) &b->u.prefix;
+  int len = MIN(a->prefixlen, b->prefixlen), idx;
+  u_char mask;
 
-  /* pre-flight check */
-  if (!bms->dump_backend_methods || !config.bgp_table_dump_refresh_time)
-    return;
+  for (idx = 0; idx < (len / 8); idx++) {
+    if (pa[idx] != pb[idx]) return (pa[idx] < pb[idx] ? -1 : 1);
+  }
+
+  if (len % 8) {
+    mask = (0xff << (8 - (len % 8)));
+    if ((pa[idx] & mask) != (pb[idx] & mask)) return ((pa[idx] & mask) < (pb[idx] & mask) ? -1 : 1);
+  }
 
-  switch (ret = fork()) {
-  case 0: /* Child */
-    /* we have to ignore signals to avoid loops: because we are already forked */
-    signal(SIGINT, SIG_IGN);
-    signal(SIGHUP, SIG_IGN);
-    pm_setproctitle("%s %s [%s]", config.type, "Core Process -- BGP Dump Writer", config.name, bms->log_str);
-    memset(last_filename, 0, sizeof(last_filename));
-    memset(current_filename, 0, sizeof(current_filename));
-    memset(&peer_log, 0, sizeof(struct bgp_peer_log));
-    memset(&bds, 0, sizeof(struct bgp_dump_stats));
-    fd_buf = malloc(OUTPUT_FILE_BUFSZ);
+  return (a->prefixlen - b->prefixlen);
+}
 
-#ifdef WITH_RABBITMQ
-    if (config.bgp_table_dump_amqp_routing_key) {
-      bgp_table_dump_init_amqp_host();
-      ret = p_amqp_connect_to_publish(&bgp_table_dump_amqp_host);
-      if (ret) exit(ret);
+static int bgp_table_dump_visited(struct bgp_table_dump *btd, struct bgp_node *rn)
+{
+  afi_t afi = rn->table->afi;
+  safi_t safi = rn->table->safi;
+
+  if (afi != btd->afi) return (afi < btd->afi);
+  if (safi != btd->safi) return (safi < btd->safi);
+  if (!btd->node) return TRUE;
+
+  return (bgp_table_dump_node_cmp(&rn->p, &btd->node->p) < 0);
+}
+
+static void bgp_table_dump_entry(struct bgp_table_dump *btd, struct bgp_node *node, struct bgp_info *ri, afi_t afi, safi_t safi)
+{
+  struct bgp_peer_log *saved_log = ri->peer->log;
+  char event_type[] = "dump";
+
+  /* the peer may be logging its messages meanwhile */
+  ri->peer->log = &btd->peer_log;
+  bgp_peer_log_msg(node, ri, afi, safi, event_type, config.bgp_table_dump_output, BGP_LOG_TYPE_MISC);
+  ri->peer->log = saved_log;
+
+  btd->bds.entries++;
+  btd->entries++;
+}
+
+static void bgp_table_dump_preimages_free(struct bgp_table_dump *btd, int peers_idx, int dump)
+{
+  struct bgp_dump_preimage *bdp, *bdp_next;
+
+  for (bdp = btd->preimages[peers_idx]; bdp; bdp = bdp_next) {
+    bdp_next = bdp->next;
+
+    if (dump) bgp_table_dump_entry(btd, &bdp->node, &bdp->ri, bdp->afi, bdp->safi);
+    if (bdp->ri.attr) bgp_attr_unintern(bdp->ri.peer, bdp->ri.attr);
+    free(bdp);
+  }
+
+  btd->preimages[peers_idx] = NULL;
+}
+
+/* Keep the former version of a path the dump did not get to yet; to be
+   called before the path is changed or deleted */
+void bgp_table_dump_preserve(struct bgp_peer *peer, struct bgp_node *rn, struct bgp_info *ri)
+{
+  struct bgp_misc_structs *bms = bgp_select_misc_db(peer->type);
+  struct bgp_table_dump *btd;
+  struct bgp_dump_preimage *bdp;
+  int peers_idx;
+
+  if (!bms || !(btd = bms->table_dump) || !btd->active) return;
+
+  /* changed already since the dump started */
+  if (ri->gen > btd->gen) return;
+
+  peers_idx = (ri->peer - peers);
+  if (!btd->peers[peers_idx]) return;
+  if (btd->peer == ri->peer && bgp_table_dump_visited(btd, rn)) return;
+
+  bdp = malloc(sizeof(struct bgp_dump_preimage));
+  if (!bdp) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (bgp_table_dump_preserve). Exiting ..\n", config.name, bms->log_str);
+    exit_all(1);
+  }
+  else memset(bdp, 0, sizeof(struct bgp_dump_preimage));
+
+  memcpy(&bdp->node.p, &rn->p, sizeof(struct prefix));
+  bdp->ri.peer = ri->peer;
+  if (ri->attr) bdp->ri.attr = bgp_attr_intern(ri->peer, ri->attr);
+  if (ri->extra) {
+    memcpy(&bdp->extra, ri->extra, sizeof(struct bgp_info_extra));
+    memset(&bdp->extra.bmed, 0, sizeof(struct bgp_msg_extra_data));
+    bdp->ri.extra = &bdp->extra;
+  }
+  bdp->afi = rn->table->afi;
+  bdp->safi = rn->table->safi;
+
+  bdp->next = btd->preimages[peers_idx];
+  btd->preimages[peers_idx] = bdp;
+}
+
+static void bgp_table_dump_peer_begin(struct bgp_table_dump *btd, struct bgp_peer *peer)
+{
+  struct bgp_misc_structs *bms = bgp_select_misc_db(FUNC_TYPE_BGP);
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(FUNC_TYPE_BGP);
+  struct bgp_peer_log *saved_log;
+  char tmpbuf[SRVBUFLEN];
+
+  if (config.bgp_table_dump_file)
+    bgp_peer_log_dynname(btd->current_filename, SRVBUFLEN, config.bgp_table_dump_file, peer);
+
+  if (config.bgp_table_dump_amqp_routing_key)
+    bgp_peer_log_dynname(btd->current_filename, SRVBUFLEN, config.bgp_table_dump_amqp_routing_key, peer);
+
+  if (config.bgp_table_dump_kafka_topic)
+    bgp_peer_log_dynname(btd->current_filename, SRVBUFLEN, config.bgp_table_dump_kafka_topic, peer);
+
+  strftime_same(btd->current_filename, SRVBUFLEN, tmpbuf, &bms->dump.tstamp.tv_sec);
+
+  /*
+     we close last_filename and open current_filename in case they differ;
+     we are safe with this approach until $peer_src_ip is the only variable
+     supported as part of bgp_table_dump_file configuration directive.
+  */
+  if (config.bgp_table_dump_file) {
+    if (strcmp(btd->last_filename, btd->current_filename)) {
+      if (btd->peer_log.fd) {
+	close_output_file(btd->peer_log.fd);
+	btd->peer_log.fd = NULL;
+
+	if (config.bgp_table_dump_latest_file)
+	  link_latest_output_file(btd->latest_filename, btd->last_filename);
+      }
+
+      btd->peer_log.fd = open_output_file(btd->current_filename, "w", TRUE);
+      if (btd->peer_log.fd && btd->fd_buf) {
+	if (setvbuf(btd->peer_log.fd, btd->fd_buf, _IOFBF, OUTPUT_FILE_BUFSZ))
+	  Log(LOG_WARNING, "WARN ( %s/%s ): [%s] setvbuf() failed: %s\n", config.name, bms->log_str, btd->current_filename, strerror(errno));
+      }
     }
+  }
+
+#ifdef WITH_RABBITMQ
+  if (config.bgp_table_dump_amqp_routing_key) {
+    btd->peer_log.amqp_host = &bgp_table_dump_amqp_host;
+    strcpy(btd->peer_log.filename, btd->current_filename);
+  }
 #endif
 
 #ifdef WITH_KAFKA
-    if (config.bgp_table_dump_kafka_topic) {
-      ret = bgp_table_dump_init_kafka_host();
-      if (ret) exit(ret);
-    }
+  if (config.bgp_table_dump_kafka_topic) {
+    btd->peer_log.kafka_host = &bgp_table_dump_kafka_host;
+    strcpy(btd->peer_log.filename, btd->current_filename);
+  }
 #endif
 
-    dumper_pid = getpid();
-    Log(LOG_INFO, "INFO ( %s/%s ): *** Dumping BGP tables - START (PID: %u) ***\n", config.name, bms->log_str, dumper_pid);
-    start = time(NULL);
-    tables_num = 0;
-
-    for (peer = NULL, saved_peer = NULL, peers_idx = 0; peers_idx < config.nfacctd_bgp_max_peers; peers_idx++) {
-      if (peers[peers_idx].fd) {
-        peer = &peers[peers_idx];
-	peer->log = &peer_log; /* abusing struct bgp_peer a bit, but we are in a child */
-
-	if (config.bgp_table_dump_file)
-	  bgp_peer_log_dynname(current_filename, SRVBUFLEN, config.bgp_table_dump_file, peer);
-
-	if (config.bgp_table_dump_amqp_routing_key)
-	  bgp_peer_log_dynname(current_filename, SRVBUFLEN, config.bgp_table_dump_amqp_routing_key, peer);
-
-	if (config.bgp_table_dump_kafka_topic)
-	  bgp_peer_log_dynname(current_filename, SRVBUFLEN, config.bgp_table_dump_kafka_topic, peer);
-
-	strftime_same(current_filename, SRVBUFLEN, tmpbuf, &bms->dump.tstamp.tv_sec);
-
-	/*
-	   we close last_filename and open current_filename in case they differ;
-	   we are safe with this approach until $peer_src_ip is the only variable
-	   supported as part of bgp_table_dump_file configuration directive.
-        */
-	if (config.bgp_table_dump_file) {
-	  if (strcmp(last_filename, current_filename)) {
-	    if (saved_peer && saved_peer->log && strlen(last_filename)) {
-	      close_output_file(saved_peer->log->fd);
-
-	      if (config.bgp_table_dump_latest_file) {
-		bgp_peer_log_dynname(latest_filename, SRVBUFLEN, config.bgp_table_dump_latest_file, saved_peer);
-		link_latest_output_file(latest_filename, last_filename);
-	      }
-	    }
-	    peer->log->fd = open_output_file(current_filename, "w", TRUE);
-	    if (fd_buf) {
-	      if (setvbuf(peer->log->fd, fd_buf, _IOFBF, OUTPUT_FILE_BUFSZ))
-		Log(LOG_WARNING, "WARN ( %s/%s ): [%s] setvbuf() failed: %s\n", config.name, bms->log_str, current_filename, errno);
-	      else memset(fd_buf, 0, OUTPUT_FILE_BUFSZ); 
-	    }
-	  }
-	}
+  saved_log = peer->log;
+  peer->log = &btd->peer_log;
+  bgp_peer_dump_init(peer, config.bgp_table_dump_output, FUNC_TYPE_BGP);
+  peer->log = saved_log;
+
+  btd->peer = peer;
+  btd->bds.entries = 0;
+  btd->afi = AFI_IP;
+  btd->safi = SAFI_UNICAST;
+  btd->node = bgp_table_top(peer, inter_domain_routing_db->rib[btd->afi][btd->safi]);
+}
+
+static void bgp_table_dump_peer_end(struct bgp_table_dump *btd)
+{
+  struct bgp_peer *peer = btd->peer;
+  struct bgp_peer_log *saved_log;
+
+  bgp_table_dump_preimages_free(btd, btd->peers_idx, TRUE);
+  btd->bds.tables++;
+
+  saved_log = peer->log;
+  peer->log = &btd->peer_log;
+  bgp_peer_dump_close(peer, &btd->bds, config.bgp_table_dump_output, FUNC_TYPE_BGP);
+  peer->log = saved_log;
+
+  strlcpy(btd->last_filename, btd->current_filename, SRVBUFLEN);
+  if (config.bgp_table_dump_latest_file)
+    bgp_peer_log_dynname(btd->latest_filename, SRVBUFLEN, config.bgp_table_dump_latest_file, peer);
+
+  btd->peers[btd->peers_idx] = FALSE;
+  btd->peers_idx++;
+  btd->peer = NULL;
+}
+
+static void bgp_table_dump_end(struct bgp_table_dump *btd)
+{
+  struct bgp_misc_structs *bms = bgp_select_misc_db(FUNC_TYPE_BGP);
+  struct timeval end;
+  u_int64_t elapsed, rate;
 
-	/*
-	   a bit pedantic maybe but should come at little cost and emulating
-	   bgp_table_dump_file behaviour will work
-	*/ 
 #ifdef WITH_RABBITMQ
-	if (config.bgp_table_dump_amqp_routing_key) {
-	  peer->log->amqp_host = &bgp_table_dump_amqp_host;
-	  strcpy(peer->log->filename, current_filename);
-	}
+  if (config.bgp_table_dump_amqp_routing_key)
+    p_amqp_close(&bgp_table_dump_amqp_host, FALSE);
 #endif
 
 #ifdef WITH_KAFKA
-	if (config.bgp_table_dump_kafka_topic) {
-	  peer->log->kafka_host = &bgp_table_dump_kafka_host;
-	  strcpy(peer->log->filename, current_filename);
-	}
+  if (config.bgp_table_dump_kafka_topic)
+    p_kafka_close(&bgp_table_dump_kafka_host, FALSE);
 #endif
 
-	bgp_peer_dump_init(peer, config.bgp_table_dump_output, FUNC_TYPE_BGP);
-        inter_domain_routing_db = bgp_select_routing_db(FUNC_TYPE_BGP);
-	dump_elems = 0;
+  if (btd->peer_log.fd) {
+    close_output_file(btd->peer_log.fd);
+    btd->peer_log.fd = NULL;
+  }
+
+  if (config.bgp_table_dump_latest_file && strlen(btd->last_filename))
+    link_latest_output_file(btd->latest_filename, btd->last_filename);
+
+  gettimeofday(&end, NULL);
+  elapsed = ((end.tv_sec - btd->start.tv_sec) * 1000000 + end.tv_usec - btd->start.tv_usec);
+  rate = (elapsed ? (btd->entries * 1000000 / elapsed) : btd->entries);
+
+  Log(LOG_INFO, "INFO ( %s/%s ): *** Dumping BGP tables - END (TABLES: %u, ENTRIES: %llu, ET: %llu.%03llu, RATE: %llu/s) ***\n",
+	config.name, bms->log_str, btd->bds.tables, (unsigned long long) btd->entries, (unsigned long long) (elapsed / 1000000),
+	(unsigned long long) ((elapsed % 1000000) / 1000), (unsigned long long) rate);
+
+  btd->active = FALSE;
+}
+
+/* Dump bounded by BGP_TABLE_DUMP_SLICE nodes; to be called under the RIB lock */
+void bgp_table_dump_slice()
+{
+  struct bgp_misc_structs *bms = bgp_select_misc_db(FUNC_TYPE_BGP);
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(FUNC_TYPE_BGP);
+  struct bgp_table_dump *btd = bms->table_dump;
+  struct bgp_node *node;
+  struct bgp_info *ri;
+  u_int32_t modulo, peer_buckets;
+  int budget = BGP_TABLE_DUMP_SLICE;
 
-	if (!inter_domain_routing_db) return;
+  if (!btd || !btd->active) return;
 
-	for (afi = AFI_IP; afi < AFI_MAX; afi++) {
-	  for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++) {
-	    table = inter_domain_routing_db->rib[afi][safi];
-	    node = bgp_table_top(peer, table);
+  while (budget > 0) {
+    if (!btd->peer) {
+      for (; btd->peers_idx < config.nfacctd_bgp_max_peers; btd->peers_idx++) {
+	if (btd->peers[btd->peers_idx]) break;
+      }
 
-	    while (node) {
-	      u_int32_t modulo = bgp_route_info_modulo(peer, NULL, bms->table_per_peer_buckets);
-	      u_int32_t peer_buckets;
-	      struct bgp_info *ri;
+      if (btd->peers_idx == config.nfacctd_bgp_max_peers) {
+	bgp_table_dump_end(btd);
+	return;
+      }
+
+      bgp_table_dump_peer_begin(btd, &peers[btd->peers_idx]);
+    }
 
-	      for (peer_buckets = 0; peer_buckets < config.bgp_table_per_peer_buckets; peer_buckets++) {
-	        for (ri = node->info[modulo+peer_buckets]; ri; ri = ri->next) {
-		  if (ri->peer == peer) {
-	            bgp_peer_log_msg(node, ri, afi, safi, event_type, config.bgp_table_dump_output, BGP_LOG_TYPE_MISC);
-	            dump_elems++;
-		  }
-		}
-	      }
+    for (; btd->node && budget > 0; budget--) {
+      node = btd->node;
+      modulo = bms->route_info_modulo(btd->peer, NULL, bms->table_per_peer_buckets);
 
-	      node = bgp_route_next(peer, node);
-	    }
-	  }
+      for (peer_buckets = 0; peer_buckets < bms->table_per_peer_buckets; peer_buckets++) {
+	for (ri = node->info[modulo+peer_buckets]; ri; ri = ri->next) {
+	  if (ri->peer == btd->peer && ri->gen <= btd->gen)
+	    bgp_table_dump_entry(btd, node, ri, btd->afi, btd->safi);
 	}
+      }
 
-        saved_peer = peer;
-	tables_num++;
+      btd->node = bgp_route_next(btd->peer, node);
+    }
 
-        strlcpy(last_filename, current_filename, SRVBUFLEN);
-	bds.entries = dump_elems;
-	bds.tables = tables_num;
-        bgp_peer_dump_close(peer, &bds, config.bgp_table_dump_output, FUNC_TYPE_BGP);
+    if (!btd->node) {
+      if (++btd->safi == SAFI_MAX) {
+	btd->safi = SAFI_UNICAST;
+	btd->afi++;
       }
+
+      if (btd->afi == AFI_MAX) bgp_table_dump_peer_end(btd);
+      else btd->node = bgp_table_top(btd->peer, inter_domain_routing_db->rib[btd->afi][btd->safi]);
     }
+  }
+}
+
+/* A peer going away during a dump: its table is dumped as far as the walk
+   got to; to be called, under the RIB lock, before its paths are deleted */
+void bgp_table_dump_peer_close(struct bgp_peer *peer)
+{
+  struct bgp_misc_structs *bms = bgp_select_misc_db(peer->type);
+  struct bgp_table_dump *btd;
+  int peers_idx;
+
+  if (peer->type != FUNC_TYPE_BGP || !bms || !(btd = bms->table_dump) || !btd->active) return;
+
+  peers_idx = (peer - peers);
+  if (!btd->peers[peers_idx]) return;
+
+  if (btd->peer == peer) {
+    if (btd->node) {
+      bgp_unlock_node(peer, btd->node);
+      btd->node = NULL;
+    }
+
+    bgp_table_dump_peer_end(btd);
+  }
+  else {
+    bgp_table_dump_preimages_free(btd, peers_idx, FALSE);
+    btd->peers[peers_idx] = FALSE;
+  }
+}
+
+/* Starts a table dump, carried on by bgp_table_dump_slice() */
+void bgp_handle_dump_event()
+{
+  struct bgp_misc_structs *bms = bgp_select_misc_db(FUNC_TYPE_BGP);
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(FUNC_TYPE_BGP);
+  struct bgp_table_dump *btd;
+  int peers_idx;
+
+  /* pre-flight check */
+  if (!bms->dump_backend_methods || !config.bgp_table_dump_refresh_time || !inter_domain_routing_db)
+    return;
+
+  if (!bms->table_dump) {
+    btd = malloc(sizeof(struct bgp_table_dump));
+    if (!btd) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (bgp_handle_dump_event). Exiting ..\n", config.name, bms->log_str);
+      exit_all(1);
+    }
+    else memset(btd, 0, sizeof(struct bgp_table_dump));
+
+    btd->peers = malloc(config.nfacctd_bgp_max_peers);
+    btd->preimages = malloc(config.nfacctd_bgp_max_peers * sizeof(struct bgp_dump_preimage *));
+    if (!btd->peers || !btd->preimages) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (bgp_handle_dump_event). Exiting ..\n", config.name, bms->log_str);
+      exit_all(1);
+    }
+    else memset(btd->preimages, 0, config.nfacctd_bgp_max_peers * sizeof(struct bgp_dump_preimage *));
+
+    btd->fd_buf = malloc(OUTPUT_FILE_BUFSZ);
+    bms->table_dump = btd;
+  }
+  else btd = bms->table_dump;
+
+  if (btd->active) return;
 
 #ifdef WITH_RABBITMQ
-    if (config.bgp_table_dump_amqp_routing_key)
-      p_amqp_close(&bgp_table_dump_amqp_host, FALSE);
+  if (config.bgp_table_dump_amqp_routing_key) {
+    bgp_table_dump_init_amqp_host();
+    if (p_amqp_connect_to_publish(&bgp_table_dump_amqp_host)) return;
+  }
 #endif
 
 #ifdef WITH_KAFKA
-    if (config.bgp_table_dump_kafka_topic)
-      p_kafka_close(&bgp_table_dump_kafka_host, FALSE);
+  if (config.bgp_table_dump_kafka_topic) {
+    if (bgp_table_dump_init_kafka_host()) return;
+  }
 #endif
 
-    if (config.bgp_table_dump_latest_file && peer) {
-      bgp_peer_log_dynname(latest_filename, SRVBUFLEN, config.bgp_table_dump_latest_file, peer);
-      link_latest_output_file(latest_filename, last_filename);
-    }
+  memset(btd->current_filename, 0, sizeof(btd->current_filename));
+  memset(btd->last_filename, 0, sizeof(btd->last_filename));
+  memset(btd->latest_filename, 0, sizeof(btd->latest_filename));
+  memset(&btd->bds, 0, sizeof(struct bgp_dump_stats));
+  btd->entries = 0;
 
-    duration = time(NULL)-start;
-    Log(LOG_INFO, "INFO ( %s/%s ): *** Dumping BGP tables - END (PID: %u, TABLES: %u ET: %u) ***\n",
-		config.name, bms->log_str, dumper_pid, tables_num, duration);
+  for (peers_idx = 0; peers_idx < config.nfacctd_bgp_max_peers; peers_idx++)
+    btd->peers[peers_idx] = (peers[peers_idx].fd ? TRUE : FALSE);
 
-    exit(0);
-  default: /* Parent */
-    if (ret == -1) { /* Something went wrong */
-      Log(LOG_WARNING, "WARN ( %s/%s ): Unable to fork BGP table dump writer: %s\n", config.name, bms->log_str, strerror(errno));
-    }
+  btd->gen = inter_domain_routing_db->gen++;
+  btd->peers_idx = 0;
+  btd->peer = NULL;
+  btd->node = NULL;
+  gettimeofday(&btd->start, NULL);
+  btd->active = TRUE;
 
-    break;
-  }
+  Log(LOG_INFO, "INFO ( %s/%s ): *** Dumping BGP tables - START ***\n", config.name, bms->log_str);
 }
 
 #if defined WITH_RABBITMQ
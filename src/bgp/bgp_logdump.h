@@ -47,6 +47,50 @@ struct bgp_dump_stats {
   u_int32_t tables;
 };
 
+/*
+   In-process, incremental BGP table dump: the RIB is walked in slices of
+   BGP_TABLE_DUMP_SLICE nodes interleaved with UPDATE processing. The dump
+   is a snapshot of the RIB as of when it started: the RIB generation is
+   bumped and each path is stamped with the generation of its last change;
+   the walk skips paths changed after the dump started and, for those the
+   walk did not get to yet, bgp_table_dump_preserve() keeps a copy of the
+   former version which is dumped along with the rest of the peer table.
+   In between slices the peers and RIB locks are released and the BGP
+   thread waits for up to BGP_TABLE_DUMP_PAUSE msecs on its sockets, so
+   that neither lookups nor the thread itself are left spinning.
+*/
+#define BGP_TABLE_DUMP_SLICE	4096
+#define BGP_TABLE_DUMP_PAUSE	1	/* msecs */
+
+struct bgp_dump_preimage {
+  struct bgp_node node; /* only the prefix is set */
+  struct bgp_info ri;
+  struct bgp_info_extra extra;
+  afi_t afi;
+  safi_t safi;
+  struct bgp_dump_preimage *next;
+};
+
+struct bgp_table_dump {
+  int active;
+  u_int32_t gen; /* RIB generation the dump is a snapshot of */
+  int peers_idx;
+  struct bgp_peer *peer; /* peer being dumped, NULL in between peers */
+  afi_t afi;
+  safi_t safi;
+  struct bgp_node *node; /* next node to visit, locked */
+  char *peers; /* peers part of the snapshot not dumped yet */
+  struct bgp_dump_preimage **preimages; /* per peer */
+  struct bgp_peer_log peer_log;
+  struct bgp_dump_stats bds;
+  u_int64_t entries;
+  struct timeval start;
+  char current_filename[SRVBUFLEN];
+  char last_filename[SRVBUFLEN];
+  char latest_filename[SRVBUFLEN];
+  char *fd_buf; /* reused across dumps */
+};
+
 /* prototypes */
 #if (!defined __BGP_LOGDUMP_C)
 #define EXT extern
@@ -62,6 +106,9 @@ EXT int bgp_peer_log_msg(struct bgp_node *, struct bgp_info *, afi_t, safi_t, ch
 EXT int bgp_peer_dump_init(struct bgp_peer *, int, int);
 EXT int bgp_peer_dump_close(struct bgp_peer *, struct bgp_dump_stats *, int, int);
 EXT void bgp_handle_dump_event();
+EXT void bgp_table_dump_slice();
+EXT void bgp_table_dump_preserve(struct bgp_peer *, struct bgp_node *, struct bgp_info *);
+EXT void bgp_table_dump_peer_close(struct bgp_peer *);
 EXT void bgp_daemon_msglog_init_amqp_host();
 EXT void bgp_table_dump_init_amqp_host();
 EXT int bgp_daemon_msglog_init_kafka_host();
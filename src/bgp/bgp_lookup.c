@@ -574,6 +574,12 @@ int bgp_lookup_node_match_cmp_bgp(struct bgp_info *info, struct node_match_cmp_t
   return TRUE;
 }
 
+/* paths are looked up against the peer they were learnt from */
+struct bgp_peer *bgp_lookup_index_peer_bgp(struct bgp_peer *peer)
+{
+  return peer;
+}
+
 void pkt_to_cache_legacy_bgp_primitives(struct cache_legacy_bgp_primitives *c, struct pkt_legacy_bgp_primitives *p,
 					pm_cfgreg_t what_to_count, pm_cfgreg_t what_to_count_2)
 {
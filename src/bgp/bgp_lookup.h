@@ -33,6 +33,7 @@ EXT void bgp_follow_nexthop_lookup(struct packet_ptrs *, int);
 EXT struct bgp_peer *bgp_lookup_find_bgp_peer(struct sockaddr *, struct xflow_status_entry *, u_int16_t, int); 
 EXT u_int32_t bgp_route_info_modulo_pathid(struct bgp_peer *, path_id_t *, int);
 EXT int bgp_lookup_node_match_cmp_bgp(struct bgp_info *, struct node_match_cmp_term2 *);
+EXT struct bgp_peer *bgp_lookup_index_peer_bgp(struct bgp_peer *);
 EXT void pkt_to_cache_legacy_bgp_primitives(struct cache_legacy_bgp_primitives *, struct pkt_legacy_bgp_primitives *, pm_cfgreg_t, pm_cfgreg_t);
 EXT void cache_to_pkt_legacy_bgp_primitives(struct pkt_legacy_bgp_primitives *, struct cache_legacy_bgp_primitives *);
 EXT void free_cache_legacy_bgp_primitives(struct cache_legacy_bgp_primitives **);
@@ -585,7 +585,9 @@ int bgp_parse_update_msg(struct bgp_msg_data *bmd, char *pkt)
   }
 
   if (attribute_len > 0) {
+    bgp_rib_lock(bgp_select_routing_db(peer->type));
     ret = bgp_attr_parse(peer, &attr, pkt, attribute_len, &mp_update, &mp_withdraw);
+    bgp_rib_unlock(bgp_select_routing_db(peer->type));
     if (ret < 0) return ret;
     pkt += attribute_len;
   }
@@ -634,6 +636,7 @@ int bgp_parse_update_msg(struct bgp_msg_data *bmd, char *pkt)
 
   /* Everything is done.  We unintern temporary structures which
 	 interned in bgp_attr_parse(). */
+  bgp_rib_lock(bgp_select_routing_db(peer->type));
   if (attr.aspath)
     aspath_unintern(peer, attr.aspath);
   if (attr.community)
@@ -642,6 +645,7 @@ int bgp_parse_update_msg(struct bgp_msg_data *bmd, char *pkt)
     ecommunity_unintern(peer, attr.ecommunity);
   if (attr.lcommunity)
     lcommunity_unintern(peer, attr.lcommunity);
+  bgp_rib_unlock(bgp_select_routing_db(peer->type));
 
   ret = ntohs(bhdr.bgpo_len);
   return ret;
@@ -931,6 +935,7 @@ int bgp_attr_parse_mp_unreach(struct bgp_peer *peer, u_int16_t len, struct bgp_a
 int bgp_nlri_parse(struct bgp_msg_data *bmd, void *attr, struct bgp_nlri *info)
 {
   struct bgp_peer *peer = bmd->peer;
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   u_char *pnt;
   u_char *lim;
   u_char safi, label[3];
@@ -1033,10 +1038,12 @@ int bgp_nlri_parse(struct bgp_msg_data *bmd, void *attr, struct bgp_nlri *info)
     }
 
     /* Let's do our job now! */
+    bgp_rib_lock(inter_domain_routing_db);
     if (attr)
       ret = bgp_process_update(bmd, &p, attr, info->afi, safi, &rd, &path_id, label);
     else
       ret = bgp_process_withdraw(bmd, &p, attr, info->afi, safi, &rd, &path_id, label);
+    bgp_rib_unlock(inter_domain_routing_db);
   }
 
   return SUCCESS;
@@ -1107,8 +1114,10 @@ int bgp_process_update(struct bgp_msg_data *bmd, struct prefix *p, void *attr, a
       }
       else {
         /* Update to new attribute.  */
+        bgp_table_dump_preserve(peer, route, ri);
         bgp_attr_unintern(peer, ri->attr);
         ri->attr = attr_new;
+        ri->gen = inter_domain_routing_db->gen;
         bgp_info_extra_process(peer, ri, safi, path_id, rd, label);
         if (bms->bgp_extra_data_process) (*bms->bgp_extra_data_process)(&bmd->extra, ri);
 
@@ -1126,6 +1135,7 @@ int bgp_process_update(struct bgp_msg_data *bmd, struct prefix *p, void *attr, a
     if (new) {
       new->peer = peer;
       new->attr = attr_new;
+      new->gen = inter_domain_routing_db->gen;
       bgp_info_extra_process(peer, new, safi, path_id, rd, label);
       if (bms->bgp_extra_data_process) (*bms->bgp_extra_data_process)(&bmd->extra, new);
     }
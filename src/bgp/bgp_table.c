@@ -37,6 +37,20 @@ static void bgp_node_free (struct bgp_node *);
 static void route_common (struct prefix *, struct prefix *, struct prefix *);
 static int check_bit (u_char *, u_char);
 static void set_link (struct bgp_node *, struct bgp_node *);
+static struct bgp_info *bgp_node_match_info (struct bgp_node *, u_int32_t, u_int32_t,
+					     int (*)(struct bgp_info *, struct node_match_cmp_term2 *),
+					     struct node_match_cmp_term2 *);
+static struct bgp_peer_rib_node *bgp_peer_rib_node_get (struct bgp_misc_structs *, struct bgp_peer_rib *, struct prefix *);
+static void bgp_peer_rib_node_delete (struct bgp_rt_structs *, struct bgp_peer_rib *, struct bgp_peer_rib_node *);
+static void bgp_peer_rib_node_free (struct bgp_rt_structs *, struct bgp_peer_rib_node *);
+
+/* RIB readers, see bgp_rib_read_begin() */
+static struct bgp_rib_reader bgp_rib_readers[BGP_RIB_READERS_MAX];
+static volatile u_int64_t bgp_rib_epoch = 1;
+static volatile int bgp_rib_readers_num;
+static volatile int bgp_rib_readers_overflow;
+static __thread int bgp_rib_reader_slot = ERR;
+static __thread int bgp_rib_reader_depth;
 
 struct bgp_table *
 bgp_table_init (afi_t afi, safi_t safi)
@@ -183,6 +197,9 @@ set_link (struct bgp_node *node, struct bgp_node *new)
 
   assert (bit == 0 || bit == 1);
 
+  /* new has to be complete before readers can reach it */
+  __sync_synchronize();
+
   node->link[bit] = new;
   new->parent = node;
 }
@@ -205,6 +222,27 @@ bgp_unlock_node (struct bgp_peer *peer, struct bgp_node *node)
     bgp_node_delete (peer, node);
 }
 
+/* Scan the buckets of a node for a path matching cmp_func */
+static struct bgp_info *
+bgp_node_match_info (struct bgp_node *node, u_int32_t modulo, u_int32_t modulo_max,
+		     int (*cmp_func)(struct bgp_info *, struct node_match_cmp_term2 *),
+		     struct node_match_cmp_term2 *nmct2)
+{
+  struct bgp_info *info, *matched_info = NULL;
+  u_int32_t modulo_idx, local_modulo;
+
+  for (local_modulo = modulo, modulo_idx = 0; modulo_idx < modulo_max; local_modulo++, modulo_idx++) {
+    for (info = node->info[local_modulo]; info; info = info->next) {
+      if (!cmp_func(info, nmct2)) {
+	matched_info = info;
+	break;
+      }
+    }
+  }
+
+  return matched_info;
+}
+
 /* Find matched prefix. */
 void
 bgp_node_match (const struct bgp_table *table, struct prefix *p, struct bgp_peer *peer,
@@ -216,7 +254,7 @@ bgp_node_match (const struct bgp_table *table, struct prefix *p, struct bgp_peer
   struct bgp_misc_structs *bms;
   struct bgp_node *node, *matched_node;
   struct bgp_info *info, *matched_info;
-  u_int32_t modulo, modulo_idx, local_modulo, modulo_max;
+  u_int32_t modulo, modulo_max;
 
   if (!table || !peer || !modulo_func || !cmp_func) return;
 
@@ -231,27 +269,50 @@ bgp_node_match (const struct bgp_table *table, struct prefix *p, struct bgp_peer
 
   matched_node = NULL;
   matched_info = NULL;
-  node = table->top;
 
-  /* Walk down tree.  If there is matched route then store it to matched. */
-  while (node && node->p.prefixlen <= p->prefixlen && prefix_match(&node->p, p)) {
-    for (local_modulo = modulo, modulo_idx = 0; modulo_idx < modulo_max; local_modulo++, modulo_idx++) {
-      for (info = node->info[local_modulo]; info; info = info->next) {
-	if (!cmp_func(info, nmct2)) {
-	  matched_node = node;
-	  matched_info = info;
-	  break;
+  /* Walk down the per-peer index, if any: it holds all and only the
+     nodes, and paths, looked up against this peer (see
+     bgp_lookup_index_peer), hence same result as below */
+  if (bms->table_per_peer_index) {
+    struct bgp_peer_rib_node *inode = NULL;
+    struct bgp_node *rn;
+
+    if (peer->rib_index && peer->rib_index[(table->afi * SAFI_MAX) + table->safi])
+      inode = peer->rib_index[(table->afi * SAFI_MAX) + table->safi]->top;
+
+    while (inode && inode->p.prefixlen <= p->prefixlen && prefix_match(&inode->p, p)) {
+      if ((rn = inode->rn)) {
+	for (info = inode->info; info; info = info->inext) {
+	  if (!cmp_func(info, nmct2)) {
+	    matched_node = rn;
+	    matched_info = info;
+	    break;
+	  }
 	}
       }
+
+      inode = inode->link[check_bit(&p->u.prefix, inode->p.prefixlen)];
     }
+  }
+  else {
+    node = table->top;
 
-    node = node->link[check_bit(&p->u.prefix, node->p.prefixlen)];
+    /* Walk down tree.  If there is matched route then store it to matched. */
+    while (node && node->p.prefixlen <= p->prefixlen && prefix_match(&node->p, p)) {
+      if ((info = bgp_node_match_info(node, modulo, modulo_max, cmp_func, nmct2))) {
+	matched_node = node;
+	matched_info = info;
+      }
+
+      node = node->link[check_bit(&p->u.prefix, node->p.prefixlen)];
+    }
   }
 
+  /* no node lock is taken: lookups run within bgp_rib_read_begin()
+     and bgp_rib_read_end() instead */
   if (matched_node) {
     (*result_node) = matched_node;
     (*result_info) = matched_info;
-    bgp_lock_node (NULL /* XXX */, matched_node);
   }
   else {
     (*result_node) = NULL;
@@ -295,6 +356,238 @@ bgp_node_match_ipv6 (const struct bgp_table *table, struct in6_addr *addr, struc
 }
 #endif /* ENABLE_IPV6 */
 
+static struct bgp_peer_rib_node *
+bgp_peer_rib_node_set (struct bgp_misc_structs *bms, struct prefix *prefix)
+{
+  struct bgp_peer_rib_node *node;
+
+  node = malloc (sizeof (struct bgp_peer_rib_node));
+  if (!node) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (bgp_peer_rib_node_set). Exiting ..\n", config.name, bms->log_str);
+    exit_all(1);
+  }
+
+  memset (node, 0, sizeof (struct bgp_peer_rib_node));
+  if (prefix) prefix_copy (&node->p, prefix);
+
+  return node;
+}
+
+static void
+bgp_peer_rib_set_link (struct bgp_peer_rib_node *node, struct bgp_peer_rib_node *new)
+{
+  int bit;
+
+  bit = check_bit (&new->p.u.prefix, node->p.prefixlen);
+
+  __sync_synchronize();
+
+  node->link[bit] = new;
+  new->parent = node;
+}
+
+/* Same as bgp_node_get() against a per-peer index */
+static struct bgp_peer_rib_node *
+bgp_peer_rib_node_get (struct bgp_misc_structs *bms, struct bgp_peer_rib *rib, struct prefix *p)
+{
+  struct bgp_peer_rib_node *new, *node, *match;
+
+  match = NULL;
+  node = rib->top;
+  while (node && node->p.prefixlen <= p->prefixlen && prefix_match (&node->p, p)) {
+    if (node->p.prefixlen == p->prefixlen) return node;
+
+    match = node;
+    node = node->link[check_bit(&p->u.prefix, node->p.prefixlen)];
+  }
+
+  if (node == NULL) {
+    new = bgp_peer_rib_node_set (bms, p);
+    if (match) bgp_peer_rib_set_link (match, new);
+    else {
+      __sync_synchronize();
+      rib->top = new;
+    }
+  }
+  else {
+    new = bgp_peer_rib_node_set (bms, NULL);
+    route_common (&node->p, p, &new->p);
+    new->p.family = p->family;
+    bgp_peer_rib_set_link (new, node);
+
+    if (match) bgp_peer_rib_set_link (match, new);
+    else {
+      __sync_synchronize();
+      rib->top = new;
+    }
+
+    if (new->p.prefixlen != p->prefixlen) {
+      match = new;
+      new = bgp_peer_rib_node_set (bms, p);
+      bgp_peer_rib_set_link (match, new);
+      rib->count++;
+    }
+  }
+  rib->count++;
+
+  return new;
+}
+
+/* Same as bgp_node_delete() against a per-peer index */
+static void
+bgp_peer_rib_node_delete (struct bgp_rt_structs *inter_domain_routing_db, struct bgp_peer_rib *rib, struct bgp_peer_rib_node *node)
+{
+  struct bgp_peer_rib_node *child, *parent;
+
+  if (node->rn || (node->link[0] && node->link[1])) return;
+
+  if (node->link[0]) child = node->link[0];
+  else child = node->link[1];
+
+  parent = node->parent;
+
+  if (child) child->parent = parent;
+
+  if (parent) {
+    if (parent->link[0] == node) parent->link[0] = child;
+    else parent->link[1] = child;
+  }
+  else rib->top = child;
+
+  rib->count--;
+  bgp_rib_retire (inter_domain_routing_db, node, free);
+
+  /* If parent node is glue then delete it also. */
+  if (parent) bgp_peer_rib_node_delete (inter_domain_routing_db, rib, parent);
+}
+
+static void
+bgp_peer_rib_node_free (struct bgp_rt_structs *inter_domain_routing_db, struct bgp_peer_rib_node *node)
+{
+  if (!node) return;
+
+  bgp_peer_rib_node_free (inter_domain_routing_db, node->link[0]);
+  bgp_peer_rib_node_free (inter_domain_routing_db, node->link[1]);
+  bgp_rib_retire (inter_domain_routing_db, node, free);
+}
+
+/* Index a new path ri of the peer at RIB node rn; paths are indexed
+   under the peer lookups are made against, ie. for BMP the session */
+void
+bgp_peer_rib_index_add (struct bgp_peer *peer, struct bgp_node *rn, struct bgp_info *ri)
+{
+  struct bgp_misc_structs *bms;
+  struct bgp_peer_rib_node *node;
+  struct bgp_peer_rib **rib;
+
+  if (!peer || !rn || !ri) return;
+
+  bms = bgp_select_misc_db(peer->type);
+  if (!bms || !bms->table_per_peer_index) return;
+
+  if (bms->bgp_lookup_index_peer) peer = bms->bgp_lookup_index_peer(peer);
+
+  /* index and its tables are published only once initialized */
+  if (!peer->rib_index) {
+    struct bgp_peer_rib **rib_index;
+
+    rib_index = malloc(sizeof(struct bgp_peer_rib *) * (AFI_MAX * SAFI_MAX));
+    if (!rib_index) goto malloc_failed;
+    memset(rib_index, 0, sizeof(struct bgp_peer_rib *) * (AFI_MAX * SAFI_MAX));
+
+    __sync_synchronize();
+    peer->rib_index = rib_index;
+  }
+
+  rib = &peer->rib_index[(rn->table->afi * SAFI_MAX) + rn->table->safi];
+  if (!(*rib)) {
+    struct bgp_peer_rib *new_rib;
+
+    new_rib = malloc(sizeof(struct bgp_peer_rib));
+    if (!new_rib) goto malloc_failed;
+    memset(new_rib, 0, sizeof(struct bgp_peer_rib));
+
+    __sync_synchronize();
+    (*rib) = new_rib;
+  }
+
+  node = bgp_peer_rib_node_get(bms, (*rib), &rn->p);
+
+  /* same as bgp_info_add(): ri has to be linked before readers reach it */
+  ri->inext = node->info;
+  ri->iprev = NULL;
+  if (node->info) node->info->iprev = ri;
+
+  __sync_synchronize();
+  node->info = ri;
+  node->rn = rn;
+
+  return;
+
+  malloc_failed:
+  Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (bgp_peer_rib_index_add). Exiting ..\n", config.name, bms->log_str);
+  exit_all(1);
+}
+
+/* Remove path ri of the peer at RIB node rn from the index */
+void
+bgp_peer_rib_index_delete (struct bgp_peer *peer, struct bgp_node *rn, struct bgp_info *ri)
+{
+  struct bgp_misc_structs *bms;
+  struct bgp_peer_rib_node *node;
+  struct bgp_peer_rib *rib;
+
+  if (!peer || !rn || !ri) return;
+
+  bms = bgp_select_misc_db(peer->type);
+  if (!bms || !bms->table_per_peer_index) return;
+
+  if (bms->bgp_lookup_index_peer) peer = bms->bgp_lookup_index_peer(peer);
+  if (!peer->rib_index) return;
+
+  rib = peer->rib_index[(rn->table->afi * SAFI_MAX) + rn->table->safi];
+  if (!rib) return;
+
+  node = rib->top;
+  while (node && node->p.prefixlen < rn->p.prefixlen && prefix_match (&node->p, &rn->p))
+    node = node->link[check_bit(&rn->p.u.prefix, node->p.prefixlen)];
+
+  if (!node || node->rn != rn) return;
+
+  /* ri itself is retired, not freed: readers may still be walking it */
+  if (ri->inext) ri->inext->iprev = ri->iprev;
+  if (ri->iprev) ri->iprev->inext = ri->inext;
+  else node->info = ri->inext;
+
+  if (!node->info) {
+    node->rn = NULL;
+    bgp_peer_rib_node_delete (bgp_select_routing_db(peer->type), rib, node);
+  }
+}
+
+void
+bgp_peer_rib_index_free (struct bgp_peer *peer)
+{
+  struct bgp_rt_structs *inter_domain_routing_db;
+  struct bgp_peer_rib **rib_index;
+  u_int32_t idx;
+
+  if (!peer || !peer->rib_index) return;
+
+  inter_domain_routing_db = bgp_select_routing_db(peer->type);
+  rib_index = peer->rib_index;
+  peer->rib_index = NULL;
+
+  for (idx = 0; idx < (AFI_MAX * SAFI_MAX); idx++) {
+    if (rib_index[idx]) {
+      bgp_peer_rib_node_free (inter_domain_routing_db, rib_index[idx]->top);
+      bgp_rib_retire (inter_domain_routing_db, rib_index[idx], free);
+    }
+  }
+
+  bgp_rib_retire (inter_domain_routing_db, rib_index, free);
+}
+
 /* Add node to routing table. */
 struct bgp_node *
 bgp_node_get (struct bgp_peer *peer, struct bgp_table *const table, struct prefix *p)
@@ -323,8 +616,10 @@ bgp_node_get (struct bgp_peer *peer, struct bgp_table *const table, struct prefi
       new = bgp_node_set (peer, table, p);
       if (match)
 	set_link (match, new);
-      else
+      else {
+	__sync_synchronize();
 	table->top = new;
+      }
     }
   else
     {
@@ -336,8 +631,10 @@ bgp_node_get (struct bgp_peer *peer, struct bgp_table *const table, struct prefi
 
       if (match)
 	set_link (match, new);
-      else
+      else {
+	__sync_synchronize();
 	table->top = new;
+      }
 
       if (new->p.prefixlen != p->prefixlen)
 	{
@@ -392,7 +689,7 @@ bgp_node_delete (struct bgp_peer *peer, struct bgp_node *node)
   
   node->table->count--;
   
-  bgp_node_free (node);
+  bgp_rib_retire (bgp_select_routing_db(peer->type), node, (void (*)(void *)) bgp_node_free);
 
   /* If parent node is stub then delete it also. */
   if (parent && parent->lock == 0)
@@ -498,3 +795,134 @@ bgp_route_next_until (struct bgp_peer *peer, struct bgp_node *node, struct bgp_n
   bgp_unlock_node (peer, start);
   return NULL;
 }
+
+/*
+   Enters a read-side section: nodes, paths and attributes reached from
+   the RIB from now on stay valid until bgp_rib_read_end(). Sections can
+   be nested; each thread takes a reader slot the first time around.
+*/
+void
+bgp_rib_read_begin ()
+{
+  int idx;
+
+  if (bgp_rib_reader_depth++) return;
+
+  if (bgp_rib_reader_slot == ERR) {
+    for (idx = 0; idx < BGP_RIB_READERS_MAX; idx++) {
+      if (__sync_bool_compare_and_swap(&bgp_rib_readers[idx].used, FALSE, TRUE)) {
+	bgp_rib_reader_slot = idx;
+	__sync_fetch_and_add(&bgp_rib_readers_num, 1);
+	break;
+      }
+    }
+
+    /* out of slots: from now on retired memory is simply never freed */
+    if (bgp_rib_reader_slot == ERR) {
+      if (!bgp_rib_readers_overflow) {
+	Log(LOG_WARNING, "WARN ( %s/core/BGP ): too many RIB reader threads (%u). RIB memory reclamation disabled.\n",
+		config.name, BGP_RIB_READERS_MAX);
+	bgp_rib_readers_overflow = TRUE;
+	__sync_synchronize();
+      }
+
+      return;
+    }
+  }
+
+  bgp_rib_readers[bgp_rib_reader_slot].epoch = bgp_rib_epoch;
+  __sync_synchronize();
+}
+
+void
+bgp_rib_read_end ()
+{
+  if (!bgp_rib_reader_depth || --bgp_rib_reader_depth) return;
+
+  if (bgp_rib_reader_slot == ERR) return;
+
+  __sync_synchronize();
+  bgp_rib_readers[bgp_rib_reader_slot].epoch = 0;
+}
+
+/*
+   Hands memory unlinked from the RIB over for reclamation; freed right
+   away if no thread ever entered a read-side section, ie. pmbgpd. To be
+   called by the (serialized) writers of inter_domain_routing_db.
+*/
+void
+bgp_rib_retire (struct bgp_rt_structs *inter_domain_routing_db, void *ptr, void (*free_func)(void *))
+{
+  struct bgp_rib_limbo *limbo;
+  struct bgp_rib_retired *retired;
+
+  if (!ptr) return;
+
+  __sync_synchronize();
+
+  if (!inter_domain_routing_db || !bgp_rib_readers_num) {
+    free_func(ptr);
+    return;
+  }
+
+  limbo = &inter_domain_routing_db->limbo;
+
+  if ((limbo->tail - limbo->head) == limbo->size) {
+    struct bgp_rib_retired *new_list;
+    u_int32_t new_size, idx;
+
+    new_size = (limbo->size ? (limbo->size * 2) : BGP_RIB_LIMBO_SIZE_DEFAULT);
+    new_list = malloc(new_size * sizeof(struct bgp_rib_retired));
+    if (!new_list) {
+      Log(LOG_ERR, "ERROR ( %s/core/BGP ): malloc() failed (bgp_rib_retire). Exiting ..\n", config.name);
+      exit_all(1);
+    }
+
+    for (idx = 0; limbo->head != limbo->tail; idx++, limbo->head++)
+      new_list[idx] = limbo->list[limbo->head & (limbo->size - 1)];
+
+    free(limbo->list);
+    limbo->list = new_list;
+    limbo->size = new_size;
+    limbo->head = 0;
+    limbo->tail = idx;
+  }
+
+  retired = &limbo->list[limbo->tail & (limbo->size - 1)];
+  retired->ptr = ptr;
+  retired->free_func = free_func;
+  retired->epoch = bgp_rib_epoch;
+  limbo->tail++;
+
+  if (!((limbo->tail - limbo->head) % BGP_RIB_RECLAIM_BATCH)) bgp_rib_reclaim(inter_domain_routing_db);
+}
+
+/* Advances the epoch and frees what no reader can be referencing anymore */
+void
+bgp_rib_reclaim (struct bgp_rt_structs *inter_domain_routing_db)
+{
+  struct bgp_rib_limbo *limbo;
+  struct bgp_rib_retired *retired;
+  u_int64_t min_epoch, epoch;
+  int idx;
+
+  if (!inter_domain_routing_db || bgp_rib_readers_overflow) return;
+
+  limbo = &inter_domain_routing_db->limbo;
+  if (limbo->head == limbo->tail) return;
+
+  min_epoch = __sync_add_and_fetch(&bgp_rib_epoch, 1);
+
+  for (idx = 0; idx < BGP_RIB_READERS_MAX; idx++) {
+    epoch = bgp_rib_readers[idx].epoch;
+    if (epoch && epoch < min_epoch) min_epoch = epoch;
+  }
+
+  while (limbo->head != limbo->tail) {
+    retired = &limbo->list[limbo->head & (limbo->size - 1)];
+    if (retired->epoch >= min_epoch) break;
+
+    retired->free_func(retired->ptr);
+    limbo->head++;
+  }
+}
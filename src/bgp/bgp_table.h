@@ -79,6 +79,72 @@ struct bgp_info
   struct bgp_peer *peer;
   struct bgp_attr *attr;
   struct bgp_info_extra *extra;
+  u_int32_t gen; /* RIB generation of the last change, see bgp_table_dump */
+
+  /* paths of the same (index) peer at the node, see bgp_peer_rib_node */
+  struct bgp_info *inext;
+  struct bgp_info *iprev;
+};
+
+/*
+   Per-peer index of a RIB table: a radix tree of only those nodes of
+   the shared table holding at least one path of the peer; glue nodes
+   have rn set to NULL. Each node also heads the list of the peer's own
+   paths at rn, linked through inext/iprev. bgp_node_match() walks it,
+   when available, in place of the shared tree so that a lookup goes
+   neither through the nodes nor through the paths of all other peers.
+*/
+struct bgp_peer_rib_node
+{
+  struct prefix p;
+
+  struct bgp_peer_rib_node *parent;
+  struct bgp_peer_rib_node *link[2];
+
+  struct bgp_node *rn;
+  struct bgp_info *info;
+};
+
+struct bgp_peer_rib
+{
+  struct bgp_peer_rib_node *top;
+
+  unsigned long count;
+};
+
+/*
+   Epoch-based reclamation of RIB memory: lookups, ie. from the collector
+   thread, walk the RIB without locks while the BGP/BMP thread(s) update
+   it. A reader brackets its use of nodes, paths and attributes between
+   bgp_rib_read_begin() and bgp_rib_read_end(); a writer unlinking any of
+   those retires it, tagged with the current epoch, instead of freeing it
+   and retired memory is reclaimed once no reader can still be in the
+   epoch it was retired in.
+*/
+#define BGP_RIB_READERS_MAX		32
+#define BGP_RIB_RECLAIM_BATCH		64
+#define BGP_RIB_LIMBO_SIZE_DEFAULT	1024
+
+struct bgp_rib_reader
+{
+  volatile u_int64_t epoch; /* zero when outside of a read-side section */
+  volatile int used;
+};
+
+struct bgp_rib_retired
+{
+  void *ptr;
+  void (*free_func)(void *);
+  u_int64_t epoch;
+};
+
+/* FIFO of retired memory, hence sorted by epoch; size is a power of 2 */
+struct bgp_rib_limbo
+{
+  struct bgp_rib_retired *list;
+  u_int32_t size;
+  u_int32_t head;
+  u_int32_t tail;
 };
 
 struct node_match_cmp_term2 {
@@ -88,6 +154,8 @@ struct node_match_cmp_term2 {
   struct host_addr *peer_dst_ip;
 };
 
+struct bgp_rt_structs;
+
 /* Prototypes */
 #if (!defined __BGP_TABLE_C)
 #define EXT extern
@@ -111,6 +179,13 @@ EXT void bgp_node_match_ipv4 (const struct bgp_table *, struct in_addr *, struct
 			      int (*cmp_func)(struct bgp_info *, struct node_match_cmp_term2 *),
 			      struct node_match_cmp_term2 *,
 			      struct bgp_node **result_node, struct bgp_info **result_info);
+EXT void bgp_peer_rib_index_add (struct bgp_peer *, struct bgp_node *, struct bgp_info *);
+EXT void bgp_peer_rib_index_delete (struct bgp_peer *, struct bgp_node *, struct bgp_info *);
+EXT void bgp_peer_rib_index_free (struct bgp_peer *);
+EXT void bgp_rib_read_begin ();
+EXT void bgp_rib_read_end ();
+EXT void bgp_rib_retire (struct bgp_rt_structs *, void *, void (*)(void *));
+EXT void bgp_rib_reclaim (struct bgp_rt_structs *);
 #ifdef ENABLE_IPV6
 EXT void bgp_node_match_ipv6 (const struct bgp_table *, struct in6_addr *, struct bgp_peer *,
 			      u_int32_t (*modulo_func)(struct bgp_peer *, path_id_t *, int),
@@ -278,14 +278,21 @@ void bgp_info_add(struct bgp_peer *peer, struct bgp_node *rn, struct bgp_info *r
   ri->prev = NULL;
   if (top)
     top->prev = ri;
+
+  /* ri has to be complete before readers can reach it */
+  __sync_synchronize();
   rn->info[modulo] = ri;
 
   bgp_lock_node(peer, rn);
   ri->peer->lock++;
+
+  bgp_peer_rib_index_add(ri->peer, rn, ri);
 }
 
 void bgp_info_delete(struct bgp_peer *peer, struct bgp_node *rn, struct bgp_info *ri, u_int32_t modulo)
 {
+  bgp_table_dump_preserve(peer, rn, ri);
+
   if (ri->next)
     ri->next->prev = ri->prev;
   if (ri->prev)
@@ -293,20 +300,28 @@ void bgp_info_delete(struct bgp_peer *peer, struct bgp_node *rn, struct bgp_info
   else
     rn->info[modulo] = ri->next;
 
+  bgp_peer_rib_index_delete(ri->peer, rn, ri);
   bgp_info_free(peer, ri);
 
   bgp_unlock_node(peer, rn);
 }
 
-/* Free bgp route information. */
+/* Free bgp route information: the path may still be in use by RIB
+   readers, see bgp_rib_retire() */
 void bgp_info_free(struct bgp_peer *peer, struct bgp_info *ri)
 {
   if (ri->attr)
     bgp_attr_unintern(peer, ri->attr);
 
-  bgp_info_extra_free(peer, &ri->extra);
-
   ri->peer->lock--;
+  bgp_rib_retire(bgp_select_routing_db(peer->type), ri, bgp_info_reclaim);
+}
+
+void bgp_info_reclaim(void *ptr)
+{
+  struct bgp_info *ri = (struct bgp_info *) ptr;
+
+  bgp_info_extra_free(ri->peer, &ri->extra);
   free(ri);
 }
 
@@ -449,7 +464,7 @@ void bgp_attr_unintern(struct bgp_peer *peer, struct bgp_attr *attr)
     ret = (struct bgp_attr *) hash_release(inter_domain_routing_db->attrhash, attr);
     // assert (ret != NULL);
     if (!ret) Log(LOG_INFO, "INFO ( %s/%s ): bgp_attr_unintern() hash lookup failed.\n", config.name, bms->log_str);
-    free(attr);
+    bgp_rib_retire(inter_domain_routing_db, attr, free);
   }
 
   /* aspath refcount shoud be decrement. */
@@ -530,12 +545,17 @@ void bgp_peer_close(struct bgp_peer *peer, int type, int no_quiet, int send_noti
     if (ret) send(peer->fd, notification_msg, ret, 0);
   }
 
+  bgp_rib_lock(bgp_select_routing_db(peer->type));
+  bgp_table_dump_peer_close(peer);
+
   /* be quiet if we are in a signal handler and already set to exit() */
   if (!no_quiet) bgp_peer_info_delete(peer);
 
   if (bms->msglog_file || bms->msglog_amqp_routing_key || bms->msglog_kafka_topic)
     bgp_peer_log_close(peer, bms->msglog_output, peer->type);
 
+  bgp_rib_unlock(bgp_select_routing_db(peer->type));
+
   if (peer->fd != ERR) close(peer->fd);
 
   peer->fd = 0;
@@ -606,6 +626,8 @@ void bgp_peer_info_delete(struct bgp_peer *peer)
       }
     }
   }
+
+  bgp_peer_rib_index_free(peer);
 }
 
 int bgp_attr_munge_as4path(struct bgp_peer *peer, struct bgp_attr *attr, struct aspath *as4path)
@@ -1031,6 +1053,155 @@ void bgp_batch_rollback(struct bgp_peer_batch *bp_batch)
   }
 }
 
+int bgp_evloop_init(struct bgp_evloop *evl, int max_events)
+{
+  if (!evl) return ERR;
+
+  memset(evl, 0, sizeof(struct bgp_evloop));
+
+#if defined HAVE_EPOLL_CREATE1
+  evl->epfd = epoll_create1(0);
+  if (evl->epfd == ERR) return ERR;
+
+  evl->ready_max = (max_events > 0 ? max_events : 1);
+  evl->ready = malloc(evl->ready_max * sizeof(struct epoll_event));
+  if (!evl->ready) return ERR;
+#else
+  FD_ZERO(&evl->bkp_read_descs);
+#endif
+
+  return SUCCESS;
+}
+
+int bgp_evloop_add(struct bgp_evloop *evl, int fd, void *ptr)
+{
+#if defined HAVE_EPOLL_CREATE1
+  struct epoll_event ev;
+#endif
+
+  if (!evl || fd < 0) return ERR;
+
+  if (fd >= evl->ptr_max) {
+    void **new_ptr;
+    int new_max = (evl->ptr_max ? evl->ptr_max : 64);
+
+    while (new_max <= fd) new_max *= 2;
+
+    new_ptr = realloc(evl->ptr, new_max * sizeof(void *));
+    if (!new_ptr) return ERR;
+
+    memset(&new_ptr[evl->ptr_max], 0, (new_max - evl->ptr_max) * sizeof(void *));
+    evl->ptr = new_ptr;
+    evl->ptr_max = new_max;
+  }
+
+#if defined HAVE_EPOLL_CREATE1
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+
+  if (epoll_ctl(evl->epfd, EPOLL_CTL_ADD, fd, &ev) == ERR) return ERR;
+#else
+  if (fd >= FD_SETSIZE) return ERR;
+
+  FD_SET(fd, &evl->bkp_read_descs);
+  if (fd > evl->max_fd) evl->max_fd = fd;
+#endif
+
+  evl->ptr[fd] = ptr;
+
+  return SUCCESS;
+}
+
+void bgp_evloop_del(struct bgp_evloop *evl, int fd)
+{
+#if defined HAVE_EPOLL_CREATE1
+  struct epoll_event ev;
+  int idx;
+#endif
+
+  if (!evl || fd < 0 || fd >= evl->ptr_max) return;
+
+#if defined HAVE_EPOLL_CREATE1
+  memset(&ev, 0, sizeof(ev));
+  epoll_ctl(evl->epfd, EPOLL_CTL_DEL, fd, &ev);
+
+  /* the fd number may be re-used before pending events are dispatched */
+  for (idx = evl->ready_idx; idx < evl->ready_num; idx++) {
+    if (evl->ready[idx].data.fd == fd) evl->ready[idx].data.fd = ERR;
+  }
+#else
+  FD_CLR(fd, &evl->bkp_read_descs);
+  FD_CLR(fd, &evl->read_descs);
+#endif
+
+  evl->ptr[fd] = NULL;
+}
+
+int bgp_evloop_wait(struct bgp_evloop *evl, struct timeval *timeout)
+{
+  int ret;
+
+  evl->ready_idx = 0;
+  evl->ready_num = 0;
+
+#if defined HAVE_EPOLL_CREATE1
+  ret = epoll_wait(evl->epfd, evl->ready, evl->ready_max, (timeout ? (timeout->tv_sec * 1000 + timeout->tv_usec / 1000) : -1));
+  if (ret > 0) evl->ready_num = ret;
+#else
+  memcpy(&evl->read_descs, &evl->bkp_read_descs, sizeof(evl->bkp_read_descs));
+  ret = select((evl->max_fd + 1), &evl->read_descs, NULL, NULL, timeout);
+  if (ret > 0) evl->ready_num = (evl->max_fd + 1);
+#endif
+
+  return ret;
+}
+
+/* returns the next ready fd, and the pointer it was added with, or ERR
+   when all of them were dispatched; each ready fd is returned once per
+   bgp_evloop_wait() so that no peer can starve the others */
+int bgp_evloop_next(struct bgp_evloop *evl, void **ptr)
+{
+  int fd;
+
+  while (evl->ready_idx < evl->ready_num) {
+#if defined HAVE_EPOLL_CREATE1
+    fd = evl->ready[evl->ready_idx].data.fd;
+    evl->ready_idx++;
+
+    if (fd == ERR) continue;
+#else
+    fd = evl->ready_idx;
+    evl->ready_idx++;
+
+    if (!FD_ISSET(fd, &evl->read_descs)) continue;
+#endif
+
+    if (ptr) *ptr = evl->ptr[fd];
+
+    return fd;
+  }
+
+  return ERR;
+}
+
+/* no-ops unless RIB updates are spread across BGP worker threads */
+void bgp_rib_lock(struct bgp_rt_structs *inter_domain_routing_db)
+{
+#if defined ENABLE_THREADS
+  if (inter_domain_routing_db && inter_domain_routing_db->lock)
+    pthread_mutex_lock(inter_domain_routing_db->lock);
+#endif
+}
+
+void bgp_rib_unlock(struct bgp_rt_structs *inter_domain_routing_db)
+{
+#if defined ENABLE_THREADS
+  if (inter_domain_routing_db && inter_domain_routing_db->lock)
+    pthread_mutex_unlock(inter_domain_routing_db->lock);
+#endif
+}
+
 struct bgp_rt_structs *bgp_select_routing_db(int peer_type)
 {
   if (peer_type < FUNC_TYPE_MAX) 
@@ -1079,9 +1250,11 @@ void bgp_link_misc_structs(struct bgp_misc_structs *bms)
   bms->table_per_peer_buckets = config.bgp_table_per_peer_buckets;
   bms->table_attr_hash_buckets = config.bgp_table_attr_hash_buckets;
   bms->table_per_peer_hash = config.bgp_table_per_peer_hash;
+  bms->table_per_peer_index = config.bgp_table_per_peer_index;
   bms->route_info_modulo = bgp_route_info_modulo;
   bms->bgp_lookup_find_peer = bgp_lookup_find_bgp_peer;
   bms->bgp_lookup_node_match_cmp = bgp_lookup_node_match_cmp_bgp;
+  bms->bgp_lookup_index_peer = bgp_lookup_index_peer_bgp;
 
   if (!bms->is_thread && !bms->dump_backend_methods) bms->skip_rib = TRUE;
 }
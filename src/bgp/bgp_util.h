@@ -55,6 +55,7 @@ EXT struct bgp_info *bgp_info_new(struct bgp_peer *);
 EXT void bgp_info_add(struct bgp_peer *, struct bgp_node *, struct bgp_info *, u_int32_t);
 EXT void bgp_info_delete(struct bgp_peer *, struct bgp_node *, struct bgp_info *, u_int32_t);
 EXT void bgp_info_free(struct bgp_peer *, struct bgp_info *);
+EXT void bgp_info_reclaim(void *);
 EXT void bgp_attr_init(int, struct bgp_rt_structs *);
 EXT struct bgp_attr *bgp_attr_intern(struct bgp_peer *, struct bgp_attr *);
 EXT void bgp_attr_unintern (struct bgp_peer *, struct bgp_attr *);
@@ -76,6 +77,14 @@ EXT void bgp_batch_increase_counter(struct bgp_peer_batch *);
 EXT void bgp_batch_decrease_counter(struct bgp_peer_batch *);
 EXT void bgp_batch_rollback(struct bgp_peer_batch *);
 
+EXT int bgp_evloop_init(struct bgp_evloop *, int);
+EXT int bgp_evloop_add(struct bgp_evloop *, int, void *);
+EXT void bgp_evloop_del(struct bgp_evloop *, int);
+EXT int bgp_evloop_wait(struct bgp_evloop *, struct timeval *);
+EXT int bgp_evloop_next(struct bgp_evloop *, void **);
+EXT void bgp_rib_lock(struct bgp_rt_structs *);
+EXT void bgp_rib_unlock(struct bgp_rt_structs *);
+
 EXT int bgp_peer_cmp(const void *, const void *);
 EXT int bgp_peer_host_addr_cmp(const void *, const void *);
 EXT void bgp_peer_free(void *);
@@ -59,7 +59,6 @@ void nfacctd_bmp_wrapper()
 void skinny_bmp_daemon()
 {
   int slen, clen, ret, rc, peers_idx, allowed, yes=1, no=0;
-  int peers_idx_rr = 0, max_peers_idx = 0;
   u_int32_t pkt_remaining_len=0;
   time_t now;
   afi_t afi;
@@ -78,8 +77,8 @@ void skinny_bmp_daemon()
   struct bgp_peer_batch bp_batch;
 
   /* select() stuff */
-  fd_set read_descs, bkp_read_descs;
-  int fd, select_fd, bkp_select_fd, recalc_fds, select_num;
+  struct bgp_evloop bmp_evl;
+  int fd, select_num;
 
   /* logdump time management */
   time_t dump_refresh_deadline;
@@ -261,16 +260,18 @@ void skinny_bmp_daemon()
     exit_all(1);
   }
 
-  rc = listen(config.bmp_sock, 1);
+  rc = listen(config.bmp_sock, SOMAXCONN);
   if (rc < 0) {
     Log(LOG_ERR, "ERROR ( %s/%s ): listen() failed (errno: %d).\n", config.name, bmp_misc_db->log_str, errno);
     exit_all(1);
   }
 
   /* Preparing for syncronous I/O multiplexing */
-  select_fd = 0;
-  FD_ZERO(&bkp_read_descs);
-  FD_SET(config.bmp_sock, &bkp_read_descs);
+  if (bgp_evloop_init(&bmp_evl, (config.nfacctd_bmp_max_peers + 1)) == ERR ||
+      bgp_evloop_add(&bmp_evl, config.bmp_sock, NULL) == ERR) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): I/O multiplexing setup failed (errno: %d).\n", config.name, bmp_misc_db->log_str, errno);
+    exit_all(1);
+  }
 
   {
     char srv_string[INET6_ADDRSTRLEN];
@@ -341,32 +342,11 @@ void skinny_bmp_daemon()
     if (config.bmp_dump_kafka_topic) bmp_dump_init_kafka_host();
   }
 
-  select_fd = bkp_select_fd = (config.bmp_sock + 1);
-  recalc_fds = FALSE;
-
   bmp_link_misc_structs(bmp_misc_db);
 
   for (;;) {
     select_again:
 
-    if (recalc_fds) {
-      select_fd = config.bmp_sock;
-      max_peers_idx = -1; /* .. since valid indexes include 0 */
-
-      for (peers_idx = 0; peers_idx < config.nfacctd_bmp_max_peers; peers_idx++) {
-        if (select_fd < bmp_peers[peers_idx].self.fd) select_fd = bmp_peers[peers_idx].self.fd;
-        if (bmp_peers[peers_idx].self.fd) max_peers_idx = peers_idx;
-      }
-      select_fd++;
-      max_peers_idx++;
-
-      bkp_select_fd = select_fd;
-      recalc_fds = FALSE;
-    }
-    else select_fd = bkp_select_fd;
-
-    memcpy(&read_descs, &bkp_read_descs, sizeof(bkp_read_descs));
-
     if (bmp_misc_db->dump_backend_methods) {
       int delta;
 
@@ -377,7 +357,7 @@ void skinny_bmp_daemon()
     }
     else drt_ptr = NULL;
 
-    select_num = select(select_fd, &read_descs, NULL, NULL, drt_ptr);
+    select_num = bgp_evloop_wait(&bmp_evl, drt_ptr);
     if (select_num < 0) goto select_again;
 
     if (reload_log_bmp_thread) {
@@ -437,8 +417,14 @@ void skinny_bmp_daemon()
     */
     if (!select_num) goto select_again;
 
+    /* Dispatching ready sockets, each one once per wakeup */
+    read_data:
+
+    fd = bgp_evloop_next(&bmp_evl, (void **) &bmpp);
+    if (fd == ERR) goto select_again;
+
     /* New connection is coming in */
-    if (FD_ISSET(config.bmp_sock, &read_descs)) {
+    if (fd == config.bmp_sock) {
       int peers_check_idx, peers_num;
 
       fd = accept(config.bmp_sock, (struct sockaddr *) &client, &clen);
@@ -475,7 +461,6 @@ void skinny_bmp_daemon()
 	      peer = NULL;
 	      bmpp = NULL;
 	    }
-            else recalc_fds = TRUE;
 
             log_notification_unset(&log_notifications.bgp_peers_throttling);
 
@@ -500,8 +485,6 @@ void skinny_bmp_daemon()
       }
 
       if (!peer) {
-        int fd;
-
         /* We briefly accept the new connection to be able to drop it */
         Log(LOG_ERR, "ERROR ( %s/%s ): Insufficient number of BMP peers has been configured by 'bmp_daemon_max_peers' (%d).\n",
                         config.name, bmp_misc_db->log_str, config.nfacctd_bmp_max_peers);
@@ -510,7 +493,11 @@ void skinny_bmp_daemon()
       }
 
       peer->fd = fd;
-      FD_SET(peer->fd, &bkp_read_descs);
+      if (bgp_evloop_add(&bmp_evl, peer->fd, bmpp) == ERR) {
+        Log(LOG_ERR, "ERROR ( %s/%s ): Unable to watch BMP peer socket (errno: %d).\n", config.name, bmp_misc_db->log_str, errno);
+        bmp_peer_close(bmpp, FUNC_TYPE_BMP);
+        goto read_data;
+      }
       peer->addr.family = ((struct sockaddr *)&client)->sa_family;
       if (peer->addr.family == AF_INET) {
         peer->addr.address.ipv4.s_addr = ((struct sockaddr_in *)&client)->sin_addr.s_addr;
@@ -545,37 +532,22 @@ void skinny_bmp_daemon()
       }
 
       Log(LOG_INFO, "INFO ( %s/%s ): [%s] BMP peers usage: %u/%u\n", config.name, bmp_misc_db->log_str, peer->addr_str, peers_num, config.nfacctd_bmp_max_peers);
-    }
 
-    read_data:
-
-    /*
-       We have something coming in: let's lookup which peer is that.
-       FvD: To avoid starvation of the "later established" peers, we
-       offset the start of the search in a round-robin style.
-    */
-    for (peer = NULL, peers_idx = 0; peers_idx < max_peers_idx; peers_idx++) {
-      int loc_idx = (peers_idx + peers_idx_rr) % max_peers_idx;
-
-      if (bmp_peers[loc_idx].self.fd && FD_ISSET(bmp_peers[loc_idx].self.fd, &read_descs)) {
-        peer = &bmp_peers[loc_idx].self;
-	bmpp = &bmp_peers[loc_idx];
-        peers_idx_rr = (peers_idx_rr + 1) % max_peers_idx;
-        break;
-      }
+      goto read_data;
     }
 
-    if (!peer) goto select_again;
+    /* We have something coming in: the peer is known straight from its fd */
+    if (!bmpp || bmpp->self.fd != fd) goto read_data;
+    peer = &bmpp->self;
 
     ret = recv(peer->fd, &peer->buf.base[peer->buf.truncated_len], (peer->buf.len - peer->buf.truncated_len), 0);
     peer->msglen = (ret + peer->buf.truncated_len);
 
     if (ret <= 0) {
       Log(LOG_INFO, "INFO ( %s/%s ): [%s] BMP connection reset by peer (%d).\n", config.name, bmp_misc_db->log_str, peer->addr_str, errno);
-      FD_CLR(peer->fd, &bkp_read_descs);
+      bgp_evloop_del(&bmp_evl, peer->fd);
       bmp_peer_close(bmpp, FUNC_TYPE_BMP);
-      recalc_fds = TRUE;
-      goto select_again;
+      goto read_data;
     }
     else {
       pkt_remaining_len = bmp_process_packet(peer->buf.base, peer->msglen, bmpp);
@@ -585,6 +557,8 @@ void skinny_bmp_daemon()
 									     pkt_remaining_len, peer->addr_str);
       else peer->buf.truncated_len = 0;
     }
+
+    goto read_data;
   }
 }
 
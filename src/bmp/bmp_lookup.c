@@ -124,3 +124,12 @@ int bgp_lookup_node_match_cmp_bmp(struct bgp_info *info, struct node_match_cmp_t
 
   return TRUE;
 }
+
+/* paths are looked up against the BMP session they were learnt from,
+   see bgp_lookup_find_bmp_peer() and bgp_lookup_node_match_cmp_bmp() */
+struct bgp_peer *bgp_lookup_index_peer_bmp(struct bgp_peer *peer)
+{
+  struct bmp_peer *bmpp = peer->bmp_se;
+
+  return &bmpp->self;
+}
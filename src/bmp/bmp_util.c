@@ -159,9 +159,11 @@ void bmp_link_misc_structs(struct bgp_misc_structs *bms)
   bms->table_per_peer_buckets = config.bmp_table_per_peer_buckets;
   bms->table_attr_hash_buckets = config.bmp_table_attr_hash_buckets;
   bms->table_per_peer_hash = config.bmp_table_per_peer_hash;
+  bms->table_per_peer_index = config.bmp_table_per_peer_index;
   bms->route_info_modulo = bmp_route_info_modulo;
   bms->bgp_lookup_find_peer = bgp_lookup_find_bmp_peer;
   bms->bgp_lookup_node_match_cmp = bgp_lookup_node_match_cmp_bmp;
+  bms->bgp_lookup_index_peer = bgp_lookup_index_peer_bmp;
 
   if (!bms->is_thread && !bms->dump_backend_methods) bms->skip_rib = TRUE;
 }
@@ -95,6 +95,7 @@ struct configuration {
   int buffer_immediate;
   int pipe_backlog;
   int pipe_check_core_pid;
+  int pipe_ring;
   int pipe_amqp;
   char *pipe_amqp_host;
   char *pipe_amqp_vhost;
@@ -197,6 +198,11 @@ struct configuration {
   u_int32_t nfacctd_as;
   u_int32_t nfacctd_net;
   int nfacctd_pipe_size;
+  int nfacctd_workers;
+  int nfacctd_worker_id;
+  int nfacctd_recv_batch;
+  int pmacctd_tpacket_v3;
+  u_int32_t pmacctd_tpacket_ring_size;
   int sfacctd_renormalize;
   int sfacctd_counter_output;
   char *sfacctd_counter_file;
@@ -310,6 +316,7 @@ struct configuration {
   int nfacctd_bgp_ipprec;
   char *nfacctd_bgp_allow_file;
   int nfacctd_bgp_max_peers;
+  int nfacctd_bgp_threads;
   int nfacctd_bgp_aspath_radius;
   char *nfacctd_bgp_stdcomm_pattern;
   char *nfacctd_bgp_extcomm_pattern;
@@ -342,6 +349,7 @@ struct configuration {
   int bgp_table_per_peer_buckets;
   int bgp_table_attr_hash_buckets;
   int bgp_table_per_peer_hash;
+  int bgp_table_per_peer_index;
   int bgp_table_dump_output;
   char *bgp_table_dump_file;
   char *bgp_table_dump_latest_file;
@@ -402,6 +410,7 @@ struct configuration {
   int bmp_table_per_peer_buckets;
   int bmp_table_attr_hash_buckets;
   int bmp_table_per_peer_hash;
+  int bmp_table_per_peer_index;
   int bmp_dump_output;
   char *bmp_dump_file;
   char *bmp_dump_latest_file;
@@ -516,6 +525,7 @@ struct configuration {
   char *tee_receivers;
   int tee_pipe_size;
   int tee_dissect_send_full_pkt;
+  int tee_batch_size;
   int uacctd_group;
   int uacctd_nl_size;
   int uacctd_threshold;
@@ -525,6 +535,8 @@ struct configuration {
   u_int16_t pkt_len_distrib_bins_lookup[ETHER_JUMBO_MTU+1];
   int use_ip_next_hop;
   int dump_max_writers;
+  int dump_purge_mode;
+  int dump_purge_threads;
   int tmp_asa_bi_flow;
   size_t thread_stack;
 };
@@ -1076,6 +1076,58 @@ int cfg_key_dump_max_writers(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_dump_purge_mode(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  lower_string(value_ptr);
+  if (!strcmp(value_ptr, "fork")) value = PURGE_MODE_FORK;
+  else if (!strcmp(value_ptr, "thread")) value = PURGE_MODE_THREAD;
+  else {
+    Log(LOG_WARNING, "WARN: [%s] Invalid purge mode value '%s'. Allowed values are: fork, thread.\n", filename, value_ptr);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.dump_purge_mode = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.dump_purge_mode = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_dump_purge_threads(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 1 || value > 64) {
+    Log(LOG_WARNING, "WARN: [%s] invalid '[print|kafka|amqp]_purge_threads' value. Allowed values are: 1 <= *_purge_threads <= 64.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.dump_purge_threads = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.dump_purge_threads = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
 int cfg_key_sql_trigger_exec(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -2076,6 +2128,28 @@ int cfg_key_plugin_pipe_check_core_pid(char *filename, char *name, char *value_p
   return changes;
 }
 
+int cfg_key_plugin_pipe_ring(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = parse_truefalse(value_ptr);
+  if (value < 0) return ERR;
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.pipe_ring = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.pipe_ring = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
 int cfg_key_plugin_pipe_amqp(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -2411,6 +2485,40 @@ int cfg_key_nfacctd_pipe_size(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_nfacctd_workers(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 1 || value > MAX_CORE_WORKERS) {
+    Log(LOG_WARNING, "WARN: [%s] '[nf|sf|pm]acctd_workers' has to be >= 1 and <= %u.\n", filename, MAX_CORE_WORKERS);
+    return ERR;
+  }
+
+  for (; list; list = list->next, changes++) list->cfg.nfacctd_workers = value;
+  if (name) Log(LOG_WARNING, "WARN: [%s] plugin name not supported for key '[nf|sf|pm]acctd_workers'. Globalized.\n", filename);
+
+  return changes;
+}
+
+int cfg_key_nfacctd_recv_batch(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 1 || value > MAX_RECV_BATCH) {
+    Log(LOG_WARNING, "WARN: [%s] '[nf|sf]acctd_recv_batch' has to be >= 1 and <= %u.\n", filename, MAX_RECV_BATCH);
+    return ERR;
+  }
+
+  for (; list; list = list->next, changes++) list->cfg.nfacctd_recv_batch = value;
+  if (name) Log(LOG_WARNING, "WARN: [%s] plugin name not supported for key '[nf|sf]acctd_recv_batch'. Globalized.\n", filename);
+
+  return changes;
+}
+
 int cfg_key_nfacctd_pro_rating(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -3493,6 +3601,23 @@ int cfg_key_nfacctd_bgp_max_peers(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_nfacctd_bgp_threads(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 1) {
+        Log(LOG_ERR, "WARN: [%s] 'bgp_daemon_threads' has to be >= 1.\n", filename);
+        return ERR;
+  }
+
+  for (; list; list = list->next, changes++) list->cfg.nfacctd_bgp_threads = value;
+  if (name) Log(LOG_WARNING, "WARN: [%s] plugin name not supported for key 'bgp_daemon_threads'. Globalized.\n", filename);
+
+  return changes;
+}
+
 int cfg_key_nfacctd_bgp_ip(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -3630,6 +3755,20 @@ int cfg_key_nfacctd_bgp_table_per_peer_hash(char *filename, char *name, char *va
   return changes;
 }
 
+int cfg_key_nfacctd_bgp_table_per_peer_index(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = parse_truefalse(value_ptr);
+  if (value < 0) return ERR;
+
+  for (; list; list = list->next, changes++) list->cfg.bgp_table_per_peer_index = value;
+  if (name) Log(LOG_WARNING, "WARN: [%s] plugin name not supported for key 'bgp_table_per_peer_index'. Globalized.\n", filename);
+
+  return changes;
+}
+
 int cfg_key_nfacctd_bgp_batch_interval(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -3922,6 +4061,20 @@ int cfg_key_nfacctd_bmp_table_per_peer_hash(char *filename, char *name, char *va
   return changes;
 }
 
+int cfg_key_nfacctd_bmp_table_per_peer_index(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = parse_truefalse(value_ptr);
+  if (value < 0) return ERR;
+
+  for (; list; list = list->next, changes++) list->cfg.bmp_table_per_peer_index = value;
+  if (name) Log(LOG_WARNING, "WARN: [%s] plugin name not supported for key 'bmp_table_per_peer_index'. Globalized.\n", filename);
+
+  return changes;
+}
+
 int cfg_key_nfacctd_bmp_msglog_file(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -4573,6 +4726,38 @@ int cfg_key_pmacctd_nonroot(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_pmacctd_tpacket_v3(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = parse_truefalse(value_ptr);
+  if (value < 0) return ERR;
+
+  for (; list; list = list->next, changes++) list->cfg.pmacctd_tpacket_v3 = value;
+  if (name) Log(LOG_WARNING, "WARN: [%s] plugin name not supported for key 'pmacctd_tpacket_v3'. Globalized.\n", filename);
+
+  return changes;
+}
+
+int cfg_key_pmacctd_tpacket_ring_size(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  u_int64_t value, changes = 0;
+  char *endptr;
+
+  value = strtoull(value_ptr, &endptr, 10);
+  if (value < TPACKET_V3_MIN_RING_SIZE || value > UINT_MAX) {
+    Log(LOG_WARNING, "WARN: [%s] 'pmacctd_tpacket_ring_size' has to be >= %u and <= UINT_MAX.\n", filename, TPACKET_V3_MIN_RING_SIZE);
+    return ERR;
+  }
+
+  for (; list; list = list->next, changes++) list->cfg.pmacctd_tpacket_ring_size = value;
+  if (name) Log(LOG_WARNING, "WARN: [%s] plugin name not supported for key 'pmacctd_tpacket_ring_size'. Globalized.\n", filename);
+
+  return changes;
+}
+
 int cfg_key_sfacctd_renormalize(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -5522,6 +5707,31 @@ int cfg_key_tee_dissect_send_full_pkt(char *filename, char *name, char *value_pt
   return changes;
 }
 
+int cfg_key_tee_batch_size(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 1 || value > MAX_TEE_BATCH) {
+    Log(LOG_WARNING, "WARN: [%s] 'tee_batch_size' has to be >= 1 and <= %u.\n", filename, MAX_TEE_BATCH);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.tee_batch_size = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.tee_batch_size = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
 void parse_time(char *filename, char *value, int *mu, int *howmany)
 {
   int k, j, len;
@@ -108,6 +108,7 @@ EXT int cfg_key_kafka_config_file(char *, char *, char *);
 EXT int cfg_key_plugin_pipe_size(char *, char *, char *);
 EXT int cfg_key_plugin_pipe_backlog(char *, char *, char *);
 EXT int cfg_key_plugin_pipe_check_core_pid(char *, char *, char *);
+EXT int cfg_key_plugin_pipe_ring(char *, char *, char *);
 EXT int cfg_key_plugin_pipe_amqp(char *, char *, char *);
 EXT int cfg_key_plugin_pipe_amqp_user(char *, char *, char *);
 EXT int cfg_key_plugin_pipe_amqp_passwd(char *, char *, char *);
@@ -148,6 +149,8 @@ EXT int cfg_key_nfacctd_net(char *, char *, char *);
 EXT int cfg_key_nfacctd_disable_checks(char *, char *, char *);
 EXT int cfg_key_nfacctd_mcast_groups(char *, char *, char *);
 EXT int cfg_key_nfacctd_pipe_size(char *, char *, char *);
+EXT int cfg_key_nfacctd_workers(char *, char *, char *);
+EXT int cfg_key_nfacctd_recv_batch(char *, char *, char *);
 EXT int cfg_key_nfacctd_pro_rating(char *, char *, char *);
 EXT int cfg_key_nfacctd_templates_file(char *, char *, char *);
 EXT int cfg_key_nfacctd_account_options(char *, char *, char *);
@@ -161,6 +164,8 @@ EXT int cfg_key_pmacctd_flow_lifetime(char *, char *, char *);
 EXT int cfg_key_pmacctd_flow_tcp_lifetime(char *, char *, char *);
 EXT int cfg_key_pmacctd_ext_sampling_rate(char *, char *, char *);
 EXT int cfg_key_pmacctd_nonroot(char *, char *, char *);
+EXT int cfg_key_pmacctd_tpacket_v3(char *, char *, char *);
+EXT int cfg_key_pmacctd_tpacket_ring_size(char *, char *, char *);
 EXT int cfg_key_sfacctd_renormalize(char *, char *, char *);
 EXT int cfg_key_sfacctd_counter_output(char *, char *, char *);
 EXT int cfg_key_sfacctd_counter_file(char *, char *, char *);
@@ -273,6 +278,7 @@ EXT int cfg_key_tee_max_receivers(char *, char *, char *);
 EXT int cfg_key_tee_max_receiver_pools(char *, char *, char *);
 EXT int cfg_key_tee_pipe_size(char *, char *, char *);
 EXT int cfg_key_tee_dissect_send_full_pkt(char *, char *, char *);
+EXT int cfg_key_tee_batch_size(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_msglog_output(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_msglog_file(char *, char *, char *);
@@ -297,6 +303,7 @@ EXT int cfg_key_nfacctd_bgp_msglog_kafka_partition_key(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_msglog_kafka_retry(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_msglog_kafka_config_file(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_max_peers(char *, char *, char *);
+EXT int cfg_key_nfacctd_bgp_threads(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_ip(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_id(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_as(char *, char *, char *);
@@ -329,6 +336,7 @@ EXT int cfg_key_nfacctd_bgp_table_peer_buckets(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_per_peer_buckets(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_attr_hash_buckets(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_per_peer_hash(char *, char *, char *);
+EXT int cfg_key_nfacctd_bgp_table_per_peer_index(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_dump_output(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_dump_file(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_dump_latest_file(char *, char *, char *);
@@ -392,6 +400,7 @@ EXT int cfg_key_nfacctd_bmp_table_peer_buckets(char *, char *, char *);
 EXT int cfg_key_nfacctd_bmp_table_per_peer_buckets(char *, char *, char *);
 EXT int cfg_key_nfacctd_bmp_table_attr_hash_buckets(char *, char *, char *);
 EXT int cfg_key_nfacctd_bmp_table_per_peer_hash(char *, char *, char *);
+EXT int cfg_key_nfacctd_bmp_table_per_peer_index(char *, char *, char *);
 EXT int cfg_key_nfacctd_bmp_dump_output(char *, char *, char *);
 EXT int cfg_key_nfacctd_bmp_dump_file(char *, char *, char *);
 EXT int cfg_key_nfacctd_bmp_dump_latest_file(char *, char *, char *);
@@ -432,6 +441,8 @@ EXT int cfg_key_uacctd_threshold(char *, char *, char *);
 EXT int cfg_key_tunnel_0(char *, char *, char *);
 EXT int cfg_key_pkt_len_distrib_bins(char *, char *, char *);
 EXT int cfg_key_dump_max_writers(char *, char *, char *);
+EXT int cfg_key_dump_purge_mode(char *, char *, char *);
+EXT int cfg_key_dump_purge_threads(char *, char *, char *);
 EXT int cfg_key_tmp_asa_bi_flow(char *, char *, char *);
 
 EXT void parse_time(char *, char *, int *, int *);
@@ -28,19 +28,22 @@
 #include "classifier.h"
 #include "jhash.h"
 
-u_int32_t conntrack_total_nodes_v4;
-u_int32_t conntrack_total_nodes_v6;
-
 void init_conntrack_table()
 {
-  if (config.conntrack_bufsz) conntrack_total_nodes_v4 = config.conntrack_bufsz / sizeof(struct conntrack_ipv4);
-  else conntrack_total_nodes_v4 = DEFAULT_CONNTRACK_BUFFER_SIZE / sizeof(struct conntrack_ipv4);
-  conntrack_ipv4_table = NULL;
+  u_int32_t total_nodes;
+
+  /* expectations may leave any primitive out, ie. they can't be hashed:
+     they are kept on a single chain, ageing out through the timer wheel */
+  if (config.conntrack_bufsz) total_nodes = config.conntrack_bufsz / sizeof(struct conntrack_ipv4);
+  else total_nodes = DEFAULT_CONNTRACK_BUFFER_SIZE / sizeof(struct conntrack_ipv4);
+  ip_table_init(&conntrack_ipv4_table, 1, 1, sizeof(struct conntrack_ipv4), total_nodes,
+		conntrack_ipv4_deadline, NULL);
 
 #if defined ENABLE_IPV6
-  if (config.conntrack_bufsz) conntrack_total_nodes_v6 = config.conntrack_bufsz / sizeof(struct conntrack_ipv6);
-  else conntrack_total_nodes_v6 = DEFAULT_CONNTRACK_BUFFER_SIZE / sizeof(struct conntrack_ipv6);
-  conntrack_ipv6_table = NULL;
+  if (config.conntrack_bufsz) total_nodes = config.conntrack_bufsz / sizeof(struct conntrack_ipv6);
+  else total_nodes = DEFAULT_CONNTRACK_BUFFER_SIZE / sizeof(struct conntrack_ipv6);
+  ip_table_init(&conntrack_ipv6_table, 1, 1, sizeof(struct conntrack_ipv6), total_nodes,
+		conntrack_ipv6_deadline, NULL);
 #endif
 }
 
@@ -341,33 +344,14 @@ void insert_conntrack_ipv4(time_t now, u_int32_t ip_src, u_int32_t ip_dst,
 			   u_int16_t port_src, u_int16_t port_dst, u_int8_t proto,
 			   pm_class_t class, conntrack_helper helper, time_t exp)
 {
-  int size = sizeof(struct conntrack_ipv4);
   struct conntrack_ipv4 *ct_elem;
 
-  if (conntrack_ipv4_table) {
-    ct_elem = conntrack_ipv4_table;
-    while (ct_elem->next && now < ct_elem->stamp+ct_elem->expiration)
-      ct_elem = ct_elem->next;
-
-    /* no entry expired and we reached the tail: let's allocate a new one */ 
-    if (now < ct_elem->stamp+ct_elem->expiration && !ct_elem->next) {
-      if (conntrack_total_nodes_v4) {
-        ct_elem->next = malloc(size);
-        ct_elem->next->next = NULL;
-        ct_elem = ct_elem->next;
-	conntrack_total_nodes_v4--;
-      }
-      else {
-	Log(LOG_INFO, "INFO ( %s/core ): Conntrack/4 buffer full. Skipping packet.\n", config.name);
-	return;
-      }
-    }
-  }
-  /* let's allocate our first element */
-  else {
-    conntrack_ipv4_table = malloc(size);
-    ct_elem = conntrack_ipv4_table;
-    ct_elem->next = NULL;
+  ip_table_expire(&conntrack_ipv4_table, now, IP_TABLE_EXPIRE_BATCH);
+
+  ct_elem = (struct conntrack_ipv4 *) ip_table_alloc(&conntrack_ipv4_table);
+  if (!ct_elem) {
+    Log(LOG_INFO, "INFO ( %s/core ): Conntrack/4 buffer full. Skipping packet.\n", config.name);
+    return;
   }
 
   ct_elem->ip_src = ip_src;
@@ -379,6 +363,15 @@ void insert_conntrack_ipv4(time_t now, u_int32_t ip_src, u_int32_t ip_dst,
   ct_elem->stamp = now;
   ct_elem->helper = helper;
   ct_elem->expiration = exp;
+  ip_table_insert(&conntrack_ipv4_table, &ct_elem->ent, 0, now);
+}
+
+time_t conntrack_ipv4_deadline(struct ip_table_entry *e, time_t now)
+{
+  struct conntrack_ipv4 *ct_elem = (struct conntrack_ipv4 *) e;
+
+  if (now < ct_elem->stamp+ct_elem->expiration) return ct_elem->stamp+ct_elem->expiration;
+  else return 0;
 }
 
 void search_conntrack(struct ip_flow_common *fp, struct packet_ptrs *pptrs, unsigned int idx)
@@ -391,13 +384,17 @@ void search_conntrack(struct ip_flow_common *fp, struct packet_ptrs *pptrs, unsi
 
 void search_conntrack_ipv4(struct ip_flow_common *fp, struct packet_ptrs *pptrs, unsigned int idx)
 {
-  struct conntrack_ipv4 *ct_elem = conntrack_ipv4_table, *aux = NULL;
+  struct ip_table_entry *e;
+  struct conntrack_ipv4 *ct_elem;
   struct my_iphdr *iphp = (struct my_iphdr *)pptrs->iph_ptr;
   struct my_tlhdr *tlhp = (struct my_tlhdr *)pptrs->tlh_ptr;
 
-  if (!conntrack_ipv4_table) return;
+  if (!conntrack_ipv4_table.count) return;
+
+  ip_table_expire(&conntrack_ipv4_table, fp->last[idx].tv_sec, IP_TABLE_EXPIRE_BATCH);
 
-  while (ct_elem) {
+  for (e = ip_table_lookup(&conntrack_ipv4_table, 0); e; e = e->next) {
+    ct_elem = (struct conntrack_ipv4 *) e;
 /*
     if (fp->last[idx] < ct_elem->stamp+CONNTRACK_GENERIC_LIFETIME) {
       printf("IP SRC: %x %x\n", iphp->ip_src.s_addr, ct_elem->ip_src);
@@ -422,18 +419,10 @@ void search_conntrack_ipv4(struct ip_flow_common *fp, struct packet_ptrs *pptrs,
       fp->class[0] = ct_elem->class;
       fp->class[1] = ct_elem->class;
       fp->conntrack_helper = ct_elem->helper;
-      ct_elem->stamp = 0;
-
-      /* no aux means we are facing the first element in the chain */
-      if (aux) aux->next = ct_elem->next;
-      else conntrack_ipv4_table = ct_elem->next;
-      free(ct_elem);
+      ip_table_remove(&conntrack_ipv4_table, e);
 
       return;
     }
-
-    aux = ct_elem;
-    ct_elem = ct_elem->next;
   }
 }
 
@@ -442,33 +431,14 @@ void insert_conntrack_ipv6(time_t now, struct in6_addr *ip_src, struct in6_addr
                            u_int16_t port_src, u_int16_t port_dst, u_int8_t proto,
                            pm_class_t class, conntrack_helper helper, time_t exp)
 {
-  int size = sizeof(struct conntrack_ipv4);
   struct conntrack_ipv6 *ct_elem;
 
-  if (conntrack_ipv6_table) {
-    ct_elem = conntrack_ipv6_table;
-    while (ct_elem->next && now < ct_elem->stamp+ct_elem->expiration)
-      ct_elem = ct_elem->next;
-
-    /* no entry expired and we reached the tail: let's allocate a new one */
-    if (now < ct_elem->stamp+ct_elem->expiration && !ct_elem->next) {
-      if (conntrack_total_nodes_v6) {
-	ct_elem->next = malloc(size);
-	ct_elem->next->next = NULL;
-	ct_elem = ct_elem->next;
-	conntrack_total_nodes_v6--;
-      }
-      else {
-        Log(LOG_INFO, "INFO ( %s/core ): Conntrack/6 buffer full. Skipping packet.\n", config.name);
-        return;
-      }
-    }
-  }
-  /* let's allocate our first element */
-  else {
-    conntrack_ipv6_table = malloc(size);
-    ct_elem = conntrack_ipv6_table;
-    ct_elem->next = NULL;
+  ip_table_expire(&conntrack_ipv6_table, now, IP_TABLE_EXPIRE_BATCH);
+
+  ct_elem = (struct conntrack_ipv6 *) ip_table_alloc(&conntrack_ipv6_table);
+  if (!ct_elem) {
+    Log(LOG_INFO, "INFO ( %s/core ): Conntrack/6 buffer full. Skipping packet.\n", config.name);
+    return;
   }
 
   memcpy(&ct_elem->ip_src, ip_src, IP6AddrSz);
@@ -480,17 +450,30 @@ void insert_conntrack_ipv6(time_t now, struct in6_addr *ip_src, struct in6_addr
   ct_elem->stamp = now;
   ct_elem->helper = helper;
   ct_elem->expiration = exp;
+  ip_table_insert(&conntrack_ipv6_table, &ct_elem->ent, 0, now);
+}
+
+time_t conntrack_ipv6_deadline(struct ip_table_entry *e, time_t now)
+{
+  struct conntrack_ipv6 *ct_elem = (struct conntrack_ipv6 *) e;
+
+  if (now < ct_elem->stamp+ct_elem->expiration) return ct_elem->stamp+ct_elem->expiration;
+  else return 0;
 }
 
 void search_conntrack_ipv6(struct ip_flow_common *fp, struct packet_ptrs *pptrs, unsigned int idx)
 {
-  struct conntrack_ipv6 *ct_elem = conntrack_ipv6_table, *aux = NULL;
+  struct ip_table_entry *e;
+  struct conntrack_ipv6 *ct_elem;
   struct ip6_hdr *iphp = (struct ip6_hdr *)pptrs->iph_ptr;
   struct my_tlhdr *tlhp = (struct my_tlhdr *)pptrs->tlh_ptr;
 
-  if (!conntrack_ipv6_table) return;
+  if (!conntrack_ipv6_table.count) return;
 
-  while (ct_elem) {
+  ip_table_expire(&conntrack_ipv6_table, fp->last[idx].tv_sec, IP_TABLE_EXPIRE_BATCH);
+
+  for (e = ip_table_lookup(&conntrack_ipv6_table, 0); e; e = e->next) {
+    ct_elem = (struct conntrack_ipv6 *) e;
     /* conntrack entries usually have incomplete informations about the upcoming
        data channels; missing primitives are to be considered always true; then,
        we assure a) full match on the remaining primitives and b) our conntrack
@@ -505,18 +488,10 @@ void search_conntrack_ipv6(struct ip_flow_common *fp, struct packet_ptrs *pptrs,
       fp->class[0] = ct_elem->class;
       fp->class[1] = ct_elem->class;
       fp->conntrack_helper = ct_elem->helper;
-      ct_elem->stamp = 0;
-
-      /* no aux means we are facing the first element in the chain */
-      if (aux) aux->next = ct_elem->next;
-      else conntrack_ipv6_table = ct_elem->next;
-      free(ct_elem);
+      ip_table_remove(&conntrack_ipv6_table, e);
 
       return;
     }
-
-    aux = ct_elem;
-    ct_elem = ct_elem->next;
   }
 }
 #endif
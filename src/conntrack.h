@@ -33,6 +33,7 @@ struct conntrack_helper_entry {
 };
 
 struct conntrack_ipv4 {
+  struct ip_table_entry ent;
   u_int32_t ip_src;
   u_int32_t ip_dst;
   u_int16_t port_src;
@@ -43,11 +44,11 @@ struct conntrack_ipv4 {
   time_t stamp;
   time_t expiration;
   conntrack_helper helper;
-  struct conntrack_ipv4 *next;
 };
 
 #if defined ENABLE_IPV6
 struct conntrack_ipv6 {
+  struct ip_table_entry ent;
   u_int32_t ip_src[4];
   u_int32_t ip_dst[4];
   u_int16_t port_src;
@@ -58,7 +59,6 @@ struct conntrack_ipv6 {
   time_t stamp;
   time_t expiration;
   conntrack_helper helper;
-  struct conntrack_ipv6 *next;
 };
 #endif
 
@@ -74,11 +74,13 @@ EXT void conntrack_rtsp_helper(time_t, struct packet_ptrs *);
 EXT void search_conntrack(struct ip_flow_common *, struct packet_ptrs *, unsigned int);
 EXT void search_conntrack_ipv4(struct ip_flow_common *, struct packet_ptrs *, unsigned int);
 EXT void insert_conntrack_ipv4(time_t, u_int32_t, u_int32_t, u_int16_t, u_int16_t, u_int8_t, pm_class_t, conntrack_helper, time_t);
-EXT struct conntrack_ipv4 *conntrack_ipv4_table;
+EXT time_t conntrack_ipv4_deadline(struct ip_table_entry *, time_t);
+EXT struct ip_table conntrack_ipv4_table;
 #if defined ENABLE_IPV6
 EXT void search_conntrack_ipv6(struct ip_flow_common *, struct packet_ptrs *, unsigned int);
 EXT void insert_conntrack_ipv6(time_t, struct in6_addr *, struct in6_addr *, u_int16_t, u_int16_t, u_int8_t, pm_class_t, conntrack_helper, time_t);
-EXT struct conntrack_ipv6 *conntrack_ipv6_table;
+EXT time_t conntrack_ipv6_deadline(struct ip_table_entry *, time_t);
+EXT struct ip_table conntrack_ipv6_table;
 #endif
 
 #undef EXT
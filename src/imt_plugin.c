@@ -161,25 +161,16 @@ void imt_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
     exit_plugin(1);
   }
 
+  /* 'imt_buckets' sizes both the index and the first memory pool: elements
+     are packed in there first, then in 'imt_mem_pools_size' sized pools */
   current_pool = request_memory_pool(config.buckets*sizeof(struct acc));
   if (current_pool == NULL) {
     Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate first memory pool, try with larger value.\n", config.name, config.type);
     exit_plugin(1);
   }
-  a = current_pool->base_ptr;
 
-  lru_elem_ptr = malloc(config.buckets*sizeof(struct acc *));
-  if (lru_elem_ptr == NULL) {
-    Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate LRU element pointers.\n", config.name, config.type);
-    exit_plugin(1);
-  }
-  else memset(lru_elem_ptr, 0, config.buckets*sizeof(struct acc *));
-
-  current_pool = request_memory_pool(config.memory_pool_size);
-  if (current_pool == NULL) {
-    Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate more memory pools, try with larger value.\n", config.name, config.type);
-    exit_plugin(1);
-  }
+  primitives_key_init(config.what_to_count, config.what_to_count_2);
+  imt_index_init(config.buckets);
 
   signal(SIGHUP, reload); /* handles reopening of syslog channel */
   signal(SIGINT, exit_now); /* exit lane */
@@ -380,13 +371,7 @@ void imt_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
         Log(LOG_ERR, "ERROR ( %s/%s ): Cannot allocate my first memory pool, try with larger value.\n", config.name, config.type);
         exit_plugin(1);
       }
-      a = current_pool->base_ptr;
-
-      current_pool = request_memory_pool(config.memory_pool_size);
-      if (current_pool == NULL) {
-        Log(LOG_ERR, "ERROR ( %s/%s ): Cannot allocate more memory pools, try with larger value.\n", config.name, config.type);
-        exit_plugin(1);
-      }
+      imt_index_reset();
       go_to_clear = FALSE;
       no_more_space = FALSE;
       memcpy(&table_reset_stamp, &cycle_stamp, sizeof(struct timeval));
@@ -572,15 +557,12 @@ void sum_mac_insert(struct primitives_ptrs *prim_ptrs)
 
 void free_extra_allocs()
 {
-  struct acc *acc_elem = NULL;
-  unsigned char *elem;
-  int following_chain = FALSE;
-  unsigned int idx;
+  struct acc *acc_elem;
+  u_int32_t idx = 0;
 
-  elem = (unsigned char *) a;
+  imt_index_complete();
 
-  for (idx = 0; idx < config.buckets; idx++) {
-    if (!following_chain) acc_elem = (struct acc *) elem;
+  while ((acc_elem = imt_index_walk(&idx))) {
     if (acc_elem->pbgp) {
       free(acc_elem->pbgp);
       acc_elem->pbgp = NULL;
@@ -606,14 +588,5 @@ void free_extra_allocs()
       free(acc_elem->pvlen);
       acc_elem->pvlen= NULL;
     }
-    if (acc_elem->next) {
-      acc_elem = acc_elem->next;
-      following_chain++;
-      idx--;
-    }
-    else {
-      elem += sizeof(struct acc);
-      following_chain = FALSE;
-    }
   }
 }
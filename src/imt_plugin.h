@@ -26,6 +26,12 @@
 #define MEMORY_POOL_SIZE 8192
 #define MAX_HOSTS 32771 
 #define MAX_QUERIES 4096
+#define IMT_INDEX_MIN_SIZE 1024
+#define IMT_INDEX_MIGRATE_STEP 32
+#define IMT_INDEX_EMPTY 0x00
+#define IMT_INDEX_MOVED 0x01
+#define IMT_INDEX_USED 0x80
+#define IMT_INDEX_TAG(h) (IMT_INDEX_USED | ((h) >> 25))
 
 /* Structures */
 struct acc {
@@ -45,7 +51,28 @@ struct acc {
   struct pkt_tunnel_primitives *ptun;
   char *pcust;
   struct pkt_vlen_hdr_primitives *pvlen;
-  struct acc *next;
+};
+
+/* open-addressing index over the accounting records: one tag byte per
+   slot (empty, moved or 0x80 | top 7 bits of the hash) is scanned first
+   so that probing rarely touches the slots or the records themselves */
+struct imt_slot {
+  u_int32_t hash;
+  struct acc *elem;
+};
+
+struct imt_table {
+  u_int8_t *tags;
+  struct imt_slot *slots;
+  u_int32_t size;			/* power of two */
+  u_int32_t mask;
+};
+
+struct imt_index {
+  struct imt_table cur;
+  struct imt_table old;			/* being migrated into 'cur' after a resize */
+  u_int32_t migrate_pos;
+  u_int32_t count;
 };
 
 struct bucket_desc {
@@ -130,6 +157,10 @@ struct imt_custom_primitives {
 EXT void insert_accounting_structure(struct primitives_ptrs *);
 EXT struct acc *search_accounting_structure(struct primitives_ptrs *);
 EXT int compare_accounting_structure(struct acc *, struct primitives_ptrs *);
+EXT void imt_index_init(u_int32_t);
+EXT void imt_index_reset();
+EXT void imt_index_complete();
+EXT struct acc *imt_index_walk(u_int32_t *);
 #undef EXT
 
 #if (!defined __MEMORY_C)
@@ -182,9 +213,8 @@ EXT void free_extra_allocs();
 #endif
 EXT void (*imt_insert_func)(struct primitives_ptrs *); /* pointer to INSERT function */
 EXT unsigned char *mpd;  /* memory pool descriptors table */
-EXT unsigned char *a;  /* accounting in-memory table */
+EXT struct imt_index imt_idx;  /* accounting in-memory table index */
 EXT struct memory_pool_desc *current_pool; /* pointer to currently used memory pool */
-EXT struct acc **lru_elem_ptr; /* pointer to Last Recently Used (lru) element in a bucket */
 EXT int no_more_space;
 EXT struct timeval cycle_stamp; /* timestamp for the current cycle */
 EXT struct timeval table_reset_stamp; /* global table reset timestamp */
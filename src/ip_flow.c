@@ -29,16 +29,12 @@
 #include "classifier.h"
 #include "jhash.h"
 
-u_int32_t flt_total_nodes;  
-time_t flt_prune_deadline;
 time_t flt_emergency_prune;
 time_t flow_generic_lifetime;
 time_t flow_tcpest_lifetime;
 u_int32_t flt_trivial_hash_rnd = 140281; /* ummmh */
 
 #if defined ENABLE_IPV6
-u_int32_t flt6_total_nodes;
-time_t flt6_prune_deadline;
 time_t flt6_emergency_prune;
 #endif
 
@@ -52,21 +48,15 @@ void init_ip_flow_handler()
 
 void init_ip4_flow_handler()
 {
-  int size;
+  u_int32_t total_nodes;
 
-  if (config.flow_bufsz) flt_total_nodes = config.flow_bufsz / sizeof(struct ip_flow);
-  else flt_total_nodes = DEFAULT_FLOW_BUFFER_SIZE / sizeof(struct ip_flow); 
+  if (config.flow_bufsz) total_nodes = config.flow_bufsz / sizeof(struct ip_flow);
+  else total_nodes = DEFAULT_FLOW_BUFFER_SIZE / sizeof(struct ip_flow); 
 
+  /* flow_hashsz is the initial size: the table grows along with the flows */
   if (!config.flow_hashsz) config.flow_hashsz = FLOW_TABLE_HASHSZ; 
-  size = sizeof(struct ip_flow) * config.flow_hashsz;
-  ip_flow_table = (struct ip_flow **) malloc(size);
-  assert(ip_flow_table);
-
-  memset(ip_flow_table, 0, size);
-  flow_lru_list.root = (struct ip_flow *) malloc(sizeof(struct ip_flow)); 
-  flow_lru_list.last = flow_lru_list.root;
-  memset(flow_lru_list.root, 0, sizeof(struct ip_flow));
-  flt_prune_deadline = time(NULL)+FLOW_TABLE_PRUNE_INTERVAL;
+  ip_table_init(&ip_flow_table, config.flow_hashsz, total_nodes/IP_TABLE_MAX_LOAD, sizeof(struct ip_flow),
+		total_nodes, flow_deadline, release_flow);
   flt_emergency_prune = 0; 
 
   if (config.flow_lifetime) flow_generic_lifetime = config.flow_lifetime;
@@ -85,11 +75,7 @@ void ip_flow_handler(struct packet_ptrs *pptrs)
 
   gettimeofday(&now, NULL);
 
-  if (now.tv_sec > flt_prune_deadline) {
-    prune_old_flows(&now);
-    flt_prune_deadline = now.tv_sec+FLOW_TABLE_PRUNE_INTERVAL;
-  }
-
+  ip_table_expire(&ip_flow_table, now.tv_sec, IP_TABLE_EXPIRE_BATCH);
   find_flow(&now, pptrs);
 }
 
@@ -141,16 +127,18 @@ void find_flow(struct timeval *now, struct packet_ptrs *pptrs)
   struct my_tcphdr my_tlh;
   struct my_iphdr *iphp = &my_iph;
   struct my_tlhdr *tlhp = (struct my_tlhdr *) &my_tlh;
-  struct ip_flow *fp, *candidate = NULL, *last_seen = NULL;
-  unsigned int idx, bucket;
+  struct ip_table_entry *e;
+  struct ip_flow *fp;
+  unsigned int idx, hash;
 
   memcpy(&my_iph, pptrs->iph_ptr, IP4HdrSz);
   memcpy(&my_tlh, pptrs->tlh_ptr, MyTCPHdrSz);
   idx = normalize_flow(&iphp->ip_src.s_addr, &iphp->ip_dst.s_addr, &tlhp->src_port, &tlhp->dst_port);
-  bucket = hash_flow(iphp->ip_src.s_addr, iphp->ip_dst.s_addr, tlhp->src_port, tlhp->dst_port, iphp->ip_p);
+  hash = hash_flow(iphp->ip_src.s_addr, iphp->ip_dst.s_addr, tlhp->src_port, tlhp->dst_port, iphp->ip_p);
 
-  for (fp = ip_flow_table[bucket]; fp; fp = fp->next) {
-    if (fp->ip_src == iphp->ip_src.s_addr && fp->ip_dst == iphp->ip_dst.s_addr &&
+  for (e = ip_table_lookup(&ip_flow_table, hash); e; e = e->next) {
+    fp = (struct ip_flow *) e;
+    if (e->hash == hash && fp->ip_src == iphp->ip_src.s_addr && fp->ip_dst == iphp->ip_dst.s_addr &&
 	fp->port_src == tlhp->src_port && fp->port_dst == tlhp->dst_port &&
 	fp->cmn.proto == iphp->ip_p) {
       /* flow found; will check for its lifetime */
@@ -174,147 +162,51 @@ void find_flow(struct timeval *now, struct packet_ptrs *pptrs)
 	return;
       } 
     }
-    if (!candidate && is_expired(now, &fp->cmn)) candidate = fp; 
-    last_seen = fp;
   } 
 
-  if (candidate) create_flow(now, candidate, TRUE, bucket, pptrs, iphp, tlhp, idx);
-  else create_flow(now, last_seen, FALSE, bucket, pptrs, iphp, tlhp, idx); 
+  create_flow(now, hash, pptrs, iphp, tlhp, idx);
 }
 
-void create_flow(struct timeval *now, struct ip_flow *fp, u_int8_t is_candidate, unsigned int bucket, struct packet_ptrs *pptrs, 
-		 struct my_iphdr *iphp, struct my_tlhdr *tlhp, unsigned int idx)
+void create_flow(struct timeval *now, unsigned int hash, struct packet_ptrs *pptrs, struct my_iphdr *iphp,
+		 struct my_tlhdr *tlhp, unsigned int idx)
 {
-  struct ip_flow *newf;
+  struct ip_flow *fp;
 
-  if (!flt_total_nodes) {
+  fp = (struct ip_flow *) ip_table_alloc(&ip_flow_table);
+  if (!fp) {
     if (now->tv_sec > flt_emergency_prune+FLOW_TABLE_EMER_PRUNE_INTERVAL) {
       Log(LOG_INFO, "INFO ( %s/core ): Flow/4 buffer full. Skipping flows.\n", config.name); 
       flt_emergency_prune = now->tv_sec;
-      prune_old_flows(now);
     }
     pptrs->new_flow = FALSE; 
     return;
   }
 
-  if (fp) {
-    /* a 'not candidate' is simply the tail (last node) of the
-       list. We need to allocate a new node */
-    if (!is_candidate) { 
-      newf = (struct ip_flow *) malloc(sizeof(struct ip_flow));
-      if (!newf) { 
-	if (now->tv_sec > flt_emergency_prune+FLOW_TABLE_EMER_PRUNE_INTERVAL) {
-	  Log(LOG_INFO, "INFO ( %s/core ): Flow/4 buffer finished memory. Skipping flows.\n", config.name);
-	  flt_emergency_prune = now->tv_sec;
-	  prune_old_flows(now);
-	}
-	pptrs->new_flow = FALSE;
-	return;
-      }
-      else flt_total_nodes--;
-      memset(newf, 0, sizeof(struct ip_flow));
-      fp->next = newf;
-      newf->prev = fp;  
-      flow_lru_list.last->lru_next = newf; /* placing new node as LRU tail */
-      newf->lru_prev = flow_lru_list.last;
-      flow_lru_list.last = newf;
-      fp = newf;
-    }
-    else {
-      if (fp->lru_next) { /* if fp->lru_next==NULL the node is already the tail */ 
-        fp->lru_prev->lru_next = fp->lru_next; 
-	fp->lru_next->lru_prev = fp->lru_prev;
-	flow_lru_list.last->lru_next = fp;
-	fp->lru_prev = flow_lru_list.last;
-	fp->lru_next = NULL;
-	flow_lru_list.last = fp;
-      }
-      clear_context_chain(&fp->cmn, 0);
-      clear_context_chain(&fp->cmn, 1);
-      memset(&fp->cmn, 0, sizeof(struct ip_flow_common));
-    }
-  }
-  else {
-    /*	we don't have any pointer to existing flows; this is because the
-	current bucket doesn't contain any node; we'll allocate the first
-	one */ 
-    fp = (struct ip_flow *) malloc(sizeof(struct ip_flow));  
-    if (!fp) {
-      if (now->tv_sec > flt_emergency_prune+FLOW_TABLE_EMER_PRUNE_INTERVAL) {
-        Log(LOG_INFO, "INFO ( %s/core ): Flow/4 buffer finished memory. Skipping flows.\n", config.name);
-        flt_emergency_prune = now->tv_sec;
-        prune_old_flows(now);
-      }
-      pptrs->new_flow = FALSE;
-      return;
-    }
-    else flt_total_nodes--;
-    memset(fp, 0, sizeof(struct ip_flow));
-    ip_flow_table[bucket] = fp;
-    flow_lru_list.last->lru_next = fp; /* placing new node as LRU tail */ 
-    fp->lru_prev = flow_lru_list.last;
-    flow_lru_list.last = fp;
-  }
-
   fp->ip_src = iphp->ip_src.s_addr;
   fp->ip_dst = iphp->ip_dst.s_addr;
   fp->port_src = tlhp->src_port;
   fp->port_dst = tlhp->dst_port;
   fp->cmn.proto = iphp->ip_p;
-  fp->cmn.bucket = bucket;
   evaluate_tcp_flags(now, pptrs, &fp->cmn, idx); 
   fp->cmn.last[idx].tv_sec = now->tv_sec; 
   fp->cmn.last[idx].tv_usec = now->tv_usec; 
+  ip_table_insert(&ip_flow_table, &fp->ent, hash, now->tv_sec);
 
   pptrs->new_flow = TRUE;
   if (config.classifiers_path) evaluate_classifiers(pptrs, &fp->cmn, idx); 
 }
 
-void prune_old_flows(struct timeval *now)
+time_t flow_deadline(struct ip_table_entry *e, time_t now)
 {
-  struct ip_flow *fp, *temp, *last_seen = flow_lru_list.root;
-
-  fp = flow_lru_list.root->lru_next;
-  while (fp) {
-    if (is_expired(now, &fp->cmn)) {
-      /* we found a stale element; we'll prune it */
-      if (fp->lru_next) temp = fp->lru_next;
-      else temp = NULL;
-
-      /* rearranging bucket's pointers */ 
-      if (fp->prev && fp->next) {
-	fp->prev->next = fp->next;
-        fp->next->prev = fp->prev;
-      }
-      else if (fp->prev) fp->prev->next = NULL;
-      else if (fp->next) {
-	ip_flow_table[fp->cmn.bucket] = fp->next;
-	fp->next->prev = NULL; 
-      }
-      else ip_flow_table[fp->cmn.bucket] = NULL;
-
-      /* rearranging LRU pointers */
-      if (fp->lru_next) {
-        fp->lru_next->lru_prev = fp->lru_prev;
-        fp->lru_prev->lru_next = fp->lru_next;
-      }
-      else fp->lru_prev->lru_next = NULL;
-
-      clear_context_chain(&fp->cmn, 0);
-      clear_context_chain(&fp->cmn, 1);
-      free(fp);
-      flt_total_nodes++;
+  return flow_cmn_deadline(&((struct ip_flow *) e)->cmn, now);
+}
 
-      if (temp) fp = temp;
-      else fp = NULL;
-    }
-    else {
-      last_seen = fp;
-      fp = fp->lru_next;
-    }
-  }
+void release_flow(struct ip_table_entry *e)
+{
+  struct ip_flow *fp = (struct ip_flow *) e;
 
-  flow_lru_list.last = last_seen;
+  clear_context_chain(&fp->cmn, 0);
+  clear_context_chain(&fp->cmn, 1);
 }
 
 unsigned int normalize_flow(u_int32_t *ip_src, u_int32_t *ip_dst,
@@ -353,7 +245,7 @@ unsigned int normalize_flow(u_int32_t *ip_src, u_int32_t *ip_dst,
 unsigned int hash_flow(u_int32_t ip_src, u_int32_t ip_dst,
 		u_int16_t port_src, u_int16_t port_dst, u_int8_t proto)
 {
-  return jhash_3words((u_int32_t)(port_src ^ port_dst) << 16 | proto, ip_src, ip_dst, flt_trivial_hash_rnd) & (config.flow_hashsz-1);
+  return jhash_3words((u_int32_t)(port_src ^ port_dst) << 16 | proto, ip_src, ip_dst, flt_trivial_hash_rnd);
 }
 
 /* is_expired() checks for the expiration of the bi-directional flow; returns: TRUE if
@@ -393,23 +285,48 @@ unsigned int is_expired_uni(struct timeval *now, struct ip_flow_common *fp, unsi
   return FALSE;
 }
 
+/* flow_cmn_deadline() returns zero if the bi-directional flow is expired or else
+   the first second at which it may be, following the same rules as is_expired() */
+time_t flow_cmn_deadline(struct ip_flow_common *fp, time_t now)
+{
+  struct timeval tv;
+  time_t lifetime, deadline = 0;
+  unsigned int idx;
+
+  tv.tv_sec = now;
+  tv.tv_usec = 0;
+  if (is_expired(&tv, fp)) return 0;
+
+  for (idx = 0; idx < 2; idx++) {
+    if (fp->proto == IPPROTO_TCP) {
+      if (!fp->tcp_flags[idx]) lifetime = flow_tcpest_lifetime;
+      else if (fp->tcp_flags[idx] & TH_RST) lifetime = FLOW_TCPRST_LIFETIME;
+      else if (fp->tcp_flags[idx] & TH_FIN) lifetime = FLOW_TCPFIN_LIFETIME;
+      else if (fp->tcp_flags[idx] & TH_SYN) lifetime = FLOW_TCPSYN_LIFETIME;
+      else lifetime = flow_tcpest_lifetime;
+    }
+    else lifetime = flow_generic_lifetime;
+
+    if (fp->last[idx].tv_sec+lifetime+1 > deadline) deadline = fp->last[idx].tv_sec+lifetime+1;
+  }
+
+  /* not expired yet, ie. TCP flags make it last longer: check again later */
+  if (deadline <= now) deadline = now+1;
+
+  return deadline;
+}
+
 #if defined ENABLE_IPV6
 void init_ip6_flow_handler()
 {
-  int size;
+  u_int32_t total_nodes;
 
-  if (config.flow_bufsz) flt6_total_nodes = config.flow_bufsz / sizeof(struct ip_flow6);
-  else flt6_total_nodes = DEFAULT_FLOW_BUFFER_SIZE / sizeof(struct ip_flow6);
+  if (config.flow_bufsz) total_nodes = config.flow_bufsz / sizeof(struct ip_flow6);
+  else total_nodes = DEFAULT_FLOW_BUFFER_SIZE / sizeof(struct ip_flow6);
 
   if (!config.flow_hashsz) config.flow_hashsz = FLOW_TABLE_HASHSZ;
-  size = sizeof(struct ip_flow6) * config.flow_hashsz;
-  ip_flow_table6 = (struct ip_flow6 **) malloc(size);
-
-  memset(ip_flow_table6, 0, size);
-  flow_lru_list6.root = (struct ip_flow6 *) malloc(sizeof(struct ip_flow6));
-  flow_lru_list6.last = flow_lru_list6.root;
-  memset(flow_lru_list6.root, 0, sizeof(struct ip_flow6));
-  flt6_prune_deadline = time(NULL)+FLOW_TABLE_PRUNE_INTERVAL;
+  ip_table_init(&ip_flow_table6, config.flow_hashsz, total_nodes/IP_TABLE_MAX_LOAD, sizeof(struct ip_flow6),
+		total_nodes, flow6_deadline, release_flow6);
   flt6_emergency_prune = 0;
 
   if (config.flow_lifetime) flow_generic_lifetime = config.flow_lifetime;
@@ -428,11 +345,7 @@ void ip_flow6_handler(struct packet_ptrs *pptrs)
 
   gettimeofday(&now, NULL);
 
-  if (now.tv_sec > flt6_prune_deadline) {
-    prune_old_flows6(&now);
-    flt6_prune_deadline = now.tv_sec+FLOW_TABLE_PRUNE_INTERVAL;
-  }
-
+  ip_table_expire(&ip_flow_table6, now.tv_sec, IP_TABLE_EXPIRE_BATCH);
   find_flow6(&now, pptrs);
 }
 
@@ -460,7 +373,7 @@ unsigned int hash_flow6(u_int32_t id, struct in6_addr *saddr, struct in6_addr *d
         c += id;
         __jhash_mix(a, b, c);
 
-        return c & (config.flow_hashsz - 1);
+        return c;
 }
 
 unsigned int normalize_flow6(struct in6_addr *saddr, struct in6_addr *daddr,
@@ -500,16 +413,18 @@ void find_flow6(struct timeval *now, struct packet_ptrs *pptrs)
   struct my_tcphdr my_tlh;
   struct ip6_hdr *iphp = &my_iph;
   struct my_tlhdr *tlhp = (struct my_tlhdr *) &my_tlh;
-  struct ip_flow6 *fp, *candidate = NULL, *last_seen = NULL;
-  unsigned int idx, bucket;
+  struct ip_table_entry *e;
+  struct ip_flow6 *fp;
+  unsigned int idx, hash;
 
   memcpy(&my_iph, pptrs->iph_ptr, IP6HdrSz);
   memcpy(&my_tlh, pptrs->tlh_ptr, MyTCPHdrSz);
   idx = normalize_flow6(&iphp->ip6_src, &iphp->ip6_dst, &tlhp->src_port, &tlhp->dst_port);
-  bucket = hash_flow6((tlhp->src_port << 16) | tlhp->dst_port, &iphp->ip6_src, &iphp->ip6_dst);
+  hash = hash_flow6((tlhp->src_port << 16) | tlhp->dst_port, &iphp->ip6_src, &iphp->ip6_dst);
 
-  for (fp = ip_flow_table6[bucket]; fp; fp = fp->next) {
-    if (!ip6_addr_cmp(&fp->ip_src, &iphp->ip6_src) && !ip6_addr_cmp(&fp->ip_dst, &iphp->ip6_dst) &&
+  for (e = ip_table_lookup(&ip_flow_table6, hash); e; e = e->next) {
+    fp = (struct ip_flow6 *) e;
+    if (e->hash == hash && !ip6_addr_cmp(&fp->ip_src, &iphp->ip6_src) && !ip6_addr_cmp(&fp->ip_dst, &iphp->ip6_dst) &&
         fp->port_src == tlhp->src_port && fp->port_dst == tlhp->dst_port &&
 	fp->cmn.proto == pptrs->l4_proto) {
       /* flow found; will check for its lifetime */
@@ -533,146 +448,50 @@ void find_flow6(struct timeval *now, struct packet_ptrs *pptrs)
 	return;
       }
     }
-    if (!candidate && is_expired(now, &fp->cmn)) candidate = fp;
-    last_seen = fp;
   }
 
-  create:
-  if (candidate) create_flow6(now, candidate, TRUE, bucket, pptrs, iphp, tlhp, idx);
-  else create_flow6(now, last_seen, FALSE, bucket, pptrs, iphp, tlhp, idx);
+  create_flow6(now, hash, pptrs, iphp, tlhp, idx);
 }
 
-void create_flow6(struct timeval *now, struct ip_flow6 *fp, u_int8_t is_candidate, unsigned int bucket,
-	          struct packet_ptrs *pptrs, struct ip6_hdr *iphp, struct my_tlhdr *tlhp, unsigned int idx)
+void create_flow6(struct timeval *now, unsigned int hash, struct packet_ptrs *pptrs, struct ip6_hdr *iphp,
+		  struct my_tlhdr *tlhp, unsigned int idx)
 {
-  struct ip_flow6 *newf;
+  struct ip_flow6 *fp;
 
-  if (!flt6_total_nodes) {
+  fp = (struct ip_flow6 *) ip_table_alloc(&ip_flow_table6);
+  if (!fp) {
     if (now->tv_sec > flt6_emergency_prune+FLOW_TABLE_EMER_PRUNE_INTERVAL) {
       Log(LOG_INFO, "INFO ( %s/core ): Flow/6 buffer full. Skipping flows.\n", config.name);
       flt6_emergency_prune = now->tv_sec;
-      prune_old_flows6(now);
     }
     pptrs->new_flow = FALSE;
     return;
   }
 
-  if (fp) {
-    /* a 'not candidate' is simply the tail (last node) of the
-       list. We need to allocate a new node */
-    if (!is_candidate) {
-      newf = (struct ip_flow6 *) malloc(sizeof(struct ip_flow6));
-      if (!newf) {
-	if (now->tv_sec > flt6_emergency_prune+FLOW_TABLE_EMER_PRUNE_INTERVAL) {
-	  Log(LOG_INFO, "INFO ( %s/core ): Flow/6 buffer full. Skipping flows.\n", config.name);
-	  flt6_emergency_prune = now->tv_sec;
-	  prune_old_flows6(now);
-	}
-        pptrs->new_flow = FALSE;
-	return;
-      }
-      else flt6_total_nodes--;
-      memset(newf, 0, sizeof(struct ip_flow6));
-      fp->next = newf;
-      newf->prev = fp;
-      flow_lru_list6.last->lru_next = newf; /* placing new node as LRU tail */
-      newf->lru_prev = flow_lru_list6.last;
-      flow_lru_list6.last = newf;
-      fp = newf;
-    }
-    else {
-      if (fp->lru_next) { /* if fp->lru_next==NULL the node is already the tail */
-        fp->lru_prev->lru_next = fp->lru_next;
-        fp->lru_next->lru_prev = fp->lru_prev;
-        flow_lru_list6.last->lru_next = fp;
-        fp->lru_prev = flow_lru_list6.last;
-        fp->lru_next = NULL;
-        flow_lru_list6.last = fp;
-      }
-      clear_context_chain(&fp->cmn, 0);
-      clear_context_chain(&fp->cmn, 1);
-      memset(&fp->cmn, 0, sizeof(struct ip_flow_common));
-    }
-  }
-  else {
-    /* we don't have any fragment pointer; this is because current
-       bucket doesn't contain any node; we'll allocate first one */
-    fp = (struct ip_flow6 *) malloc(sizeof(struct ip_flow6));
-    if (!fp) {
-      if (now->tv_sec > flt6_emergency_prune+FLOW_TABLE_EMER_PRUNE_INTERVAL) {
-        Log(LOG_INFO, "INFO ( %s/core ): Flow/6 buffer full. Skipping flows.\n", config.name);
-        flt6_emergency_prune = now->tv_sec;
-        prune_old_flows6(now);
-      }
-      pptrs->new_flow = FALSE;
-      return;
-    }
-    else flt6_total_nodes--;
-    memset(fp, 0, sizeof(struct ip_flow6));
-    ip_flow_table6[bucket] = fp;
-    flow_lru_list6.last->lru_next = fp; /* placing new node as LRU tail */
-    fp->lru_prev = flow_lru_list6.last;
-    flow_lru_list6.last = fp;
-  }
-
   ip6_addr_cpy(&fp->ip_src, &iphp->ip6_src);
   ip6_addr_cpy(&fp->ip_dst, &iphp->ip6_dst);
   fp->port_src = tlhp->src_port;
   fp->port_dst = tlhp->dst_port;
   fp->cmn.proto = pptrs->l4_proto;
-  fp->cmn.bucket = bucket;
   evaluate_tcp_flags(now, pptrs, &fp->cmn, idx);
   fp->cmn.last[idx].tv_sec = now->tv_sec;
   fp->cmn.last[idx].tv_usec = now->tv_usec;
+  ip_table_insert(&ip_flow_table6, &fp->ent, hash, now->tv_sec);
 
   pptrs->new_flow = TRUE;
   if (config.classifiers_path) evaluate_classifiers(pptrs, &fp->cmn, idx); 
 }
 
-void prune_old_flows6(struct timeval *now)
+time_t flow6_deadline(struct ip_table_entry *e, time_t now)
 {
-  struct ip_flow6 *fp, *temp, *last_seen = flow_lru_list6.root;
-
-  fp = flow_lru_list6.root->lru_next;
-  while (fp) {
-    if (is_expired(now, &fp->cmn)) {
-      /* we found a stale element; we'll prune it */
-      if (fp->lru_next) temp = fp->lru_next;
-      else temp = NULL;
-
-      /* rearranging bucket's pointers */
-      if (fp->prev && fp->next) {
-        fp->prev->next = fp->next;
-        fp->next->prev = fp->prev;
-      }
-      else if (fp->prev) fp->prev->next = NULL;
-      else if (fp->next) {
-        ip_flow_table6[fp->cmn.bucket] = fp->next;
-        fp->next->prev = NULL;
-      }
-      else ip_flow_table6[fp->cmn.bucket] = NULL;
-
-      /* rearranging LRU pointers */
-      if (fp->lru_next) {
-        fp->lru_next->lru_prev = fp->lru_prev;
-        fp->lru_prev->lru_next = fp->lru_next;
-      }
-      else fp->lru_prev->lru_next = NULL;
-
-      clear_context_chain(&fp->cmn, 0);
-      clear_context_chain(&fp->cmn, 1);
-      free(fp);
-      flt6_total_nodes++;
+  return flow_cmn_deadline(&((struct ip_flow6 *) e)->cmn, now);
+}
 
-      if (temp) fp = temp;
-      else fp = NULL;
-    }
-    else {
-      last_seen = fp;
-      fp = fp->lru_next;
-    }
-  }
+void release_flow6(struct ip_table_entry *e)
+{
+  struct ip_flow6 *fp = (struct ip_flow6 *) e;
 
-  flow_lru_list6.last = last_seen;
+  clear_context_chain(&fp->cmn, 0);
+  clear_context_chain(&fp->cmn, 1);
 }
 #endif
@@ -22,6 +22,8 @@
 #ifndef _IP_FLOW_H_
 #define _IP_FLOW_H_
 
+#include "ip_table.h"
+
 /* defines */
 #define FLOW_TABLE_HASHSZ 256 
 #define FLOW_GENERIC_LIFETIME 60 
@@ -29,7 +31,6 @@
 #define FLOW_TCPEST_LIFETIME 432000
 #define FLOW_TCPFIN_LIFETIME 30 
 #define FLOW_TCPRST_LIFETIME 10 
-#define FLOW_TABLE_PRUNE_INTERVAL 3600 
 #define FLOW_TABLE_EMER_PRUNE_INTERVAL 60
 #define DEFAULT_FLOW_BUFFER_SIZE 16384000 /* 16 Mb */
 
@@ -45,7 +46,6 @@ struct ip_flow_common {
      [0] = forward flow data
      [1] = reverse flow data
   */
-  u_int16_t bucket;
   struct timeval last[2];
   u_int32_t last_tcp_seq;
   u_int8_t tcp_flags[2];
@@ -59,6 +59,7 @@ struct ip_flow_common {
 };
 
 struct ip_flow {
+  struct ip_table_entry ent;
   struct ip_flow_common cmn;
   u_int32_t ip_src;
   u_int32_t ip_dst;
@@ -66,33 +67,16 @@ struct ip_flow {
   u_int16_t port_dst;
   char *bgp_src; /* pointer to bgp_node structure for source prefix, if any */
   char *bgp_dst; /* pointer to bgp_node structure for destination prefix, if any */
-  struct ip_flow *lru_next;
-  struct ip_flow *lru_prev;
-  struct ip_flow *next;
-  struct ip_flow *prev;
-};
-
-struct flow_lru_l {
-  struct ip_flow *root;
-  struct ip_flow *last;
 };
 
 #if defined ENABLE_IPV6
 struct ip_flow6 {
+  struct ip_table_entry ent;
   struct ip_flow_common cmn;
   u_int32_t ip_src[4];
   u_int32_t ip_dst[4];
   u_int16_t port_src;
   u_int16_t port_dst;
-  struct ip_flow6 *lru_next;
-  struct ip_flow6 *lru_prev;
-  struct ip_flow6 *next;
-  struct ip_flow6 *prev;
-};
-
-struct flow_lru_l6 {
-  struct ip_flow6 *root;
-  struct ip_flow6 *last;
 };
 #endif
 
@@ -106,13 +90,15 @@ EXT void init_ip_flow_handler(); /* wrapper */
 EXT void init_ip4_flow_handler(); 
 EXT void ip_flow_handler(struct packet_ptrs *); 
 EXT void find_flow(struct timeval *, struct packet_ptrs *); 
-EXT void create_flow(struct timeval *, struct ip_flow *, u_int8_t, unsigned int, struct packet_ptrs *, struct my_iphdr *, struct my_tlhdr *, unsigned int); 
-EXT void prune_old_flows(struct timeval *); 
+EXT void create_flow(struct timeval *, unsigned int, struct packet_ptrs *, struct my_iphdr *, struct my_tlhdr *, unsigned int); 
+EXT time_t flow_deadline(struct ip_table_entry *, time_t);
+EXT void release_flow(struct ip_table_entry *);
 
 EXT unsigned int hash_flow(u_int32_t, u_int32_t, u_int16_t, u_int16_t, u_int8_t);
 EXT unsigned int normalize_flow(u_int32_t *, u_int32_t *, u_int16_t *, u_int16_t *);
 EXT unsigned int is_expired(struct timeval *, struct ip_flow_common *);
 EXT unsigned int is_expired_uni(struct timeval *, struct ip_flow_common *, unsigned int);
+EXT time_t flow_cmn_deadline(struct ip_flow_common *, time_t);
 EXT void evaluate_tcp_flags(struct timeval *, struct packet_ptrs *, struct ip_flow_common *, unsigned int);
 EXT void clear_tcp_flow_cmn(struct ip_flow_common *, unsigned int);
 
@@ -122,17 +108,16 @@ EXT void ip_flow6_handler(struct packet_ptrs *);
 EXT unsigned int hash_flow6(u_int32_t, struct in6_addr *, struct in6_addr *);
 EXT unsigned int normalize_flow6(struct in6_addr *, struct in6_addr *, u_int16_t *, u_int16_t *);
 EXT void find_flow6(struct timeval *, struct packet_ptrs *);
-EXT void create_flow6(struct timeval *, struct ip_flow6 *, u_int8_t, unsigned int, struct packet_ptrs *, struct ip6_hdr *, struct my_tlhdr *, unsigned int);
-EXT void prune_old_flows6(struct timeval *); 
+EXT void create_flow6(struct timeval *, unsigned int, struct packet_ptrs *, struct ip6_hdr *, struct my_tlhdr *, unsigned int);
+EXT time_t flow6_deadline(struct ip_table_entry *, time_t);
+EXT void release_flow6(struct ip_table_entry *);
 #endif
 
 /* global vars */
-EXT struct ip_flow **ip_flow_table;
-EXT struct flow_lru_l flow_lru_list;
+EXT struct ip_table ip_flow_table;
 
 #if defined ENABLE_IPV6
-EXT struct ip_flow6 **ip_flow_table6;
-EXT struct flow_lru_l6 flow_lru_list6;
+EXT struct ip_table ip_flow_table6;
 #endif
 #undef EXT
 
@@ -29,14 +29,10 @@
 #include "ip_frag.h"
 #include "jhash.h"
 
-u_int32_t ipft_total_nodes;  
-time_t prune_deadline;
 time_t emergency_prune;
 u_int32_t trivial_hash_rnd = 140281; /* ummmh */
 
 #if defined ENABLE_IPV6
-u_int32_t ipft6_total_nodes;
-time_t prune_deadline6;
 time_t emergency_prune6;
 #endif
 
@@ -50,14 +46,13 @@ void init_ip_fragment_handler()
 
 void init_ip4_fragment_handler()
 {
-  if (config.frag_bufsz) ipft_total_nodes = config.frag_bufsz / sizeof(struct ip_fragment);
-  else ipft_total_nodes = DEFAULT_FRAG_BUFFER_SIZE / sizeof(struct ip_fragment); 
-
-  memset(ipft, 0, sizeof(ipft));
-  lru_list.root = (struct ip_fragment *) malloc(sizeof(struct ip_fragment)); 
-  lru_list.last = lru_list.root;
-  memset(lru_list.root, 0, sizeof(struct ip_fragment));
-  prune_deadline = time(NULL)+PRUNE_INTERVAL;
+  u_int32_t total_nodes;
+
+  if (config.frag_bufsz) total_nodes = config.frag_bufsz / sizeof(struct ip_fragment);
+  else total_nodes = DEFAULT_FRAG_BUFFER_SIZE / sizeof(struct ip_fragment); 
+
+  ip_table_init(&ipft, IPFT_HASHSZ, total_nodes/IP_TABLE_MAX_LOAD, sizeof(struct ip_fragment),
+		total_nodes, fragment_deadline, release_fragment);
   emergency_prune = 0;
 }
 
@@ -65,22 +60,21 @@ int ip_fragment_handler(struct packet_ptrs *pptrs)
 {
   u_int32_t now = time(NULL);
 
-  if (now > prune_deadline) {
-    prune_old_fragments(now, PRUNE_OFFSET);
-    prune_deadline = now+PRUNE_INTERVAL;
-  }
+  ip_table_expire(&ipft, now, IP_TABLE_EXPIRE_BATCH);
   return find_fragment(now, pptrs);
 }
 
 int find_fragment(u_int32_t now, struct packet_ptrs *pptrs)
 {
   struct my_iphdr *iphp = (struct my_iphdr *)pptrs->iph_ptr;
-  struct ip_fragment *fp, *candidate = NULL, *last_seen = NULL;
-  unsigned int bucket = hash_fragment(iphp->ip_id, iphp->ip_src.s_addr,
-				      iphp->ip_dst.s_addr, iphp->ip_p);
-
-  for (fp = ipft[bucket]; fp; fp = fp->next) {
-    if (fp->ip_id == iphp->ip_id && fp->ip_src == iphp->ip_src.s_addr &&
+  struct ip_table_entry *e;
+  struct ip_fragment *fp;
+  unsigned int hash = hash_fragment(iphp->ip_id, iphp->ip_src.s_addr,
+				    iphp->ip_dst.s_addr, iphp->ip_p);
+
+  for (e = ip_table_lookup(&ipft, hash); e; e = e->next) {
+    fp = (struct ip_fragment *) e;
+    if (e->hash == hash && fp->ip_id == iphp->ip_id && fp->ip_src == iphp->ip_src.s_addr &&
 	fp->ip_dst == iphp->ip_dst.s_addr && fp->ip_p == iphp->ip_p) {
       /* fragment found; will check for its deadline */
       if (fp->deadline > now) {
@@ -112,88 +106,38 @@ int find_fragment(u_int32_t now, struct packet_ptrs *pptrs)
 	}
       } 
       else {
-	candidate = fp;
-	if (!candidate->got_first) notify_orphan_fragment(candidate);
-	goto create;
+	/* stale fragment, not yet reaped: will be recycled */
+	if (!fp->got_first) notify_orphan_fragment(fp);
+	return create_fragment(now, fp, hash, pptrs);
       }
     }
-    if ((fp->deadline < now) && !candidate) {
-      candidate = fp; 
-      if (!candidate->got_first) notify_orphan_fragment(candidate);
-    }
-    last_seen = fp;
   } 
 
-  create:
-  if (candidate) return create_fragment(now, candidate, TRUE, bucket, pptrs);
-  else return create_fragment(now, last_seen, FALSE, bucket, pptrs); 
+  return create_fragment(now, NULL, hash, pptrs); 
 }
 
-int create_fragment(u_int32_t now, struct ip_fragment *fp, u_int8_t is_candidate, unsigned int bucket, struct packet_ptrs *pptrs)
+/* create_fragment() recycles 'fp' if it's a stale entry for the same datagram
+   or else allocates a new one */
+int create_fragment(u_int32_t now, struct ip_fragment *fp, unsigned int hash, struct packet_ptrs *pptrs)
 {
   struct my_iphdr *iphp = (struct my_iphdr *)pptrs->iph_ptr;
-  struct ip_fragment *newf;
-
-  if (!ipft_total_nodes) {
-    if (now > emergency_prune+EMER_PRUNE_INTERVAL) {
-      Log(LOG_INFO, "INFO ( %s/core ): Fragment/4 buffer full. Skipping fragments.\n", config.name);
-      emergency_prune = now;
-      prune_old_fragments(now, 0);
-    }
-    return FALSE; 
-  }
+  u_int8_t is_new = FALSE;
 
-  if (fp) {
-    /* a 'not candidate' is simply the tail (last node) of the
-       list. We need to allocate a new node */
-    if (!is_candidate) { 
-      newf = (struct ip_fragment *) malloc(sizeof(struct ip_fragment));
-      if (!newf) { 
-	if (now > emergency_prune+EMER_PRUNE_INTERVAL) {
-	  Log(LOG_INFO, "INFO ( %s/core ): Fragment/4 buffer full. Skipping fragments.\n", config.name);
-	  emergency_prune = now;
-	  prune_old_fragments(now, 0);
-	}
-	return FALSE;
-      }
-      else ipft_total_nodes--;
-      memset(newf, 0, sizeof(struct ip_fragment));
-      fp->next = newf;
-      newf->prev = fp;  
-      lru_list.last->lru_next = newf; /* placing new node as LRU tail */
-      newf->lru_prev = lru_list.last;
-      lru_list.last = newf;
-      fp = newf;
-    }
-    else {
-      if (fp->lru_next) { /* if fp->lru_next==NULL the node is already the tail */ 
-        fp->lru_prev->lru_next = fp->lru_next; 
-	fp->lru_next->lru_prev = fp->lru_prev;
-	lru_list.last->lru_next = fp;
-	fp->lru_prev = lru_list.last;
-	fp->lru_next = NULL;
-	lru_list.last = fp;
-      }
-    }
-  }
-  else {
-    /* we don't have any fragment pointer; this is because current
-       bucket doesn't contain any node; we'll allocate first one */ 
-    fp = (struct ip_fragment *) malloc(sizeof(struct ip_fragment));  
+  if (!fp) {
+    fp = (struct ip_fragment *) ip_table_alloc(&ipft);
     if (!fp) {
       if (now > emergency_prune+EMER_PRUNE_INTERVAL) {
         Log(LOG_INFO, "INFO ( %s/core ): Fragment/4 buffer full. Skipping fragments.\n", config.name);
         emergency_prune = now;
-        prune_old_fragments(now, 0);
       }
       return FALSE;
     }
-    else ipft_total_nodes--;
-    memset(fp, 0, sizeof(struct ip_fragment));
-    ipft[bucket] = fp;
-    lru_list.last->lru_next = fp; /* placing new node as LRU tail */ 
-    fp->lru_prev = lru_list.last;
-    lru_list.last = fp;
+    is_new = TRUE;
+  }
+  else {
+    fp->got_first = FALSE;
+    fp->a = 0;
+    fp->pa = 0;
   }
 
   fp->deadline = now+IPF_TIMEOUT;
@@ -201,7 +145,7 @@ int create_fragment(u_int32_t now, struct ip_fragment *fp, u_int8_t is_candidate
   fp->ip_p = iphp->ip_p;
   fp->ip_src = iphp->ip_src.s_addr;
   fp->ip_dst = iphp->ip_dst.s_addr;
-  fp->bucket = bucket;
+  if (is_new) ip_table_insert(&ipft, &fp->ent, hash, now);
 
   if (!(iphp->ip_off & htons(IP_OFFMASK))) {
     /* it's a first fragment */
@@ -219,51 +163,26 @@ int create_fragment(u_int32_t now, struct ip_fragment *fp, u_int8_t is_candidate
   }
 }
 
-void prune_old_fragments(u_int32_t now, u_int32_t off)
+time_t fragment_deadline(struct ip_table_entry *e, time_t now)
 {
-  struct ip_fragment *fp, *temp;
-  u_int32_t deadline = now-off;
-
-  fp = lru_list.root->lru_next;
-  while (fp) {
-    if (deadline > fp->deadline) {
-      /* we found a stale element; we'll prune it */
-      if (fp->lru_next) temp = fp->lru_next;
-      else temp = NULL;
-
-      /* rearranging bucket's pointers */ 
-      if (fp->prev && fp->next) {
-	fp->prev->next = fp->next;
-        fp->next->prev = fp->prev;
-      }
-      else if (fp->prev) fp->prev->next = NULL;
-      else if (fp->next) {
-	ipft[fp->bucket] = fp->next;
-	fp->next->prev = NULL; 
-      }
-      else ipft[fp->bucket] = NULL;
+  struct ip_fragment *fp = (struct ip_fragment *) e;
 
-      free(fp);
-      ipft_total_nodes++;
+  if (fp->deadline > now) return fp->deadline;
+  else return 0;
+}
 
-      if (temp) fp = temp;
-      else fp = NULL;
-    }
-    else break;
-  }
+void release_fragment(struct ip_table_entry *e)
+{
+  struct ip_fragment *fp = (struct ip_fragment *) e;
 
-  if (fp) {
-    fp->lru_prev = lru_list.root;
-    lru_list.root->lru_next = fp;
-  }
-  else lru_list.last = lru_list.root;
+  if (!fp->got_first) notify_orphan_fragment(fp);
 }
 
 /* hash_fragment() is taken (it has another name there) from Linux kernel 2.4;
    see full credits contained in jhash.h */ 
 unsigned int hash_fragment(u_int16_t id, u_int32_t src, u_int32_t dst, u_int8_t proto)
 {
-  return jhash_3words((u_int32_t)id << 16 | proto, src, dst, trivial_hash_rnd) & (IPFT_HASHSZ-1);
+  return jhash_3words((u_int32_t)id << 16 | proto, src, dst, trivial_hash_rnd);
 }
 
 void notify_orphan_fragment(struct ip_fragment *frag)
@@ -285,14 +204,13 @@ void notify_orphan_fragment(struct ip_fragment *frag)
 #if defined ENABLE_IPV6
 void init_ip6_fragment_handler()
 {
-  if (config.frag_bufsz) ipft6_total_nodes = config.frag_bufsz / sizeof(struct ip6_fragment);
-  else ipft6_total_nodes = DEFAULT_FRAG_BUFFER_SIZE / sizeof(struct ip6_fragment);
-
-  memset(ipft6, 0, sizeof(ipft6));
-  lru_list6.root = (struct ip6_fragment *) malloc(sizeof(struct ip6_fragment));
-  lru_list6.last = lru_list6.root;
-  memset(lru_list6.root, 0, sizeof(struct ip6_fragment));
-  prune_deadline6 = time(NULL)+PRUNE_INTERVAL;
+  u_int32_t total_nodes;
+
+  if (config.frag_bufsz) total_nodes = config.frag_bufsz / sizeof(struct ip6_fragment);
+  else total_nodes = DEFAULT_FRAG_BUFFER_SIZE / sizeof(struct ip6_fragment);
+
+  ip_table_init(&ipft6, IPFT_HASHSZ, total_nodes/IP_TABLE_MAX_LOAD, sizeof(struct ip6_fragment),
+		total_nodes, fragment6_deadline, release_fragment6);
   emergency_prune6 = 0;
 }
 
@@ -300,10 +218,7 @@ int ip6_fragment_handler(struct packet_ptrs *pptrs, struct ip6_frag *fhdr)
 {
   u_int32_t now = time(NULL);
 
-  if (now > prune_deadline6) {
-    prune_old_fragments6(now, PRUNE_OFFSET);
-    prune_deadline6 = now+PRUNE_INTERVAL;
-  }
+  ip_table_expire(&ipft6, now, IP_TABLE_EXPIRE_BATCH);
   return find_fragment6(now, pptrs, fhdr);
 }
 
@@ -331,17 +246,19 @@ unsigned int hash_fragment6(u_int32_t id, struct in6_addr *saddr, struct in6_add
         c += id;
         __jhash_mix(a, b, c);
 
-        return c & (IPFT_HASHSZ - 1);
+        return c;
 }
 
 int find_fragment6(u_int32_t now, struct packet_ptrs *pptrs, struct ip6_frag *fhdr)
 {
   struct ip6_hdr *iphp = (struct ip6_hdr *)pptrs->iph_ptr;
-  struct ip6_fragment *fp, *candidate = NULL, *last_seen = NULL;
-  unsigned int bucket = hash_fragment6(fhdr->ip6f_ident, &iphp->ip6_src, &iphp->ip6_dst);
+  struct ip_table_entry *e;
+  struct ip6_fragment *fp;
+  unsigned int hash = hash_fragment6(fhdr->ip6f_ident, &iphp->ip6_src, &iphp->ip6_dst);
 
-  for (fp = ipft6[bucket]; fp; fp = fp->next) {
-    if (fp->id == fhdr->ip6f_ident && !ip6_addr_cmp(&fp->src, &iphp->ip6_src) &&
+  for (e = ip_table_lookup(&ipft6, hash); e; e = e->next) {
+    fp = (struct ip6_fragment *) e;
+    if (e->hash == hash && fp->id == fhdr->ip6f_ident && !ip6_addr_cmp(&fp->src, &iphp->ip6_src) &&
         !ip6_addr_cmp(&fp->dst, &iphp->ip6_dst)) {
       /* fragment found; will check for its deadline */
       if (fp->deadline > now) {
@@ -373,96 +290,44 @@ int find_fragment6(u_int32_t now, struct packet_ptrs *pptrs, struct ip6_frag *fh
         }
       }
       else {
-        candidate = fp;
-	if (!candidate->got_first) notify_orphan_fragment6(candidate);
-        goto create;
+        /* stale fragment, not yet reaped: will be recycled */
+	if (!fp->got_first) notify_orphan_fragment6(fp);
+        return create_fragment6(now, fp, hash, pptrs, fhdr);
       }
     }
-    if ((fp->deadline < now) && !candidate) {
-      candidate = fp;
-      if (!candidate->got_first) notify_orphan_fragment6(candidate);
-    }
-    last_seen = fp;
   }
 
-  create:
-  if (candidate) return create_fragment6(now, candidate, TRUE, bucket, pptrs, fhdr);
-  else return create_fragment6(now, last_seen, FALSE, bucket, pptrs, fhdr);
+  return create_fragment6(now, NULL, hash, pptrs, fhdr);
 }
 
-int create_fragment6(u_int32_t now, struct ip6_fragment *fp, u_int8_t is_candidate, unsigned int bucket,
+int create_fragment6(u_int32_t now, struct ip6_fragment *fp, unsigned int hash,
 			struct packet_ptrs *pptrs, struct ip6_frag *fhdr)
 {
   struct ip6_hdr *iphp = (struct ip6_hdr *)pptrs->iph_ptr;
-  struct ip6_fragment *newf;
-
-  if (!ipft6_total_nodes) { 
-    if (now > emergency_prune6+EMER_PRUNE_INTERVAL) {
-      Log(LOG_INFO, "INFO ( %s/core ): Fragment/6 buffer full. Skipping fragments.\n", config.name);
-      emergency_prune6 = now;
-      prune_old_fragments6(now, 0);
-    }
-    return FALSE;
-  }
+  u_int8_t is_new = FALSE;
 
-  if (fp) {
-    /* a 'not candidate' is simply the tail (last node) of the
-       list. We need to allocate a new node */
-    if (!is_candidate) {
-      newf = (struct ip6_fragment *) malloc(sizeof(struct ip6_fragment));
-      if (!newf) {
-	if (now > emergency_prune6+EMER_PRUNE_INTERVAL) {
-	  Log(LOG_INFO, "INFO ( %s/core ): Fragment/6 buffer full. Skipping fragments.\n", config.name);
-	  emergency_prune6 = now;
-	  prune_old_fragments6(now, 0);
-	}
-	return FALSE;
-      }
-      else ipft6_total_nodes--;
-      memset(newf, 0, sizeof(struct ip6_fragment));
-      fp->next = newf;
-      newf->prev = fp;
-      lru_list6.last->lru_next = newf; /* placing new node as LRU tail */
-      newf->lru_prev = lru_list6.last;
-      lru_list6.last = newf;
-      fp = newf;
-    }
-    else {
-      if (fp->lru_next) { /* if fp->lru_next==NULL the node is already the tail */
-        fp->lru_prev->lru_next = fp->lru_next;
-        fp->lru_next->lru_prev = fp->lru_prev;
-        lru_list6.last->lru_next = fp;
-        fp->lru_prev = lru_list6.last;
-        fp->lru_next = NULL;
-        lru_list6.last = fp;
-      }
-    }
-  }
-  else {
-    /* we don't have any fragment pointer; this is because current
-       bucket doesn't contain any node; we'll allocate first one */
-    fp = (struct ip6_fragment *) malloc(sizeof(struct ip6_fragment));
+  if (!fp) {
+    fp = (struct ip6_fragment *) ip_table_alloc(&ipft6);
     if (!fp) {
       if (now > emergency_prune6+EMER_PRUNE_INTERVAL) {
         Log(LOG_INFO, "INFO ( %s/core ): Fragment/6 buffer full. Skipping fragments.\n", config.name);
         emergency_prune6 = now;
-        prune_old_fragments6(now, 0);
       }
       return FALSE;
     }
-    else ipft6_total_nodes--;
-    memset(fp, 0, sizeof(struct ip6_fragment));
-    ipft6[bucket] = fp;
-    lru_list6.last->lru_next = fp; /* placing new node as LRU tail */
-    fp->lru_prev = lru_list6.last;
-    lru_list6.last = fp;
+    is_new = TRUE;
+  }
+  else {
+    fp->got_first = FALSE;
+    fp->a = 0;
+    fp->pa = 0;
   }
 
   fp->deadline = now+IPF_TIMEOUT;
   fp->id = fhdr->ip6f_ident;
   ip6_addr_cpy(&fp->src, &iphp->ip6_src);
   ip6_addr_cpy(&fp->dst, &iphp->ip6_dst);
-  fp->bucket = bucket;
+  if (is_new) ip_table_insert(&ipft6, &fp->ent, hash, now);
 
   if (!(fhdr->ip6f_offlg & htons(IP6F_OFF_MASK))) {
     /* it's a first fragment */
@@ -480,44 +345,19 @@ int create_fragment6(u_int32_t now, struct ip6_fragment *fp, u_int8_t is_candida
   }
 }
 
-void prune_old_fragments6(u_int32_t now, u_int32_t off)
+time_t fragment6_deadline(struct ip_table_entry *e, time_t now)
 {
-  struct ip6_fragment *fp, *temp;
-  u_int32_t deadline = now-off;
-
-  fp = lru_list6.root->lru_next;
-  while (fp) {
-    if (deadline > fp->deadline) {
-      /* we found a stale element; we'll prune it */
-      if (fp->lru_next) temp = fp->lru_next;
-      else temp = NULL;
-
-      /* rearranging bucket's pointers */
-      if (fp->prev && fp->next) {
-        fp->prev->next = fp->next;
-        fp->next->prev = fp->prev;
-      }
-      else if (fp->prev) fp->prev->next = NULL;
-      else if (fp->next) {
-        ipft6[fp->bucket] = fp->next;
-        fp->next->prev = NULL;
-      }
-      else ipft6[fp->bucket] = NULL;
+  struct ip6_fragment *fp = (struct ip6_fragment *) e;
 
-      free(fp);
-      ipft6_total_nodes++;
+  if (fp->deadline > now) return fp->deadline;
+  else return 0;
+}
 
-      if (temp) fp = temp;
-      else fp = NULL;
-    }
-    else break;
-  }
+void release_fragment6(struct ip_table_entry *e)
+{
+  struct ip6_fragment *fp = (struct ip6_fragment *) e;
 
-  if (fp) {
-    fp->lru_prev = lru_list6.root;
-    lru_list6.root->lru_next = fp;
-  }
-  else lru_list6.last = lru_list6.root;
+  if (!fp->got_first) notify_orphan_fragment6(fp);
 }
 
 void notify_orphan_fragment6(struct ip6_fragment *frag)
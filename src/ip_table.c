@@ -0,0 +1,259 @@
+/*
+    pmacct (Promiscuous mode IP Accounting package)
+    pmacct is Copyright (C) 2003-2017 by Paolo Lucente
+*/
+
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#define __IP_TABLE_C
+
+/* includes */
+#include "pmacct.h"
+#include "ip_table.h"
+
+/* functions */
+static u_int32_t ip_table_roundup(u_int32_t size)
+{
+  u_int32_t ret = 1;
+
+  while (ret < size && ret < (1U << 30)) ret <<= 1;
+
+  return ret;
+}
+
+/* 'size' is the initial number of buckets, 'max_size' the number it can
+   grow up to: a table with a single, fixed bucket is just a list */
+void ip_table_init(struct ip_table *t, u_int32_t size, u_int32_t max_size, size_t entry_size,
+		   u_int32_t max_nodes, ip_table_deadline_t deadline, ip_table_release_t release)
+{
+  memset(t, 0, sizeof(struct ip_table));
+
+  t->size = ip_table_roundup(size);
+  t->max_size = ip_table_roundup(max_size);
+  if (t->max_size < t->size) t->max_size = t->size;
+
+  t->buckets = (struct ip_table_entry **) malloc(t->size*sizeof(struct ip_table_entry *));
+  assert(t->buckets);
+  memset(t->buckets, 0, t->size*sizeof(struct ip_table_entry *));
+
+  t->entry_size = entry_size;
+  t->avail = max_nodes;
+  t->clk = time(NULL);
+  t->deadline = deadline;
+  t->release = release;
+}
+
+/* returns a zeroed node or NULL if the budget or memory are exhausted */
+struct ip_table_entry *ip_table_alloc(struct ip_table *t)
+{
+  struct ip_table_entry *e;
+  char *slab;
+  int idx;
+
+  if (!t->avail) return NULL;
+
+  if (!t->free_list) {
+    slab = malloc(sizeof(void *)+(IP_TABLE_SLAB_ENTRIES*t->entry_size));
+    if (!slab) return NULL;
+
+    *(void **) slab = t->slabs;
+    t->slabs = slab;
+    slab += sizeof(void *);
+
+    for (idx = IP_TABLE_SLAB_ENTRIES-1; idx >= 0; idx--) {
+      e = (struct ip_table_entry *) (slab+(idx*t->entry_size));
+      e->next = t->free_list;
+      t->free_list = e;
+    }
+  }
+
+  e = t->free_list;
+  t->free_list = e->next;
+  t->avail--;
+
+  memset(e, 0, t->entry_size);
+
+  return e;
+}
+
+static struct ip_table_entry **ip_table_head(struct ip_table *t, u_int32_t hash)
+{
+  u_int32_t idx;
+
+  /* buckets not yet migrated still hold their nodes */
+  if (t->old_buckets) {
+    idx = hash & (t->old_size-1);
+    if (idx >= t->rehash_idx) return &t->old_buckets[idx];
+  }
+
+  return &t->buckets[hash & (t->size-1)];
+}
+
+static void ip_table_link(struct ip_table_entry **head, struct ip_table_entry *e)
+{
+  if ((e->next = *head)) e->next->pprev = &e->next;
+  *head = e;
+  e->pprev = head;
+}
+
+static void ip_table_rehash(struct ip_table *t)
+{
+  struct ip_table_entry *e, *next;
+  int steps;
+
+  for (steps = 0; t->old_buckets && steps < IP_TABLE_REHASH_STEP; steps++) {
+    for (e = t->old_buckets[t->rehash_idx]; e; e = next) {
+      next = e->next;
+      ip_table_link(&t->buckets[e->hash & (t->size-1)], e);
+    }
+    t->old_buckets[t->rehash_idx] = NULL;
+
+    if (++t->rehash_idx == t->old_size) {
+      free(t->old_buckets);
+      t->old_buckets = NULL;
+    }
+  }
+}
+
+static void ip_table_grow(struct ip_table *t)
+{
+  struct ip_table_entry **buckets;
+  u_int32_t size = t->size << 1;
+
+  /* best effort: on failure we just carry on with longer chains */
+  buckets = (struct ip_table_entry **) malloc(size*sizeof(struct ip_table_entry *));
+  if (!buckets) return;
+  memset(buckets, 0, size*sizeof(struct ip_table_entry *));
+
+  t->old_buckets = t->buckets;
+  t->old_size = t->size;
+  t->rehash_idx = 0;
+  t->buckets = buckets;
+  t->size = size;
+}
+
+/* returns the head of the chain 'hash' belongs to; callers are
+   expected to compare the hash of each node before its key */
+struct ip_table_entry *ip_table_lookup(struct ip_table *t, u_int32_t hash)
+{
+  ip_table_rehash(t);
+
+  return *ip_table_head(t, hash);
+}
+
+static void ip_table_schedule(struct ip_table *t, struct ip_table_entry *e, time_t deadline)
+{
+  struct ip_table_entry **head;
+
+  /* nodes falling beyond the wheel are looked at once per turn */
+  if (deadline < t->clk) deadline = t->clk;
+  else if (deadline > t->clk+IP_TABLE_WHEEL_MASK) deadline = t->clk+IP_TABLE_WHEEL_MASK;
+
+  head = &t->wheel[deadline & IP_TABLE_WHEEL_MASK];
+  if ((e->w_next = *head)) e->w_next->w_pprev = &e->w_next;
+  *head = e;
+  e->w_pprev = head;
+}
+
+static void ip_table_unschedule(struct ip_table_entry *e)
+{
+  if (!e->w_pprev) return;
+
+  if (e->w_next) e->w_next->w_pprev = e->w_pprev;
+  *e->w_pprev = e->w_next;
+  e->w_next = NULL;
+  e->w_pprev = NULL;
+}
+
+void ip_table_insert(struct ip_table *t, struct ip_table_entry *e, u_int32_t hash, time_t now)
+{
+  if (!t->old_buckets && t->size < t->max_size && t->count >= t->size*IP_TABLE_MAX_LOAD)
+    ip_table_grow(t);
+
+  e->hash = hash;
+  ip_table_link(ip_table_head(t, hash), e);
+  t->count++;
+
+  ip_table_schedule(t, e, t->deadline(e, now));
+}
+
+void ip_table_remove(struct ip_table *t, struct ip_table_entry *e)
+{
+  if (e->pprev) {
+    if (e->next) e->next->pprev = e->pprev;
+    *e->pprev = e->next;
+    e->pprev = NULL;
+  }
+  ip_table_unschedule(e);
+
+  if (t->release) t->release(e);
+
+  e->next = t->free_list;
+  t->free_list = e;
+  t->avail++;
+  t->count--;
+}
+
+/* sweeps the wheel up to 'now' visiting at most 'max' nodes, so that
+   the cost of expiring is spread over time; returns the nodes freed */
+u_int32_t ip_table_expire(struct ip_table *t, time_t now, u_int32_t max)
+{
+  struct ip_table_entry *e;
+  u_int32_t visited = 0, expired = 0;
+  time_t deadline;
+
+  /* after a long pause every slot is due: go through each of them once */
+  if (now-t->clk > IP_TABLE_WHEEL_SLOTS) t->clk = now-IP_TABLE_WHEEL_SLOTS;
+
+  while (t->clk <= now) {
+    while ((e = t->wheel[t->clk & IP_TABLE_WHEEL_MASK])) {
+      if (visited == max) return expired;
+      visited++;
+
+      ip_table_unschedule(e);
+      deadline = t->deadline(e, now);
+
+      if (deadline <= now) {
+	ip_table_remove(t, e);
+	expired++;
+      }
+      /* lands past t->clk, never in the slot being swept */
+      else ip_table_schedule(t, e, deadline);
+    }
+
+    t->clk++;
+  }
+
+  return expired;
+}
+
+/* releases the memory of the table; nodes still in it are not released
+   one by one, ie. callers remove those needing it beforehand */
+void ip_table_free(struct ip_table *t)
+{
+  void *slab;
+
+  while ((slab = t->slabs)) {
+    t->slabs = *(void **) slab;
+    free(slab);
+  }
+
+  free(t->buckets);
+  if (t->old_buckets) free(t->old_buckets);
+
+  memset(t, 0, sizeof(struct ip_table));
+}
@@ -0,0 +1,92 @@
+/*
+    pmacct (Promiscuous mode IP Accounting package)
+    pmacct is Copyright (C) 2003-2017 by Paolo Lucente
+*/
+
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifndef _IP_TABLE_H_
+#define _IP_TABLE_H_
+
+/*
+   Hash table shared by the flow, fragment and conntrack trackers: nodes
+   are carved out of slabs and recycled through a free list, the bucket
+   array doubles in size by migrating a few buckets at every access and
+   expiry is driven by a one-second timer wheel swept a bounded number
+   of nodes at a time. Tracked structures embed a struct ip_table_entry
+   as their very first member.
+*/
+
+/* defines */
+#define IP_TABLE_SLAB_ENTRIES	1024
+#define IP_TABLE_MAX_LOAD	2	/* nodes per bucket before growing */
+#define IP_TABLE_REHASH_STEP	8	/* buckets migrated per access */
+#define IP_TABLE_WHEEL_SLOTS	256	/* seconds; power of 2 */
+#define IP_TABLE_WHEEL_MASK	(IP_TABLE_WHEEL_SLOTS-1)
+#define IP_TABLE_EXPIRE_BATCH	64	/* nodes visited per expiry pass */
+
+/* structures */
+struct ip_table_entry {
+  struct ip_table_entry *next;		/* bucket chain */
+  struct ip_table_entry **pprev;
+  struct ip_table_entry *w_next;	/* timer wheel slot */
+  struct ip_table_entry **w_pprev;
+  u_int32_t hash;
+};
+
+/*
+   Returns zero if the node has expired by 'now' or else the time by
+   which it should be looked at again; nodes are checked lazily, ie. it
+   is fine to refresh a node without rescheduling it.
+*/
+typedef time_t (*ip_table_deadline_t)(struct ip_table_entry *, time_t);
+typedef void (*ip_table_release_t)(struct ip_table_entry *);
+
+struct ip_table {
+  struct ip_table_entry **buckets;
+  struct ip_table_entry **old_buckets;	/* being migrated, if not NULL */
+  u_int32_t size;
+  u_int32_t old_size;
+  u_int32_t rehash_idx;
+  u_int32_t max_size;
+  u_int32_t count;
+  u_int32_t avail;			/* nodes left in the budget */
+  size_t entry_size;
+  struct ip_table_entry *free_list;
+  void *slabs;				/* chained via their first word */
+  struct ip_table_entry *wheel[IP_TABLE_WHEEL_SLOTS];
+  time_t clk;				/* next second to be swept */
+  ip_table_deadline_t deadline;
+  ip_table_release_t release;
+};
+
+/* prototypes */
+#if (!defined __IP_TABLE_C)
+#define EXT extern
+#else
+#define EXT
+#endif
+EXT void ip_table_init(struct ip_table *, u_int32_t, u_int32_t, size_t, u_int32_t, ip_table_deadline_t, ip_table_release_t);
+EXT struct ip_table_entry *ip_table_alloc(struct ip_table *);
+EXT struct ip_table_entry *ip_table_lookup(struct ip_table *, u_int32_t);
+EXT void ip_table_insert(struct ip_table *, struct ip_table_entry *, u_int32_t, time_t);
+EXT void ip_table_remove(struct ip_table *, struct ip_table_entry *);
+EXT u_int32_t ip_table_expire(struct ip_table *, time_t, u_int32_t);
+EXT void ip_table_free(struct ip_table *);
+#undef EXT
+
+#endif /* _IP_TABLE_H_ */
@@ -283,7 +283,7 @@ void isis_pdu_runner(u_char *user, const struct pcap_pkthdr *pkthdr, const u_cha
   if (timeval_cmp(&isis_now, &isis_spf_deadline) >= 0) {
     if (circuit->area->is_type & IS_LEVEL_1) {
       if (circuit->area->ip_circuits) {
-	ret = isis_run_spf(circuit->area, 1, AF_INET);
+	ret = isis_spf_run_pending(circuit->area, 1, AF_INET);
 	isis_route_validate_table (circuit->area, circuit->area->route_table[0]);
       }
       /* XXX: IPv6 handled here */
@@ -291,7 +291,7 @@ void isis_pdu_runner(u_char *user, const struct pcap_pkthdr *pkthdr, const u_cha
 
     if (circuit->area->is_type & IS_LEVEL_2) {
       if (circuit->area->ip_circuits) {
-	ret = isis_run_spf(circuit->area, 2, AF_INET);
+	ret = isis_spf_run_pending(circuit->area, 2, AF_INET);
 	isis_route_validate_table (circuit->area, circuit->area->route_table[1]);
       }
       /* XXX: IPv6 handled here */
@@ -39,6 +39,7 @@
 #include "isis_misc.h"
 #include "isis_dynhn.h"
 #include "isis_pdu.h"
+#include "isis_spf.h"
 
 extern struct isis *isis;
 
@@ -146,6 +147,13 @@ isis_adj_state_change (struct isis_adjacency *adj, enum isis_adj_state state,
   Log(LOG_DEBUG, "DEBUG ( %s/core/ISIS ): ISIS-Adj (%s): Adjacency state change %d->%d: %s\n",
 		 config.name, circuit->area->area_tag, old_state, state, reason ? reason : "unspecified"); 
 
+  /* the topology changed: routes need a full SPF run */
+  if (old_state != state && (state == ISIS_ADJ_UP || state == ISIS_ADJ_DOWN))
+    {
+      isis_spf_trigger (circuit->area, 1, TRUE);
+      isis_spf_trigger (circuit->area, 2, TRUE);
+    }
+
   if (state == ISIS_ADJ_UP)
     {
       /* update counter & timers for debugging purposes */
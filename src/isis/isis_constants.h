@@ -76,6 +76,7 @@
 #define METRICS_UNSUPPORTED 0x80
 #define PERIODIC_SPF_INTERVAL         60	/* at the top of my head */
 #define MINIMUM_SPF_INTERVAL           5	/* .. same here          */
+#define MINIMUM_PRC_INTERVAL           1	/* routes only, cheap    */
 
 /*
  * NLPID values
@@ -335,6 +335,46 @@ isis_lsp_authinfo_check (struct stream *stream, struct isis_area *area,
   return authentication_check (passwd, &tlvs.auth_info);
 }
 
+/*
+ * Digest of what the SPF looks at in a LSP other than prefixes: when an
+ * update leaves it unchanged, recalculating routes (PRC) is enough
+ */
+static u_int32_t
+lsp_spf_digest (struct isis_lsp *lsp)
+{
+  struct listnode *node;
+  struct is_neigh *is_neigh;
+  struct te_is_neigh *te_is_neigh;
+  u_int32_t digest;
+  int idx;
+
+  digest = ISIS_MASK_LSP_OL_BIT (lsp->lsp_header->lsp_bits) ? 1 : 0;
+  digest = (digest * 33) ^ (lsp->lsp_header->seq_num == 0);
+
+  if (lsp->tlv_data.nlpids)
+    for (idx = 0; idx < lsp->tlv_data.nlpids->count; idx++)
+      digest = (digest * 33) ^ lsp->tlv_data.nlpids->nlpids[idx];
+
+  if (lsp->tlv_data.is_neighs)
+    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.is_neighs, node, is_neigh))
+      {
+	for (idx = 0; idx < ISIS_SYS_ID_LEN + 1; idx++)
+	  digest = (digest * 33) ^ is_neigh->neigh_id[idx];
+	digest = (digest * 33) ^ is_neigh->metrics.metric_default;
+      }
+
+  if (lsp->tlv_data.te_is_neighs)
+    for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.te_is_neighs, node, te_is_neigh))
+      {
+	for (idx = 0; idx < ISIS_SYS_ID_LEN + 1; idx++)
+	  digest = (digest * 33) ^ te_is_neigh->neigh_id[idx];
+	for (idx = 0; idx < 3; idx++)
+	  digest = (digest * 33) ^ te_is_neigh->te_metric[idx];
+      }
+
+  return digest;
+}
+
 static void
 lsp_update_data (struct isis_lsp *lsp, struct stream *stream,
 		 struct isis_area *area)
@@ -381,6 +421,8 @@ lsp_update_data (struct isis_lsp *lsp, struct stream *stream,
 		       ntohs (lsp->lsp_header->pdu_len) - ISIS_FIXED_HDR_LEN
 		       - ISIS_LSP_HDR_LEN, &expected, &found, &lsp->tlv_data);
 
+  lsp->spf_digest = lsp_spf_digest (lsp);
+
   if (found & TLVFLAG_DYN_HOSTNAME)
     {
       if (area->dynhostname)
@@ -397,6 +439,11 @@ lsp_update (struct isis_lsp *lsp, struct isis_link_state_hdr *lsp_hdr,
 	    struct stream *stream, struct isis_area *area, int level)
 {
   dnode_t *dnode = NULL;
+  u_int32_t spf_digest = lsp->spf_digest;
+  int changed;
+
+  changed = (lsp->lsp_header->seq_num != lsp_hdr->seq_num ||
+	     lsp->lsp_header->checksum != lsp_hdr->checksum);
 
   /* Remove old LSP from LSP database. */
   dnode = dict_lookup (area->lspdb[level - 1], lsp->lsp_header->lsp_id);
@@ -415,6 +462,9 @@ lsp_update (struct isis_lsp *lsp, struct isis_link_state_hdr *lsp_hdr,
 
   if (dnode)
     lsp_insert (lsp, area->lspdb[level - 1]);
+
+  if (changed)
+    isis_spf_trigger (area, level, lsp->spf_digest != spf_digest);
 }
 
 /* creation of LSP directly from what we received */
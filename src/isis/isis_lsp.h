@@ -62,6 +62,7 @@ struct isis_lsp
   /* FIXME: For now only topology LSP's use this. Is it helpful for others? */
   struct isis_area *area;
   struct tlvs tlv_data;		/* Simplifies TLV access */
+  u_int32_t spf_digest;		/* see lsp_spf_digest() */
 };
 
 #define LSP_EQUAL 1
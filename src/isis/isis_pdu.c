@@ -51,6 +51,7 @@
 #include "isis_csm.h"
 #include "isis_events.h"
 #include "isis_lsp.h"
+#include "isis_spf.h"
 
 extern struct thread_master *master;
 extern struct isis *isis;
@@ -916,6 +917,7 @@ dontcheckadj:
 	  lsp->adj = adj;
 
 	  lsp_insert (lsp, circuit->area->lspdb[level - 1]);
+	  isis_spf_trigger (circuit->area, level, TRUE);
 	  /* ii */
 	  ISIS_FLAGS_SET_ALL (lsp->SRMflags);
 	  /* iii */
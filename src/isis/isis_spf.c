@@ -30,6 +30,7 @@
 #include "prefix.h"
 #include "hash.h"
 #include "table.h"
+#include "pqueue.h"
 
 #include "isis_constants.h"
 #include "isis_common.h"
@@ -184,6 +185,90 @@ remove_excess_adjs (struct list *adjs)
   return;
 }
 
+/*
+ * TENT is a heap ordered by cost and by vertextype on tie break situation
+ */
+static int
+isis_vertex_queue_cmp (void *a, void *b)
+{
+  struct isis_vertex *va = a, *vb = b;
+
+  if (va->d_N != vb->d_N)
+    return (va->d_N < vb->d_N) ? -1 : 1;
+
+  if (va->type != vb->type)
+    return (va->type < vb->type) ? -1 : 1;
+
+  return 0;
+}
+
+static void
+isis_vertex_queue_update (void *vertex, int index)
+{
+  ((struct isis_vertex *) vertex)->tent_index = index;
+}
+
+static unsigned int
+isis_vertex_hash_key (void *arg)
+{
+  struct isis_vertex *vertex = arg;
+  unsigned int key = vertex->type;
+  u_char *ptr;
+  int len, idx;
+
+  switch (vertex->type)
+    {
+    case VTYPE_ES:
+    case VTYPE_NONPSEUDO_IS:
+    case VTYPE_NONPSEUDO_TE_IS:
+      ptr = vertex->N.id;
+      len = ISIS_SYS_ID_LEN;
+      break;
+    case VTYPE_PSEUDO_IS:
+    case VTYPE_PSEUDO_TE_IS:
+      ptr = vertex->N.id;
+      len = ISIS_SYS_ID_LEN + 1;
+      break;
+    default:
+      key = (key * 33) ^ vertex->N.prefix.family;
+      key = (key * 33) ^ vertex->N.prefix.prefixlen;
+      ptr = (u_char *) &vertex->N.prefix.u.prefix;
+      len = PSIZE (vertex->N.prefix.prefixlen);
+      break;
+    }
+
+  for (idx = 0; idx < len; idx++)
+    key = (key * 33) ^ ptr[idx];
+
+  return key;
+}
+
+static int
+isis_vertex_hash_cmp (const void *a, const void *b)
+{
+  const struct isis_vertex *va = a, *vb = b;
+  const struct isis_prefix *p1, *p2;
+
+  if (va->type != vb->type)
+    return FALSE;
+
+  switch (va->type)
+    {
+    case VTYPE_ES:
+    case VTYPE_NONPSEUDO_IS:
+    case VTYPE_NONPSEUDO_TE_IS:
+      return !memcmp (va->N.id, vb->N.id, ISIS_SYS_ID_LEN);
+    case VTYPE_PSEUDO_IS:
+    case VTYPE_PSEUDO_TE_IS:
+      return !memcmp (va->N.id, vb->N.id, ISIS_SYS_ID_LEN + 1);
+    default:
+      p1 = &va->N.prefix;
+      p2 = &vb->N.prefix;
+      return (p1->family == p2->family && p1->prefixlen == p2->prefixlen &&
+	      !memcmp (&p1->u.prefix, &p2->u.prefix, PSIZE (p1->prefixlen)));
+    }
+}
+
 static struct isis_spftree *
 isis_spftree_new ()
 {
@@ -196,7 +281,18 @@ isis_spftree_new ()
       return NULL;
     }
 
-  tree->tents = isis_list_new ();
+  tree->tents = isis_pqueue_create ();
+  if (tree->tents == NULL)
+    {
+      Log(LOG_ERR, "ERROR ( %s/core/ISIS ): ISIS-Spf: isis_spftree_new Out of memory!\n", config.name);
+      free(tree);
+      return NULL;
+    }
+  tree->tents->cmp = isis_vertex_queue_cmp;
+  tree->tents->update = isis_vertex_queue_update;
+
+  tree->vertices = isis_hash_create_size (SPF_VERTEX_HASHSIZE, isis_vertex_hash_key,
+					  isis_vertex_hash_cmp);
   tree->paths = isis_list_new ();
   return tree;
 }
@@ -215,12 +311,18 @@ isis_vertex_del (struct isis_vertex *vertex)
 static void
 isis_spftree_del (struct isis_spftree *spftree)
 {
-  spftree->tents->del = (void (*)(void *)) isis_vertex_del;
-  isis_list_delete (spftree->tents);
+  int idx;
+
+  for (idx = 0; idx < spftree->tents->size; idx++)
+    isis_vertex_del (spftree->tents->array[idx]);
+  isis_pqueue_delete (spftree->tents);
 
   spftree->paths->del = (void (*)(void *)) isis_vertex_del;
   isis_list_delete (spftree->paths);
 
+  isis_hash_clean (spftree->vertices, NULL);
+  isis_hash_free (spftree->vertices);
+
   free(spftree);
 
   return;
@@ -254,18 +356,9 @@ spftree_area_init (struct isis_area *area)
   return;
 }
 
-static struct isis_vertex *
-isis_vertex_new (void *id, enum vertextype vtype)
+static void
+isis_vertex_id_init (struct isis_vertex *vertex, void *id, enum vertextype vtype)
 {
-  struct isis_vertex *vertex;
-
-  vertex = calloc(1, sizeof (struct isis_vertex));
-  if (vertex == NULL)
-    {
-      Log(LOG_ERR, "ERROR ( %s/core/ISIS ): isis_vertex_new Out of memory!\n", config.name);
-      return NULL;
-    }
-
   vertex->type = vtype;
   switch (vtype)
     {
@@ -291,8 +384,23 @@ isis_vertex_new (void *id, enum vertextype vtype)
     default:
       Log(LOG_ERR, "ERROR ( %s/core/ISIS ): WTF!\n", config.name);
     }
+}
+
+static struct isis_vertex *
+isis_vertex_new (void *id, enum vertextype vtype)
+{
+  struct isis_vertex *vertex;
+
+  vertex = calloc(1, sizeof (struct isis_vertex));
+  if (vertex == NULL)
+    {
+      Log(LOG_ERR, "ERROR ( %s/core/ISIS ): isis_vertex_new Out of memory!\n", config.name);
+      return NULL;
+    }
 
+  isis_vertex_id_init (vertex, id, vtype);
   vertex->Adj_N = isis_list_new ();
+  vertex->tent_index = -1;
 
   return vertex;
 }
@@ -324,68 +432,40 @@ isis_spf_add_self (struct isis_spftree *spftree, struct isis_area *area,
   vertex->lsp = lsp;
 
   isis_listnode_add (spftree->paths, vertex);
+  isis_hash_get (spftree->vertices, vertex, isis_hash_alloc_intern);
 
   return;
 }
 
+/*
+ * Looks a vertex up in both TENT and PATHS: tent_index tells which
+ */
 static struct isis_vertex *
-isis_find_vertex (struct list *list, void *id, enum vertextype vtype)
+isis_find_vertex (struct isis_spftree *spftree, void *id, enum vertextype vtype)
 {
-  struct listnode *node;
-  struct isis_vertex *vertex;
-  struct isis_prefix *p1, *p2;
+  struct isis_vertex key;
 
-  for (ALL_LIST_ELEMENTS_RO (list, node, vertex))
-    {
-      if (vertex->type != vtype)
-	continue;
-      switch (vtype)
-	{
-	case VTYPE_ES:
-	case VTYPE_NONPSEUDO_IS:
-	case VTYPE_NONPSEUDO_TE_IS:
-	  if (memcmp ((u_char *) id, vertex->N.id, ISIS_SYS_ID_LEN) == 0)
-	    return vertex;
-	  break;
-	case VTYPE_PSEUDO_IS:
-	case VTYPE_PSEUDO_TE_IS:
-	  if (memcmp ((u_char *) id, vertex->N.id, ISIS_SYS_ID_LEN + 1) == 0)
-	    return vertex;
-	  break;
-	case VTYPE_IPREACH_INTERNAL:
-	case VTYPE_IPREACH_EXTERNAL:
-	case VTYPE_IPREACH_TE:
-#ifdef ENABLE_IPV6
-	case VTYPE_IP6REACH_INTERNAL:
-	case VTYPE_IP6REACH_EXTERNAL:
-#endif /* ENABLE_IPV6 */
-	  p1 = (struct isis_prefix *) id;
-	  p2 = (struct isis_prefix *) &vertex->N.id;
-	  if (p1->family == p2->family && p1->prefixlen == p2->prefixlen &&
-	      memcmp (&p1->u.prefix, &p2->u.prefix,
-		      PSIZE (p1->prefixlen)) == 0)
-	    return vertex;
-	  break;
-	}
-    }
+  isis_vertex_id_init (&key, id, vtype);
 
-  return NULL;
+  return isis_hash_lookup (spftree->vertices, &key);
 }
 
 /*
- * Add a vertex to TENT sorted by cost and by vertextype on tie break situation
+ * Add a vertex to TENT
  */
 static struct isis_vertex *
 isis_spf_add2tent (struct isis_spftree *spftree, enum vertextype vtype,
 		   void *id, struct isis_adjacency *adj, u_int32_t cost,
 		   int depth, int family)
 {
-  struct isis_vertex *vertex, *v;
-  struct listnode *node;
+  struct isis_vertex *vertex;
 
   u_char buff[BUFSIZ];
 
   vertex = isis_vertex_new (id, vtype);
+  if (vertex == NULL)
+    return NULL;
+
   vertex->d_N = cost;
   vertex->depth = depth;
 
@@ -397,44 +477,38 @@ isis_spf_add2tent (struct isis_spftree *spftree, enum vertextype vtype,
               config.name, vtype2string (vertex->type), vid2string (vertex, buff),
               vertex->depth, vertex->d_N);
 
-  isis_listnode_add (spftree->tents, vertex);
-  if (isis_list_isempty (spftree->tents))
-    {
-      isis_listnode_add (spftree->tents, vertex);
-      return vertex;
-    }
-  
-  /* XXX: This cant use the standard ALL_LIST_ELEMENT macro */
-  for (node = listhead (spftree->tents); node; node = listnextnode (node))
-    {
-      v = listgetdata (node);
-      if (v->d_N > vertex->d_N)
-	{
-	  isis_list_add_node_prev (spftree->tents, node, vertex);
-	  break;
-	}
-      else if (v->d_N == vertex->d_N)
-	{
-	  /*  Tie break, add according to type */
-	  while (v && v->d_N == vertex->d_N && v->type > vertex->type)
-	    {
-	      if (v->type > vertex->type)
-		{
-		  break;
-		}
-              /* XXX: this seems dubious, node is the loop iterator */
-	      node = listnextnode (node);
-	      (node) ? (v = listgetdata (node)) : (v = NULL);
-	    }
-	  isis_list_add_node_prev (spftree->tents, node, vertex);
-	  break;
-	}
-      else if (node->next == NULL)
-	{
-	  isis_list_add_node_next (spftree->tents, node, vertex);
-	  break;
-	}
-    }
+  isis_pqueue_enqueue (vertex, spftree->tents);
+  isis_hash_get (spftree->vertices, vertex, isis_hash_alloc_intern);
+
+  return vertex;
+}
+
+/*
+ * A shorter path was found to a vertex in TENT: it is moved up the heap
+ * in place rather than queued twice
+ */
+static void
+isis_spf_tent_decrease (struct isis_spftree *spftree, struct isis_vertex *vertex,
+			struct isis_adjacency *adj, u_int32_t cost, int depth)
+{
+  vertex->d_N = cost;
+  vertex->depth = depth;
+
+  isis_list_delete_all_node (vertex->Adj_N);
+  if (adj)
+    isis_listnode_add (vertex->Adj_N, adj);
+
+  isis_pqueue_trickle_up (vertex->tent_index, spftree->tents);
+}
+
+static struct isis_vertex *
+isis_spf_tent_pop (struct isis_spftree *spftree)
+{
+  struct isis_vertex *vertex;
+
+  vertex = isis_pqueue_dequeue (spftree->tents);
+  vertex->tent_index = -1;
+
   return vertex;
 }
 
@@ -445,9 +519,9 @@ isis_spf_add_local (struct isis_spftree *spftree, enum vertextype vtype,
 {
   struct isis_vertex *vertex;
 
-  vertex = isis_find_vertex (spftree->tents, id, vtype);
+  vertex = isis_find_vertex (spftree, id, vtype);
 
-  if (vertex)
+  if (vertex && vertex->tent_index >= 0)
     {
       /* C.2.5   c) */
       if (vertex->d_N == cost)
@@ -460,15 +534,13 @@ isis_spf_add_local (struct isis_spftree *spftree, enum vertextype vtype,
 	}
       /*         f) */
       else if (vertex->d_N > cost)
-	{
-	  isis_listnode_delete (spftree->tents, vertex);
-	  goto add2tent;
-	}
+	isis_spf_tent_decrease (spftree, vertex, adj, cost, 1);
       /*       e) do nothing */
       return vertex;
     }
+  else if (vertex)
+    return vertex;
 
-add2tent:
   return isis_spf_add2tent (spftree, vtype, id, adj, cost, 1, family);
 }
 
@@ -483,14 +555,13 @@ process_N (struct isis_spftree *spftree, enum vertextype vtype, void *id,
   if (dist > MAX_PATH_METRIC)
     return;
   /*       c)    */
-  vertex = isis_find_vertex (spftree->paths, id, vtype);
-  if (vertex)
+  vertex = isis_find_vertex (spftree, id, vtype);
+  if (vertex && vertex->tent_index < 0)
     {
       assert (dist >= vertex->d_N);
       return;
     }
 
-  vertex = isis_find_vertex (spftree->tents, id, vtype);
   /*       d)    */
   if (vertex)
     {
@@ -512,7 +583,8 @@ process_N (struct isis_spftree *spftree, enum vertextype vtype, void *id,
 	}
       else
 	{
-	  isis_listnode_delete (spftree->tents, vertex);
+	  isis_spf_tent_decrease (spftree, vertex, adj, dist, depth);
+	  return;
 	}
     }
 
@@ -521,11 +593,11 @@ process_N (struct isis_spftree *spftree, enum vertextype vtype, void *id,
 }
 
 /*
- * C.2.6 Step 1
+ * C.2.6 Step 1; with 'topology' unset only prefixes are looked at (PRC)
  */
 static int
 isis_spf_process_lsp (struct isis_spftree *spftree, struct isis_lsp *lsp,
-		      uint32_t cost, uint16_t depth, int family)
+		      uint32_t cost, uint16_t depth, int family, int topology)
 {
   struct listnode *node, *fragnode = NULL;
   u_int16_t dist;
@@ -554,7 +626,7 @@ lspfragloop:
 
   if (!ISIS_MASK_LSP_OL_BIT (lsp->lsp_header->lsp_bits))
     {
-      if (lsp->tlv_data.is_neighs)
+      if (topology && lsp->tlv_data.is_neighs)
 	{
           for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.is_neighs, node, is_neigh))
 	    {
@@ -569,7 +641,7 @@ lspfragloop:
 			 depth + 1, lsp->adj, family);
 	    }
 	}
-      if (lsp->tlv_data.te_is_neighs)
+      if (topology && lsp->tlv_data.te_is_neighs)
 	{
 	  for (ALL_LIST_ELEMENTS_RO (lsp->tlv_data.te_is_neighs, node,
 				     te_is_neigh))
@@ -700,10 +772,7 @@ pseudofragloop:
 	/* Two way connectivity */
 	if (!memcmp (is_neigh->neigh_id, isis->sysid, ISIS_SYS_ID_LEN))
 	  continue;
-	if (isis_find_vertex
-	    (spftree->tents, (void *) is_neigh->neigh_id, vtype) == NULL
-	    && isis_find_vertex (spftree->paths, (void *) is_neigh->neigh_id,
-			       vtype) == NULL)
+	if (isis_find_vertex (spftree, (void *) is_neigh->neigh_id, vtype) == NULL)
 	  {
 	    /* C.2.5 i) */
 	    isis_spf_add2tent (spftree, vtype, is_neigh->neigh_id, lsp->adj,
@@ -718,10 +787,7 @@ pseudofragloop:
 	/* Two way connectivity */
 	if (!memcmp (te_is_neigh->neigh_id, isis->sysid, ISIS_SYS_ID_LEN))
 	  continue;
-	if (isis_find_vertex
-	    (spftree->tents, (void *) te_is_neigh->neigh_id, vtype) == NULL
-	    && isis_find_vertex (spftree->paths, (void *) te_is_neigh->neigh_id,
-				 vtype) == NULL)
+	if (isis_find_vertex (spftree, (void *) te_is_neigh->neigh_id, vtype) == NULL)
 	  {
 	    /* C.2.5 i) */
 	    isis_spf_add2tent (spftree, vtype, te_is_neigh->neigh_id, lsp->adj,
@@ -743,64 +809,79 @@ pseudofragloop:
   return ISIS_OK;
 }
 
-static int
-isis_spf_preload_tent (struct isis_spftree *spftree,
-		       struct isis_area *area, int level, int family)
+/*
+ * Add IP(v6) addresses of this circuit
+ */
+static void
+isis_spf_preload_prefixes (struct isis_spftree *spftree,
+			   struct isis_circuit *circuit, int family)
 {
-  struct isis_vertex *vertex;
-  struct isis_circuit *circuit;
-  struct listnode *cnode, *anode, *ipnode;
-  struct isis_adjacency *adj;
-  struct isis_lsp *lsp;
-  struct list *adj_list;
-  struct list *adjdb;
+  struct listnode *ipnode;
   struct prefix_ipv4 *ipv4;
   struct isis_prefix prefix;
-  int retval = ISIS_OK;
-  u_char lsp_id[ISIS_SYS_ID_LEN + 2];
 #ifdef ENABLE_IPV6
   struct prefix_ipv6 *ipv6;
 #endif /* ENABLE_IPV6 */
 
-  for (ALL_LIST_ELEMENTS_RO (area->circuit_list, cnode, circuit))
+  if (family == AF_INET)
     {
-      if (circuit->state != C_STATE_UP)
-	continue;
-      if (!(circuit->circuit_is_type & level))
-	continue;
-      if (family == AF_INET && !circuit->ip_router)
-	continue;
-#ifdef ENABLE_IPV6
-      if (family == AF_INET6 && !circuit->ipv6_router)
-	continue;
-#endif /* ENABLE_IPV6 */
-      /* 
-       * Add IP(v6) addresses of this circuit
-       */
-      if (family == AF_INET)
+      prefix.family = AF_INET;
+      for (ALL_LIST_ELEMENTS_RO (circuit->ip_addrs, ipnode, ipv4))
 	{
-	  prefix.family = AF_INET;
-          for (ALL_LIST_ELEMENTS_RO (circuit->ip_addrs, ipnode, ipv4))
-	    {
-	      prefix.u.prefix4 = ipv4->prefix;
-	      prefix.prefixlen = ipv4->prefixlen;
-	      isis_spf_add_local (spftree, VTYPE_IPREACH_INTERNAL, &prefix,
-				  NULL, 0, family);
-	    }
+	  prefix.u.prefix4 = ipv4->prefix;
+	  prefix.prefixlen = ipv4->prefixlen;
+	  isis_spf_add_local (spftree, VTYPE_IPREACH_INTERNAL, &prefix,
+			      NULL, 0, family);
 	}
+    }
 #ifdef ENABLE_IPV6
-      if (family == AF_INET6)
+  if (family == AF_INET6)
+    {
+      prefix.family = AF_INET6;
+      for (ALL_LIST_ELEMENTS_RO (circuit->ipv6_non_link, ipnode, ipv6))
 	{
-	  prefix.family = AF_INET6;
-	  for (ALL_LIST_ELEMENTS_RO (circuit->ipv6_non_link, ipnode, ipv6))
-	    {
-	      prefix.prefixlen = ipv6->prefixlen;
-	      prefix.u.prefix6 = ipv6->prefix;
-	      isis_spf_add_local (spftree, VTYPE_IP6REACH_INTERNAL,
-				  &prefix, NULL, 0, family);
-	    }
+	  prefix.prefixlen = ipv6->prefixlen;
+	  prefix.u.prefix6 = ipv6->prefix;
+	  isis_spf_add_local (spftree, VTYPE_IP6REACH_INTERNAL,
+			      &prefix, NULL, 0, family);
 	}
+    }
 #endif /* ENABLE_IPV6 */
+}
+
+static int
+isis_spf_preload_circuit (struct isis_circuit *circuit, int level, int family)
+{
+  if (circuit->state != C_STATE_UP)
+    return FALSE;
+  if (!(circuit->circuit_is_type & level))
+    return FALSE;
+  if (family == AF_INET && !circuit->ip_router)
+    return FALSE;
+#ifdef ENABLE_IPV6
+  if (family == AF_INET6 && !circuit->ipv6_router)
+    return FALSE;
+#endif /* ENABLE_IPV6 */
+
+  return TRUE;
+}
+
+static int
+isis_spf_preload_tent (struct isis_spftree *spftree,
+		       struct isis_area *area, int level, int family)
+{
+  struct isis_circuit *circuit;
+  struct listnode *cnode;
+  struct isis_adjacency *adj;
+  int retval = ISIS_OK;
+
+  for (ALL_LIST_ELEMENTS_RO (area->circuit_list, cnode, circuit))
+    {
+      if (!isis_spf_preload_circuit (circuit, level, family))
+	continue;
+
+      isis_spf_preload_prefixes (spftree, circuit, family);
+
       if (circuit->circ_type == CIRCUIT_T_P2P)
 	{
 	  adj = circuit->u.p2p.neighbor;
@@ -879,37 +960,42 @@ add_to_paths (struct isis_spftree *spftree, struct isis_vertex *vertex,
 static void
 init_spt (struct isis_spftree *spftree)
 {
-  spftree->tents->del = spftree->paths->del = (void (*)(void *)) isis_vertex_del;
-  isis_list_delete_all_node (spftree->tents);
+  int idx;
+
+  for (idx = 0; idx < spftree->tents->size; idx++)
+    isis_vertex_del (spftree->tents->array[idx]);
+  spftree->tents->size = 0;
+
+  spftree->paths->del = (void (*)(void *)) isis_vertex_del;
   isis_list_delete_all_node (spftree->paths);
-  spftree->tents->del = spftree->paths->del = NULL;
+  spftree->paths->del = NULL;
+
+  isis_hash_clean (spftree->vertices, NULL);
 
   return;
 }
 
-int
-isis_run_spf (struct isis_area *area, int level, int family)
+static struct isis_spftree *
+isis_spftree_get (struct isis_area *area, int level, int family)
 {
-  int retval = ISIS_OK;
-  struct listnode *node;
-  struct isis_vertex *vertex;
-  struct isis_spftree *spftree = NULL;
-  u_char lsp_id[ISIS_SYS_ID_LEN + 2];
-  struct isis_lsp *lsp;
-  struct route_table *table = NULL;
-  struct route_node *rode;
-  struct isis_route_info *rinfo;
-
   if (family == AF_INET)
-    spftree = area->spftree[level - 1];
+    return area->spftree[level - 1];
 #ifdef ENABLE_IPV6
   else if (family == AF_INET6)
-    spftree = area->spftree6[level - 1];
+    return area->spftree6[level - 1];
 #endif
 
-  assert (spftree);
+  return NULL;
+}
+
+/* Make all routes in current route table inactive. */
+static void
+isis_spf_routes_inactive (struct isis_area *area, int level, int family)
+{
+  struct route_table *table = NULL;
+  struct route_node *rode;
+  struct isis_route_info *rinfo;
 
-  /* Make all routes in current route table inactive. */
   if (family == AF_INET)
     table = area->route_table[level - 1];
 #ifdef ENABLE_IPV6
@@ -925,6 +1011,22 @@ isis_run_spf (struct isis_area *area, int level, int family)
 
       UNSET_FLAG (rinfo->flag, ISIS_ROUTE_FLAG_ACTIVE);
     }
+}
+
+int
+isis_run_spf (struct isis_area *area, int level, int family)
+{
+  int retval = ISIS_OK;
+  struct isis_vertex *vertex;
+  struct isis_spftree *spftree;
+  u_char lsp_id[ISIS_SYS_ID_LEN + 2];
+  struct isis_lsp *lsp;
+
+  spftree = isis_spftree_get (area, level, family);
+
+  assert (spftree);
+
+  isis_spf_routes_inactive (area, level, family);
 
   /*
    * C.2.5 Step 0
@@ -938,22 +1040,16 @@ isis_run_spf (struct isis_area *area, int level, int family)
   /*
    * C.2.7 Step 2
    */
-  if (listcount (spftree->tents) == 0)
+  if (spftree->tents->size == 0)
     {
       Log(LOG_WARNING, "WARN ( %s/core/ISIS ): ISIS-Spf: TENT is empty\n", config.name);
       goto out;
     }
 
-  while (listcount (spftree->tents) > 0)
+  while (spftree->tents->size > 0)
     {
-      node = listhead (spftree->tents);
-      vertex = listgetdata (node);
-
-      /* Remove from tent list */
-      isis_list_delete_node (spftree->tents, node);
-
-      if (isis_find_vertex (spftree->paths, vertex->N.id, vertex->type))
-	continue;
+      /* Remove from TENT; vertices are queued only once */
+      vertex = isis_spf_tent_pop (spftree);
 
       add_to_paths (spftree, vertex, area, level);
       if (vertex->type == VTYPE_PSEUDO_IS ||
@@ -975,7 +1071,7 @@ isis_run_spf (struct isis_area *area, int level, int family)
 	      else
 		{
 		  isis_spf_process_lsp (spftree, lsp, vertex->d_N,
-					vertex->depth, family);
+					vertex->depth, family, TRUE);
 		}
 	    }
 	  else
@@ -997,6 +1093,131 @@ out:
   return retval;
 }
 
+/*
+ * Partial route calculation: the shortest path tree of the last SPF run
+ * still holds, only prefixes changed. Prefix vertices are dropped from
+ * PATHS and recalculated off the IS vertices kept there, which is linear
+ * in the number of prefixes rather than a full Dijkstra run.
+ */
+int
+isis_run_prc (struct isis_area *area, int level, int family)
+{
+  struct isis_spftree *spftree;
+  struct isis_circuit *circuit;
+  struct isis_vertex *vertex;
+  struct listnode *node, *nnode;
+  struct list *is_vertices;
+  struct isis_lsp *lsp;
+  u_char lsp_id[ISIS_SYS_ID_LEN + 2];
+
+  spftree = isis_spftree_get (area, level, family);
+
+  assert (spftree);
+
+  isis_spf_routes_inactive (area, level, family);
+
+  is_vertices = isis_list_new ();
+
+  for (ALL_LIST_ELEMENTS (spftree->paths, node, nnode, vertex))
+    {
+      if (vertex->type > VTYPE_ES)
+	{
+	  isis_hash_release (spftree->vertices, vertex);
+	  isis_list_delete_node (spftree->paths, node);
+	  isis_vertex_del (vertex);
+	}
+      /* pseudonode LSPs carry no prefixes; our own are preloaded */
+      else if (vertex->type == VTYPE_NONPSEUDO_IS ||
+	       vertex->type == VTYPE_NONPSEUDO_TE_IS)
+	isis_listnode_add (is_vertices, vertex);
+    }
+
+  for (ALL_LIST_ELEMENTS_RO (area->circuit_list, node, circuit))
+    if (isis_spf_preload_circuit (circuit, level, family))
+      isis_spf_preload_prefixes (spftree, circuit, family);
+
+  for (ALL_LIST_ELEMENTS_RO (is_vertices, node, vertex))
+    {
+      if (!memcmp (vertex->N.id, isis->sysid, ISIS_SYS_ID_LEN))
+	continue;
+
+      memcpy (lsp_id, vertex->N.id, ISIS_SYS_ID_LEN);
+      LSP_PSEUDO_ID (lsp_id) = 0;
+      LSP_FRAGMENT (lsp_id) = 0;
+      lsp = lsp_search (lsp_id, area->lspdb[level - 1]);
+      if (lsp)
+	isis_spf_process_lsp (spftree, lsp, vertex->d_N, vertex->depth,
+			      family, FALSE);
+    }
+
+  isis_list_delete (is_vertices);
+
+  while (spftree->tents->size > 0)
+    {
+      vertex = isis_spf_tent_pop (spftree);
+      add_to_paths (spftree, vertex, area, level);
+    }
+
+  spftree->pending = 0;
+
+  Log(LOG_DEBUG, "DEBUG ( %s/core/ISIS ): ISIS-Spf (tag: %s, level: %u): PRC run\n",
+		config.name, area->area_tag, area->is_type);
+
+  return ISIS_OK;
+}
+
+/*
+ * Runs what a spftree is due for: PRC when only prefixes changed since
+ * the last SPF run, and that is recent enough, a full SPF otherwise
+ */
+int
+isis_spf_run_pending (struct isis_area *area, int level, int family)
+{
+  struct isis_spftree *spftree;
+
+  spftree = isis_spftree_get (area, level, family);
+
+  assert (spftree);
+
+  /* another level was triggered: ours waits for the periodic run */
+  if (!spftree->pending && spftree->lastrun &&
+      time (NULL) - spftree->lastrun < PERIODIC_SPF_INTERVAL / 2)
+    return ISIS_OK;
+
+  if (spftree->pending == ISIS_SPF_PENDING_PRC && spftree->lastrun &&
+      time (NULL) - spftree->lastrun < PERIODIC_SPF_INTERVAL)
+    return isis_run_prc (area, level, family);
+
+  return isis_run_spf (area, level, family);
+}
+
+/*
+ * Called upon LSP database and adjacency changes: brings the next run
+ * forward so that lookups see fresh routes, still holding down SPF runs
+ * to one every MINIMUM_SPF_INTERVAL under churn
+ */
+void
+isis_spf_trigger (struct isis_area *area, int level, int full)
+{
+  time_t deadline;
+
+  if (!(area->is_type & level) || !area->spftree[level - 1])
+    return;
+
+  area->spftree[level - 1]->pending |= full ? ISIS_SPF_PENDING_FULL : ISIS_SPF_PENDING_PRC;
+#ifdef ENABLE_IPV6
+  if (area->spftree6[level - 1])
+    area->spftree6[level - 1]->pending |= full ? ISIS_SPF_PENDING_FULL : ISIS_SPF_PENDING_PRC;
+#endif
+
+  deadline = isis_now.tv_sec + (full ? MINIMUM_SPF_INTERVAL : MINIMUM_PRC_INTERVAL);
+  if (isis_spf_deadline.tv_sec > deadline)
+    {
+      isis_spf_deadline.tv_sec = deadline;
+      isis_spf_deadline.tv_usec = 0;
+    }
+}
+
 int
 isis_run_spf_l1 (struct thread *thread)
 {
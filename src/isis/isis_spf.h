@@ -24,6 +24,12 @@
 #ifndef _ISIS_SPF_H_
 #define _ISIS_SPF_H_
 
+#define SPF_VERTEX_HASHSIZE	8191	/* prime */
+
+/* what a spftree is due for, see isis_spf_trigger() */
+#define ISIS_SPF_PENDING_FULL	0x01
+#define ISIS_SPF_PENDING_PRC	0x02	/* only routes need recalculating */
+
 enum vertextype
 {
   VTYPE_PSEUDO_IS = 1,
@@ -59,6 +65,7 @@ struct isis_vertex
   u_int16_t depth;		/* The depth in the imaginary tree */
 
   struct list *Adj_N;		/* {Adj(N)}  */
+  int tent_index;		/* position in TENT, -1 once in PATHS */
 };
 
 struct isis_spftree
@@ -67,7 +74,8 @@ struct isis_spftree
   time_t lastrun;		/* for scheduling */
   int pending;			/* already scheduled */
   struct list *paths;		/* the SPT */
-  struct list *tents;		/* TENT */
+  struct pqueue *tents;		/* TENT */
+  struct hash *vertices;	/* TENT and PATHS, by id */
 
   u_int32_t timerun;		/* statistics */
 };
@@ -80,6 +88,9 @@ struct isis_spftree
 EXT void spftree_area_init (struct isis_area *);
 EXT int isis_spf_schedule (struct isis_area *, int);
 EXT int isis_run_spf (struct isis_area *, int, int);
+EXT int isis_run_prc (struct isis_area *, int, int);
+EXT int isis_spf_run_pending (struct isis_area *, int, int);
+EXT void isis_spf_trigger (struct isis_area *, int, int);
 #ifdef ENABLE_IPV6
 EXT int isis_spf_schedule6 (struct isis_area *, int);
 #endif
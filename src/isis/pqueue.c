@@ -0,0 +1,185 @@
+/* Priority queue (binary heap)
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#define __PQUEUE_C
+
+#include "pmacct.h"
+#include "isis.h"
+
+#include "pqueue.h"
+
+/* Index arithmetic of a binary heap laid out in an array */
+#define DATA_SIZE (sizeof (void *))
+#define PARENT_OF(x) ((x - 1) / 2)
+#define LEFT_OF(x)  (2 * x + 1)
+#define RIGHT_OF(x) (2 * x + 2)
+#define HAVE_CHILD(x,q) (x < (q)->size / 2)
+
+void
+isis_pqueue_trickle_up (int index, struct pqueue *queue)
+{
+  void *tmp;
+
+  /* Save current node as tmp node.  */
+  tmp = queue->array[index];
+
+  /* Continue until the node reaches top or the place where the parent
+     node should be upper than the tmp node.  */
+  while (index > 0 &&
+         (*queue->cmp) (tmp, queue->array[PARENT_OF (index)]) < 0)
+    {
+      /* actually trickle up */
+      queue->array[index] = queue->array[PARENT_OF (index)];
+      if (queue->update != NULL)
+	(*queue->update) (queue->array[index], index);
+      index = PARENT_OF (index);
+    }
+
+  /* Restore the tmp node to appropriate place.  */
+  queue->array[index] = tmp;
+  if (queue->update != NULL)
+    (*queue->update) (tmp, index);
+}
+
+void
+isis_pqueue_trickle_down (int index, struct pqueue *queue)
+{
+  void *tmp;
+  int which;
+
+  /* Save current node as tmp node.  */
+  tmp = queue->array[index];
+
+  /* Continue until the node have at least one (left) child.  */
+  while (HAVE_CHILD (index, queue))
+    {
+      /* If right child exists, and if the right child is more proper
+         to be moved upper.  */
+      if (RIGHT_OF (index) < queue->size &&
+          (*queue->cmp) (queue->array[LEFT_OF (index)],
+                         queue->array[RIGHT_OF (index)]) > 0)
+        which = RIGHT_OF (index);
+      else
+        which = LEFT_OF (index);
+
+      /* If the tmp node should be upper than the child, break.  */
+      if ((*queue->cmp) (queue->array[which], tmp) > 0)
+        break;
+
+      /* Actually trickle down the tmp node.  */
+      queue->array[index] = queue->array[which];
+      if (queue->update != NULL)
+	(*queue->update) (queue->array[index], index);
+      index = which;
+    }
+
+  /* Restore the tmp node to appropriate place.  */
+  queue->array[index] = tmp;
+  if (queue->update != NULL)
+    (*queue->update) (tmp, index);
+}
+
+struct pqueue *
+isis_pqueue_create (void)
+{
+  struct pqueue *queue;
+
+  queue = calloc(1, sizeof (struct pqueue));
+  if (queue == NULL)
+    return NULL;
+
+  queue->array = calloc(1, DATA_SIZE * PQUEUE_INIT_ARRAYSIZE);
+  if (queue->array == NULL)
+    {
+      free(queue);
+      return NULL;
+    }
+
+  queue->array_size = PQUEUE_INIT_ARRAYSIZE;
+
+  /* By default we want nothing to happen when a node changes. */
+  queue->update = NULL;
+
+  return queue;
+}
+
+void
+isis_pqueue_delete (struct pqueue *queue)
+{
+  free(queue->array);
+  free(queue);
+}
+
+static int
+pqueue_expand (struct pqueue *queue)
+{
+  void **newarray;
+
+  newarray = realloc(queue->array, queue->array_size * DATA_SIZE * 2);
+  if (newarray == NULL)
+    return 0;
+
+  queue->array = newarray;
+  queue->array_size *= 2;
+
+  return 1;
+}
+
+void
+isis_pqueue_enqueue (void *data, struct pqueue *queue)
+{
+  if (queue->size + 2 >= queue->array_size && ! pqueue_expand (queue))
+    {
+      Log(LOG_ERR, "ERROR ( %s/core/ISIS ): isis_pqueue_enqueue() out of memory!\n", config.name);
+      return;
+    }
+
+  queue->array[queue->size] = data;
+  if (queue->update != NULL)
+    (*queue->update) (data, queue->size);
+  isis_pqueue_trickle_up (queue->size, queue);
+  queue->size ++;
+}
+
+void *
+isis_pqueue_dequeue (struct pqueue *queue)
+{
+  void *data = queue->array[0];
+  queue->array[0] =  queue->array[--queue->size];
+  isis_pqueue_trickle_down (0, queue);
+  return data;
+}
+
+void
+isis_pqueue_remove_at (int index, struct pqueue *queue)
+{
+  queue->array[index] = queue->array[--queue->size];
+
+  if (index > 0
+      && (*queue->cmp) (queue->array[index],
+                        queue->array[PARENT_OF(index)]) < 0)
+    {
+      isis_pqueue_trickle_up (index, queue);
+    }
+  else
+    {
+      isis_pqueue_trickle_down (index, queue);
+    }
+}
@@ -0,0 +1,52 @@
+/* Priority queue (binary heap)
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _PQUEUE_H_
+#define _PQUEUE_H_
+
+#define PQUEUE_INIT_ARRAYSIZE  32
+
+struct pqueue
+{
+  void **array;
+  int array_size;
+  int size;
+
+  /* negative if the first argument is to be dequeued first */
+  int (*cmp) (void *, void *);
+  /* told about every move, so that elements can track their index */
+  void (*update) (void *, int);
+};
+
+#if (!defined __PQUEUE_C)
+#define EXT extern
+#else
+#define EXT
+#endif
+EXT struct pqueue *isis_pqueue_create (void);
+EXT void isis_pqueue_delete (struct pqueue *);
+EXT void isis_pqueue_enqueue (void *, struct pqueue *);
+EXT void *isis_pqueue_dequeue (struct pqueue *);
+EXT void isis_pqueue_remove_at (int, struct pqueue *);
+EXT void isis_pqueue_trickle_down (int, struct pqueue *);
+EXT void isis_pqueue_trickle_up (int, struct pqueue *);
+#undef EXT
+
+#endif /* _PQUEUE_H_ */
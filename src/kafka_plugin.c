@@ -29,10 +29,20 @@
 #include "plugin_cmn_json.h"
 #include "plugin_cmn_avro.h"
 #include "kafka_plugin.h"
+#include "crc32.h"
 #ifndef WITH_JANSSON
 #error "--enable-kafka requires --enable-jansson"
 #endif
 
+/* variables */
+static struct p_purge_pool kafka_purge_pool;
+static struct p_kafka_purge *kafka_purge;
+
+/* prototypes */
+static void kafka_purge_init_host(struct p_kafka_host *, int);
+static u_int32_t kafka_purge_topic_key(struct chained_cache *);
+static void kafka_cache_purge_worker(struct p_purge_worker *);
+
 /* Functions */
 void kafka_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 {
@@ -120,6 +130,15 @@ void kafka_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
     exit_plugin(1);
   }
 
+  /* a static topic with a fixed partition or key sends everything to a
+     single partition: only a single producer can preserve its ordering */
+  if (config.dump_purge_threads > 1 && !(config.sql_table && strchr(config.sql_table, '$')) &&
+      (config.kafka_partition || config.kafka_partition_key)) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): 'kafka_purge_threads' ignored: static 'kafka_topic' with 'kafka_partition' or 'kafka_partition_key' requires a single producer.\n",
+	config.name, config.type);
+    config.dump_purge_threads = 1;
+  }
+
   /* setting function pointers */
   if (config.what_to_count & (COUNT_SUM_HOST|COUNT_SUM_NET))
     insert_func = P_sum_host_insert;
@@ -188,7 +207,7 @@ void kafka_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
     pfd.events = POLLIN;
     timeout = MIN(refresh_timeout, (amqp_timeout ? amqp_timeout : INT_MAX));
     timeout = MIN(timeout, (avro_schema_timeout ? avro_schema_timeout : INT_MAX));
-    ret = poll(&pfd, (pfd.fd == ERR ? 0 : 1), timeout);
+    ret = plugin_pipe_poll(&pfd, status, timeout);
 
     if (ret <= 0) {
       if (getppid() == 1) {
@@ -267,6 +286,7 @@ void kafka_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
         pollagain = FALSE;
         memcpy(pipebuf, rg->ptr, bufsz);
+        plugin_pipe_ring_release(status);
         rg->ptr += bufsz;
       }
 #ifdef WITH_RABBITMQ
@@ -326,36 +346,13 @@ void kafka_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
 void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 {
-  struct pkt_primitives *data = NULL;
-  struct pkt_bgp_primitives *pbgp = NULL;
-  struct pkt_nat_primitives *pnat = NULL;
-  struct pkt_mpls_primitives *pmpls = NULL;
-  struct pkt_tunnel_primitives *ptun = NULL;
-  char *pcust = NULL;
-  struct pkt_vlen_hdr_primitives *pvlen = NULL;
-  struct pkt_bgp_primitives empty_pbgp;
-  struct pkt_nat_primitives empty_pnat;
-  struct pkt_mpls_primitives empty_pmpls;
-  struct pkt_tunnel_primitives empty_ptun;
-  char *empty_pcust = NULL;
-  char src_mac[18], dst_mac[18], src_host[INET6_ADDRSTRLEN], dst_host[INET6_ADDRSTRLEN], ip_address[INET6_ADDRSTRLEN];
-  char rd_str[SRVBUFLEN], misc_str[SRVBUFLEN], dyn_kafka_topic[SRVBUFLEN], *orig_kafka_topic = NULL;
-  int i, j, stop, batch_idx, is_topic_dyn = FALSE, qn = 0, ret, saved_index = index;
-  int mv_num = 0, mv_num_save = 0;
+  struct p_kafka_purge serial_purge, *purge;
+  struct p_purge_worker serial_worker;
+  char *empty_pcust = NULL, *orig_kafka_topic = NULL;
+  int j, stop, is_topic_dyn = FALSE, qn = 0, ret, saved_index = index, workers, errors = 0;
   time_t start, duration;
   pid_t writer_pid = getpid();
 
-  char *json_buf = NULL;
-  int json_buf_off = 0;
-
-#ifdef WITH_AVRO
-  avro_writer_t avro_writer;
-  char *avro_buf = NULL;
-  int avro_buffer_full = FALSE;
-#endif
-
-  p_kafka_init_host(&kafkap_kafka_host, config.kafka_config_file);
-
   /* setting some defaults */
   if (!config.sql_host) config.sql_host = default_kafka_broker_host;
   if (!config.kafka_broker_port) config.kafka_broker_port = default_kafka_broker_port;
@@ -370,33 +367,15 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
 
   if (config.amqp_routing_key_rr) orig_kafka_topic = config.sql_table;
 
-  p_kafka_init_topic_rr(&kafkap_kafka_host);
-  p_kafka_set_topic_rr(&kafkap_kafka_host, config.amqp_routing_key_rr);
-
   empty_pcust = malloc(config.cpptrs.len);
   if (!empty_pcust) {
     Log(LOG_ERR, "ERROR ( %s/%s ): Unable to malloc() empty_pcust. Exiting.\n", config.name, config.type);
     exit_plugin(1);
   }
 
-  memset(&empty_pbgp, 0, sizeof(struct pkt_bgp_primitives));
-  memset(&empty_pnat, 0, sizeof(struct pkt_nat_primitives));
-  memset(&empty_pmpls, 0, sizeof(struct pkt_mpls_primitives));
-  memset(&empty_ptun, 0, sizeof(struct pkt_tunnel_primitives));
   memset(empty_pcust, 0, config.cpptrs.len);
 
-  p_kafka_connect_to_produce(&kafkap_kafka_host);
-  p_kafka_set_broker(&kafkap_kafka_host, config.sql_host, config.kafka_broker_port);
-  if (!is_topic_dyn && !config.amqp_routing_key_rr) p_kafka_set_topic(&kafkap_kafka_host, config.sql_table);
-  p_kafka_set_partition(&kafkap_kafka_host, config.kafka_partition);
-  p_kafka_set_key(&kafkap_kafka_host, config.kafka_partition_key, config.kafka_partition_keylen);
-
-  if (config.message_broker_output & PRINT_OUTPUT_JSON) p_kafka_set_content_type(&kafkap_kafka_host, PM_KAFKA_CNT_TYPE_STR);
-  else if (config.message_broker_output & PRINT_OUTPUT_AVRO) p_kafka_set_content_type(&kafkap_kafka_host, PM_KAFKA_CNT_TYPE_BIN);
-  else {
-    Log(LOG_ERR, "ERROR ( %s/%s ): Unsupported kafka_output value specified. Exiting.\n", config.name, config.type);
-    exit_plugin(1);
-  }
+  kafka_purge_init_host(&kafkap_kafka_host, is_topic_dyn);
 
   for (j = 0, stop = 0; (!stop) && P_preprocess_funcs[j]; j++)
     stop = P_preprocess_funcs[j](queue, &index, j);
@@ -422,13 +401,165 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
     }
   }
 
+  if ((workers = P_purge_pool_init(&kafka_purge_pool, kafka_cache_purge_worker))) {
+    if (!kafka_purge) {
+      kafka_purge = (struct p_kafka_purge *) pm_malloc(workers * sizeof(struct p_kafka_purge));
+      memset(kafka_purge, 0, workers * sizeof(struct p_kafka_purge));
+    }
+
+    /* each worker produces through its own handle; records sharing a
+       dynamic topic are kept on the same worker to preserve their order */
+    for (j = 0; j < workers; j++) {
+      purge = &kafka_purge[j];
+
+      kafka_purge_init_host(&purge->host, is_topic_dyn);
+      purge->kafka_host = &purge->host;
+      purge->orig_kafka_topic = orig_kafka_topic;
+      purge->is_topic_dyn = is_topic_dyn;
+      purge->writer_pid = writer_pid;
+      purge->empty_pcust = empty_pcust;
+
+      kafka_purge_pool.worker[j].priv = purge;
+    }
+
+    P_purge_pool_partition(&kafka_purge_pool, queue, index, is_topic_dyn ? kafka_purge_topic_key : NULL);
+    P_purge_pool_run(&kafka_purge_pool);
+
+    for (j = 0; j < workers; j++) {
+      p_kafka_close(&kafka_purge[j].host, FALSE);
+      qn += kafka_purge_pool.worker[j].qn;
+      if (kafka_purge_pool.worker[j].ret == ERR) errors++;
+    }
+  }
+  else {
+    memset(&serial_purge, 0, sizeof(serial_purge));
+    serial_purge.kafka_host = &kafkap_kafka_host;
+    serial_purge.orig_kafka_topic = orig_kafka_topic;
+    serial_purge.is_topic_dyn = is_topic_dyn;
+    serial_purge.writer_pid = writer_pid;
+    serial_purge.empty_pcust = empty_pcust;
+
+    memset(&serial_worker, 0, sizeof(serial_worker));
+    serial_worker.queue = queue;
+    serial_worker.index = index;
+    serial_worker.priv = &serial_purge;
+
+    kafka_cache_purge_worker(&serial_worker);
+    qn = serial_worker.qn;
+    if (serial_worker.ret == ERR) errors++;
+  }
+
+  duration = time(NULL)-start;
+
+  if (config.print_markers) {
+    if (config.message_broker_output & PRINT_OUTPUT_JSON || config.message_broker_output & PRINT_OUTPUT_AVRO) {
+      void *json_obj;
+      char *json_str;
+
+      json_obj = compose_purge_close_json(config.name, writer_pid, qn, saved_index, duration);
+
+      if (json_obj) json_str = compose_json_str(json_obj);
+      if (json_str) {
+	sleep(1); /* Let's give a small delay to facilitate purge_close being
+		     the last message in batch in case of partitioned topics */
+        Log(LOG_DEBUG, "DEBUG ( %s/%s ): %s\n\n", config.name, config.type, json_str);
+        ret = p_kafka_produce_data(&kafkap_kafka_host, json_str, strlen(json_str));
+
+        free(json_str);
+        json_str = NULL;
+      }
+    }
+  }
+
+  p_kafka_close(&kafkap_kafka_host, FALSE);
+
+  if (errors) Log(LOG_ERR, "ERROR ( %s/%s ): %u purge worker(s) aborted; cache purged partially.\n", config.name, config.type, errors);
+
+  Log(LOG_INFO, "INFO ( %s/%s ): *** Purging cache - END (PID: %u, QN: %u/%u, ET: %u) ***\n",
+		config.name, config.type, writer_pid, qn, saved_index, duration);
+
+  if (workers) P_purge_pool_report(&kafka_purge_pool);
+
+  if (config.sql_trigger_exec) P_trigger_exec(config.sql_trigger_exec); 
+
+  if (empty_pcust) free(empty_pcust);
+}
+
+static void kafka_purge_init_host(struct p_kafka_host *kafka_host, int is_topic_dyn)
+{
+  p_kafka_init_host(kafka_host, config.kafka_config_file);
+
+  p_kafka_init_topic_rr(kafka_host);
+  p_kafka_set_topic_rr(kafka_host, config.amqp_routing_key_rr);
+
+  p_kafka_connect_to_produce(kafka_host);
+  p_kafka_set_broker(kafka_host, config.sql_host, config.kafka_broker_port);
+  if (!is_topic_dyn && !config.amqp_routing_key_rr) p_kafka_set_topic(kafka_host, config.sql_table);
+  p_kafka_set_partition(kafka_host, config.kafka_partition);
+  p_kafka_set_key(kafka_host, config.kafka_partition_key, config.kafka_partition_keylen);
+
+  if (config.message_broker_output & PRINT_OUTPUT_JSON) p_kafka_set_content_type(kafka_host, PM_KAFKA_CNT_TYPE_STR);
+  else if (config.message_broker_output & PRINT_OUTPUT_AVRO) p_kafka_set_content_type(kafka_host, PM_KAFKA_CNT_TYPE_BIN);
+  else {
+    Log(LOG_ERR, "ERROR ( %s/%s ): Unsupported kafka_output value specified. Exiting.\n", config.name, config.type);
+    exit_plugin(1);
+  }
+}
+
+static u_int32_t kafka_purge_topic_key(struct chained_cache *cache_ptr)
+{
+  char topic[SRVBUFLEN];
+
+  P_handle_table_dyn_strings(topic, SRVBUFLEN, config.sql_table, cache_ptr);
+
+  return cache_crc32((unsigned char *) topic, strlen(topic));
+}
+
+static void kafka_cache_purge_worker(struct p_purge_worker *worker)
+{
+  struct p_kafka_purge *purge = (struct p_kafka_purge *) worker->priv;
+  struct p_kafka_host *kafka_host = purge->kafka_host;
+  struct chained_cache **queue = worker->queue;
+  struct pkt_primitives *data = NULL;
+  struct pkt_bgp_primitives *pbgp = NULL;
+  struct pkt_nat_primitives *pnat = NULL;
+  struct pkt_mpls_primitives *pmpls = NULL;
+  struct pkt_tunnel_primitives *ptun = NULL;
+  char *pcust = NULL;
+  struct pkt_vlen_hdr_primitives *pvlen = NULL;
+  struct pkt_bgp_primitives empty_pbgp;
+  struct pkt_nat_primitives empty_pnat;
+  struct pkt_mpls_primitives empty_pmpls;
+  struct pkt_tunnel_primitives empty_ptun;
+  char dyn_kafka_topic[SRVBUFLEN];
+  int j, index = worker->index, qn = 0, ret;
+  int mv_num = 0, mv_num_save = 0;
+
+  char *json_buf = NULL;
+  int json_buf_off = 0;
+
+#ifdef WITH_AVRO
+  avro_writer_t avro_writer = NULL;
+  char *avro_buf = NULL;
+  int avro_buffer_full = FALSE;
+#endif
+
+  /* in thread mode this runs in a writer thread: errors must not take
+     the plugin down, they abort this share of the purge instead */
+  worker->ret = SUCCESS;
+
+  memset(&empty_pbgp, 0, sizeof(struct pkt_bgp_primitives));
+  memset(&empty_pnat, 0, sizeof(struct pkt_nat_primitives));
+  memset(&empty_pmpls, 0, sizeof(struct pkt_mpls_primitives));
+  memset(&empty_ptun, 0, sizeof(struct pkt_tunnel_primitives));
+
   if (config.message_broker_output & PRINT_OUTPUT_JSON) {
     if (config.sql_multi_values) {
       json_buf = malloc(config.sql_multi_values);
 
       if (!json_buf) {
-	Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (json_buf). Exiting ..\n", config.name, config.type);
-	exit_plugin(1);
+	Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (json_buf). Purge aborted.\n", config.name, config.type);
+	goto error;
       }
       else memset(json_buf, 0, config.sql_multi_values);
     }
@@ -440,12 +571,16 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
     avro_buf = malloc(config.avro_buffer_size);
 
     if (!avro_buf) {
-      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (avro_buf). Exiting ..\n", config.name, config.type);
-      exit_plugin(1);
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (avro_buf). Purge aborted.\n", config.name, config.type);
+      goto error;
     }
     else memset(avro_buf, 0, config.avro_buffer_size);
 
     avro_writer = avro_writer_memory(avro_buf, config.avro_buffer_size);
+    if (!avro_writer) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): AVRO: unable to create writer. Purge aborted.\n", config.name, config.type);
+      goto error;
+    }
 #endif
   }
 
@@ -469,7 +604,7 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
     else ptun = &empty_ptun;
 
     if (queue[j]->pcust) pcust = queue[j]->pcust;
-    else pcust = empty_pcust;
+    else pcust = purge->empty_pcust;
 
     if (queue[j]->pvlen) pvlen = queue[j]->pvlen;
     else pvlen = NULL;
@@ -478,13 +613,7 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
 
     if (config.message_broker_output & PRINT_OUTPUT_JSON) {
 #ifdef WITH_JANSSON
-      json_t *json_obj = json_object();
-      int idx;
-
-      for (idx = 0; idx < N_PRIMITIVES && cjhandler[idx]; idx++) cjhandler[idx](json_obj, queue[j]);
-      add_writer_name_and_pid_json(json_obj, config.name, writer_pid);
-
-      json_str = compose_json_str(json_obj);
+      json_str = compose_json_record(queue[j], config.name, purge->writer_pid);
 #endif
     }
     else if (config.message_broker_output & PRINT_OUTPUT_AVRO) {
@@ -496,7 +625,7 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
                            &queue[j]->basetime, queue[j]->stitch, avro_iface);
       size_t avro_value_size;
 
-      add_writer_name_and_pid_avro(avro_value, config.name, writer_pid);
+      add_writer_name_and_pid_avro(avro_value, config.name, purge->writer_pid);
       avro_value_sizeof(&avro_value, &avro_value_size);
 
       if (avro_value_size > config.avro_buffer_size) {
@@ -504,7 +633,7 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
             config.name, config.type, config.avro_buffer_size);
         Log(LOG_ERR, "ERROR ( %s/%s ): AVRO: increase value or look for avro_buffer_size in CONFIG-KEYS document.\n\n",
             config.name, config.type);
-        exit_plugin(1);
+        worker->ret = ERR;
       }
       else if (avro_value_size >= (config.avro_buffer_size - avro_writer_tell(avro_writer))) {
         avro_buffer_full = TRUE;
@@ -513,7 +642,7 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
       else if (avro_value_write(avro_writer, &avro_value)) {
         Log(LOG_ERR, "ERROR ( %s/%s ): AVRO: unable to write value: %s\n",
             config.name, config.type, avro_strerror());
-        exit_plugin(1);
+        worker->ret = ERR;
       }
       else {
         mv_num++;
@@ -521,6 +650,8 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
 
       avro_value_decref(&avro_value);
       avro_value_iface_decref(avro_iface);
+
+      if (worker->ret == ERR) goto error;
 #else
       if (config.debug) Log(LOG_DEBUG, "DEBUG ( %s/%s ): compose_avro(): AVRO object not created due to missing --enable-avro\n", config.name, config.type);
 #endif
@@ -534,8 +665,9 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
 
 	if (json_strlen >= (config.sql_multi_values - json_buf_off)) {
 	  if (json_strlen >= config.sql_multi_values) {
-	    Log(LOG_ERR, "ERROR ( %s/%s ): kafka_multi_values not large enough to store JSON elements. Exiting ..\n", config.name, config.type); 
-	    exit(1);
+	    Log(LOG_ERR, "ERROR ( %s/%s ): kafka_multi_values not large enough to store JSON elements. Purge aborted.\n", config.name, config.type); 
+	    free(json_str);
+	    goto error;
 	  }
 
 	  tmp_str = json_str;
@@ -548,24 +680,23 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
 	  string_add_newline(json_buf);
 	  json_buf_off = strlen(json_buf);
 
-	  free(json_str);
 	  json_str = NULL;
 	}
       }
 
       if (json_str) {
-        if (is_topic_dyn) {
-          P_handle_table_dyn_strings(dyn_kafka_topic, SRVBUFLEN, orig_kafka_topic, queue[j]);
-          p_kafka_set_topic(&kafkap_kafka_host, dyn_kafka_topic);
+        if (purge->is_topic_dyn) {
+          P_handle_table_dyn_strings(dyn_kafka_topic, SRVBUFLEN, purge->orig_kafka_topic, queue[j]);
+          p_kafka_set_topic(kafka_host, dyn_kafka_topic);
         }
 
         if (config.amqp_routing_key_rr) {
-          P_handle_table_dyn_rr(dyn_kafka_topic, SRVBUFLEN, orig_kafka_topic, &kafkap_kafka_host.topic_rr);
-          p_kafka_set_topic(&kafkap_kafka_host, dyn_kafka_topic);
+          P_handle_table_dyn_rr(dyn_kafka_topic, SRVBUFLEN, purge->orig_kafka_topic, &kafka_host->topic_rr);
+          p_kafka_set_topic(kafka_host, dyn_kafka_topic);
         }
 
         Log(LOG_DEBUG, "DEBUG ( %s/%s ): %s\n\n", config.name, config.type, json_str);
-        ret = p_kafka_produce_data(&kafkap_kafka_host, json_str, strlen(json_str));
+        ret = p_kafka_produce_data(kafka_host, json_str, strlen(json_str));
 
 	if (config.sql_multi_values) {
 	  json_str = tmp_str;
@@ -578,7 +709,6 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
           json_buf_off = strlen(json_buf);
         }
 
-        free(json_str);
         json_str = NULL;
 
         if (!ret) {
@@ -591,17 +721,17 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
     else if (config.message_broker_output & PRINT_OUTPUT_AVRO) {
 #ifdef WITH_AVRO
       if (!config.sql_multi_values || (mv_num >= config.sql_multi_values) || avro_buffer_full) {
-        if (is_topic_dyn) {
-          P_handle_table_dyn_strings(dyn_kafka_topic, SRVBUFLEN, orig_kafka_topic, queue[j]);
-          p_kafka_set_topic(&kafkap_kafka_host, dyn_kafka_topic);
+        if (purge->is_topic_dyn) {
+          P_handle_table_dyn_strings(dyn_kafka_topic, SRVBUFLEN, purge->orig_kafka_topic, queue[j]);
+          p_kafka_set_topic(kafka_host, dyn_kafka_topic);
         }
 
         if (config.amqp_routing_key_rr) {
-          P_handle_table_dyn_rr(dyn_kafka_topic, SRVBUFLEN, orig_kafka_topic, &kafkap_kafka_host.topic_rr);
-          p_kafka_set_topic(&kafkap_kafka_host, dyn_kafka_topic);
+          P_handle_table_dyn_rr(dyn_kafka_topic, SRVBUFLEN, purge->orig_kafka_topic, &kafka_host->topic_rr);
+          p_kafka_set_topic(kafka_host, dyn_kafka_topic);
         }
 
-        ret = p_kafka_produce_data(&kafkap_kafka_host, avro_buf, avro_writer_tell(avro_writer));
+        ret = p_kafka_produce_data(kafka_host, avro_buf, avro_writer_tell(avro_writer));
         avro_writer_reset(avro_writer);
         avro_buffer_full = FALSE;
         mv_num_save = mv_num;
@@ -619,7 +749,7 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
       if (json_buf && json_buf_off) {
 	/* no handling of dyn routing keys here: not compatible */
 	Log(LOG_DEBUG, "DEBUG ( %s/%s ): %s\n\n", config.name, config.type, json_buf);
-	ret = p_kafka_produce_data(&kafkap_kafka_host, json_buf, strlen(json_buf));
+	ret = p_kafka_produce_data(kafka_host, json_buf, strlen(json_buf));
 
 	if (!ret) qn += mv_num;
       }
@@ -627,8 +757,7 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
     else if (config.message_broker_output & PRINT_OUTPUT_AVRO) {
 #ifdef WITH_AVRO
       if (avro_writer_tell(avro_writer)) {
-        ret = p_kafka_produce_data(&kafkap_kafka_host, avro_buf, avro_writer_tell(avro_writer));
-        avro_writer_free(avro_writer);
+        ret = p_kafka_produce_data(kafka_host, avro_buf, avro_writer_tell(avro_writer));
 
         if (!ret) qn += mv_num;
       }
@@ -636,40 +765,18 @@ void kafka_cache_purge(struct chained_cache *queue[], int index, int safe_action
     }
   }
 
-  duration = time(NULL)-start;
-
-  if (config.print_markers) {
-    if (config.message_broker_output & PRINT_OUTPUT_JSON || config.message_broker_output & PRINT_OUTPUT_AVRO) {
-      void *json_obj;
-      char *json_str;
-
-      json_obj = compose_purge_close_json(config.name, writer_pid, qn, saved_index, duration);
-
-      if (json_obj) json_str = compose_json_str(json_obj);
-      if (json_str) {
-	sleep(1); /* Let's give a small delay to facilitate purge_close being
-		     the last message in batch in case of partitioned topics */
-        Log(LOG_DEBUG, "DEBUG ( %s/%s ): %s\n\n", config.name, config.type, json_str);
-        ret = p_kafka_produce_data(&kafkap_kafka_host, json_str, strlen(json_str));
-
-        free(json_str);
-        json_str = NULL;
-      }
-    }
-  }
-
-  p_kafka_close(&kafkap_kafka_host, FALSE);
-
-  Log(LOG_INFO, "INFO ( %s/%s ): *** Purging cache - END (PID: %u, QN: %u/%u, ET: %u) ***\n",
-		config.name, config.type, writer_pid, qn, saved_index, duration);
+  goto exit_lane;
 
-  if (config.sql_trigger_exec) P_trigger_exec(config.sql_trigger_exec); 
+  error:
+  worker->ret = ERR;
 
-  if (empty_pcust) free(empty_pcust);
+  exit_lane:
+  worker->qn = qn;
 
   if (json_buf) free(json_buf);
 
 #ifdef WITH_AVRO
+  if (avro_writer) avro_writer_free(avro_writer);
   if (avro_buf) free(avro_buf);
 #endif
 }
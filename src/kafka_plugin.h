@@ -26,6 +26,14 @@
 /* defines */
 
 /* structures */
+struct p_kafka_purge {
+  struct p_kafka_host host;
+  struct p_kafka_host *kafka_host;
+  char *orig_kafka_topic;
+  char *empty_pcust;
+  int is_topic_dyn;
+  pid_t writer_pid;
+};
 
 /* prototypes */
 #if (!defined __KAFKA_PLUGIN_C)
@@ -158,7 +158,7 @@ void mongodb_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
     pfd.fd = pipe_fd;
     pfd.events = POLLIN;
     timeout = MIN(refresh_timeout, (amqp_timeout ? amqp_timeout : INT_MAX));
-    ret = poll(&pfd, (pfd.fd == ERR ? 0 : 1), timeout);
+    ret = plugin_pipe_poll(&pfd, status, timeout);
 
     if (ret <= 0) {
       if (getppid() == 1) {
@@ -230,6 +230,7 @@ void mongodb_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
         pollagain = FALSE;
         memcpy(pipebuf, rg->ptr, bufsz);
+        plugin_pipe_ring_release(status);
         rg->ptr += bufsz;
       }
 #ifdef WITH_RABBITMQ
@@ -908,6 +909,10 @@ void MongoDB_cache_purge(struct chained_cache *queue[], int index, int safe_acti
   if (config.sql_trigger_exec) P_trigger_exec(config.sql_trigger_exec); 
 
   if (empty_pcust) free(empty_pcust);
+  if (bson_batch) free(bson_batch);
+
+  /* purge mode thread: writer is not going away */
+  mongo_disconnect(&db_conn);
 }
 
 int MongoDB_get_database(char *db, int dblen, char *db_table)
@@ -119,7 +119,7 @@ void mysql_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
     pfd.fd = pipe_fd;
     pfd.events = POLLIN;
     timeout = MIN(refresh_timeout, (amqp_timeout ? amqp_timeout : INT_MAX));
-    ret = poll(&pfd, (pfd.fd == ERR ? 0 : 1), timeout);
+    ret = plugin_pipe_poll(&pfd, status, timeout);
 
     if (ret <= 0) {
       if (getppid() == 1) {
@@ -197,6 +197,7 @@ void mysql_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
         pollagain = FALSE;
         memcpy(pipebuf, rg->ptr, bufsz);
+        plugin_pipe_ring_release(status);
         rg->ptr += bufsz;
       }
 #ifdef WITH_RABBITMQ
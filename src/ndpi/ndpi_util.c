@@ -24,6 +24,7 @@
 #ifdef WITH_NDPI
 
 #include <stdlib.h>
+#include <stddef.h>
 
 #ifdef WIN32
 #include <winsock2.h> /* winsock.h is included automatically */
@@ -70,6 +71,7 @@
 #endif
 
 #include "../pmacct.h"
+#include "../jhash.h"
 #include "ndpi_util.h"
 
 /* ***************************************************** */
@@ -107,7 +109,46 @@ static void ndpi_free_wrapper(void *freeable) {
 
 /* ***************************************************** */
 
+#define NDPI_FLOW_LRU(l) ((struct ndpi_flow_info *) ((char *) (l) - offsetof(struct ndpi_flow_info, lru)))
+
+static void ndpi_flow_lru_unlink(struct ndpi_flow_info *flow) {
+  flow->lru.prev->next = flow->lru.next;
+  flow->lru.next->prev = flow->lru.prev;
+}
+
+/* ***************************************************** */
+
+static void ndpi_flow_lru_push(struct ndpi_workflow *workflow, struct ndpi_flow_info *flow) {
+  flow->lru.next = workflow->ndpi_flows_lru.next;
+  flow->lru.prev = &workflow->ndpi_flows_lru;
+  flow->lru.next->prev = &flow->lru;
+  workflow->ndpi_flows_lru.next = &flow->lru;
+}
+
+/* ***************************************************** */
+
+/* flows are looked at lazily: last_seen is refreshed with no rescheduling */
+static time_t ndpi_flow_deadline(struct ip_table_entry *e, time_t now) {
+  struct ndpi_flow_info *flow = (struct ndpi_flow_info *) e;
+  time_t deadline = (flow->last_seen + MAX_IDLE_TIME) / TICK_RESOLUTION;
+
+  return((deadline > now) ? deadline : 0);
+}
+
+/* ***************************************************** */
+
+static void ndpi_flow_release(struct ip_table_entry *e) {
+  struct ndpi_flow_info *flow = (struct ndpi_flow_info *) e;
+
+  ndpi_flow_lru_unlink(flow);
+  ndpi_free_flow_info_half(flow);
+}
+
+/* ***************************************************** */
+
 struct ndpi_workflow * ndpi_workflow_init(const struct ndpi_workflow_prefs * prefs, pcap_t * pcap_handle) {
+  u_int64_t max_flows;
+  u_int32_t flow_size;
 
   set_ndpi_malloc(ndpi_malloc_wrapper), set_ndpi_free(ndpi_free_wrapper);
   set_ndpi_flow_malloc(NULL), set_ndpi_flow_free(NULL);
@@ -125,29 +166,31 @@ struct ndpi_workflow * ndpi_workflow_init(const struct ndpi_workflow_prefs * pre
     exit(-1);
   }
 
-  workflow->ndpi_flows_root = ndpi_calloc(workflow->prefs.num_roots, sizeof(void *));
-  return workflow;
-}
+  /* the memory cap accounts for the nDPI state of each flow too */
+  flow_size = sizeof(struct ndpi_flow_info) + SIZEOF_FLOW_STRUCT + 2 * SIZEOF_ID_STRUCT;
+  max_flows = workflow->prefs.max_ndpi_flows;
+  if(workflow->prefs.max_flows_memory && (workflow->prefs.max_flows_memory / flow_size) < max_flows)
+    max_flows = workflow->prefs.max_flows_memory / flow_size;
 
-/* ***************************************************** */
+  ip_table_init(&workflow->ndpi_flows, workflow->prefs.num_roots, MAX_NUM_ROOTS,
+		sizeof(struct ndpi_flow_info), max_flows, ndpi_flow_deadline, ndpi_flow_release);
+  /* the wheel follows packet time, which may well be in the past */
+  workflow->ndpi_flows.clk = 0;
 
-static void ndpi_flow_info_freer(void *node) {
-  struct ndpi_flow_info *flow = (struct ndpi_flow_info*)node;
+  workflow->ndpi_flows_lru.next = workflow->ndpi_flows_lru.prev = &workflow->ndpi_flows_lru;
+  workflow->ndpi_flows_hash_rnd = (u_int32_t) random();
 
-  ndpi_free_flow_info_half(flow);
-  ndpi_free(flow);
+  return workflow;
 }
 
 /* ***************************************************** */
 
 void ndpi_workflow_free(struct ndpi_workflow * workflow) {
-  int i;
-
-  for(i=0; i<workflow->prefs.num_roots; i++)
-    ndpi_tdestroy(workflow->ndpi_flows_root[i], ndpi_flow_info_freer);
+  while(workflow->ndpi_flows_lru.next != &workflow->ndpi_flows_lru)
+    ip_table_remove(&workflow->ndpi_flows, &NDPI_FLOW_LRU(workflow->ndpi_flows_lru.next)->ent);
 
+  ip_table_free(&workflow->ndpi_flows);
   ndpi_exit_detection_module(workflow->ndpi_struct);
-  free(workflow->ndpi_flows_root);
   free(workflow);
 }
 
@@ -169,6 +212,33 @@ int ndpi_workflow_node_cmp(const void *a, const void *b) {
 
 /* ***************************************************** */
 
+static u_int32_t ndpi_workflow_node_hash(struct ndpi_workflow *workflow, const struct ndpi_flow_info *flow) {
+  return(jhash_3words(flow->lower_ip, flow->upper_ip,
+		      ((u_int32_t) flow->lower_port << 16) | flow->upper_port,
+		      workflow->ndpi_flows_hash_rnd ^ (((u_int32_t) flow->vlan_id << 8) | flow->protocol)));
+}
+
+/* ***************************************************** */
+
+/* when full, room is made evicting the least recently seen flow */
+static struct ndpi_flow_info *ndpi_workflow_node_alloc(struct ndpi_workflow *workflow) {
+  struct ndpi_flow_info *flow;
+
+  flow = (struct ndpi_flow_info *) ip_table_alloc(&workflow->ndpi_flows);
+
+  if(flow == NULL && workflow->ndpi_flows_lru.prev != &workflow->ndpi_flows_lru) {
+    ip_table_remove(&workflow->ndpi_flows, &NDPI_FLOW_LRU(workflow->ndpi_flows_lru.prev)->ent);
+    workflow->stats.ndpi_flow_count--;
+    workflow->stats.evicted_flow_count++;
+
+    flow = (struct ndpi_flow_info *) ip_table_alloc(&workflow->ndpi_flows);
+  }
+
+  return(flow);
+}
+
+/* ***************************************************** */
+
 static void ndpi_patchIPv6Address(char *str) {
   int i = 0, j = 0;
 
@@ -204,13 +274,13 @@ static struct ndpi_flow_info *get_ndpi_flow_info(struct ndpi_workflow * workflow
 						 u_int8_t **payload,
 						 u_int16_t *payload_len,
 						 u_int8_t *src_to_dst_direction) {
-  u_int32_t idx, l4_offset;
+  u_int32_t hash, l4_offset;
   u_int32_t lower_ip;
   u_int32_t upper_ip;
   u_int16_t lower_port;
   u_int16_t upper_port;
   struct ndpi_flow_info flow;
-  void *ret;
+  struct ip_table_entry *ret;
   u_int8_t *l3, *l4;
 
   /*
@@ -329,70 +399,74 @@ static struct ndpi_flow_info *get_ndpi_flow_info(struct ndpi_workflow * workflow
   NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_DEBUG, "[NDPI] [%u][%u:%u <-> %u:%u]\n",
 	   iph->protocol, lower_ip, ntohs(lower_port), upper_ip, ntohs(upper_port));
 
-  idx = (vlan_id + lower_ip + upper_ip + iph->protocol + lower_port + upper_port) % workflow->prefs.num_roots;
-  ret = ndpi_tfind(&flow, &workflow->ndpi_flows_root[idx], ndpi_workflow_node_cmp);
+  hash = ndpi_workflow_node_hash(workflow, &flow);
+
+  for(ret = ip_table_lookup(&workflow->ndpi_flows, hash); ret != NULL; ret = ret->next)
+    if(ret->hash == hash && !ndpi_workflow_node_cmp(&flow, ret))
+      break;
 
   if(ret == NULL) {
-    if(workflow->stats.ndpi_flow_count == workflow->prefs.max_ndpi_flows) {
-      NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR,
-	       "maximum flow count (%u) has been exceeded\n",
-	       workflow->prefs.max_ndpi_flows);
-      exit(-1);
-    } else {
-      struct ndpi_flow_info *newflow = (struct ndpi_flow_info*)malloc(sizeof(struct ndpi_flow_info));
+    struct ndpi_flow_info *newflow = ndpi_workflow_node_alloc(workflow);
 
-      if(newflow == NULL) {
-	NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(1): not enough memory\n", __FUNCTION__);
-	return(NULL);
-      }
+    if(newflow == NULL) {
+      NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(1): not enough memory\n", __FUNCTION__);
+      return(NULL);
+    }
 
-      memset(newflow, 0, sizeof(struct ndpi_flow_info));
-      newflow->protocol = iph->protocol, newflow->vlan_id = vlan_id;
-      newflow->lower_ip = lower_ip, newflow->upper_ip = upper_ip;
-      newflow->lower_port = lower_port, newflow->upper_port = upper_port;
-      newflow->ip_version = version;
-      newflow->src_to_dst_direction = *src_to_dst_direction;
-
-      if(version == IPVERSION) {
-	inet_ntop(AF_INET, &lower_ip, newflow->lower_name, sizeof(newflow->lower_name));
-	inet_ntop(AF_INET, &upper_ip, newflow->upper_name, sizeof(newflow->upper_name));
-      } else {
-	inet_ntop(AF_INET6, &iph6->ip6_src, newflow->lower_name, sizeof(newflow->lower_name));
-	inet_ntop(AF_INET6, &iph6->ip6_dst, newflow->upper_name, sizeof(newflow->upper_name));
-	/* For consistency across platforms replace :0: with :: */
-	ndpi_patchIPv6Address(newflow->lower_name), ndpi_patchIPv6Address(newflow->upper_name);
-      }
+    newflow->protocol = iph->protocol, newflow->vlan_id = vlan_id;
+    newflow->lower_ip = lower_ip, newflow->upper_ip = upper_ip;
+    newflow->lower_port = lower_port, newflow->upper_port = upper_port;
+    newflow->ip_version = version;
+    newflow->src_to_dst_direction = *src_to_dst_direction;
+    newflow->last_seen = workflow->last_time;
 
-      if((newflow->ndpi_flow = ndpi_flow_malloc(SIZEOF_FLOW_STRUCT)) == NULL) {
-	NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(2): not enough memory\n", __FUNCTION__);
-	free(newflow);
-	return(NULL);
-      } else
-	memset(newflow->ndpi_flow, 0, SIZEOF_FLOW_STRUCT);
-
-      if((newflow->src_id = ndpi_malloc(SIZEOF_ID_STRUCT)) == NULL) {
-	NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(3): not enough memory\n", __FUNCTION__);
-	free(newflow);
-	return(NULL);
-      } else
-	memset(newflow->src_id, 0, SIZEOF_ID_STRUCT);
-
-      if((newflow->dst_id = ndpi_malloc(SIZEOF_ID_STRUCT)) == NULL) {
-	NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(4): not enough memory\n", __FUNCTION__);
-	free(newflow);
-	return(NULL);
-      } else
-	memset(newflow->dst_id, 0, SIZEOF_ID_STRUCT);
-
-      ndpi_tsearch(newflow, &workflow->ndpi_flows_root[idx], ndpi_workflow_node_cmp); /* Add */
-      workflow->stats.ndpi_flow_count++;
-
-      *src = newflow->src_id, *dst = newflow->dst_id;
-
-      return newflow;
+    if(version == IPVERSION) {
+      inet_ntop(AF_INET, &lower_ip, newflow->lower_name, sizeof(newflow->lower_name));
+      inet_ntop(AF_INET, &upper_ip, newflow->upper_name, sizeof(newflow->upper_name));
+    } else {
+      inet_ntop(AF_INET6, &iph6->ip6_src, newflow->lower_name, sizeof(newflow->lower_name));
+      inet_ntop(AF_INET6, &iph6->ip6_dst, newflow->upper_name, sizeof(newflow->upper_name));
+      /* For consistency across platforms replace :0: with :: */
+      ndpi_patchIPv6Address(newflow->lower_name), ndpi_patchIPv6Address(newflow->upper_name);
     }
+
+    /* in the table from now on: removing it releases whatever got allocated */
+    ip_table_insert(&workflow->ndpi_flows, &newflow->ent, hash, workflow->last_time / TICK_RESOLUTION);
+    ndpi_flow_lru_push(workflow, newflow);
+    workflow->stats.ndpi_flow_count++;
+
+    if((newflow->ndpi_flow = ndpi_flow_malloc(SIZEOF_FLOW_STRUCT)) == NULL) {
+      NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(2): not enough memory\n", __FUNCTION__);
+      goto release;
+    } else
+      memset(newflow->ndpi_flow, 0, SIZEOF_FLOW_STRUCT);
+
+    if((newflow->src_id = ndpi_malloc(SIZEOF_ID_STRUCT)) == NULL) {
+      NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(3): not enough memory\n", __FUNCTION__);
+      goto release;
+    } else
+      memset(newflow->src_id, 0, SIZEOF_ID_STRUCT);
+
+    if((newflow->dst_id = ndpi_malloc(SIZEOF_ID_STRUCT)) == NULL) {
+      NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(4): not enough memory\n", __FUNCTION__);
+      goto release;
+    } else
+      memset(newflow->dst_id, 0, SIZEOF_ID_STRUCT);
+
+    *src = newflow->src_id, *dst = newflow->dst_id;
+
+    return newflow;
+
+  release:
+    ip_table_remove(&workflow->ndpi_flows, &newflow->ent);
+    workflow->stats.ndpi_flow_count--;
+    return(NULL);
   } else {
-    struct ndpi_flow_info *flow = *(struct ndpi_flow_info**)ret;
+    struct ndpi_flow_info *flow = (struct ndpi_flow_info *) ret;
+
+    /* most recently seen first */
+    ndpi_flow_lru_unlink(flow);
+    ndpi_flow_lru_push(workflow, flow);
 
     if(flow->lower_ip == lower_ip && flow->upper_ip == upper_ip
        && flow->lower_port == lower_port && flow->upper_port == upper_port)
@@ -636,6 +710,15 @@ struct ndpi_proto ndpi_workflow_process_packet (struct ndpi_workflow * workflow,
   /* update last time value */
   workflow->last_time = time;
 
+  /* purge idle flows, a budget at a time */
+  if(workflow->last_idle_scan_time + IDLE_SCAN_PERIOD < time) {
+    u_int32_t idle = ip_table_expire(&workflow->ndpi_flows, time / TICK_RESOLUTION, IDLE_SCAN_BUDGET);
+
+    workflow->stats.ndpi_flow_count -= idle;
+    workflow->stats.idle_flow_count += idle;
+    workflow->last_idle_scan_time = time;
+  }
+
   /*** check Data Link type ***/
   const int datalink_type = pcap_datalink(workflow->pcap_handle);
 
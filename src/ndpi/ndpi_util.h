@@ -31,18 +31,28 @@
 #define __NDPI_UTIL_H__
 
 #include <pcap.h>
+#include "../ip_table.h"
 
 #define MAX_NUM_READER_THREADS     16
 #define IDLE_SCAN_PERIOD           10 /* msec (use TICK_RESOLUTION = 1000) */
 #define MAX_IDLE_TIME           30000
 #define IDLE_SCAN_BUDGET         1024
-#define NUM_ROOTS                 512
+#define NUM_ROOTS                 512 /* initial hash buckets */
+#define MAX_NUM_ROOTS         4194304
 #define MAX_NDPI_FLOWS      200000000
+#define MAX_FLOWS_MEMORY    536870912 /* bytes, nDPI state included */
 #define TICK_RESOLUTION          1000
 
 
+// flows by recency: the least recently seen is evicted when full
+struct ndpi_flow_lru {
+  struct ndpi_flow_lru *next, *prev;
+};
+
 // flow tracking
 typedef struct ndpi_flow_info {
+  struct ip_table_entry ent; /* must be first, see ip_table.h */
+  struct ndpi_flow_lru lru;
   u_int32_t lower_ip;
   u_int32_t upper_ip;
   u_int16_t lower_port;
@@ -81,6 +91,7 @@ typedef struct ndpi_stats {
   u_int64_t protocol_counter_bytes[NDPI_MAX_SUPPORTED_PROTOCOLS + NDPI_MAX_NUM_CUSTOM_PROTOCOLS + 1];
   u_int32_t protocol_flows[NDPI_MAX_SUPPORTED_PROTOCOLS + NDPI_MAX_NUM_CUSTOM_PROTOCOLS + 1];
   u_int32_t ndpi_flow_count;
+  u_int64_t idle_flow_count, evicted_flow_count;
   u_int64_t tcp_count, udp_count;
   u_int64_t mpls_count, pppoe_count, vlan_count, fragmented_count;
   u_int64_t packet_len[6];
@@ -94,6 +105,7 @@ typedef struct ndpi_workflow_prefs {
   u_int8_t quiet_mode;
   u_int32_t num_roots;
   u_int32_t max_ndpi_flows;
+  u_int64_t max_flows_memory;
 } ndpi_workflow_prefs_t;
 
 struct ndpi_workflow;
@@ -118,7 +130,10 @@ typedef struct ndpi_workflow {
   pcap_t *pcap_handle;
 
   /* allocated by prefs */
-  void **ndpi_flows_root;
+  struct ip_table ndpi_flows;
+  struct ndpi_flow_lru ndpi_flows_lru;
+  u_int32_t ndpi_flows_hash_rnd;
+  u_int64_t last_idle_scan_time;
   struct ndpi_detection_module_struct *ndpi_struct;
 } ndpi_workflow_t;
 
@@ -44,6 +44,8 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
   struct networks_table tmp, *tmpt = &tmp; 
   struct networks_table bkt;
   struct networks_table_metadata *mdt = NULL;
+  struct networks_trie trie;
+  struct networks_trie_prefix *tpfx = NULL;
   char buf[SRVBUFLEN], *bufptr, *delim, *peer_as, *as, *net, *mask, *nh;
   int rows, eff_rows = 0, j, buflen, fields, prev[128];
   unsigned int index, fake_row = 0;
@@ -55,6 +57,7 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
 
   memset(&bkt, 0, sizeof(bkt));
   memset(&tmp, 0, sizeof(tmp));
+  memset(&trie, 0, sizeof(trie));
   memset(&st, 0, sizeof(st));
   default_route_in_networks4_table = FALSE;
 
@@ -73,6 +76,7 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
     if ((file = fopen(filename,"r")) == NULL) {
       if (!(config.nfacctd_net & NF_NET_KEEP && config.nfacctd_as & NF_AS_KEEP)) {
         Log(LOG_WARNING, "WARN ( %s/%s ): [%s] file not found.\n", config.name, config.type, filename);
+	networks_trie_free(&nc->trie);
 	return;
       }
 
@@ -295,6 +299,9 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
 	mdt[index].childs = eff_childs;
       }
 
+      tpfx = malloc(tmpt->num*sizeof(struct networks_trie_prefix));
+      if (tpfx) memset(tpfx, 0, tmpt->num*sizeof(struct networks_trie_prefix));
+
       /* 5a step: building final networks table */
       for (index = 0; index < tmpt->num; index++) {
 	int current, next;
@@ -319,6 +326,12 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
 	  }
 	  memcpy(&nt->table[current], &tmpt->table[index], sizeof(struct networks_table_entry));
         }
+
+	if (tpfx) {
+	  for (j = 0; j < 4; j++) tpfx[index].key[j] = (tmpt->table[index].net >> (24-(j*8))) & 0xff;
+	  tpfx[index].len = tmpt->table[index].masknum;
+	  tpfx[index].value = current+1;
+	}
       }
 
       /* 5b step: debug and default route detection */
@@ -346,6 +359,16 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
 	index++;
       }
 
+      /* 5c step: indexing the final table in a multibit trie; tmpt is sorted
+	 as networks_trie_build() expects. Upon failure we stick to binsearch() */
+      if (!tpfx || networks_trie_build(&trie, tpfx, tmpt->num) == ERR)
+	Log(LOG_WARNING, "WARN ( %s/%s ): [%s] malloc() failed while building IPv4 Networks Trie.\n", config.name, config.type, filename);
+      else Log(LOG_DEBUG, "DEBUG ( %s/%s ): [%s] IPv4 Networks Trie successfully created: %u nodes.\n",
+		config.name, config.type, filename, trie.nodes_num);
+
+      if (tpfx) free(tpfx);
+      tpfx = NULL;
+
       /* 6th step: create networks cache BUT only for the first time */
       if (!nc->cache) {
         if (!config.networks_cache_entries) nc->num = NETWORKS_CACHE_ENTRIES;
@@ -361,6 +384,8 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
 
       /* 7th step: freeing resources */
       memset(nc->cache, 0, nc->num*sizeof(struct networks_cache_entry));
+      networks_trie_free(&nc->trie);
+      memcpy(&nc->trie, &trie, sizeof(struct networks_trie));
       free(tmpt->table);
       free(mdt);
       if (bkt.table) free(bkt.table);
@@ -381,6 +406,8 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
   handle_error:
   if (tmpt->table) free(tmpt->table);
   if (mdt) free(mdt);
+  if (tpfx) free(tpfx);
+  networks_trie_free(&trie);
 
   if (bkt.num) {
     if (!nt->table) {
@@ -391,6 +418,8 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
       stat(filename, &st);
       nt->timestamp = st.st_mtime;
     }
+    /* the old trie does not index the current table anymore */
+    else networks_trie_free(&nc->trie);
   }
   else exit_plugin(1);
 }
@@ -464,6 +493,13 @@ struct networks_table_entry *binsearch(struct networks_table *nt, struct network
   u_int32_t net, addrh = ntohl(a->address.ipv4.s_addr), addr = a->address.ipv4.s_addr;
   struct networks_table_entry *ret;
 
+  if (nc->trie.root) {
+    u_int32_t value = networks_trie_lookup(&nc->trie, (u_int8_t *) &a->address.ipv4.s_addr);
+
+    if (value) return &nt->table[value-1];
+    else return NULL;
+  }
+
   ret = networks_cache_search(nc, &addr); 
   if (ret) {
     if (ret->masknum == 255) return NULL; /* dummy entry identification */
@@ -521,6 +557,171 @@ struct networks_table_entry *networks_cache_search(struct networks_cache *nc, u_
   else return NULL;
 }
 
+/*
+   networks_trie_*: multibit trie over the networks table. Longest-prefix
+   match is resolved with one access to the 2^16 root array plus at most one
+   access per further 8-bit stride (ie. 3 for IPv4, 15 for IPv6), regardless
+   of table size and cache hit rate. Prefixes given to networks_trie_build()
+   must be sorted by address and, on ties, by ascending length: this way any
+   prefix is painted before the more specific ones it contains.
+*/
+static u_int32_t networks_trie_popcount(u_int64_t x)
+{
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+
+  return (x * 0x0101010101010101ULL) >> 56;
+}
+
+static u_int32_t networks_trie_rank(struct networks_trie_node *node, u_int32_t pos)
+{
+  u_int32_t word = pos >> 6, rank = 0, idx;
+
+  for (idx = 0; idx < word; idx++) rank += networks_trie_popcount(node->vec[idx]);
+  rank += networks_trie_popcount(node->vec[word] & ((2ULL << (pos & 63)) - 1));
+
+  return rank - 1;
+}
+
+static int networks_trie_reserve(struct networks_trie *t)
+{
+  void *ptr;
+
+  if (t->nodes_num == t->nodes_max) {
+    t->nodes_max = t->nodes_max ? t->nodes_max * 2 : 1024;
+    ptr = realloc(t->nodes, t->nodes_max * sizeof(struct networks_trie_node));
+    if (!ptr) return ERR;
+    t->nodes = ptr;
+  }
+
+  if (t->values_num + (1 << NETWORKS_TRIE_STRIDE) > t->values_max) {
+    t->values_max = t->values_max ? t->values_max * 2 : 16384;
+    ptr = realloc(t->values, t->values_max * sizeof(u_int32_t));
+    if (!ptr) return ERR;
+    t->values = ptr;
+  }
+
+  return SUCCESS;
+}
+
+static int networks_trie_build_node(struct networks_trie *t, struct networks_trie_prefix *p, u_int32_t start,
+				    u_int32_t end, u_int8_t depth, u_int32_t deflt, u_int32_t *value)
+{
+  u_int32_t slots[1 << NETWORKS_TRIE_STRIDE], idx, next, slot, span, runs;
+  struct networks_trie_node *node;
+  u_int8_t byte = depth / 8, bits = depth + NETWORKS_TRIE_STRIDE;
+
+  for (slot = 0; slot < (1 << NETWORKS_TRIE_STRIDE); slot++) slots[slot] = deflt;
+
+  /* prefixes terminating within this stride */
+  for (idx = start; idx < end; idx++) {
+    if (p[idx].len > bits) continue;
+
+    span = 1 << (bits - p[idx].len);
+    for (slot = p[idx].key[byte]; span; slot++, span--) slots[slot] = p[idx].value;
+  }
+
+  /* longer prefixes, grouped by slot, go one level down */
+  for (idx = start; idx < end; idx = next) {
+    slot = p[idx].key[byte];
+    for (next = idx + 1; next < end && p[next].key[byte] == slot; next++);
+    while (idx < next && p[idx].len <= bits) idx++;
+
+    if (idx < next) {
+      if (networks_trie_build_node(t, p, idx, next, bits, slots[slot], &slots[slot]) == ERR) return ERR;
+    }
+  }
+
+  for (slot = 1, runs = 1; slot < (1 << NETWORKS_TRIE_STRIDE); slot++) {
+    if (slots[slot] != slots[slot-1]) runs++;
+  }
+
+  /* uniform node: no need to keep it */
+  if (runs == 1) {
+    *value = slots[0];
+    return SUCCESS;
+  }
+
+  if (networks_trie_reserve(t) == ERR) return ERR;
+
+  node = &t->nodes[t->nodes_num];
+  memset(node, 0, sizeof(struct networks_trie_node));
+  node->base = t->values_num;
+
+  for (slot = 0; slot < (1 << NETWORKS_TRIE_STRIDE); slot++) {
+    if (!slot || slots[slot] != slots[slot-1]) {
+      node->vec[slot >> 6] |= (1ULL << (slot & 63));
+      t->values[t->values_num++] = slots[slot];
+    }
+  }
+
+  *value = NETWORKS_TRIE_CHILD | t->nodes_num;
+  t->nodes_num++;
+
+  return SUCCESS;
+}
+
+int networks_trie_build(struct networks_trie *t, struct networks_trie_prefix *p, u_int32_t num)
+{
+  u_int32_t idx, next, slot, span;
+
+  memset(t, 0, sizeof(struct networks_trie));
+
+  t->root = malloc((1 << NETWORKS_TRIE_ROOT_BITS) * sizeof(u_int32_t));
+  if (!t->root) return ERR;
+  memset(t->root, 0, (1 << NETWORKS_TRIE_ROOT_BITS) * sizeof(u_int32_t));
+
+  for (idx = 0; idx < num; idx++) {
+    if (p[idx].len > NETWORKS_TRIE_ROOT_BITS) continue;
+
+    span = 1 << (NETWORKS_TRIE_ROOT_BITS - p[idx].len);
+    for (slot = (p[idx].key[0] << 8) | p[idx].key[1]; span; slot++, span--) t->root[slot] = p[idx].value;
+  }
+
+  for (idx = 0; idx < num; idx = next) {
+    slot = (p[idx].key[0] << 8) | p[idx].key[1];
+    for (next = idx + 1; next < num && ((p[next].key[0] << 8) | p[next].key[1]) == slot; next++);
+    while (idx < next && p[idx].len <= NETWORKS_TRIE_ROOT_BITS) idx++;
+
+    if (idx < next) {
+      if (networks_trie_build_node(t, p, idx, next, NETWORKS_TRIE_ROOT_BITS, t->root[slot], &t->root[slot]) == ERR) {
+	networks_trie_free(t);
+	return ERR;
+      }
+    }
+  }
+
+  return SUCCESS;
+}
+
+/* returns 0 if no match, the index of the matching entry plus one otherwise */
+u_int32_t networks_trie_lookup(struct networks_trie *t, u_int8_t *key)
+{
+  struct networks_trie_node *node;
+  u_int32_t value;
+  u_int8_t byte = NETWORKS_TRIE_ROOT_BITS / 8;
+
+  value = t->root[(key[0] << 8) | key[1]];
+
+  while (value & NETWORKS_TRIE_CHILD) {
+    node = &t->nodes[value & ~NETWORKS_TRIE_CHILD];
+    value = t->values[node->base + networks_trie_rank(node, key[byte])];
+    byte++;
+  }
+
+  return value;
+}
+
+void networks_trie_free(struct networks_trie *t)
+{
+  if (t->root) free(t->root);
+  if (t->nodes) free(t->nodes);
+  if (t->values) free(t->values);
+
+  memset(t, 0, sizeof(struct networks_trie));
+}
+
 void set_net_funcs(struct networks_table *nt)
 {
   u_int8_t count = 0;
@@ -1394,6 +1595,8 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
   struct networks_table tmp, *tmpt = &tmp;
   struct networks_table bkt;
   struct networks_table_metadata *mdt = 0;
+  struct networks_trie trie;
+  struct networks_trie_prefix *tpfx = NULL;
   char buf[SRVBUFLEN], *bufptr, *delim, *peer_as, *as, *net, *mask, *nh;
   int rows, eff_rows = 0, j, buflen, fields, prev[128];
   unsigned int index, fake_row = 0;
@@ -1406,6 +1609,7 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
 
   memset(&bkt, 0, sizeof(bkt));
   memset(&tmp, 0, sizeof(tmp));
+  memset(&trie, 0, sizeof(trie));
   memset(&st, 0, sizeof(st));
   default_route_in_networks6_table = FALSE;
 
@@ -1424,6 +1628,7 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
     if ((file = fopen(filename,"r")) == NULL) {
       if (!(config.nfacctd_net & NF_NET_KEEP && config.nfacctd_as & NF_AS_KEEP)) {
         Log(LOG_WARNING, "WARN ( %s/%s ): [%s] file not found.\n", config.name, config.type, filename);
+        networks_trie_free(&nc->trie6);
         return;
       }
 
@@ -1646,6 +1851,9 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
         mdt[index].childs = eff_childs;
       }
 
+      tpfx = malloc(tmpt->num6*sizeof(struct networks_trie_prefix));
+      if (tpfx) memset(tpfx, 0, tmpt->num6*sizeof(struct networks_trie_prefix));
+
       /* 5a step: building final networks table */
       for (index = 0; index < tmpt->num6; index++) {
         int current, next;
@@ -1670,6 +1878,12 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
           }
           memcpy(&nt->table6[current], &tmpt->table6[index], sizeof(struct networks6_table_entry));
         }
+
+        if (tpfx) {
+          for (j = 0; j < 16; j++) tpfx[index].key[j] = (tmpt->table6[index].net[j/4] >> (24-((j%4)*8))) & 0xff;
+          tpfx[index].len = tmpt->table6[index].masknum;
+          tpfx[index].value = current+1;
+        }
       }
  
       /* 5b step: debug and default route detection */
@@ -1697,6 +1911,16 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
         index++;
       }
 
+      /* 5c step: indexing the final table in a multibit trie; tmpt is sorted
+         as networks_trie_build() expects. Upon failure we stick to binsearch6() */
+      if (!tpfx || networks_trie_build(&trie, tpfx, tmpt->num6) == ERR)
+        Log(LOG_WARNING, "WARN ( %s/%s ): [%s] malloc() failed while building IPv6 Networks Trie.\n", config.name, config.type, filename);
+      else Log(LOG_DEBUG, "DEBUG ( %s/%s ): [%s] IPv6 Networks Trie successfully created: %u nodes.\n",
+                config.name, config.type, filename, trie.nodes_num);
+
+      if (tpfx) free(tpfx);
+      tpfx = NULL;
+
       /* 6th step: create networks cache BUT only for the first time */
       if (!nc->cache6) {
         if (!config.networks_cache_entries) nc->num6 = NETWORKS6_CACHE_ENTRIES;
@@ -1712,6 +1936,8 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
 
       /* 7th step: freeing resources */
       memset(nc->cache6, 0, nc->num6*sizeof(struct networks6_cache_entry));
+      networks_trie_free(&nc->trie6);
+      memcpy(&nc->trie6, &trie, sizeof(struct networks_trie));
       free(tmpt->table6);
       free(mdt);
       if (bkt.table6) free(bkt.table6);
@@ -1732,6 +1958,8 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
   handle_error:
   if (tmpt->table6) free(tmpt->table6);
   if (mdt) free(mdt);
+  if (tpfx) free(tpfx);
+  networks_trie_free(&trie);
 
   if (bkt.num6) {
     if (!nt->table6) {
@@ -1742,6 +1970,8 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
       stat(filename, &st);
       nt->timestamp = st.st_mtime;
     }
+    /* the old trie does not index the current table anymore */
+    else networks_trie_free(&nc->trie6);
   }
   else exit_plugin(1);
 }
@@ -1840,6 +2070,13 @@ struct networks6_table_entry *binsearch6(struct networks_table *nt, struct netwo
   u_int32_t net[4], addrh[4], addr[4]; 
   struct networks6_table_entry *ret;
 
+  if (nc->trie6.root) {
+    u_int32_t value = networks_trie_lookup(&nc->trie6, (u_int8_t *) &a->address.ipv6);
+
+    if (value) return &nt->table6[value-1];
+    else return NULL;
+  }
+
   memcpy(&addr, &a->address.ipv6, IP6AddrSz);
   memcpy(&addrh, &a->address.ipv6, IP6AddrSz);
   memcpy(&addrh, (void *) pm_ntohl6(addrh), IP6AddrSz);
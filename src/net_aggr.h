@@ -26,18 +26,52 @@
 #define RETURN_AS 1
 #define NET_FUNCS_N 32
 
+/* multibit trie: 16-bit direct-indexed root, 8-bit compressed strides */
+#define NETWORKS_TRIE_ROOT_BITS 16
+#define NETWORKS_TRIE_STRIDE 8
+#define NETWORKS_TRIE_CHILD 0x80000000
+
 /* structures */
 struct networks_cache_entry {
   u_int32_t key;
   struct networks_table_entry *result;
 };
 
+/*
+   Trie slots hold either 0 (no match), NETWORKS_TRIE_CHILD|<node index> or
+   <entry index + 1> into the flat networks table. Each child node keeps a
+   bitmap with a bit set where a run of equal slot values starts; values are
+   stored once per run and are retrieved by ranking the bitmap.
+*/
+struct networks_trie_node {
+  u_int64_t vec[4];
+  u_int32_t base;
+};
+
+struct networks_trie {
+  u_int32_t *root;
+  struct networks_trie_node *nodes;
+  u_int32_t nodes_num;
+  u_int32_t nodes_max;
+  u_int32_t *values;
+  u_int32_t values_num;
+  u_int32_t values_max;
+};
+
+struct networks_trie_prefix {
+  u_int8_t key[16];
+  u_int8_t len;
+  u_int32_t value;
+};
+
 struct networks_cache {
   struct networks_cache_entry *cache;
   unsigned int num;
+  struct networks_trie trie;
 #if defined ENABLE_IPV6
   struct networks6_cache_entry *cache6;
   unsigned int num6;
+  struct networks_trie trie6;
 #endif
 };
 
@@ -145,6 +179,9 @@ EXT void merge(char *, struct networks_table_entry *, int, int, int);
 EXT struct networks_table_entry *binsearch(struct networks_table *, struct networks_cache *, struct host_addr *);
 EXT void networks_cache_insert(struct networks_cache *, u_int32_t *, struct networks_table_entry *);
 EXT struct networks_table_entry *networks_cache_search(struct networks_cache *, u_int32_t *);
+EXT int networks_trie_build(struct networks_trie *, struct networks_trie_prefix *, u_int32_t);
+EXT u_int32_t networks_trie_lookup(struct networks_trie *, u_int8_t *);
+EXT void networks_trie_free(struct networks_trie *);
 
 #if defined ENABLE_IPV6
 EXT void load_networks6(char *, struct networks_table *, struct networks_cache *); 
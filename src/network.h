@@ -442,6 +442,19 @@ struct pkt_primitives {
   u_int16_t export_proto_version;
 };
 
+/* struct pkt_primitives areas selected by the aggregation method */
+#define MAX_PRIMITIVES_KEY_RANGES 32
+
+struct primitives_key_range {
+  u_int16_t off;
+  u_int16_t len;
+};
+
+struct primitives_key {
+  struct primitives_key_range range[MAX_PRIMITIVES_KEY_RANGES];
+  int num;
+};
+
 struct pkt_data {
   struct pkt_primitives primitives;
   pm_counter_t pkt_len;
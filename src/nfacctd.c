@@ -93,7 +93,7 @@ int main(int argc,char **argv, char **envp)
   struct plugin_requests req;
   struct packet_ptrs_vector pptrs;
   char config_file[SRVBUFLEN];
-  unsigned char netflow_packet[NETFLOW_MSG_SIZE];
+  unsigned char netflow_buf[NETFLOW_MSG_SIZE], *netflow_packet = netflow_buf;
   int logf, rc, yes=1, no=0, allowed;
   struct host_addr addr;
   struct hosts_table allow;
@@ -104,6 +104,7 @@ int main(int argc,char **argv, char **envp)
   struct id_table bta_table;
   struct id_table bitr_table;
   struct id_table sampling_table;
+  struct id_table_reload_set maps_reload;
   u_int32_t idx;
   int ret;
 
@@ -187,6 +188,7 @@ int main(int argc,char **argv, char **envp)
   memset(&bta_table, 0, sizeof(bta_table));
   memset(&bitr_table, 0, sizeof(bitr_table));
   memset(&sampling_table, 0, sizeof(sampling_table));
+  memset(&maps_reload, 0, sizeof(maps_reload));
   memset(&reload_map_tstamp, 0, sizeof(reload_map_tstamp));
   log_notifications_init(&log_notifications);
   config.acct_type = ACCT_NF;
@@ -503,6 +505,35 @@ int main(int argc,char **argv, char **envp)
   signal(SIGUSR2, reload_maps); /* sets to true the reload_maps flag */
   signal(SIGPIPE, SIG_IGN); /* we want to exit gracefully when a pipe is broken */
 
+  if (config.nfacctd_workers > 1) {
+#if !defined SO_REUSEPORT
+    Log(LOG_ERR, "ERROR ( %s/core ): 'nfacctd_workers' requires SO_REUSEPORT support. Exiting.\n", config.name);
+    exit(1);
+#endif
+    if (config.nfacctd_bgp || config.nfacctd_bmp || config.nfacctd_isis || config.telemetry_daemon) {
+      Log(LOG_ERR, "ERROR ( %s/core ): 'nfacctd_workers' is not compatible with bgp_daemon, bmp_daemon, isis_daemon and telemetry_daemon. Exiting.\n", config.name);
+      exit(1);
+    }
+
+    if (config.nfacctd_templates_file) {
+      Log(LOG_ERR, "ERROR ( %s/core ): 'nfacctd_workers' is not compatible with 'nfacctd_templates_file'. Exiting.\n", config.name);
+      exit(1);
+    }
+
+    list = plugins_list;
+    while (list) {
+      /* every worker runs its own copy of the plugins: only those not
+	 aggregating data, hence not splitting it across workers, qualify */
+      if (list->type.id != PLUGIN_ID_CORE && list->type.id != PLUGIN_ID_TEE) {
+	Log(LOG_ERR, "ERROR ( %s/core ): 'nfacctd_workers' is supported only with 'tee' plugins ('%s' is a '%s' plugin). Exiting.\n",
+	    config.name, list->name, list->type.string);
+	exit(1);
+      }
+      list = list->next;
+    }
+    core_workers_spawn();
+  }
+
   /* If no IP address is supplied, let's set our default
      behaviour: IPv4 address, INADDR_ANY, port 2100 */
   if (!config.nfacctd_port) config.nfacctd_port = DEFAULT_NFACCTD_PORT;
@@ -561,6 +592,16 @@ int main(int argc,char **argv, char **envp)
   rc = setsockopt(config.sock, SOL_SOCKET, SO_REUSEADDR, (char *)&yes, sizeof(yes));
   if (rc < 0) Log(LOG_ERR, "WARN ( %s/core ): setsockopt() failed for SO_REUSEADDR.\n", config.name);
 
+#if (defined SO_REUSEPORT)
+  if (config.nfacctd_workers > 1) {
+    rc = setsockopt(config.sock, SOL_SOCKET, SO_REUSEPORT, (char *)&yes, sizeof(yes));
+    if (rc < 0) {
+      Log(LOG_ERR, "ERROR ( %s/core ): setsockopt() failed for SO_REUSEPORT.\n", config.name);
+      exit(1);
+    }
+  }
+#endif
+
 #if (defined ENABLE_IPV6) && (defined IPV6_BINDV6ONLY)
   rc = setsockopt(config.sock, IPPROTO_IPV6, IPV6_BINDV6ONLY, (char *) &no, (socklen_t) sizeof(no));
   if (rc < 0) Log(LOG_ERR, "WARN ( %s/core ): setsockopt() failed for IPV6_BINDV6ONLY.\n", config.name);
@@ -608,6 +649,7 @@ int main(int argc,char **argv, char **envp)
 
   if (config.sampling_map) {
     load_id_file(MAP_SAMPLING, config.sampling_map, &sampling_table, &req, &sampling_map_allocated);
+    sampling_map_caching = !(sampling_table.flags & PRETAG_FLAG_NOCACHE);
     set_sampling_table(&pptrs, (u_char *) &sampling_table);
   }
   else set_sampling_table(&pptrs, NULL);
@@ -687,6 +729,7 @@ int main(int argc,char **argv, char **envp)
 
     if (config.nfacctd_bgp_to_agent_map) {
       load_id_file(MAP_BGP_TO_XFLOW_AGENT, config.nfacctd_bgp_to_agent_map, &bta_table, &req, &bta_map_allocated);
+      bta_map_caching = !(bta_table.flags & PRETAG_FLAG_NOCACHE);
       pptrs.v4.bta_table = (u_char *) &bta_table;
     }
     else pptrs.v4.bta_table = NULL;
@@ -762,7 +805,8 @@ int main(int argc,char **argv, char **envp)
   load_plugins(&req);
   load_plugin_filters(1);
   evaluate_packet_handlers();
-  pm_setproctitle("%s [%s]", "Core Process", config.proc_name);
+  if (config.nfacctd_worker_id) pm_setproctitle("%s #%u [%s]", "Core Process", config.nfacctd_worker_id, config.proc_name);
+  else pm_setproctitle("%s [%s]", "Core Process", config.proc_name);
   if (config.pidfile) write_pid_file(config.pidfile);
   load_networks(config.networks_file, &nt, &nc);
 
@@ -774,8 +818,8 @@ int main(int argc,char **argv, char **envp)
   kill(getpid(), SIGCHLD);
 
   /* initializing template cache */ 
-  memset(&tpl_cache, 0, sizeof(tpl_cache));
-  tpl_cache.num = TEMPLATE_CACHE_ENTRIES;
+  init_template_cache();
+  print_status_table_ext = print_template_cache_stats;
 
   if (config.nfacctd_templates_file) {
     load_templates_from_file(config.nfacctd_templates_file);
@@ -916,8 +960,22 @@ int main(int argc,char **argv, char **envp)
   /* fixing NetFlow v9/IPFIX template func pointers */
   get_ext_db_ie_by_type = &ext_db_get_ie;
 
+#if defined HAVE_RECVMMSG
+  if (config.nfacctd_recv_batch > 1) xflow_recv_batch_init(&xflow_recv_batch, config.nfacctd_recv_batch, NETFLOW_MSG_SIZE);
+#else
+  if (config.nfacctd_recv_batch > 1) {
+    Log(LOG_WARNING, "WARN ( %s/core ): 'nfacctd_recv_batch' requires recvmmsg() support. Ignored.\n", config.name);
+    config.nfacctd_recv_batch = FALSE;
+  }
+#endif
+
   /* Main loop */
   for(;;) {
+#if defined HAVE_RECVMMSG
+    if (config.nfacctd_recv_batch > 1)
+      ret = xflow_recv_batch_next(&xflow_recv_batch, config.sock, &netflow_packet, (struct sockaddr *) &client, sizeof(client), &pptrs);
+    else
+#endif
     ret = recvfrom(config.sock, netflow_packet, NETFLOW_MSG_SIZE, 0, (struct sockaddr *) &client, &clen);
 
     if (ret < 2) continue; /* we don't have enough data to decode the version */ 
@@ -932,29 +990,36 @@ int main(int argc,char **argv, char **envp)
     if (allow.num) allowed = check_allow(&allow, (struct sockaddr *)&client); 
     if (!allowed) continue;
 
-    if (reload_map) {
-      bta_map_caching = TRUE;
-      sampling_map_caching = TRUE;
-      req.key_value_table = NULL;
-
+    if (reload_map && pretag_reload_begin(&maps_reload)) {
       load_networks(config.networks_file, &nt, &nc);
 
       if (config.nfacctd_bgp && config.nfacctd_bgp_peer_as_src_map) 
-        load_id_file(MAP_BGP_PEER_AS_SRC, config.nfacctd_bgp_peer_as_src_map, &bpas_table, &req, &bpas_map_allocated); 
+        pretag_reload_add(&maps_reload, MAP_BGP_PEER_AS_SRC, config.nfacctd_bgp_peer_as_src_map, &bpas_table, &bpas_map_allocated); 
       if (config.nfacctd_bgp && config.nfacctd_bgp_src_local_pref_map) 
-        load_id_file(MAP_BGP_SRC_LOCAL_PREF, config.nfacctd_bgp_src_local_pref_map, &blp_table, &req, &blp_map_allocated); 
+        pretag_reload_add(&maps_reload, MAP_BGP_SRC_LOCAL_PREF, config.nfacctd_bgp_src_local_pref_map, &blp_table, &blp_map_allocated); 
       if (config.nfacctd_bgp && config.nfacctd_bgp_src_med_map) 
-        load_id_file(MAP_BGP_SRC_MED, config.nfacctd_bgp_src_med_map, &bmed_table, &req, &bmed_map_allocated); 
+        pretag_reload_add(&maps_reload, MAP_BGP_SRC_MED, config.nfacctd_bgp_src_med_map, &bmed_table, &bmed_map_allocated); 
       if (config.nfacctd_bgp && config.nfacctd_bgp_to_agent_map)
-        load_id_file(MAP_BGP_TO_XFLOW_AGENT, config.nfacctd_bgp_to_agent_map, &bta_table, &req, &bta_map_allocated);
+        pretag_reload_add(&maps_reload, MAP_BGP_TO_XFLOW_AGENT, config.nfacctd_bgp_to_agent_map, &bta_table, &bta_map_allocated);
       if (config.nfacctd_flow_to_rd_map)
-        load_id_file(MAP_FLOW_TO_RD, config.nfacctd_flow_to_rd_map, &bitr_table, &req, &bitr_map_allocated);
-      if (config.sampling_map) {
-        load_id_file(MAP_SAMPLING, config.sampling_map, &sampling_table, &req, &sampling_map_allocated);
-        set_sampling_table(&pptrs, (u_char *) &sampling_table);
-      }
+        pretag_reload_add(&maps_reload, MAP_FLOW_TO_RD, config.nfacctd_flow_to_rd_map, &bitr_table, &bitr_map_allocated);
+      if (config.sampling_map)
+        pretag_reload_add(&maps_reload, MAP_SAMPLING, config.sampling_map, &sampling_table, &sampling_map_allocated);
 
+      pretag_reload_end(&maps_reload);
       reload_map = FALSE;
+    }
+
+    /* maps are built away from the packet path; swap them in here */
+    if (pretag_reload_poll(&maps_reload)) {
+      for (idx = 0; idx < maps_reload.num; idx++) {
+        if (maps_reload.slot[idx].published && maps_reload.slot[idx].req.bpf_filter) req.bpf_filter = TRUE;
+      }
+
+      bta_map_caching = !(bta_table.flags & PRETAG_FLAG_NOCACHE);
+      sampling_map_caching = !(sampling_table.flags & PRETAG_FLAG_NOCACHE);
+      if (config.sampling_map) set_sampling_table(&pptrs, (u_char *) &sampling_table);
+
       gettimeofday(&reload_map_tstamp, NULL);
     }
 
@@ -964,6 +1029,9 @@ int main(int argc,char **argv, char **envp)
       reset_tag_label_status(&pptrs);
       reset_shadow_status(&pptrs);
 
+      /* RIB nodes and paths looked up stay valid till the datagram is processed */
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_rib_read_begin();
+
       switch(((struct struct_header_v5 *)netflow_packet)->version) {
       case 1:
 	process_v1_packet(netflow_packet, ret, &pptrs.v4, &req);
@@ -989,6 +1057,8 @@ int main(int argc,char **argv, char **envp)
         }
 	break;
       }
+
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_rib_read_end();
     }
     else if (tee_plugins) {
       process_raw_packet(netflow_packet, ret, &pptrs, &req);
@@ -1382,11 +1452,13 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 
     tpl = find_template(data_hdr->flow_id, (struct host_addr *) pptrs->f_agent, fid, SourceId);
     if (!tpl) {
-      sa_to_addr((struct sockaddr *)pptrs->f_agent, &debug_a, &debug_agent_port);
-      addr_to_str(debug_agent_addr, &debug_a);
+      if (template_cache_miss(data_hdr->flow_id, (struct sockaddr *) pptrs->f_agent, SourceId)) {
+        sa_to_addr((struct sockaddr *)pptrs->f_agent, &debug_a, &debug_agent_port);
+        addr_to_str(debug_agent_addr, &debug_a);
 
-      Log(LOG_DEBUG, "DEBUG ( %s/core ): Discarded NetFlow v9/IPFIX packet (R: unknown template %u [%s:%u])\n",
+        Log(LOG_DEBUG, "DEBUG ( %s/core ): Discarded NetFlow v9/IPFIX packet (R: unknown template %u [%s:%u])\n",
 		config.name, fid, debug_agent_addr, SourceId);
+      }
       pkt += (flowsetlen-NfDataHdrV9Sz);
       off += flowsetlen;
     }
@@ -2342,7 +2414,7 @@ int NF_find_id(struct id_table *t, struct packet_ptrs *pptrs, pm_id_t *tag, pm_i
 
     for (iterator = 0; index_results[iterator] && iterator < ID_TABLE_INDEX_RESULTS; iterator++) {
       ret = pretag_entry_process(index_results[iterator], pptrs, tag, tag2);
-      if (!(ret & PRETAG_MAP_RCODE_JEQ)) return ret;
+      if ((!ret || ret > TRUE) && !(ret & PRETAG_MAP_RCODE_JEQ)) return ret;
     }
 
     /* if we have at least one index we trust we did a good job */
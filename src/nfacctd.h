@@ -418,7 +418,35 @@ struct data_hdr_v9 {
 #define V8_12_MAXFLOWS 44  /* max records in V8 DST_PREFIX_TOS packet */
 #define V8_13_MAXFLOWS 35  /* max records in V8 PREFIX_TOS packet */
 #define V8_14_MAXFLOWS 35  /* max records in V8 PREFIX_PORT_TOS packet */
-#define TEMPLATE_CACHE_ENTRIES 255
+#define TEMPLATE_CACHE_ENTRIES 256 /* initial buckets, power of 2 */
+#define TEMPLATE_CACHE_MAX_ENTRIES 1048576
+#define TEMPLATE_CACHE_LOAD_FACTOR 2 /* avg chain length triggering a resize */
+#define TEMPLATE_CACHE_MISS_ENTRIES 1024
+#define TEMPLATE_CACHE_REHASH_STEP 16 /* old buckets moved per lookup while resizing */
+#define TEMPLATE_CACHE_MISS_LOG_INTERVAL 60
+
+/* compiled templates, see NF_compile_template() */
+#define TPL_PROG_MAX_OPS	16
+
+#define TPL_PROG_OP_COPY	1
+#define TPL_PROG_OP_NTOHS	2	/* 16 to 16 bits */
+#define TPL_PROG_OP_NTOHS_32	3	/* 16 to 32 bits */
+#define TPL_PROG_OP_NTOHL	4	/* 32 to 32 bits */
+#define TPL_PROG_OP_U8_32	5	/* 8 to 32 bits */
+#define TPL_PROG_OP_IPV4	6
+#define TPL_PROG_OP_IPV6	7
+
+#define TPL_PROG_SRC_MAC	0x00000001
+#define TPL_PROG_DST_MAC	0x00000002
+#define TPL_PROG_COS		0x00000004
+#define TPL_PROG_SRC_HOST	0x00000008
+#define TPL_PROG_DST_HOST	0x00000010
+#define TPL_PROG_SRC_PORT	0x00000020
+#define TPL_PROG_DST_PORT	0x00000040
+#define TPL_PROG_IP_PROTO	0x00000080
+#define TPL_PROG_TCP_FLAGS	0x00000100
+#define TPL_PROG_IN_IFACE	0x00000200
+#define TPL_PROG_OUT_IFACE	0x00000400
 
 #define NF_TIME_MSECS 0 /* times are in msecs */
 #define NF_TIME_SECS 1 /* times are in secs */ 
@@ -730,6 +758,19 @@ struct tpl_field_list {
   char *ptr;
 };
 
+/* Compiled template: data record to struct pkt_data copy program */
+struct tpl_prog_op {
+  u_int16_t off;			/* offset in the data record */
+  u_int16_t len;			/* bytes to read */
+  u_int16_t dst;			/* offset in struct pkt_data */
+  u_int8_t op;
+};
+
+struct tpl_prog {
+  u_int8_t num;
+  struct tpl_prog_op ops[TPL_PROG_MAX_OPS];
+};
+
 struct template_cache_entry {
   struct host_addr agent;               /* NetFlow Exporter agent */
   u_int32_t source_id;                  /* Exporter Observation Domain */
@@ -738,15 +779,39 @@ struct template_cache_entry {
   u_int16_t num;                        /* number of fields described into template */
   u_int16_t len;                        /* total length of the described flowset */
   u_int8_t vlen;                        /* flag for variable-length fields */
+  u_int32_t hash;                       /* (agent, source_id, template_id) hash */
   struct otpl_field tpl[NF9_MAX_DEFINED_FIELD];
-  struct tpl_field_db ext_db[TPL_EXT_DB_ENTRIES];
-  struct tpl_field_list list[TPL_LIST_ENTRIES];
+  struct tpl_field_db *ext_db;          /* TPL_EXT_DB_ENTRIES, allocated on first use */
+  struct tpl_field_list *list;          /* 'num' entries, data templates only */
+  struct tpl_prog *prog;                /* one per channel, fixed-length data templates only */
   struct template_cache_entry *next;
 };
 
+/* Negative cache of (agent, source_id, template_id) tuples looked up and
+   not found, ie. Data Flowsets received ahead of their template; direct
+   mapped, an entry is dropped as soon as its template is linked */
+struct template_cache_miss {
+  struct host_addr agent;
+  u_int32_t hash;
+  u_int32_t source_id;
+  u_int16_t template_id;
+  u_int32_t count;                      /* Data Flowsets discarded */
+  time_t stamp;                         /* last time the miss was logged */
+};
+
 struct template_cache {
-  u_int16_t num;
-  struct template_cache_entry *c[TEMPLATE_CACHE_ENTRIES];
+  u_int32_t num;                        /* buckets, power of 2 */
+  u_int32_t entries;
+  struct template_cache_entry **c;
+  struct template_cache_entry **old;    /* buckets being rehashed into c, if resizing */
+  u_int32_t old_num;
+  u_int32_t old_idx;                    /* next old bucket to be rehashed */
+  struct template_cache_miss *miss;
+  u_int64_t lookups;
+  u_int64_t collisions;                 /* chain entries walked past */
+  u_int64_t misses;
+  u_int64_t neg_hits;                   /* misses answered by the negative cache */
+  u_int32_t resizes;
 };
 
 typedef void (*v8_filter_handler)(struct packet_ptrs *, void *);
@@ -796,6 +861,14 @@ EXT u_int16_t debug_agent_port;
 #endif
 EXT struct template_cache_entry *handle_template(struct template_hdr_v9 *, struct packet_ptrs *, u_int16_t, u_int32_t, u_int16_t *, u_int16_t, u_int32_t);
 EXT struct template_cache_entry *find_template(u_int16_t, struct host_addr *, u_int16_t, u_int32_t);
+EXT void init_template_cache();
+EXT u_int32_t template_cache_hash(struct host_addr *, u_int32_t, u_int16_t);
+EXT void template_cache_link(struct template_cache_entry *);
+EXT void template_cache_resize(u_int32_t);
+EXT void template_cache_rehash_step();
+EXT int template_cache_miss(u_int16_t, struct sockaddr *, u_int32_t);
+EXT void free_template_entry(struct template_cache_entry *);
+EXT void print_template_cache_stats(time_t);
 EXT struct template_cache_entry *insert_template(struct template_hdr_v9 *, struct packet_ptrs *, u_int16_t, u_int32_t, u_int16_t *, u_int8_t, u_int16_t, u_int32_t);
 EXT struct template_cache_entry *refresh_template(struct template_hdr_v9 *, struct template_cache_entry *, struct packet_ptrs *, u_int16_t, u_int32_t, u_int16_t *, u_int8_t, u_int16_t, u_int32_t);
 EXT void log_template_header(struct template_cache_entry *, struct packet_ptrs *, u_int16_t, u_int32_t, u_int8_t);
@@ -821,4 +894,7 @@ EXT void save_template(struct template_cache_entry *, char *);
 #define EXT
 #endif
 EXT struct utpl_field *(*get_ext_db_ie_by_type)(struct template_cache_entry *, u_int32_t, u_int16_t, u_int8_t);
+EXT void NF_compile_template(struct template_cache_entry *);
+EXT void NF_compile_template_prog(struct template_cache_entry *, u_int32_t, struct tpl_prog *);
+EXT void NF_tpl_prog_add(struct tpl_prog *, u_int8_t, struct otpl_field *, u_int16_t, u_int16_t);
 #undef EXT
@@ -25,7 +25,6 @@
 /* $Id$ */
 
 #include "common.h"
-#include "treetype.h"
 #include "nfprobe_plugin.h"
 
 RCSID("$Id$");
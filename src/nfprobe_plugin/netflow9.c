@@ -34,7 +34,6 @@
 #define __NFPROBE_NETFLOW9_C
 
 #include "common.h"
-#include "treetype.h"
 #include "nfprobe_plugin.h"
 #include "ip_flow.h"
 #include "classifier.h"
@@ -193,6 +192,10 @@ struct NF9_INTERNAL_OPTIONS_TEMPLATE {
 
 /* Local data: templates and counters */
 #define NF9_SOFTFLOWD_MAX_PACKET_SIZE	512
+/* Datagrams queued per sendmmsg() call; each datagram slot is followed by
+   room for a data record of the maximum size, see nf_flow_to_flowset() */
+#define NF9_SEND_BATCH			64
+#define NF9_BATCH_SLOT_SIZE		(NF9_SOFTFLOWD_MAX_PACKET_SIZE*3)
 #define NF9_SOFTFLOWD_V4_TEMPLATE_ID	1024
 #define NF9_SOFTFLOWD_V6_TEMPLATE_ID	2048
 #define NF9_OPTIONS_TEMPLATE_ID		4096
@@ -222,8 +225,14 @@ static struct NF9_INTERNAL_OPTIONS_TEMPLATE sampling_option_int_template;
 static struct NF9_OPTIONS_TEMPLATE class_option_template;
 static struct NF9_INTERNAL_OPTIONS_TEMPLATE class_option_int_template;
 static char ftoft_buf_0[NF9_SOFTFLOWD_MAX_PACKET_SIZE*2];
-static char ftoft_buf_1[NF9_SOFTFLOWD_MAX_PACKET_SIZE*2];
-static char packet[NF9_SOFTFLOWD_MAX_PACKET_SIZE];
+
+/* Send batch: datagrams are built in place and flushed all at once */
+static char nf9_batch_buf[NF9_SEND_BATCH][NF9_BATCH_SLOT_SIZE];
+static struct iovec nf9_batch_iov[NF9_SEND_BATCH];
+#if defined HAVE_SENDMMSG
+static struct mmsghdr nf9_batch_msgs[NF9_SEND_BATCH];
+#endif
+static int nf9_batch_num;
 
 static int nf9_pkts_until_template = -1;
 static u_int8_t send_options = FALSE;
@@ -1609,268 +1618,135 @@ nf_flow_to_flowset_inc_len(char **ftoft_ptr, int *add_len, int orig_len, int ele
   }
 }
 
+/*
+ * Encode one direction of a flow as a data record, straight at ftoft_ptr,
+ * walking the internal template of its address family and direction.
+ * Returns the length of the record or -1 if the family is unsupported.
+ */
 static int
-nf_flow_to_flowset(const struct FLOW *flow, u_char *packet, u_int len,
-    const struct timeval *system_boot_time, u_int *len_used, int direction)
+nf_flow_to_flowset_record(char *ftoft_ptr, const struct FLOW *flow, int idx,
+    int flow_direction, const struct timeval *system_boot_time)
 {
-	u_int freclen_0, freclen_1, ret_len, nflows, idx;
+	struct NF9_INTERNAL_TEMPLATE *tpl, *pen_tpl;
 	u_int64_t rec64;
 	u_int32_t rec32;
 	u_int8_t rec8;
-	char *ftoft_ptr_0 = ftoft_buf_0;
-	char *ftoft_ptr_1 = ftoft_buf_1;
-	int flow_direction[2], elem_len, add_len;
+	int ridx, elem_len, add_len = 0;
 
-	bzero(ftoft_buf_0, sizeof(ftoft_buf_0));
-	bzero(ftoft_buf_1, sizeof(ftoft_buf_1));
-	*len_used = nflows = ret_len = 0;
-	flow_direction[0] = (flow->direction[0] == DIRECTION_UNKNOWN) ? DIRECTION_IN : flow->direction[0];
-	flow_direction[1] = (flow->direction[1] == DIRECTION_UNKNOWN) ? DIRECTION_IN : flow->direction[1];
-	
-	if (direction == flow_direction[0]) {
-	  if (config.nfprobe_version == 9 && config.timestamps_secs) {
-	    rec32 = htonl(timeval_sub_ms(&flow->flow_last, system_boot_time));
-	    memcpy(ftoft_ptr_0, &rec32, 4);
-	    ftoft_ptr_0 += 4;
-
-	    rec32 = htonl(timeval_sub_ms(&flow->flow_start, system_boot_time));
-	    memcpy(ftoft_ptr_0, &rec32, 4);
-	    ftoft_ptr_0 += 4;
-	  }
-	  else if ((config.nfprobe_version == 9 && !config.timestamps_secs) || config.nfprobe_version == 10) {
-	    u_int64_t tstamp_msec;
-
-	    tstamp_msec = flow->flow_last.tv_sec;
-	    tstamp_msec = tstamp_msec * 1000;
-	    tstamp_msec += (flow->flow_last.tv_usec / 1000);
-            rec64 = pmXXX_htonll(tstamp_msec);
-            memcpy(ftoft_ptr_0, &rec64, 8);
-            ftoft_ptr_0 += 8;
-
-            tstamp_msec = flow->flow_start.tv_sec;
-            tstamp_msec = tstamp_msec * 1000;
-            tstamp_msec += (flow->flow_start.tv_usec / 1000);
-            rec64 = pmXXX_htonll(tstamp_msec);
-            memcpy(ftoft_ptr_0, &rec64, 8);
-            ftoft_ptr_0 += 8;
-	  }
+	switch (flow->af) {
+	case AF_INET:
+		rec8 = 4;
+		tpl = (flow_direction == DIRECTION_OUT) ? &v4_int_template_out : &v4_int_template;
+		pen_tpl = (flow_direction == DIRECTION_OUT) ? &v4_pen_int_template_out : &v4_pen_int_template;
+		break;
+#if defined ENABLE_IPV6
+	case AF_INET6:
+		rec8 = 6;
+		tpl = (flow_direction == DIRECTION_OUT) ? &v6_int_template_out : &v6_int_template;
+		pen_tpl = (flow_direction == DIRECTION_OUT) ? &v6_pen_int_template_out : &v6_pen_int_template;
+		break;
+#endif
+	default:
+		return (-1);
+	}
+
+	if (config.nfprobe_version == 9 && config.timestamps_secs) {
+	  rec32 = htonl(timeval_sub_ms(&flow->flow_last, system_boot_time));
+	  memcpy(ftoft_ptr, &rec32, 4);
+	  ftoft_ptr += 4;
+
+	  rec32 = htonl(timeval_sub_ms(&flow->flow_start, system_boot_time));
+	  memcpy(ftoft_ptr, &rec32, 4);
+	  ftoft_ptr += 4;
+	}
+	else if ((config.nfprobe_version == 9 && !config.timestamps_secs) || config.nfprobe_version == 10) {
+	  u_int64_t tstamp_msec;
+
+	  tstamp_msec = flow->flow_last.tv_sec;
+	  tstamp_msec = tstamp_msec * 1000;
+	  tstamp_msec += (flow->flow_last.tv_usec / 1000);
+	  rec64 = pmXXX_htonll(tstamp_msec);
+	  memcpy(ftoft_ptr, &rec64, 8);
+	  ftoft_ptr += 8;
+
+	  tstamp_msec = flow->flow_start.tv_sec;
+	  tstamp_msec = tstamp_msec * 1000;
+	  tstamp_msec += (flow->flow_start.tv_usec / 1000);
+	  rec64 = pmXXX_htonll(tstamp_msec);
+	  memcpy(ftoft_ptr, &rec64, 8);
+	  ftoft_ptr += 8;
+	}
 
 #if defined HAVE_64BIT_COUNTERS
-          rec64 = pmXXX_htonll(flow->octets[0]);
-          memcpy(ftoft_ptr_0, &rec64, 8);
-          ftoft_ptr_0 += 8;
+	rec64 = pmXXX_htonll(flow->octets[idx]);
+	memcpy(ftoft_ptr, &rec64, 8);
+	ftoft_ptr += 8;
 
-          rec64 = pmXXX_htonll(flow->packets[0]);
-          memcpy(ftoft_ptr_0, &rec64, 8);
-          ftoft_ptr_0 += 8;
+	rec64 = pmXXX_htonll(flow->packets[idx]);
+	memcpy(ftoft_ptr, &rec64, 8);
+	ftoft_ptr += 8;
 #else
-	  rec32 = htonl(flow->octets[0]);
-	  memcpy(ftoft_ptr_0, &rec32, 4);
-	  ftoft_ptr_0 += 4;
+	rec32 = htonl(flow->octets[idx]);
+	memcpy(ftoft_ptr, &rec32, 4);
+	ftoft_ptr += 4;
 
-	  rec32 = htonl(flow->packets[0]);
-  	  memcpy(ftoft_ptr_0, &rec32, 4);
-	  ftoft_ptr_0 += 4;
+	rec32 = htonl(flow->packets[idx]);
+	memcpy(ftoft_ptr, &rec32, 4);
+	ftoft_ptr += 4;
 #endif
 
-          switch (flow->af) {
-          case AF_INET:
-                rec8 = 4;
-                memcpy(ftoft_ptr_0, &rec8, 1);
-                ftoft_ptr_0 += 1;
-		if (flow_direction[0] == DIRECTION_IN) {
-                  for (idx = 5, add_len = 0; v4_int_template.r[idx].handler; idx++) {
-                    elem_len = v4_int_template.r[idx].handler(ftoft_ptr_0, flow, 0, v4_int_template.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_0, &add_len, v4_int_template.r[idx].length, elem_len); 
-                  }
-                  freclen_0 = v4_int_template.tot_rec_len;
-
-		  for (idx = 0; v4_pen_int_template.r[idx].handler; idx++) {
-                    elem_len = v4_pen_int_template.r[idx].handler(ftoft_ptr_0, flow, 0, v4_pen_int_template.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_0, &add_len, v4_pen_int_template.r[idx].length, elem_len);
-                  }
-                  freclen_0 += (v4_pen_int_template.tot_rec_len + add_len);
-		}
-		else if (flow_direction[0] == DIRECTION_OUT) {
-                  for (idx = 5, add_len = 0; v4_int_template_out.r[idx].handler; idx++) {
-                    elem_len = v4_int_template_out.r[idx].handler(ftoft_ptr_0, flow, 0, v4_int_template_out.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_0, &add_len, v4_int_template_out.r[idx].length, elem_len);
-                  }
-                  freclen_0 = v4_int_template_out.tot_rec_len;
-
-                  for (idx = 0; v4_pen_int_template_out.r[idx].handler; idx++) {
-                    elem_len = v4_pen_int_template_out.r[idx].handler(ftoft_ptr_0, flow, 0, v4_pen_int_template_out.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_0, &add_len, v4_pen_int_template_out.r[idx].length, elem_len);
-                  }
-                  freclen_0 += (v4_pen_int_template_out.tot_rec_len + add_len);
-		}
-                break;
-#if defined ENABLE_IPV6
-          case AF_INET6:
-                rec8 = 6;
-                memcpy(ftoft_ptr_0, &rec8, 1);
-                ftoft_ptr_0 += 1;
-		if (flow_direction[0] == DIRECTION_IN) {
-                  for (idx = 5, add_len = 0; v6_int_template.r[idx].handler; idx++) {
-                    elem_len = v6_int_template.r[idx].handler(ftoft_ptr_0, flow, 0, v6_int_template.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_0, &add_len, v6_int_template.r[idx].length, elem_len);
-                  }
-                  freclen_0 = v6_int_template.tot_rec_len;
-
-                  for (idx = 0; v6_pen_int_template.r[idx].handler; idx++) {
-                    elem_len = v6_pen_int_template.r[idx].handler(ftoft_ptr_0, flow, 0, v6_pen_int_template.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_0, &add_len, v6_pen_int_template.r[idx].length, elem_len);
-                  }
-                  freclen_0 += (v6_pen_int_template.tot_rec_len + add_len);
-		}
-		else if (flow_direction[0] == DIRECTION_OUT) {
-                  for (idx = 5, add_len = 0; v6_int_template_out.r[idx].handler; idx++) {
-                    elem_len = v6_int_template_out.r[idx].handler(ftoft_ptr_0, flow, 0, v6_int_template_out.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_0, &add_len, v6_int_template_out.r[idx].length, elem_len);
-                  }
-                  freclen_0 = v6_int_template_out.tot_rec_len;
-
-                  for (idx = 0; v6_pen_int_template_out.r[idx].handler; idx++) {
-                    elem_len = v6_pen_int_template_out.r[idx].handler(ftoft_ptr_0, flow, 0, v6_pen_int_template_out.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_0, &add_len, v6_pen_int_template_out.r[idx].length, elem_len);
-                  }
-                  freclen_0 += (v6_pen_int_template_out.tot_rec_len + add_len);
-		}
-                break;
-#endif
-          default:
-                return (-1);
-          }
+	memcpy(ftoft_ptr, &rec8, 1);
+	ftoft_ptr += 1;
+
+	/* First five records (timestamps, counters, IP version) done above */
+	for (ridx = 5; tpl->r[ridx].handler; ridx++) {
+	  elem_len = tpl->r[ridx].handler(ftoft_ptr, flow, idx, tpl->r[ridx].length);
+	  nf_flow_to_flowset_inc_len(&ftoft_ptr, &add_len, tpl->r[ridx].length, elem_len);
 	}
 
-	if (direction == flow_direction[1]) {
-	  if (config.nfprobe_version == 9 && config.timestamps_secs) {
-	    rec32 = htonl(timeval_sub_ms(&flow->flow_last, system_boot_time));
-	    memcpy(ftoft_ptr_1, &rec32, 4);
-	    ftoft_ptr_1 += 4;
-	
-	    rec32 = htonl(timeval_sub_ms(&flow->flow_start, system_boot_time));
-	    memcpy(ftoft_ptr_1, &rec32, 4);
-	    ftoft_ptr_1 += 4;
-	  }
-          else if ((config.nfprobe_version == 9 && !config.timestamps_secs) || config.nfprobe_version == 10) {
-            u_int64_t tstamp_msec;
-
-            tstamp_msec = flow->flow_last.tv_sec;
-            tstamp_msec = tstamp_msec * 1000;
-            tstamp_msec += (flow->flow_last.tv_usec / 1000);
-            rec64 = pmXXX_htonll(tstamp_msec);
-            memcpy(ftoft_ptr_1, &rec64, 8);
-            ftoft_ptr_1 += 8;
-
-            tstamp_msec = flow->flow_start.tv_sec;
-            tstamp_msec = tstamp_msec * 1000;
-            tstamp_msec += (flow->flow_start.tv_usec / 1000);
-            rec64 = pmXXX_htonll(tstamp_msec);
-            memcpy(ftoft_ptr_1, &rec64, 8);
-            ftoft_ptr_1 += 8;
-          }
+	for (ridx = 0; pen_tpl->r[ridx].handler; ridx++) {
+	  elem_len = pen_tpl->r[ridx].handler(ftoft_ptr, flow, idx, pen_tpl->r[ridx].length);
+	  nf_flow_to_flowset_inc_len(&ftoft_ptr, &add_len, pen_tpl->r[ridx].length, elem_len);
+	}
 
-#if defined HAVE_64BIT_COUNTERS
-          rec64 = pmXXX_htonll(flow->octets[1]);
-          memcpy(ftoft_ptr_1, &rec64, 8);
-          ftoft_ptr_1 += 8;
+	return (tpl->tot_rec_len + pen_tpl->tot_rec_len + add_len);
+}
 
-          rec64 = pmXXX_htonll(flow->packets[1]);
-          memcpy(ftoft_ptr_1, &rec64, 8);
-          ftoft_ptr_1 += 8;
-#else
-	  rec32 = htonl(flow->octets[1]);
-	  memcpy(ftoft_ptr_1, &rec32, 4);
-	  ftoft_ptr_1 += 4;
+/*
+ * Records are encoded in place: 'packet' points into a datagram slot of
+ * the send batch, which has enough slack past 'len' to let a record that
+ * turns out not to fit be written and then simply disregarded.
+ */
+static int
+nf_flow_to_flowset(const struct FLOW *flow, u_char *packet, u_int len,
+    const struct timeval *system_boot_time, u_int *len_used, int direction)
+{
+	u_int ret_len, nflows;
+	int flow_direction[2], freclen, idx;
 
-	  rec32 = htonl(flow->packets[1]);
-	  memcpy(ftoft_ptr_1, &rec32, 4);
-	  ftoft_ptr_1 += 4;
-#endif
+	*len_used = nflows = ret_len = 0;
+	flow_direction[0] = (flow->direction[0] == DIRECTION_UNKNOWN) ? DIRECTION_IN : flow->direction[0];
+	flow_direction[1] = (flow->direction[1] == DIRECTION_UNKNOWN) ? DIRECTION_IN : flow->direction[1];
 
-          switch (flow->af) {
-          case AF_INET:
-                rec8 = 4;
-                memcpy(ftoft_ptr_1, &rec8, 1);
-                ftoft_ptr_1 += 1;
-		if (flow_direction[1] == DIRECTION_IN) {
-                  for (idx = 5, add_len = 0; v4_int_template.r[idx].handler; idx++) {
-                    elem_len = v4_int_template.r[idx].handler(ftoft_ptr_1, flow, 1, v4_int_template.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_1, &add_len, v4_int_template.r[idx].length, elem_len);
-                  }
-                  freclen_1 = v4_int_template.tot_rec_len;
-
-                  for (idx = 0; v4_pen_int_template.r[idx].handler; idx++) {
-                    elem_len = v4_pen_int_template.r[idx].handler(ftoft_ptr_1, flow, 1, v4_pen_int_template.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_1, &add_len, v4_pen_int_template.r[idx].length, elem_len);
-                  }
-                  freclen_1 += (v4_pen_int_template.tot_rec_len + add_len);
-		}
-		else if (flow_direction[1] == DIRECTION_OUT) {
-                  for (idx = 5, add_len = 0; v4_int_template_out.r[idx].handler; idx++) {
-                    elem_len = v4_int_template_out.r[idx].handler(ftoft_ptr_1, flow, 1, v4_int_template_out.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_1, &add_len, v4_int_template_out.r[idx].length, elem_len);
-                  }
-                  freclen_1 = v4_int_template_out.tot_rec_len;
-
-                  for (idx = 0; v4_pen_int_template_out.r[idx].handler; idx++) {
-                    elem_len = v4_pen_int_template_out.r[idx].handler(ftoft_ptr_1, flow, 1, v4_pen_int_template_out.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_1, &add_len, v4_pen_int_template_out.r[idx].length, elem_len);
-                  }
-                  freclen_1 += (v4_pen_int_template_out.tot_rec_len + add_len);
-		}
-                break;
+	for (idx = 0; idx < 2; idx++) {
+		if (direction != flow_direction[idx])
+			continue;
+
+		if (flow->af != AF_INET
 #if defined ENABLE_IPV6
-          case AF_INET6:
-                rec8 = 6;
-                memcpy(ftoft_ptr_1, &rec8, 1);
-                ftoft_ptr_1 += 1;
-		if (flow_direction[1] == DIRECTION_IN) {
-                  for (idx = 5, add_len = 0; v6_int_template.r[idx].handler; idx++) {
-                    elem_len = v6_int_template.r[idx].handler(ftoft_ptr_1, flow, 1, v6_int_template.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_1, &add_len, v6_int_template.r[idx].length, elem_len);
-                  }
-                  freclen_1 = v6_int_template.tot_rec_len;
-
-                  for (idx = 0; v6_pen_int_template.r[idx].handler; idx++) {
-                    elem_len = v6_pen_int_template.r[idx].handler(ftoft_ptr_1, flow, 1, v6_pen_int_template.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_1, &add_len, v6_pen_int_template.r[idx].length, elem_len);
-                  }
-                  freclen_1 += (v6_pen_int_template.tot_rec_len + add_len);
-		}
-		else if (flow_direction[1] == DIRECTION_OUT) {
-                  for (idx = 5, add_len = 0; v6_int_template_out.r[idx].handler; idx++) {
-                    elem_len = v6_int_template_out.r[idx].handler(ftoft_ptr_1, flow, 1, v6_int_template_out.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_1, &add_len, v6_int_template_out.r[idx].length, elem_len);
-                  }
-                  freclen_1 = v6_int_template_out.tot_rec_len;
-
-                  for (idx = 0; v6_pen_int_template_out.r[idx].handler; idx++) {
-                    elem_len = v6_pen_int_template_out.r[idx].handler(ftoft_ptr_1, flow, 1, v6_pen_int_template_out.r[idx].length);
-		    nf_flow_to_flowset_inc_len(&ftoft_ptr_1, &add_len, v6_pen_int_template_out.r[idx].length, elem_len);
-                  }
-                  freclen_1 += (v6_pen_int_template_out.tot_rec_len + add_len);
-		}
-                break;
+		    && flow->af != AF_INET6
 #endif
-          default:
-                return (-1);
-          }
-	}
-
-	if (flow->octets[0] > 0 && direction == flow_direction[0]) {
-		if (ret_len + freclen_0 > len)
+		   )
 			return (-1);
-		memcpy(packet + ret_len, ftoft_buf_0, freclen_0);
-		ret_len += freclen_0;
-		nflows++;
-	}
-	if (flow->octets[1] > 0 && direction == flow_direction[1]) {
-		if (ret_len + freclen_1 > len)
+
+		if (flow->octets[idx] == 0)
+			continue;
+
+		freclen = nf_flow_to_flowset_record((char *)packet + ret_len, flow, idx,
+		    flow_direction[idx], system_boot_time);
+		if (freclen < 0 || ret_len + freclen > len)
 			return (-1);
-		memcpy(packet + ret_len, ftoft_buf_1, freclen_1);
-		ret_len += freclen_1;
+		ret_len += freclen;
 		nflows++;
 	}
 
@@ -1882,7 +1758,7 @@ static int
 nf_sampling_option_to_flowset(u_char *packet, u_int len, const struct timeval *system_boot_time, u_int *len_used)
 {
         u_int freclen, ret_len, nflows;
-        u_int32_t rec32;
+        u_int32_t rec32 = 0;
         u_int8_t rec8;
         char *ftoft_ptr_0 = ftoft_buf_0;
 
@@ -1984,6 +1860,50 @@ nf_class_option_to_flowset(u_int idx, u_char *packet, u_int len, const struct ti
         return (nflows);
 }
 
+/*
+ * Send out the queued datagrams, with as few sendmmsg() calls as the
+ * socket allows. Returns number of packets sent or -1 on error
+ */
+static int
+nf9_batch_flush(int nfsock, int verbose_flag)
+{
+	socklen_t errsz;
+	int err, idx, ret;
+
+	if (!nf9_batch_num)
+		return (0);
+
+	errsz = sizeof(err);
+	/* Clear ICMP errors */
+	getsockopt(nfsock, SOL_SOCKET, SO_ERROR, &err, &errsz);
+
+	for (idx = 0; idx < nf9_batch_num;) {
+#if defined HAVE_SENDMMSG
+		ret = sendmmsg(nfsock, &nf9_batch_msgs[idx], nf9_batch_num - idx, 0);
+#else
+		ret = send(nfsock, nf9_batch_iov[idx].iov_base, nf9_batch_iov[idx].iov_len, 0);
+		if (ret != -1) ret = 1;
+#endif
+		if (ret > 0)
+			idx += ret;
+		else if (ret == -1 && errno == EINTR)
+			continue;
+		else {
+			Log(LOG_WARNING, "WARN ( %s/%s ): send() failed: %s\n", config.name, config.type, strerror(errno));
+			nf9_batch_num = 0;
+			return (-1);
+		}
+	}
+
+	if (verbose_flag)
+		Log(LOG_DEBUG, "DEBUG ( %s/%s ): Flushed %d NetFlow v9/IPFIX packets\n", config.name, config.type, nf9_batch_num);
+
+	ret = nf9_batch_num;
+	nf9_batch_num = 0;
+
+	return (ret);
+}
+
 /*
  * Given an array of expired flows, send netflow v9 report packets
  * Returns number of packets sent or -1 on error
@@ -1993,18 +1913,17 @@ send_netflow_v9(struct FLOW **flows, int num_flows, int nfsock,
     u_int64_t *flows_exported, struct timeval *system_boot_time,
     int verbose_flag, u_int8_t engine_type, u_int8_t engine_id)
 {
-	struct NF9_HEADER *nf9;
-	struct IPFIX_HEADER *nf10;
+	struct NF9_HEADER *nf9 = NULL;
+	struct IPFIX_HEADER *nf10 = NULL;
 	struct NF9_DATA_FLOWSET_HEADER *dh;
 	struct timeval now;
-	u_int offset, last_af, flow_j, num_packets, inc, last_valid;
+	u_int offset = 0, last_af, flow_j, num_packets, inc = 0, last_valid;
 	u_int num_class, class_j;
 	int direction, new_direction;
-	socklen_t errsz;
-	int err, r, flow_i, class_i;
+	int r = 0, flow_i, class_i;
 	u_int8_t *sid_ptr;
+	char *packet;
 
-	memset(packet, 0, sizeof(packet));
 	gettimeofday(&now, NULL);
 
 	if (nf9_pkts_until_template == -1) {
@@ -2020,7 +1939,8 @@ send_netflow_v9(struct FLOW **flows, int num_flows, int nfsock,
 	  last_valid = 0; new_direction = TRUE;
 
 	  for (flow_j = 0, class_j = 0; flow_j < num_flows;) {
-		bzero(packet, sizeof(packet));
+		packet = nf9_batch_buf[nf9_batch_num];
+		bzero(packet, NF9_BATCH_SLOT_SIZE);
 		if (config.nfprobe_version == 9) {
 		  nf9 = (struct NF9_HEADER *)packet;
 
@@ -2122,7 +2042,7 @@ send_netflow_v9(struct FLOW **flows, int num_flows, int nfsock,
 					/* Finalise last header */
 					dh->c.length = htons(dh->c.length);
 				}
-				if (offset + sizeof(*dh) > sizeof(packet)) {
+				if (offset + sizeof(*dh) > NF9_SOFTFLOWD_MAX_PACKET_SIZE) {
 					/* Mark header is finished */
 					dh = NULL;
 					break;
@@ -2166,12 +2086,12 @@ send_netflow_v9(struct FLOW **flows, int num_flows, int nfsock,
 			if (send_options) {
 			  if (send_sampling_option) {
                             r = nf_sampling_option_to_flowset(packet + offset,
-                              sizeof(packet) - offset, system_boot_time, &inc);
+                              NF9_SOFTFLOWD_MAX_PACKET_SIZE - offset, system_boot_time, &inc);
 			    send_sampling_option = FALSE;
 			  }
 			  else if (send_class_option) {
                             r = nf_class_option_to_flowset(class_i + class_j, packet + offset,
-                              sizeof(packet) - offset, system_boot_time, &inc);
+                              NF9_SOFTFLOWD_MAX_PACKET_SIZE - offset, system_boot_time, &inc);
 
 			    if (r > 0) class_i += r;
 			    if (class_i + class_j >= num_class) send_class_option = FALSE;
@@ -2179,7 +2099,7 @@ send_netflow_v9(struct FLOW **flows, int num_flows, int nfsock,
 			}
 			else 
 			  r = nf_flow_to_flowset(flows[flow_i + flow_j], packet + offset,
-			    sizeof(packet) - offset, system_boot_time, &inc, direction);
+			    NF9_SOFTFLOWD_MAX_PACKET_SIZE - offset, system_boot_time, &inc, direction);
 
 			/* Wrap up */
 			if (r <= 0) {
@@ -2220,7 +2140,8 @@ send_netflow_v9(struct FLOW **flows, int num_flows, int nfsock,
 		/* Don't finish header if it has already been done */
 		if (dh != NULL) {
 			if (offset % 4 != 0) {
-				/* Pad to multiple of 4 */
+				/* Pad to multiple of 4; may hold leftovers of a record not fitting */
+				memset(packet + offset, 0, 4 - (offset % 4));
 				dh->c.length += 4 - (offset % 4);
 				offset += 4 - (offset % 4);
 			}
@@ -2234,15 +2155,20 @@ send_netflow_v9(struct FLOW **flows, int num_flows, int nfsock,
 		  else if (config.nfprobe_version == 10) nf10->len = htons(offset);
 
 		  if (verbose_flag)
-		    Log(LOG_DEBUG, "DEBUG ( %s/%s ): Sending NetFlow v9/IPFIX packet: len = %d\n", config.name, config.type, offset);
-		  errsz = sizeof(err);
-		  /* Clear ICMP errors */
-		  getsockopt(nfsock, SOL_SOCKET, SO_ERROR, &err, &errsz); 
-		  if (send(nfsock, packet, (size_t)offset, 0) == -1) {
-		    Log(LOG_WARNING, "WARN ( %s/%s ): send() failed: %s\n", config.name, config.type, strerror(errno));
-		    return (-1);
+		    Log(LOG_DEBUG, "DEBUG ( %s/%s ): Queuing NetFlow v9/IPFIX packet: len = %d\n", config.name, config.type, offset);
+
+		  nf9_batch_iov[nf9_batch_num].iov_base = packet;
+		  nf9_batch_iov[nf9_batch_num].iov_len = offset;
+#if defined HAVE_SENDMMSG
+		  nf9_batch_msgs[nf9_batch_num].msg_hdr.msg_iov = &nf9_batch_iov[nf9_batch_num];
+		  nf9_batch_msgs[nf9_batch_num].msg_hdr.msg_iovlen = 1;
+#endif
+		  nf9_batch_num++;
+
+		  if (nf9_batch_num == NF9_SEND_BATCH) {
+		    if ((r = nf9_batch_flush(nfsock, verbose_flag)) < 0) return (-1);
+		    num_packets += r;
 		  }
-		  num_packets++;
 		  nf9_pkts_until_template--;
 		}
 		else {
@@ -2254,5 +2180,8 @@ send_netflow_v9(struct FLOW **flows, int num_flows, int nfsock,
 	  }
 	}
 
+	if ((r = nf9_batch_flush(nfsock, verbose_flag)) < 0) return (-1);
+	num_packets += r;
+
 	return (num_packets);
 }
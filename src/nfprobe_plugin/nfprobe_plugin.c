@@ -52,11 +52,10 @@
 
 #include "common.h"
 #include "addr.h"
-#include "sys-tree.h"
 #include "convtime.h"
 #include "../nfacctd.h"
 #include "nfprobe_plugin.h"
-#include "treetype.h"
+#include "jhash.h"
 
 #include "pmacct-data.h"
 #include "plugin_hooks.h"
@@ -69,7 +68,7 @@ static int timeout = 0;
 struct FLOWTRACK *glob_flowtrack = NULL;
 
 /* Prototypes */
-static void force_expire(struct FLOWTRACK *, u_int32_t);
+static int force_expire(struct FLOWTRACK *, u_int32_t);
 
 /* Signal handler flags */
 static int graceful_shutdown_request = 0;	
@@ -156,29 +155,274 @@ flow_compare(struct FLOW *a, struct FLOW *b)
 	return (0);
 }
 
-/* Generate functions for flow tree */
-FLOW_PROTOTYPE(FLOWS, FLOW, trp, flow_compare);
-FLOW_GENERATE(FLOWS, FLOW, trp, flow_compare);
+/* Hash of the flow identity, consistent with flow_compare() */
+static u_int32_t
+flow_hash(struct FLOWTRACK *ft, struct FLOW *flow)
+{
+	u_int32_t hash;
+
+	hash = jhash(flow->addr, sizeof(flow->addr), ft->flows.seed);
+
+	return (jhash_3words(flow->af, flow->protocol,
+	    ((u_int32_t)flow->port[0] << 16) | flow->port[1], hash));
+}
+
+static void
+flow_table_init(struct FLOW_TABLE *t, u_int32_t entries)
+{
+	u_int32_t size = FLOW_HASH_MIN_SIZE;
+
+	/* Keep the load factor at or below 1/2 */
+	while (size < entries && size < (1U << 30))
+		size <<= 1;
+	size <<= 1;
+
+	t->slots = pm_malloc(sizeof(*t->slots) * size);
+	memset(t->slots, 0, sizeof(*t->slots) * size);
+	t->size = size;
+	t->count = 0;
+	t->seed = (u_int32_t) time(NULL) ^ (u_int32_t) getpid();
+}
 
-/*
- * This is the expiry comparison function.
- */
 static int
-expiry_compare(struct EXPIRY *a, struct EXPIRY *b)
+flow_table_grow(struct FLOW_TABLE *t)
 {
-	if (a->expires_at != b->expires_at)
-		return (a->expires_at > b->expires_at ? 1 : -1);
+	struct FLOW_HASH_SLOT *slots;
+	u_int32_t size, mask, i, idx;
+
+	size = t->size << 1;
+	mask = size - 1;
+
+	if (!size || (slots = malloc(sizeof(*slots) * size)) == NULL)
+		return (-1);
+	memset(slots, 0, sizeof(*slots) * size);
+
+	for (i = 0; i < t->size; i++) {
+		if (t->slots[i].flow == NULL)
+			continue;
+		for (idx = t->slots[i].hash & mask; slots[idx].flow != NULL;
+		    idx = (idx + 1) & mask);
+		slots[idx] = t->slots[i];
+	}
 
-	/* Make expiry entries unique by comparing flow sequence */
-	if (a->flow->flow_seq != b->flow->flow_seq)
-		return (a->flow->flow_seq > b->flow->flow_seq ? 1 : -1);
+	free(t->slots);
+	t->slots = slots;
+	t->size = size;
+
+	if (verbose_flag)
+		Log(LOG_DEBUG, "DEBUG ( %s/%s ): Flow table grown to %u slots\n",
+		    config.name, config.type, size);
 
 	return (0);
 }
 
-/* Generate functions for flow tree */
-EXPIRY_PROTOTYPE(EXPIRIES, EXPIRY, trp, expiry_compare);
-EXPIRY_GENERATE(EXPIRIES, EXPIRY, trp, expiry_compare);
+static struct FLOW *
+flow_table_find(struct FLOW_TABLE *t, struct FLOW *key, u_int32_t hash)
+{
+	u_int32_t mask = t->size - 1, idx;
+
+	for (idx = hash & mask; t->slots[idx].flow != NULL;
+	    idx = (idx + 1) & mask) {
+		if (t->slots[idx].hash == hash &&
+		    flow_compare(t->slots[idx].flow, key) == 0)
+			return (t->slots[idx].flow);
+	}
+
+	return (NULL);
+}
+
+static int
+flow_table_insert(struct FLOW_TABLE *t, struct FLOW *flow)
+{
+	u_int32_t mask, idx;
+
+	/* Growing is best effort: only a full table is fatal */
+	if ((t->count + 1) * 2 > t->size && flow_table_grow(t) == -1 &&
+	    t->count + 1 >= t->size)
+		return (-1);
+
+	mask = t->size - 1;
+	for (idx = flow->hash & mask; t->slots[idx].flow != NULL;
+	    idx = (idx + 1) & mask);
+
+	t->slots[idx].hash = flow->hash;
+	t->slots[idx].flow = flow;
+	t->count++;
+	flow->hashed = TRUE;
+
+	return (0);
+}
+
+/* Removal by backward shifting, so that no tombstones are needed */
+static void
+flow_table_remove(struct FLOW_TABLE *t, struct FLOW *flow)
+{
+	u_int32_t mask = t->size - 1, idx, next, home;
+
+	for (idx = flow->hash & mask; t->slots[idx].flow != flow;
+	    idx = (idx + 1) & mask) {
+		if (t->slots[idx].flow == NULL)
+			return;
+	}
+
+	for (next = (idx + 1) & mask; t->slots[next].flow != NULL;
+	    next = (next + 1) & mask) {
+		home = t->slots[next].hash & mask;
+		if (((next - home) & mask) >= ((next - idx) & mask)) {
+			t->slots[idx] = t->slots[next];
+			idx = next;
+		}
+	}
+
+	t->slots[idx].hash = 0;
+	t->slots[idx].flow = NULL;
+	t->count--;
+	flow->hashed = FALSE;
+}
+
+static struct FLOW *
+flow_alloc(struct FLOW_POOL *p)
+{
+	struct FLOW_SLAB *slab;
+	struct FLOW *flow;
+	int i;
+
+	if (p->free_list == NULL) {
+		if ((slab = malloc(sizeof(*slab))) == NULL)
+			return (NULL);
+		if ((slab->flows = malloc(sizeof(*slab->flows) * FLOW_SLAB_ENTRIES)) == NULL) {
+			free(slab);
+			return (NULL);
+		}
+
+		for (i = FLOW_SLAB_ENTRIES - 1; i >= 0; i--) {
+			slab->flows[i].next_free = p->free_list;
+			p->free_list = &slab->flows[i];
+		}
+
+		slab->next = p->slabs;
+		p->slabs = slab;
+		p->allocated += FLOW_SLAB_ENTRIES;
+	}
+
+	flow = p->free_list;
+	p->free_list = flow->next_free;
+
+	return (flow);
+}
+
+static void
+flow_release(struct FLOW_POOL *p, struct FLOW *flow)
+{
+	flow->next_free = p->free_list;
+	p->free_list = flow;
+}
+
+static struct EXPIRY **
+expiry_head(struct EXPIRY_WHEEL *w, int level, int slot)
+{
+	if (level == EXPIRY_IMMEDIATE)
+		return (&w->immediate);
+
+	return (&w->slot[level][slot]);
+}
+
+static void
+expiry_link(struct EXPIRY_WHEEL *w, struct EXPIRY *e, int level, int slot)
+{
+	struct EXPIRY **head = expiry_head(w, level, slot);
+
+	if (level == EXPIRY_IMMEDIATE)
+		w->num_immediate++;
+	else {
+		w->bitmap[level] |= (1ULL << slot);
+		w->count++;
+	}
+
+	e->level = level;
+	e->slot = slot;
+	if ((e->next = *head) != NULL)
+		e->next->pprev = &e->next;
+	*head = e;
+	e->pprev = head;
+}
+
+static void
+expiry_unlink(struct EXPIRY_WHEEL *w, struct EXPIRY *e)
+{
+	if (e->pprev == NULL)
+		return;
+
+	if (e->next != NULL)
+		e->next->pprev = e->pprev;
+	*e->pprev = e->next;
+	e->next = NULL;
+	e->pprev = NULL;
+
+	if (e->level == EXPIRY_IMMEDIATE)
+		w->num_immediate--;
+	else {
+		if (w->slot[e->level][e->slot] == NULL)
+			w->bitmap[e->level] &= ~(1ULL << e->slot);
+		w->count--;
+	}
+}
+
+/*
+ * Link an expiry event to the wheel slot covering its expires_at. Events
+ * already due go to the slot of the current second; events beyond the
+ * range of the wheel are parked in its farthest slot and get re-evaluated
+ * when that is cascaded.
+ */
+static void
+expiry_schedule(struct EXPIRY_WHEEL *w, struct EXPIRY *e)
+{
+	u_int32_t t = e->expires_at, delta;
+	int level;
+
+	if (t == 0) {
+		expiry_link(w, e, EXPIRY_IMMEDIATE, 0);
+		return;
+	}
+
+	if (t < w->clk)
+		t = w->clk;
+
+	if ((delta = t - w->clk) > EXPIRY_WHEEL_MAX_DELTA) {
+		delta = EXPIRY_WHEEL_MAX_DELTA;
+		t = w->clk + delta;
+	}
+
+	for (level = 0; level < EXPIRY_WHEEL_LEVELS - 1; level++) {
+		if (delta < (1U << (EXPIRY_WHEEL_BITS * (level + 1))))
+			break;
+	}
+
+	expiry_link(w, e, level,
+	    (t >> (EXPIRY_WHEEL_BITS * level)) & EXPIRY_WHEEL_MASK);
+}
+
+/* Advance the wheel by one second, cascading slots on level boundaries */
+static void
+expiry_tick(struct EXPIRY_WHEEL *w)
+{
+	struct EXPIRY *e, **head;
+	int level;
+
+	w->clk++;
+
+	for (level = 1; level < EXPIRY_WHEEL_LEVELS; level++) {
+		if (w->clk & ((1U << (EXPIRY_WHEEL_BITS * level)) - 1))
+			break;
+
+		head = expiry_head(w, level,
+		    (w->clk >> (EXPIRY_WHEEL_BITS * level)) & EXPIRY_WHEEL_MASK);
+		while ((e = *head) != NULL) {
+			expiry_unlink(w, e);
+			expiry_schedule(w, e);
+		}
+	}
+}
 
 /* Format a time in an ISOish format */
 static const char *
@@ -560,28 +804,28 @@ ipv6_to_flowrec_update(struct FLOW *flow, struct primitives_ptrs *prim_ptrs, int
 static void
 flow_update_expiry(struct FLOWTRACK *ft, struct FLOW *flow)
 {
-	EXPIRY_REMOVE(EXPIRIES, &ft->expiries, flow->expiry);
+	expiry_unlink(&ft->expiries, &flow->expiry);
 
 #if defined HAVE_64BIT_COUNTERS
         if (config.nfprobe_version == 9 || config.nfprobe_version == 10) {
 	  if (flow->octets[0] > (1ULL << 63) || flow->octets[1] > (1ULL << 63)) { 
-                flow->expiry->expires_at = 0;
-                flow->expiry->reason = R_OVERBYTES;
+                flow->expiry.expires_at = 0;
+                flow->expiry.reason = R_OVERBYTES;
                 goto out;
 	  }
         }
 	else {
           if (flow->octets[0] > (1U << 31) || flow->octets[1] > (1U << 31)) {
-                flow->expiry->expires_at = 0;
-                flow->expiry->reason = R_OVERBYTES;
+                flow->expiry.expires_at = 0;
+                flow->expiry.reason = R_OVERBYTES;
                 goto out;
           }
 	}
 #else
 	/* Flows over 2Gb traffic */
 	if (flow->octets[0] > (1U << 31) || flow->octets[1] > (1U << 31)) {
-		flow->expiry->expires_at = 0;
-		flow->expiry->reason = R_OVERBYTES;
+		flow->expiry.expires_at = 0;
+		flow->expiry.reason = R_OVERBYTES;
 		goto out;
 	}
 #endif
@@ -590,8 +834,8 @@ flow_update_expiry(struct FLOWTRACK *ft, struct FLOW *flow)
 	if (ft->maximum_lifetime != 0 && 
 	    flow->flow_last.tv_sec - flow->flow_start.tv_sec > 
 	    ft->maximum_lifetime) {
-		flow->expiry->expires_at = 0;
-		flow->expiry->reason = R_MAXLIFE;
+		flow->expiry.expires_at = 0;
+		flow->expiry.reason = R_MAXLIFE;
 		goto out;
 	}
 	
@@ -600,35 +844,35 @@ flow_update_expiry(struct FLOWTRACK *ft, struct FLOW *flow)
 		if (ft->tcp_rst_timeout != 0 &&
 		    ((flow->tcp_flags[0] & TH_RST) ||
 		    (flow->tcp_flags[1] & TH_RST))) {
-			flow->expiry->expires_at = flow->flow_last.tv_sec + 
+			flow->expiry.expires_at = flow->flow_last.tv_sec + 
 			    ft->tcp_rst_timeout;
-			flow->expiry->reason = R_TCP_RST;
+			flow->expiry.reason = R_TCP_RST;
 			goto out;
 		}
 		/* Finished TCP flows */
 		if (ft->tcp_fin_timeout != 0 &&
 		    ((flow->tcp_flags[0] & TH_FIN) &&
 		    (flow->tcp_flags[1] & TH_FIN))) {
-			flow->expiry->expires_at = flow->flow_last.tv_sec + 
+			flow->expiry.expires_at = flow->flow_last.tv_sec + 
 			    ft->tcp_fin_timeout;
-			flow->expiry->reason = R_TCP_FIN;
+			flow->expiry.reason = R_TCP_FIN;
 			goto out;
 		}
 
 		/* TCP flows */
 		if (ft->tcp_timeout != 0) {
-			flow->expiry->expires_at = flow->flow_last.tv_sec + 
+			flow->expiry.expires_at = flow->flow_last.tv_sec + 
 			    ft->tcp_timeout;
-			flow->expiry->reason = R_TCP;
+			flow->expiry.reason = R_TCP;
 			goto out;
 		}
 	}
 
 	if (ft->udp_timeout != 0 && flow->protocol == IPPROTO_UDP) {
 		/* UDP flows */
-		flow->expiry->expires_at = flow->flow_last.tv_sec + 
+		flow->expiry.expires_at = flow->flow_last.tv_sec + 
 		    ft->udp_timeout;
-		flow->expiry->reason = R_UDP;
+		flow->expiry.reason = R_UDP;
 		goto out;
 	}
 
@@ -639,19 +883,19 @@ flow_update_expiry(struct FLOWTRACK *ft, struct FLOW *flow)
 #endif
 	   )) {
 		/* UDP flows */
-		flow->expiry->expires_at = flow->flow_last.tv_sec + 
+		flow->expiry.expires_at = flow->flow_last.tv_sec + 
 		    ft->icmp_timeout;
-		flow->expiry->reason = R_ICMP;
+		flow->expiry.reason = R_ICMP;
 		goto out;
 	}
 
 	/* Everything else */
-	flow->expiry->expires_at = flow->flow_last.tv_sec + 
+	flow->expiry.expires_at = flow->flow_last.tv_sec + 
 	    ft->general_timeout;
-	flow->expiry->reason = R_GENERAL;
+	flow->expiry.reason = R_GENERAL;
 
  out:
-	EXPIRY_INSERT(EXPIRIES, &ft->expiries, flow->expiry);
+	expiry_schedule(&ft->expiries, &flow->expiry);
 }
 
 void free_flow_allocs(struct FLOW *flow)
@@ -675,7 +919,8 @@ process_packet(struct FLOWTRACK *ft, struct primitives_ptrs *prim_ptrs, const st
 {
   struct pkt_data *data = prim_ptrs->data;
 
-  struct FLOW tmp, *flow;
+  struct FLOW tmp, *flow = NULL;
+  u_int32_t hash = 0;
   int frag, af, dont_summarize = (config.acct_type == ACCT_NF ? 1 : 0);
 
   ft->total_packets += data->pkt_num;
@@ -707,24 +952,33 @@ process_packet(struct FLOWTRACK *ft, struct primitives_ptrs *prim_ptrs, const st
     ft->frag_packets += data->pkt_num;
 
   /* If a matching flow does not exist, create and insert one */
-  if (dont_summarize || ((flow = FLOW_FIND(FLOWS, &ft->flows, &tmp)) == NULL)) {
+  if (!dont_summarize) {
+    hash = flow_hash(ft, &tmp);
+    flow = flow_table_find(&ft->flows, &tmp, hash);
+  }
+
+  if (flow == NULL) {
     /* Allocate and fill in the flow */
-    if ((flow = malloc(sizeof(*flow))) == NULL) return (PP_MALLOC_FAIL);
+    if ((flow = flow_alloc(&ft->pool)) == NULL) return (PP_MALLOC_FAIL);
     memcpy(flow, &tmp, sizeof(*flow));
     memcpy(&flow->flow_start, received_time, sizeof(flow->flow_start));
     flow->flow_seq = ft->next_flow_seq++;
-    FLOW_INSERT(FLOWS, &ft->flows, flow);
+    flow->hash = hash;
 
-    /* Allocate and fill in the associated expiry event */
-    if ((flow->expiry = malloc(sizeof(*flow->expiry))) == NULL)
+    /* Flows are never looked up when not summarizing */
+    if (!dont_summarize && flow_table_insert(&ft->flows, flow) == -1) {
+      flow_release(&ft->pool, flow);
       return (PP_MALLOC_FAIL);
-    flow->expiry->flow = flow;
+    }
+
+    /* Fill in the associated expiry event */
+    flow->expiry.flow = flow;
     /* Expiration note: 0 means expire immediately; we prefer this to happen 
        when attaching to nfacctd - ie. dont_summarize is TRUE */
-    if (!dont_summarize) flow->expiry->expires_at = 1;
-    else flow->expiry->expires_at = 0;
-    flow->expiry->reason = R_GENERAL;
-    EXPIRY_INSERT(EXPIRIES, &ft->expiries, flow->expiry);
+    if (!dont_summarize) flow->expiry.expires_at = 1;
+    else flow->expiry.expires_at = 0;
+    flow->expiry.reason = R_GENERAL;
+    expiry_schedule(&ft->expiries, &flow->expiry);
 
     if (data->flo_num) ft->num_flows += data->flo_num;
     else ft->num_flows++;
@@ -766,7 +1020,7 @@ process_packet(struct FLOWTRACK *ft, struct primitives_ptrs *prim_ptrs, const st
 	
   memcpy(&flow->flow_last, received_time, sizeof(flow->flow_last));
 
-  if (flow->expiry->expires_at != 0) flow_update_expiry(ft, flow);
+  if (flow->expiry.expires_at != 0) flow_update_expiry(ft, flow);
 
   return (PP_OK);
 }
@@ -875,22 +1129,28 @@ update_expiry_stats(struct FLOWTRACK *ft, struct EXPIRY *e)
 static int
 next_expire(struct FLOWTRACK *ft)
 {
-	struct EXPIRY *expiry;
+	struct EXPIRY_WHEEL *w = &ft->expiries;
 	struct timeval now;
 	u_int32_t expires_at, ret, fudge;
+	u_int64_t pending;
 
 	gettimeofday(&now, NULL);
 
-	if ((expiry = EXPIRY_MIN(EXPIRIES, &ft->expiries)) == NULL)
-		return (-1); /* indefinite */
-
-	expires_at = expiry->expires_at;
-
 	/* Don't cluster urgent expiries */
-	if (expires_at == 0 && (expiry->reason == R_OVERBYTES || 
-	    expiry->reason == R_OVERFLOWS || expiry->reason == R_FLUSH))
+	if (w->num_immediate)
 		return (0); /* Now */
 
+	if (!w->count)
+		return (-1); /* indefinite */
+
+	/* Earliest busy slot of this wheel turn, else the next cascade */
+	expires_at = w->clk;
+	for (pending = w->bitmap[0] >> (w->clk & EXPIRY_WHEEL_MASK);
+	    pending && !(pending & 1); pending >>= 1)
+		expires_at++;
+	if (!pending)
+		expires_at = (w->clk | EXPIRY_WHEEL_MASK) + 1;
+
 	/* Cluster expiries by expiry_interval */
 	if (ft->expiry_interval > 1) {
 		if ((fudge = expires_at % ft->expiry_interval) > 0)
@@ -904,73 +1164,101 @@ next_expire(struct FLOWTRACK *ft)
 	return (ret);
 }
 
-/*
- * Scan the tree of expiry events and process expired flows. If zap_all
- * is set, then forcibly expire all flows.
- */
 #define CE_EXPIRE_NORMAL	0  /* Normal expiry processing */
 #define CE_EXPIRE_ALL		-1 /* Expire all flows immediately */
 #define CE_EXPIRE_FORCED	1  /* Only expire force-expired flows */
+
+/* Unlink an expired flow from the table and the wheel, queue it for export */
+static void
+queue_expired(struct FLOWTRACK *ft, struct EXPIRY *expiry, int ex, int *num_expired)
+{
+	if (verbose_flag)
+		Log(LOG_DEBUG, "DEBUG ( %s/%s ): Queuing flow seq:%llu (%p) for expiry\n",
+		   config.name, config.type, expiry->flow->flow_seq, expiry->flow);
+
+	ft->expired_flows[(*num_expired)++] = expiry->flow;
+
+	if (ex == CE_EXPIRE_ALL)
+		expiry->reason = R_FLUSH;
+
+	update_expiry_stats(ft, expiry);
+
+	expiry_unlink(&ft->expiries, expiry);
+	if (expiry->flow->hashed)
+		flow_table_remove(&ft->flows, expiry->flow);
+
+	ft->num_flows--;
+}
+
+/*
+ * Advance the timer wheel up to now and process expired flows. If zap_all
+ * is set, then forcibly expire all flows. Work is bounded: at most
+ * EXPIRY_BATCH flows are evicted per call, the rest is left for the next.
+ */
 static int
 check_expired(struct FLOWTRACK *ft, struct NETFLOW_TARGET *target, int ex, u_int8_t engine_type, u_int8_t engine_id)
 {
-	struct FLOW **expired_flows, **oldexp;
-	int num_expired, i, r;
+	struct FLOW **expired_flows = ft->expired_flows;
+	struct EXPIRY_WHEEL *w = &ft->expiries;
+	struct EXPIRY *expiry;
+	int num_expired, i, r, level, slot;
+	u_int32_t step;
+	u_int64_t pending;
 	struct timeval now;
 
-	struct EXPIRY *expiry, *nexpiry;
-
 	gettimeofday(&now, NULL);
 
 	r = 0;
 	num_expired = 0;
-	expired_flows = NULL;
 
 	if (verbose_flag)
 	  Log(LOG_DEBUG, "DEBUG ( %s/%s ): Starting expiry scan: mode %d\n", config.name, config.type, ex);
 
-	for(expiry = EXPIRY_MIN(EXPIRIES, &ft->expiries);
-	    expiry != NULL;
-	    expiry = nexpiry) {
-		nexpiry = EXPIRY_NEXT(EXPIRIES, &ft->expiries, expiry);
-		if ((expiry->expires_at == 0) || (ex == CE_EXPIRE_ALL) || 
-		    (ex != CE_EXPIRE_FORCED &&
-		    (expiry->expires_at < now.tv_sec))) {
-			/* Flow has expired */
-			if (verbose_flag)
-				Log(LOG_DEBUG, "DEBUG ( %s/%s ): Queuing flow seq:%llu (%p) for expiry\n",
-				   config.name, config.type, expiry->flow->flow_seq, expiry->flow);
-
-			/* Add to array of expired flows */
-			oldexp = expired_flows;
-			expired_flows = realloc(expired_flows,
-			    sizeof(*expired_flows) * (num_expired + 1));
-			/* Don't fatal on realloc failures */
-			if (expired_flows == NULL)
-				expired_flows = oldexp;
-			else {
-				expired_flows[num_expired] = expiry->flow;
-				num_expired++;
+	while (num_expired < EXPIRY_BATCH && (expiry = w->immediate) != NULL)
+		queue_expired(ft, expiry, ex, &num_expired);
+
+	if (ex == CE_EXPIRE_ALL) {
+		for (level = 0; level < EXPIRY_WHEEL_LEVELS; level++) {
+			for (slot = 0; slot < EXPIRY_WHEEL_SLOTS; slot++) {
+				while (num_expired < EXPIRY_BATCH &&
+				    (expiry = w->slot[level][slot]) != NULL)
+					queue_expired(ft, expiry, ex, &num_expired);
+			}
+		}
+	}
+	else if (ex == CE_EXPIRE_NORMAL) {
+		while (num_expired < EXPIRY_BATCH && w->clk < now.tv_sec) {
+			slot = w->clk & EXPIRY_WHEEL_MASK;
+			if ((expiry = w->slot[0][slot]) != NULL) {
+				queue_expired(ft, expiry, ex, &num_expired);
+				continue;
 			}
 
-			if (ex == CE_EXPIRE_ALL)
-				expiry->reason = R_FLUSH;
+			if (!w->count) {
+				w->clk = now.tv_sec;
+				break;
+			}
 
-			update_expiry_stats(ft, expiry);
+			/* Skip to the next busy slot or to the next cascade */
+			for (pending = w->bitmap[0] >> slot, step = 0;
+			    pending && !(pending & 1); pending >>= 1)
+				step++;
+			if (!pending)
+				step = EXPIRY_WHEEL_SLOTS - slot;
 
-			/* Remove from flow tree, destroy expiry event */
-			FLOW_REMOVE(FLOWS, &ft->flows, expiry->flow);
-			EXPIRY_REMOVE(EXPIRIES, &ft->expiries, expiry);
-			expiry->flow->expiry = NULL;
-			free(expiry);
+			if (w->clk + step > now.tv_sec) {
+				w->clk = now.tv_sec;
+				break;
+			}
 
-			ft->num_flows--;
+			w->clk += step - 1;
+			expiry_tick(w);
 		}
 	}
 
 	if (verbose_flag)
 		Log(LOG_DEBUG, "DEBUG ( %s/%s ): Finished scan %d flow(s) to be evicted\n", config.name, config.type, num_expired);
-	
+
 	/* Processing for expired flows */
 	if (num_expired > 0) {
 		if (target != NULL) {
@@ -978,13 +1266,12 @@ check_expired(struct FLOWTRACK *ft, struct NETFLOW_TARGET *target, int ex, u_int
 			  Log(LOG_WARNING, "WARN ( %s/%s ): No connection to collector, discarding flows\n", config.name, config.type);
 			  for (i = 0; i < num_expired; i++) {
 				  free_flow_allocs(expired_flows[i]);
-				  free(expired_flows[i]);
+				  flow_release(&ft->pool, expired_flows[i]);
 			  }
-			  free(expired_flows);
 			  return -1;
                         }
 			else {
-			  r = target->dialect->func(expired_flows, num_expired, 
+			  r = target->dialect->func(expired_flows, num_expired,
 			    target->fd, &ft->flows_exported, // &ft->next_datagram_seq,
 			    &ft->system_boot_time, verbose_flag, engine_type, engine_id);
 			  if (verbose_flag)
@@ -999,105 +1286,101 @@ check_expired(struct FLOWTRACK *ft, struct NETFLOW_TARGET *target, int ex, u_int
 		}
 		for (i = 0; i < num_expired; i++) {
 			if (verbose_flag) {
-				Log(LOG_DEBUG, "DEBUG ( %s/%s ): EXPIRED: %s (%p)\n", config.name, config.type, 
+				Log(LOG_DEBUG, "DEBUG ( %s/%s ): EXPIRED: %s (%p)\n", config.name, config.type,
 				    format_flow(expired_flows[i]),
 				    expired_flows[i]);
 			}
 			update_statistics(ft, expired_flows[i]);
 
 			free_flow_allocs(expired_flows[i]);
-			free(expired_flows[i]);
+			flow_release(&ft->pool, expired_flows[i]);
 		}
-	
-		free(expired_flows);
 	}
 
 	return (r == -1 ? -1 : num_expired);
 }
 
 /*
- * Force expiry of num_to_expire flows (e.g. when flow table overfull) 
+ * Force expiry of num_to_expire flows (e.g. when flow table overfull).
+ * Flows are taken from the wheel in order of expiry and moved over to
+ * the immediate list; returns how many flows await immediate expiry.
  */
-static void
+static int
 force_expire(struct FLOWTRACK *ft, u_int32_t num_to_expire)
 {
-	struct EXPIRY *expiry, **expiryv;
-	int i;
+	struct EXPIRY_WHEEL *w = &ft->expiries;
+	struct EXPIRY *expiry, *nexpiry;
+	int level, slot, start, n;
+	u_int32_t i;
+
+	/* Flows already queued for immediate expiry count towards the goal */
+	if (num_to_expire <= w->num_immediate)
+		return (w->num_immediate);
+	num_to_expire -= w->num_immediate;
 
-	/* XXX move all overflow processing here (maybe) */
 	if (verbose_flag)
 		Log(LOG_INFO, "INFO ( %s/%s ): Forcing expiry of %d flows\n",
 		    config.name, config.type, num_to_expire);
 
-	/*
-	 * Do this in two steps, as it is dangerous to change a key on 
-	 * a tree entry without first removing it and then re-adding it.
-	 * It is even worse when this has to be done during a FOREACH :)
-	 * To get around this, we make a list of expired flows and _then_ 
-	 * alter them 
-	 */
-	 
-	if ((expiryv = malloc(sizeof(*expiryv) * num_to_expire)) == NULL) {
-		/*
-		 * On malloc failure, expire ALL flows. I assume that 
-		 * setting all the keys in a tree to the same value is 
-		 * safe.
-		 */
-		Log(LOG_ERR, "ERROR ( %s/%s ): Out of memory while expiring flows\n", config.name, config.type);
-		EXPIRY_FOREACH(expiry, EXPIRIES, &ft->expiries) {
-			expiry->expires_at = 0;
-			expiry->reason = R_OVERFLOWS;
-			ft->flows_force_expired++;
+	for (i = 0, level = 0; level < EXPIRY_WHEEL_LEVELS && i < num_to_expire; level++) {
+		/* Upper levels: the slot of the current turn was cascaded already */
+		start = (w->clk >> (EXPIRY_WHEEL_BITS * level)) + (level ? 1 : 0);
+
+		for (n = 0; n < EXPIRY_WHEEL_SLOTS && i < num_to_expire; n++) {
+			slot = (start + n) & EXPIRY_WHEEL_MASK;
+
+			for (expiry = w->slot[level][slot]; expiry != NULL &&
+			    i < num_to_expire; expiry = nexpiry) {
+				nexpiry = expiry->next;
+				expiry_unlink(w, expiry);
+				expiry->expires_at = 0;
+				expiry->reason = R_OVERFLOWS;
+				expiry_link(w, expiry, EXPIRY_IMMEDIATE, 0);
+				i++;
+			}
 		}
-		return;
-	}
-	
-	/* Make the list of flows to expire */
-	i = 0;
-	EXPIRY_FOREACH(expiry, EXPIRIES, &ft->expiries) {
-		if (i >= num_to_expire)
-			break;
-		expiryv[i++] = expiry;
 	}
+
 	if (i < num_to_expire) {
 		Log(LOG_ERR, "ERROR ( %s/%s ): Needed to expire %d flows, but only %d active.\n",
 				config.name, config.type, num_to_expire, i);
-		num_to_expire = i;
 	}
 
-	for(i = 0; i < num_to_expire; i++) {
-		EXPIRY_REMOVE(EXPIRIES, &ft->expiries, expiryv[i]);
-		expiryv[i]->expires_at = 0;
-		expiryv[i]->reason = R_OVERFLOWS;
-		EXPIRY_INSERT(EXPIRIES, &ft->expiries, expiryv[i]);
-	}
-	ft->flows_force_expired += num_to_expire;
-	free(expiryv);
-	/* XXX - this is overcomplicated, perhaps use a separate queue */
+	ft->flows_force_expired += i;
+
+	return (w->num_immediate);
 }
 
 /* Delete all flows that we know about without processing */
 static int
 delete_all_flows(struct FLOWTRACK *ft)
 {
-	struct FLOW *flow, *nflow;
-	int i;
-	
-	i = 0;
-	for(flow = FLOW_MIN(FLOWS, &ft->flows); flow != NULL; flow = nflow) {
-		nflow = FLOW_NEXT(FLOWS, &ft->flows, flow);
-		FLOW_REMOVE(FLOWS, &ft->flows, flow);
-		
-		EXPIRY_REMOVE(EXPIRIES, &ft->expiries, flow->expiry);
-		free(flow->expiry);
+	struct EXPIRY_WHEEL *w = &ft->expiries;
+	struct EXPIRY *expiry, **head;
+	struct FLOW *flow;
+	int i, level, slot;
 
-		ft->num_flows--;
-
-		free_flow_allocs(flow);
-		free(flow);
-		i++;
+	i = 0;
+	for (level = 0; level <= EXPIRY_IMMEDIATE; level++) {
+		for (slot = 0; slot < EXPIRY_WHEEL_SLOTS; slot++) {
+			head = expiry_head(w, level, slot);
+			while ((expiry = *head) != NULL) {
+				flow = expiry->flow;
+				expiry_unlink(w, expiry);
+				if (flow->hashed)
+					flow_table_remove(&ft->flows, flow);
+
+				ft->num_flows--;
+
+				free_flow_allocs(flow);
+				flow_release(&ft->pool, flow);
+				i++;
+			}
+			if (level == EXPIRY_IMMEDIATE)
+				break;
+		}
 	}
-	
+
 	return (i);
 }
 
@@ -1217,13 +1500,14 @@ connsock(struct sockaddr_storage *addr, socklen_t len, int hoplimit)
 }
 
 static void
-init_flowtrack(struct FLOWTRACK *ft)
+init_flowtrack(struct FLOWTRACK *ft, u_int32_t max_flows)
 {
 	/* Set up flow-tracking structure */
 	memset(ft, '\0', sizeof(*ft));
 	ft->next_flow_seq = 1;
-	FLOW_INIT(&ft->flows);
-	EXPIRY_INIT(&ft->expiries);
+	flow_table_init(&ft->flows, max_flows);
+	ft->expiries.clk = time(NULL);
+	ft->expired_flows = pm_malloc(sizeof(*ft->expired_flows) * EXPIRY_BATCH);
 	
 	ft->tcp_timeout = DEFAULT_TCP_TIMEOUT;
 	ft->tcp_rst_timeout = DEFAULT_TCP_RST_TIMEOUT;
@@ -1448,7 +1732,10 @@ void nfprobe_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 	    
   memset(&cb_ctxt, '\0', sizeof(cb_ctxt));
 
-  init_flowtrack(&flowtrack);
+  if (!config.nfprobe_maxflows) max_flows = DEFAULT_MAX_FLOWS;
+  else max_flows = config.nfprobe_maxflows;
+
+  init_flowtrack(&flowtrack, max_flows);
 
   memset(&dest, '\0', sizeof(dest));
   memset(&target, '\0', sizeof(target));
@@ -1464,9 +1751,6 @@ void nfprobe_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
   if (!config.nfprobe_hoplimit) hoplimit = -1;
   else hoplimit = config.nfprobe_hoplimit;
 
-  if (!config.nfprobe_maxflows) max_flows = DEFAULT_MAX_FLOWS;
-  else max_flows = config.nfprobe_maxflows;
-
   if (config.debug) verbose_flag = TRUE;
   if (config.pcap_savefile) capfile = config.pcap_savefile;
 
@@ -1565,7 +1849,7 @@ sort_version:
 
     if (config.pipe_homegrown || config.pipe_amqp) {
       timeout = MIN(refresh_timeout, (amqp_timeout ? amqp_timeout : INT_MAX));
-      ret = poll(&pfd, (pfd.fd == ERR ? 0 : 1), timeout);
+      ret = plugin_pipe_poll(&pfd, status, timeout);
     }
 #ifdef WITH_KAFKA
     else if (config.pipe_kafka) {
@@ -1577,7 +1861,7 @@ sort_version:
     /* Flags set by signal handlers or control socket */
     if (graceful_shutdown_request) {
       Log(LOG_WARNING, "WARN ( %s/%s ): Shutting down on user request.\n", config.name, config.type);
-      check_expired(&flowtrack, &target, CE_EXPIRE_ALL, engine_type, engine_id);
+      while (check_expired(&flowtrack, &target, CE_EXPIRE_ALL, engine_type, engine_id) > 0);
       goto exit_lane;
     }
 
@@ -1653,6 +1937,7 @@ read_data:
   
         pollagain = FALSE;
         memcpy(pipebuf, rg->ptr, bufsz);
+        plugin_pipe_ring_release(status);
         rg->ptr += bufsz;
       }
 #ifdef WITH_RABBITMQ
@@ -1750,8 +2035,8 @@ expiry_check:
        * out first and immediately reprocess to evict them
        */
       if (flowtrack.num_flows > max_flows) {
-	force_expire(&flowtrack, flowtrack.num_flows - max_flows);
-	goto expiry_check;
+	if (force_expire(&flowtrack, flowtrack.num_flows - max_flows) > 0)
+	  goto expiry_check;
       }
     }
   }
@@ -33,8 +33,6 @@
 #define _SOFTFLOWD_H
 
 #include "common.h"
-#include "sys-tree.h"
-#include "treetype.h"
 
 /* User to setuid to and directory to chroot to when we drop privs */
 #ifndef PRIVDROP_USER
@@ -68,6 +66,22 @@
  */
 #define DEFAULT_MAX_FLOWS	8192
 
+/*
+ * Flow table and timer wheel geometry. Flows are carved out of slabs of
+ * FLOW_SLAB_ENTRIES; the wheel has EXPIRY_WHEEL_LEVELS levels of
+ * EXPIRY_WHEEL_SLOTS one-second granular slots each (~194 days range).
+ * A single expiry pass evicts at most EXPIRY_BATCH flows.
+ */
+#define FLOW_SLAB_ENTRIES	1024
+#define FLOW_HASH_MIN_SIZE	1024
+#define EXPIRY_WHEEL_BITS	6
+#define EXPIRY_WHEEL_SLOTS	(1 << EXPIRY_WHEEL_BITS)
+#define EXPIRY_WHEEL_MASK	(EXPIRY_WHEEL_SLOTS - 1)
+#define EXPIRY_WHEEL_LEVELS	4
+#define EXPIRY_WHEEL_MAX_DELTA	((1U << (EXPIRY_WHEEL_BITS * EXPIRY_WHEEL_LEVELS)) - 1)
+#define EXPIRY_IMMEDIATE	EXPIRY_WHEEL_LEVELS
+#define EXPIRY_BATCH		8192
+
 /* Return values from process_packet */
 #define PP_OK           0
 #define PP_BAD_PACKET   -2
@@ -78,15 +92,61 @@ struct STATISTIC {
 	double min, mean, max;
 };
 
+/*
+ * Open-addressing (linear probing) table of active flows. The full
+ * hash is cached next to the pointer so that most probes are resolved
+ * without touching the flow itself.
+ */
+struct FLOW_HASH_SLOT {
+	u_int32_t hash;
+	struct FLOW *flow;
+};
+
+struct FLOW_TABLE {
+	struct FLOW_HASH_SLOT *slots;
+	u_int32_t size;				/* Always a power of two */
+	u_int32_t count;
+	u_int32_t seed;
+};
+
+/* Slab allocator for flows; never returns memory to the system */
+struct FLOW_SLAB {
+	struct FLOW_SLAB *next;
+	struct FLOW *flows;
+};
+
+struct FLOW_POOL {
+	struct FLOW_SLAB *slabs;
+	struct FLOW *free_list;
+	u_int32_t allocated;
+};
+
+/*
+ * Hierarchical timer wheel of expiry events. "clk" is the next second
+ * to be processed: level n slots are cascaded into the lower levels as
+ * "clk" crosses their boundary. Flows scheduled for immediate disposal
+ * are kept aside on their own list.
+ */
+struct EXPIRY_WHEEL {
+	struct EXPIRY *slot[EXPIRY_WHEEL_LEVELS][EXPIRY_WHEEL_SLOTS];
+	u_int64_t bitmap[EXPIRY_WHEEL_LEVELS];	/* Non-empty slots */
+	struct EXPIRY *immediate;
+	u_int32_t num_immediate;
+	u_int32_t count;			/* Scheduled, excl. immediate */
+	u_int32_t clk;
+};
+
 /*
  * This structure is the root of the flow tracking system.
- * It holds the root of the tree of active flows and the head of the
- * tree of expiry events. It also collects miscellaneous statistics
+ * It holds the table of active flows and the timer wheel of expiry
+ * events. It also collects miscellaneous statistics
  */
 struct FLOWTRACK {
 	/* The flows and their expiry events */
-	FLOW_HEAD(FLOWS, FLOW) flows;		/* Top of flow tree */
-	EXPIRY_HEAD(EXPIRIES, EXPIRY) expiries;	/* Top of expiries tree */
+	struct FLOW_TABLE flows;		/* Active flows */
+	struct FLOW_POOL pool;			/* Flow slabs */
+	struct EXPIRY_WHEEL expiries;		/* Expiry events */
+	struct FLOW **expired_flows;		/* EXPIRY_BATCH flows to export */
 
 	unsigned int num_flows;			/* # of active flows */
 	u_int64_t next_flow_seq;		/* Next flow ID */
@@ -139,7 +199,33 @@ struct FLOWTRACK {
 };
 
 /*
- * This structure is an entry in the tree of flows that we are 
+ * This is an entry in the timer wheel of expiry events. The wheel is used
+ * to avoid traversing the whole table of active flows looking for ones to
+ * expire. "expires_at" is the time at which the flow should be discarded,
+ * or zero if it is scheduled for immediate disposal. 
+ *
+ * When a flow which hasn't been scheduled for immediate expiry registers 
+ * traffic, it is unlinked from its current wheel slot and re-linked
+ * (subject to its updated timeout).
+ *
+ * Expiry scans operate by advancing the wheel up to now and expiring
+ * the entries of each slot the wheel goes past
+ */
+struct EXPIRY {
+	struct EXPIRY *next, **pprev;		/* Wheel slot list */
+	struct FLOW *flow;			/* pointer to flow */
+	u_int8_t level;				/* Wheel level or EXPIRY_IMMEDIATE */
+	u_int8_t slot;
+
+	u_int32_t expires_at;			/* time_t */
+	enum { 
+		R_GENERAL, R_TCP, R_TCP_RST, R_TCP_FIN, R_UDP, R_ICMP, 
+		R_MAXLIFE, R_OVERBYTES, R_OVERFLOWS, R_FLUSH
+	} reason;
+};
+
+/*
+ * This structure is an entry in the table of flows that we are 
  * currently tracking. 
  *
  * Because flows are matched _bi-directionally_, they must be stored in
@@ -148,8 +234,10 @@ struct FLOWTRACK {
  */
 struct FLOW {
 	/* Housekeeping */
-	struct EXPIRY *expiry;			/* Pointer to expiry record */
-	FLOW_ENTRY(FLOW) trp;			/* Tree pointer */
+	struct EXPIRY expiry;			/* Expiry record */
+	struct FLOW *next_free;			/* Slab free list */
+	u_int32_t hash;				/* Flow identity hash */
+	u_int8_t hashed;			/* Linked in the flow table */
 
 	/* Flow identity (all are in network byte order) */
 	int af;					/* Address family of flow */
@@ -203,31 +291,6 @@ struct FLOW {
 	struct pkt_vlen_hdr_primitives *pvlen[2]; 	/* space for vlen primitives */
 };
 
-/*
- * This is an entry in the tree of expiry events. The tree is used to 
- * avoid traversion the whole tree of active flows looking for ones to
- * expire. "expires_at" is the time at which the flow should be discarded,
- * or zero if it is scheduled for immediate disposal. 
- *
- * When a flow which hasn't been scheduled for immediate expiry registers 
- * traffic, it is deleted from its current position in the tree and 
- * re-inserted (subject to its updated timeout).
- *
- * Expiry scans operate by starting at the head of the tree and expiring
- * each entry with expires_at < now
- * 
- */
-struct EXPIRY {
-	EXPIRY_ENTRY(EXPIRY) trp;		/* Tree pointer */
-	struct FLOW *flow;			/* pointer to flow */
-
-	u_int32_t expires_at;			/* time_t */
-	enum { 
-		R_GENERAL, R_TCP, R_TCP_RST, R_TCP_FIN, R_UDP, R_ICMP, 
-		R_MAXLIFE, R_OVERBYTES, R_OVERFLOWS, R_FLUSH
-	} reason;
-};
-
 /* Prototype for functions shared from softflowd.c */
 u_int32_t timeval_sub_ms(const struct timeval *t1, const struct timeval *t2);
 
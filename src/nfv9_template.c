@@ -27,6 +27,7 @@
 #include "addr.h"
 #include "nfacctd.h"
 #include "pmacct-data.h"
+#include "jhash.h"
 
 struct template_cache_entry *handle_template(struct template_hdr_v9 *hdr, struct packet_ptrs *pptrs, u_int16_t tpl_type,
 						u_int32_t sid, u_int16_t *pens, u_int16_t len, u_int32_t seq)
@@ -55,48 +56,249 @@ struct template_cache_entry *handle_template(struct template_hdr_v9 *hdr, struct
   return tpl;
 }
 
-struct template_cache_entry *find_template(u_int16_t id, struct host_addr *agent, u_int16_t tpl_type, u_int32_t sid)
+void init_template_cache()
 {
-  struct template_cache_entry *ptr;
-  u_int16_t modulo = (ntohs(id)%tpl_cache.num);
+  memset(&tpl_cache, 0, sizeof(tpl_cache));
+
+  tpl_cache.num = TEMPLATE_CACHE_ENTRIES;
+  tpl_cache.c = calloc(tpl_cache.num, sizeof(struct template_cache_entry *));
+  tpl_cache.miss = calloc(TEMPLATE_CACHE_MISS_ENTRIES, sizeof(struct template_cache_miss));
+
+  if (!tpl_cache.c || !tpl_cache.miss) {
+    Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate the Template Cache. Exiting.\n", config.name);
+    exit(1);
+  }
+}
+
+/* IPv4-mapped IPv6 agents hash as their IPv4 counterpart so to stay
+   consistent with sa_addr_cmp() */
+u_int32_t template_cache_hash(struct host_addr *agent, u_int32_t sid, u_int16_t id)
+{
+  u_int32_t addr_key = 0;
+
+  if (agent->family == AF_INET) addr_key = agent->address.ipv4.s_addr;
+#if defined ENABLE_IPV6
+  else if (agent->family == AF_INET6) {
+    u_int32_t *addr6 = (u_int32_t *) &agent->address.ipv6;
 
-  ptr = tpl_cache.c[modulo];
+    if (IN6_IS_ADDR_V4MAPPED(&agent->address.ipv6)) addr_key = addr6[3];
+    else addr_key = jhash2(addr6, 4, 0);
+  }
+#endif
 
+  return jhash_3words(addr_key, sid, id, 0);
+}
+
+static struct template_cache_entry *template_cache_chain_find(struct template_cache_entry *ptr, u_int32_t hash,
+					u_int16_t id, u_int32_t sid, struct host_addr *agent)
+{
   while (ptr) {
-    if ((ptr->template_id == id) && (!sa_addr_cmp((struct sockaddr *)agent, &ptr->agent)) &&
-	(ptr->source_id == sid))
+    if ((ptr->hash == hash) && (ptr->template_id == id) && (ptr->source_id == sid) &&
+	(!sa_addr_cmp((struct sockaddr *)agent, &ptr->agent)))
       return ptr;
-    else ptr = ptr->next;
+    else {
+      tpl_cache.collisions++;
+      ptr = ptr->next;
+    }
   }
 
   return NULL;
 }
 
+struct template_cache_entry *find_template(u_int16_t id, struct host_addr *agent, u_int16_t tpl_type, u_int32_t sid)
+{
+  struct template_cache_entry *ptr;
+  struct template_cache_miss *miss;
+  struct host_addr a;
+  u_int32_t hash;
+  u_int16_t port;
+
+  memset(&a, 0, sizeof(a));
+  sa_to_addr((struct sockaddr *)agent, &a, &port);
+  hash = template_cache_hash(&a, sid, id);
+
+  tpl_cache.lookups++;
+
+  if (tpl_cache.old) template_cache_rehash_step();
+
+  /* known to be missing: no need to walk the chain */
+  miss = &tpl_cache.miss[hash % TEMPLATE_CACHE_MISS_ENTRIES];
+  if (miss->count && miss->hash == hash && miss->template_id == id &&
+      miss->source_id == sid && !memcmp(&miss->agent, &a, sizeof(struct host_addr))) {
+    tpl_cache.neg_hits++;
+    tpl_cache.misses++;
+    return NULL;
+  }
+
+  ptr = template_cache_chain_find(tpl_cache.c[hash & (tpl_cache.num-1)], hash, id, sid, agent);
+  if (!ptr && tpl_cache.old)
+    ptr = template_cache_chain_find(tpl_cache.old[hash & (tpl_cache.old_num-1)], hash, id, sid, agent);
+
+  if (!ptr) tpl_cache.misses++;
+
+  return ptr;
+}
+
+/* Links a new entry in the cache; entries are expected to have 'agent',
+   'source_id' and 'template_id' already set */
+void template_cache_link(struct template_cache_entry *ptr)
+{
+  struct template_cache_miss *miss;
+  u_int32_t modulo;
+
+  ptr->hash = template_cache_hash(&ptr->agent, ptr->source_id, ptr->template_id);
+  modulo = (ptr->hash & (tpl_cache.num-1));
+  ptr->next = tpl_cache.c[modulo];
+  tpl_cache.c[modulo] = ptr;
+  tpl_cache.entries++;
+
+  miss = &tpl_cache.miss[ptr->hash % TEMPLATE_CACHE_MISS_ENTRIES];
+  if (miss->count && miss->hash == ptr->hash && miss->template_id == ptr->template_id &&
+      miss->source_id == ptr->source_id && !memcmp(&miss->agent, &ptr->agent, sizeof(struct host_addr))) {
+    char agent_addr[INET6_ADDRSTRLEN];
+
+    addr_to_str(agent_addr, &ptr->agent);
+    Log(LOG_DEBUG, "DEBUG ( %s/core ): Template %u [%s:%u] received after %u Data Flowsets were discarded\n",
+	config.name, ntohs(ptr->template_id), agent_addr, ptr->source_id, miss->count);
+    memset(miss, 0, sizeof(struct template_cache_miss));
+  }
+
+  if (tpl_cache.old) template_cache_rehash_step();
+  else if (tpl_cache.entries > (tpl_cache.num * TEMPLATE_CACHE_LOAD_FACTOR) && tpl_cache.num < TEMPLATE_CACHE_MAX_ENTRIES)
+    template_cache_resize(tpl_cache.num * 2);
+}
+
+/* Starts growing the cache to 'num' buckets: new entries go to the new
+   buckets straight away while the old ones are moved over a few at a
+   time, by template_cache_rehash_step(), so that no single packet pays
+   for rehashing the whole cache */
+void template_cache_resize(u_int32_t num)
+{
+  struct template_cache_entry **c;
+
+  if (tpl_cache.old) return;
+
+  c = calloc(num, sizeof(struct template_cache_entry *));
+  if (!c) {
+    Log(LOG_WARNING, "WARN ( %s/core ): Unable to grow the Template Cache to %u buckets.\n", config.name, num);
+    return;
+  }
+
+  tpl_cache.old = tpl_cache.c;
+  tpl_cache.old_num = tpl_cache.num;
+  tpl_cache.old_idx = 0;
+
+  tpl_cache.c = c;
+  tpl_cache.num = num;
+  tpl_cache.resizes++;
+
+  Log(LOG_DEBUG, "DEBUG ( %s/core ): Template Cache resizing to %u buckets (%u entries)\n", config.name, num, tpl_cache.entries);
+}
+
+void template_cache_rehash_step()
+{
+  struct template_cache_entry *ptr, *next;
+  u_int32_t step, modulo;
+
+  for (step = 0; step < TEMPLATE_CACHE_REHASH_STEP && tpl_cache.old_idx < tpl_cache.old_num; step++, tpl_cache.old_idx++) {
+    for (ptr = tpl_cache.old[tpl_cache.old_idx]; ptr; ptr = next) {
+      next = ptr->next;
+      modulo = (ptr->hash & (tpl_cache.num-1));
+      ptr->next = tpl_cache.c[modulo];
+      tpl_cache.c[modulo] = ptr;
+    }
+
+    tpl_cache.old[tpl_cache.old_idx] = NULL;
+  }
+
+  if (tpl_cache.old_idx == tpl_cache.old_num) {
+    free(tpl_cache.old);
+    tpl_cache.old = NULL;
+    tpl_cache.old_num = 0;
+    tpl_cache.old_idx = 0;
+  }
+}
+
+/* Accounts for a Data Flowset whose template is not known yet and enters
+   it in the negative cache checked by find_template(); returns TRUE if
+   the miss is worth logging, ie. the first one seen for the
+   (agent, source_id, template_id) tuple or once every
+   TEMPLATE_CACHE_MISS_LOG_INTERVAL secs */
+int template_cache_miss(u_int16_t id, struct sockaddr *agent, u_int32_t sid)
+{
+  struct template_cache_miss *miss;
+  struct host_addr a;
+  u_int32_t hash;
+  u_int16_t port;
+  time_t now;
+
+  memset(&a, 0, sizeof(a));
+  sa_to_addr(agent, &a, &port);
+  hash = template_cache_hash(&a, sid, id);
+  miss = &tpl_cache.miss[hash % TEMPLATE_CACHE_MISS_ENTRIES];
+
+  if (!miss->count || miss->hash != hash || miss->template_id != id ||
+      miss->source_id != sid || memcmp(&miss->agent, &a, sizeof(struct host_addr))) {
+    memcpy(&miss->agent, &a, sizeof(struct host_addr));
+    miss->hash = hash;
+    miss->source_id = sid;
+    miss->template_id = id;
+    miss->count = 0;
+    miss->stamp = 0;
+  }
+
+  miss->count++;
+  now = time(NULL);
+
+  if (now >= miss->stamp + TEMPLATE_CACHE_MISS_LOG_INTERVAL) {
+    miss->stamp = now;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+void free_template_entry(struct template_cache_entry *ptr)
+{
+  if (ptr) {
+    if (ptr->ext_db) free(ptr->ext_db);
+    if (ptr->list) free(ptr->list);
+    if (ptr->prog) free(ptr->prog);
+    free(ptr);
+  }
+}
+
+void print_template_cache_stats(time_t now)
+{
+  Log(LOG_NOTICE, "NOTICE ( %s/%s ): Template cache entries: %u buckets: %u resizes: %u (%u)\n",
+	config.name, config.type, tpl_cache.entries, tpl_cache.num, tpl_cache.resizes, now);
+  Log(LOG_NOTICE, "NOTICE ( %s/%s ): Template cache lookups: %llu misses: %llu (negative cache: %llu) collisions: %llu\n",
+	config.name, config.type, (unsigned long long)tpl_cache.lookups, (unsigned long long)tpl_cache.misses,
+	(unsigned long long)tpl_cache.neg_hits, (unsigned long long)tpl_cache.collisions);
+}
+
 struct template_cache_entry *insert_template(struct template_hdr_v9 *hdr, struct packet_ptrs *pptrs, u_int16_t tpl_type,
 						u_int32_t sid, u_int16_t *pens, u_int8_t version, u_int16_t len, u_int32_t seq)
 {
-  struct template_cache_entry *ptr, *prevptr = NULL;
+  struct template_cache_entry *ptr;
   struct template_field_v9 *field;
-  u_int16_t modulo = (ntohs(hdr->template_id)%tpl_cache.num), count;
-  u_int16_t num = ntohs(hdr->num), type, port, off;
+  u_int16_t count, num = ntohs(hdr->num), type, port, off;
   u_int32_t *pen;
   u_int8_t ipfix_ebit;
   u_char *tpl;
 
-  ptr = tpl_cache.c[modulo];
-
-  while (ptr) {
-    prevptr = ptr;
-    ptr = ptr->next;
+  ptr = malloc(sizeof(struct template_cache_entry));
+  if (ptr) {
+    memset(ptr, 0, sizeof(struct template_cache_entry));
+    ptr->list = calloc(num ? num : 1, sizeof(struct tpl_field_list));
   }
 
-  ptr = malloc(sizeof(struct template_cache_entry));
-  if (!ptr) {
+  if (!ptr || !ptr->list) {
     Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate enough memory for a new Template Cache Entry.\n", config.name);
+    free_template_entry(ptr);
     return NULL;
   }
 
-  memset(ptr, 0, sizeof(struct template_cache_entry));
   sa_to_addr((struct sockaddr *)pptrs->f_agent, &ptr->agent, &port);
   ptr->source_id = sid;
   ptr->template_id = hdr->template_id;
@@ -116,7 +318,7 @@ struct template_cache_entry *insert_template(struct template_hdr_v9 *hdr, struct
       notify_malf_packet(LOG_INFO, "INFO: unable to read next Template Flowset (malformed template)",
                         (struct sockaddr *) pptrs->f_agent, seq);
       xflow_tot_bad_datagrams++;
-      free(ptr);
+      free_template_entry(ptr);
       return NULL;
     }
 
@@ -191,8 +393,8 @@ struct template_cache_entry *insert_template(struct template_hdr_v9 *hdr, struct
     field++;
   }
 
-  if (prevptr) prevptr->next = ptr;
-  else tpl_cache.c[modulo] = ptr;
+  NF_compile_template(ptr);
+  template_cache_link(ptr);
 
   log_template_footer(ptr, ptr->len, version);
 
@@ -207,11 +409,11 @@ struct template_cache_entry *insert_template(struct template_hdr_v9 *hdr, struct
 #ifdef WITH_JANSSON
 void load_templates_from_file(char *path)
 {
-  struct template_cache_entry *tpl, *prev_ptr = NULL, *ptr = NULL;
+  struct template_cache_entry *tpl;
+  struct sockaddr_storage agent;
   FILE *tmp_file = fopen(path, "r");
   char errbuf[SRVBUFLEN], tmpbuf[LARGEBUFLEN];
   int line = 1;
-  u_int16_t modulo;
 
   if (!tmp_file) {
     Log(LOG_ERR, "ERROR ( %s/core ): [%s] load_templates_from_file(): unable to fopen(). File skipped.\n",
@@ -227,26 +429,22 @@ void load_templates_from_file(char *path)
     }
     else {
       /* We assume the cache is empty when templates are loaded */
-      if (find_template(tpl->template_id, &tpl->agent, tpl->template_type, tpl->source_id))
+      memset(&agent, 0, sizeof(agent));
+      addr_to_sa((struct sockaddr *) &agent, &tpl->agent, 0);
+
+      if (find_template(tpl->template_id, (struct host_addr *) &agent, tpl->template_type, tpl->source_id)) {
         Log(LOG_DEBUG, "WARN ( %s/core ): Template %u already exists in cache. Skipping\n",
                 config.name, tpl->template_id);
+        free_template_entry(tpl);
+      }
       else {
-        modulo = (ntohs(tpl->template_id)%tpl_cache.num);
-        ptr = tpl_cache.c[modulo];
-
-        while (ptr) {
-          prev_ptr = ptr;
-          ptr = ptr->next;
-        }
-
-        if (prev_ptr) prev_ptr->next = tpl;
-        else tpl_cache.c[modulo] = tpl;
+        NF_compile_template(tpl);
+        template_cache_link(tpl);
 
         Log(LOG_DEBUG, "DEBUG ( %s/core ): Loaded template %u into cache.\n", config.name, tpl->template_id);
       }
     }
 
-    prev_ptr = NULL;
     line++;
   }
 
@@ -536,6 +734,14 @@ struct template_cache_entry *nfacctd_offline_read_json_template(char *buf, char
       }
       else ret->num = json_integer_value(json_num);
 
+      if (ret->template_type == 0) {
+        ret->list = calloc(ret->num ? ret->num : 1, sizeof(struct tpl_field_list));
+        if (!ret->list) {
+          snprintf(errbuf, errlen, "nfacctd_offline_read_json_template(): Unable to allocate enough memory for a new Template Cache Entry.\n");
+	  goto exit_lane;
+        }
+      }
+
       json_len = json_object_get(json_obj, "len");
       if (json_len == NULL) {
         snprintf(errbuf, errlen, "nfacctd_offline_read_json_template(): len null. Line skipped.\n");
@@ -570,6 +776,11 @@ struct template_cache_entry *nfacctd_offline_read_json_template(char *buf, char
           int idx = 0;
 
           json_array_foreach(json_list, key, value) {
+            if (idx >= ret->num) {
+              snprintf(errbuf, errlen, "nfacctd_offline_read_json_template(): too many template fields. Line skipped.\n");
+	      goto exit_lane;
+            }
+
             if (json_integer_value(json_object_get(value, "type")) == TPL_TYPE_LEGACY) {
 	      json_t *json_otpl = NULL, *json_otpl_member = NULL;
 	      struct otpl_field otpl;
@@ -680,6 +891,12 @@ struct template_cache_entry *nfacctd_offline_read_json_template(char *buf, char
               }
               else ie_idx = json_integer_value(json_utpl_member);
 
+              if (!ret->ext_db) ret->ext_db = calloc(TPL_EXT_DB_ENTRIES, sizeof(struct tpl_field_db));
+              if (!ret->ext_db || ie_idx < 0 || ie_idx >= IES_PER_TPL_EXT_DB_ENTRY) {
+                snprintf(errbuf, errlen, "nfacctd_offline_read_json_template(): invalid ie_idx. Line skipped.\n");
+	        goto exit_lane;
+              }
+
               modulo = (utpl.type%TPL_EXT_DB_ENTRIES);
               memcpy(&ret->ext_db[modulo].ie[ie_idx], &utpl, sizeof(struct utpl_field));
               ret->list[idx].ptr = (char *) &ret->ext_db[modulo].ie[ie_idx];
@@ -744,7 +961,7 @@ struct template_cache_entry *nfacctd_offline_read_json_template(char *buf, char
 
   exit_lane:
   json_decref(json_obj);
-  if (ret) free(ret);
+  free_template_entry(ret);
 
   return NULL;
 }
@@ -788,8 +1005,16 @@ struct template_cache_entry *refresh_template(struct template_hdr_v9 *hdr, struc
   tpl->template_id = hdr->template_id;
   tpl->template_type = 0;
   tpl->num = num;
+  tpl->hash = backup.hash;
   tpl->next = next;
 
+  tpl->list = calloc(num ? num : 1, sizeof(struct tpl_field_list));
+  if (!tpl->list) {
+    Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate enough memory to refresh a Template Cache Entry.\n", config.name);
+    memcpy(tpl, &backup, sizeof(struct template_cache_entry));
+    return NULL;
+  }
+
   log_template_header(tpl, pptrs, tpl_type, sid, version);
 
   count = off = 0;
@@ -803,6 +1028,8 @@ struct template_cache_entry *refresh_template(struct template_hdr_v9 *hdr, struc
       notify_malf_packet(LOG_INFO, "INFO: unable to read next Template Flowset (malformed template)",
                         (struct sockaddr *) pptrs->f_agent, seq);
       xflow_tot_bad_datagrams++;
+      if (tpl->ext_db) free(tpl->ext_db);
+      free(tpl->list);
       memcpy(tpl, &backup, sizeof(struct template_cache_entry));
       return NULL;
     }
@@ -873,6 +1100,12 @@ struct template_cache_entry *refresh_template(struct template_hdr_v9 *hdr, struc
     field++;
   }
 
+  if (backup.ext_db) free(backup.ext_db);
+  if (backup.list) free(backup.list);
+  if (backup.prog) free(backup.prog);
+
+  NF_compile_template(tpl);
+
   log_template_footer(tpl, tpl->len, version);
 
 #ifdef WITH_JANSSON
@@ -957,33 +1190,24 @@ struct template_cache_entry *insert_opt_template(void *hdr, struct packet_ptrs *
 {
   struct options_template_hdr_v9 *hdr_v9 = (struct options_template_hdr_v9 *) hdr;
   struct options_template_hdr_ipfix *hdr_v10 = (struct options_template_hdr_ipfix *) hdr;
-  struct template_cache_entry *ptr, *prevptr = NULL;
+  struct template_cache_entry *ptr;
   struct template_field_v9 *field;
-  u_int16_t modulo, count, slen, olen, type, port, tid, off;
+  u_int16_t count, slen, olen, type, port, tid, off;
   u_char *tpl;
 
   /* NetFlow v9 */
   if (tpl_type == 1) {
-    modulo = ntohs(hdr_v9->template_id)%tpl_cache.num;
     tid = hdr_v9->template_id;
     slen = ntohs(hdr_v9->scope_len)/sizeof(struct template_field_v9);
     olen = ntohs(hdr_v9->option_len)/sizeof(struct template_field_v9);
   }
   /* IPFIX */
   else if (tpl_type == 3) {
-    modulo = ntohs(hdr_v10->template_id)%tpl_cache.num;
     tid = hdr_v10->template_id;
     slen = ntohs(hdr_v10->scope_count);
     olen = ntohs(hdr_v10->option_count)-slen;
   }
 
-  ptr = tpl_cache.c[modulo];
-
-  while (ptr) {
-    prevptr = ptr;
-    ptr = ptr->next;
-  }
-
   ptr = malloc(sizeof(struct template_cache_entry));
   if (!ptr) {
     Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate enough memory for a new Options Template Cache Entry.\n", config.name);
@@ -1011,7 +1235,7 @@ struct template_cache_entry *insert_opt_template(void *hdr, struct packet_ptrs *
       notify_malf_packet(LOG_INFO, "INFO: unable to read next Options Template Flowset (malformed template)",
                         (struct sockaddr *) pptrs->f_agent, seq);
       xflow_tot_bad_datagrams++;
-      free(ptr);
+      free_template_entry(ptr);
       return NULL;
     }
 
@@ -1029,8 +1253,7 @@ struct template_cache_entry *insert_opt_template(void *hdr, struct packet_ptrs *
     off += NfTplFieldV9Sz;
   }
 
-  if (prevptr) prevptr->next = ptr;
-  else tpl_cache.c[modulo] = ptr;
+  template_cache_link(ptr);
 
   log_template_footer(ptr, ptr->len, version);
 
@@ -1073,6 +1296,7 @@ struct template_cache_entry *refresh_opt_template(void *hdr, struct template_cac
   tpl->template_id = tid;
   tpl->template_type = 1;
   tpl->num = olen+slen;
+  tpl->hash = backup.hash;
   tpl->next = next;
 
   log_template_header(tpl, pptrs, tpl_type, sid, version);  
@@ -1107,6 +1331,11 @@ struct template_cache_entry *refresh_opt_template(void *hdr, struct template_cac
     off += NfTplFieldV9Sz;
   }
 
+  /* a template ID may have moved from data to options */
+  if (backup.ext_db) free(backup.ext_db);
+  if (backup.list) free(backup.list);
+  if (backup.prog) free(backup.prog);
+
   log_template_footer(tpl, tpl->len, version);
 
 #ifdef WITH_JANSSON
@@ -1189,6 +1418,8 @@ struct utpl_field *ext_db_get_ie(struct template_cache_entry *ptr, u_int32_t pen
   u_int16_t ie_idx, ext_db_modulo = (type%TPL_EXT_DB_ENTRIES);
   struct utpl_field *ext_db_ptr = NULL;
 
+  if (!ptr->ext_db) return NULL;
+
   for (ie_idx = 0; ie_idx < IES_PER_TPL_EXT_DB_ENTRY; ie_idx++) {
     if (ptr->ext_db[ext_db_modulo].ie[ie_idx].type == type &&
 	ptr->ext_db[ext_db_modulo].ie[ie_idx].pen == pen &&
@@ -1208,6 +1439,11 @@ struct utpl_field *ext_db_get_next_ie(struct template_cache_entry *ptr, u_int16_
 
   (*repeat_id) = 0;
 
+  if (!ptr->ext_db) {
+    ptr->ext_db = calloc(TPL_EXT_DB_ENTRIES, sizeof(struct tpl_field_db));
+    if (!ptr->ext_db) return NULL;
+  }
+
   for (ie_idx = 0; ie_idx < IES_PER_TPL_EXT_DB_ENTRY; ie_idx++) {
     if (ptr->ext_db[ext_db_modulo].ie[ie_idx].type == type) (*repeat_id)++;
 
@@ -88,6 +88,10 @@ void pcap_cb(u_char *user, const struct pcap_pkthdr *pkthdr, const u_char *buf)
         if (config.nfacctd_isis) {
           isis_srcdst_lookup(&pptrs);
         }
+
+        /* RIB nodes and paths looked up stay valid till exec_plugins() returns */
+        if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_rib_read_begin();
+
         if (config.nfacctd_bgp) {
           BTA_find_id((struct id_table *)pptrs.bta_table, &pptrs, &pptrs.bta, &pptrs.bta2);
           bgp_srcdst_lookup(&pptrs, FUNC_TYPE_BGP);
@@ -102,6 +106,8 @@ void pcap_cb(u_char *user, const struct pcap_pkthdr *pkthdr, const u_char *buf)
 
 	set_index_pkt_ptrs(&pptrs);
         exec_plugins(&pptrs, &req);
+
+        if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_rib_read_end();
       }
     }
   }
@@ -388,7 +394,7 @@ int PM_find_id(struct id_table *t, struct packet_ptrs *pptrs, pm_id_t *tag, pm_i
 
     for (iterator = 0; index_results[iterator] && iterator < ID_TABLE_INDEX_RESULTS; iterator++) {
       ret = pretag_entry_process(index_results[iterator], pptrs, tag, tag2);
-      if (!(ret & PRETAG_MAP_RCODE_JEQ)) return ret;
+      if ((!ret || ret > TRUE) && !(ret & PRETAG_MAP_RCODE_JEQ)) return ret;
     }
 
     /* if we have at least one index we trust we did a good job */
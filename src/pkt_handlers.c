@@ -857,6 +857,8 @@ void evaluate_packet_handlers()
       primitives++;
     }
 
+    if (config.acct_type == ACCT_NF) NF_tpl_prog_setup(&channels_list[index]);
+
     index++;
   }
 
@@ -1443,6 +1445,246 @@ void custom_primitives_handler(struct channels_list_entry *chptr, struct packet_
   }
 }
 
+/*
+ * NetFlow v9/IPFIX compiled templates: the simplest primitives, ie. those
+ * which are a plain copy of one field out of a fixed-length data record,
+ * are pulled out of the handlers chain and decoded by running a per-template
+ * list of (offset, length, destination, conversion) built when the template
+ * is inserted or refreshed. NetFlow v5/v8 and variable-length templates
+ * keep going through the original handlers.
+ */
+void NF_tpl_prog_setup(struct channels_list_entry *chptr)
+{
+  struct {
+    pkt_handler handler;
+    u_int32_t mask;
+  } supported[] = {
+#if defined (HAVE_L2)
+    { NF_src_mac_handler, TPL_PROG_SRC_MAC },
+    { NF_dst_mac_handler, TPL_PROG_DST_MAC },
+    { NF_cos_handler, TPL_PROG_COS },
+#endif
+    { NF_src_host_handler, TPL_PROG_SRC_HOST },
+    { NF_dst_host_handler, TPL_PROG_DST_HOST },
+    { NF_src_port_handler, TPL_PROG_SRC_PORT },
+    { NF_dst_port_handler, TPL_PROG_DST_PORT },
+    { NF_ip_proto_handler, TPL_PROG_IP_PROTO },
+    { NF_tcp_flags_handler, TPL_PROG_TCP_FLAGS },
+    { NF_in_iface_handler, TPL_PROG_IN_IFACE },
+    { NF_out_iface_handler, TPL_PROG_OUT_IFACE },
+    { NULL, 0 }
+  };
+  int src, dst, fallback = 0, idx;
+
+  chptr->tpl_prog_mask = 0;
+  memset(chptr->tpl_prog_fallback, 0, sizeof(chptr->tpl_prog_fallback));
+
+  /* channels get compacted as plugins die: the position at startup is
+     kept as the slot of the channel in template programs */
+  chptr->tpl_prog_idx = (chptr - channels_list);
+
+  for (src = 0, dst = 0; chptr->phandler[src]; src++) {
+    for (idx = 0; supported[idx].handler; idx++) {
+      if (chptr->phandler[src] == supported[idx].handler) break;
+    }
+
+    if (supported[idx].handler && fallback < (MAX_TPL_PROG_HANDLERS-1)) {
+      /* the compiled template takes the place of the first handler it replaces */
+      if (!chptr->tpl_prog_mask) chptr->phandler[dst++] = NF_tpl_prog_handler;
+
+      chptr->tpl_prog_mask |= supported[idx].mask;
+      chptr->tpl_prog_fallback[fallback++] = supported[idx].handler;
+    }
+    else chptr->phandler[dst++] = chptr->phandler[src];
+  }
+
+  for (; dst < src; dst++) chptr->phandler[dst] = NULL;
+}
+
+void NF_tpl_prog_handler(struct channels_list_entry *chptr, struct packet_ptrs *pptrs, char **data)
+{
+  struct struct_header_v8 *hdr = (struct struct_header_v8 *) pptrs->f_header;
+  struct template_cache_entry *tpl = (struct template_cache_entry *) pptrs->f_tpl;
+  struct tpl_prog *prog;
+  struct tpl_prog_op *op;
+  struct host_addr *addr;
+  u_char *src, *dst;
+  u_int32_t t32;
+  u_int16_t t16;
+  int idx;
+
+  if ((hdr->version == 9 || hdr->version == 10) && tpl && tpl->prog) {
+    prog = &tpl->prog[chptr->tpl_prog_idx];
+
+    for (idx = 0, op = prog->ops; idx < prog->num; idx++, op++) {
+      src = (u_char *) pptrs->f_data + op->off;
+      dst = (u_char *) (*data) + op->dst;
+
+      switch (op->op) {
+      case TPL_PROG_OP_COPY:
+	memcpy(dst, src, op->len);
+	break;
+      case TPL_PROG_OP_NTOHS:
+	t16 = 0;
+	memcpy(&t16, src, op->len);
+	t16 = ntohs(t16);
+	memcpy(dst, &t16, 2);
+	break;
+      case TPL_PROG_OP_NTOHS_32:
+	memcpy(&t16, src, 2);
+	t32 = ntohs(t16);
+	memcpy(dst, &t32, 4);
+	break;
+      case TPL_PROG_OP_NTOHL:
+	memcpy(&t32, src, 4);
+	t32 = ntohl(t32);
+	memcpy(dst, &t32, 4);
+	break;
+      case TPL_PROG_OP_U8_32:
+	t32 = *src;
+	memcpy(dst, &t32, 4);
+	break;
+      case TPL_PROG_OP_IPV4:
+	if (pptrs->l3_proto == ETHERTYPE_IP || pptrs->flow_type == NF9_FTYPE_NAT_EVENT /* NAT64 case */) {
+	  addr = (struct host_addr *) dst;
+	  memcpy(&addr->address.ipv4, src, op->len);
+	  addr->family = AF_INET;
+	}
+	break;
+#if defined ENABLE_IPV6
+      case TPL_PROG_OP_IPV6:
+	if (pptrs->l3_proto == ETHERTYPE_IPV6 || pptrs->flow_type == NF9_FTYPE_NAT_EVENT /* NAT64 case */) {
+	  addr = (struct host_addr *) dst;
+	  memcpy(&addr->address.ipv6, src, op->len);
+	  addr->family = AF_INET6;
+	}
+	break;
+#endif
+      default:
+	break;
+      }
+    }
+  }
+  else {
+    for (idx = 0; chptr->tpl_prog_fallback[idx]; idx++)
+      (*chptr->tpl_prog_fallback[idx])(chptr, pptrs, data);
+  }
+}
+
+void NF_tpl_prog_add(struct tpl_prog *prog, u_int8_t op, struct otpl_field *field, u_int16_t maxlen, u_int16_t dst)
+{
+  if (prog->num < TPL_PROG_MAX_OPS) {
+    prog->ops[prog->num].off = field->off;
+    prog->ops[prog->num].len = MIN(field->len, maxlen);
+    prog->ops[prog->num].dst = dst;
+    prog->ops[prog->num].op = op;
+    prog->num++;
+  }
+}
+
+/* Mirrors, field by field, what the replaced NF_*_handler() do */
+void NF_compile_template_prog(struct template_cache_entry *tpl, u_int32_t mask, struct tpl_prog *prog)
+{
+  struct otpl_field *f = tpl->tpl;
+
+#if defined (HAVE_L2)
+  if (mask & TPL_PROG_SRC_MAC) {
+    if (f[NF9_IN_SRC_MAC].len) NF_tpl_prog_add(prog, TPL_PROG_OP_COPY, &f[NF9_IN_SRC_MAC], 6, offsetof(struct pkt_data, primitives.eth_shost));
+    else if (f[NF9_OUT_SRC_MAC].len) NF_tpl_prog_add(prog, TPL_PROG_OP_COPY, &f[NF9_OUT_SRC_MAC], 6, offsetof(struct pkt_data, primitives.eth_shost));
+  }
+
+  if (mask & TPL_PROG_DST_MAC) {
+    if (f[NF9_IN_DST_MAC].len) NF_tpl_prog_add(prog, TPL_PROG_OP_COPY, &f[NF9_IN_DST_MAC], 6, offsetof(struct pkt_data, primitives.eth_dhost));
+    else if (f[NF9_OUT_DST_MAC].len) NF_tpl_prog_add(prog, TPL_PROG_OP_COPY, &f[NF9_OUT_DST_MAC], 6, offsetof(struct pkt_data, primitives.eth_dhost));
+  }
+
+  if (mask & TPL_PROG_COS) {
+    if (f[NF9_DOT1QPRIORITY].len) NF_tpl_prog_add(prog, TPL_PROG_OP_COPY, &f[NF9_DOT1QPRIORITY], 1, offsetof(struct pkt_data, primitives.cos));
+  }
+#endif
+
+  if (mask & TPL_PROG_SRC_HOST) {
+    if (f[NF9_IPV4_SRC_ADDR].len) NF_tpl_prog_add(prog, TPL_PROG_OP_IPV4, &f[NF9_IPV4_SRC_ADDR], 4, offsetof(struct pkt_data, primitives.src_ip));
+    else if (f[NF9_IPV4_SRC_PREFIX].len) NF_tpl_prog_add(prog, TPL_PROG_OP_IPV4, &f[NF9_IPV4_SRC_PREFIX], 4, offsetof(struct pkt_data, primitives.src_ip));
+#if defined ENABLE_IPV6
+    if (f[NF9_IPV6_SRC_ADDR].len) NF_tpl_prog_add(prog, TPL_PROG_OP_IPV6, &f[NF9_IPV6_SRC_ADDR], 16, offsetof(struct pkt_data, primitives.src_ip));
+    else if (f[NF9_IPV6_SRC_PREFIX].len) NF_tpl_prog_add(prog, TPL_PROG_OP_IPV6, &f[NF9_IPV6_SRC_PREFIX], 16, offsetof(struct pkt_data, primitives.src_ip));
+#endif
+  }
+
+  if (mask & TPL_PROG_DST_HOST) {
+    if (f[NF9_IPV4_DST_ADDR].len) NF_tpl_prog_add(prog, TPL_PROG_OP_IPV4, &f[NF9_IPV4_DST_ADDR], 4, offsetof(struct pkt_data, primitives.dst_ip));
+    else if (f[NF9_IPV4_DST_PREFIX].len) NF_tpl_prog_add(prog, TPL_PROG_OP_IPV4, &f[NF9_IPV4_DST_PREFIX], 4, offsetof(struct pkt_data, primitives.dst_ip));
+#if defined ENABLE_IPV6
+    if (f[NF9_IPV6_DST_ADDR].len) NF_tpl_prog_add(prog, TPL_PROG_OP_IPV6, &f[NF9_IPV6_DST_ADDR], 16, offsetof(struct pkt_data, primitives.dst_ip));
+    else if (f[NF9_IPV6_DST_PREFIX].len) NF_tpl_prog_add(prog, TPL_PROG_OP_IPV6, &f[NF9_IPV6_DST_PREFIX], 16, offsetof(struct pkt_data, primitives.dst_ip));
+#endif
+  }
+
+  if (mask & TPL_PROG_SRC_PORT) {
+    if (f[NF9_L4_SRC_PORT].len) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHS, &f[NF9_L4_SRC_PORT], 2, offsetof(struct pkt_data, primitives.src_port));
+    else if (f[NF9_UDP_SRC_PORT].len) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHS, &f[NF9_UDP_SRC_PORT], 2, offsetof(struct pkt_data, primitives.src_port));
+    else if (f[NF9_TCP_SRC_PORT].len) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHS, &f[NF9_TCP_SRC_PORT], 2, offsetof(struct pkt_data, primitives.src_port));
+  }
+
+  if (mask & TPL_PROG_DST_PORT) {
+    if (f[NF9_L4_DST_PORT].len) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHS, &f[NF9_L4_DST_PORT], 2, offsetof(struct pkt_data, primitives.dst_port));
+    else if (f[NF9_UDP_DST_PORT].len) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHS, &f[NF9_UDP_DST_PORT], 2, offsetof(struct pkt_data, primitives.dst_port));
+    else if (f[NF9_TCP_DST_PORT].len) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHS, &f[NF9_TCP_DST_PORT], 2, offsetof(struct pkt_data, primitives.dst_port));
+  }
+
+  if (mask & TPL_PROG_IP_PROTO) {
+    if (f[NF9_L4_PROTOCOL].len) NF_tpl_prog_add(prog, TPL_PROG_OP_COPY, &f[NF9_L4_PROTOCOL], 1, offsetof(struct pkt_data, primitives.proto));
+  }
+
+  if (mask & TPL_PROG_TCP_FLAGS) {
+    if (f[NF9_TCP_FLAGS].len == 1) NF_tpl_prog_add(prog, TPL_PROG_OP_U8_32, &f[NF9_TCP_FLAGS], 1, offsetof(struct pkt_data, tcp_flags));
+  }
+
+  if (mask & TPL_PROG_IN_IFACE) {
+    if (f[NF9_INPUT_SNMP].len == 2) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHS_32, &f[NF9_INPUT_SNMP], 2, offsetof(struct pkt_data, primitives.ifindex_in));
+    else if (f[NF9_INPUT_SNMP].len == 4) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHL, &f[NF9_INPUT_SNMP], 4, offsetof(struct pkt_data, primitives.ifindex_in));
+    else if (f[NF9_INPUT_PHYSINT].len == 4) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHL, &f[NF9_INPUT_PHYSINT], 4, offsetof(struct pkt_data, primitives.ifindex_in));
+  }
+
+  if (mask & TPL_PROG_OUT_IFACE) {
+    if (f[NF9_OUTPUT_SNMP].len == 2) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHS_32, &f[NF9_OUTPUT_SNMP], 2, offsetof(struct pkt_data, primitives.ifindex_out));
+    else if (f[NF9_OUTPUT_SNMP].len == 4) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHL, &f[NF9_OUTPUT_SNMP], 4, offsetof(struct pkt_data, primitives.ifindex_out));
+    else if (f[NF9_OUTPUT_PHYSINT].len == 4) NF_tpl_prog_add(prog, TPL_PROG_OP_NTOHL, &f[NF9_OUTPUT_PHYSINT], 4, offsetof(struct pkt_data, primitives.ifindex_out));
+  }
+}
+
+void NF_compile_template(struct template_cache_entry *tpl)
+{
+  int index, num = 0;
+
+  if (tpl->prog) {
+    free(tpl->prog);
+    tpl->prog = NULL;
+  }
+
+  /* variable-length templates get their offsets resolved per record */
+  if (tpl->template_type != 0 || tpl->vlen) return;
+
+  for (index = 0; channels_list[index].aggregation; index++) {
+    if (channels_list[index].tpl_prog_mask && channels_list[index].tpl_prog_idx >= num)
+      num = (channels_list[index].tpl_prog_idx+1);
+  }
+
+  if (!num) return;
+
+  tpl->prog = calloc(num, sizeof(struct tpl_prog));
+  if (!tpl->prog) {
+    Log(LOG_WARNING, "WARN ( %s/core ): Unable to allocate memory to compile template %u.\n", config.name, ntohs(tpl->template_id));
+    return;
+  }
+
+  for (index = 0; channels_list[index].aggregation; index++) {
+    if (channels_list[index].tpl_prog_mask)
+      NF_compile_template_prog(tpl, channels_list[index].tpl_prog_mask, &tpl->prog[channels_list[index].tpl_prog_idx]);
+  }
+}
+
 #if defined (HAVE_L2)
 void NF_src_mac_handler(struct channels_list_entry *chptr, struct packet_ptrs *pptrs, char **data)
 {
@@ -3376,7 +3618,9 @@ void NF_timestamp_arrival_handler(struct channels_list_entry *chptr, struct pack
   struct template_cache_entry *tpl = (struct template_cache_entry *) pptrs->f_tpl;
   struct pkt_nat_primitives *pnat = (struct pkt_nat_primitives *) ((*data) + chptr->extras.off_pkt_nat_primitives);
 
-  gettimeofday(&pnat->timestamp_arrival, NULL);
+  /* batched reception stamps datagrams once per batch */
+  if (config.nfacctd_recv_batch > 1) pnat->timestamp_arrival = pptrs->pkthdr->ts;
+  else gettimeofday(&pnat->timestamp_arrival, NULL);
   if (chptr->plugin->cfg.timestamps_secs) pnat->timestamp_arrival.tv_usec = 0;
 }
 
@@ -3738,6 +3982,7 @@ void NF_class_handler(struct channels_list_entry *chptr, struct packet_ptrs *ppt
         pdata->cst.stamp.tv_sec = ntohl(((struct struct_header_v9 *) pptrs->f_header)->unix_secs)-
            ((ntohl(((struct struct_header_v9 *) pptrs->f_header)->SysUptime)-ntohl(fstime))/1000);
       }
+      else if (config.nfacctd_recv_batch > 1) pdata->cst.stamp.tv_sec = pptrs->pkthdr->ts.tv_sec;
       else pdata->cst.stamp.tv_sec = time(NULL);
       pdata->cst.stamp.tv_usec = 0; 
     }
@@ -5143,7 +5388,8 @@ void SF_timestamp_start_handler(struct channels_list_entry *chptr, struct packet
   struct pkt_nat_primitives *pnat = (struct pkt_nat_primitives *) ((*data) + chptr->extras.off_pkt_nat_primitives);
   SFSample *sample = (SFSample *) pptrs->f_data;
 
-  gettimeofday(&pnat->timestamp_start, NULL);
+  if (config.nfacctd_recv_batch > 1) pnat->timestamp_start = pptrs->pkthdr->ts;
+  else gettimeofday(&pnat->timestamp_start, NULL);
   if (chptr->plugin->cfg.timestamps_secs) pnat->timestamp_start.tv_usec = 0;
 }
 
@@ -5153,7 +5399,8 @@ void SF_timestamp_arrival_handler(struct channels_list_entry *chptr, struct pack
   struct pkt_nat_primitives *pnat = (struct pkt_nat_primitives *) ((*data) + chptr->extras.off_pkt_nat_primitives);
   SFSample *sample = (SFSample *) pptrs->f_data;
 
-  gettimeofday(&pnat->timestamp_arrival, NULL);
+  if (config.nfacctd_recv_batch > 1) pnat->timestamp_arrival = pptrs->pkthdr->ts;
+  else gettimeofday(&pnat->timestamp_arrival, NULL);
   if (chptr->plugin->cfg.timestamps_secs) pnat->timestamp_arrival.tv_usec = 0;
 }
 
@@ -5183,7 +5430,8 @@ void SF_class_handler(struct channels_list_entry *chptr, struct packet_ptrs *ppt
   pdata->cst.pa = 0;
   pdata->cst.fa = 0;
 
-  pdata->cst.stamp.tv_sec = time(NULL); /* XXX */
+  if (config.nfacctd_recv_batch > 1) pdata->cst.stamp.tv_sec = pptrs->pkthdr->ts.tv_sec;
+  else pdata->cst.stamp.tv_sec = time(NULL); /* XXX */
   pdata->cst.stamp.tv_usec = 0;
 }
 
@@ -5586,6 +5834,8 @@ char *lookup_tpl_ext_db(void *entry, u_int32_t pen, u_int16_t type)
   struct template_cache_entry *tpl = (struct template_cache_entry *) entry;
   u_int16_t ie_idx, ext_db_modulo = (type%TPL_EXT_DB_ENTRIES);
 
+  if (!tpl->ext_db) return NULL;
+
   for (ie_idx = 0; ie_idx < IES_PER_TPL_EXT_DB_ENTRY; ie_idx++) {
     if (tpl->ext_db[ext_db_modulo].ie[ie_idx].type == type &&
         tpl->ext_db[ext_db_modulo].ie[ie_idx].pen == pen)
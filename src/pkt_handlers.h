@@ -68,6 +68,8 @@ EXT void sfprobe_payload_handler(struct channels_list_entry *, struct packet_ptr
 EXT void nfprobe_extras_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
 EXT void mpls_vpn_rd_frommap_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
 
+EXT void NF_tpl_prog_setup(struct channels_list_entry *);
+EXT void NF_tpl_prog_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
 EXT void NF_src_mac_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
 EXT void NF_dst_mac_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
 EXT void NF_vlan_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
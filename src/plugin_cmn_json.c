@@ -32,6 +32,268 @@
 
 /* Functions */
 #ifdef WITH_JANSSON
+/*
+ * Direct-to-buffer JSON writer. Output is byte-for-byte what
+ * json_dumps(obj, JSON_PRESERVE_ORDER) produces for the equivalent
+ * jansson object: ", " and ": " separators, jansson's escaping rules
+ * and invalid UTF-8 strings dropped along with their key.
+ */
+#define CJ_KEY(key)			", \"" key "\": "
+#define cj_add_int(jb, key, val)	cj_add_int_key((jb), CJ_KEY(key), sizeof(CJ_KEY(key)) - 1, (long long) (val))
+#define cj_add_uint_str(jb, key, val)	cj_add_uint_str_key((jb), CJ_KEY(key), sizeof(CJ_KEY(key)) - 1, (val))
+#define cj_add_str(jb, key, str)	cj_add_str_key((jb), CJ_KEY(key), sizeof(CJ_KEY(key)) - 1, (str))
+#define cj_add_ip(jb, key, addr)	cj_add_ip_key((jb), CJ_KEY(key), sizeof(CJ_KEY(key)) - 1, (addr))
+#define cj_add_mac(jb, key, mac)	cj_add_mac_key((jb), CJ_KEY(key), sizeof(CJ_KEY(key)) - 1, (mac))
+#define cj_add_tstamp(jb, key, tv, usec)	cj_add_tstamp_key((jb), CJ_KEY(key), sizeof(CJ_KEY(key)) - 1, (tv), (usec))
+
+static const char cj_digits[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static const char cj_hex[] = "0123456789ABCDEF";
+
+/* pre-rendered ', "name": ' prefixes of custom primitives */
+static struct cjbuf cjcp_key[MAX_CUSTOM_PRIMITIVES];
+
+static void cjbuf_grow(struct cjbuf *jb, u_int32_t need)
+{
+  u_int32_t size = jb->size ? jb->size : CJBUF_INITLEN;
+  char *base;
+
+  while (size < jb->len + need) size *= 2;
+
+  base = realloc(jb->base, size);
+  if (!base) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): JSON: realloc() failed (cjbuf). Exiting ..\n", config.name, config.type);
+    exit_plugin(1);
+  }
+
+  jb->base = base;
+  jb->size = size;
+}
+
+static inline void cjbuf_reserve(struct cjbuf *jb, u_int32_t need)
+{
+  if (jb->len + need > jb->size) cjbuf_grow(jb, need);
+}
+
+static inline void cjbuf_append(struct cjbuf *jb, const char *str, u_int32_t len)
+{
+  cjbuf_reserve(jb, len);
+  memcpy(jb->base + jb->len, str, len);
+  jb->len += len;
+}
+
+static inline void cjbuf_putc(struct cjbuf *jb, char c)
+{
+  cjbuf_reserve(jb, 1);
+  jb->base[jb->len++] = c;
+}
+
+static void cjbuf_add_uint(struct cjbuf *jb, unsigned long long val)
+{
+  char tmp[24], *ptr = tmp + sizeof(tmp);
+  int idx;
+
+  while (val >= 100) {
+    idx = (val % 100) * 2;
+    val /= 100;
+    *--ptr = cj_digits[idx + 1];
+    *--ptr = cj_digits[idx];
+  }
+
+  if (val >= 10) {
+    idx = val * 2;
+    *--ptr = cj_digits[idx + 1];
+    *--ptr = cj_digits[idx];
+  }
+  else *--ptr = '0' + val;
+
+  cjbuf_append(jb, ptr, (tmp + sizeof(tmp)) - ptr);
+}
+
+static void cjbuf_add_int(struct cjbuf *jb, long long val)
+{
+  if (val < 0) {
+    cjbuf_putc(jb, '-');
+    cjbuf_add_uint(jb, -(unsigned long long) val);
+  }
+  else cjbuf_add_uint(jb, val);
+}
+
+/* length of the valid UTF-8 sequence at str, 0 if invalid (as per jansson) */
+static int cj_utf8_len(const u_char *str)
+{
+  u_int32_t cp;
+  int len, idx;
+
+  if (str[0] < 0xC2) return 0;
+  else if (str[0] <= 0xDF) {
+    len = 2;
+    cp = str[0] & 0x1F;
+  }
+  else if (str[0] <= 0xEF) {
+    len = 3;
+    cp = str[0] & 0x0F;
+  }
+  else if (str[0] <= 0xF4) {
+    len = 4;
+    cp = str[0] & 0x07;
+  }
+  else return 0;
+
+  for (idx = 1; idx < len; idx++) {
+    if ((str[idx] & 0xC0) != 0x80) return 0;
+    cp = (cp << 6) | (str[idx] & 0x3F);
+  }
+
+  if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000)) return 0;
+  if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+
+  return len;
+}
+
+static int cjbuf_add_string(struct cjbuf *jb, const char *str)
+{
+  const u_char *ptr = (const u_char *) str, *run;
+  char esc[6];
+  int len;
+
+  cjbuf_putc(jb, '"');
+
+  while (*ptr) {
+    for (run = ptr; *ptr >= 0x20 && *ptr < 0x80 && *ptr != '"' && *ptr != '\\'; ptr++);
+    if (ptr > run) cjbuf_append(jb, (const char *) run, ptr - run);
+
+    if (!*ptr) break;
+
+    if (*ptr >= 0x80) {
+      if (!(len = cj_utf8_len(ptr))) return ERR;
+
+      cjbuf_append(jb, (const char *) ptr, len);
+      ptr += len;
+      continue;
+    }
+
+    esc[0] = '\\';
+    len = 2;
+
+    switch (*ptr) {
+    case '"': esc[1] = '"'; break;
+    case '\\': esc[1] = '\\'; break;
+    case '\b': esc[1] = 'b'; break;
+    case '\f': esc[1] = 'f'; break;
+    case '\n': esc[1] = 'n'; break;
+    case '\r': esc[1] = 'r'; break;
+    case '\t': esc[1] = 't'; break;
+    default:
+      esc[1] = 'u';
+      esc[2] = '0';
+      esc[3] = '0';
+      esc[4] = cj_hex[*ptr >> 4];
+      esc[5] = cj_hex[*ptr & 0xF];
+      len = 6;
+      break;
+    }
+
+    cjbuf_append(jb, esc, len);
+    ptr++;
+  }
+
+  cjbuf_putc(jb, '"');
+
+  return SUCCESS;
+}
+
+static void cj_add_int_key(struct cjbuf *jb, const char *key, u_int32_t keylen, long long val)
+{
+  cjbuf_append(jb, key, keylen);
+  cjbuf_add_int(jb, val);
+}
+
+static void cj_add_uint_str_key(struct cjbuf *jb, const char *key, u_int32_t keylen, u_int32_t val)
+{
+  cjbuf_append(jb, key, keylen);
+  cjbuf_putc(jb, '"');
+  cjbuf_add_uint(jb, val);
+  cjbuf_putc(jb, '"');
+}
+
+static void cj_add_str_key(struct cjbuf *jb, const char *key, u_int32_t keylen, const char *str)
+{
+  u_int32_t mark = jb->len;
+
+  /* jansson refuses NULL and non-UTF-8 strings: the key is dropped */
+  cjbuf_append(jb, key, keylen);
+  if (!str || cjbuf_add_string(jb, str) == ERR) jb->len = mark;
+}
+
+static void cj_add_ip_key(struct cjbuf *jb, const char *key, u_int32_t keylen, struct host_addr *addr)
+{
+  if (addr->family == AF_INET) {
+    const u_char *octet = (const u_char *) &addr->address.ipv4;
+
+    cjbuf_append(jb, key, keylen);
+    cjbuf_putc(jb, '"');
+    cjbuf_add_uint(jb, octet[0]);
+    cjbuf_putc(jb, '.');
+    cjbuf_add_uint(jb, octet[1]);
+    cjbuf_putc(jb, '.');
+    cjbuf_add_uint(jb, octet[2]);
+    cjbuf_putc(jb, '.');
+    cjbuf_add_uint(jb, octet[3]);
+    cjbuf_putc(jb, '"');
+  }
+  else {
+    char ip_address[INET6_ADDRSTRLEN];
+
+    addr_to_str(ip_address, addr);
+    cj_add_str_key(jb, key, keylen, ip_address);
+  }
+}
+
+static void cj_add_mac_key(struct cjbuf *jb, const char *key, u_int32_t keylen, u_char *mac)
+{
+  cjbuf_append(jb, key, keylen);
+  cjbuf_reserve(jb, 20);
+  jb->base[jb->len] = '"';
+  etheraddr_string(mac, jb->base + jb->len + 1);
+  jb->len += strlen(jb->base + jb->len + 1) + 1;
+  jb->base[jb->len++] = '"';
+}
+
+static void cj_add_tstamp_key(struct cjbuf *jb, const char *key, u_int32_t keylen, struct timeval *tv, int usec)
+{
+  /* localtime() + strftime() only when the second changes */
+  static __thread time_t last_sec;
+  static __thread char last_str[VERYSHORTBUFLEN];
+  static __thread int last_len;
+
+  cjbuf_append(jb, key, keylen);
+  cjbuf_putc(jb, '"');
+
+  if (config.timestamps_since_epoch) cjbuf_add_uint(jb, (u_int32_t) tv->tv_sec);
+  else {
+    if (!last_len || last_sec != tv->tv_sec) {
+      struct tm tm;
+
+      last_sec = tv->tv_sec;
+      localtime_r(&last_sec, &tm);
+      last_len = strftime(last_str, sizeof(last_str), "%Y-%m-%d %H:%M:%S", &tm);
+    }
+
+    cjbuf_append(jb, last_str, last_len);
+  }
+
+  if (usec) {
+    cjbuf_putc(jb, '.');
+    cjbuf_add_uint(jb, (u_int32_t) tv->tv_usec);
+  }
+
+  cjbuf_putc(jb, '"');
+}
+
 void compose_json(u_int64_t wtc, u_int64_t wtc_2)
 {
   int idx = 0;
@@ -384,6 +646,15 @@ void compose_json(u_int64_t wtc, u_int64_t wtc_2)
   }
 
   if (config.cpptrs.num) {
+    int cp_idx;
+
+    for (cp_idx = 0; cp_idx < config.cpptrs.num; cp_idx++) {
+      cjcp_key[cp_idx].len = 0;
+      cjbuf_append(&cjcp_key[cp_idx], ", ", 2);
+      cjbuf_add_string(&cjcp_key[cp_idx], config.cpptrs.primitive[cp_idx].name);
+      cjbuf_append(&cjcp_key[cp_idx], ": ", 2);
+    }
+
     cjhandler[idx] = compose_json_custom_primitives;
     idx++;
   }
@@ -401,86 +672,80 @@ void compose_json(u_int64_t wtc, u_int64_t wtc_2)
   cjhandler[idx] = compose_json_counters;
 }
 
-void compose_json_event_type(json_t *obj, struct chained_cache *null)
+void compose_json_event_type(struct cjbuf *jb, struct chained_cache *null)
 {
   char event_type[] = "purge";
 
-  json_object_set_new_nocheck(obj, "event_type", json_string(event_type));
+  cj_add_str(jb, "event_type", event_type);
 }
 
-void compose_json_tag(json_t *obj, struct chained_cache *cc)
+void compose_json_tag(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "tag", json_integer((json_int_t)cc->primitives.tag));
+  cj_add_int(jb, "tag", cc->primitives.tag);
 }
 
-void compose_json_tag2(json_t *obj, struct chained_cache *cc)
+void compose_json_tag2(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "tag2", json_integer((json_int_t)cc->primitives.tag2));
+  cj_add_int(jb, "tag2", cc->primitives.tag2);
 }
 
-void compose_json_label(json_t *obj, struct chained_cache *cc)
+void compose_json_label(struct cjbuf *jb, struct chained_cache *cc)
 {
   char empty_string[] = "", *str_ptr;
 
   vlen_prims_get(cc->pvlen, COUNT_INT_LABEL, &str_ptr);
   if (!str_ptr) str_ptr = empty_string;
 
-  json_object_set_new_nocheck(obj, "label", json_string(str_ptr));
+  cj_add_str(jb, "label", str_ptr);
 }
 
-void compose_json_class(json_t *obj, struct chained_cache *cc)
+void compose_json_class(struct cjbuf *jb, struct chained_cache *cc)
 {
   char empty_string[] = "", *str_ptr;
   struct pkt_primitives *pbase = &cc->primitives;
 
-  json_object_set_new_nocheck(obj, "class", json_string((pbase->class && class[(pbase->class)-1].id) ? class[(pbase->class)-1].protocol : "unknown"));
+  cj_add_str(jb, "class", (pbase->class && class[(pbase->class)-1].id) ? class[(pbase->class)-1].protocol : "unknown");
 }
 
-void compose_json_src_mac(json_t *obj, struct chained_cache *cc)
+void compose_json_src_mac(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char mac[18];
-
-  etheraddr_string(cc->primitives.eth_shost, mac);
-  json_object_set_new_nocheck(obj, "mac_src", json_string(mac));
+  cj_add_mac(jb, "mac_src", cc->primitives.eth_shost);
 }
 
-void compose_json_dst_mac(json_t *obj, struct chained_cache *cc)
+void compose_json_dst_mac(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char mac[18];
-  
-  etheraddr_string(cc->primitives.eth_dhost, mac);
-  json_object_set_new_nocheck(obj, "mac_dst", json_string(mac));
+  cj_add_mac(jb, "mac_dst", cc->primitives.eth_dhost);
 }
 
-void compose_json_vlan(json_t *obj, struct chained_cache *cc)
+void compose_json_vlan(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "vlan", json_integer((json_int_t)cc->primitives.vlan_id));
+  cj_add_int(jb, "vlan", cc->primitives.vlan_id);
 }
 
-void compose_json_cos(json_t *obj, struct chained_cache *cc)
+void compose_json_cos(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "cos", json_integer((json_int_t)cc->primitives.cos));
+  cj_add_int(jb, "cos", cc->primitives.cos);
 }
 
-void compose_json_etype(json_t *obj, struct chained_cache *cc)
+void compose_json_etype(struct cjbuf *jb, struct chained_cache *cc)
 {
   char misc_str[VERYSHORTBUFLEN];
 
   sprintf(misc_str, "%x", cc->primitives.etype);
-  json_object_set_new_nocheck(obj, "etype", json_string(misc_str));
+  cj_add_str(jb, "etype", misc_str);
 }
 
-void compose_json_src_as(json_t *obj, struct chained_cache *cc)
+void compose_json_src_as(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "as_src", json_integer((json_int_t)cc->primitives.src_as));
+  cj_add_int(jb, "as_src", cc->primitives.src_as);
 }
 
-void compose_json_dst_as(json_t *obj, struct chained_cache *cc)
+void compose_json_dst_as(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "as_dst", json_integer((json_int_t)cc->primitives.dst_as));
+  cj_add_int(jb, "as_dst", cc->primitives.dst_as);
 }
 
-void compose_json_std_comm(json_t *obj, struct chained_cache *cc)
+void compose_json_std_comm(struct cjbuf *jb, struct chained_cache *cc)
 {
   char *str_ptr = NULL, *bgp_comm, empty_string[] = "";
 
@@ -494,10 +759,10 @@ void compose_json_std_comm(json_t *obj, struct chained_cache *cc)
   }
   else str_ptr = empty_string;
 
-  json_object_set_new_nocheck(obj, "comms", json_string(str_ptr));
+  cj_add_str(jb, "comms", str_ptr);
 }
 
-void compose_json_ext_comm(json_t *obj, struct chained_cache *cc)
+void compose_json_ext_comm(struct cjbuf *jb, struct chained_cache *cc)
 {
   char *str_ptr = NULL, *bgp_comm, empty_string[] = "";
 
@@ -511,10 +776,10 @@ void compose_json_ext_comm(json_t *obj, struct chained_cache *cc)
   }
   else str_ptr = empty_string;
 
-  json_object_set_new_nocheck(obj, "ecomms", json_string(str_ptr));
+  cj_add_str(jb, "ecomms", str_ptr);
 }
 
-void compose_json_lrg_comm(json_t *obj, struct chained_cache *cc)
+void compose_json_lrg_comm(struct cjbuf *jb, struct chained_cache *cc)
 {
   char *str_ptr = NULL, *bgp_comm, empty_string[] = "";
 
@@ -528,10 +793,10 @@ void compose_json_lrg_comm(json_t *obj, struct chained_cache *cc)
   }
   else str_ptr = empty_string;
 
-  json_object_set_new_nocheck(obj, "lcomms", json_string(str_ptr));
+  cj_add_str(jb, "lcomms", str_ptr);
 }
 
-void compose_json_as_path(json_t *obj, struct chained_cache *cc)
+void compose_json_as_path(struct cjbuf *jb, struct chained_cache *cc)
 {
   char *str_ptr = NULL, *as_path, empty_string[] = "";
 
@@ -545,46 +810,40 @@ void compose_json_as_path(json_t *obj, struct chained_cache *cc)
   }
   else str_ptr = empty_string;
 
-  json_object_set_new_nocheck(obj, "as_path", json_string(str_ptr));
+  cj_add_str(jb, "as_path", str_ptr);
 }
 
-void compose_json_local_pref(json_t *obj, struct chained_cache *cc)
+void compose_json_local_pref(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "local_pref", json_integer((json_int_t)cc->pbgp->local_pref));
+  cj_add_int(jb, "local_pref", cc->pbgp->local_pref);
 }
 
-void compose_json_med(json_t *obj, struct chained_cache *cc)
+void compose_json_med(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "med", json_integer((json_int_t)cc->pbgp->med));
+  cj_add_int(jb, "med", cc->pbgp->med);
 }
 
-void compose_json_peer_src_as(json_t *obj, struct chained_cache *cc)
+void compose_json_peer_src_as(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "peer_as_src", json_integer((json_int_t)cc->pbgp->peer_src_as));
+  cj_add_int(jb, "peer_as_src", cc->pbgp->peer_src_as);
 }
 
-void compose_json_peer_dst_as(json_t *obj, struct chained_cache *cc)
+void compose_json_peer_dst_as(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "peer_as_dst", json_integer((json_int_t)cc->pbgp->peer_dst_as));
+  cj_add_int(jb, "peer_as_dst", cc->pbgp->peer_dst_as);
 }
 
-void compose_json_peer_src_ip(json_t *obj, struct chained_cache *cc)
+void compose_json_peer_src_ip(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char ip_address[INET6_ADDRSTRLEN];
-
-  addr_to_str(ip_address, &cc->pbgp->peer_src_ip);
-  json_object_set_new_nocheck(obj, "peer_ip_src", json_string(ip_address));
+  cj_add_ip(jb, "peer_ip_src", &cc->pbgp->peer_src_ip);
 }
 
-void compose_json_peer_dst_ip(json_t *obj, struct chained_cache *cc)
+void compose_json_peer_dst_ip(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char ip_address[INET6_ADDRSTRLEN];
-
-  addr_to_str(ip_address, &cc->pbgp->peer_dst_ip);
-  json_object_set_new_nocheck(obj, "peer_ip_dst", json_string(ip_address));
+  cj_add_ip(jb, "peer_ip_dst", &cc->pbgp->peer_dst_ip);
 }
 
-void compose_json_src_std_comm(json_t *obj, struct chained_cache *cc)
+void compose_json_src_std_comm(struct cjbuf *jb, struct chained_cache *cc)
 {
   char *str_ptr = NULL, *bgp_comm, empty_string[] = "";
 
@@ -598,10 +857,10 @@ void compose_json_src_std_comm(json_t *obj, struct chained_cache *cc)
   }
   else str_ptr = empty_string;
 
-  json_object_set_new_nocheck(obj, "src_comms", json_string(str_ptr));
+  cj_add_str(jb, "src_comms", str_ptr);
 }
 
-void compose_json_src_ext_comm(json_t *obj, struct chained_cache *cc)
+void compose_json_src_ext_comm(struct cjbuf *jb, struct chained_cache *cc)
 {
   char *str_ptr = NULL, *bgp_comm, empty_string[] = "";
 
@@ -615,10 +874,10 @@ void compose_json_src_ext_comm(json_t *obj, struct chained_cache *cc)
   }
   else str_ptr = empty_string;
 
-  json_object_set_new_nocheck(obj, "src_ecomms", json_string(str_ptr));
+  cj_add_str(jb, "src_ecomms", str_ptr);
 }
 
-void compose_json_src_lrg_comm(json_t *obj, struct chained_cache *cc)
+void compose_json_src_lrg_comm(struct cjbuf *jb, struct chained_cache *cc)
 {
   char *str_ptr = NULL, *bgp_comm, empty_string[] = "";
 
@@ -632,10 +891,10 @@ void compose_json_src_lrg_comm(json_t *obj, struct chained_cache *cc)
   }
   else str_ptr = empty_string;
 
-  json_object_set_new_nocheck(obj, "src_lcomms", json_string(str_ptr));
+  cj_add_str(jb, "src_lcomms", str_ptr);
 }
 
-void compose_json_src_as_path(json_t *obj, struct chained_cache *cc)
+void compose_json_src_as_path(struct cjbuf *jb, struct chained_cache *cc)
 {
   char *str_ptr = NULL, *as_path, empty_string[] = "";
 
@@ -649,308 +908,263 @@ void compose_json_src_as_path(json_t *obj, struct chained_cache *cc)
   }
   else str_ptr = empty_string;
 
-  json_object_set_new_nocheck(obj, "src_as_path", json_string(str_ptr));
+  cj_add_str(jb, "src_as_path", str_ptr);
 }
 
-void compose_json_src_local_pref(json_t *obj, struct chained_cache *cc)
+void compose_json_src_local_pref(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "src_local_pref", json_integer((json_int_t)cc->pbgp->src_local_pref));
+  cj_add_int(jb, "src_local_pref", cc->pbgp->src_local_pref);
 }
 
-void compose_json_src_med(json_t *obj, struct chained_cache *cc)
+void compose_json_src_med(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "src_med", json_integer((json_int_t)cc->pbgp->src_med));
+  cj_add_int(jb, "src_med", cc->pbgp->src_med);
 }
 
-void compose_json_in_iface(json_t *obj, struct chained_cache *cc)
+void compose_json_in_iface(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "iface_in", json_integer((json_int_t)cc->primitives.ifindex_in));
+  cj_add_int(jb, "iface_in", cc->primitives.ifindex_in);
 }
 
-void compose_json_out_iface(json_t *obj, struct chained_cache *cc)
+void compose_json_out_iface(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "iface_out", json_integer((json_int_t)cc->primitives.ifindex_out));
+  cj_add_int(jb, "iface_out", cc->primitives.ifindex_out);
 }
 
-void compose_json_mpls_vpn_rd(json_t *obj, struct chained_cache *cc)
+void compose_json_mpls_vpn_rd(struct cjbuf *jb, struct chained_cache *cc)
 {
   char rd_str[VERYSHORTBUFLEN];
 
   bgp_rd2str(rd_str, &cc->pbgp->mpls_vpn_rd);
-  json_object_set_new_nocheck(obj, "mpls_vpn_rd", json_string(rd_str));
+  cj_add_str(jb, "mpls_vpn_rd", rd_str);
 }
 
-void compose_json_src_host(json_t *obj, struct chained_cache *cc)
+void compose_json_src_host(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char ip_address[INET6_ADDRSTRLEN];
-
-  addr_to_str(ip_address, &cc->primitives.src_ip);
-  json_object_set_new_nocheck(obj, "ip_src", json_string(ip_address));
+  cj_add_ip(jb, "ip_src", &cc->primitives.src_ip);
 }
 
-void compose_json_src_net(json_t *obj, struct chained_cache *cc)
+void compose_json_src_net(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char ip_address[INET6_ADDRSTRLEN];
-
-  addr_to_str(ip_address, &cc->primitives.src_net);
-  json_object_set_new_nocheck(obj, "net_src", json_string(ip_address));
+  cj_add_ip(jb, "net_src", &cc->primitives.src_net);
 }
 
-void compose_json_dst_host(json_t *obj, struct chained_cache *cc)
+void compose_json_dst_host(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char ip_address[INET6_ADDRSTRLEN];
-
-  addr_to_str(ip_address, &cc->primitives.dst_ip);
-  json_object_set_new_nocheck(obj, "ip_dst", json_string(ip_address));
+  cj_add_ip(jb, "ip_dst", &cc->primitives.dst_ip);
 }
 
-void compose_json_dst_net(json_t *obj, struct chained_cache *cc)
+void compose_json_dst_net(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char ip_address[INET6_ADDRSTRLEN];
-
-  addr_to_str(ip_address, &cc->primitives.dst_net);
-  json_object_set_new_nocheck(obj, "net_dst", json_string(ip_address));
+  cj_add_ip(jb, "net_dst", &cc->primitives.dst_net);
 }
 
-void compose_json_src_mask(json_t *obj, struct chained_cache *cc)
+void compose_json_src_mask(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "mask_src", json_integer((json_int_t)cc->primitives.src_nmask));
+  cj_add_int(jb, "mask_src", cc->primitives.src_nmask);
 }
 
-void compose_json_dst_mask(json_t *obj, struct chained_cache *cc)
+void compose_json_dst_mask(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "mask_dst", json_integer((json_int_t)cc->primitives.dst_nmask));
+  cj_add_int(jb, "mask_dst", cc->primitives.dst_nmask);
 }
 
-void compose_json_src_port(json_t *obj, struct chained_cache *cc)
+void compose_json_src_port(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "port_src", json_integer((json_int_t)cc->primitives.src_port));
+  cj_add_int(jb, "port_src", cc->primitives.src_port);
 }
 
-void compose_json_dst_port(json_t *obj, struct chained_cache *cc)
+void compose_json_dst_port(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "port_dst", json_integer((json_int_t)cc->primitives.dst_port));
+  cj_add_int(jb, "port_dst", cc->primitives.dst_port);
 }
 
 #if defined (WITH_GEOIP)
-void compose_json_src_host_country(json_t *obj, struct chained_cache *cc)
+void compose_json_src_host_country(struct cjbuf *jb, struct chained_cache *cc)
 {
   char empty_string[] = "";
  
   if (cc->primitives.src_ip_country.id > 0)
-    json_object_set_new_nocheck(obj, "country_ip_src", json_string(GeoIP_code_by_id(cc->primitives.src_ip_country.id)));
+    cj_add_str(jb, "country_ip_src", GeoIP_code_by_id(cc->primitives.src_ip_country.id));
   else
-    json_object_set_new_nocheck(obj, "country_ip_src", json_string(empty_string));
+    cj_add_str(jb, "country_ip_src", empty_string);
 }
 
-void compose_json_dst_host_country(json_t *obj, struct chained_cache *cc)
+void compose_json_dst_host_country(struct cjbuf *jb, struct chained_cache *cc)
 {
   char empty_string[] = "";
 
   if (cc->primitives.dst_ip_country.id > 0)
-    json_object_set_new_nocheck(obj, "country_ip_dst", json_string(GeoIP_code_by_id(cc->primitives.dst_ip_country.id)));
+    cj_add_str(jb, "country_ip_dst", GeoIP_code_by_id(cc->primitives.dst_ip_country.id));
   else
-    json_object_set_new_nocheck(obj, "country_ip_dst", json_string(empty_string));
+    cj_add_str(jb, "country_ip_dst", empty_string);
 }
 #endif
 #if defined (WITH_GEOIPV2)
-void compose_json_src_host_country(json_t *obj, struct chained_cache *cc)
+void compose_json_src_host_country(struct cjbuf *jb, struct chained_cache *cc)
 {
   char empty_string[] = "";
 
   if (strlen(cc->primitives.src_ip_country.str))
-    json_object_set_new_nocheck(obj, "country_ip_src", json_string(cc->primitives.src_ip_country.str));
+    cj_add_str(jb, "country_ip_src", cc->primitives.src_ip_country.str);
   else
-    json_object_set_new_nocheck(obj, "country_ip_src", json_string(empty_string));
+    cj_add_str(jb, "country_ip_src", empty_string);
 }
 
-void compose_json_dst_host_country(json_t *obj, struct chained_cache *cc)
+void compose_json_dst_host_country(struct cjbuf *jb, struct chained_cache *cc)
 {
   char empty_string[] = "";
 
   if (strlen(cc->primitives.dst_ip_country.str))
-    json_object_set_new_nocheck(obj, "country_ip_dst", json_string(cc->primitives.dst_ip_country.str));
+    cj_add_str(jb, "country_ip_dst", cc->primitives.dst_ip_country.str);
   else
-    json_object_set_new_nocheck(obj, "country_ip_dst", json_string(empty_string));
+    cj_add_str(jb, "country_ip_dst", empty_string);
 }
 
-void compose_json_src_host_pocode(json_t *obj, struct chained_cache *cc)
+void compose_json_src_host_pocode(struct cjbuf *jb, struct chained_cache *cc)
 {
   char empty_string[] = "";
 
   if (strlen(cc->primitives.src_ip_pocode.str))
-    json_object_set_new_nocheck(obj, "pocode_ip_src", json_string(cc->primitives.src_ip_pocode.str));
+    cj_add_str(jb, "pocode_ip_src", cc->primitives.src_ip_pocode.str);
   else
-    json_object_set_new_nocheck(obj, "pocode_ip_src", json_string(empty_string));
+    cj_add_str(jb, "pocode_ip_src", empty_string);
 }
 
-void compose_json_dst_host_pocode(json_t *obj, struct chained_cache *cc)
+void compose_json_dst_host_pocode(struct cjbuf *jb, struct chained_cache *cc)
 {
   char empty_string[] = "";
 
   if (strlen(cc->primitives.dst_ip_pocode.str))
-    json_object_set_new_nocheck(obj, "pocode_ip_dst", json_string(cc->primitives.dst_ip_pocode.str));
+    cj_add_str(jb, "pocode_ip_dst", cc->primitives.dst_ip_pocode.str);
   else
-    json_object_set_new_nocheck(obj, "pocode_ip_dst", json_string(empty_string));
+    cj_add_str(jb, "pocode_ip_dst", empty_string);
 }
 #endif
 
-void compose_json_tcp_flags(json_t *obj, struct chained_cache *cc)
+void compose_json_tcp_flags(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char misc_str[VERYSHORTBUFLEN];
-
-  sprintf(misc_str, "%u", cc->tcp_flags);
-  json_object_set_new_nocheck(obj, "tcp_flags", json_string(misc_str));
+  cj_add_uint_str(jb, "tcp_flags", cc->tcp_flags);
 }
 
-void compose_json_proto(json_t *obj, struct chained_cache *cc)
+void compose_json_proto(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char misc_str[VERYSHORTBUFLEN];
-
   if (!config.num_protos && (cc->primitives.proto < protocols_number))
-    json_object_set_new_nocheck(obj, "ip_proto", json_string(_protocols[cc->primitives.proto].name));
+    cj_add_str(jb, "ip_proto", _protocols[cc->primitives.proto].name);
   else
-    json_object_set_new_nocheck(obj, "ip_proto", json_integer((json_int_t)cc->primitives.proto));
+    cj_add_int(jb, "ip_proto", cc->primitives.proto);
 }
 
-void compose_json_tos(json_t *obj, struct chained_cache *cc)
+void compose_json_tos(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "tos", json_integer((json_int_t)cc->primitives.tos));
+  cj_add_int(jb, "tos", cc->primitives.tos);
 }
 
-void compose_json_sampling_rate(json_t *obj, struct chained_cache *cc)
+void compose_json_sampling_rate(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "sampling_rate", json_integer((json_int_t)cc->primitives.sampling_rate));
+  cj_add_int(jb, "sampling_rate", cc->primitives.sampling_rate);
 }
 
-void compose_json_pkt_len_distrib(json_t *obj, struct chained_cache *cc)
+void compose_json_pkt_len_distrib(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "pkt_len_distrib", json_string(config.pkt_len_distrib_bins[cc->primitives.pkt_len_distrib]));
+  cj_add_str(jb, "pkt_len_distrib", config.pkt_len_distrib_bins[cc->primitives.pkt_len_distrib]);
 }
 
-void compose_json_post_nat_src_host(json_t *obj, struct chained_cache *cc)
+void compose_json_post_nat_src_host(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char ip_address[INET6_ADDRSTRLEN];
-
-  addr_to_str(ip_address, &cc->pnat->post_nat_src_ip);
-  json_object_set_new_nocheck(obj, "post_nat_ip_src", json_string(ip_address));
+  cj_add_ip(jb, "post_nat_ip_src", &cc->pnat->post_nat_src_ip);
 }
 
-void compose_json_post_nat_dst_host(json_t *obj, struct chained_cache *cc)
+void compose_json_post_nat_dst_host(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char ip_address[INET6_ADDRSTRLEN];
-
-  addr_to_str(ip_address, &cc->pnat->post_nat_dst_ip);
-  json_object_set_new_nocheck(obj, "post_nat_ip_dst", json_string(ip_address));
+  cj_add_ip(jb, "post_nat_ip_dst", &cc->pnat->post_nat_dst_ip);
 }
 
-void compose_json_post_nat_src_port(json_t *obj, struct chained_cache *cc)
+void compose_json_post_nat_src_port(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "post_nat_port_src", json_integer((json_int_t)cc->pnat->post_nat_src_port));
+  cj_add_int(jb, "post_nat_port_src", cc->pnat->post_nat_src_port);
 }
 
-void compose_json_post_nat_dst_port(json_t *obj, struct chained_cache *cc)
+void compose_json_post_nat_dst_port(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "post_nat_port_dst", json_integer((json_int_t)cc->pnat->post_nat_dst_port));
+  cj_add_int(jb, "post_nat_port_dst", cc->pnat->post_nat_dst_port);
 }
 
-void compose_json_nat_event(json_t *obj, struct chained_cache *cc)
+void compose_json_nat_event(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "nat_event", json_integer((json_int_t)cc->pnat->nat_event));
+  cj_add_int(jb, "nat_event", cc->pnat->nat_event);
 }
 
-void compose_json_mpls_label_top(json_t *obj, struct chained_cache *cc)
+void compose_json_mpls_label_top(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "mpls_label_top", json_integer((json_int_t)cc->pmpls->mpls_label_top));
+  cj_add_int(jb, "mpls_label_top", cc->pmpls->mpls_label_top);
 }
 
-void compose_json_mpls_label_bottom(json_t *obj, struct chained_cache *cc)
+void compose_json_mpls_label_bottom(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "mpls_label_bottom", json_integer((json_int_t)cc->pmpls->mpls_label_bottom));
+  cj_add_int(jb, "mpls_label_bottom", cc->pmpls->mpls_label_bottom);
 }
 
-void compose_json_mpls_stack_depth(json_t *obj, struct chained_cache *cc)
+void compose_json_mpls_stack_depth(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "mpls_stack_depth", json_integer((json_int_t)cc->pmpls->mpls_stack_depth));
+  cj_add_int(jb, "mpls_stack_depth", cc->pmpls->mpls_stack_depth);
 }
 
-void compose_json_tunnel_src_host(json_t *obj, struct chained_cache *cc)
+void compose_json_tunnel_src_host(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char ip_address[INET6_ADDRSTRLEN];
-
-  addr_to_str(ip_address, &cc->ptun->tunnel_src_ip);
-  json_object_set_new_nocheck(obj, "tunnel_ip_src", json_string(ip_address));
+  cj_add_ip(jb, "tunnel_ip_src", &cc->ptun->tunnel_src_ip);
 }
 
-void compose_json_tunnel_dst_host(json_t *obj, struct chained_cache *cc)
+void compose_json_tunnel_dst_host(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char ip_address[INET6_ADDRSTRLEN];
-
-  addr_to_str(ip_address, &cc->ptun->tunnel_dst_ip);
-  json_object_set_new_nocheck(obj, "tunnel_ip_dst", json_string(ip_address));
+  cj_add_ip(jb, "tunnel_ip_dst", &cc->ptun->tunnel_dst_ip);
 }
 
-void compose_json_tunnel_proto(json_t *obj, struct chained_cache *cc)
+void compose_json_tunnel_proto(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char misc_str[VERYSHORTBUFLEN];
-
   if (!config.num_protos && (cc->ptun->tunnel_proto < protocols_number))
-    json_object_set_new_nocheck(obj, "tunnel_ip_proto", json_string(_protocols[cc->ptun->tunnel_proto].name));
+    cj_add_str(jb, "tunnel_ip_proto", _protocols[cc->ptun->tunnel_proto].name);
   else
-    json_object_set_new_nocheck(obj, "tunnel_ip_proto", json_integer((json_int_t)cc->ptun->tunnel_proto));
+    cj_add_int(jb, "tunnel_ip_proto", cc->ptun->tunnel_proto);
 }
 
-void compose_json_tunnel_tos(json_t *obj, struct chained_cache *cc)
+void compose_json_tunnel_tos(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "tunnel_tos", json_integer((json_int_t)cc->ptun->tunnel_tos));
+  cj_add_int(jb, "tunnel_tos", cc->ptun->tunnel_tos);
 }
 
-void compose_json_timestamp_start(json_t *obj, struct chained_cache *cc)
+void compose_json_timestamp_start(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char tstamp_str[VERYSHORTBUFLEN];
-
-  compose_timestamp(tstamp_str, VERYSHORTBUFLEN, &cc->pnat->timestamp_start, TRUE, config.timestamps_since_epoch);
-  json_object_set_new_nocheck(obj, "timestamp_start", json_string(tstamp_str));
+  cj_add_tstamp(jb, "timestamp_start", &cc->pnat->timestamp_start, TRUE);
 }
 
-void compose_json_timestamp_end(json_t *obj, struct chained_cache *cc)
+void compose_json_timestamp_end(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char tstamp_str[VERYSHORTBUFLEN];
-
-  compose_timestamp(tstamp_str, VERYSHORTBUFLEN, &cc->pnat->timestamp_end, TRUE, config.timestamps_since_epoch);
-  json_object_set_new_nocheck(obj, "timestamp_end", json_string(tstamp_str));
+  cj_add_tstamp(jb, "timestamp_end", &cc->pnat->timestamp_end, TRUE);
 }
 
-void compose_json_timestamp_arrival(json_t *obj, struct chained_cache *cc)
+void compose_json_timestamp_arrival(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char tstamp_str[VERYSHORTBUFLEN];
-
-  compose_timestamp(tstamp_str, VERYSHORTBUFLEN, &cc->pnat->timestamp_arrival, TRUE, config.timestamps_since_epoch);
-  json_object_set_new_nocheck(obj, "timestamp_arrival", json_string(tstamp_str));
+  cj_add_tstamp(jb, "timestamp_arrival", &cc->pnat->timestamp_arrival, TRUE);
 }
 
-void compose_json_timestamp_stitching(json_t *obj, struct chained_cache *cc)
+void compose_json_timestamp_stitching(struct cjbuf *jb, struct chained_cache *cc)
 {
-  char tstamp_str[VERYSHORTBUFLEN];
-
-  compose_timestamp(tstamp_str, VERYSHORTBUFLEN, &cc->stitch->timestamp_min, TRUE, config.timestamps_since_epoch);
-  json_object_set_new_nocheck(obj, "timestamp_min", json_string(tstamp_str));
-
-  compose_timestamp(tstamp_str, VERYSHORTBUFLEN, &cc->stitch->timestamp_max, TRUE, config.timestamps_since_epoch);
-  json_object_set_new_nocheck(obj, "timestamp_max", json_string(tstamp_str));
+  cj_add_tstamp(jb, "timestamp_min", &cc->stitch->timestamp_min, TRUE);
+  cj_add_tstamp(jb, "timestamp_max", &cc->stitch->timestamp_max, TRUE);
 }
 
-void compose_json_export_proto_seqno(json_t *obj, struct chained_cache *cc)
+void compose_json_export_proto_seqno(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "export_proto_seqno", json_integer((json_int_t)cc->primitives.export_proto_seqno));
+  cj_add_int(jb, "export_proto_seqno", cc->primitives.export_proto_seqno);
 }
 
-void compose_json_export_proto_version(json_t *obj, struct chained_cache *cc)
+void compose_json_export_proto_version(struct cjbuf *jb, struct chained_cache *cc)
 {
-  json_object_set_new_nocheck(obj, "export_proto_version", json_integer((json_int_t)cc->primitives.export_proto_version));
+  cj_add_int(jb, "export_proto_version", cc->primitives.export_proto_version);
 }
 
-void compose_json_custom_primitives(json_t *obj, struct chained_cache *cc)
+void compose_json_custom_primitives(struct cjbuf *jb, struct chained_cache *cc)
 {
   char empty_string[] = "";
   int cp_idx;
@@ -960,50 +1174,81 @@ void compose_json_custom_primitives(json_t *obj, struct chained_cache *cc)
       char cp_str[VERYSHORTBUFLEN];
 
       custom_primitive_value_print(cp_str, VERYSHORTBUFLEN, cc->pcust, &config.cpptrs.primitive[cp_idx], FALSE);
-      json_object_set_new_nocheck(obj, config.cpptrs.primitive[cp_idx].name, json_string(cp_str));
+      cj_add_str_key(jb, cjcp_key[cp_idx].base, cjcp_key[cp_idx].len, cp_str);
     }
     else {
       char *label_ptr = NULL;
 
       vlen_prims_get(cc->pvlen, config.cpptrs.primitive[cp_idx].ptr->type, &label_ptr);
       if (!label_ptr) label_ptr = empty_string;
-      json_object_set_new_nocheck(obj, config.cpptrs.primitive[cp_idx].name, json_string(label_ptr));
+      cj_add_str_key(jb, cjcp_key[cp_idx].base, cjcp_key[cp_idx].len, label_ptr);
     }
   }
 }
 
-void compose_json_history(json_t *obj, struct chained_cache *cc)
+void compose_json_history(struct cjbuf *jb, struct chained_cache *cc)
 {
   if (cc->basetime.tv_sec) {
-    char tstamp_str[VERYSHORTBUFLEN];
     struct timeval tv;
 
     tv.tv_sec = cc->basetime.tv_sec;
     tv.tv_usec = 0;
-    compose_timestamp(tstamp_str, VERYSHORTBUFLEN, &tv, FALSE, config.timestamps_since_epoch);
-    json_object_set_new_nocheck(obj, "stamp_inserted", json_string(tstamp_str));
+    cj_add_tstamp(jb, "stamp_inserted", &tv, FALSE);
 
     tv.tv_sec = time(NULL);
     tv.tv_usec = 0;
-    compose_timestamp(tstamp_str, VERYSHORTBUFLEN, &tv, FALSE, config.timestamps_since_epoch);
-    json_object_set_new_nocheck(obj, "stamp_updated", json_string(tstamp_str));
+    cj_add_tstamp(jb, "stamp_updated", &tv, FALSE);
   }
 }
 
-void compose_json_flows(json_t *obj, struct chained_cache *cc)
+void compose_json_flows(struct cjbuf *jb, struct chained_cache *cc)
 {
   if (cc->flow_type != NF9_FTYPE_EVENT && cc->flow_type != NF9_FTYPE_OPTION)
-    json_object_set_new_nocheck(obj, "flows", json_integer((json_int_t)cc->flow_counter));
+    cj_add_int(jb, "flows", cc->flow_counter);
 }
 
-void compose_json_counters(json_t *obj, struct chained_cache *cc)
+void compose_json_counters(struct cjbuf *jb, struct chained_cache *cc)
 {
   if (cc->flow_type != NF9_FTYPE_EVENT && cc->flow_type != NF9_FTYPE_OPTION) {
-    json_object_set_new_nocheck(obj, "packets", json_integer((json_int_t)cc->packet_counter));
-    json_object_set_new_nocheck(obj, "bytes", json_integer((json_int_t)cc->bytes_counter));
+    cj_add_int(jb, "packets", cc->packet_counter);
+    cj_add_int(jb, "bytes", cc->bytes_counter);
   }
 }
 
+/*
+ * Serializes a cache entry through the configured handlers into a
+ * per-thread buffer which is reused across calls: the returned string
+ * is only valid until the next call. writer_name, if set, appends the
+ * writer_id of message brokers.
+ */
+char *compose_json_record(struct chained_cache *cc, char *writer_name, pid_t writer_pid)
+{
+  static __thread struct cjbuf jb;
+  static __thread char wid[SHORTSHORTBUFLEN];
+  static __thread pid_t wid_pid;
+  int idx;
+
+  jb.len = 0;
+
+  for (idx = 0; idx < N_PRIMITIVES && cjhandler[idx]; idx++) cjhandler[idx](&jb, cc);
+
+  if (writer_name) {
+    if (!wid[0] || wid_pid != writer_pid) {
+      snprintf(wid, SHORTSHORTBUFLEN, "%s/%u", writer_name, writer_pid);
+      wid_pid = writer_pid;
+    }
+
+    cj_add_str(&jb, "writer_id", wid);
+  }
+
+  cjbuf_append(&jb, "}", 2);
+
+  /* every pair starts with ", ": the first one becomes the opening "{" */
+  jb.base[1] = '{';
+
+  return &jb.base[1];
+}
+
 void *compose_purge_init_json(char *writer_name, pid_t writer_pid)
 {
   char event_type[] = "purge_init", wid[SHORTSHORTBUFLEN];
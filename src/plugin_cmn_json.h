@@ -19,9 +19,22 @@
     Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 */
 
+/* defines */
+#define CJBUF_INITLEN		LARGEBUFLEN
+
+/* structures */
+/* Records are serialized straight into a reusable, growable output
+   buffer rather than through a per-record jansson object: handlers
+   append ', "key": value' pairs and compose_json_record() frames them */
+struct cjbuf {
+  char *base;
+  u_int32_t len;
+  u_int32_t size;
+};
+
 /* typedefs */
 #ifdef WITH_JANSSON
-typedef void (*compose_json_handler)(json_t *, struct chained_cache *);
+typedef void (*compose_json_handler)(struct cjbuf *, struct chained_cache *);
 #endif
 
 #if (!defined __PLUGIN_CMN_JSON_C)
@@ -35,82 +48,84 @@ typedef void (*compose_json_handler)(json_t *, struct chained_cache *);
 EXT compose_json_handler cjhandler[N_PRIMITIVES];
 
 /* prototypes */
-EXT void compose_json_event_type(json_t *, struct chained_cache *);
-EXT void compose_json_tag(json_t *, struct chained_cache *);
-EXT void compose_json_tag2(json_t *, struct chained_cache *);
-EXT void compose_json_label(json_t *, struct chained_cache *);
-EXT void compose_json_class(json_t *, struct chained_cache *);
-EXT void compose_json_src_mac(json_t *, struct chained_cache *);
-EXT void compose_json_dst_mac(json_t *, struct chained_cache *);
-EXT void compose_json_vlan(json_t *, struct chained_cache *);
-EXT void compose_json_cos(json_t *, struct chained_cache *);
-EXT void compose_json_etype(json_t *, struct chained_cache *);
-EXT void compose_json_src_as(json_t *, struct chained_cache *);
-EXT void compose_json_dst_as(json_t *, struct chained_cache *);
-EXT void compose_json_std_comm(json_t *, struct chained_cache *);
-EXT void compose_json_ext_comm(json_t *, struct chained_cache *);
-EXT void compose_json_lrg_comm(json_t *, struct chained_cache *);
-EXT void compose_json_as_path(json_t *, struct chained_cache *);
-EXT void compose_json_local_pref(json_t *, struct chained_cache *);
-EXT void compose_json_med(json_t *, struct chained_cache *);
-EXT void compose_json_peer_src_as(json_t *, struct chained_cache *);
-EXT void compose_json_peer_dst_as(json_t *, struct chained_cache *);
-EXT void compose_json_peer_src_ip(json_t *, struct chained_cache *);
-EXT void compose_json_peer_dst_ip(json_t *, struct chained_cache *);
-EXT void compose_json_src_std_comm(json_t *, struct chained_cache *);
-EXT void compose_json_src_ext_comm(json_t *, struct chained_cache *);
-EXT void compose_json_src_lrg_comm(json_t *, struct chained_cache *);
-EXT void compose_json_src_as_path(json_t *, struct chained_cache *);
-EXT void compose_json_src_local_pref(json_t *, struct chained_cache *);
-EXT void compose_json_src_med(json_t *, struct chained_cache *);
-EXT void compose_json_in_iface(json_t *, struct chained_cache *);
-EXT void compose_json_out_iface(json_t *, struct chained_cache *);
-EXT void compose_json_mpls_vpn_rd(json_t *, struct chained_cache *);
-EXT void compose_json_src_host(json_t *, struct chained_cache *);
-EXT void compose_json_src_net(json_t *, struct chained_cache *);
-EXT void compose_json_dst_host(json_t *, struct chained_cache *);
-EXT void compose_json_dst_net(json_t *, struct chained_cache *);
-EXT void compose_json_src_mask(json_t *, struct chained_cache *);
-EXT void compose_json_dst_mask(json_t *, struct chained_cache *);
-EXT void compose_json_src_port(json_t *, struct chained_cache *);
-EXT void compose_json_dst_port(json_t *, struct chained_cache *);
+EXT void compose_json_event_type(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_tag(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_tag2(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_label(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_class(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_mac(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_dst_mac(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_vlan(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_cos(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_etype(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_as(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_dst_as(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_std_comm(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_ext_comm(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_lrg_comm(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_as_path(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_local_pref(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_med(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_peer_src_as(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_peer_dst_as(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_peer_src_ip(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_peer_dst_ip(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_std_comm(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_ext_comm(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_lrg_comm(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_as_path(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_local_pref(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_med(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_in_iface(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_out_iface(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_mpls_vpn_rd(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_host(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_net(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_dst_host(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_dst_net(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_mask(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_dst_mask(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_port(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_dst_port(struct cjbuf *, struct chained_cache *);
 #if defined (WITH_GEOIP)
-EXT void compose_json_src_host_country(json_t *, struct chained_cache *);
-EXT void compose_json_dst_host_country(json_t *, struct chained_cache *);
+EXT void compose_json_src_host_country(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_dst_host_country(struct cjbuf *, struct chained_cache *);
 #endif
 #if defined (WITH_GEOIPV2)
-EXT void compose_json_src_host_country(json_t *, struct chained_cache *);
-EXT void compose_json_dst_host_country(json_t *, struct chained_cache *);
-EXT void compose_json_src_host_pocode(json_t *, struct chained_cache *);
-EXT void compose_json_dst_host_pocode(json_t *, struct chained_cache *);
+EXT void compose_json_src_host_country(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_dst_host_country(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_src_host_pocode(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_dst_host_pocode(struct cjbuf *, struct chained_cache *);
 #endif
-EXT void compose_json_tcp_flags(json_t *, struct chained_cache *);
-EXT void compose_json_proto(json_t *, struct chained_cache *);
-EXT void compose_json_tos(json_t *, struct chained_cache *);
-EXT void compose_json_sampling_rate(json_t *, struct chained_cache *);
-EXT void compose_json_pkt_len_distrib(json_t *, struct chained_cache *);
-EXT void compose_json_post_nat_src_host(json_t *, struct chained_cache *);
-EXT void compose_json_post_nat_dst_host(json_t *, struct chained_cache *);
-EXT void compose_json_post_nat_src_port(json_t *, struct chained_cache *);
-EXT void compose_json_post_nat_dst_port(json_t *, struct chained_cache *);
-EXT void compose_json_nat_event(json_t *, struct chained_cache *);
-EXT void compose_json_mpls_label_top(json_t *, struct chained_cache *);
-EXT void compose_json_mpls_label_bottom(json_t *, struct chained_cache *);
-EXT void compose_json_mpls_stack_depth(json_t *, struct chained_cache *);
-EXT void compose_json_tunnel_src_host(json_t *, struct chained_cache *);
-EXT void compose_json_tunnel_dst_host(json_t *, struct chained_cache *);
-EXT void compose_json_tunnel_proto(json_t *, struct chained_cache *);
-EXT void compose_json_tunnel_tos(json_t *, struct chained_cache *);
-EXT void compose_json_timestamp_start(json_t *, struct chained_cache *);
-EXT void compose_json_timestamp_end(json_t *, struct chained_cache *);
-EXT void compose_json_timestamp_arrival(json_t *, struct chained_cache *);
-EXT void compose_json_timestamp_stitching(json_t *, struct chained_cache *);
-EXT void compose_json_export_proto_seqno(json_t *, struct chained_cache *);
-EXT void compose_json_export_proto_version(json_t *, struct chained_cache *);
-EXT void compose_json_custom_primitives(json_t *, struct chained_cache *);
-EXT void compose_json_history(json_t *, struct chained_cache *);
-EXT void compose_json_flows(json_t *, struct chained_cache *);
-EXT void compose_json_counters(json_t *, struct chained_cache *);
+EXT void compose_json_tcp_flags(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_proto(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_tos(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_sampling_rate(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_pkt_len_distrib(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_post_nat_src_host(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_post_nat_dst_host(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_post_nat_src_port(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_post_nat_dst_port(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_nat_event(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_mpls_label_top(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_mpls_label_bottom(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_mpls_stack_depth(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_tunnel_src_host(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_tunnel_dst_host(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_tunnel_proto(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_tunnel_tos(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_timestamp_start(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_timestamp_end(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_timestamp_arrival(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_timestamp_stitching(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_export_proto_seqno(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_export_proto_version(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_custom_primitives(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_history(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_flows(struct cjbuf *, struct chained_cache *);
+EXT void compose_json_counters(struct cjbuf *, struct chained_cache *);
+
+EXT char *compose_json_record(struct chained_cache *, char *, pid_t);
 #endif
 EXT void compose_json(u_int64_t, u_int64_t);
 EXT void *compose_purge_init_json(char *, pid_t);
@@ -80,6 +80,7 @@ void P_init_default_values()
   pt_size = sizeof(struct pkt_tunnel_primitives);
   pc_size = config.cpptrs.len;
   dbc_size = sizeof(struct chained_cache);
+  primitives_key_init(config.what_to_count, config.what_to_count_2);
 
   memset(&sa, 0, sizeof(struct scratch_area));
   sa.num = config.print_cache_entries*AVERAGE_CHAIN_LEN;
@@ -104,6 +105,8 @@ void P_init_default_values()
 
   /* handling purge preprocessor */
   set_preprocess_funcs(config.sql_preprocess, &prep, PREP_DICT_PRINT);
+
+  if (config.dump_purge_mode == PURGE_MODE_THREAD) P_cache_purge_thread_init();
 }
 
 void P_config_checks()
@@ -131,7 +134,7 @@ unsigned int P_cache_modulo(struct primitives_ptrs *prim_ptrs)
   struct pkt_vlen_hdr_primitives *pvlen = prim_ptrs->pvlen;
   register unsigned int modulo;
 
-  modulo = cache_crc32((unsigned char *)srcdst, pp_size);
+  modulo = primitives_key_hash(srcdst, 0);
   if (pbgp) modulo ^= cache_crc32((unsigned char *)pbgp, pb_size);
   if (pnat) modulo ^= cache_crc32((unsigned char *)pnat, pn_size);
   if (pmpls) modulo ^= cache_crc32((unsigned char *)pmpls, pm_size);
@@ -158,7 +161,7 @@ struct chained_cache *P_cache_search(struct primitives_ptrs *prim_ptrs)
   int res_time = TRUE, res_cust = TRUE, res_vlen = TRUE;
 
   start:
-  res_data = memcmp(&cache_ptr->primitives, data, sizeof(struct pkt_primitives));
+  res_data = primitives_key_cmp(&cache_ptr->primitives, data);
 
   if (basetime_cmp) {
     res_time = (*basetime_cmp)(&cache_ptr->basetime, &ibasetime);
@@ -283,7 +286,7 @@ void P_cache_insert(struct primitives_ptrs *prim_ptrs, struct insert_data *idata
   start:
   res_data = res_bgp = res_nat = res_mpls = res_tun = res_time = res_cust = res_vlen = TRUE;
 
-  res_data = memcmp(&cache_ptr->primitives, srcdst, sizeof(struct pkt_primitives)); 
+  res_data = primitives_key_cmp(&cache_ptr->primitives, srcdst); 
 
   if (basetime_cmp) {
     res_time = (*basetime_cmp)(&cache_ptr->basetime, &ibasetime);
@@ -510,29 +513,39 @@ void P_cache_insert(struct primitives_ptrs *prim_ptrs, struct insert_data *idata
     if (config.type_id == PLUGIN_ID_PRINT && config.sql_table && !config.print_output_file_append)
       Log(LOG_WARNING, "WARN ( %s/%s ): Make sure print_output_file_append is set to true.\n", config.name, config.type);
 
-    if (qq_ptr) P_cache_mark_flush(queries_queue, qq_ptr, FALSE);
-
-    /* Writing out to replenish cache space */
-    dump_writers_count();
-    if (dump_writers_get_flags() != CHLD_ALERT) {
-      switch (ret = fork()) {
-      case 0: /* Child */
-        (*purge_func)(queries_queue, qq_ptr, TRUE);
-        exit(0);
-      default: /* Parent */
-        if (ret == -1) Log(LOG_WARNING, "WARN ( %s/%s ): Unable to fork writer: %s\n", config.name, config.type, strerror(errno));
-        else dump_writers_add(ret);
+    if (config.dump_purge_mode == PURGE_MODE_THREAD) {
+      P_cache_purge_thread_wait();
+      if (qq_ptr) P_cache_mark_flush(queries_queue, qq_ptr, FALSE);
 
-	break;
-      }
+      /* Swapping generation to replenish cache space */
+      P_cache_purge_thread_start(TRUE);
     }
-    else Log(LOG_WARNING, "WARN ( %s/%s ): Maximum number of writer processes reached (%d).\n", config.name, config.type, dump_writers_get_active());
+    else {
+      if (qq_ptr) P_cache_mark_flush(queries_queue, qq_ptr, FALSE);
+
+      /* Writing out to replenish cache space */
+      dump_writers_count();
+      if (dump_writers_get_flags() != CHLD_ALERT) {
+        switch (ret = fork()) {
+        case 0: /* Child */
+          (*purge_func)(queries_queue, qq_ptr, TRUE);
+          exit(0);
+        default: /* Parent */
+          if (ret == -1) Log(LOG_WARNING, "WARN ( %s/%s ): Unable to fork writer: %s\n", config.name, config.type, strerror(errno));
+          else dump_writers_add(ret);
+
+	  break;
+        }
+      }
+      else Log(LOG_WARNING, "WARN ( %s/%s ): Maximum number of writer processes reached (%d).\n", config.name, config.type, dump_writers_get_active());
 
-    P_cache_flush(queries_queue, qq_ptr);
-    qq_ptr = FALSE;
-    if (pqq_ptr) {
-      P_cache_insert_pending(pending_queries_queue, pqq_ptr, pqq_container);
-      pqq_ptr = 0;
+      P_cache_flush(queries_queue, qq_ptr);
+      qq_ptr = FALSE;
+
+      if (pqq_ptr) {
+        P_cache_insert_pending(pending_queries_queue, pqq_ptr, pqq_container);
+        pqq_ptr = 0;
+      }
     }
 
     /* try to insert again */
@@ -610,36 +623,43 @@ void P_cache_handle_flush_event(struct ports_table *pt)
 {
   pid_t ret;
 
-  if (qq_ptr) P_cache_mark_flush(queries_queue, qq_ptr, FALSE);
+  if (config.dump_purge_mode == PURGE_MODE_THREAD) {
+    P_cache_purge_thread_wait();
+    if (qq_ptr) P_cache_mark_flush(queries_queue, qq_ptr, FALSE);
+    P_cache_purge_thread_start(FALSE);
+  }
+  else {
+    if (qq_ptr) P_cache_mark_flush(queries_queue, qq_ptr, FALSE);
 
-  dump_writers_count();
-  if (dump_writers_get_flags() != CHLD_ALERT) {
-    switch (ret = fork()) {
-    case 0: /* Child */
-      pm_setproctitle("%s %s [%s]", config.type, "Plugin -- Writer", config.name);
-      (*purge_func)(queries_queue, qq_ptr, FALSE);
-      exit(0);
-    default: /* Parent */
-      if (ret == -1) Log(LOG_WARNING, "WARN ( %s/%s ): Unable to fork writer: %s\n", config.name, config.type, strerror(errno));
-      else dump_writers_add(ret);
-
-      break;
+    dump_writers_count();
+    if (dump_writers_get_flags() != CHLD_ALERT) {
+      switch (ret = fork()) {
+      case 0: /* Child */
+        pm_setproctitle("%s %s [%s]", config.type, "Plugin -- Writer", config.name);
+        (*purge_func)(queries_queue, qq_ptr, FALSE);
+        exit(0);
+      default: /* Parent */
+        if (ret == -1) Log(LOG_WARNING, "WARN ( %s/%s ): Unable to fork writer: %s\n", config.name, config.type, strerror(errno));
+        else dump_writers_add(ret);
+
+        break;
+      }
     }
-  }
-  else Log(LOG_WARNING, "WARN ( %s/%s ): Maximum number of writer processes reached (%d).\n", config.name, config.type, dump_writers_get_active());
+    else Log(LOG_WARNING, "WARN ( %s/%s ): Maximum number of writer processes reached (%d).\n", config.name, config.type, dump_writers_get_active());
 
-  P_cache_flush(queries_queue, qq_ptr);
+    P_cache_flush(queries_queue, qq_ptr);
+    qq_ptr = FALSE;
+
+    if (pqq_ptr) {
+      P_cache_insert_pending(pending_queries_queue, pqq_ptr, pqq_container);
+      pqq_ptr = 0;
+    }
+  }
 
   gettimeofday(&flushtime, NULL);
   refresh_deadline += config.sql_refresh_time;
-  qq_ptr = FALSE;
   memset(&new_basetime, 0, sizeof(new_basetime));
 
-  if (pqq_ptr) {
-    P_cache_insert_pending(pending_queries_queue, pqq_ptr, pqq_container);
-    pqq_ptr = 0;
-  }
-
   if (reload_map) {
     load_networks(config.networks_file, &nt, &nc);
     load_ports(config.ports_file, pt);
@@ -715,9 +735,9 @@ void P_cache_flush(struct chained_cache *queue[], int index)
 struct chained_cache *P_cache_attach_new_node(struct chained_cache *elem)
 {
   if ((sa.ptr+sizeof(struct chained_cache)) <= (sa.base+sa.size)) {
-    sa.ptr += sizeof(struct chained_cache);
     elem->next = (struct chained_cache *) sa.ptr;
-    return (struct chained_cache *) sa.ptr;
+    sa.ptr += sizeof(struct chained_cache);
+    return elem->next;
   }
   else return NULL; /* XXX */
 }
@@ -772,8 +792,318 @@ void P_sum_mac_insert(struct primitives_ptrs *prim_ptrs, struct insert_data *ida
 }
 #endif
 
+void P_cache_purge_thread_init()
+{
+#if defined ENABLE_THREADS
+  struct p_cache_gen *gen;
+  sigset_t mask, saved_mask;
+
+  memset(&purge_thread, 0, sizeof(purge_thread));
+  pthread_mutex_init(&purge_thread.mutex, NULL);
+  pthread_cond_init(&purge_thread.cond, NULL);
+
+  /* current generation: allocated by P_init_default_values() */
+  gen = &purge_thread.gen[purge_thread.cur];
+  gen->purge_queue = (struct chained_cache **) pm_malloc((sa.num+config.print_cache_entries)*sizeof(struct chained_cache *));
+
+  /* signals are for the main thread to handle */
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, &saved_mask);
+  purge_thread.pool = allocate_thread_pool(1);
+  pthread_sigmask(SIG_SETMASK, &saved_mask, NULL);
+
+  if (!purge_thread.pool) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): Unable to start purge writer thread. Exiting.\n", config.name, config.type);
+    exit_plugin(1);
+  }
+
+  Log(LOG_INFO, "INFO ( %s/%s ): purge mode: thread\n", config.name, config.type);
+#else
+  Log(LOG_WARNING, "WARN ( %s/%s ): purge mode 'thread' requires --enable-threads. Reverting to 'fork'.\n", config.name, config.type);
+  config.dump_purge_mode = PURGE_MODE_FORK;
+#endif
+}
+
+#if defined ENABLE_THREADS
+static void P_cache_gen_alloc(struct p_cache_gen *gen)
+{
+  gen->cache = (struct chained_cache *) pm_malloc(config.print_cache_entries*dbc_size);
+  gen->queries_queue = (struct chained_cache **) pm_malloc((sa.num+config.print_cache_entries)*sizeof(struct chained_cache *));
+  gen->purge_queue = (struct chained_cache **) pm_malloc((sa.num+config.print_cache_entries)*sizeof(struct chained_cache *));
+  gen->sa.base = (unsigned char *) pm_malloc(sa.size);
+  gen->sa.ptr = gen->sa.base;
+  gen->sa.num = sa.num;
+  gen->sa.size = sa.size;
+  gen->sa.next = NULL;
+
+  memset(gen->cache, 0, config.print_cache_entries*sizeof(struct chained_cache));
+  memset(gen->queries_queue, 0, (sa.num+config.print_cache_entries)*sizeof(struct chained_cache *));
+  memset(gen->sa.base, 0, gen->sa.size);
+
+  Log(LOG_INFO, "INFO ( %s/%s ): purge mode thread: allocated second cache generation\n", config.name, config.type);
+}
+
+static void P_cache_purge_thread_run(void *arg)
+{
+  struct p_cache_gen *gen = (struct p_cache_gen *) arg;
+  struct timeval start, end;
+  struct rusage ru;
+  int j;
+
+  gettimeofday(&start, NULL);
+
+  memcpy(gen->purge_queue, gen->queries_queue, gen->qq_ptr*sizeof(struct chained_cache *));
+  (*purge_func)(gen->purge_queue, gen->qq_ptr, gen->safe_action);
+
+  /* generation is clean for re-use, see P_cache_flush() */
+  for (j = 0; j < gen->qq_ptr; j++) {
+    gen->queries_queue[j]->valid = PRINT_CACHE_FREE;
+    gen->queries_queue[j]->next = NULL;
+  }
+
+  gen->sa.ptr = gen->sa.base;
+
+  gettimeofday(&end, NULL);
+  memset(&ru, 0, sizeof(ru));
+  getrusage(RUSAGE_SELF, &ru);
+
+  Log(LOG_INFO, "INFO ( %s/%s ): purge thread: entries=%u latency=%llums peak_rss=%ldKB\n", config.name, config.type,
+	gen->qq_ptr, (unsigned long long) (((end.tv_sec - start.tv_sec) * 1000) + ((end.tv_usec - start.tv_usec) / 1000)),
+	ru.ru_maxrss);
+
+  gen->qq_ptr = 0;
+
+  pthread_mutex_lock(&purge_thread.mutex);
+  purge_thread.busy = FALSE;
+  pthread_cond_signal(&purge_thread.cond);
+  pthread_mutex_unlock(&purge_thread.mutex);
+}
+#endif
+
+/* waits for the writer thread to be done with the previous generation */
+void P_cache_purge_thread_wait()
+{
+#if defined ENABLE_THREADS
+  struct timeval start, end;
+
+  pthread_mutex_lock(&purge_thread.mutex);
+  if (purge_thread.busy) {
+    gettimeofday(&start, NULL);
+    while (purge_thread.busy) pthread_cond_wait(&purge_thread.cond, &purge_thread.mutex);
+    gettimeofday(&end, NULL);
+
+    Log(LOG_WARNING, "WARN ( %s/%s ): purge thread still busy with previous generation; waited %llums.\n", config.name, config.type,
+	(unsigned long long) (((end.tv_sec - start.tv_sec) * 1000) + ((end.tv_usec - start.tv_usec) / 1000)));
+  }
+  pthread_mutex_unlock(&purge_thread.mutex);
+#endif
+}
+
+/* hands the current generation over to the writer thread, switches
+   inserts over to the other one and re-inserts pending entries in it;
+   P_cache_purge_thread_wait() and P_cache_mark_flush() must have been
+   called beforehand */
+void P_cache_purge_thread_start(int safe_action)
+{
+#if defined ENABLE_THREADS
+  struct p_cache_gen *old, *new;
+
+  old = &purge_thread.gen[purge_thread.cur];
+  new = &purge_thread.gen[!purge_thread.cur];
+
+  if (!new->cache) P_cache_gen_alloc(new);
+
+  old->cache = cache;
+  old->queries_queue = queries_queue;
+  memcpy(&old->sa, &sa, sizeof(struct scratch_area));
+  old->qq_ptr = qq_ptr;
+  old->safe_action = safe_action;
+
+  cache = new->cache;
+  queries_queue = new->queries_queue;
+  memcpy(&sa, &new->sa, sizeof(struct scratch_area));
+  qq_ptr = 0;
+
+  purge_thread.cur = !purge_thread.cur;
+
+  /* pending_queries_queue and pqq_ptr belong to the writer from now on */
+  if (pqq_ptr) {
+    P_cache_insert_pending(pending_queries_queue, pqq_ptr, pqq_container);
+    pqq_ptr = 0;
+  }
+
+  pthread_mutex_lock(&purge_thread.mutex);
+  purge_thread.busy = TRUE;
+  pthread_mutex_unlock(&purge_thread.mutex);
+
+  send_to_pool(purge_thread.pool, P_cache_purge_thread_run, old);
+#endif
+}
+
+#if defined ENABLE_THREADS
+static void P_purge_worker_run(void *arg)
+{
+  struct p_purge_worker *worker = (struct p_purge_worker *) arg;
+  struct p_purge_pool *pool = worker->pool;
+  struct timeval start, end;
+
+  gettimeofday(&start, NULL);
+  (*pool->func)(worker);
+  gettimeofday(&end, NULL);
+
+  worker->entries += worker->index;
+  worker->usecs += ((end.tv_sec - start.tv_sec) * 1000000) + (end.tv_usec - start.tv_usec);
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->running--;
+  if (!pool->running) pthread_cond_signal(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+}
+#endif
+
+/* returns the number of purge workers, 0 if the purge is to be serial */
+int P_purge_pool_init(struct p_purge_pool *pool, void (*func)(struct p_purge_worker *))
+{
+  if (config.dump_purge_threads <= 1) return 0;
+
+#if defined ENABLE_THREADS
+  if (!pool->threads) {
+    sigset_t mask, saved_mask;
+    int idx;
+
+    /* signals are for the main thread to handle */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, &saved_mask);
+    pool->threads = allocate_thread_pool(config.dump_purge_threads);
+    pthread_sigmask(SIG_SETMASK, &saved_mask, NULL);
+
+    if (!pool->threads) {
+      Log(LOG_WARNING, "WARN ( %s/%s ): Unable to start purge worker threads. Purging serially.\n", config.name, config.type);
+      config.dump_purge_threads = 0;
+      return 0;
+    }
+
+    pool->num = config.dump_purge_threads;
+    pool->worker = (struct p_purge_worker *) pm_malloc(pool->num * sizeof(struct p_purge_worker));
+    memset(pool->worker, 0, pool->num * sizeof(struct p_purge_worker));
+
+    for (idx = 0; idx < pool->num; idx++) {
+      pool->worker[idx].id = idx;
+      pool->worker[idx].pool = pool;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+  }
+
+  pool->func = func;
+
+  return pool->num;
+#else
+  Log(LOG_WARNING, "WARN ( %s/%s ): purge threads require --enable-threads. Purging serially.\n", config.name, config.type);
+  config.dump_purge_threads = 0;
+
+  return 0;
+#endif
+}
+
+/*
+   Splits queue across the workers. Without a key function each worker gets
+   a contiguous slice; with one, entries are spread by key, so that all the
+   entries sharing a key (ie. a dynamic topic or routing key) are handled
+   by the same worker, in queue order.
+*/
+void P_purge_pool_partition(struct p_purge_pool *pool, struct chained_cache *queue[], int index, u_int32_t (*key)(struct chained_cache *))
+{
+  struct p_purge_worker *worker;
+  int idx, j, offset;
+
+  if (!key) {
+    for (idx = 0; idx < pool->num; idx++) {
+      worker = &pool->worker[idx];
+      offset = ((long long) index * idx) / pool->num;
+
+      worker->queue = &queue[offset];
+      worker->index = (((long long) index * (idx + 1)) / pool->num) - offset;
+      worker->qn = 0;
+    }
+
+    return;
+  }
+
+  if (pool->part_len < index) {
+    if (pool->part_queue) free(pool->part_queue);
+    if (pool->part_hash) free(pool->part_hash);
+
+    pool->part_queue = (struct chained_cache **) pm_malloc(index * sizeof(struct chained_cache *));
+    pool->part_hash = (u_int32_t *) pm_malloc(index * sizeof(u_int32_t));
+    pool->part_len = index;
+  }
+
+  for (idx = 0; idx < pool->num; idx++) {
+    pool->worker[idx].index = 0;
+    pool->worker[idx].qn = 0;
+  }
+
+  for (j = 0; j < index; j++) {
+    pool->part_hash[j] = (*key)(queue[j]) % pool->num;
+    pool->worker[pool->part_hash[j]].index++;
+  }
+
+  for (idx = 0, offset = 0; idx < pool->num; idx++) {
+    worker = &pool->worker[idx];
+    worker->queue = &pool->part_queue[offset];
+    offset += worker->index;
+    worker->index = 0;
+  }
+
+  for (j = 0; j < index; j++) {
+    worker = &pool->worker[pool->part_hash[j]];
+    worker->queue[worker->index] = queue[j];
+    worker->index++;
+  }
+}
+
+/* runs all the workers over their partitions and waits for completion */
+void P_purge_pool_run(struct p_purge_pool *pool)
+{
+#if defined ENABLE_THREADS
+  int idx;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->running = pool->num;
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (idx = 0; idx < pool->num; idx++)
+    send_to_pool(pool->threads, P_purge_worker_run, &pool->worker[idx]);
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->running) pthread_cond_wait(&pool->cond, &pool->mutex);
+  pthread_mutex_unlock(&pool->mutex);
+#endif
+}
+
+void P_purge_pool_report(struct p_purge_pool *pool)
+{
+  struct p_purge_worker *worker;
+  int idx;
+
+  for (idx = 0; idx < pool->num; idx++) {
+    worker = &pool->worker[idx];
+
+    Log(LOG_INFO, "INFO ( %s/%s ): purge worker #%u: entries=%llu ET=%llums rate=%llu/s\n", config.name, config.type, worker->id,
+	(unsigned long long) worker->entries, (unsigned long long) (worker->usecs / 1000),
+	(unsigned long long) (worker->usecs ? ((worker->entries * 1000000) / worker->usecs) : worker->entries));
+
+    worker->entries = 0;
+    worker->usecs = 0;
+  }
+}
+
 void P_exit_now(int signum)
 {
+  if (config.dump_purge_mode == PURGE_MODE_THREAD) P_cache_purge_thread_wait();
+
   if (qq_ptr) P_cache_mark_flush(queries_queue, qq_ptr, TRUE);
 
   dump_writers_count();
@@ -99,6 +99,68 @@ struct p_broker_timers {
 #if (!defined __PLUGIN_COMMON_EXPORT)
 
 #include "preprocess.h"
+#if defined ENABLE_THREADS
+#include "thread_pool.h"
+
+/*
+   purge_mode: thread. The cache is double-buffered: on purge the filled
+   generation is handed over to a dedicated writer thread while the
+   plugin carries on inserting into the other one; purge_queue is the
+   writer private copy of queries_queue (purge functions reshuffle it).
+*/
+struct p_cache_gen {
+  struct chained_cache *cache;
+  struct chained_cache **queries_queue;
+  struct chained_cache **purge_queue;
+  struct scratch_area sa;
+  int qq_ptr;
+  int safe_action;
+};
+
+struct p_purge_thread {
+  thread_pool_t *pool;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int busy;
+  int cur;
+  struct p_cache_gen gen[2];
+};
+#endif
+
+/*
+   purge_threads: a purge partitions the committed queue across a pool of
+   workers; each worker owns its partition (queue, index), plugin private
+   state (priv, ie. serializer buffers, producer handle, file segment) and
+   throughput counters which are reported at the end of the purge.
+*/
+struct p_purge_pool;
+
+struct p_purge_worker {
+  int id;
+  struct chained_cache **queue;
+  int index;
+  int qn;
+  int ret;		/* ERR if the worker gave up on its share */
+  void *priv;
+  u_int64_t entries;
+  u_int64_t usecs;
+  struct p_purge_pool *pool;
+};
+
+struct p_purge_pool {
+  int num;
+  struct p_purge_worker *worker;
+  void (*func)(struct p_purge_worker *);
+  struct chained_cache **part_queue;
+  u_int32_t *part_hash;
+  int part_len;
+#if defined ENABLE_THREADS
+  thread_pool_t *threads;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int running;
+#endif
+};
 
 /* prototypes */
 #if (!defined __PLUGIN_COMMON_C)
@@ -123,6 +185,13 @@ EXT void P_cache_insert_pending(struct chained_cache *[], int, struct chained_ca
 EXT void P_cache_mark_flush(struct chained_cache *[], int, int);
 EXT void P_cache_flush(struct chained_cache *[], int);
 EXT void P_cache_handle_flush_event(struct ports_table *);
+EXT void P_cache_purge_thread_init();
+EXT void P_cache_purge_thread_wait();
+EXT void P_cache_purge_thread_start(int);
+EXT int P_purge_pool_init(struct p_purge_pool *, void (*)(struct p_purge_worker *));
+EXT void P_purge_pool_partition(struct p_purge_pool *, struct chained_cache *[], int, u_int32_t (*)(struct chained_cache *));
+EXT void P_purge_pool_run(struct p_purge_pool *);
+EXT void P_purge_pool_report(struct p_purge_pool *);
 EXT void P_exit_now(int);
 EXT int P_trigger_exec(char *);
 EXT void primptrs_set_all_from_chained_cache(struct primitives_ptrs *, struct chained_cache *);
@@ -158,6 +227,9 @@ EXT int (*basetime_cmp)(struct timeval *, struct timeval *);
 EXT struct timeval basetime, ibasetime, new_basetime;
 EXT time_t timeslot;
 EXT int dyn_table;
+#if defined ENABLE_THREADS
+EXT struct p_purge_thread purge_thread;
+#endif
 
 #ifdef WITH_AVRO
 EXT avro_schema_t avro_acct_schema;
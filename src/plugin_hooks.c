@@ -28,6 +28,13 @@
 #include "plugin_hooks.h"
 #include "plugin_common.h"
 #include "pkt_handlers.h"
+#if defined HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+/* variables */
+static struct id_table_reload_set ptm_reload;
+static int exec_plugins_depth; /* >1 if re-entered via a pre_tag_map JEQ */
 
 /* functions */
 
@@ -106,6 +113,33 @@ void load_plugins(struct plugin_requests *req)
       while (list->cfg.buffer_size % 4 != 0) list->cfg.buffer_size--;
 #endif
 
+      if (list->cfg.pipe_ring) {
+	if (list->type.id == PLUGIN_ID_MEMORY) {
+	  Log(LOG_WARNING, "WARN ( %s/%s ): 'plugin_pipe_ring' is not supported by the memory plugin. Disabled.\n", list->name, list->type.string);
+	  list->cfg.pipe_ring = FALSE;
+	}
+	else {
+	  /* at least two buffers: one being filled, one being read; at most
+	     MAX_SEQNUM-1 not to get sequence numbers ambiguous across laps */
+	  if ((list->cfg.pipe_size/list->cfg.buffer_size) < 2) list->cfg.pipe_size = list->cfg.buffer_size*2;
+	  if ((list->cfg.pipe_size/list->cfg.buffer_size) >= MAX_SEQNUM) {
+	    list->cfg.pipe_size = list->cfg.buffer_size*(MAX_SEQNUM-1);
+	    Log(LOG_WARNING, "WARN ( %s/%s ): 'plugin_pipe_ring' holds at most %u buffers: plugin_pipe_size reduced to %llu bytes.\n",
+		list->name, list->type.string, (MAX_SEQNUM-1), list->cfg.pipe_size);
+	  }
+	}
+      }
+
+#if defined HAVE_EVENTFD
+      if (list->cfg.pipe_ring) {
+	/* both ends share the eventfd: the Core Process signals, the plugin drains */
+	if ((list->pipe[0] = list->pipe[1] = eventfd(0, EFD_NONBLOCK)) == -1) {
+	  Log(LOG_ERR, "ERROR ( %s/%s ): eventfd() failed: %s\nExiting.\n", list->name, list->type.string, strerror(errno));
+	  exit_all(1);
+	}
+      }
+      else
+#endif
       if (!list->cfg.pipe_amqp) {
         /* creating communication channel */
         socketpair(AF_UNIX, SOCK_DGRAM, 0, list->pipe);
@@ -261,11 +295,11 @@ void load_plugins(struct plugin_requests *req)
 
 	close(config.sock);
 	close(config.bgp_sock);
-	if (!list->cfg.pipe_amqp) close(list->pipe[1]);
+	if (!list->cfg.pipe_amqp && !list->cfg.pipe_ring) close(list->pipe[1]);
 	(*list->type.func)(list->pipe[0], &list->cfg, chptr);
 	exit(0);
       default: /* Parent */
-	if (!list->cfg.pipe_amqp) {
+	if (!list->cfg.pipe_amqp && !list->cfg.pipe_ring) {
 	  close(list->pipe[0]);
 	  setnonblocking(list->pipe[1]);
 	}
@@ -423,6 +457,7 @@ void exec_plugins(struct packet_ptrs *pptrs, struct plugin_requests *req)
   int index, got_tags = FALSE;
 
   pretag_init_label(&saved_label);
+  exec_plugins_depth++;
 
 #if defined WITH_GEOIPV2
   if (reload_geoipv2_file && config.geoipv2_file) {
@@ -523,6 +558,9 @@ reprocess:
 
       if (((channels_list[index].bufptr + fixed_size) > channels_list[index].bufend) ||
 	  (channels_list[index].hdr.num == INT_MAX) || channels_list[index].buffer_immediate) {
+	/* ring full: the buffer is dropped and its slot is filled again */
+	if (channels_list[index].plugin->cfg.pipe_ring && plugin_pipe_ring_full(&channels_list[index])) goto ring_full;
+
 	channels_list[index].hdr.seq++;
 	channels_list[index].hdr.seq %= MAX_SEQNUM;
 
@@ -561,6 +599,7 @@ reprocess:
 	  ret = p_kafka_produce_data(&chptr->kafka_host, chptr->rg.ptr, chptr->bufsize);
 #endif
 	}
+	else if (channels_list[index].plugin->cfg.pipe_ring) plugin_pipe_ring_commit(&channels_list[index]);
 	else {
 	  if (channels_list[index].status->wakeup) {
 	    channels_list[index].status->backlog++;
@@ -588,6 +627,7 @@ reprocess:
         ((struct ch_buf_hdr *)channels_list[index].rg.ptr)->num = 0;
         ((struct ch_buf_hdr *)channels_list[index].rg.ptr)->core_pid = 0;
 
+        ring_full:
         /* rewind pointer */
         channels_list[index].bufptr = channels_list[index].buf;
         channels_list[index].hdr.num = 0;
@@ -605,35 +645,57 @@ reprocess:
     pretag_free_label(&pptrs->label);
   }
 
-  /* check if we have to reload the map: new loop is to
-     ensure we reload it for all plugins and prevent any
-     timing issues with pointers to labels */
-  if (reload_map_exec_plugins) {
-    memset(&req->ptm_c, 0, sizeof(struct ptm_complex)); 
+  /* check if we have to reload the map: maps are built in the
+     background and swapped in here, once all plugins are served,
+     to prevent any timing issues with pointers to labels. Nested
+     calls are made while the outer one still walks the entries of
+     the current map, hence tables are touched at the top level only */
+  if (exec_plugins_depth > 1) goto exit_lane;
 
+  if (reload_map_exec_plugins && pretag_reload_begin(&ptm_reload)) {
     for (index = 0; channels_list[index].aggregation || channels_list[index].aggregation_2; index++) {
       struct plugins_list_entry *p = channels_list[index].plugin;
+      struct id_table_reload *ptm_slot;
 
       if (p->cfg.pre_tag_map && find_id_func) {
-        if (p->cfg.type_id == PLUGIN_ID_TEE) {
-          req->ptm_c.load_ptm_plugin = p->cfg.type_id;
-          req->ptm_c.load_ptm_res = FALSE;
+        ptm_slot = pretag_reload_add(&ptm_reload, config.acct_type, p->cfg.pre_tag_map, &p->cfg.ptm, &p->cfg.ptm_alloc);
+        if (ptm_slot) {
+          ptm_slot->req.map_entries = p->cfg.maps_entries;
+          ptm_slot->req.map_row_len = p->cfg.maps_row_len;
+          ptm_slot->req.ptm_c.load_ptm_plugin = p->cfg.type_id;
+          ptm_slot->owner = p;
         }
+      }
+    }
 
-        load_pre_tag_map(config.acct_type, p->cfg.pre_tag_map, &p->cfg.ptm, req, &p->cfg.ptm_alloc,
-                         p->cfg.maps_entries, p->cfg.maps_row_len);
+    pretag_reload_end(&ptm_reload);
+    reload_map_exec_plugins = FALSE;
+  }
 
-        if (p->cfg.type_id == PLUGIN_ID_TEE) {
-          p->cfg.ptm_complex = req->ptm_c.load_ptm_res;
-          if (req->ptm_c.load_ptm_res) req->ptm_c.exec_ptm_dissect = TRUE;
-        }
-      }
+  if (pretag_reload_poll(&ptm_reload)) {
+    req->ptm_c.exec_ptm_dissect = FALSE;
+
+    for (index = 0; index < ptm_reload.num; index++) {
+      struct id_table_reload *ptm_slot = &ptm_reload.slot[index];
+      struct plugins_list_entry *p = ptm_slot->owner;
+
+      if (!ptm_slot->published) continue;
+
+      if (ptm_slot->req.bpf_filter) req->bpf_filter = TRUE;
+      if (p->cfg.type_id == PLUGIN_ID_TEE) p->cfg.ptm_complex = ptm_slot->req.ptm_c.load_ptm_res;
+    }
+
+    for (index = 0; channels_list[index].aggregation || channels_list[index].aggregation_2; index++) {
+      struct plugins_list_entry *p = channels_list[index].plugin;
+
+      if (p->cfg.type_id == PLUGIN_ID_TEE && p->cfg.ptm_complex) req->ptm_c.exec_ptm_dissect = TRUE;
     }
   }
 
+  exit_lane:
   /* cleanups */
-  reload_map_exec_plugins = FALSE;
   pretag_free_label(&saved_label);
+  exec_plugins_depth--;
 }
 
 struct channels_list_entry *insert_pipe_channel(int plugin_type, struct configuration *cfg, int pipe)
@@ -666,6 +728,7 @@ struct channels_list_entry *insert_pipe_channel(int plugin_type, struct configur
       chptr->buf = 0;
       chptr->bufptr = chptr->buf;
       chptr->bufend = cfg->buffer_size-sizeof(struct ch_buf_hdr);
+      chptr->ring_slots = cfg->pipe_size/cfg->buffer_size;
 
       // XXX: no need to map_shared() if using AMQP
       /* +PKT_MSG_SIZE has been introduced as a margin as a
@@ -880,6 +943,8 @@ void fill_pipe_buffer()
   for (index = 0; channels_list[index].aggregation || channels_list[index].aggregation_2; index++) {
     chptr = &channels_list[index];
 
+    if (chptr->plugin->cfg.pipe_ring && plugin_pipe_ring_full(chptr)) continue;
+
     chptr->hdr.seq++;
     chptr->hdr.seq %= MAX_SEQNUM;
 
@@ -897,6 +962,7 @@ void fill_pipe_buffer()
       p_kafka_produce_data(&chptr->kafka_host, chptr->rg.ptr, chptr->bufsize);
 #endif
     }
+    else if (chptr->plugin->cfg.pipe_ring) plugin_pipe_ring_commit(chptr);
     else {
       if (chptr->status->wakeup) {
         chptr->status->wakeup = chptr->request;
@@ -1259,4 +1325,100 @@ void plugin_pipe_check(struct configuration *cfg)
     cfg->pipe_kafka = FALSE;
     cfg->pipe_homegrown = TRUE;
   }
+
+  if (cfg->pipe_ring) {
+#if defined HAVE_EVENTFD
+    if (!cfg->pipe_homegrown) {
+      Log(LOG_WARNING, "WARN ( %s/%s ): 'plugin_pipe_ring' applies to the home-grown queue only: disabled.\n", cfg->name, cfg->type);
+      cfg->pipe_ring = FALSE;
+    }
+#else
+    Log(LOG_WARNING, "WARN ( %s/%s ): 'plugin_pipe_ring' requires eventfd() support: disabled.\n", cfg->name, cfg->type);
+    cfg->pipe_ring = FALSE;
+#endif
+  }
+}
+
+/* plugin_pipe_ring_full(): Core Process side; true if committing the
+   current buffer would leave no free slot to move on to. Drops are
+   accounted here */
+int plugin_pipe_ring_full(struct channels_list_entry *chptr)
+{
+  struct ch_status *status = chptr->status;
+  time_t now;
+
+  if ((status->head - status->tail + 2) <= chptr->ring_slots) return FALSE;
+
+  status->drops++;
+
+  now = time(NULL);
+  if (now >= (chptr->ring_drops_log + CH_RING_DROPS_LOG_INTERVAL)) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): plugin_pipe_ring full: %llu buffers dropped so far (plugin_buffer_size=%llu plugin_pipe_size=%llu).\n",
+	chptr->plugin->cfg.name, chptr->plugin->cfg.type, (unsigned long long)status->drops,
+	chptr->plugin->cfg.buffer_size, chptr->plugin->cfg.pipe_size);
+    chptr->ring_drops_log = now;
+  }
+
+  return TRUE;
+}
+
+/* plugin_pipe_ring_commit(): Core Process side; publishes a committed
+   buffer and signals the plugin only if it went idle waiting for data */
+void plugin_pipe_ring_commit(struct channels_list_entry *chptr)
+{
+  struct ch_status *status = chptr->status;
+
+  __sync_synchronize();
+  status->head++;
+  __sync_synchronize();
+
+  if (status->wakeup) {
+    u_int64_t one = 1;
+
+    status->wakeup = chptr->request;
+    if (write(chptr->pipe, &one, sizeof(one)) != sizeof(one))
+      Log(LOG_WARNING, "WARN ( %s/%s ): Failed during write: %s\n", chptr->plugin->cfg.name, chptr->plugin->cfg.type, strerror(errno));
+  }
+}
+
+/* plugin_pipe_ring_release(): plugin side; to be called once a buffer
+   has been copied off the ring so that its slot can be reused */
+void plugin_pipe_ring_release(struct ch_status *status)
+{
+  if (config.pipe_ring) {
+    __sync_synchronize();
+    status->tail++;
+  }
+}
+
+/* plugin_pipe_poll(): plugin side poll() of the queue. With the ring,
+   'wakeup' is raised and pending buffers looked for before sleeping so
+   that a commit racing with it is not missed; stale signals are drained
+   and do not count as a wakeup */
+int plugin_pipe_poll(struct pollfd *pfd, struct ch_status *status, int timeout)
+{
+  int ret;
+
+  if (!config.pipe_ring || pfd->fd == ERR) return poll(pfd, (pfd->fd == ERR ? 0 : 1), timeout);
+
+  for (;;) {
+    status->wakeup = TRUE;
+    __sync_synchronize();
+
+    if (status->head != status->tail) {
+      status->wakeup = FALSE;
+      return 1;
+    }
+
+    ret = poll(pfd, 1, timeout);
+    if (ret <= 0) return ret;
+
+#if defined HAVE_EVENTFD
+    {
+      u_int64_t cnt;
+
+      if (read(pfd->fd, &cnt, sizeof(cnt)) == -1 && errno != EAGAIN) return ERR;
+    }
+#endif
+  }
 }
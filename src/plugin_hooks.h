@@ -19,6 +19,8 @@
     Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 */
 
+#include <sys/poll.h>
+
 #define __PLUGIN_COMMON_EXPORT
 #include "plugin_common.h"
 #undef  __PLUGIN_COMMON_EXPORT
@@ -30,6 +32,9 @@
 #define MAX_FAILS 5 
 #define MAX_SEQNUM 65536 
 #define MAX_RG_COUNT_ERR 3 
+#define MAX_TPL_PROG_HANDLERS 12
+#define CH_CACHELINE_SZ 64
+#define CH_RING_DROPS_LOG_INTERVAL 60
 
 struct channels_list_entry;
 typedef void (*pkt_handler) (struct channels_list_entry *, struct packet_ptrs *, char **);
@@ -53,6 +58,13 @@ struct ch_status {
   u_int8_t wakeup;		/* plugin is polling */ 
   u_int32_t backlog;
   u_int64_t last_buf_off;	/* offset of last committed buffer */
+
+  /* plugin_pipe_ring: buffers committed by the Core Process and buffers
+     released by the plugin; kept on separate cache lines not to bounce
+     between producer and consumer */
+  u_int64_t head __attribute__ ((aligned (CH_CACHELINE_SZ)));
+  u_int64_t drops;		/* buffers dropped due to a full ring */
+  u_int64_t tail __attribute__ ((aligned (CH_CACHELINE_SZ)));
 };
 
 struct sampling {
@@ -111,7 +123,12 @@ struct channels_list_entry {
   int buffer_immediate;
   int same_aggregate;
   pkt_handler phandler[N_PRIMITIVES];
+  u_int32_t tpl_prog_mask;				/* NetFlow v9/IPFIX primitives decoded via compiled templates */
+  pkt_handler tpl_prog_fallback[MAX_TPL_PROG_HANDLERS];	/* handlers replaced by NF_tpl_prog_handler() */
+  int tpl_prog_idx;					/* compiled template slot; stable across delete_pipe_channel() */
   int pipe;
+  u_int64_t ring_slots;					/* plugin_pipe_ring: number of buffers in the ring */
+  time_t ring_drops_log;				/* plugin_pipe_ring: last time drops were logged */
   pid_t core_pid;
   pm_id_t tag;						/* post-tagging tag */
   pm_id_t tag2;						/* post-tagging tag2 */
@@ -191,6 +208,10 @@ EXT int plugin_pipe_kafka_connect_to_consume(struct p_kafka_host *, struct plugi
 EXT void plugin_pipe_amqp_compile_check();
 EXT void plugin_pipe_kafka_compile_check();
 EXT void plugin_pipe_check(struct configuration *);
+EXT int plugin_pipe_ring_full(struct channels_list_entry *);
+EXT void plugin_pipe_ring_commit(struct channels_list_entry *);
+EXT void plugin_pipe_ring_release(struct ch_status *);
+EXT int plugin_pipe_poll(struct pollfd *, struct ch_status *, int);
 EXT int plugin_pipe_set_retry_timeout(struct p_broker_timers *, int);
 EXT int plugin_pipe_calc_retry_timeout_diff(struct p_broker_timers *, time_t);
 
@@ -340,6 +340,7 @@ static const struct _dictionary_line dictionary[] = {
   {"plugin_pipe_size", cfg_key_plugin_pipe_size},
   {"plugin_pipe_backlog", cfg_key_plugin_pipe_backlog},
   {"plugin_pipe_check_core_pid", cfg_key_plugin_pipe_check_core_pid},
+  {"plugin_pipe_ring", cfg_key_plugin_pipe_ring},
   {"plugin_pipe_amqp", cfg_key_plugin_pipe_amqp},
   {"plugin_pipe_amqp_user", cfg_key_plugin_pipe_amqp_user},
   {"plugin_pipe_amqp_passwd", cfg_key_plugin_pipe_amqp_passwd},
@@ -422,6 +423,8 @@ static const struct _dictionary_line dictionary[] = {
   {"print_history_offset", cfg_key_sql_history_offset},
   {"print_history_roundoff", cfg_key_sql_history_roundoff},
   {"print_max_writers", cfg_key_dump_max_writers},
+  {"print_purge_mode", cfg_key_dump_purge_mode},
+  {"print_purge_threads", cfg_key_dump_purge_threads},
   {"print_preprocess", cfg_key_sql_preprocess},
   {"print_preprocess_type", cfg_key_sql_preprocess_type},
   {"print_startup_delay", cfg_key_sql_startup_delay},
@@ -439,6 +442,7 @@ static const struct _dictionary_line dictionary[] = {
   {"mongo_insert_batch", cfg_key_mongo_insert_batch},
   {"mongo_indexes_file", cfg_key_sql_table_schema},
   {"mongo_max_writers", cfg_key_dump_max_writers},
+  {"mongo_purge_mode", cfg_key_dump_purge_mode},
   {"mongo_preprocess", cfg_key_sql_preprocess},
   {"mongo_preprocess_type", cfg_key_sql_preprocess_type},
   {"mongo_startup_delay", cfg_key_sql_startup_delay},
@@ -461,6 +465,8 @@ static const struct _dictionary_line dictionary[] = {
   {"amqp_frame_max", cfg_key_amqp_frame_max},
   {"amqp_cache_entries", cfg_key_print_cache_entries},
   {"amqp_max_writers", cfg_key_dump_max_writers},
+  {"amqp_purge_mode", cfg_key_dump_purge_mode},
+  {"amqp_purge_threads", cfg_key_dump_purge_threads},
   {"amqp_preprocess", cfg_key_sql_preprocess},
   {"amqp_preprocess_type", cfg_key_sql_preprocess_type},
   {"amqp_startup_delay", cfg_key_sql_startup_delay},
@@ -484,6 +490,8 @@ static const struct _dictionary_line dictionary[] = {
   {"kafka_partition_key", cfg_key_kafka_partition_key},
   {"kafka_cache_entries", cfg_key_print_cache_entries},
   {"kafka_max_writers", cfg_key_dump_max_writers},
+  {"kafka_purge_mode", cfg_key_dump_purge_mode},
+  {"kafka_purge_threads", cfg_key_dump_purge_threads},
   {"kafka_preprocess", cfg_key_sql_preprocess},
   {"kafka_preprocess_type", cfg_key_sql_preprocess_type},
   {"kafka_startup_delay", cfg_key_sql_startup_delay},
@@ -506,6 +514,8 @@ static const struct _dictionary_line dictionary[] = {
   {"nfacctd_mcast_groups", cfg_key_nfacctd_mcast_groups},
   {"nfacctd_peer_as", cfg_key_nfprobe_peer_as},
   {"nfacctd_pipe_size", cfg_key_nfacctd_pipe_size},
+  {"nfacctd_workers", cfg_key_nfacctd_workers},
+  {"nfacctd_recv_batch", cfg_key_nfacctd_recv_batch},
   {"nfacctd_pro_rating", cfg_key_nfacctd_pro_rating},
   {"nfacctd_templates_file", cfg_key_nfacctd_templates_file},
   {"nfacctd_account_options", cfg_key_nfacctd_account_options},
@@ -526,6 +536,9 @@ static const struct _dictionary_line dictionary[] = {
   {"pmacctd_stitching", cfg_key_nfacctd_stitching},
   {"pmacctd_renormalize", cfg_key_sfacctd_renormalize},
   {"pmacctd_nonroot", cfg_key_pmacctd_nonroot},
+  {"pmacctd_workers", cfg_key_nfacctd_workers},
+  {"pmacctd_tpacket_v3", cfg_key_pmacctd_tpacket_v3},
+  {"pmacctd_tpacket_ring_size", cfg_key_pmacctd_tpacket_ring_size},
   {"uacctd_proc_name", cfg_key_proc_name},
   {"uacctd_force_frag_handling", cfg_key_pmacctd_force_frag_handling},
   {"uacctd_frag_buffer_size", cfg_key_pmacctd_frag_buffer_size},
@@ -615,6 +628,8 @@ static const struct _dictionary_line dictionary[] = {
   {"sfacctd_net", cfg_key_nfacctd_net},
   {"sfacctd_peer_as", cfg_key_nfprobe_peer_as},
   {"sfacctd_pipe_size", cfg_key_nfacctd_pipe_size},
+  {"sfacctd_workers", cfg_key_nfacctd_workers},
+  {"sfacctd_recv_batch", cfg_key_nfacctd_recv_batch},
   {"sfacctd_renormalize", cfg_key_sfacctd_renormalize},
   {"sfacctd_disable_checks", cfg_key_nfacctd_disable_checks},
   {"sfacctd_mcast_groups", cfg_key_nfacctd_mcast_groups},
@@ -671,6 +686,7 @@ static const struct _dictionary_line dictionary[] = {
   {"tee_ipprec", cfg_key_nfprobe_ip_precedence},
   {"tee_pipe_size", cfg_key_tee_pipe_size},
   {"tee_dissect_send_full_pkt", cfg_key_tee_dissect_send_full_pkt},
+  {"tee_batch_size", cfg_key_tee_batch_size},
   {"bgp_daemon", cfg_key_nfacctd_bgp},
   {"bgp_daemon_ip", cfg_key_nfacctd_bgp_ip},
   {"bgp_daemon_id", cfg_key_nfacctd_bgp_id},
@@ -678,6 +694,7 @@ static const struct _dictionary_line dictionary[] = {
   {"bgp_daemon_port", cfg_key_nfacctd_bgp_port},
   {"bgp_daemon_pipe_size", cfg_key_nfacctd_bgp_pipe_size},
   {"bgp_daemon_max_peers", cfg_key_nfacctd_bgp_max_peers},
+  {"bgp_daemon_threads", cfg_key_nfacctd_bgp_threads},
   {"bgp_daemon_msglog_output", cfg_key_nfacctd_bgp_msglog_output},
   {"bgp_daemon_msglog_file", cfg_key_nfacctd_bgp_msglog_file},
   {"bgp_daemon_msglog_amqp_host", cfg_key_nfacctd_bgp_msglog_amqp_host},
@@ -732,6 +749,7 @@ static const struct _dictionary_line dictionary[] = {
   {"bgp_table_per_peer_buckets", cfg_key_nfacctd_bgp_table_per_peer_buckets},
   {"bgp_table_attr_hash_buckets", cfg_key_nfacctd_bgp_table_attr_hash_buckets},
   {"bgp_table_per_peer_hash", cfg_key_nfacctd_bgp_table_per_peer_hash},
+  {"bgp_table_per_peer_index", cfg_key_nfacctd_bgp_table_per_peer_index},
   {"bgp_table_dump_output", cfg_key_nfacctd_bgp_table_dump_output},
   {"bgp_table_dump_file", cfg_key_nfacctd_bgp_table_dump_file},
   {"bgp_table_dump_latest_file", cfg_key_nfacctd_bgp_table_dump_latest_file},
@@ -789,6 +807,7 @@ static const struct _dictionary_line dictionary[] = {
   {"bmp_table_per_peer_buckets", cfg_key_nfacctd_bmp_table_per_peer_buckets},
   {"bmp_table_attr_hash_buckets", cfg_key_nfacctd_bmp_table_attr_hash_buckets},
   {"bmp_table_per_peer_hash", cfg_key_nfacctd_bmp_table_per_peer_hash},
+  {"bmp_table_per_peer_index", cfg_key_nfacctd_bmp_table_per_peer_index},
   {"bmp_dump_output", cfg_key_nfacctd_bmp_dump_output},
   {"bmp_dump_file", cfg_key_nfacctd_bmp_dump_file},
   {"bmp_dump_latest_file", cfg_key_nfacctd_bmp_dump_latest_file},
@@ -31,6 +31,13 @@
 #define N_PRIMITIVES 57
 #define N_FUNCS 10 
 #define MAX_N_PLUGINS 32
+#define MAX_CORE_WORKERS 64
+#define MAX_RECV_BATCH 1024
+#define MAX_TEE_BATCH 1024
+#define TPACKET_V3_BLOCK_SIZE (1 << 20)
+#define TPACKET_V3_MIN_RING_SIZE (2 * TPACKET_V3_BLOCK_SIZE)
+#define TPACKET_V3_DEFAULT_RING_SIZE (64 * TPACKET_V3_BLOCK_SIZE)
+#define TPACKET_V3_RETIRE_TOV 64 /* msecs */
 #define PROTO_LEN 12
 #define MAX_MAP_ENTRIES 2048 /* allow maps */
 #define BGP_MD5_MAP_ENTRIES 8192
@@ -383,6 +390,9 @@
 #define PRINT_OUTPUT_EVENT	0x00000008
 #define PRINT_OUTPUT_AVRO  	0x00000010
 
+#define PURGE_MODE_FORK		0x00000000
+#define PURGE_MODE_THREAD	0x00000001
+
 #define DIRECTION_UNKNOWN	0x00000000
 #define DIRECTION_IN		0x00000001
 #define DIRECTION_OUT		0x00000002
@@ -36,6 +36,7 @@
 #include "bgp/bgp.h"
 #include "classifier.h"
 #include "isis/isis.h"
+#include "tpacket.h"
 
 #if defined WITH_NDPI
 #include "ndpi/ndpi_util.h"
@@ -113,6 +114,10 @@ int main(int argc,char **argv, char **envp)
   struct id_table biss_table;
   struct id_table bta_table;
   struct pcap_callback_data cb_data;
+#if defined HAVE_TPACKET_V3
+  struct tpacket_v3_ring tpacket_ring;
+  u_int16_t fanout_id = 0;
+#endif
 
   /* getopt() stuff */
   extern char *optarg;
@@ -646,6 +651,52 @@ int main(int argc,char **argv, char **envp)
     list = list->next;
   }
 
+  if (config.pmacctd_tpacket_v3) {
+#if !defined HAVE_TPACKET_V3
+    Log(LOG_ERR, "ERROR ( %s/core ): 'pmacctd_tpacket_v3' requires Linux TPACKET_V3 support. Exiting.\n", config.name);
+    exit(1);
+#endif
+    if (config.pcap_savefile) {
+      Log(LOG_WARNING, "WARN ( %s/core ): 'pmacctd_tpacket_v3' does not apply to 'pcap_savefile'. Ignored.\n", config.name);
+      config.pmacctd_tpacket_v3 = FALSE;
+    }
+    if (!config.pmacctd_tpacket_ring_size) config.pmacctd_tpacket_ring_size = TPACKET_V3_DEFAULT_RING_SIZE;
+  }
+
+  if (config.nfacctd_workers > 1) {
+#if !defined HAVE_TPACKET_V3
+    Log(LOG_ERR, "ERROR ( %s/core ): 'pmacctd_workers' requires Linux PACKET_FANOUT support. Exiting.\n", config.name);
+    exit(1);
+#else
+    if (config.pcap_savefile) {
+      Log(LOG_ERR, "ERROR ( %s/core ): 'pmacctd_workers' is not compatible with 'pcap_savefile'. Exiting.\n", config.name);
+      exit(1);
+    }
+
+    if (config.nfacctd_bgp || config.nfacctd_isis) {
+      Log(LOG_ERR, "ERROR ( %s/core ): 'pmacctd_workers' is not compatible with bgp_daemon and isis_daemon. Exiting.\n", config.name);
+      exit(1);
+    }
+
+    list = plugins_list;
+    while (list) {
+      /* every worker runs its own copy of the plugins: only those keying
+	 their state by flow, which the fanout hash keeps on one worker, qualify */
+      if (list->type.id != PLUGIN_ID_CORE && list->type.id != PLUGIN_ID_NFPROBE &&
+	  list->type.id != PLUGIN_ID_SFPROBE) {
+	Log(LOG_ERR, "ERROR ( %s/core ): 'pmacctd_workers' is supported only with 'nfprobe' and 'sfprobe' plugins ('%s' is a '%s' plugin). Exiting.\n",
+	    config.name, list->name, list->type.string);
+	exit(1);
+      }
+      list = list->next;
+    }
+
+    /* the fanout group is shared by all workers */
+    fanout_id = (getpid() & 0xFFFF);
+    core_workers_spawn();
+#endif
+  }
+
   load_plugins(&req);
 
   if (config.handle_fragments) init_ip_fragment_handler();
@@ -673,6 +724,22 @@ int main(int argc,char **argv, char **envp)
   }
 
   throttle_startup:
+#if defined HAVE_TPACKET_V3
+  if (config.pmacctd_tpacket_v3) {
+    if (tpacket_v3_open(&tpacket_ring, config.dev, psize, config.promisc, config.pmacctd_tpacket_ring_size) == ERR) {
+      if (!config.if_wait) exit_all(1);
+      else {
+        sleep(5); /* XXX: user defined ? */
+        goto throttle_startup;
+      }
+    }
+
+    /* a dead handle for the sake of filter compilation */
+    device.dev_desc = pcap_open_dead(DLT_EN10MB, psize);
+    glob_tpacket = &tpacket_ring;
+  }
+  else
+#endif
   if (config.dev) {
     if ((device.dev_desc = pcap_open_live(config.dev, psize, config.promisc, 1000, errbuf)) == NULL) {
       if (!config.if_wait) {
@@ -694,7 +761,7 @@ int main(int argc,char **argv, char **envp)
 
   device.active = TRUE;
   glob_pcapt = device.dev_desc; /* SIGINT/stats handling */
-  if (config.nfacctd_pipe_size) {
+  if (config.nfacctd_pipe_size && !config.pmacctd_tpacket_v3) {
     int slen = sizeof(config.nfacctd_pipe_size), x;
 
 #if defined (PCAP_TYPE_linux) || (PCAP_TYPE_snoop)
@@ -704,7 +771,8 @@ int main(int argc,char **argv, char **envp)
 #endif
   }
 
-  device.link_type = pcap_datalink(device.dev_desc);
+  if (config.pmacctd_tpacket_v3) device.link_type = DLT_EN10MB;
+  else device.link_type = pcap_datalink(device.dev_desc);
   for (index = 0; _devices[index].link_type != -1; index++) {
     if (device.link_type == _devices[index].link_type)
       device.data = &_devices[index];
@@ -738,13 +806,27 @@ int main(int argc,char **argv, char **envp)
     if (config.dev) Log(LOG_WARNING, "WARN ( %s/core ): %s\n", config.name, errbuf);
   }
 
+  memset(&filter, 0, sizeof(filter));
   if (pcap_compile(device.dev_desc, &filter, config.clbuf, 0, netmask) < 0)
     Log(LOG_WARNING, "WARN ( %s/core ): %s (going on without a filter)\n", config.name, pcap_geterr(device.dev_desc));
+#if defined HAVE_TPACKET_V3
+  else if (config.pmacctd_tpacket_v3) {
+    if (tpacket_v3_setfilter(&tpacket_ring, &filter) == ERR)
+      Log(LOG_WARNING, "WARN ( %s/core ): going on without a filter\n", config.name);
+  }
+#endif
   else {
     if (pcap_setfilter(device.dev_desc, &filter) < 0)
       Log(LOG_WARNING, "WARN ( %s/core ): %s (going on without a filter)\n", config.name, pcap_geterr(device.dev_desc));
   }
 
+#if defined HAVE_TPACKET_V3
+  if (config.nfacctd_workers > 1) {
+    if (tpacket_fanout_join(config.pmacctd_tpacket_v3 ? tpacket_ring.fd : pcap_fileno(device.dev_desc), fanout_id) == ERR)
+      exit_all(1);
+  }
+#endif
+
   /* signal handling we want to inherit to plugins (when not re-defined elsewhere) */
   signal(SIGCHLD, startup_handle_falling_child); /* takes note of plugins failed during startup phase */
   signal(SIGHUP, reload); /* handles reopening of syslog channel */
@@ -859,7 +941,8 @@ int main(int argc,char **argv, char **envp)
 
   /* plugins glue: creation (until 093) */
   evaluate_packet_handlers();
-  pm_setproctitle("%s [%s]", "Core Process", config.proc_name);
+  if (config.nfacctd_worker_id) pm_setproctitle("%s #%u [%s]", "Core Process", config.nfacctd_worker_id, config.proc_name);
+  else pm_setproctitle("%s [%s]", "Core Process", config.proc_name);
   if (config.pidfile) write_pid_file(config.pidfile);
 
   /* signals to be handled only by the core process;
@@ -884,6 +967,7 @@ int main(int argc,char **argv, char **envp)
     prefs.decode_tunnels = 0;
     prefs.num_roots = NUM_ROOTS;
     prefs.max_ndpi_flows = MAX_NDPI_FLOWS;
+    prefs.max_flows_memory = MAX_FLOWS_MEMORY;
     prefs.quiet_mode = 0;
 
     workflow = ndpi_workflow_init(&prefs, glob_pcapt);
@@ -892,6 +976,25 @@ int main(int argc,char **argv, char **envp)
   /* Main loop: if pcap_loop() exits maybe an error occurred; we will try closing
      and reopening again our listening device */
   for(;;) {
+#if defined HAVE_TPACKET_V3
+    if (config.pmacctd_tpacket_v3) {
+      if (!device.active) {
+        Log(LOG_WARNING, "WARN ( %s/core ): %s has become unavailable; throttling ...\n", config.name, config.dev);
+        tpacket_throttle_loop:
+        sleep(5); /* XXX: user defined ? */
+        if (tpacket_v3_open(&tpacket_ring, config.dev, psize, config.promisc, config.pmacctd_tpacket_ring_size) == ERR)
+          goto tpacket_throttle_loop;
+        tpacket_v3_setfilter(&tpacket_ring, &filter);
+        if (config.nfacctd_workers > 1) tpacket_fanout_join(tpacket_ring.fd, fanout_id);
+        device.active = TRUE;
+      }
+      tpacket_v3_loop(&tpacket_ring, pcap_cb, (u_char *) &cb_data);
+      tpacket_v3_close(&tpacket_ring);
+      device.active = FALSE;
+      continue;
+    }
+#endif
+
     if (!device.active) {
       Log(LOG_WARNING, "WARN ( %s/core ): %s has become unavailable; throttling ...\n", config.name, config.dev);
       throttle_loop:
@@ -899,6 +1002,9 @@ int main(int argc,char **argv, char **envp)
       if ((device.dev_desc = pcap_open_live(config.dev, psize, config.promisc, 1000, errbuf)) == NULL)
         goto throttle_loop;
       pcap_setfilter(device.dev_desc, &filter);
+#if defined HAVE_TPACKET_V3
+      if (config.nfacctd_workers > 1) tpacket_fanout_join(pcap_fileno(device.dev_desc), fanout_id);
+#endif
       device.active = TRUE;
     }
     pcap_loop(device.dev_desc, -1, pcap_cb, (u_char *) &cb_data);
@@ -32,6 +32,9 @@
 #include "tee_plugin/tee_recvs-data.h"
 #include "isis/isis.h"
 #include "isis/isis-data.h"
+#if defined ENABLE_THREADS
+#include "thread_pool.h"
+#endif
 #include "crc32.h"
 #include "pmacct-data.h"
 
@@ -593,6 +596,7 @@ void load_id_file(int acct_type, char *filename, struct id_table *t, struct plug
 	  (acct_type == ACCT_NF || acct_type == ACCT_SF || acct_type == ACCT_PM ||
 	   acct_type == MAP_BGP_PEER_AS_SRC || acct_type == MAP_FLOW_TO_RD)) {
 	pt_bitmap_t idx_bmap;
+	int idx_rc;
 	
 	t->index_num = MAX_ID_TABLE_INDEXES;
 
@@ -603,13 +607,12 @@ void load_id_file(int acct_type, char *filename, struct id_table *t, struct plug
 #endif
 	  idx_bmap = pretag_index_build_bitmap(ptr, acct_type);
 
-	  /* insert bitmap to index list and determine entries per index */ 
-	  if (pretag_index_insert_bitmap(t, idx_bmap)) {
-	    Log(LOG_WARNING, "WARN ( %s/%s ): [%s] Out of indexes. Indexing disabled.\n",
-		config.name, config.type, filename);
-	    pretag_index_destroy(t);
-	    break;
-	  }
+	  /* insert bitmap to index list and determine entries per index;
+	     entries that can't be indexed are set aside as residual */ 
+	  if ((idx_rc = pretag_index_validate(ptr, idx_bmap)))
+	    pretag_index_insert_residual(t, ptr, idx_bmap, idx_rc);
+	  else if (pretag_index_insert_bitmap(t, idx_bmap, &ptr->key.agent_mask))
+	    pretag_index_insert_residual(t, ptr, idx_bmap, PRETAG_INDEX_RC_NO_INDEXES);
 	}
 
 	/* set handlers */
@@ -626,16 +629,11 @@ void load_id_file(int acct_type, char *filename, struct id_table *t, struct plug
           idx_bmap = pretag_index_build_bitmap(ptr, acct_type);
 
 	  /* fill indexes */
-	  pretag_index_fill(t, idx_bmap, ptr);
+	  if (!pretag_index_validate(ptr, idx_bmap)) pretag_index_fill(t, idx_bmap, ptr);
 	}
-      }
 
-      if (t->flags & PRETAG_FLAG_NEG) {
-        Log(LOG_WARNING, "WARN ( %s/%s ): [%s] Negations not supported. Indexing disabled.\n",
-                config.name, config.type, filename);
-        pretag_index_destroy(t);
+	pretag_index_report(t);
       }
-      else pretag_index_report(t);
     }
   }
 
@@ -876,15 +874,46 @@ pt_bitmap_t pretag_index_build_bitmap(struct id_entry *ptr, int acct_type)
   return idx_bmap;
 }
 
-int pretag_index_insert_bitmap(struct id_table *t, pt_bitmap_t idx_bmap)
+pt_bitmap_t pretag_index_supported_bitmap()
+{
+  pt_bitmap_t supported_bmap = 0;
+  u_int32_t index = 0;
+
+  for (index = 0; tag_map_index_entries_dictionary[index].key; index++)
+    supported_bmap |= tag_map_index_entries_dictionary[index].key;
+
+  return supported_bmap;
+}
+
+/* returns zero if the entry can be indexed, the reason why not otherwise */
+int pretag_index_validate(struct id_entry *ptr, pt_bitmap_t idx_bmap)
+{
+  if (idx_bmap & ~pretag_index_supported_bitmap()) return PRETAG_INDEX_RC_UNSUPPORTED;
+
+  /* hashed keys can only be looked up for equality */
+  if (ptr->key.input.neg || ptr->key.output.neg || ptr->key.bgp_nexthop.neg ||
+      ptr->key.src_as.neg || ptr->key.dst_as.neg || ptr->key.peer_src_as.neg ||
+      ptr->key.peer_dst_as.neg || ptr->key.mpls_label_bottom.neg || ptr->key.mpls_vpn_id.neg ||
+      ptr->key.mpls_vpn_rd.neg || ptr->key.src_mac.neg || ptr->key.dst_mac.neg ||
+      ptr->key.vlan_id.neg || ptr->key.cvlan_id.neg) return PRETAG_INDEX_RC_NEG;
+
+  return FALSE;
+}
+
+int pretag_index_insert_bitmap(struct id_table *t, pt_bitmap_t idx_bmap, pt_hostmask_t *agent_mask)
 {
   u_int32_t iterator = 0;
 
   if (!t) return TRUE;
 
   for (iterator = 0; iterator < t->index_num; iterator++) {
-    if (!t->index[iterator].entries || t->index[iterator].bitmap == idx_bmap) {
+    if (!t->index[iterator].entries) {
       t->index[iterator].bitmap = idx_bmap;
+      if (idx_bmap & PRETAG_IP) memcpy(&t->index[iterator].agent_mask, agent_mask, sizeof(pt_hostmask_t));
+      t->index[iterator].entries++;
+      return FALSE;
+    }
+    else if (pretag_index_match_bitmap(&t->index[iterator], idx_bmap, agent_mask)) {
       t->index[iterator].entries++;
       return FALSE;
     }
@@ -893,6 +922,38 @@ int pretag_index_insert_bitmap(struct id_table *t, pt_bitmap_t idx_bmap)
   return TRUE;
 }
 
+/* indexes including the 'ip' key are per address family and prefix length */
+int pretag_index_match_bitmap(struct id_table_index *idx, pt_bitmap_t idx_bmap, pt_hostmask_t *agent_mask)
+{
+  if (idx->bitmap != idx_bmap) return FALSE;
+  if (!(idx_bmap & PRETAG_IP)) return TRUE;
+  if (idx->agent_mask.family != agent_mask->family) return FALSE;
+
+  if (agent_mask->family == AF_INET) return (idx->agent_mask.mask.m4 == agent_mask->mask.m4);
+#if defined ENABLE_IPV6
+  else if (agent_mask->family == AF_INET6) return !memcmp(idx->agent_mask.mask.m6, agent_mask->mask.m6, sizeof(agent_mask->mask.m6));
+#endif
+
+  return FALSE;
+}
+
+void pretag_index_insert_residual(struct id_table *t, struct id_entry *ptr, pt_bitmap_t idx_bmap, u_int8_t reason)
+{
+  struct id_table_index_residual *residual;
+
+  if (!t) return;
+
+  /* we keep counting past the limit for reporting purposes */
+  if (t->index_residual_num < ID_TABLE_INDEX_RESIDUAL) {
+    residual = &t->index_residual[t->index_residual_num];
+    residual->e = ptr;
+    residual->bitmap = idx_bmap;
+    residual->reason = reason;
+  }
+
+  t->index_residual_num++;
+}
+
 int pretag_index_set_handlers(struct id_table *t)
 {
   pt_bitmap_t residual_idx_bmap = 0;
@@ -994,7 +1055,7 @@ int pretag_index_fill(struct id_table *t, pt_bitmap_t idx_bmap, struct id_entry
   if (!t) return ERR;
 
   for (iterator = 0; iterator < t->index_num; iterator++) {
-    if (t->index[iterator].entries && t->index[iterator].bitmap == idx_bmap) {
+    if (t->index[iterator].entries && pretag_index_match_bitmap(&t->index[iterator], idx_bmap, &ptr->key.agent_mask)) {
       struct id_entry e;
       struct id_index_entry *idie;
       pm_hash_serial_t *hash_serializer;
@@ -1042,12 +1103,9 @@ int pretag_index_fill(struct id_table *t, pt_bitmap_t idx_bmap, struct id_entry
         }
       }
 
-      if (index == idie->depth) {
-        Log(LOG_WARNING, "WARN ( %s/%s ): [%s] maps_index: out of index space %x. Indexing disabled.\n",
-		config.name, config.type, t->filename, idx_bmap);
-	pretag_index_destroy(t);
-	break;
-      }
+      if (index == idie->depth) pretag_index_insert_residual(t, ptr, idx_bmap, PRETAG_INDEX_RC_FULL);
+
+      break;
     }
   }
 
@@ -1083,6 +1141,45 @@ void pretag_index_report(struct id_table *t)
 	  (buckets * sizeof(struct id_index_entry)));
     } 
   }
+
+  for (index = 0; index < MIN(t->index_residual_num, ID_TABLE_INDEX_RESIDUAL); index++) {
+    struct id_table_index_residual *residual = &t->index_residual[index];
+    char ip_string[INET6_ADDRSTRLEN];
+
+    addr_to_str(ip_string, &residual->e->key.agent_ip.a);
+
+    switch (residual->reason) {
+    case PRETAG_INDEX_RC_NEG:
+      Log(LOG_INFO, "INFO ( %s/%s ): [%s] maps_index: entry %u (ip %s) not indexed: negations not supported.\n",
+	  config.name, config.type, t->filename, residual->e->pos, ip_string);
+      break;
+    case PRETAG_INDEX_RC_UNSUPPORTED:
+      Log(LOG_INFO, "INFO ( %s/%s ): [%s] maps_index: entry %u (ip %s) not indexed: field(s) %llx not supported.\n",
+	  config.name, config.type, t->filename, residual->e->pos, ip_string,
+	  (unsigned long long) (residual->bitmap & ~pretag_index_supported_bitmap()));
+      break;
+    case PRETAG_INDEX_RC_NO_INDEXES:
+      Log(LOG_INFO, "INFO ( %s/%s ): [%s] maps_index: entry %u (ip %s) not indexed: out of indexes.\n",
+	  config.name, config.type, t->filename, residual->e->pos, ip_string);
+      break;
+    case PRETAG_INDEX_RC_FULL:
+      Log(LOG_INFO, "INFO ( %s/%s ): [%s] maps_index: entry %u (ip %s) not indexed: out of index space %llx.\n",
+	  config.name, config.type, t->filename, residual->e->pos, ip_string, (unsigned long long) residual->bitmap);
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (t->index_residual_num > ID_TABLE_INDEX_RESIDUAL) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): [%s] maps_index: %u entries not indexed (first %u listed). Indexing disabled.\n",
+	config.name, config.type, t->filename, t->index_residual_num, ID_TABLE_INDEX_RESIDUAL);
+    pretag_index_destroy(t);
+  }
+  else if (t->index_residual_num) {
+    Log(LOG_INFO, "INFO ( %s/%s ): [%s] maps_index: %u entries not indexed; evaluated upon every lookup.\n",
+	config.name, config.type, t->filename, t->index_residual_num);
+  }
 }
 
 void pretag_index_destroy(struct id_table *t)
@@ -1115,16 +1212,18 @@ void pretag_index_destroy(struct id_table *t)
   }
 
   t->index_num = 0;
+  t->index_residual_num = 0;
 }
 
 void pretag_index_lookup(struct id_table *t, struct packet_ptrs *pptrs, struct id_entry **index_results, int ir_entries)
 {
-  struct id_entry res_fdata;
+  struct id_entry res_fdata, *residual;
   struct id_index_entry *idie;
+  struct host_addr agent;
   pm_hash_serial_t *hash_serializer;
   pm_hash_key_t *hash_key;
   u_int32_t iterator, iterator_ir, index_cc, index_hdlr;
-  int modulo, buckets;
+  int modulo, buckets, have_agent;
 
   if (!t || !pptrs || !index_results) return;
 
@@ -1138,6 +1237,7 @@ void pretag_index_lookup(struct id_table *t, struct packet_ptrs *pptrs, struct i
       hash_serial_set_off(hash_serializer, 0);
       hash_key = hash_serial_get_key(hash_serializer);
       buckets = IDT_INDEX_HASH_BASE(t->index[iterator].entries);
+      memcpy(&res_fdata.key.agent_mask, &t->index[iterator].agent_mask, sizeof(pt_hostmask_t));
 
       for (index_hdlr = 0; (*t->index[iterator].fdata_handler[index_hdlr]); index_hdlr++) {
         (*t->index[iterator].fdata_handler[index_hdlr])(&res_fdata, &t->index[iterator].hash_serializer, pptrs);
@@ -1148,24 +1248,38 @@ void pretag_index_lookup(struct id_table *t, struct packet_ptrs *pptrs, struct i
 
       for (index_cc = 0; idie->result[index_cc] && index_cc < idie->depth; index_cc++) {
 	if (!hash_key_cmp(&idie->hash_key[index_cc], hash_key)) {
-          index_results[iterator_ir] = idie->result[index_cc];
-	  if (iterator_ir < ir_entries) iterator_ir++;
-	  else {
-	    Log(LOG_WARNING, "WARN ( %s/%s ): [%s] maps_index: out of index results space. Indexing disabled.\n",
-                config.name, config.type, t->filename);
-	    pretag_index_destroy(t);
-	    memset(index_results, 0, (sizeof(struct id_entry *) * ir_entries));
-	    return;
-	  }
+	  /* last slot is left NULL as terminator */
+	  if (iterator_ir < (ir_entries - 1)) index_results[iterator_ir++] = idie->result[index_cc];
+	  else goto out_of_space;
 	}
       }
     }
     else break;
   }
 
+  /* residual entries: only the 'ip' key is left to check here */
+  have_agent = !PT_map_index_fdata_get_agent(pptrs, &agent);
+
+  for (iterator = 0; iterator < t->index_residual_num; iterator++) {
+    residual = t->index_residual[iterator].e;
+
+    if (have_agent && host_addr_mask_cmp(&residual->key.agent_ip.a, &residual->key.agent_mask, &agent)) continue;
+
+    if (iterator_ir < (ir_entries - 1)) index_results[iterator_ir++] = residual;
+    else goto out_of_space;
+  }
+
   // pretag_index_results_compress(index_results, ir_entries);
   pretag_index_results_sort(index_results, ir_entries);
   pretag_index_results_compress_jeqs(index_results, ir_entries);
+
+  return;
+
+  out_of_space:
+  Log(LOG_WARNING, "WARN ( %s/%s ): [%s] maps_index: out of index results space. Indexing disabled.\n",
+      config.name, config.type, t->filename);
+  pretag_index_destroy(t);
+  memset(index_results, 0, (sizeof(struct id_entry *) * ir_entries));
 }
 
 void pretag_index_results_sort(struct id_entry **index_results, int ir_entries)
@@ -1175,14 +1289,12 @@ void pretag_index_results_sort(struct id_entry **index_results, int ir_entries)
 
   if (!index_results) return;
 
-  for (i = 0, j = 1; index_results[i] && i < ir_entries; i++, j++) {
-    if (index_results[j] && j < ir_entries) {
-      if (index_results[i]->pos > index_results[j]->pos) {
-	ptr = index_results[j];
-	index_results[j] = index_results[i];
-	index_results[i] = ptr;
-      }
-    }
+  /* insertion sort: results come from several indexes, each in map order */
+  for (i = 1; i < ir_entries && index_results[i]; i++) {
+    ptr = index_results[i];
+
+    for (j = i; j > 0 && index_results[j-1]->pos > ptr->pos; j--) index_results[j] = index_results[j-1];
+    index_results[j] = ptr;
   }
 }
 
@@ -1233,3 +1345,165 @@ int pretag_index_have_one(struct id_table *t)
 {
   return t->index[0].entries;
 }
+
+void pretag_table_free(struct id_table *t)
+{
+  int index;
+
+  if (!t) return;
+
+  if (config.maps_index && pretag_index_have_one(t)) pretag_index_destroy(t);
+
+  if (t->e) {
+    for (index = 0; index < t->num; index++) {
+      pcap_freecode(&t->e[index].key.filter);
+      pretag_free_label(&t->e[index].label);
+    }
+
+    free(t->e);
+  }
+
+  memset(t, 0, sizeof(struct id_table));
+}
+
+/*
+   Maps reload: the daemon collects the tables to be reloaded between
+   pretag_reload_begin() and pretag_reload_end(); with threads enabled
+   parsing and indexing then happen in a builder thread while packets
+   keep being processed against the current tables. pretag_reload_poll()
+   is to be called by the (single) consumer of the tables at a point in
+   which no id_entry is referenced: it publishes the new tables onto the
+   existing ones and hands the old content back to the builder for
+   freeing. Without threads, pretag_reload_end() builds them inline.
+*/
+int pretag_reload_begin(struct id_table_reload_set *set)
+{
+  if (!set) return FALSE;
+
+  if (set->state != PRETAG_RELOAD_IDLE) return FALSE;
+
+  if (!set->slot) {
+    set->slot = malloc(PRETAG_RELOAD_MAX_SLOTS * sizeof(struct id_table_reload));
+    if (!set->slot) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): pretag_reload_begin(): malloc() failed.\n", config.name, config.type);
+      return FALSE;
+    }
+
+#if defined ENABLE_THREADS
+    set->pool = allocate_thread_pool(1);
+    assert(set->pool);
+#endif
+  }
+
+  memset(set->slot, 0, PRETAG_RELOAD_MAX_SLOTS * sizeof(struct id_table_reload));
+  set->num = 0;
+
+  return TRUE;
+}
+
+struct id_table_reload *pretag_reload_add(struct id_table_reload_set *set, int acct_type, char *filename,
+					  struct id_table *t, int *map_allocated)
+{
+  struct id_table_reload *s;
+
+  if (!set || !set->slot || !filename || !t || !map_allocated) return NULL;
+
+  if (set->num >= PRETAG_RELOAD_MAX_SLOTS) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): [%s] pretag_reload_add(): too many maps. Not reloaded.\n", config.name, config.type, filename);
+    return NULL;
+  }
+
+  s = &set->slot[set->num];
+  s->acct_type = acct_type;
+  s->filename = filename;
+  s->t = t;
+  s->map_allocated = map_allocated;
+  set->num++;
+
+  return s;
+}
+
+void pretag_reload_end(struct id_table_reload_set *set)
+{
+  if (!set || !set->slot) return;
+
+  if (!set->num) return;
+
+  set->state = PRETAG_RELOAD_BUILDING;
+
+#if defined ENABLE_THREADS
+  send_to_pool((thread_pool_t *) set->pool, pretag_reload_build, set);
+#else
+  pretag_reload_build(set);
+#endif
+}
+
+void pretag_reload_build(struct id_table_reload_set *set)
+{
+  struct id_table_reload *s;
+  int idx;
+
+  for (idx = 0; idx < set->num; idx++) {
+    s = &set->slot[idx];
+
+    /* the live table is never touched here, it may be in use by the
+       consumer. A non-zero timestamp makes load_id_file() roll back
+       rather than exit upon errors, also for tables never loaded
+       before; success is marked by a set filename */
+    s->staged.timestamp = s->t->timestamp ? s->t->timestamp : 1;
+    load_id_file(s->acct_type, s->filename, &s->staged, &s->req, &s->staged_allocated);
+  }
+
+  __sync_synchronize();
+  set->state = PRETAG_RELOAD_READY;
+}
+
+int pretag_reload_poll(struct id_table_reload_set *set)
+{
+  struct id_table_reload *s;
+  int idx;
+
+  if (set->state != PRETAG_RELOAD_READY) return FALSE;
+
+  __sync_synchronize();
+
+  for (idx = 0; idx < set->num; idx++) {
+    s = &set->slot[idx];
+
+    if (s->staged.filename) {
+      memcpy(&s->retired, s->t, sizeof(struct id_table));
+      memcpy(s->t, &s->staged, sizeof(struct id_table));
+      *s->map_allocated = TRUE;
+      s->published = TRUE;
+    }
+    else {
+      /* no previous map to roll back to: keep running without one */
+      if (!s->t->timestamp)
+	Log(LOG_WARNING, "WARN ( %s/%s ): [%s] map not loaded. Retrying at next reload.\n", config.name, config.type, s->filename);
+
+      memcpy(&s->retired, &s->staged, sizeof(struct id_table));
+    }
+
+    memset(&s->staged, 0, sizeof(struct id_table));
+  }
+
+  set->state = PRETAG_RELOAD_RETIRING;
+
+#if defined ENABLE_THREADS
+  send_to_pool((thread_pool_t *) set->pool, pretag_reload_retire, set);
+#else
+  pretag_reload_retire(set);
+#endif
+
+  return TRUE;
+}
+
+void pretag_reload_retire(struct id_table_reload_set *set)
+{
+  int idx;
+
+  for (idx = 0; idx < set->num; idx++) pretag_table_free(&set->slot[idx].retired);
+
+  __sync_synchronize();
+  set->state = PRETAG_RELOAD_IDLE;
+}
@@ -25,9 +25,10 @@
 #define MAX_BITMAP_ENTRIES 64 /* pt_bitmap_t -> u_int64_t */
 #define MAX_PRETAG_MAP_ENTRIES 384 
 
-#define MAX_ID_TABLE_INDEXES 8
+#define MAX_ID_TABLE_INDEXES 16
 #define ID_TABLE_INDEX_DEPTH 8
 #define ID_TABLE_INDEX_RESULTS (MAX_ID_TABLE_INDEXES * 8)
+#define ID_TABLE_INDEX_RESIDUAL 16
 
 #define PRETAG_IN_IFACE			0x000000001
 #define PRETAG_OUT_IFACE		0x000000002
@@ -74,9 +75,23 @@
 #define PRETAG_MAP_RCODE_LABEL		0x00008000
 
 #define PRETAG_FLAG_NEG			0x00000001
+#define PRETAG_FLAG_NOCACHE		0x00000002
 
 #define IDT_INDEX_HASH_BASE(entries)	(entries * 2)
 
+/* reasons for a map entry not to be indexed */
+#define PRETAG_INDEX_RC_NEG		1
+#define PRETAG_INDEX_RC_UNSUPPORTED	2
+#define PRETAG_INDEX_RC_NO_INDEXES	3
+#define PRETAG_INDEX_RC_FULL		4
+
+/* background map reload states */
+#define PRETAG_RELOAD_IDLE		0
+#define PRETAG_RELOAD_BUILDING		1
+#define PRETAG_RELOAD_READY		2
+#define PRETAG_RELOAD_RETIRING		3
+#define PRETAG_RELOAD_MAX_SLOTS		(MAX_N_PLUGINS+8)
+
 typedef int (*pretag_handler) (struct packet_ptrs *, void *, void *);
 typedef pm_id_t (*pretag_stack_handler) (pm_id_t, pm_id_t);
 
@@ -203,6 +218,7 @@ struct id_index_entry {
 
 struct id_table_index {
   pt_bitmap_t bitmap; 
+  pt_hostmask_t agent_mask; /* prefix length of indexed 'ip' keys */
   int entries;
   pretag_copier idt_handler[MAX_BITMAP_ENTRIES];
   pretag_copier fdata_handler[MAX_BITMAP_ENTRIES];
@@ -210,6 +226,13 @@ struct id_table_index {
   struct id_index_entry *idx_t;
 };
 
+/* map entries which could not be indexed; evaluated upon every lookup */
+struct id_table_index_residual {
+  struct id_entry *e;
+  pt_bitmap_t bitmap;
+  u_int8_t reason;
+};
+
 struct id_table {
   char *filename;
   int type;
@@ -223,6 +246,8 @@ struct id_table {
   struct id_entry *e;
   struct id_table_index index[MAX_ID_TABLE_INDEXES];
   unsigned int index_num;
+  struct id_table_index_residual index_residual[ID_TABLE_INDEX_RESIDUAL];
+  unsigned int index_residual_num;
   time_t timestamp;
   u_int32_t flags;
 };
@@ -247,6 +272,29 @@ struct pretag_label_filter {
   ptlt_t table[MAX_PRETAG_MAP_ENTRIES/4];
 };
 
+/* a map being (re)loaded: the new table is built in 'staged' away from
+   the packet path and published onto 't' by the consumer; what 't' held
+   before is parked in 'retired' until the builder frees it */
+struct id_table_reload {
+  int acct_type;
+  char *filename;
+  struct id_table *t;
+  int *map_allocated;
+  struct plugin_requests req;
+  struct id_table staged;
+  int staged_allocated;
+  struct id_table retired;
+  u_int8_t published;
+  void *owner;
+};
+
+struct id_table_reload_set {
+  struct id_table_reload *slot;
+  int num;
+  volatile int state;
+  void *pool;
+};
+
 /* prototypes */
 #if (!defined __PRETAG_C)
 #define EXT extern
@@ -265,7 +313,11 @@ EXT int pretag_copy_label(pt_label_t *, pt_label_t *);
 EXT void pretag_free_label(pt_label_t *);
 EXT int pretag_entry_process(struct id_entry *, struct packet_ptrs *, pm_id_t *, pm_id_t *);
 EXT pt_bitmap_t pretag_index_build_bitmap(struct id_entry *, int);
-EXT int pretag_index_insert_bitmap(struct id_table *, pt_bitmap_t);
+EXT pt_bitmap_t pretag_index_supported_bitmap();
+EXT int pretag_index_validate(struct id_entry *, pt_bitmap_t);
+EXT int pretag_index_insert_bitmap(struct id_table *, pt_bitmap_t, pt_hostmask_t *);
+EXT int pretag_index_match_bitmap(struct id_table_index *, pt_bitmap_t, pt_hostmask_t *);
+EXT void pretag_index_insert_residual(struct id_table *, struct id_entry *, pt_bitmap_t, u_int8_t);
 EXT int pretag_index_set_handlers(struct id_table *);
 EXT int pretag_index_allocate(struct id_table *);
 EXT int pretag_index_fill(struct id_table *, pt_bitmap_t, struct id_entry *);
@@ -276,6 +328,13 @@ EXT void pretag_index_results_sort(struct id_entry **, int);
 EXT void pretag_index_results_compress(struct id_entry **, int);
 EXT void pretag_index_results_compress_jeqs(struct id_entry **, int);
 EXT int pretag_index_have_one(struct id_table *);
+EXT void pretag_table_free(struct id_table *);
+EXT int pretag_reload_begin(struct id_table_reload_set *);
+EXT struct id_table_reload *pretag_reload_add(struct id_table_reload_set *, int, char *, struct id_table *, int *);
+EXT void pretag_reload_end(struct id_table_reload_set *);
+EXT int pretag_reload_poll(struct id_table_reload_set *);
+EXT void pretag_reload_build(struct id_table_reload_set *);
+EXT void pretag_reload_retire(struct id_table_reload_set *);
 
 EXT int bpas_map_allocated;
 EXT int blp_map_allocated;
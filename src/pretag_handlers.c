@@ -215,8 +215,8 @@ int PT_map_input_handler(char *filename, struct id_entry *e, char *value, struct
   int x = 0, len;
   char *endptr;
 
-  if (acct_type == MAP_SAMPLING) sampling_map_caching = FALSE;
-  if (acct_type == MAP_BGP_TO_XFLOW_AGENT) bta_map_caching = FALSE; 
+  if (acct_type == MAP_SAMPLING || acct_type == MAP_BGP_TO_XFLOW_AGENT)
+    ((struct id_table *) req->key_value_table)->flags |= PRETAG_FLAG_NOCACHE;
   if (req->ptm_c.load_ptm_plugin == PLUGIN_ID_TEE) req->ptm_c.load_ptm_res = TRUE;
 
   e->key.input.neg = pt_check_neg(&value, &((struct id_table *) req->key_value_table)->flags);
@@ -250,8 +250,8 @@ int PT_map_output_handler(char *filename, struct id_entry *e, char *value, struc
   int x = 0, len;
   char *endptr;
 
-  if (acct_type == MAP_SAMPLING) sampling_map_caching = FALSE;
-  if (acct_type == MAP_BGP_TO_XFLOW_AGENT) bta_map_caching = FALSE; 
+  if (acct_type == MAP_SAMPLING || acct_type == MAP_BGP_TO_XFLOW_AGENT)
+    ((struct id_table *) req->key_value_table)->flags |= PRETAG_FLAG_NOCACHE;
   if (req->ptm_c.load_ptm_plugin == PLUGIN_ID_TEE) req->ptm_c.load_ptm_res = TRUE;
 
   e->key.output.neg = pt_check_neg(&value, &((struct id_table *) req->key_value_table)->flags);
@@ -2905,30 +2905,43 @@ int PT_map_index_entries_cvlan_id_handler(struct id_entry *e, pm_hash_serial_t *
   return FALSE;
 }
 
-int PT_map_index_fdata_ip_handler(struct id_entry *e, pm_hash_serial_t *hash_serializer, void *src)
+int PT_map_index_fdata_get_agent(struct packet_ptrs *pptrs, struct host_addr *a)
 {
-  struct packet_ptrs *pptrs = (struct packet_ptrs *) src;
   struct sockaddr *sa = (struct sockaddr *) pptrs->f_agent;
   SFSample *sample = (SFSample *)pptrs->f_data;
-  u_int16_t port, j;
+  u_int16_t port;
+
+  memset(a, 0, sizeof(struct host_addr));
 
   if (config.acct_type == ACCT_NF) {
-    sa_to_addr((struct sockaddr *)sa, &e->key.agent_ip.a, &port);
+    sa_to_addr((struct sockaddr *)sa, a, &port);
   }
   else if (config.acct_type == ACCT_SF) {
     if (sample->agent_addr.type == SFLADDRESSTYPE_IP_V4) {
-      e->key.agent_ip.a.family = AF_INET;
-      e->key.agent_ip.a.address.ipv4.s_addr = sample->agent_addr.address.ip_v4.s_addr;
+      a->family = AF_INET;
+      a->address.ipv4.s_addr = sample->agent_addr.address.ip_v4.s_addr;
     }
 #if defined ENABLE_IPV6
     else if (sample->agent_addr.type == SFLADDRESSTYPE_IP_V6) {
-      e->key.agent_ip.a.family = AF_INET6;
-      for (j = 0; j < 4; j++) e->key.agent_ip.a.address.ipv6.s6_addr[j] = sample->agent_addr.address.ip_v6.s6_addr[j];
+      a->family = AF_INET6;
+      memcpy(&a->address.ipv6, &sample->agent_addr.address.ip_v6, IP6AddrSz);
     }
 #endif 
   }
   else return TRUE;
 
+  return FALSE;
+}
+
+int PT_map_index_fdata_ip_handler(struct id_entry *e, pm_hash_serial_t *hash_serializer, void *src)
+{
+  struct packet_ptrs *pptrs = (struct packet_ptrs *) src;
+
+  if (PT_map_index_fdata_get_agent(pptrs, &e->key.agent_ip.a)) return TRUE;
+
+  /* index keyed on 'ip' prefixes: pretag_index_lookup() passes the mask in */
+  if (e->key.agent_mask.family) host_addr_mask(&e->key.agent_ip.a, &e->key.agent_mask);
+
   hash_serial_append(hash_serializer, (char *)&e->key.agent_ip.a, sizeof(struct host_addr), FALSE);
 
   return FALSE;
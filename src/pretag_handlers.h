@@ -79,6 +79,7 @@ EXT int PT_map_index_entries_src_mac_handler(struct id_entry *, pm_hash_serial_t
 EXT int PT_map_index_entries_dst_mac_handler(struct id_entry *, pm_hash_serial_t *, void *); 
 EXT int PT_map_index_entries_vlan_id_handler(struct id_entry *, pm_hash_serial_t *, void *); 
 EXT int PT_map_index_entries_cvlan_id_handler(struct id_entry *, pm_hash_serial_t *, void *); 
+EXT int PT_map_index_fdata_get_agent(struct packet_ptrs *, struct host_addr *);
 EXT int PT_map_index_fdata_ip_handler(struct id_entry *, pm_hash_serial_t *, void *); 
 EXT int PT_map_index_fdata_input_handler(struct id_entry *, pm_hash_serial_t *, void *); 
 EXT int PT_map_index_fdata_output_handler(struct id_entry *, pm_hash_serial_t *, void *); 
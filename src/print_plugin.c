@@ -35,6 +35,13 @@
 #include "crc32.h"
 #include "bgp/bgp.h"
 
+/* variables */
+static struct p_purge_pool print_purge_pool;
+
+/* prototypes */
+static void P_cache_purge_worker(struct p_purge_worker *);
+static void P_cache_purge_segments(FILE *, struct chained_cache *[], int, char *, int);
+
 /* Functions */
 void print_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr) 
 {
@@ -200,7 +207,7 @@ void print_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
     if (config.pipe_homegrown || config.pipe_amqp) {
       timeout = MIN(refresh_timeout, (amqp_timeout ? amqp_timeout : INT_MAX));
-      ret = poll(&pfd, (pfd.fd == ERR ? 0 : 1), timeout);
+      ret = plugin_pipe_poll(&pfd, status, timeout);
     }
 #ifdef WITH_KAFKA
     else if (config.pipe_kafka) {
@@ -256,7 +263,7 @@ void print_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
 	saved_qq_ptr = qq_ptr;
 	P_cache_handle_flush_event(&pt);
-	if (saved_qq_ptr) print_output_stdout_header = FALSE;
+	if (saved_qq_ptr && config.dump_purge_mode != PURGE_MODE_THREAD) print_output_stdout_header = FALSE;
       }
       break;
     default: /* we received data */
@@ -295,6 +302,7 @@ void print_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
         pollagain = FALSE;
         memcpy(pipebuf, rg->ptr, bufsz);
+        plugin_pipe_ring_release(status);
         rg->ptr += bufsz;
       }
 #ifdef WITH_RABBITMQ
@@ -322,7 +330,7 @@ void print_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
 	saved_qq_ptr = qq_ptr;
 	P_cache_handle_flush_event(&pt);
-	if (saved_qq_ptr) print_output_stdout_header = FALSE;
+	if (saved_qq_ptr && config.dump_purge_mode != PURGE_MODE_THREAD) print_output_stdout_header = FALSE;
       }
 
       data = (struct pkt_data *) (pipebuf+sizeof(struct ch_buf_hdr));
@@ -369,24 +377,9 @@ void print_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
 void P_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 {
-  struct pkt_primitives *data = NULL;
-  struct pkt_bgp_primitives *pbgp = NULL;
-  struct pkt_nat_primitives *pnat = NULL;
-  struct pkt_mpls_primitives *pmpls = NULL;
-  struct pkt_tunnel_primitives *ptun = NULL;
-  char *pcust = NULL;
-  struct pkt_vlen_hdr_primitives *pvlen = NULL;
-  struct pkt_bgp_primitives empty_pbgp;
-  struct pkt_nat_primitives empty_pnat;
-  struct pkt_mpls_primitives empty_pmpls;
-  struct pkt_tunnel_primitives empty_ptun;
-  char *empty_pcust = NULL;
-  char src_mac[18], dst_mac[18], src_host[INET6_ADDRSTRLEN], dst_host[INET6_ADDRSTRLEN], ip_address[INET6_ADDRSTRLEN];
-  char rd_str[SRVBUFLEN], *sep = config.print_output_separator, *fd_buf;
-  char *as_path, *bgp_comm, empty_string[] = "", empty_aspath[] = "^$", empty_ip4[] = "0.0.0.0", empty_ip6[] = "::";
-  char empty_macaddress[] = "00:00:00:00:00:00", empty_rd[] = "0:0";
+  char *empty_pcust = NULL, *fd_buf;
   FILE *f = NULL, *lockf = NULL;
-  int j, stop, is_event = FALSE, qn = 0, go_to_pending, saved_index = index, file_to_be_created;
+  int j, stop, is_event = FALSE, qn = 0, go_to_pending, saved_index = index, file_to_be_created, out_idx;
   time_t start, duration;
   char tmpbuf[LONGLONGSRVBUFLEN], current_table[SRVBUFLEN], elem_table[SRVBUFLEN];
   struct primitives_ptrs prim_ptrs, elem_prim_ptrs;
@@ -408,10 +401,6 @@ void P_cache_purge(struct chained_cache *queue[], int index, int safe_action)
     exit_plugin(1);
   }
 
-  memset(&empty_pbgp, 0, sizeof(struct pkt_bgp_primitives));
-  memset(&empty_pnat, 0, sizeof(struct pkt_nat_primitives));
-  memset(&empty_pmpls, 0, sizeof(struct pkt_mpls_primitives));
-  memset(&empty_ptun, 0, sizeof(struct pkt_tunnel_primitives));
   memset(empty_pcust, 0, config.cpptrs.len);
   memset(&prim_ptrs, 0, sizeof(prim_ptrs));
   memset(&dummy_data, 0, sizeof(dummy_data));
@@ -533,11 +522,13 @@ void P_cache_purge(struct chained_cache *queue[], int index, int safe_action)
         P_write_stats_header_formatted(stdout, is_event);
       else if (config.print_output & PRINT_OUTPUT_CSV)
         P_write_stats_header_csv(stdout, is_event);
+
+      /* purge mode thread: writer shares memory with the plugin */
+      if (config.dump_purge_mode == PURGE_MODE_THREAD) print_output_stdout_header = FALSE;
     }
   }
 
-  for (j = 0; j < index; j++) {
-    int count = 0;
+  for (j = 0, out_idx = 0; j < index; j++) {
     go_to_pending = FALSE;
 
     if (queue[j]->valid != PRINT_CACHE_COMMITTED) continue;
@@ -565,238 +556,419 @@ void P_cache_purge(struct chained_cache *queue[], int index, int safe_action)
     if (!go_to_pending) {
       qn++;
 
-      data = &queue[j]->primitives;
-      if (queue[j]->pbgp) pbgp = queue[j]->pbgp;
-      else pbgp = &empty_pbgp;
-  
-      if (queue[j]->pnat) pnat = queue[j]->pnat;
-      else pnat = &empty_pnat;
-  
-      if (queue[j]->pmpls) pmpls = queue[j]->pmpls;
-      else pmpls = &empty_pmpls;
+      /* compacting in place: out_idx never overtakes j */
+      queue[out_idx] = queue[j];
+      out_idx++;
+    }
+  }
 
-      if (queue[j]->ptun) ptun = queue[j]->ptun;
-      else ptun = &empty_ptun;
-  
-      if (queue[j]->pcust) pcust = queue[j]->pcust;
-      else pcust = empty_pcust;
+  if (f && config.print_output & PRINT_OUTPUT_AVRO) {
+    for (j = 0; j < out_idx; j++) {
+#ifdef WITH_AVRO
+      static struct pkt_bgp_primitives empty_pbgp;
+      static struct pkt_nat_primitives empty_pnat;
+      static struct pkt_mpls_primitives empty_pmpls;
+      static struct pkt_tunnel_primitives empty_ptun;
+      avro_value_iface_t *avro_iface = avro_generic_class_from_schema(avro_acct_schema);
+      avro_value_t avro_value;
+
+      struct pkt_bgp_primitives *pbgp = queue[j]->pbgp ? queue[j]->pbgp : &empty_pbgp;
+      struct pkt_nat_primitives *pnat = queue[j]->pnat ? queue[j]->pnat : &empty_pnat;
+      struct pkt_mpls_primitives *pmpls = queue[j]->pmpls ? queue[j]->pmpls : &empty_pmpls;
+      struct pkt_tunnel_primitives *ptun = queue[j]->ptun ? queue[j]->ptun : &empty_ptun;
+      char *pcust = queue[j]->pcust ? queue[j]->pcust : empty_pcust;
+      struct pkt_vlen_hdr_primitives *pvlen = queue[j]->pvlen;
+
+      avro_value = compose_avro(config.what_to_count, config.what_to_count_2, queue[j]->flow_type,
+                       &queue[j]->primitives, pbgp, pnat, pmpls, ptun, pcust, pvlen, queue[j]->bytes_counter,
+                       queue[j]->packet_counter, queue[j]->flow_counter, queue[j]->tcp_flags, NULL,
+                       queue[j]->stitch, avro_iface);
+
+      if (config.sql_table) {
+        if (avro_file_writer_append_value(avro_writer, &avro_value)) {
+          Log(LOG_ERR, "ERROR ( %s/%s ): AVRO: failed writing the value: %s\n",
+              config.name, config.type, avro_strerror());
+          exit_plugin(1);
+        }
+      }
+      else {
+        char *json_str;
 
-      if (queue[j]->pvlen) pvlen = queue[j]->pvlen;
-      else pvlen = NULL;
-  
-      if (queue[j]->valid == PRINT_CACHE_FREE) continue;
-  
-      if (f && config.print_output & PRINT_OUTPUT_FORMATTED) {
-        if (config.what_to_count & COUNT_TAG) fprintf(f, "%-10llu  ", data->tag);
-        if (config.what_to_count & COUNT_TAG2) fprintf(f, "%-10llu  ", data->tag2);
-        if (config.what_to_count & COUNT_CLASS) fprintf(f, "%-16s  ", ((data->class && class[(data->class)-1].id) ? class[(data->class)-1].protocol : "unknown" ));
+        if (avro_value_to_json(&avro_value, TRUE, &json_str)) {
+          Log(LOG_ERR, "ERROR ( %s/%s ): AVRO: unable to value to JSON: %s\n",
+              config.name, config.type, avro_strerror());
+          exit_plugin(1);
+        }
+
+        fprintf(f, "%s\n", json_str);
+        free(json_str);
+      }
+
+      avro_value_iface_decref(avro_iface);
+      avro_value_decref(&avro_value);
+#else
+      if (config.debug) Log(LOG_DEBUG, "DEBUG ( %s/%s ): compose_avro(): AVRO object not created due to missing --enable-avro\n", config.name, config.type);
+#endif
+    }
+  }
+  else if (f) {
+    if (P_purge_pool_init(&print_purge_pool, P_cache_purge_worker))
+      P_cache_purge_segments(f, queue, out_idx, empty_pcust, is_event);
+    else {
+      for (j = 0; j < out_idx; j++) P_write_cache_entry(f, queue[j], empty_pcust, is_event);
+    }
+  }
+
+  duration = time(NULL)-start;
+
+  if (f && config.print_markers) {
+    if ((config.print_output & PRINT_OUTPUT_CSV) || (config.print_output & PRINT_OUTPUT_FORMATTED))
+      fprintf(f, "--END (%u)--\n", writer_pid);
+    else if (config.print_output & PRINT_OUTPUT_JSON) {
+      void *json_obj;
+
+      json_obj = compose_purge_close_json(config.name, writer_pid, qn, saved_index, duration);
+      if (json_obj) write_and_free_json(f, json_obj);
+    }
+  }
+    
+  if (config.sql_table) {
+#ifdef WITH_AVRO
+    if (config.print_output & PRINT_OUTPUT_AVRO)
+      avro_file_writer_flush(avro_writer);
+#endif
+
+    if (config.print_latest_file) {
+      if (!safe_action) {
+        memset(tmpbuf, 0, LONGLONGSRVBUFLEN);
+        handle_dynname_internal_strings(tmpbuf, LONGSRVBUFLEN, config.print_latest_file, &prim_ptrs);
+        link_latest_output_file(tmpbuf, current_table);
+      }
+    }
+
+#ifdef WITH_AVRO
+    if (config.print_output & PRINT_OUTPUT_AVRO) {
+      avro_file_writer_close(avro_writer);
+    }
+#endif
+    else {
+      if (f) close_output_file(f);
+    }
+  }
+  else {
+    /* writing to stdout: releasing lock */
+    fflush(f);
+    close_output_file(lockf);
+  }
+
+  /* If we have pending queries then start again */
+  if (pqq_ptr) goto start;
+
+  Log(LOG_INFO, "INFO ( %s/%s ): *** Purging cache - END (PID: %u, QN: %u/%u, ET: %u) ***\n",
+		config.name, config.type, writer_pid, qn, saved_index, duration);
+
+  if (print_purge_pool.num) P_purge_pool_report(&print_purge_pool);
+
+  if (config.sql_trigger_exec) P_trigger_exec(config.sql_trigger_exec); 
+
+  if (empty_pcust) free(empty_pcust);
+  if (fd_buf) free(fd_buf);
+}
+
+/*
+   purge_threads: entries are formatted in parallel, each worker into its
+   own in-memory file segment; segments are then written out in queue
+   order, one round of PRINT_SEGMENT_ENTRIES entries per worker at a time
+   to keep memory usage bounded.
+*/
+static void P_cache_purge_worker(struct p_purge_worker *worker)
+{
+  struct p_print_segment *seg = (struct p_print_segment *) worker->priv;
+  FILE *mf;
+  int j;
+
+  seg->buf = NULL;
+  seg->len = 0;
+
+  mf = open_memstream(&seg->buf, &seg->len);
+  if (!mf) return;
+
+  for (j = 0; j < worker->index; j++) P_write_cache_entry(mf, worker->queue[j], seg->empty_pcust, seg->is_event);
+
+  fclose(mf);
+}
+
+static void P_cache_purge_segments(FILE *f, struct chained_cache *queue[], int index, char *empty_pcust, int is_event)
+{
+  struct p_purge_worker *worker;
+  struct p_print_segment *seg;
+  int j, idx, round, k;
+
+  for (idx = 0; idx < print_purge_pool.num; idx++) {
+    worker = &print_purge_pool.worker[idx];
+
+    if (!worker->priv) worker->priv = pm_malloc(sizeof(struct p_print_segment));
+
+    seg = (struct p_print_segment *) worker->priv;
+    seg->empty_pcust = empty_pcust;
+    seg->is_event = is_event;
+  }
+
+  for (j = 0; j < index; j += round) {
+    round = MIN(index - j, print_purge_pool.num * PRINT_SEGMENT_ENTRIES);
+
+    P_purge_pool_partition(&print_purge_pool, &queue[j], round, NULL);
+    P_purge_pool_run(&print_purge_pool);
+
+    for (idx = 0; idx < print_purge_pool.num; idx++) {
+      worker = &print_purge_pool.worker[idx];
+      seg = (struct p_print_segment *) worker->priv;
+
+      if (seg->buf) {
+        fwrite(seg->buf, 1, seg->len, f);
+        free(seg->buf);
+        seg->buf = NULL;
+      }
+      else {
+        Log(LOG_WARNING, "WARN ( %s/%s ): purge worker #%u: open_memstream() failed. Writing segment serially.\n", config.name, config.type, worker->id);
+        for (k = 0; k < worker->index; k++) P_write_cache_entry(f, worker->queue[k], empty_pcust, is_event);
+      }
+    }
+  }
+}
+
+/* writes a cache entry out in CSV, formatted or JSON format */
+void P_write_cache_entry(FILE *f, struct chained_cache *cc, char *empty_pcust, int is_event)
+{
+  static struct pkt_bgp_primitives empty_pbgp;
+  static struct pkt_nat_primitives empty_pnat;
+  static struct pkt_mpls_primitives empty_pmpls;
+  static struct pkt_tunnel_primitives empty_ptun;
+  struct pkt_primitives *data = &cc->primitives;
+  struct pkt_bgp_primitives *pbgp = cc->pbgp ? cc->pbgp : &empty_pbgp;
+  struct pkt_nat_primitives *pnat = cc->pnat ? cc->pnat : &empty_pnat;
+  struct pkt_mpls_primitives *pmpls = cc->pmpls ? cc->pmpls : &empty_pmpls;
+  struct pkt_tunnel_primitives *ptun = cc->ptun ? cc->ptun : &empty_ptun;
+  char *pcust = cc->pcust ? cc->pcust : empty_pcust;
+  struct pkt_vlen_hdr_primitives *pvlen = cc->pvlen;
+  char src_mac[18], dst_mac[18], src_host[INET6_ADDRSTRLEN], dst_host[INET6_ADDRSTRLEN], ip_address[INET6_ADDRSTRLEN];
+  char rd_str[SRVBUFLEN], *sep = config.print_output_separator;
+  char *as_path, *bgp_comm, empty_string[] = "", empty_aspath[] = "^$", empty_ip4[] = "0.0.0.0", empty_ip6[] = "::";
+  char empty_macaddress[] = "00:00:00:00:00:00", empty_rd[] = "0:0";
+  struct tm tm_buf;
+  int count = 0;
+
+  if (f && config.print_output & PRINT_OUTPUT_FORMATTED) {
+    if (config.what_to_count & COUNT_TAG) fprintf(f, "%-10llu  ", data->tag);
+    if (config.what_to_count & COUNT_TAG2) fprintf(f, "%-10llu  ", data->tag2);
+    if (config.what_to_count & COUNT_CLASS) fprintf(f, "%-16s  ", ((data->class && class[(data->class)-1].id) ? class[(data->class)-1].protocol : "unknown" ));
   #if defined (HAVE_L2)
-        if (config.what_to_count & (COUNT_SRC_MAC|COUNT_SUM_MAC)) {
-          etheraddr_string(data->eth_shost, src_mac);
+    if (config.what_to_count & (COUNT_SRC_MAC|COUNT_SUM_MAC)) {
+      etheraddr_string(data->eth_shost, src_mac);
   	if (strlen(src_mac))
-            fprintf(f, "%-17s  ", src_mac);
-          else
-            fprintf(f, "%-17s  ", empty_macaddress);
-        }
-        if (config.what_to_count & COUNT_DST_MAC) {
-          etheraddr_string(data->eth_dhost, dst_mac);
+        fprintf(f, "%-17s  ", src_mac);
+      else
+        fprintf(f, "%-17s  ", empty_macaddress);
+    }
+    if (config.what_to_count & COUNT_DST_MAC) {
+      etheraddr_string(data->eth_dhost, dst_mac);
   	if (strlen(dst_mac))
-            fprintf(f, "%-17s  ", dst_mac);
+        fprintf(f, "%-17s  ", dst_mac);
   	else
-            fprintf(f, "%-17s  ", empty_macaddress);
-        }
-        if (config.what_to_count & COUNT_VLAN) fprintf(f, "%-5u  ", data->vlan_id); 
-        if (config.what_to_count & COUNT_COS) fprintf(f, "%-2u  ", data->cos); 
-        if (config.what_to_count & COUNT_ETHERTYPE) fprintf(f, "%-5x  ", data->etype); 
+        fprintf(f, "%-17s  ", empty_macaddress);
+    }
+    if (config.what_to_count & COUNT_VLAN) fprintf(f, "%-5u  ", data->vlan_id); 
+    if (config.what_to_count & COUNT_COS) fprintf(f, "%-2u  ", data->cos); 
+    if (config.what_to_count & COUNT_ETHERTYPE) fprintf(f, "%-5x  ", data->etype); 
   #endif
-        if (config.what_to_count & (COUNT_SRC_AS|COUNT_SUM_AS)) fprintf(f, "%-10u  ", data->src_as); 
-        if (config.what_to_count & COUNT_DST_AS) fprintf(f, "%-10u  ", data->dst_as); 
+    if (config.what_to_count & (COUNT_SRC_AS|COUNT_SUM_AS)) fprintf(f, "%-10u  ", data->src_as); 
+    if (config.what_to_count & COUNT_DST_AS) fprintf(f, "%-10u  ", data->dst_as); 
   
-        if (config.what_to_count & COUNT_LOCAL_PREF) fprintf(f, "%-7u  ", pbgp->local_pref);
-        if (config.what_to_count & COUNT_SRC_LOCAL_PREF) fprintf(f, "%-7u  ", pbgp->src_local_pref);
-        if (config.what_to_count & COUNT_MED) fprintf(f, "%-6u  ", pbgp->med);
-        if (config.what_to_count & COUNT_SRC_MED) fprintf(f, "%-6u  ", pbgp->src_med);
+    if (config.what_to_count & COUNT_LOCAL_PREF) fprintf(f, "%-7u  ", pbgp->local_pref);
+    if (config.what_to_count & COUNT_SRC_LOCAL_PREF) fprintf(f, "%-7u  ", pbgp->src_local_pref);
+    if (config.what_to_count & COUNT_MED) fprintf(f, "%-6u  ", pbgp->med);
+    if (config.what_to_count & COUNT_SRC_MED) fprintf(f, "%-6u  ", pbgp->src_med);
 
-        if (config.what_to_count & COUNT_PEER_SRC_AS) fprintf(f, "%-10u  ", pbgp->peer_src_as);
-        if (config.what_to_count & COUNT_PEER_DST_AS) fprintf(f, "%-10u  ", pbgp->peer_dst_as);
+    if (config.what_to_count & COUNT_PEER_SRC_AS) fprintf(f, "%-10u  ", pbgp->peer_src_as);
+    if (config.what_to_count & COUNT_PEER_DST_AS) fprintf(f, "%-10u  ", pbgp->peer_dst_as);
   
-        if (config.what_to_count & COUNT_PEER_SRC_IP) {
-          addr_to_str(ip_address, &pbgp->peer_src_ip);
+    if (config.what_to_count & COUNT_PEER_SRC_IP) {
+      addr_to_str(ip_address, &pbgp->peer_src_ip);
   #if defined ENABLE_IPV6
-          if (strlen(ip_address))
-            fprintf(f, "%-45s  ", ip_address);
+      if (strlen(ip_address))
+        fprintf(f, "%-45s  ", ip_address);
   	else
-            fprintf(f, "%-45s  ", empty_ip6);
+        fprintf(f, "%-45s  ", empty_ip6);
   #else
   	if (strlen(ip_address))
-            fprintf(f, "%-15s  ", ip_address);
+        fprintf(f, "%-15s  ", ip_address);
   	else
-            fprintf(f, "%-15s  ", empty_ip4);
+        fprintf(f, "%-15s  ", empty_ip4);
   #endif
-        }
-        if (config.what_to_count & COUNT_PEER_DST_IP) {
-          addr_to_str(ip_address, &pbgp->peer_dst_ip);
+    }
+    if (config.what_to_count & COUNT_PEER_DST_IP) {
+      addr_to_str(ip_address, &pbgp->peer_dst_ip);
   #if defined ENABLE_IPV6
-          if (strlen(ip_address))
-            fprintf(f, "%-45s  ", ip_address);
-          else
-            fprintf(f, "%-45s  ", empty_ip6);
+      if (strlen(ip_address))
+        fprintf(f, "%-45s  ", ip_address);
+      else
+        fprintf(f, "%-45s  ", empty_ip6);
   #else
-          if (strlen(ip_address))
-            fprintf(f, "%-15s  ", ip_address);
-          else 
-            fprintf(f, "%-15s  ", empty_ip4);
+      if (strlen(ip_address))
+        fprintf(f, "%-15s  ", ip_address);
+      else 
+        fprintf(f, "%-15s  ", empty_ip4);
   #endif
-        }
+    }
   
-        if (config.what_to_count & COUNT_IN_IFACE) fprintf(f, "%-10u  ", data->ifindex_in);
-        if (config.what_to_count & COUNT_OUT_IFACE) fprintf(f, "%-10u  ", data->ifindex_out);
+    if (config.what_to_count & COUNT_IN_IFACE) fprintf(f, "%-10u  ", data->ifindex_in);
+    if (config.what_to_count & COUNT_OUT_IFACE) fprintf(f, "%-10u  ", data->ifindex_out);
   
-        if (config.what_to_count & COUNT_MPLS_VPN_RD) {
-          bgp_rd2str(rd_str, &pbgp->mpls_vpn_rd);
+    if (config.what_to_count & COUNT_MPLS_VPN_RD) {
+      bgp_rd2str(rd_str, &pbgp->mpls_vpn_rd);
   	if (strlen(rd_str))
-            fprintf(f, "%-18s  ", rd_str);
+        fprintf(f, "%-18s  ", rd_str);
   	else
-            fprintf(f, "%-18s  ", empty_rd);
-        }
+        fprintf(f, "%-18s  ", empty_rd);
+    }
   
-        if (config.what_to_count & (COUNT_SRC_HOST|COUNT_SUM_HOST)) {
-          addr_to_str(src_host, &data->src_ip);
+    if (config.what_to_count & (COUNT_SRC_HOST|COUNT_SUM_HOST)) {
+      addr_to_str(src_host, &data->src_ip);
   #if defined ENABLE_IPV6
   	if (strlen(src_host))
-            fprintf(f, "%-45s  ", src_host);
+        fprintf(f, "%-45s  ", src_host);
   	else
-            fprintf(f, "%-45s  ", empty_ip6);
+        fprintf(f, "%-45s  ", empty_ip6);
   #else
   	if (strlen(src_host))
-            fprintf(f, "%-15s  ", src_host);
+        fprintf(f, "%-15s  ", src_host);
   	else
-            fprintf(f, "%-15s  ", empty_ip4);
+        fprintf(f, "%-15s  ", empty_ip4);
   #endif
-        }
+    }
 
-        if (config.what_to_count & (COUNT_SRC_NET|COUNT_SUM_NET)) {
-          addr_to_str(src_host, &data->src_net);
+    if (config.what_to_count & (COUNT_SRC_NET|COUNT_SUM_NET)) {
+      addr_to_str(src_host, &data->src_net);
   #if defined ENABLE_IPV6
-        if (strlen(src_host))
-            fprintf(f, "%-45s  ", src_host);
-        else
-            fprintf(f, "%-45s  ", empty_ip6);
+    if (strlen(src_host))
+        fprintf(f, "%-45s  ", src_host);
+    else
+        fprintf(f, "%-45s  ", empty_ip6);
   #else
-        if (strlen(src_host))
-            fprintf(f, "%-15s  ", src_host);
-        else
-            fprintf(f, "%-15s  ", empty_ip4);
+    if (strlen(src_host))
+        fprintf(f, "%-15s  ", src_host);
+    else
+        fprintf(f, "%-15s  ", empty_ip4);
   #endif
-        }
+    }
 
-        if (config.what_to_count & COUNT_DST_HOST) {
-          addr_to_str(dst_host, &data->dst_ip);
+    if (config.what_to_count & COUNT_DST_HOST) {
+      addr_to_str(dst_host, &data->dst_ip);
   #if defined ENABLE_IPV6
   	if (strlen(dst_host))
-            fprintf(f, "%-45s  ", dst_host);
+        fprintf(f, "%-45s  ", dst_host);
   	else
-            fprintf(f, "%-45s  ", empty_ip6);
+        fprintf(f, "%-45s  ", empty_ip6);
   #else
   	if (strlen(dst_host))
-            fprintf(f, "%-15s  ", dst_host);
+        fprintf(f, "%-15s  ", dst_host);
   	else
-            fprintf(f, "%-15s  ", empty_ip4);
+        fprintf(f, "%-15s  ", empty_ip4);
   #endif
-        }
+    }
 
-        if (config.what_to_count & COUNT_DST_NET) {
-          addr_to_str(dst_host, &data->dst_net);
+    if (config.what_to_count & COUNT_DST_NET) {
+      addr_to_str(dst_host, &data->dst_net);
   #if defined ENABLE_IPV6
-        if (strlen(dst_host))
-            fprintf(f, "%-45s  ", dst_host);
-        else
-            fprintf(f, "%-45s  ", empty_ip6);
+    if (strlen(dst_host))
+        fprintf(f, "%-45s  ", dst_host);
+    else
+        fprintf(f, "%-45s  ", empty_ip6);
   #else
-        if (strlen(dst_host))
-            fprintf(f, "%-15s  ", dst_host);
-        else
-            fprintf(f, "%-15s  ", empty_ip4);
+    if (strlen(dst_host))
+        fprintf(f, "%-15s  ", dst_host);
+    else
+        fprintf(f, "%-15s  ", empty_ip4);
   #endif
-        }
+    }
 
-        if (config.what_to_count & COUNT_SRC_NMASK) fprintf(f, "%-3u       ", data->src_nmask);
-        if (config.what_to_count & COUNT_DST_NMASK) fprintf(f, "%-3u       ", data->dst_nmask);
-        if (config.what_to_count & (COUNT_SRC_PORT|COUNT_SUM_PORT)) fprintf(f, "%-5u     ", data->src_port);
-        if (config.what_to_count & COUNT_DST_PORT) fprintf(f, "%-5u     ", data->dst_port);
-        if (config.what_to_count & COUNT_TCPFLAGS) fprintf(f, "%-3u        ", queue[j]->tcp_flags);
+    if (config.what_to_count & COUNT_SRC_NMASK) fprintf(f, "%-3u       ", data->src_nmask);
+    if (config.what_to_count & COUNT_DST_NMASK) fprintf(f, "%-3u       ", data->dst_nmask);
+    if (config.what_to_count & (COUNT_SRC_PORT|COUNT_SUM_PORT)) fprintf(f, "%-5u     ", data->src_port);
+    if (config.what_to_count & COUNT_DST_PORT) fprintf(f, "%-5u     ", data->dst_port);
+    if (config.what_to_count & COUNT_TCPFLAGS) fprintf(f, "%-3u        ", cc->tcp_flags);
   
-        if (config.what_to_count & COUNT_IP_PROTO) {
-          if (!config.num_protos && (data->proto < protocols_number))
+    if (config.what_to_count & COUNT_IP_PROTO) {
+      if (!config.num_protos && (data->proto < protocols_number))
 	    fprintf(f, "%-10s  ", _protocols[data->proto].name);
-          else
+      else
 	    fprintf(f, "%-10d  ", data->proto);
-        }
+    }
   
-        if (config.what_to_count & COUNT_IP_TOS) fprintf(f, "%-3u    ", data->tos);
+    if (config.what_to_count & COUNT_IP_TOS) fprintf(f, "%-3u    ", data->tos);
   
   #if defined WITH_GEOIP
-        if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) fprintf(f, "%-5s       ", GeoIP_code_by_id(data->src_ip_country.id));
-        if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) fprintf(f, "%-5s       ", GeoIP_code_by_id(data->dst_ip_country.id));
+    if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) fprintf(f, "%-5s       ", GeoIP_code_by_id(data->src_ip_country.id));
+    if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) fprintf(f, "%-5s       ", GeoIP_code_by_id(data->dst_ip_country.id));
   #endif
   #if defined WITH_GEOIPV2
-        if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) fprintf(f, "%-5s       ", data->src_ip_country.str);
-        if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) fprintf(f, "%-5s       ", data->dst_ip_country.str);
-        if (config.what_to_count_2 & COUNT_SRC_HOST_POCODE) fprintf(f, "%-12s  ", data->src_ip_pocode.str);
-        if (config.what_to_count_2 & COUNT_DST_HOST_POCODE) fprintf(f, "%-12s  ", data->dst_ip_pocode.str);
+    if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) fprintf(f, "%-5s       ", data->src_ip_country.str);
+    if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) fprintf(f, "%-5s       ", data->dst_ip_country.str);
+    if (config.what_to_count_2 & COUNT_SRC_HOST_POCODE) fprintf(f, "%-12s  ", data->src_ip_pocode.str);
+    if (config.what_to_count_2 & COUNT_DST_HOST_POCODE) fprintf(f, "%-12s  ", data->dst_ip_pocode.str);
   #endif
   
-        if (config.what_to_count_2 & COUNT_SAMPLING_RATE) fprintf(f, "%-7u       ", data->sampling_rate);
-        if (config.what_to_count_2 & COUNT_PKT_LEN_DISTRIB) fprintf(f, "%-10s      ", config.pkt_len_distrib_bins[data->pkt_len_distrib]);
+    if (config.what_to_count_2 & COUNT_SAMPLING_RATE) fprintf(f, "%-7u       ", data->sampling_rate);
+    if (config.what_to_count_2 & COUNT_PKT_LEN_DISTRIB) fprintf(f, "%-10s      ", config.pkt_len_distrib_bins[data->pkt_len_distrib]);
   
-        if (config.what_to_count_2 & COUNT_POST_NAT_SRC_HOST) {
-          addr_to_str(ip_address, &pnat->post_nat_src_ip);
+    if (config.what_to_count_2 & COUNT_POST_NAT_SRC_HOST) {
+      addr_to_str(ip_address, &pnat->post_nat_src_ip);
   
   #if defined ENABLE_IPV6
-          if (strlen(ip_address))
-            fprintf(f, "%-45s  ", ip_address);
-          else
-            fprintf(f, "%-45s  ", empty_ip6);
+      if (strlen(ip_address))
+        fprintf(f, "%-45s  ", ip_address);
+      else
+        fprintf(f, "%-45s  ", empty_ip6);
   #else
-          if (strlen(ip_address))
-            fprintf(f, "%-15s  ", ip_address);
-          else
-            fprintf(f, "%-15s  ", empty_ip4);
+      if (strlen(ip_address))
+        fprintf(f, "%-15s  ", ip_address);
+      else
+        fprintf(f, "%-15s  ", empty_ip4);
   #endif
-        }
+    }
   
-        if (config.what_to_count_2 & COUNT_POST_NAT_DST_HOST) {
-          addr_to_str(ip_address, &pnat->post_nat_dst_ip);
+    if (config.what_to_count_2 & COUNT_POST_NAT_DST_HOST) {
+      addr_to_str(ip_address, &pnat->post_nat_dst_ip);
   
   #if defined ENABLE_IPV6
-          if (strlen(ip_address))
-            fprintf(f, "%-45s  ", ip_address);
-          else
-            fprintf(f, "%-45s  ", empty_ip6);
+      if (strlen(ip_address))
+        fprintf(f, "%-45s  ", ip_address);
+      else
+        fprintf(f, "%-45s  ", empty_ip6);
   #else 
-          if (strlen(ip_address))
-            fprintf(f, "%-15s  ", ip_address);
-          else
-            fprintf(f, "%-15s  ", empty_ip4);
+      if (strlen(ip_address))
+        fprintf(f, "%-15s  ", ip_address);
+      else
+        fprintf(f, "%-15s  ", empty_ip4);
   #endif
-        }
+    }
   
-        if (config.what_to_count_2 & COUNT_POST_NAT_SRC_PORT) fprintf(f, "%-5u              ", pnat->post_nat_src_port);
-        if (config.what_to_count_2 & COUNT_POST_NAT_DST_PORT) fprintf(f, "%-5u              ", pnat->post_nat_dst_port);
-        if (config.what_to_count_2 & COUNT_NAT_EVENT) fprintf(f, "%-3u       ", pnat->nat_event);
+    if (config.what_to_count_2 & COUNT_POST_NAT_SRC_PORT) fprintf(f, "%-5u              ", pnat->post_nat_src_port);
+    if (config.what_to_count_2 & COUNT_POST_NAT_DST_PORT) fprintf(f, "%-5u              ", pnat->post_nat_dst_port);
+    if (config.what_to_count_2 & COUNT_NAT_EVENT) fprintf(f, "%-3u       ", pnat->nat_event);
   
-        if (config.what_to_count_2 & COUNT_MPLS_LABEL_TOP) {
+    if (config.what_to_count_2 & COUNT_MPLS_LABEL_TOP) {
   	fprintf(f, "%-7u         ", pmpls->mpls_label_top);
-        }
-        if (config.what_to_count_2 & COUNT_MPLS_LABEL_BOTTOM) {
+    }
+    if (config.what_to_count_2 & COUNT_MPLS_LABEL_BOTTOM) {
   	fprintf(f, "%-7u            ", pmpls->mpls_label_bottom);
-        }
-        if (config.what_to_count_2 & COUNT_MPLS_STACK_DEPTH) {
+    }
+    if (config.what_to_count_2 & COUNT_MPLS_STACK_DEPTH) {
   	fprintf(f, "%-2u                ", pmpls->mpls_stack_depth);
-        }
+    }
 
 	if (config.what_to_count_2 & COUNT_TUNNEL_SRC_HOST) {
-          addr_to_str(ip_address, &ptun->tunnel_src_ip);
+      addr_to_str(ip_address, &ptun->tunnel_src_ip);
 
 #if defined ENABLE_IPV6
 	  if (strlen(ip_address))
@@ -836,237 +1008,237 @@ void P_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 
 	if (config.what_to_count_2 & COUNT_TUNNEL_IP_TOS) fprintf(f, "%-3u         ", ptun->tunnel_tos);
   
-        if (config.what_to_count_2 & COUNT_TIMESTAMP_START) {
-          char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
-          time_t time1;
-          struct tm *time2;
+    if (config.what_to_count_2 & COUNT_TIMESTAMP_START) {
+      char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
+      time_t time1;
+      struct tm *time2;
   
-          if (config.timestamps_since_epoch) {
+      if (config.timestamps_since_epoch) {
 	    snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_start.tv_sec, pnat->timestamp_start.tv_usec);
 	  }
 	  else {
-            time1 = pnat->timestamp_start.tv_sec;
-            time2 = localtime(&time1);
-            strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_start.tv_usec);
+        time1 = pnat->timestamp_start.tv_sec;
+        time2 = localtime_r(&time1, &tm_buf);
+        strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
+        snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_start.tv_usec);
 	  }
 
-          fprintf(f, "%-30s ", buf2);
-        }
+      fprintf(f, "%-30s ", buf2);
+    }
   
-        if (config.what_to_count_2 & COUNT_TIMESTAMP_END) {
-          char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
-          time_t time1;
-          struct tm *time2;
-        
-          if (config.timestamps_since_epoch) {
-            snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_end.tv_sec, pnat->timestamp_end.tv_usec);
-          }
-          else {
-            time1 = pnat->timestamp_end.tv_sec;
-            time2 = localtime(&time1);
-            strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_end.tv_usec);
+    if (config.what_to_count_2 & COUNT_TIMESTAMP_END) {
+      char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
+      time_t time1;
+      struct tm *time2;
+    
+      if (config.timestamps_since_epoch) {
+        snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_end.tv_sec, pnat->timestamp_end.tv_usec);
+      }
+      else {
+        time1 = pnat->timestamp_end.tv_sec;
+        time2 = localtime_r(&time1, &tm_buf);
+        strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
+        snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_end.tv_usec);
 	  }
 
-          fprintf(f, "%-30s ", buf2);
-        }
+      fprintf(f, "%-30s ", buf2);
+    }
 
-        if (config.what_to_count_2 & COUNT_TIMESTAMP_ARRIVAL) {
-          char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
-          time_t time1;
-          struct tm *time2;
+    if (config.what_to_count_2 & COUNT_TIMESTAMP_ARRIVAL) {
+      char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
+      time_t time1;
+      struct tm *time2;
 
-          if (config.timestamps_since_epoch) {
-            snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_arrival.tv_sec, pnat->timestamp_arrival.tv_usec);
-          }
-          else {
-            time1 = pnat->timestamp_arrival.tv_sec;
-            time2 = localtime(&time1);
-            strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_arrival.tv_usec);
-          }
+      if (config.timestamps_since_epoch) {
+        snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_arrival.tv_sec, pnat->timestamp_arrival.tv_usec);
+      }
+      else {
+        time1 = pnat->timestamp_arrival.tv_sec;
+        time2 = localtime_r(&time1, &tm_buf);
+        strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
+        snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_arrival.tv_usec);
+      }
 
-          fprintf(f, "%-30s ", buf2);
-        }
+      fprintf(f, "%-30s ", buf2);
+    }
 
-        if (config.nfacctd_stitching && queue[j]->stitch) {
-          char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
-          time_t time1;
-          struct tm *time2;
+    if (config.nfacctd_stitching && cc->stitch) {
+      char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
+      time_t time1;
+      struct tm *time2;
 
-          if (config.timestamps_since_epoch) {
-            snprintf(buf2, SRVBUFLEN, "%u.%u", queue[j]->stitch->timestamp_min.tv_sec, queue[j]->stitch->timestamp_min.tv_usec);
-            fprintf(f, "%-30s ", buf2);
+      if (config.timestamps_since_epoch) {
+        snprintf(buf2, SRVBUFLEN, "%u.%u", cc->stitch->timestamp_min.tv_sec, cc->stitch->timestamp_min.tv_usec);
+        fprintf(f, "%-30s ", buf2);
 
-            snprintf(buf2, SRVBUFLEN, "%u.%u", queue[j]->stitch->timestamp_max.tv_sec, queue[j]->stitch->timestamp_max.tv_usec);
-            fprintf(f, "%-30s ", buf2);
-          }
-          else {
-	    time1 = queue[j]->stitch->timestamp_min.tv_sec;
-            time2 = localtime(&time1);
-            strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, queue[j]->stitch->timestamp_min.tv_usec);
-            fprintf(f, "%-30s ", buf2);
-
-            time1 = queue[j]->stitch->timestamp_max.tv_sec;
-            time2 = localtime(&time1);
-            strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, queue[j]->stitch->timestamp_max.tv_usec);
-            fprintf(f, "%-30s ", buf2);
+        snprintf(buf2, SRVBUFLEN, "%u.%u", cc->stitch->timestamp_max.tv_sec, cc->stitch->timestamp_max.tv_usec);
+        fprintf(f, "%-30s ", buf2);
+      }
+      else {
+	    time1 = cc->stitch->timestamp_min.tv_sec;
+        time2 = localtime_r(&time1, &tm_buf);
+        strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
+        snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, cc->stitch->timestamp_min.tv_usec);
+        fprintf(f, "%-30s ", buf2);
+
+        time1 = cc->stitch->timestamp_max.tv_sec;
+        time2 = localtime_r(&time1, &tm_buf);
+        strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
+        snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, cc->stitch->timestamp_max.tv_usec);
+        fprintf(f, "%-30s ", buf2);
 	  }
-        }
+    }
 
-        if (config.what_to_count_2 & COUNT_EXPORT_PROTO_SEQNO) fprintf(f, "%-18u  ", data->export_proto_seqno);
-        if (config.what_to_count_2 & COUNT_EXPORT_PROTO_VERSION) fprintf(f, "%-20u  ", data->export_proto_version);
+    if (config.what_to_count_2 & COUNT_EXPORT_PROTO_SEQNO) fprintf(f, "%-18u  ", data->export_proto_seqno);
+    if (config.what_to_count_2 & COUNT_EXPORT_PROTO_VERSION) fprintf(f, "%-20u  ", data->export_proto_version);
 
-        /* all custom primitives printed here */
-        {
-          int cp_idx;
+    /* all custom primitives printed here */
+    {
+      int cp_idx;
   
-          for (cp_idx = 0; cp_idx < config.cpptrs.num; cp_idx++) {
+      for (cp_idx = 0; cp_idx < config.cpptrs.num; cp_idx++) {
 	    if (config.cpptrs.primitive[cp_idx].ptr->len != PM_VARIABLE_LENGTH) {
-              char cp_str[SRVBUFLEN];
+          char cp_str[SRVBUFLEN];
 
-              custom_primitive_value_print(cp_str, SRVBUFLEN, pcust, &config.cpptrs.primitive[cp_idx], TRUE);
+          custom_primitive_value_print(cp_str, SRVBUFLEN, pcust, &config.cpptrs.primitive[cp_idx], TRUE);
 	      fprintf(f, "%s  ", cp_str);
 	    }
 	    else {
 	      /* vlen primitives not supported in formatted outputs: we should never get here */
-              char *label_ptr = NULL;
+          char *label_ptr = NULL;
 
-              vlen_prims_get(pvlen, config.cpptrs.primitive[cp_idx].ptr->type, &label_ptr);
-              if (!label_ptr) label_ptr = empty_string;
-              fprintf(f, "%s  ", label_ptr);
+          vlen_prims_get(pvlen, config.cpptrs.primitive[cp_idx].ptr->type, &label_ptr);
+          if (!label_ptr) label_ptr = empty_string;
+          fprintf(f, "%s  ", label_ptr);
 	    }
-          }
-        }
+      }
+    }
 
-        if (!is_event) {
+    if (!is_event) {
   #if defined HAVE_64BIT_COUNTERS
-          fprintf(f, "%-20llu  ", queue[j]->packet_counter);
-          if (config.what_to_count & COUNT_FLOWS) fprintf(f, "%-20llu  ", queue[j]->flow_counter);
-          fprintf(f, "%llu\n", queue[j]->bytes_counter);
+      fprintf(f, "%-20llu  ", cc->packet_counter);
+      if (config.what_to_count & COUNT_FLOWS) fprintf(f, "%-20llu  ", cc->flow_counter);
+      fprintf(f, "%llu\n", cc->bytes_counter);
   #else
-          fprintf(f, "%-10lu  ", queue[j]->packet_counter);
-          if (config.what_to_count & COUNT_FLOWS) fprintf(f, "%-10lu  ", queue[j]->flow_counter);
-          fprintf(f, "%lu\n", queue[j]->bytes_counter);
+      fprintf(f, "%-10lu  ", cc->packet_counter);
+      if (config.what_to_count & COUNT_FLOWS) fprintf(f, "%-10lu  ", cc->flow_counter);
+      fprintf(f, "%lu\n", cc->bytes_counter);
   #endif
-        }
-        else fprintf(f, "\n");
-      }
-      else if (f && config.print_output & PRINT_OUTPUT_CSV) {
-        if (config.what_to_count & COUNT_TAG) fprintf(f, "%s%llu", write_sep(sep, &count), data->tag);
-        if (config.what_to_count & COUNT_TAG2) fprintf(f, "%s%llu", write_sep(sep, &count), data->tag2);
+    }
+    else fprintf(f, "\n");
+  }
+  else if (f && config.print_output & PRINT_OUTPUT_CSV) {
+    if (config.what_to_count & COUNT_TAG) fprintf(f, "%s%llu", write_sep(sep, &count), data->tag);
+    if (config.what_to_count & COUNT_TAG2) fprintf(f, "%s%llu", write_sep(sep, &count), data->tag2);
 	if (config.what_to_count_2 & COUNT_LABEL) P_fprintf_csv_string(f, pvlen, COUNT_INT_LABEL, write_sep(sep, &count), empty_string);
-        if (config.what_to_count & COUNT_CLASS) fprintf(f, "%s%s", write_sep(sep, &count), ((data->class && class[(data->class)-1].id) ? class[(data->class)-1].protocol : "unknown" ));
+    if (config.what_to_count & COUNT_CLASS) fprintf(f, "%s%s", write_sep(sep, &count), ((data->class && class[(data->class)-1].id) ? class[(data->class)-1].protocol : "unknown" ));
   #if defined (HAVE_L2)
-        if (config.what_to_count & (COUNT_SRC_MAC|COUNT_SUM_MAC)) {
-          etheraddr_string(data->eth_shost, src_mac);
-          fprintf(f, "%s%s", write_sep(sep, &count), src_mac);
-        }
-        if (config.what_to_count & COUNT_DST_MAC) {
-          etheraddr_string(data->eth_dhost, dst_mac);
-          fprintf(f, "%s%s", write_sep(sep, &count), dst_mac);
-        }
-        if (config.what_to_count & COUNT_VLAN) fprintf(f, "%s%u", write_sep(sep, &count), data->vlan_id); 
-        if (config.what_to_count & COUNT_COS) fprintf(f, "%s%u", write_sep(sep, &count), data->cos); 
-        if (config.what_to_count & COUNT_ETHERTYPE) fprintf(f, "%s%x", write_sep(sep, &count), data->etype); 
+    if (config.what_to_count & (COUNT_SRC_MAC|COUNT_SUM_MAC)) {
+      etheraddr_string(data->eth_shost, src_mac);
+      fprintf(f, "%s%s", write_sep(sep, &count), src_mac);
+    }
+    if (config.what_to_count & COUNT_DST_MAC) {
+      etheraddr_string(data->eth_dhost, dst_mac);
+      fprintf(f, "%s%s", write_sep(sep, &count), dst_mac);
+    }
+    if (config.what_to_count & COUNT_VLAN) fprintf(f, "%s%u", write_sep(sep, &count), data->vlan_id); 
+    if (config.what_to_count & COUNT_COS) fprintf(f, "%s%u", write_sep(sep, &count), data->cos); 
+    if (config.what_to_count & COUNT_ETHERTYPE) fprintf(f, "%s%x", write_sep(sep, &count), data->etype); 
   #endif
-        if (config.what_to_count & (COUNT_SRC_AS|COUNT_SUM_AS)) fprintf(f, "%s%u", write_sep(sep, &count), data->src_as); 
-        if (config.what_to_count & COUNT_DST_AS) fprintf(f, "%s%u", write_sep(sep, &count), data->dst_as); 
+    if (config.what_to_count & (COUNT_SRC_AS|COUNT_SUM_AS)) fprintf(f, "%s%u", write_sep(sep, &count), data->src_as); 
+    if (config.what_to_count & COUNT_DST_AS) fprintf(f, "%s%u", write_sep(sep, &count), data->dst_as); 
   
-        if (config.what_to_count & COUNT_STD_COMM) {
-          char *str_ptr = NULL;
-
-          vlen_prims_get(pvlen, COUNT_INT_STD_COMM, &str_ptr);
-          if (str_ptr) {
-            bgp_comm = str_ptr;
-            while (bgp_comm) {
-              bgp_comm = strchr(str_ptr, ' ');
-              if (bgp_comm) *bgp_comm = '_';
-            }
-
-          }
-
-          P_fprintf_csv_string(f, pvlen, COUNT_INT_STD_COMM, write_sep(sep, &count), empty_string);
+    if (config.what_to_count & COUNT_STD_COMM) {
+      char *str_ptr = NULL;
+
+      vlen_prims_get(pvlen, COUNT_INT_STD_COMM, &str_ptr);
+      if (str_ptr) {
+        bgp_comm = str_ptr;
+        while (bgp_comm) {
+          bgp_comm = strchr(str_ptr, ' ');
+          if (bgp_comm) *bgp_comm = '_';
         }
 
-        if (config.what_to_count & COUNT_EXT_COMM) {
-          char *str_ptr = NULL;
+      }
 
-          vlen_prims_get(pvlen, COUNT_INT_EXT_COMM, &str_ptr);
-          if (str_ptr) {
-            bgp_comm = str_ptr;
-            while (bgp_comm) {
-              bgp_comm = strchr(str_ptr, ' ');
-              if (bgp_comm) *bgp_comm = '_';
-            }
-          }
+      P_fprintf_csv_string(f, pvlen, COUNT_INT_STD_COMM, write_sep(sep, &count), empty_string);
+    }
+
+    if (config.what_to_count & COUNT_EXT_COMM) {
+      char *str_ptr = NULL;
 
-          P_fprintf_csv_string(f, pvlen, COUNT_INT_EXT_COMM, write_sep(sep, &count), empty_string);
+      vlen_prims_get(pvlen, COUNT_INT_EXT_COMM, &str_ptr);
+      if (str_ptr) {
+        bgp_comm = str_ptr;
+        while (bgp_comm) {
+          bgp_comm = strchr(str_ptr, ' ');
+          if (bgp_comm) *bgp_comm = '_';
         }
+      }
 
-        if (config.what_to_count_2 & COUNT_LRG_COMM) {
-          char *str_ptr = NULL;
+      P_fprintf_csv_string(f, pvlen, COUNT_INT_EXT_COMM, write_sep(sep, &count), empty_string);
+    }
 
-          vlen_prims_get(pvlen, COUNT_INT_LRG_COMM, &str_ptr);
-          if (str_ptr) {
-            bgp_comm = str_ptr;
-            while (bgp_comm) {
-              bgp_comm = strchr(str_ptr, ' ');
-              if (bgp_comm) *bgp_comm = '_';
-            }
-          }
+    if (config.what_to_count_2 & COUNT_LRG_COMM) {
+      char *str_ptr = NULL;
 
-          P_fprintf_csv_string(f, pvlen, COUNT_INT_LRG_COMM, write_sep(sep, &count), empty_string);
+      vlen_prims_get(pvlen, COUNT_INT_LRG_COMM, &str_ptr);
+      if (str_ptr) {
+        bgp_comm = str_ptr;
+        while (bgp_comm) {
+          bgp_comm = strchr(str_ptr, ' ');
+          if (bgp_comm) *bgp_comm = '_';
         }
+      }
 
-        if (config.what_to_count & COUNT_SRC_STD_COMM) {
-          char *str_ptr = NULL;
+      P_fprintf_csv_string(f, pvlen, COUNT_INT_LRG_COMM, write_sep(sep, &count), empty_string);
+    }
 
-          vlen_prims_get(pvlen, COUNT_INT_SRC_STD_COMM, &str_ptr);
-          if (str_ptr) {
-            bgp_comm = str_ptr;
-            while (bgp_comm) {
-              bgp_comm = strchr(str_ptr, ' ');
-              if (bgp_comm) *bgp_comm = '_';
-            }
+    if (config.what_to_count & COUNT_SRC_STD_COMM) {
+      char *str_ptr = NULL;
 
-          }
-
-          P_fprintf_csv_string(f, pvlen, COUNT_INT_SRC_STD_COMM, write_sep(sep, &count), empty_string);
+      vlen_prims_get(pvlen, COUNT_INT_SRC_STD_COMM, &str_ptr);
+      if (str_ptr) {
+        bgp_comm = str_ptr;
+        while (bgp_comm) {
+          bgp_comm = strchr(str_ptr, ' ');
+          if (bgp_comm) *bgp_comm = '_';
         }
 
-        if (config.what_to_count & COUNT_SRC_EXT_COMM) {
-          char *str_ptr = NULL;
+      }
 
-          vlen_prims_get(pvlen, COUNT_INT_SRC_EXT_COMM, &str_ptr);
-          if (str_ptr) {
-            bgp_comm = str_ptr;
-            while (bgp_comm) {
-              bgp_comm = strchr(str_ptr, ' ');
-              if (bgp_comm) *bgp_comm = '_';
-            }
-          }
+      P_fprintf_csv_string(f, pvlen, COUNT_INT_SRC_STD_COMM, write_sep(sep, &count), empty_string);
+    }
 
-          P_fprintf_csv_string(f, pvlen, COUNT_INT_SRC_EXT_COMM, write_sep(sep, &count), empty_string);
+    if (config.what_to_count & COUNT_SRC_EXT_COMM) {
+      char *str_ptr = NULL;
+
+      vlen_prims_get(pvlen, COUNT_INT_SRC_EXT_COMM, &str_ptr);
+      if (str_ptr) {
+        bgp_comm = str_ptr;
+        while (bgp_comm) {
+          bgp_comm = strchr(str_ptr, ' ');
+          if (bgp_comm) *bgp_comm = '_';
         }
+      }
 
-        if (config.what_to_count_2 & COUNT_SRC_LRG_COMM) {
-          char *str_ptr = NULL;
+      P_fprintf_csv_string(f, pvlen, COUNT_INT_SRC_EXT_COMM, write_sep(sep, &count), empty_string);
+    }
 
-          vlen_prims_get(pvlen, COUNT_INT_SRC_LRG_COMM, &str_ptr);
-          if (str_ptr) {
-            bgp_comm = str_ptr;
-            while (bgp_comm) {
-              bgp_comm = strchr(str_ptr, ' ');
-              if (bgp_comm) *bgp_comm = '_';
-            }
-          }
+    if (config.what_to_count_2 & COUNT_SRC_LRG_COMM) {
+      char *str_ptr = NULL;
 
-          P_fprintf_csv_string(f, pvlen, COUNT_INT_SRC_LRG_COMM, write_sep(sep, &count), empty_string);
+      vlen_prims_get(pvlen, COUNT_INT_SRC_LRG_COMM, &str_ptr);
+      if (str_ptr) {
+        bgp_comm = str_ptr;
+        while (bgp_comm) {
+          bgp_comm = strchr(str_ptr, ' ');
+          if (bgp_comm) *bgp_comm = '_';
         }
+      }
+
+      P_fprintf_csv_string(f, pvlen, COUNT_INT_SRC_LRG_COMM, write_sep(sep, &count), empty_string);
+    }
   
 	if (config.what_to_count & COUNT_AS_PATH) {
 	  char *str_ptr = NULL;
@@ -1074,9 +1246,9 @@ void P_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 	  vlen_prims_get(pvlen, COUNT_INT_AS_PATH, &str_ptr);
 	  if (str_ptr) {
 	    as_path = str_ptr;
-            while (as_path) {
-              as_path = strchr(str_ptr, ' ');
-              if (as_path) *as_path = '_';
+        while (as_path) {
+          as_path = strchr(str_ptr, ' ');
+          if (as_path) *as_path = '_';
 	    }
 
 	  }
@@ -1084,109 +1256,109 @@ void P_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 	  P_fprintf_csv_string(f, pvlen, COUNT_INT_AS_PATH, write_sep(sep, &count), empty_string);
 	}
 
-        if (config.what_to_count & COUNT_SRC_AS_PATH) {
-          char *str_ptr = NULL;
+    if (config.what_to_count & COUNT_SRC_AS_PATH) {
+      char *str_ptr = NULL;
 
-          vlen_prims_get(pvlen, COUNT_INT_SRC_AS_PATH, &str_ptr);
-          if (str_ptr) {
-            as_path = str_ptr;
-            while (as_path) {
-              as_path = strchr(str_ptr, ' ');
-              if (as_path) *as_path = '_';
-            }
+      vlen_prims_get(pvlen, COUNT_INT_SRC_AS_PATH, &str_ptr);
+      if (str_ptr) {
+        as_path = str_ptr;
+        while (as_path) {
+          as_path = strchr(str_ptr, ' ');
+          if (as_path) *as_path = '_';
+        }
 
-          }
+      }
 
-          P_fprintf_csv_string(f, pvlen, COUNT_INT_SRC_AS_PATH, write_sep(sep, &count), empty_string);
-        }
+      P_fprintf_csv_string(f, pvlen, COUNT_INT_SRC_AS_PATH, write_sep(sep, &count), empty_string);
+    }
 
-        if (config.what_to_count & COUNT_LOCAL_PREF) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->local_pref);
-        if (config.what_to_count & COUNT_SRC_LOCAL_PREF) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->src_local_pref);
-        if (config.what_to_count & COUNT_MED) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->med);
-        if (config.what_to_count & COUNT_SRC_MED) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->src_med);
+    if (config.what_to_count & COUNT_LOCAL_PREF) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->local_pref);
+    if (config.what_to_count & COUNT_SRC_LOCAL_PREF) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->src_local_pref);
+    if (config.what_to_count & COUNT_MED) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->med);
+    if (config.what_to_count & COUNT_SRC_MED) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->src_med);
 
-        if (config.what_to_count & COUNT_PEER_SRC_AS) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->peer_src_as);
-        if (config.what_to_count & COUNT_PEER_DST_AS) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->peer_dst_as);
+    if (config.what_to_count & COUNT_PEER_SRC_AS) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->peer_src_as);
+    if (config.what_to_count & COUNT_PEER_DST_AS) fprintf(f, "%s%u", write_sep(sep, &count), pbgp->peer_dst_as);
   
-        if (config.what_to_count & COUNT_PEER_SRC_IP) {
-          addr_to_str(ip_address, &pbgp->peer_src_ip);
-          fprintf(f, "%s%s", write_sep(sep, &count), ip_address);
-        }
-        if (config.what_to_count & COUNT_PEER_DST_IP) {
-          addr_to_str(ip_address, &pbgp->peer_dst_ip);
-          fprintf(f, "%s%s", write_sep(sep, &count), ip_address);
-        }
+    if (config.what_to_count & COUNT_PEER_SRC_IP) {
+      addr_to_str(ip_address, &pbgp->peer_src_ip);
+      fprintf(f, "%s%s", write_sep(sep, &count), ip_address);
+    }
+    if (config.what_to_count & COUNT_PEER_DST_IP) {
+      addr_to_str(ip_address, &pbgp->peer_dst_ip);
+      fprintf(f, "%s%s", write_sep(sep, &count), ip_address);
+    }
   
-        if (config.what_to_count & COUNT_IN_IFACE) fprintf(f, "%s%u", write_sep(sep, &count), data->ifindex_in);
-        if (config.what_to_count & COUNT_OUT_IFACE) fprintf(f, "%s%u", write_sep(sep, &count), data->ifindex_out);
+    if (config.what_to_count & COUNT_IN_IFACE) fprintf(f, "%s%u", write_sep(sep, &count), data->ifindex_in);
+    if (config.what_to_count & COUNT_OUT_IFACE) fprintf(f, "%s%u", write_sep(sep, &count), data->ifindex_out);
   
-        if (config.what_to_count & COUNT_MPLS_VPN_RD) {
-          bgp_rd2str(rd_str, &pbgp->mpls_vpn_rd);
-          fprintf(f, "%s%s", write_sep(sep, &count), rd_str);
-        }
+    if (config.what_to_count & COUNT_MPLS_VPN_RD) {
+      bgp_rd2str(rd_str, &pbgp->mpls_vpn_rd);
+      fprintf(f, "%s%s", write_sep(sep, &count), rd_str);
+    }
   
-        if (config.what_to_count & (COUNT_SRC_HOST|COUNT_SUM_HOST)) {
-          addr_to_str(src_host, &data->src_ip);
-          fprintf(f, "%s%s", write_sep(sep, &count), src_host);
-        }
-        if (config.what_to_count & (COUNT_SRC_NET|COUNT_SUM_NET)) {
-          addr_to_str(src_host, &data->src_net);
-          fprintf(f, "%s%s", write_sep(sep, &count), src_host);
-        }
+    if (config.what_to_count & (COUNT_SRC_HOST|COUNT_SUM_HOST)) {
+      addr_to_str(src_host, &data->src_ip);
+      fprintf(f, "%s%s", write_sep(sep, &count), src_host);
+    }
+    if (config.what_to_count & (COUNT_SRC_NET|COUNT_SUM_NET)) {
+      addr_to_str(src_host, &data->src_net);
+      fprintf(f, "%s%s", write_sep(sep, &count), src_host);
+    }
 
-        if (config.what_to_count & COUNT_DST_HOST) {
-          addr_to_str(dst_host, &data->dst_ip);
-          fprintf(f, "%s%s", write_sep(sep, &count), dst_host);
-        }
-        if (config.what_to_count & COUNT_DST_NET) {
-          addr_to_str(dst_host, &data->dst_net);
-          fprintf(f, "%s%s", write_sep(sep, &count), dst_host);
-        }
+    if (config.what_to_count & COUNT_DST_HOST) {
+      addr_to_str(dst_host, &data->dst_ip);
+      fprintf(f, "%s%s", write_sep(sep, &count), dst_host);
+    }
+    if (config.what_to_count & COUNT_DST_NET) {
+      addr_to_str(dst_host, &data->dst_net);
+      fprintf(f, "%s%s", write_sep(sep, &count), dst_host);
+    }
   
-        if (config.what_to_count & COUNT_SRC_NMASK) fprintf(f, "%s%u", write_sep(sep, &count), data->src_nmask);
-        if (config.what_to_count & COUNT_DST_NMASK) fprintf(f, "%s%u", write_sep(sep, &count), data->dst_nmask);
-        if (config.what_to_count & (COUNT_SRC_PORT|COUNT_SUM_PORT)) fprintf(f, "%s%u", write_sep(sep, &count), data->src_port);
-        if (config.what_to_count & COUNT_DST_PORT) fprintf(f, "%s%u", write_sep(sep, &count), data->dst_port);
-        if (config.what_to_count & COUNT_TCPFLAGS) fprintf(f, "%s%u", write_sep(sep, &count), queue[j]->tcp_flags);
+    if (config.what_to_count & COUNT_SRC_NMASK) fprintf(f, "%s%u", write_sep(sep, &count), data->src_nmask);
+    if (config.what_to_count & COUNT_DST_NMASK) fprintf(f, "%s%u", write_sep(sep, &count), data->dst_nmask);
+    if (config.what_to_count & (COUNT_SRC_PORT|COUNT_SUM_PORT)) fprintf(f, "%s%u", write_sep(sep, &count), data->src_port);
+    if (config.what_to_count & COUNT_DST_PORT) fprintf(f, "%s%u", write_sep(sep, &count), data->dst_port);
+    if (config.what_to_count & COUNT_TCPFLAGS) fprintf(f, "%s%u", write_sep(sep, &count), cc->tcp_flags);
   
-        if (config.what_to_count & COUNT_IP_PROTO) {
-          if (!config.num_protos && (data->proto < protocols_number))
+    if (config.what_to_count & COUNT_IP_PROTO) {
+      if (!config.num_protos && (data->proto < protocols_number))
 	    fprintf(f, "%s%s", write_sep(sep, &count), _protocols[data->proto].name);
-          else
+      else
 	    fprintf(f, "%s%d", write_sep(sep, &count), data->proto);
-        }
+    }
   
-        if (config.what_to_count & COUNT_IP_TOS) fprintf(f, "%s%u", write_sep(sep, &count), data->tos);
+    if (config.what_to_count & COUNT_IP_TOS) fprintf(f, "%s%u", write_sep(sep, &count), data->tos);
   
   #if defined WITH_GEOIP
-        if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) fprintf(f, "%s%s", write_sep(sep, &count), GeoIP_code_by_id(data->src_ip_country.id));
-        if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) fprintf(f, "%s%s", write_sep(sep, &count), GeoIP_code_by_id(data->dst_ip_country.id));
+    if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) fprintf(f, "%s%s", write_sep(sep, &count), GeoIP_code_by_id(data->src_ip_country.id));
+    if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) fprintf(f, "%s%s", write_sep(sep, &count), GeoIP_code_by_id(data->dst_ip_country.id));
   #endif
   #if defined WITH_GEOIPV2
-        if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) fprintf(f, "%s%s", write_sep(sep, &count), data->src_ip_country.str);
-        if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) fprintf(f, "%s%s", write_sep(sep, &count), data->dst_ip_country.str);
-        if (config.what_to_count_2 & COUNT_SRC_HOST_POCODE) fprintf(f, "%s%s", write_sep(sep, &count), data->src_ip_pocode.str);
-        if (config.what_to_count_2 & COUNT_DST_HOST_POCODE) fprintf(f, "%s%s", write_sep(sep, &count), data->dst_ip_pocode.str);
+    if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) fprintf(f, "%s%s", write_sep(sep, &count), data->src_ip_country.str);
+    if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) fprintf(f, "%s%s", write_sep(sep, &count), data->dst_ip_country.str);
+    if (config.what_to_count_2 & COUNT_SRC_HOST_POCODE) fprintf(f, "%s%s", write_sep(sep, &count), data->src_ip_pocode.str);
+    if (config.what_to_count_2 & COUNT_DST_HOST_POCODE) fprintf(f, "%s%s", write_sep(sep, &count), data->dst_ip_pocode.str);
   #endif
   
-        if (config.what_to_count_2 & COUNT_SAMPLING_RATE) fprintf(f, "%s%u", write_sep(sep, &count), data->sampling_rate);
-        if (config.what_to_count_2 & COUNT_PKT_LEN_DISTRIB) fprintf(f, "%s%s", write_sep(sep, &count), config.pkt_len_distrib_bins[data->pkt_len_distrib]);
+    if (config.what_to_count_2 & COUNT_SAMPLING_RATE) fprintf(f, "%s%u", write_sep(sep, &count), data->sampling_rate);
+    if (config.what_to_count_2 & COUNT_PKT_LEN_DISTRIB) fprintf(f, "%s%s", write_sep(sep, &count), config.pkt_len_distrib_bins[data->pkt_len_distrib]);
   
-        if (config.what_to_count_2 & COUNT_POST_NAT_SRC_HOST) {
-          addr_to_str(src_host, &pnat->post_nat_src_ip);
-          fprintf(f, "%s%s", write_sep(sep, &count), src_host);
-        }
-        if (config.what_to_count_2 & COUNT_POST_NAT_DST_HOST) {
-          addr_to_str(dst_host, &pnat->post_nat_dst_ip);
-          fprintf(f, "%s%s", write_sep(sep, &count), dst_host);
-        }
-        if (config.what_to_count_2 & COUNT_POST_NAT_SRC_PORT) fprintf(f, "%s%u", write_sep(sep, &count), pnat->post_nat_src_port);
-        if (config.what_to_count_2 & COUNT_POST_NAT_DST_PORT) fprintf(f, "%s%u", write_sep(sep, &count), pnat->post_nat_dst_port);
-        if (config.what_to_count_2 & COUNT_NAT_EVENT) fprintf(f, "%s%u", write_sep(sep, &count), pnat->nat_event);
+    if (config.what_to_count_2 & COUNT_POST_NAT_SRC_HOST) {
+      addr_to_str(src_host, &pnat->post_nat_src_ip);
+      fprintf(f, "%s%s", write_sep(sep, &count), src_host);
+    }
+    if (config.what_to_count_2 & COUNT_POST_NAT_DST_HOST) {
+      addr_to_str(dst_host, &pnat->post_nat_dst_ip);
+      fprintf(f, "%s%s", write_sep(sep, &count), dst_host);
+    }
+    if (config.what_to_count_2 & COUNT_POST_NAT_SRC_PORT) fprintf(f, "%s%u", write_sep(sep, &count), pnat->post_nat_src_port);
+    if (config.what_to_count_2 & COUNT_POST_NAT_DST_PORT) fprintf(f, "%s%u", write_sep(sep, &count), pnat->post_nat_dst_port);
+    if (config.what_to_count_2 & COUNT_NAT_EVENT) fprintf(f, "%s%u", write_sep(sep, &count), pnat->nat_event);
   
-        if (config.what_to_count_2 & COUNT_MPLS_LABEL_TOP) fprintf(f, "%s%u", write_sep(sep, &count), pmpls->mpls_label_top);
-        if (config.what_to_count_2 & COUNT_MPLS_LABEL_BOTTOM) fprintf(f, "%s%u", write_sep(sep, &count), pmpls->mpls_label_bottom);
-        if (config.what_to_count_2 & COUNT_MPLS_STACK_DEPTH) fprintf(f, "%s%u", write_sep(sep, &count), pmpls->mpls_stack_depth);
+    if (config.what_to_count_2 & COUNT_MPLS_LABEL_TOP) fprintf(f, "%s%u", write_sep(sep, &count), pmpls->mpls_label_top);
+    if (config.what_to_count_2 & COUNT_MPLS_LABEL_BOTTOM) fprintf(f, "%s%u", write_sep(sep, &count), pmpls->mpls_label_bottom);
+    if (config.what_to_count_2 & COUNT_MPLS_STACK_DEPTH) fprintf(f, "%s%u", write_sep(sep, &count), pmpls->mpls_stack_depth);
 
 	if (config.what_to_count_2 & COUNT_TUNNEL_SRC_HOST) {
 	  addr_to_str(src_host, &ptun->tunnel_src_ip);
@@ -1206,100 +1378,100 @@ void P_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 
 	if (config.what_to_count_2 & COUNT_TUNNEL_IP_TOS) fprintf(f, "%s%u", write_sep(sep, &count), ptun->tunnel_tos);
   
-        if (config.what_to_count_2 & COUNT_TIMESTAMP_START) {
-          char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
-          time_t time1;
-          struct tm *time2;
+    if (config.what_to_count_2 & COUNT_TIMESTAMP_START) {
+      char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
+      time_t time1;
+      struct tm *time2;
  
-          if (config.timestamps_since_epoch) {
-            snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_start.tv_sec, pnat->timestamp_start.tv_usec);
-          }
-          else {
-            time1 = pnat->timestamp_start.tv_sec;
-            time2 = localtime(&time1);
-            strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_start.tv_usec);
+      if (config.timestamps_since_epoch) {
+        snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_start.tv_sec, pnat->timestamp_start.tv_usec);
+      }
+      else {
+        time1 = pnat->timestamp_start.tv_sec;
+        time2 = localtime_r(&time1, &tm_buf);
+        strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
+        snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_start.tv_usec);
 	  }
 
-          fprintf(f, "%s%s", write_sep(sep, &count), buf2);
-        }
+      fprintf(f, "%s%s", write_sep(sep, &count), buf2);
+    }
   
-        if (config.what_to_count_2 & COUNT_TIMESTAMP_END) {
-          char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
-          time_t time1;
-          struct tm *time2;
+    if (config.what_to_count_2 & COUNT_TIMESTAMP_END) {
+      char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
+      time_t time1;
+      struct tm *time2;
   
-          if (config.timestamps_since_epoch) {
-            snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_end.tv_sec, pnat->timestamp_end.tv_usec);
-          }
-          else {
-            time1 = pnat->timestamp_end.tv_sec;
-            time2 = localtime(&time1);
-            strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_end.tv_usec);
+      if (config.timestamps_since_epoch) {
+        snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_end.tv_sec, pnat->timestamp_end.tv_usec);
+      }
+      else {
+        time1 = pnat->timestamp_end.tv_sec;
+        time2 = localtime_r(&time1, &tm_buf);
+        strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
+        snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_end.tv_usec);
 	  }
 
-          fprintf(f, "%s%s", write_sep(sep, &count), buf2);
-        }
+      fprintf(f, "%s%s", write_sep(sep, &count), buf2);
+    }
 
-        if (config.what_to_count_2 & COUNT_TIMESTAMP_ARRIVAL) {
-          char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
-          time_t time1;
-          struct tm *time2;
+    if (config.what_to_count_2 & COUNT_TIMESTAMP_ARRIVAL) {
+      char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
+      time_t time1;
+      struct tm *time2;
 
-          if (config.timestamps_since_epoch) {
-            snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_arrival.tv_sec, pnat->timestamp_arrival.tv_usec);
-          }
-          else {
-            time1 = pnat->timestamp_arrival.tv_sec;
-            time2 = localtime(&time1);
-            strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_arrival.tv_usec);
-          }
+      if (config.timestamps_since_epoch) {
+        snprintf(buf2, SRVBUFLEN, "%u.%u", pnat->timestamp_arrival.tv_sec, pnat->timestamp_arrival.tv_usec);
+      }
+      else {
+        time1 = pnat->timestamp_arrival.tv_sec;
+        time2 = localtime_r(&time1, &tm_buf);
+        strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
+        snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, pnat->timestamp_arrival.tv_usec);
+      }
 
-          fprintf(f, "%s%s", write_sep(sep, &count), buf2);
-        }
+      fprintf(f, "%s%s", write_sep(sep, &count), buf2);
+    }
 
-        if (config.nfacctd_stitching && queue[j]->stitch) {
-          char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
-          time_t time1;
-          struct tm *time2;
+    if (config.nfacctd_stitching && cc->stitch) {
+      char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
+      time_t time1;
+      struct tm *time2;
 
-          if (config.timestamps_since_epoch) {
-            snprintf(buf2, SRVBUFLEN, "%u.%u", queue[j]->stitch->timestamp_min.tv_sec, queue[j]->stitch->timestamp_min.tv_usec);
+      if (config.timestamps_since_epoch) {
+        snprintf(buf2, SRVBUFLEN, "%u.%u", cc->stitch->timestamp_min.tv_sec, cc->stitch->timestamp_min.tv_usec);
 	    fprintf(f, "%s%s", write_sep(sep, &count), buf2);
 
-            snprintf(buf2, SRVBUFLEN, "%u.%u", queue[j]->stitch->timestamp_max.tv_sec, queue[j]->stitch->timestamp_max.tv_usec);
+        snprintf(buf2, SRVBUFLEN, "%u.%u", cc->stitch->timestamp_max.tv_sec, cc->stitch->timestamp_max.tv_usec);
 	    fprintf(f, "%s%s", write_sep(sep, &count), buf2);
-          }
+      }
 	  else {
-            time1 = queue[j]->stitch->timestamp_min.tv_sec;
-            time2 = localtime(&time1);
-            strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, queue[j]->stitch->timestamp_min.tv_usec);
-            fprintf(f, "%s%s", write_sep(sep, &count), buf2);
-
-            time1 = queue[j]->stitch->timestamp_max.tv_sec;
-            time2 = localtime(&time1);
-            strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, queue[j]->stitch->timestamp_max.tv_usec);
-            fprintf(f, "%s%s", write_sep(sep, &count), buf2);
+        time1 = cc->stitch->timestamp_min.tv_sec;
+        time2 = localtime_r(&time1, &tm_buf);
+        strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
+        snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, cc->stitch->timestamp_min.tv_usec);
+        fprintf(f, "%s%s", write_sep(sep, &count), buf2);
+
+        time1 = cc->stitch->timestamp_max.tv_sec;
+        time2 = localtime_r(&time1, &tm_buf);
+        strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
+        snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, cc->stitch->timestamp_max.tv_usec);
+        fprintf(f, "%s%s", write_sep(sep, &count), buf2);
 	  }
-        }
+    }
 
-        if (config.what_to_count_2 & COUNT_EXPORT_PROTO_SEQNO) fprintf(f, "%s%u", write_sep(sep, &count), data->export_proto_seqno);
-        if (config.what_to_count_2 & COUNT_EXPORT_PROTO_VERSION) fprintf(f, "%s%u", write_sep(sep, &count), data->export_proto_version);
+    if (config.what_to_count_2 & COUNT_EXPORT_PROTO_SEQNO) fprintf(f, "%s%u", write_sep(sep, &count), data->export_proto_seqno);
+    if (config.what_to_count_2 & COUNT_EXPORT_PROTO_VERSION) fprintf(f, "%s%u", write_sep(sep, &count), data->export_proto_version);
   
-        /* all custom primitives printed here */
-        {
-          int cp_idx;
+    /* all custom primitives printed here */
+    {
+      int cp_idx;
   
-          for (cp_idx = 0; cp_idx < config.cpptrs.num; cp_idx++) {
-            if (config.cpptrs.primitive[cp_idx].ptr->len != PM_VARIABLE_LENGTH) {
-              char cp_str[SRVBUFLEN];
+      for (cp_idx = 0; cp_idx < config.cpptrs.num; cp_idx++) {
+        if (config.cpptrs.primitive[cp_idx].ptr->len != PM_VARIABLE_LENGTH) {
+          char cp_str[SRVBUFLEN];
 
 	      custom_primitive_value_print(cp_str, SRVBUFLEN, pcust, &config.cpptrs.primitive[cp_idx], FALSE);
-              fprintf(f, "%s%s", write_sep(sep, &count), cp_str);
+          fprintf(f, "%s%s", write_sep(sep, &count), cp_str);
 	    }
 	    else {
 	      char *label_ptr = NULL;
@@ -1308,120 +1480,27 @@ void P_cache_purge(struct chained_cache *queue[], int index, int safe_action)
 	      if (!label_ptr) label_ptr = empty_string;
 	      fprintf(f, "%s%s", write_sep(sep, &count), label_ptr);
 	    }
-          }
-        }
+      }
+    }
   
-        if (!is_event) {
+    if (!is_event) {
   #if defined HAVE_64BIT_COUNTERS
-          fprintf(f, "%s%llu", write_sep(sep, &count), queue[j]->packet_counter);
-          if (config.what_to_count & COUNT_FLOWS) fprintf(f, "%s%llu", write_sep(sep, &count), queue[j]->flow_counter);
-          fprintf(f, "%s%llu\n", write_sep(sep, &count), queue[j]->bytes_counter);
+      fprintf(f, "%s%llu", write_sep(sep, &count), cc->packet_counter);
+      if (config.what_to_count & COUNT_FLOWS) fprintf(f, "%s%llu", write_sep(sep, &count), cc->flow_counter);
+      fprintf(f, "%s%llu\n", write_sep(sep, &count), cc->bytes_counter);
   #else
-          fprintf(f, "%s%lu", write_sep(sep, &count), queue[j]->packet_counter);
-          if (config.what_to_count & COUNT_FLOWS) fprintf(f, "%s%lu", write_sep(sep, &count), queue[j]->flow_counter);
-          fprintf(f, "%s%lu\n", write_sep(sep, &count), queue[j]->bytes_counter);
+      fprintf(f, "%s%lu", write_sep(sep, &count), cc->packet_counter);
+      if (config.what_to_count & COUNT_FLOWS) fprintf(f, "%s%lu", write_sep(sep, &count), cc->flow_counter);
+      fprintf(f, "%s%lu\n", write_sep(sep, &count), cc->bytes_counter);
   #endif
-        }
-        else fprintf(f, "\n");
-      }
-      else if (f && config.print_output & PRINT_OUTPUT_JSON) {
-#ifdef WITH_JANSSON
-	json_t *json_obj = json_object();
-	int idx;
-
-	for (idx = 0; idx < N_PRIMITIVES && cjhandler[idx]; idx++) cjhandler[idx](json_obj, queue[j]);
-        if (json_obj) write_and_free_json(f, json_obj);
-#endif
-      }
-      else if (f && config.print_output & PRINT_OUTPUT_AVRO) {
-#ifdef WITH_AVRO
-        avro_value_iface_t *avro_iface = avro_generic_class_from_schema(avro_acct_schema);
-
-        avro_value_t avro_value = compose_avro(config.what_to_count, config.what_to_count_2, queue[j]->flow_type,
-                         &queue[j]->primitives, pbgp, pnat, pmpls, ptun, pcust, pvlen, queue[j]->bytes_counter,
-                         queue[j]->packet_counter, queue[j]->flow_counter, queue[j]->tcp_flags, NULL,
-                         queue[j]->stitch, avro_iface);
-
-        if (config.sql_table) {
-          if (avro_file_writer_append_value(avro_writer, &avro_value)) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): AVRO: failed writing the value: %s\n",
-                config.name, config.type, avro_strerror());
-            exit_plugin(1);
-          }
-        }
-        else {
-          char *json_str;
-
-          if (avro_value_to_json(&avro_value, TRUE, &json_str)) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): AVRO: unable to value to JSON: %s\n",
-                config.name, config.type, avro_strerror());
-            exit_plugin(1);
-          }
-
-          fprintf(f, "%s\n", json_str);
-          free(json_str);
-        }
-
-        avro_value_iface_decref(avro_iface);
-        avro_value_decref(&avro_value);
-#else
-        if (config.debug) Log(LOG_DEBUG, "DEBUG ( %s/%s ): compose_avro(): AVRO object not created due to missing --enable-avro\n", config.name, config.type);
-#endif
-      }
     }
+    else fprintf(f, "\n");
   }
-
-  duration = time(NULL)-start;
-
-  if (f && config.print_markers) {
-    if ((config.print_output & PRINT_OUTPUT_CSV) || (config.print_output & PRINT_OUTPUT_FORMATTED))
-      fprintf(f, "--END (%u)--\n", writer_pid);
-    else if (config.print_output & PRINT_OUTPUT_JSON) {
-      void *json_obj;
-
-      json_obj = compose_purge_close_json(config.name, writer_pid, qn, saved_index, duration);
-      if (json_obj) write_and_free_json(f, json_obj);
-    }
-  }
-    
-  if (config.sql_table) {
-#ifdef WITH_AVRO
-    if (config.print_output & PRINT_OUTPUT_AVRO)
-      avro_file_writer_flush(avro_writer);
-#endif
-
-    if (config.print_latest_file) {
-      if (!safe_action) {
-        memset(tmpbuf, 0, LONGLONGSRVBUFLEN);
-        handle_dynname_internal_strings(tmpbuf, LONGSRVBUFLEN, config.print_latest_file, &prim_ptrs);
-        link_latest_output_file(tmpbuf, current_table);
-      }
-    }
-
-#ifdef WITH_AVRO
-    if (config.print_output & PRINT_OUTPUT_AVRO) {
-      avro_file_writer_close(avro_writer);
-    }
+  else if (f && config.print_output & PRINT_OUTPUT_JSON) {
+#ifdef WITH_JANSSON
+    fprintf(f, "%s\n", compose_json_record(cc, NULL, 0));
 #endif
-    else {
-      if (f) close_output_file(f);
-    }
-  }
-  else {
-    /* writing to stdout: releasing lock */
-    fflush(f);
-    close_output_file(lockf);
   }
-
-  /* If we have pending queries then start again */
-  if (pqq_ptr) goto start;
-
-  Log(LOG_INFO, "INFO ( %s/%s ): *** Purging cache - END (PID: %u, QN: %u/%u, ET: %u) ***\n",
-		config.name, config.type, writer_pid, qn, saved_index, duration);
-
-  if (config.sql_trigger_exec) P_trigger_exec(config.sql_trigger_exec); 
-
-  if (empty_pcust) free(empty_pcust);
 }
 
 void P_write_stats_header_formatted(FILE *f, int is_event)
@@ -22,6 +22,17 @@
 /* includes */
 #include <sys/poll.h>
 
+/* defines */
+#define PRINT_SEGMENT_ENTRIES	4096
+
+/* structures */
+struct p_print_segment {
+  char *buf;
+  size_t len;
+  char *empty_pcust;
+  int is_event;
+};
+
 /* prototypes */
 #if (!defined __PRINT_PLUGIN_C)
 #define EXT extern
@@ -30,6 +41,7 @@
 #endif
 EXT void print_plugin(int, struct configuration *, void *);
 EXT void P_cache_purge(struct chained_cache *[], int, int);
+EXT void P_write_cache_entry(FILE *, struct chained_cache *, char *, int);
 EXT void P_write_stats_header_formatted(FILE *, int);
 EXT void P_write_stats_header_csv(FILE *, int);
 EXT void P_fprintf_csv_string(FILE *, struct pkt_vlen_hdr_primitives *, pm_cfgreg_t, char *, char *);
@@ -70,9 +70,8 @@ void process_query_data(int sd, unsigned char *buf, int len, struct extra_primit
   struct query_header *q, *uq;
   struct query_entry request;
   struct reply_buffer rb;
-  unsigned char *elem, *bufptr;
-  int following_chain=0;
-  unsigned int idx;
+  unsigned char *bufptr;
+  u_int32_t idx;
   struct pkt_data dummy;
   struct pkt_bgp_primitives dummy_pbgp;
   struct pkt_legacy_bgp_primitives dummy_plbgp;
@@ -160,15 +159,15 @@ void process_query_data(int sd, unsigned char *buf, int len, struct extra_primit
     else return;
   }
 
-  elem = (unsigned char *) a;
+  /* walks below expect a single, fully migrated, index table */
+  imt_index_complete();
 
   reset_counter = q->type & WANT_RESET;
 
   if (q->type & WANT_STATS) {
     q->what_to_count = config.what_to_count; 
     q->what_to_count_2 = config.what_to_count_2; 
-    for (idx = 0; idx < config.buckets; idx++) {
-      if (!following_chain) acc_elem = (struct acc *) elem;
+    for (idx = 0; (acc_elem = imt_index_walk(&idx)); ) {
       if (!test_zero_elem(acc_elem)) {
 	enQueue_elem(sd, &rb, acc_elem, PdataSz, datasize);
 
@@ -205,38 +204,29 @@ void process_query_data(int sd, unsigned char *buf, int len, struct extra_primit
           enQueue_elem(sd, &rb, acc_elem->pvlen, PvhdrSz + acc_elem->pvlen->tot_len, datasize - extras->off_pkt_vlen_hdr_primitives);
         }
       } 
-      if (acc_elem->next != NULL) {
-        Log(LOG_DEBUG, "DEBUG ( %s/%s ): Following chain in reply ...\n", config.name, config.type);
-        acc_elem = acc_elem->next;
-        following_chain = TRUE;
-        idx--;
-      }
-      else {
-        elem += sizeof(struct acc);
-        following_chain = FALSE;
-      }
     }
     if (rb.packed) send(sd, rb.buf, rb.packed, 0); /* send remainder data */
   }
   else if (q->type & WANT_STATUS) {
-    for (idx = 0; idx < config.buckets; idx++) {
-
-      /* Administrativia */
-      following_chain = FALSE;
-      bd.num = 0;
-      bd.howmany = 0;
-      acc_elem = (struct acc *) elem;
-
-      do {
-        if (following_chain) acc_elem = acc_elem->next;
-        if (!test_zero_elem(acc_elem)) bd.howmany++;
-        bd.num = idx; /* we need to avoid this redundancy */
-        following_chain = TRUE;
-      } while (acc_elem->next != NULL);
-
-      enQueue_elem(sd, &rb, &bd, sizeof(struct bucket_desc), sizeof(struct bucket_desc));
-      elem += sizeof(struct acc);
+    unsigned short int *howmany;
+
+    /* a bucket is an index slot; it accounts for the elements which
+       hash to it, no matter how far the probing did put them */
+    howmany = calloc(imt_idx.cur.size, sizeof(unsigned short int));
+    if (howmany) {
+      for (idx = 0; (acc_elem = imt_index_walk(&idx)); ) {
+        if (!test_zero_elem(acc_elem)) howmany[acc_elem->signature & imt_idx.cur.mask]++;
+      }
+
+      for (idx = 0; idx < imt_idx.cur.size; idx++) {
+        bd.num = idx;
+        bd.howmany = howmany[idx];
+        enQueue_elem(sd, &rb, &bd, sizeof(struct bucket_desc), sizeof(struct bucket_desc));
+      }
+
+      free(howmany);
     }
+    else Log(LOG_ERR, "ERROR ( %s/%s ): Unable to malloc() bucket descriptors.\n", config.name, config.type);
     if (rb.packed) send(sd, rb.buf, rb.packed, 0);
   }
   else if (q->type & WANT_MATCH || q->type & WANT_COUNTER) {
@@ -368,12 +358,9 @@ void process_query_data(int sd, unsigned char *buf, int len, struct extra_primit
 	struct pkt_mpls_primitives mbuf;
 	struct pkt_tunnel_primitives ubuf;
 	struct pkt_data abuf;
-        following_chain = FALSE;
-	elem = (unsigned char *) a;
 	memset(&abuf, 0, sizeof(abuf));
 
-        for (idx = 0; idx < config.buckets; idx++) {
-          if (!following_chain) acc_elem = (struct acc *) elem;
+        for (idx = 0; (acc_elem = imt_index_walk(&idx)); ) {
 	  if (!test_zero_elem(acc_elem)) {
 	    /* XXX: support for custom and vlen primitives */
 	    mask_elem(&tbuf, &bbuf, &lbbuf, &nbuf, &mbuf, &ubuf, acc_elem, request.what_to_count, request.what_to_count_2, extras); 
@@ -419,15 +406,6 @@ void process_query_data(int sd, unsigned char *buf, int len, struct extra_primit
 	      if (reset_counter) set_reset_flag(acc_elem);
 	    }
           }
-          if (acc_elem->next) {
-            acc_elem = acc_elem->next;
-            following_chain = TRUE;
-            idx--;
-          }
-          else {
-            elem += sizeof(struct acc);
-            following_chain = FALSE;
-          }
         }
 	if (q->type & WANT_COUNTER) enQueue_elem(sd, &rb, &abuf, PdataSz, PdataSz); /* enqueue accumulated data */
       }
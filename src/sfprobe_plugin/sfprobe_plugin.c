@@ -679,7 +679,7 @@ poll_again:
 
     if (config.pipe_homegrown || config.pipe_amqp) {
       timeout = MIN(refresh_timeout, (amqp_timeout ? amqp_timeout : INT_MAX));
-      ret = poll(&pfd, (pfd.fd == ERR ? 0 : 1), timeout);
+      ret = plugin_pipe_poll(&pfd, status, timeout);
     }
 #ifdef WITH_KAFKA
     else if (config.pipe_kafka) {
@@ -751,6 +751,7 @@ read_data:
   
         pollagain = FALSE;
         memcpy(pipebuf, rg->ptr, bufsz);
+        plugin_pipe_ring_release(status);
         rg->ptr += bufsz;
       }
 #ifdef WITH_RABBITMQ
@@ -27,6 +27,7 @@
 #include "pmacct-data.h"
 #include "plugin_hooks.h"
 #include "bgp/bgp.h"
+#include "tpacket.h"
 
 /* extern */
 extern struct plugins_list_entry *plugin_list;
@@ -59,6 +60,9 @@ void handle_falling_child()
      delete nodes (plugins) from it */ 
   for (j = 0; j < MAX_N_PLUGINS; j++) {
     if (failed_plugins[j]) { 
+      if (core_workers_reap(failed_plugins[j]))
+	Log(LOG_WARNING, "WARN ( %s/%s ): Core Process worker (pid %u) exited.\n", config.name, config.type, failed_plugins[j]);
+
       list = search_plugin_by_pid(failed_plugins[j]);
       if (list) {
         Log(LOG_WARNING, "WARN ( %s/%s ): connection lost to '%s-%s'; closing connection.\n",
@@ -78,6 +82,9 @@ void handle_falling_child()
   } 
 
   j = waitpid(-1, 0, WNOHANG);
+  if (core_workers_reap(j))
+    Log(LOG_WARNING, "WARN ( %s/%s ): Core Process worker (pid %u) exited.\n", config.name, config.type, j);
+
   list = search_plugin_by_pid(j);
   if (list) {
     Log(LOG_WARNING, "WARN ( %s/%s ): connection lost to '%s-%s'; closing connection.\n",
@@ -101,6 +108,7 @@ void ignore_falling_child()
   int status;
 
   while ((cpid = waitpid(-1, &status, WNOHANG)) > 0) {
+    core_workers_reap(cpid);
     if (!WIFEXITED(status)) Log(LOG_WARNING, "WARN ( %s/%s ): Abnormal exit status detected for child PID %u\n", config.name, config.type, cpid);
     // sql_writers.retired++;
   }
@@ -127,7 +135,11 @@ void my_sigint_handler(int signum)
   /* We are about to exit, but it may take a while - because of the
      wait() call. Let's release collector's socket to improve turn-
      around times when restarting the daemon */
-  if (config.acct_type == ACCT_NF || config.acct_type == ACCT_SF) close(config.sock);
+  if (config.acct_type == ACCT_NF || config.acct_type == ACCT_SF) {
+    close(config.sock);
+    core_workers_signal(SIGINT);
+  }
+  else if (config.acct_type == ACCT_PM) core_workers_signal(SIGINT);
 
 #if defined (IRIX) || (SOLARIS)
   signal(SIGCHLD, SIG_IGN);
@@ -152,6 +164,10 @@ void my_sigint_handler(int signum)
   Log(LOG_INFO, "INFO ( %s/%s ): OK, Exiting ...\n", config.name, config.type);
 
   if (config.acct_type == ACCT_PM && !config.uacctd_group /* XXX */) {
+#if defined HAVE_TPACKET_V3
+    if (glob_tpacket) tpacket_v3_log_stats(glob_tpacket, time(NULL));
+    else
+#endif
     if (config.dev) {
       if (pcap_stats(glob_pcapt, &ps) < 0) printf("\npcap_stats: %s\n", pcap_geterr(glob_pcapt));
       printf("\n");
@@ -189,6 +205,8 @@ void reload()
   if (config.sfacctd_counter_file) reload_log_sf_cnt = TRUE;
   if (config.telemetry_msglog_file) reload_log_telemetry_thread = TRUE;
 
+  core_workers_signal(SIGHUP);
+
   signal(SIGHUP, reload);
 }
 
@@ -197,6 +215,10 @@ void push_stats()
   time_t now = time(NULL);
 
   if (config.acct_type == ACCT_PM) {
+#if defined HAVE_TPACKET_V3
+    if (glob_tpacket) tpacket_v3_log_stats(glob_tpacket, now);
+    else
+#endif
     if (config.dev) {
       if (pcap_stats(glob_pcapt, &ps) < 0) Log(LOG_INFO, "INFO ( %s/%s ): pcap_stats: %s\n",
 						config.name, config.type, pcap_geterr(glob_pcapt));
@@ -209,6 +231,8 @@ void push_stats()
   else if (config.acct_type == ACCT_NF || config.acct_type == ACCT_SF)
     print_status_table(now, XFLOW_STATUS_TABLE_SZ);
 
+  core_workers_signal(SIGUSR1);
+
   signal(SIGUSR1, push_stats);
 }
 
@@ -225,6 +249,8 @@ void reload_maps()
     reload_map_exec_plugins = TRUE;
     reload_geoipv2_file = TRUE;
   }
+
+  core_workers_signal(SIGUSR2);
   
   signal(SIGUSR2, reload_maps);
 }
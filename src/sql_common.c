@@ -176,6 +176,7 @@ void sql_init_default_values(struct extra_primitives *extras)
   pt_size = sizeof(struct pkt_tunnel_primitives);
   pc_size = config.cpptrs.len;
   dbc_size = sizeof(struct db_cache);
+  primitives_key_init(config.what_to_count, config.what_to_count_2);
 
   /* handling purge preprocessor */
   set_preprocess_funcs(config.sql_preprocess, &prep, PREP_DICT_SQL);
@@ -297,7 +298,7 @@ void sql_cache_modulo(struct primitives_ptrs *prim_ptrs, struct insert_data *ida
   char *pcust = prim_ptrs->pcust;
   struct pkt_vlen_hdr_primitives *pvlen = prim_ptrs->pvlen;
 
-  idata->hash = cache_crc32((unsigned char *)srcdst, pp_size);
+  idata->hash = primitives_key_hash(srcdst, 0);
   if (pbgp) idata->hash ^= cache_crc32((unsigned char *)pbgp, pb_size);
   if (pnat) idata->hash ^= cache_crc32((unsigned char *)pnat, pn_size);
   if (pmpls) idata->hash ^= cache_crc32((unsigned char *)pmpls, pm_size);
@@ -531,7 +532,7 @@ struct db_cache *sql_cache_search(struct primitives_ptrs *prim_ptrs, time_t base
   else {
     if (Cursor->valid == SQL_CACHE_INUSE) {
       /* checks: pkt_primitives and pkt_bgp_primitives */
-      res_data = memcmp(&Cursor->primitives, data, sizeof(struct pkt_primitives));
+      res_data = primitives_key_cmp(&Cursor->primitives, data);
 
       if (pbgp && Cursor->pbgp) {
         res_bgp = memcmp(Cursor->pbgp, pbgp, sizeof(struct pkt_bgp_primitives));
@@ -715,7 +716,7 @@ void sql_cache_insert(struct primitives_ptrs *prim_ptrs, struct insert_data *ida
       int res_cust = TRUE, res_vlen = TRUE;
 
       /* checks: pkt_primitives and pkt_bgp_primitives */
-      res_data = memcmp(&Cursor->primitives, srcdst, sizeof(struct pkt_primitives));
+      res_data = primitives_key_cmp(&Cursor->primitives, srcdst);
 
       if (pbgp && Cursor->pbgp) {
         res_bgp = memcmp(Cursor->pbgp, pbgp, sizeof(struct pkt_bgp_primitives));
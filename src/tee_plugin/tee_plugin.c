@@ -46,7 +46,7 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
   unsigned char *rgptr;
   int pollagain = TRUE;
   u_int32_t seq = 1, rg_err_count = 0;
-  time_t now;
+  time_t now, stats_time;
   void *kafka_msg;
 
 #ifdef WITH_RABBITMQ
@@ -113,12 +113,12 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
   if (!config.tee_max_receivers) config.tee_max_receivers = MAX_TEE_RECEIVERS;
 
   for (pool_idx = 0; pool_idx < config.tee_max_receiver_pools; pool_idx++) { 
-    receivers.pools[pool_idx].receivers = malloc(config.tee_max_receivers*sizeof(struct tee_receivers));
+    receivers.pools[pool_idx].receivers = malloc(config.tee_max_receivers*sizeof(struct tee_receiver));
     if (!receivers.pools[pool_idx].receivers) {
       Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate receivers for pool #%u. Exiting ...\n", config.name, config.type, pool_idx);
       exit_plugin(1);
     }
-    else memset(receivers.pools[pool_idx].receivers, 0, config.tee_max_receivers*sizeof(struct tee_receivers));
+    else memset(receivers.pools[pool_idx].receivers, 0, config.tee_max_receivers*sizeof(struct tee_receiver));
   }
 
   if (config.nfprobe_receiver) {
@@ -164,6 +164,7 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
   else setnonblocking(pipe_fd);
 
   now = time(NULL);
+  stats_time = now;
 
   memset(pipebuf, 0, config.buffer_size);
   err_cant_bridge_af = 0;
@@ -181,7 +182,7 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
     if (config.pipe_homegrown || config.pipe_amqp) {
       timeout = MIN(refresh_timeout, (amqp_timeout ? amqp_timeout : INT_MAX));
-      ret = poll(&pfd, (pfd.fd == ERR ? 0 : 1), timeout);
+      ret = plugin_pipe_poll(&pfd, status, timeout);
     }
 #ifdef WITH_KAFKA
     else if (config.pipe_kafka) {
@@ -207,6 +208,11 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
     now = time(NULL);
 
+    if (config.tee_batch_size > 1 && now >= (stats_time + config.sql_refresh_time)) {
+      Tee_log_stats();
+      stats_time = now;
+    }
+
 #ifdef WITH_RABBITMQ
     if (config.pipe_amqp && pipe_fd == ERR) {
       if (timeout == amqp_timeout) {
@@ -229,7 +235,7 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
     switch (ret) {
     case 0: /* timeout */
-      /* reserved for future since we don't currently cache/batch/etc */
+      /* nothing to do: send batches never outlive the buffer they point into */
       break;
     default: /* we received data */
       read_data:
@@ -267,6 +273,7 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
   
         pollagain = FALSE;
         memcpy(pipebuf, rg->ptr, bufsz);
+        plugin_pipe_ring_release(status);
         rg->ptr += bufsz;
       }
 #ifdef WITH_RABBITMQ
@@ -303,12 +310,12 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 	    if (!receivers.pools[pool_idx].balance.func) {
 	      for (recv_idx = 0; recv_idx < receivers.pools[pool_idx].num; recv_idx++) {
 	        target = &receivers.pools[pool_idx].receivers[recv_idx];
-	        Tee_send(msg, (struct sockaddr *) &target->dest, target->fd);
+	        Tee_send(msg, target);
 	      }
 	    }
 	    else {
 	      target = receivers.pools[pool_idx].balance.func(&receivers.pools[pool_idx], msg);
-	      Tee_send(msg, (struct sockaddr *) &target->dest, target->fd);
+	      if (target) Tee_send(msg, target);
 	    }
 	  }
 	}
@@ -321,6 +328,9 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 	  msg->payload = (dataptr + PmsgSz);
 	}
       }
+
+      /* queued datagrams point into pipebuf: flush before it gets reused */
+      Tee_flush_all();
       }
 
       if (config.pipe_homegrown) goto read_data;
@@ -334,8 +344,11 @@ void Tee_exit_now(int signum)
   exit_plugin(0);
 }
 
-void Tee_send(struct pkt_msg *msg, struct sockaddr *target, int fd)
+void Tee_send(struct pkt_msg *msg, struct tee_receiver *target)
 {
+  struct tee_batch *b = &target->batch;
+  struct msghdr *mh;
+  struct iovec *iov;
   struct host_addr r;
   u_char recv_addr[50];
   u_int16_t recv_port;
@@ -349,7 +362,7 @@ void Tee_send(struct pkt_msg *msg, struct sockaddr *target, int fd)
     sa_to_addr((struct sockaddr *)msg, &a, &agent_port);
     addr_to_str(agent_addr, &a);
 
-    sa_to_addr((struct sockaddr *)target, &r, &recv_port);
+    sa_to_addr((struct sockaddr *)&target->dest, &r, &recv_port);
     addr_to_str(recv_addr, &r);
 
     if (config.acct_type == ACCT_NF) flow = netflow;
@@ -360,117 +373,247 @@ void Tee_send(struct pkt_msg *msg, struct sockaddr *target, int fd)
 			recv_addr, recv_port);
   }
 
+  if (config.tee_transparent && msg->agent.sa_family != ((struct sockaddr *)&target->dest)->sa_family) {
+    time_t now = time(NULL);
+
+    if (now > err_cant_bridge_af + 60) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): Can't bridge Address Families when in transparent mode\n", config.name, config.type);
+      err_cant_bridge_af = now;
+    }
+
+    return;
+  }
+
+  mh = TEE_BATCH_MSGHDR(b, b->num);
+  iov = &b->iov[b->num * 2];
+
+  iov[1].iov_base = msg->payload;
+  iov[1].iov_len = msg->len;
+
   if (!config.tee_transparent) {
-    if (send(fd, msg->payload, msg->len, 0) == -1) {
-      struct host_addr a;
-      u_char agent_addr[50];
-      u_int16_t agent_port;
+    mh->msg_iov = &iov[1];
+    mh->msg_iovlen = 1;
+  }
+  else {
+    iov[0].iov_base = b->hdrs + (b->num * TEE_HDR_TPL_LEN);
+    iov[0].iov_len = Tee_patch_hdr_tpl(target, msg, iov[0].iov_base);
+    mh->msg_iov = iov;
+    mh->msg_iovlen = 2;
+  }
+
+  b->pmsgs[b->num] = msg;
+  b->num++;
+
+  if (b->num == b->max) Tee_flush(target);
+}
+
+void Tee_flush(struct tee_receiver *target)
+{
+  struct tee_batch *b = &target->batch;
+  int idx = 0, ret;
+
+  while (idx < b->num) {
+#if defined HAVE_SENDMMSG
+    ret = sendmmsg(target->fd, &b->msgs[idx], b->num - idx, 0);
+#else
+    ret = sendmsg(target->fd, &b->msgs[idx], 0);
+    if (ret != -1) ret = 1;
+#endif
+
+    if (ret > 0) {
+      b->batches++;
+      b->datagrams += ret;
+      idx += ret;
+    }
+    else if (ret == -1 && errno == EINTR) continue;
+    else {
+      struct pkt_msg *msg = b->pmsgs[idx];
+      struct host_addr a, r;
+      u_char agent_addr[50], recv_addr[50];
+      u_int16_t agent_port, recv_port;
 
       sa_to_addr((struct sockaddr *)msg, &a, &agent_port);
       addr_to_str(agent_addr, &a);
 
-      sa_to_addr((struct sockaddr *)target, &r, &recv_port);
+      sa_to_addr((struct sockaddr *)&target->dest, &r, &recv_port);
       addr_to_str(recv_addr, &r);
 
-      Log(LOG_ERR, "ERROR ( %s/%s ): send() from [%s:%u] seqno [%u] to [%s:%u] failed (%s)\n",
-			config.name, config.type, agent_addr, agent_port, msg->seqno, recv_addr,
-			recv_port, strerror(errno));
+      Log(LOG_ERR, "ERROR ( %s/%s ): %ssend() from [%s:%u] seqno [%u] to [%s:%u] failed (%s)\n",
+			config.name, config.type, (config.tee_transparent ? "raw " : ""), agent_addr,
+			agent_port, msg->seqno, recv_addr, recv_port, strerror(errno));
+
+      /* skip the offending datagram and carry on with the rest of the batch */
+      b->drops++;
+      idx++;
     }
   }
-  else {
-    char *buf_ptr = tee_send_buf;
-    struct sockaddr_in *sa = (struct sockaddr_in *) &msg->agent;
-    struct my_iphdr *i4h = (struct my_iphdr *) buf_ptr;
+
+  b->num = 0;
+}
+
+void Tee_flush_all()
+{
+  int pool_idx, recv_idx;
+
+  for (pool_idx = 0; pool_idx < receivers.num; pool_idx++) {
+    for (recv_idx = 0; recv_idx < receivers.pools[pool_idx].num; recv_idx++) {
+      if (receivers.pools[pool_idx].receivers[recv_idx].batch.num)
+	Tee_flush(&receivers.pools[pool_idx].receivers[recv_idx]);
+    }
+  }
+}
+
+void Tee_init_batch(struct tee_receiver *target)
+{
+  struct tee_batch *b = &target->batch;
+  int max = (config.tee_batch_size ? config.tee_batch_size : 1);
+
+  memset(b, 0, sizeof(struct tee_batch));
+
+  b->msgs = malloc(max * sizeof(*b->msgs));
+  b->iov = malloc(max * 2 * sizeof(struct iovec));
+  b->pmsgs = malloc(max * sizeof(struct pkt_msg *));
+  if (config.tee_transparent) b->hdrs = malloc(max * TEE_HDR_TPL_LEN);
+
+  if (!b->msgs || !b->iov || !b->pmsgs || (config.tee_transparent && !b->hdrs)) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate send batch (tee_batch_size=%u). Exiting ...\n", config.name, config.type, max);
+    exit_plugin(1);
+  }
+
+  memset(b->msgs, 0, max * sizeof(*b->msgs));
+  b->max = max;
+}
+
+/* Tee_init_hdr_tpl(): pre-computes the IP/UDP headers towards the receiver;
+   source address, source port and lengths are filled in per datagram */
+void Tee_init_hdr_tpl(struct tee_receiver *target)
+{
+  struct sockaddr *dest = (struct sockaddr *) &target->dest;
+  struct my_iphdr *i4h = (struct my_iphdr *) target->tpl.buf;
 #if defined ENABLE_IPV6
-    struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *) &msg->agent;
-    struct ip6_hdr *i6h = (struct ip6_hdr *) buf_ptr;
+  struct ip6_hdr *i6h = (struct ip6_hdr *) target->tpl.buf;
 #endif
-    struct my_udphdr *uh;
-
-    if (msg->agent.sa_family == target->sa_family) {
-      /* UDP header first */
-      if (target->sa_family == AF_INET) {
-        buf_ptr += IP4HdrSz;
-        uh = (struct my_udphdr *) buf_ptr;
-        uh->uh_sport = sa->sin_port;
-        uh->uh_dport = ((struct sockaddr_in *)target)->sin_port;
-      }
+  struct my_udphdr *uh;
+
+  memset(&target->tpl, 0, sizeof(struct tee_hdr_tpl));
+
+  if (dest->sa_family == AF_INET) {
+    i4h->ip_vhl = 4;
+    i4h->ip_vhl <<= 4;
+    i4h->ip_vhl |= (IP4HdrSz/4);
+
+    if (config.nfprobe_ipprec) {
+      int opt = config.nfprobe_ipprec << 5;
+      i4h->ip_tos = opt;
+    }
+    else i4h->ip_tos = 0;
+
+    i4h->ip_id = 0;
+    i4h->ip_off = 0;
+    i4h->ip_ttl = 255;
+    i4h->ip_p = IPPROTO_UDP;
+    i4h->ip_sum = 0;
+    i4h->ip_dst.s_addr = ((struct sockaddr_in *)dest)->sin_addr.s_addr;
+
+    uh = (struct my_udphdr *) (target->tpl.buf + IP4HdrSz);
+    uh->uh_dport = ((struct sockaddr_in *)dest)->sin_port;
+    target->tpl.len = IP4HdrSz+UDPHdrSz;
+  }
 #if defined ENABLE_IPV6
-      else if (target->sa_family == AF_INET6) {
-        buf_ptr += IP6HdrSz;
-        uh = (struct my_udphdr *) buf_ptr;
-        uh->uh_sport = sa6->sin6_port;
-        uh->uh_dport = ((struct sockaddr_in6 *)target)->sin6_port;
-      }
+  else if (dest->sa_family == AF_INET6) {
+    i6h->ip6_vfc = 6;
+    i6h->ip6_vfc <<= 4;
+    i6h->ip6_nxt = IPPROTO_UDP;
+    i6h->ip6_hlim = 255;
+    memcpy(&i6h->ip6_dst, &((struct sockaddr_in6 *)dest)->sin6_addr, IP6AddrSz);
+
+    uh = (struct my_udphdr *) (target->tpl.buf + IP6HdrSz);
+    uh->uh_dport = ((struct sockaddr_in6 *)dest)->sin6_port;
+    target->tpl.len = IP6HdrSz+UDPHdrSz;
+  }
 #endif
+  else return;
 
-      uh->uh_ulen = htons(msg->len+UDPHdrSz);
-      uh->uh_sum = 0;
+  uh->uh_sum = 0;
+}
 
-      /* IP header then */
-      if (target->sa_family == AF_INET) {
-        i4h->ip_vhl = 4;
-        i4h->ip_vhl <<= 4;
-        i4h->ip_vhl |= (IP4HdrSz/4);
+/* Tee_patch_hdr_tpl(): copies the receiver header template in 'hdr' and
+   completes it for the given datagram; the template keeps the source of
+   the last agent seen so that it is rewritten only when the agent changes.
+   Returns the length of the headers */
+int Tee_patch_hdr_tpl(struct tee_receiver *target, struct pkt_msg *msg, char *hdr)
+{
+  struct my_iphdr *i4h;
+#if defined ENABLE_IPV6
+  struct ip6_hdr *i6h;
+#endif
+  struct my_udphdr *uh;
 
-	if (config.nfprobe_ipprec) {
-	  int opt = config.nfprobe_ipprec << 5;
-          i4h->ip_tos = opt;
-	}
-	else i4h->ip_tos = 0;
+  if (msg->agent.sa_family == AF_INET) {
+    struct sockaddr_in *sa = (struct sockaddr_in *) &msg->agent;
+
+    i4h = (struct my_iphdr *) target->tpl.buf;
+    uh = (struct my_udphdr *) (target->tpl.buf + IP4HdrSz);
+    if (i4h->ip_src.s_addr != sa->sin_addr.s_addr || uh->uh_sport != sa->sin_port) {
+      i4h->ip_src.s_addr = sa->sin_addr.s_addr;
+      uh->uh_sport = sa->sin_port;
+    }
 
+    memcpy(hdr, target->tpl.buf, target->tpl.len);
+
+    i4h = (struct my_iphdr *) hdr;
+    uh = (struct my_udphdr *) (hdr + IP4HdrSz);
 #if !defined BSD
-        i4h->ip_len = htons(IP4HdrSz+UDPHdrSz+msg->len);
+    i4h->ip_len = htons(IP4HdrSz+UDPHdrSz+msg->len);
 #else
-        i4h->ip_len = IP4HdrSz+UDPHdrSz+msg->len;
+    i4h->ip_len = IP4HdrSz+UDPHdrSz+msg->len;
 #endif
-        i4h->ip_id = 0;
-        i4h->ip_off = 0;
-        i4h->ip_ttl = 255;
-        i4h->ip_p = IPPROTO_UDP;
-        i4h->ip_sum = 0;
-        i4h->ip_src.s_addr = sa->sin_addr.s_addr;
-        i4h->ip_dst.s_addr = ((struct sockaddr_in *)target)->sin_addr.s_addr;
-      }
+  }
 #if defined ENABLE_IPV6
-      else if (target->sa_family == AF_INET6) {
-        i6h->ip6_vfc = 6;
-        i6h->ip6_vfc <<= 4;
-        i6h->ip6_plen = htons(UDPHdrSz+msg->len);
-        i6h->ip6_nxt = IPPROTO_UDP;
-        i6h->ip6_hlim = 255;
-        memcpy(&i6h->ip6_src, &sa6->sin6_addr, IP6AddrSz);
-        memcpy(&i6h->ip6_dst, &((struct sockaddr_in6 *)target)->sin6_addr, IP6AddrSz);
-      }
+  else if (msg->agent.sa_family == AF_INET6) {
+    struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *) &msg->agent;
+
+    i6h = (struct ip6_hdr *) target->tpl.buf;
+    uh = (struct my_udphdr *) (target->tpl.buf + IP6HdrSz);
+    if (uh->uh_sport != sa6->sin6_port || memcmp(&i6h->ip6_src, &sa6->sin6_addr, IP6AddrSz)) {
+      memcpy(&i6h->ip6_src, &sa6->sin6_addr, IP6AddrSz);
+      uh->uh_sport = sa6->sin6_port;
+    }
+
+    memcpy(hdr, target->tpl.buf, target->tpl.len);
+
+    i6h = (struct ip6_hdr *) hdr;
+    uh = (struct my_udphdr *) (hdr + IP6HdrSz);
+    i6h->ip6_plen = htons(UDPHdrSz+msg->len);
+  }
 #endif
+  else return 0;
 
-      /* Put everything together and send */
-      buf_ptr += UDPHdrSz;
-      memcpy(buf_ptr, msg->payload, msg->len);
+  uh->uh_ulen = htons(msg->len+UDPHdrSz);
 
-      if (send(fd, tee_send_buf, IP4HdrSz+UDPHdrSz+msg->len, 0) == -1) {
-        struct host_addr a;
-        u_char agent_addr[50];
-        u_int16_t agent_port;
+  return target->tpl.len;
+}
 
-        sa_to_addr((struct sockaddr *)msg, &a, &agent_port);
-        addr_to_str(agent_addr, &a);
+void Tee_log_stats()
+{
+  struct tee_receiver *target;
+  struct host_addr r;
+  u_char recv_addr[50];
+  u_int16_t recv_port;
+  int pool_idx, recv_idx;
 
-	sa_to_addr((struct sockaddr *)target, &r, &recv_port);
-	addr_to_str(recv_addr, &r);
+  for (pool_idx = 0; pool_idx < receivers.num; pool_idx++) {
+    for (recv_idx = 0; recv_idx < receivers.pools[pool_idx].num; recv_idx++) {
+      target = &receivers.pools[pool_idx].receivers[recv_idx];
 
-        Log(LOG_ERR, "ERROR ( %s/%s ): raw send() from [%s:%u] seqno [%u] to [%s:%u] failed (%s)\n",
-			config.name, config.type, agent_addr, agent_port, msg->seqno, recv_addr,
-			recv_port, strerror(errno));
-      }
-    }
-    else {
-      time_t now = time(NULL);
+      sa_to_addr((struct sockaddr *)&target->dest, &r, &recv_port);
+      addr_to_str(recv_addr, &r);
 
-      if (now > err_cant_bridge_af + 60) {
-        Log(LOG_ERR, "ERROR ( %s/%s ): Can't bridge Address Families when in transparent mode\n", config.name, config.type);
-	err_cant_bridge_af = now;
-      }
+      Log(LOG_INFO, "INFO ( %s/%s ): pool ID: %u :: receiver: [%s:%u] :: datagrams: %llu batches: %llu avg batch: %llu/%u drops: %llu\n",
+		config.name, config.type, receivers.pools[pool_idx].id, recv_addr, recv_port,
+		(unsigned long long)target->batch.datagrams, (unsigned long long)target->batch.batches,
+		(unsigned long long)(target->batch.batches ? (target->batch.datagrams / target->batch.batches) : 0),
+		target->batch.max, (unsigned long long)target->batch.drops);
     }
   }
 }
@@ -484,9 +627,14 @@ void Tee_destroy_recvs()
     for (recv_idx = 0; recv_idx < receivers.pools[pool_idx].num; recv_idx++) {
       target = &receivers.pools[pool_idx].receivers[recv_idx];
       if (target->fd) close(target->fd);
+
+      if (target->batch.msgs) free(target->batch.msgs);
+      if (target->batch.iov) free(target->batch.iov);
+      if (target->batch.pmsgs) free(target->batch.pmsgs);
+      if (target->batch.hdrs) free(target->batch.hdrs);
     }
 
-    memset(receivers.pools[pool_idx].receivers, 0, config.tee_max_receivers*sizeof(struct tee_receivers));
+    memset(receivers.pools[pool_idx].receivers, 0, config.tee_max_receivers*sizeof(struct tee_receiver));
     memset(&receivers.pools[pool_idx].tag_filter, 0, sizeof(struct pretag_filter));
     memset(&receivers.pools[pool_idx].balance, 0, sizeof(struct tee_balance));
     receivers.pools[pool_idx].id = 0;
@@ -518,6 +666,8 @@ void Tee_init_socks()
       }
 
       target->fd = Tee_prepare_sock((struct sockaddr *) &target->dest, target->dest_len, receivers.pools[pool_idx].src_port);
+      Tee_init_batch(target);
+      if (config.tee_transparent) Tee_init_hdr_tpl(target);
 
       if (config.debug) {
 	struct host_addr recv_addr;
@@ -28,6 +28,13 @@
 #define DEFAULT_TEE_REFRESH_TIME 10
 #define MAX_TEE_POOLS 128 
 #define MAX_TEE_RECEIVERS 32 
+#define TEE_HDR_TPL_LEN 64		/* room for IPv6 + UDP headers */
+
+#if defined HAVE_SENDMMSG
+#define TEE_BATCH_MSGHDR(b, idx)	(&(b)->msgs[(idx)].msg_hdr)
+#else
+#define TEE_BATCH_MSGHDR(b, idx)	(&(b)->msgs[(idx)])
+#endif
 
 #define TEE_BALANCE_NONE	0
 #define TEE_BALANCE_RR		1
@@ -37,6 +44,34 @@
 typedef struct tee_receiver *(*tee_balance_algorithm) (void *, struct pkt_msg *);
 
 /* structures */
+
+/* per-receiver send queue: datagrams are referenced, not copied, and
+   replicated with a single sendmmsg() call when the queue fills up or
+   when the plugin buffer they point into is done with */
+struct tee_batch {
+#if defined HAVE_SENDMMSG
+  struct mmsghdr *msgs;
+#else
+  struct msghdr *msgs;
+#endif
+  struct iovec *iov;			/* two per datagram: IP/UDP header, payload */
+  struct pkt_msg **pmsgs;		/* original messages, for logging purposes */
+  char *hdrs;				/* transparent mode: per-datagram headers */
+  int num;				/* datagrams queued */
+  int max;				/* queue size */
+  u_int64_t datagrams;			/* datagrams sent */
+  u_int64_t batches;			/* send calls */
+  u_int64_t drops;			/* datagrams failed to be sent */
+};
+
+/* transparent mode: IP/UDP headers pre-computed for the receiver and the
+   last agent seen; per datagram only lengths (and, if the agent changes,
+   source address and port) are patched */
+struct tee_hdr_tpl {
+  char buf[TEE_HDR_TPL_LEN];
+  int len;
+};
+
 struct tee_receiver {
 #if defined ENABLE_IPV6
   struct sockaddr_storage dest;
@@ -45,6 +80,8 @@ struct tee_receiver {
 #endif
   socklen_t dest_len;
   int fd;
+  struct tee_hdr_tpl tpl;
+  struct tee_batch batch;
 };
 
 struct tee_balance {
@@ -77,7 +114,13 @@ struct tee_receivers {
 EXT void Tee_exit_now(int);
 EXT void Tee_init_socks();
 EXT void Tee_destroy_recvs();
-EXT void Tee_send(struct pkt_msg *, struct sockaddr *, int);
+EXT void Tee_send(struct pkt_msg *, struct tee_receiver *);
+EXT void Tee_flush(struct tee_receiver *);
+EXT void Tee_flush_all();
+EXT void Tee_init_batch(struct tee_receiver *);
+EXT void Tee_init_hdr_tpl(struct tee_receiver *);
+EXT int Tee_patch_hdr_tpl(struct tee_receiver *, struct pkt_msg *, char *);
+EXT void Tee_log_stats();
 EXT int Tee_prepare_sock(struct sockaddr *, socklen_t, u_int16_t);
 EXT int Tee_parse_hostport(const char *, struct sockaddr *, socklen_t *);
 EXT struct tee_receiver *Tee_rr_balance(void *, struct pkt_msg *);
@@ -85,7 +128,6 @@ EXT struct tee_receiver *Tee_hash_agent_balance(void *, struct pkt_msg *);
 EXT struct tee_receiver *Tee_hash_tag_balance(void *, struct pkt_msg *);
 
 /* global variables */
-EXT char tee_send_buf[65535];
 EXT struct tee_receivers receivers; 
 EXT int err_cant_bridge_af;
 
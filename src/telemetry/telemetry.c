@@ -67,7 +67,7 @@ void telemetry_daemon(void *t_data_void)
   telemetry_peer_udp_cache tpuc;
 
   int slen, clen, ret, rc, peers_idx, allowed, yes=1, no=0;
-  int peers_idx_rr = 0, max_peers_idx = 0, peers_num = 0;
+  int peers_num = 0;
   int decoder = 0, data_decoder = 0, recv_flags = 0;
   u_int16_t port = 0;
   char *srv_proto = NULL;
@@ -85,8 +85,8 @@ void telemetry_daemon(void *t_data_void)
   struct host_addr addr;
 
   /* select() stuff */
-  fd_set read_descs, bkp_read_descs;
-  int fd, select_fd, bkp_select_fd, recalc_fds, select_num;
+  struct bgp_evloop telemetry_evl;
+  int fd, select_num;
 
   /* logdump time management */
   time_t dump_refresh_deadline;
@@ -348,7 +348,7 @@ void telemetry_daemon(void *t_data_void)
   }
 
   if (config.telemetry_port_tcp) {
-    rc = listen(config.telemetry_sock, 1);
+    rc = listen(config.telemetry_sock, SOMAXCONN);
     if (rc < 0) {
       Log(LOG_ERR, "ERROR ( %s/%s ): listen() failed (errno: %d).\n", config.name, t_data->log_str, errno);
       exit_all(1);
@@ -356,9 +356,11 @@ void telemetry_daemon(void *t_data_void)
   }
 
   /* Preparing for syncronous I/O multiplexing */
-  select_fd = 0;
-  FD_ZERO(&bkp_read_descs);
-  FD_SET(config.telemetry_sock, &bkp_read_descs);
+  if (bgp_evloop_init(&telemetry_evl, (config.telemetry_max_peers + 1)) == ERR ||
+      bgp_evloop_add(&telemetry_evl, config.telemetry_sock, NULL) == ERR) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): I/O multiplexing setup failed (errno: %d).\n", config.name, t_data->log_str, errno);
+    exit_all(1);
+  }
 
   {
     char srv_string[INET6_ADDRSTRLEN];
@@ -413,34 +415,11 @@ void telemetry_daemon(void *t_data_void)
     if (config.telemetry_dump_kafka_topic) telemetry_dump_init_kafka_host();
   }
 
-  select_fd = bkp_select_fd = (config.telemetry_sock + 1);
-  recalc_fds = FALSE;
-
   telemetry_link_misc_structs(telemetry_misc_db);
 
   for (;;) {
     select_again:
 
-    if (recalc_fds) {
-      select_fd = config.telemetry_sock;
-      max_peers_idx = -1; /* .. since valid indexes include 0 */
-
-      for (peers_idx = 0, peers_num = 0; peers_idx < config.telemetry_max_peers; peers_idx++) {
-        if (select_fd < telemetry_peers[peers_idx].fd) select_fd = telemetry_peers[peers_idx].fd;
-        if (telemetry_peers[peers_idx].fd) {
-	  max_peers_idx = peers_idx;
-	  peers_num++;
-	}
-      }
-      select_fd++;
-      max_peers_idx++;
-
-      bkp_select_fd = select_fd;
-      recalc_fds = FALSE;
-    }
-    else select_fd = bkp_select_fd;
-
-    memcpy(&read_descs, &bkp_read_descs, sizeof(bkp_read_descs));
     if (telemetry_misc_db->dump_backend_methods) {
       int delta;
 
@@ -451,7 +430,7 @@ void telemetry_daemon(void *t_data_void)
     }
     else drt_ptr = NULL;
 
-    select_num = select(select_fd, &read_descs, NULL, NULL, drt_ptr);
+    select_num = bgp_evloop_wait(&telemetry_evl, drt_ptr);
     if (select_num < 0) goto select_again;
 
     t_data->now = time(NULL);
@@ -471,7 +450,7 @@ void telemetry_daemon(void *t_data_void)
 	      Log(LOG_INFO, "INFO ( %s/%s ): [%s] telemetry UDP peer removed (timeout).\n", config.name, t_data->log_str, peer->addr_str);
 	      telemetry_peer_close(peer, FUNC_TYPE_TELEMETRY);
 	      if (telemetry_is_zjson(decoder)) telemetry_peer_z_close(peer_z);
-	      recalc_fds = TRUE;
+	      peers_num--;
 	    }
 	  }
 	}
@@ -555,8 +534,14 @@ void telemetry_daemon(void *t_data_void)
     */
     if (!select_num) goto select_again;
 
+    /* Dispatching ready sockets, each one once per wakeup */
+    read_data:
+
+    fd = bgp_evloop_next(&telemetry_evl, (void **) &peer);
+    if (fd == ERR) goto select_again;
+
     /* New connection is coming in */
-    if (FD_ISSET(config.telemetry_sock, &read_descs)) {
+    if (fd == config.telemetry_sock) {
       if (config.telemetry_port_tcp) {
         fd = accept(config.telemetry_sock, (struct sockaddr *) &client, &clen);
         if (fd == ERR) goto read_data;
@@ -565,7 +550,7 @@ void telemetry_daemon(void *t_data_void)
 	char dummy_local_buf[TRUE];
 
 	ret = recvfrom(config.telemetry_sock, dummy_local_buf, TRUE, MSG_PEEK, (struct sockaddr *) &client, &clen);
-	if (ret <= 0) goto select_again;
+	if (ret <= 0) goto read_data;
 	else fd = config.telemetry_sock;
       }
 
@@ -594,7 +579,7 @@ void telemetry_daemon(void *t_data_void)
 	  peer = &telemetry_peers[tpuc_ret->index];
 	  telemetry_peers_udp_timeout[tpuc_ret->index].last_msg = t_data->now;
 
-	  goto read_data;
+	  goto process_data;
 	}
       }
 
@@ -613,8 +598,6 @@ void telemetry_daemon(void *t_data_void)
 	  }
 
 	  if (peer) {
-	    recalc_fds = TRUE;
-
 	    if (config.telemetry_port_udp) {
 	      tpuc.index = peers_idx;
 	      telemetry_peers_udp_timeout[peers_idx].last_msg = t_data->now;
@@ -637,7 +620,12 @@ void telemetry_daemon(void *t_data_void)
       }
 
       peer->fd = fd;
-      if (config.telemetry_port_tcp) FD_SET(peer->fd, &bkp_read_descs);
+      if (config.telemetry_port_tcp && bgp_evloop_add(&telemetry_evl, peer->fd, peer) == ERR) {
+        Log(LOG_ERR, "ERROR ( %s/%s ): Unable to watch telemetry peer socket (errno: %d).\n", config.name, t_data->log_str, errno);
+        telemetry_peer_close(peer, FUNC_TYPE_TELEMETRY);
+        if (telemetry_is_zjson(decoder)) telemetry_peer_z_close(&telemetry_peers_z[peer - telemetry_peers]);
+        goto read_data;
+      }
       peer->addr.family = ((struct sockaddr *)&client)->sa_family;
       if (peer->addr.family == AF_INET) {
         peer->addr.address.ipv4.s_addr = ((struct sockaddr_in *)&client)->sin_addr.s_addr;
@@ -660,31 +648,16 @@ void telemetry_daemon(void *t_data_void)
       peers_num++;
       Log(LOG_INFO, "INFO ( %s/%s ): [%s] telemetry peers usage: %u/%u\n",
 	  config.name, t_data->log_str, peer->addr_str, peers_num, config.telemetry_max_peers);
-    }
-
-    read_data:
-
-    /*
-       We have something coming in: let's lookup which peer is that.
-       FvD: To avoid starvation of the "later established" peers, we
-       offset the start of the search in a round-robin style.
-    */
-    if (config.telemetry_port_tcp) {
-      for (peer = NULL, peers_idx = 0; peers_idx < max_peers_idx; peers_idx++) {
-        int loc_idx = (peers_idx + peers_idx_rr) % max_peers_idx;
-
-        if (telemetry_peers[loc_idx].fd && FD_ISSET(telemetry_peers[loc_idx].fd, &read_descs)) {
-          peer = &telemetry_peers[loc_idx];
 
-	  if (telemetry_is_zjson(decoder)) peer_z = &telemetry_peers_z[loc_idx];
-
-          peers_idx_rr = (peers_idx_rr + 1) % max_peers_idx;
-          break;
-        }
-      }
+      /* UDP: the datagram that announced the peer is to be read now */
+      if (config.telemetry_port_tcp) goto read_data;
     }
+    /* We have something coming in: the peer is known straight from its fd */
+    else if (!peer || peer->fd != fd) goto read_data;
+
+    process_data:
 
-    if (!peer) goto select_again;
+    if (telemetry_is_zjson(decoder)) peer_z = &telemetry_peers_z[peer - telemetry_peers];
 
     recv_flags = 0;
 
@@ -724,10 +697,10 @@ void telemetry_daemon(void *t_data_void)
 
     if (ret <= 0) {
       Log(LOG_INFO, "INFO ( %s/%s ): [%s] connection reset by peer (%d).\n", config.name, t_data->log_str, peer->addr_str, errno);
-      FD_CLR(peer->fd, &bkp_read_descs);
+      if (config.telemetry_port_tcp) bgp_evloop_del(&telemetry_evl, peer->fd);
       telemetry_peer_close(peer, FUNC_TYPE_TELEMETRY);
       if (telemetry_is_zjson(decoder)) telemetry_peer_z_close(peer_z);
-      recalc_fds = TRUE;
+      peers_num--;
     }
     else {
       peer->stats.packets++;
@@ -736,6 +709,8 @@ void telemetry_daemon(void *t_data_void)
         telemetry_process_data(peer, t_data, data_decoder);
       }
     }
+
+    goto read_data;
   }
 }
 
@@ -0,0 +1,325 @@
+/*
+    pmacct (Promiscuous mode IP Accounting package)
+    pmacct is Copyright (C) 2003-2017 by Paolo Lucente
+*/
+
+
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#define __TPACKET_C
+
+/* includes */
+#include "pmacct.h"
+#include "tpacket.h"
+
+#if defined HAVE_TPACKET_V3
+/* prototypes */
+static u_char *tpacket_v3_vlan_insert(struct tpacket_v3_ring *, struct tpacket3_hdr *, u_char *, struct pcap_pkthdr *);
+
+/* functions */
+/* tpacket_v3_open(): opens an AF_PACKET socket on the given interface and sets
+   up a memory-mapped TPACKET_V3 receive ring of ring_size bytes. The kernel
+   fills fixed-size blocks with variable-length frames; a block is handed over
+   to userspace when full or after TPACKET_V3_RETIRE_TOV msecs. Packets are
+   truncated to snaplen by the socket filter (see tpacket_v3_setfilter()) */
+int tpacket_v3_open(struct tpacket_v3_ring *ring, char *dev, int snaplen, int promisc, u_int32_t ring_size)
+{
+  struct tpacket_req3 req;
+  struct sockaddr_ll sll;
+  struct packet_mreq mreq;
+  struct ifreq ifr;
+  struct sock_filter snap_insn = BPF_STMT(BPF_RET | BPF_K, snaplen);
+  struct sock_fprog snap_prog = { 1, &snap_insn };
+  int version = TPACKET_V3;
+
+  memset(ring, 0, sizeof(struct tpacket_v3_ring));
+  ring->snaplen = snaplen;
+
+  if ((ring->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_open(): socket() failed: %s\n", config.name, config.type, strerror(errno));
+    return ERR;
+  }
+
+  if (!(ring->ifindex = if_nametoindex(dev))) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_open(): unknown interface %s\n", config.name, config.type, dev);
+    goto err;
+  }
+
+  memset(&ifr, 0, sizeof(ifr));
+  strlcpy(ifr.ifr_name, dev, sizeof(ifr.ifr_name));
+  if (ioctl(ring->fd, SIOCGIFHWADDR, &ifr) < 0) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_open(): SIOCGIFHWADDR failed on %s: %s\n", config.name, config.type, dev, strerror(errno));
+    goto err;
+  }
+
+  /* frames are passed on as DLT_EN10MB */
+  if (ifr.ifr_hwaddr.sa_family == ARPHRD_LOOPBACK) ring->loopback = TRUE;
+  else if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_open(): %s is not an Ethernet interface (ARPHRD %u)\n",
+	config.name, config.type, dev, ifr.ifr_hwaddr.sa_family);
+    goto err;
+  }
+
+  if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_open(): TPACKET_V3 not supported: %s\n", config.name, config.type, strerror(errno));
+    goto err;
+  }
+
+  /* snaplen until the proper filter is attached */
+  if (setsockopt(ring->fd, SOL_SOCKET, SO_ATTACH_FILTER, &snap_prog, sizeof(snap_prog)) < 0) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_open(): SO_ATTACH_FILTER failed: %s\n", config.name, config.type, strerror(errno));
+    goto err;
+  }
+
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = TPACKET_V3_BLOCK_SIZE;
+  req.tp_block_nr = ring_size / TPACKET_V3_BLOCK_SIZE;
+  req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+  req.tp_frame_nr = (req.tp_block_size / req.tp_frame_size) * req.tp_block_nr;
+  req.tp_retire_blk_tov = TPACKET_V3_RETIRE_TOV;
+
+  if (setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_open(): PACKET_RX_RING failed (%u blocks of %u bytes): %s\n",
+	config.name, config.type, req.tp_block_nr, req.tp_block_size, strerror(errno));
+    goto err;
+  }
+
+  ring->block_size = req.tp_block_size;
+  ring->block_nr = req.tp_block_nr;
+  ring->map_len = (size_t) ring->block_size * ring->block_nr;
+
+  ring->map = mmap(NULL, ring->map_len, PROT_READ|PROT_WRITE, MAP_SHARED, ring->fd, 0);
+  if (ring->map == MAP_FAILED) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_open(): mmap() failed: %s\n", config.name, config.type, strerror(errno));
+    ring->map = NULL;
+    goto err;
+  }
+
+  memset(&sll, 0, sizeof(sll));
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons(ETH_P_ALL);
+  sll.sll_ifindex = ring->ifindex;
+
+  if (bind(ring->fd, (struct sockaddr *) &sll, sizeof(sll)) < 0) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_open(): bind() to %s failed: %s\n", config.name, config.type, dev, strerror(errno));
+    goto err;
+  }
+
+  if (promisc) {
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = ring->ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+      Log(LOG_WARNING, "WARN ( %s/%s ): tpacket_v3_open(): unable to set %s in promiscuous mode: %s\n",
+	  config.name, config.type, dev, strerror(errno));
+  }
+
+  ring->vlan_buf = malloc(snaplen + TPACKET_V3_VLAN_TAG_LEN);
+  if (!ring->vlan_buf) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_open(): Unable to malloc() vlan_buf.\n", config.name, config.type);
+    goto err;
+  }
+
+  gettimeofday(&ring->last_stats, NULL);
+
+  Log(LOG_INFO, "INFO ( %s/%s ): TPACKET_V3 ring on %s: %u blocks of %u bytes\n",
+      config.name, config.type, dev, ring->block_nr, ring->block_size);
+
+  return SUCCESS;
+
+  err:
+  tpacket_v3_close(ring);
+
+  return ERR;
+}
+
+/* tpacket_v3_setfilter(): a BPF program compiled by libpcap against a
+   DLT_EN10MB handle is attached as-is to the socket; being run by the
+   kernel, VLAN tags have already been stripped from the frame at that
+   point, hence 'vlan' filter primitives are not expected to match */
+int tpacket_v3_setfilter(struct tpacket_v3_ring *ring, struct bpf_program *filter)
+{
+  struct sock_fprog prog;
+
+  if (!filter->bf_len) return SUCCESS;
+
+  prog.len = filter->bf_len;
+  prog.filter = (struct sock_filter *) filter->bf_insns;
+
+  if (setsockopt(ring->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): tpacket_v3_setfilter(): SO_ATTACH_FILTER failed: %s\n", config.name, config.type, strerror(errno));
+    return ERR;
+  }
+
+  return SUCCESS;
+}
+
+/* tpacket_v3_loop(): walks the ring block by block, handing each frame
+   over to callback; blocks are returned to the kernel once all of their
+   frames have been processed. Returns only upon a socket error, ie. the
+   interface going away */
+int tpacket_v3_loop(struct tpacket_v3_ring *ring, pcap_handler callback, u_char *user)
+{
+  struct tpacket_block_desc *bd;
+  struct tpacket3_hdr *ppd;
+  struct sockaddr_ll *sll;
+  struct pcap_pkthdr hdr;
+  struct pollfd pfd;
+  u_int32_t idx, num_pkts;
+  u_char *pkt;
+
+  memset(&pfd, 0, sizeof(pfd));
+  pfd.fd = ring->fd;
+  pfd.events = POLLIN|POLLERR;
+
+  for (;;) {
+    bd = (struct tpacket_block_desc *) (ring->map + ((size_t) ring->block_idx * ring->block_size));
+
+    if (!(bd->hdr.bh1.block_status & TP_STATUS_USER)) {
+      if (poll(&pfd, 1, -1) < 0) {
+	if (errno == EINTR) continue;
+
+	Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_loop(): poll() failed: %s\n", config.name, config.type, strerror(errno));
+	return ERR;
+      }
+
+      if (pfd.revents & (POLLERR|POLLHUP|POLLNVAL)) {
+	Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_v3_loop(): socket error on %s\n", config.name, config.type, config.dev);
+	return ERR;
+      }
+
+      continue;
+    }
+
+    num_pkts = bd->hdr.bh1.num_pkts;
+    ppd = (struct tpacket3_hdr *) ((u_int8_t *) bd + bd->hdr.bh1.offset_to_first_pkt);
+
+    for (idx = 0; idx < num_pkts; idx++) {
+      sll = (struct sockaddr_ll *) ((u_int8_t *) ppd + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+      /* on loopback each packet is seen twice, once per direction */
+      if (!ring->loopback || sll->sll_pkttype != PACKET_OUTGOING) {
+	hdr.ts.tv_sec = ppd->tp_sec;
+	hdr.ts.tv_usec = ppd->tp_nsec / 1000;
+	hdr.caplen = ppd->tp_snaplen;
+	hdr.len = ppd->tp_len;
+	pkt = (u_char *) ppd + ppd->tp_mac;
+
+	if (ppd->tp_status & TP_STATUS_VLAN_VALID) pkt = tpacket_v3_vlan_insert(ring, ppd, pkt, &hdr);
+
+	(*callback)(user, &hdr, pkt);
+      }
+
+      ppd = (struct tpacket3_hdr *) ((u_int8_t *) ppd + ppd->tp_next_offset);
+    }
+
+    __sync_synchronize();
+    bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    ring->block_idx = (ring->block_idx + 1) % ring->block_nr;
+  }
+
+  return SUCCESS;
+}
+
+/* the kernel strips the 802.1Q tag off received frames and reports it in
+   the frame header: put it back in place for the L2 handlers */
+static u_char *tpacket_v3_vlan_insert(struct tpacket_v3_ring *ring, struct tpacket3_hdr *ppd, u_char *pkt, struct pcap_pkthdr *hdr)
+{
+  u_int16_t tpid = ETH_P_8021Q, tci = ppd->hv1.tp_vlan_tci;
+
+  if (hdr->caplen < (2 * ETH_ALEN) || hdr->caplen > ring->snaplen) return pkt;
+
+#if defined TP_STATUS_VLAN_TPID_VALID
+  if (ppd->tp_status & TP_STATUS_VLAN_TPID_VALID) tpid = ppd->hv1.tp_vlan_tpid;
+#endif
+
+  tpid = htons(tpid);
+  tci = htons(tci);
+
+  memcpy(ring->vlan_buf, pkt, 2 * ETH_ALEN);
+  memcpy(ring->vlan_buf + (2 * ETH_ALEN), &tpid, 2);
+  memcpy(ring->vlan_buf + (2 * ETH_ALEN) + 2, &tci, 2);
+  memcpy(ring->vlan_buf + (2 * ETH_ALEN) + TPACKET_V3_VLAN_TAG_LEN, pkt + (2 * ETH_ALEN), hdr->caplen - (2 * ETH_ALEN));
+
+  hdr->caplen += TPACKET_V3_VLAN_TAG_LEN;
+  hdr->len += TPACKET_V3_VLAN_TAG_LEN;
+
+  return ring->vlan_buf;
+}
+
+void tpacket_v3_close(struct tpacket_v3_ring *ring)
+{
+  if (ring->map) munmap(ring->map, ring->map_len);
+  if (ring->fd >= 0) close(ring->fd);
+  if (ring->vlan_buf) free(ring->vlan_buf);
+
+  ring->map = NULL;
+  ring->vlan_buf = NULL;
+  ring->fd = ERR;
+}
+
+void tpacket_v3_stats(struct tpacket_v3_ring *ring)
+{
+  struct tpacket_stats_v3 st;
+  socklen_t len = sizeof(st);
+
+  if (ring->fd < 0) return;
+
+  if (!getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len)) {
+    ring->packets += st.tp_packets;
+    ring->drops += st.tp_drops;
+  }
+}
+
+/* tpacket_v3_log_stats(): logs the packets received, the packets dropped
+   for lack of ring space and the packet rate since the last call */
+void tpacket_v3_log_stats(struct tpacket_v3_ring *ring, time_t now)
+{
+  struct timeval tv;
+  u_int64_t pps = 0, delta;
+
+  tpacket_v3_stats(ring);
+
+  gettimeofday(&tv, NULL);
+  delta = ((tv.tv_sec - ring->last_stats.tv_sec) * 1000000) + (tv.tv_usec - ring->last_stats.tv_usec);
+  if (delta) pps = ((ring->packets - ring->last_packets) * 1000000) / delta;
+
+  Log(LOG_NOTICE, "NOTICE ( %s/%s ): %s: (%u) worker #%u: %llu packets received by filter, %llu dropped by kernel, %llu packets/s\n",
+	config.name, config.type, config.dev, now, config.nfacctd_worker_id, (unsigned long long) ring->packets,
+	(unsigned long long) ring->drops, (unsigned long long) pps);
+
+  ring->last_packets = ring->packets;
+  ring->last_stats = tv;
+}
+
+/* tpacket_fanout_join(): joins the socket to the PACKET_FANOUT group shared
+   by all Core Process workers. Packets are spread by flow hash, which is
+   symmetric, with fragments being reassembled beforehand: both directions
+   of a flow, and all of its fragments, are processed by the same worker */
+int tpacket_fanout_join(int fd, u_int16_t group_id)
+{
+  int fanout_arg = (group_id | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16));
+
+  if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) < 0) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): tpacket_fanout_join(): PACKET_FANOUT failed: %s\n", config.name, config.type, strerror(errno));
+    return ERR;
+  }
+
+  return SUCCESS;
+}
+#endif
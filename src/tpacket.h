@@ -0,0 +1,79 @@
+/*
+    pmacct (Promiscuous mode IP Accounting package)
+    pmacct is Copyright (C) 2003-2017 by Paolo Lucente
+*/
+
+
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* includes */
+#if defined (PCAP_TYPE_linux)
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <net/if_arp.h>
+#include <poll.h>
+#endif
+
+/* defines */
+#if defined (TP_STATUS_BLK_TMO) && defined (PACKET_FANOUT)
+#define HAVE_TPACKET_V3
+#endif
+
+#define TPACKET_V3_VLAN_TAG_LEN 4
+
+/* structures */
+#if defined HAVE_TPACKET_V3
+struct tpacket_v3_ring {
+  int fd;
+  int ifindex;
+  int loopback;
+  u_int8_t *map;
+  size_t map_len;
+  u_int32_t block_size;
+  u_int32_t block_nr;
+  u_int32_t block_idx;
+  u_int32_t snaplen;
+  u_char *vlan_buf;
+
+  /* statistics: kernel counters are reset upon reading */
+  u_int64_t packets;
+  u_int64_t drops;
+  u_int64_t last_packets;
+  struct timeval last_stats;
+};
+#endif
+
+/* prototypes */
+#if (!defined __TPACKET_C)
+#define EXT extern
+#else
+#define EXT
+#endif
+#if defined HAVE_TPACKET_V3
+EXT int tpacket_v3_open(struct tpacket_v3_ring *, char *, int, int, u_int32_t);
+EXT int tpacket_v3_setfilter(struct tpacket_v3_ring *, struct bpf_program *);
+EXT int tpacket_v3_loop(struct tpacket_v3_ring *, pcap_handler, u_char *);
+EXT void tpacket_v3_close(struct tpacket_v3_ring *);
+EXT void tpacket_v3_stats(struct tpacket_v3_ring *);
+EXT void tpacket_v3_log_stats(struct tpacket_v3_ring *, time_t);
+EXT int tpacket_fanout_join(int, u_int16_t);
+
+/* global vars */
+EXT struct tpacket_v3_ring *glob_tpacket;
+#endif
+#undef EXT
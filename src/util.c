@@ -28,6 +28,7 @@
 #include "ip_flow.h"
 #include "classifier.h"
 #include "plugin_hooks.h"
+#include "jhash.h"
 #include <search.h>
 #include <sys/file.h>
 
@@ -1180,6 +1181,21 @@ void set_sampling_table(struct packet_ptrs_vector *pptrsv, u_char *t)
 #endif
 }
 
+void set_vector_pkthdr_ts(struct packet_ptrs_vector *pptrsv, struct timeval *ts)
+{
+  pptrsv->v4.pkthdr->ts = *ts;
+  pptrsv->vlan4.pkthdr->ts = *ts;
+  pptrsv->mpls4.pkthdr->ts = *ts;
+  pptrsv->vlanmpls4.pkthdr->ts = *ts;
+
+#if defined ENABLE_IPV6
+  pptrsv->v6.pkthdr->ts = *ts;
+  pptrsv->vlan6.pkthdr->ts = *ts;
+  pptrsv->mpls6.pkthdr->ts = *ts;
+  pptrsv->vlanmpls6.pkthdr->ts = *ts;
+#endif
+}
+
 void *pm_malloc(size_t size)
 {
   unsigned char *obj;
@@ -2345,6 +2361,108 @@ int vlen_prims_delete(struct pkt_vlen_hdr_primitives *hdr, pm_cfgreg_t wtc /*, o
   return ret;
 }
 
+/* whole structure until primitives_key_init() is called */
+static struct primitives_key pkey = { { { 0, sizeof(struct pkt_primitives) } }, 1 };
+
+static void primitives_key_add(u_int16_t off, u_int16_t len)
+{
+  struct primitives_key_range *prev;
+
+  if (pkey.num) {
+    prev = &pkey.range[pkey.num - 1];
+
+    /* adjacent fields are merged so to be processed in one go */
+    if (prev->off + prev->len == off) {
+      prev->len += len;
+      return;
+    }
+  }
+
+  if (pkey.num < MAX_PRIMITIVES_KEY_RANGES) {
+    pkey.range[pkey.num].off = off;
+    pkey.range[pkey.num].len = len;
+    pkey.num++;
+  }
+}
+
+#define PKEY_FIELD(f) primitives_key_add(offsetof(struct pkt_primitives, f), sizeof(((struct pkt_primitives *)0)->f))
+
+/*
+   primitives_key_init(): builds the list of struct pkt_primitives areas
+   the aggregation method can populate; caches then hash and compare just
+   those instead of the whole structure. Areas are added following the
+   structure layout so that adjacent ones get merged.
+*/
+void primitives_key_init(pm_cfgreg_t w, pm_cfgreg_t w2)
+{
+  memset(&pkey, 0, sizeof(pkey));
+
+#if defined (HAVE_L2)
+  if (w & COUNT_DST_MAC) PKEY_FIELD(eth_dhost);
+  if (w & (COUNT_SRC_MAC|COUNT_SUM_MAC)) PKEY_FIELD(eth_shost);
+  if (w & COUNT_VLAN) PKEY_FIELD(vlan_id);
+  if (w & COUNT_COS) PKEY_FIELD(cos);
+  if (w & COUNT_ETHERTYPE) PKEY_FIELD(etype);
+#endif
+  if (w & (COUNT_SRC_HOST|COUNT_SRC_NET|COUNT_SUM_HOST|COUNT_SUM_NET)) PKEY_FIELD(src_ip);
+  if (w & (COUNT_DST_HOST|COUNT_DST_NET|COUNT_SUM_HOST|COUNT_SUM_NET)) PKEY_FIELD(dst_ip);
+  if (w & (COUNT_SRC_NET|COUNT_SUM_NET)) PKEY_FIELD(src_net);
+  if (w & (COUNT_DST_NET|COUNT_SUM_NET)) PKEY_FIELD(dst_net);
+  if (w & COUNT_SRC_NMASK) PKEY_FIELD(src_nmask);
+  if (w & COUNT_DST_NMASK) PKEY_FIELD(dst_nmask);
+  if (w & (COUNT_SRC_AS|COUNT_SUM_AS)) PKEY_FIELD(src_as);
+  if (w & (COUNT_DST_AS|COUNT_SUM_AS)) PKEY_FIELD(dst_as);
+  if (w & (COUNT_SRC_PORT|COUNT_SUM_PORT)) PKEY_FIELD(src_port);
+  if (w & (COUNT_DST_PORT|COUNT_SUM_PORT)) PKEY_FIELD(dst_port);
+  if (w & COUNT_IP_TOS) PKEY_FIELD(tos);
+  if (w & COUNT_IP_PROTO) PKEY_FIELD(proto);
+  if (w & COUNT_IN_IFACE) PKEY_FIELD(ifindex_in);
+  if (w & COUNT_OUT_IFACE) PKEY_FIELD(ifindex_out);
+#if defined (WITH_GEOIP) || defined (WITH_GEOIPV2)
+  if (w2 & COUNT_SRC_HOST_COUNTRY) PKEY_FIELD(src_ip_country);
+  if (w2 & COUNT_DST_HOST_COUNTRY) PKEY_FIELD(dst_ip_country);
+  if (w2 & COUNT_SRC_HOST_POCODE) PKEY_FIELD(src_ip_pocode);
+  if (w2 & COUNT_DST_HOST_POCODE) PKEY_FIELD(dst_ip_pocode);
+#endif
+  if (w & COUNT_TAG) PKEY_FIELD(tag);
+  if (w & COUNT_TAG2) PKEY_FIELD(tag2);
+  if (w & COUNT_CLASS) PKEY_FIELD(class);
+  if (w2 & COUNT_SAMPLING_RATE) PKEY_FIELD(sampling_rate);
+  if (w2 & COUNT_PKT_LEN_DISTRIB) PKEY_FIELD(pkt_len_distrib);
+  if (w2 & COUNT_EXPORT_PROTO_SEQNO) PKEY_FIELD(export_proto_seqno);
+  if (w2 & COUNT_EXPORT_PROTO_VERSION) PKEY_FIELD(export_proto_version);
+
+  /* no primitive in the base structure, ie. BGP-only aggregation */
+  if (!pkey.num) primitives_key_add(0, sizeof(struct pkt_primitives));
+
+  Log(LOG_DEBUG, "DEBUG ( %s/%s ): aggregation key: %u ranges\n", config.name, config.type, pkey.num);
+}
+
+u_int32_t primitives_key_hash(struct pkt_primitives *data, u_int32_t initval)
+{
+  unsigned char *base = (unsigned char *) data;
+  u_int32_t hash = initval;
+  int idx;
+
+  for (idx = 0; idx < pkey.num; idx++)
+    hash = jhash(base + pkey.range[idx].off, pkey.range[idx].len, hash);
+
+  return hash;
+}
+
+/* returns zero if the selected areas match, like memcmp() */
+int primitives_key_cmp(struct pkt_primitives *d1, struct pkt_primitives *d2)
+{
+  unsigned char *b1 = (unsigned char *) d1, *b2 = (unsigned char *) d2;
+  int idx;
+
+  for (idx = 0; idx < pkey.num; idx++) {
+    if (memcmp(b1 + pkey.range[idx].off, b2 + pkey.range[idx].off, pkey.range[idx].len)) return TRUE;
+  }
+
+  return FALSE;
+}
+
 void replace_string(char *str, int string_len, char *var, char *value)
 {
   char *ptr_start, *ptr_end;
@@ -2614,6 +2732,98 @@ int dump_writers_add(pid_t pid)
   return ret;
 }
 
+/* core_workers_spawn(): forks (config.nfacctd_workers - 1) replicas of the
+   Core Process. Each worker goes on to open its own SO_REUSEPORT socket and
+   to start its own set of plugins; the kernel hashes incoming datagrams by
+   socket 4-tuple, hence all traffic sent from a given exporter address and
+   port lands on the same worker. Exporters spreading their export across
+   multiple source ports are split across workers instead, each with its
+   own template cache, xflow status and sequence tracking.
+   Returns the worker index, 0 being the original Core Process */
+int core_workers_spawn()
+{
+  struct plugins_list_entry *list;
+  u_int16_t idx;
+  pid_t pid;
+
+  core_workers.active = 0;
+  core_workers.max = config.nfacctd_workers;
+  core_workers.flags = FALSE;
+
+  if (core_workers.max < 2) return 0;
+
+  core_workers.list = malloc(core_workers.max * sizeof(pid_t));
+  if (!core_workers.list) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): Unable to allocate core_workers list. Exiting.\n", config.name, config.type);
+    exit(1);
+  }
+  memset(core_workers.list, 0, (core_workers.max * sizeof(pid_t)));
+
+  core_workers.list[0] = getpid();
+  core_workers.active++;
+
+  for (idx = 1; idx < core_workers.max; idx++) {
+    switch (pid = fork()) {
+    case -1:
+      Log(LOG_ERR, "ERROR ( %s/%s ): Unable to fork Core Process worker #%u: %s\n", config.name, config.type, idx, strerror(errno));
+      break;
+    case 0:
+      /* workers do not keep track of siblings: only worker #0 does */
+      free(core_workers.list);
+      memset(&core_workers, 0, sizeof(core_workers));
+
+      config.nfacctd_worker_id = idx;
+      config.pidfile = NULL;
+      for (list = plugins_list; list; list = list->next) list->cfg.pidfile = NULL;
+
+      return idx;
+    default:
+      core_workers.list[idx] = pid;
+      core_workers.active++;
+      break;
+    }
+  }
+
+  Log(LOG_INFO, "INFO ( %s/%s ): Spawned %u Core Process workers.\n", config.name, config.type, core_workers.active);
+
+  return 0;
+}
+
+/* core_workers_signal(): relays a signal received by worker #0 (ie. the one
+   whose PID is in the pidfile) to all sibling workers; plugins inherit the
+   list upon fork() hence the check on the PID */
+void core_workers_signal(int signum)
+{
+  u_int16_t idx;
+
+  if (!core_workers.list || core_workers.list[0] != getpid()) return;
+
+  for (idx = 1; idx < core_workers.max; idx++) {
+    if (core_workers.list[idx]) kill(core_workers.list[idx], signum);
+  }
+}
+
+/* core_workers_reap(): to be called upon reaping a child; if that was a
+   worker, its slot is cleared so that its PID, once recycled by the
+   system, is not signalled. Returns TRUE if pid was a worker */
+int core_workers_reap(pid_t pid)
+{
+  u_int16_t idx;
+
+  if (!core_workers.list || pid <= 0) return FALSE;
+
+  for (idx = 1; idx < core_workers.max; idx++) {
+    if (core_workers.list[idx] == pid) {
+      core_workers.list[idx] = 0;
+      core_workers.active--;
+
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
 int pm_scandir(const char *dir, struct dirent ***namelist,
             int (*select)(const struct dirent *),
             int (*compar)(const void *, const void *))
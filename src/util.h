@@ -81,6 +81,7 @@ EXT void reset_net_status_v(struct packet_ptrs_vector *);
 EXT void reset_shadow_status(struct packet_ptrs_vector *);
 EXT void reset_fallback_status(struct packet_ptrs *);
 EXT void set_sampling_table(struct packet_ptrs_vector *, u_char *);
+EXT void set_vector_pkthdr_ts(struct packet_ptrs_vector *, struct timeval *);
 EXT void set_shadow_status(struct packet_ptrs *);
 EXT void set_default_preferences(struct configuration *);
 EXT FILE *open_output_file(char *, char *, int);
@@ -156,6 +157,10 @@ EXT void vlen_prims_debug(struct pkt_vlen_hdr_primitives *);
 EXT void vlen_prims_insert(struct pkt_vlen_hdr_primitives *, pm_cfgreg_t, int, char *, int);
 EXT int vlen_prims_delete(struct pkt_vlen_hdr_primitives *, pm_cfgreg_t);
 
+EXT void primitives_key_init(pm_cfgreg_t, pm_cfgreg_t);
+EXT u_int32_t primitives_key_hash(struct pkt_primitives *, u_int32_t);
+EXT int primitives_key_cmp(struct pkt_primitives *, struct pkt_primitives *);
+
 EXT void hash_init_key(pm_hash_key_t *);
 EXT int hash_init_serial(pm_hash_serial_t *, u_int16_t);
 EXT int hash_alloc_key(pm_hash_key_t *, u_int16_t);
@@ -178,6 +183,10 @@ EXT u_int16_t dump_writers_get_active();
 EXT u_int16_t dump_writers_get_max();
 EXT int dump_writers_add(pid_t);
 
+EXT int core_workers_spawn();
+EXT void core_workers_signal(int);
+EXT int core_workers_reap(pid_t);
+
 EXT int pm_scandir(const char *, struct dirent ***, int (*select)(const struct dirent *), int (*compar)(const void *, const void *));
 EXT void pm_scandir_free(struct dirent ***, int);
 EXT int pm_alphasort(const void *, const void *);
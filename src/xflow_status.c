@@ -177,9 +177,84 @@ void print_status_table(time_t now, int buckets)
 
   Log(LOG_NOTICE, "NOTICE ( %s/%s ): +++\n", config.name, config.type);
   Log(LOG_NOTICE, "NOTICE ( %s/%s ): Total bad %s datagrams: %u (%u)\n", config.name, config.type, ftype, xflow_tot_bad_datagrams, now);
+  if (print_status_table_ext) print_status_table_ext(now);
+#if defined HAVE_RECVMMSG
+  if (xflow_recv_batch.num) {
+    Log(LOG_NOTICE, "NOTICE ( %s/%s ): Receive batches: %llu datagrams: %llu avg fill: %llu/%u full: %llu\n",
+	config.name, config.type, (unsigned long long)xflow_recv_batch.calls, (unsigned long long)xflow_recv_batch.datagrams,
+	(unsigned long long)(xflow_recv_batch.calls ? (xflow_recv_batch.datagrams / xflow_recv_batch.calls) : 0),
+	xflow_recv_batch.num, (unsigned long long)xflow_recv_batch.full);
+  }
+#endif
   Log(LOG_NOTICE, "NOTICE ( %s/%s ): ---\n", config.name, config.type);
 }
 
+#if defined HAVE_RECVMMSG
+void xflow_recv_batch_init(struct xflow_recv_batch *b, int num, int bufsz)
+{
+  int idx;
+
+  memset(b, 0, sizeof(struct xflow_recv_batch));
+
+  b->msgs = malloc(num * sizeof(struct mmsghdr));
+  b->iov = malloc(num * sizeof(struct iovec));
+  b->addrs = malloc(num * sizeof(struct sockaddr_storage));
+  b->bufs = malloc((size_t)num * bufsz);
+
+  if (!b->msgs || !b->iov || !b->addrs || !b->bufs) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): Unable to allocate receive batch (num=%u bufsz=%u). Exiting.\n", config.name, config.type, num, bufsz);
+    exit(1);
+  }
+
+  memset(b->msgs, 0, num * sizeof(struct mmsghdr));
+
+  for (idx = 0; idx < num; idx++) {
+    b->iov[idx].iov_base = b->bufs + ((size_t)idx * bufsz);
+    b->iov[idx].iov_len = bufsz;
+    b->msgs[idx].msg_hdr.msg_iov = &b->iov[idx];
+    b->msgs[idx].msg_hdr.msg_iovlen = 1;
+    b->msgs[idx].msg_hdr.msg_name = &b->addrs[idx];
+  }
+
+  b->num = num;
+  b->bufsz = bufsz;
+}
+
+/* xflow_recv_batch_next(): returns the next datagram of the current batch,
+   pulling a new batch off the socket when the current one is exhausted. On
+   refill the batch is time-stamped and the stamp propagated to the dummy
+   pcap headers of the packet_ptrs vector */
+int xflow_recv_batch_next(struct xflow_recv_batch *b, int sock, unsigned char **buf,
+			  struct sockaddr *sa, int salen, struct packet_ptrs_vector *pptrsv)
+{
+  struct mmsghdr *msg;
+  int idx, ret;
+
+  if (b->idx == b->cnt) {
+    for (idx = 0; idx < b->num; idx++) b->msgs[idx].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+
+    ret = recvmmsg(sock, b->msgs, b->num, MSG_WAITFORONE, NULL);
+    b->idx = b->cnt = 0;
+    if (ret <= 0) return ERR;
+
+    b->cnt = ret;
+    b->calls++;
+    b->datagrams += ret;
+    if (ret == b->num) b->full++;
+
+    gettimeofday(&b->stamp, NULL);
+    if (pptrsv) set_vector_pkthdr_ts(pptrsv, &b->stamp);
+  }
+
+  msg = &b->msgs[b->idx];
+  *buf = msg->msg_hdr.msg_iov->iov_base;
+  memcpy(sa, msg->msg_hdr.msg_name, MIN(salen, msg->msg_hdr.msg_namelen));
+  b->idx++;
+
+  return msg->msg_len;
+}
+#endif
+
 struct xflow_status_entry_sampling *
 search_smp_if_status_table(struct xflow_status_entry_sampling *sentry, u_int32_t interface)
 {
@@ -81,6 +81,26 @@ struct xflow_status_entry
   struct xflow_status_entry *next;
 };
 
+#if defined HAVE_RECVMMSG
+/* batched datagram reception via recvmmsg(): datagrams are read into a
+   pre-allocated ring of buffers and time-stamped once per batch */
+struct xflow_recv_batch
+{
+  struct mmsghdr *msgs;
+  struct iovec *iov;
+  struct sockaddr_storage *addrs;
+  unsigned char *bufs;
+  int bufsz;			/* size of each buffer */
+  int num;			/* batch size, ie. number of buffers */
+  int cnt;			/* datagrams in current batch */
+  int idx;			/* next datagram to be returned */
+  struct timeval stamp;		/* time of reception of current batch */
+  u_int64_t calls;		/* recvmmsg() calls returning data */
+  u_int64_t datagrams;		/* datagrams received */
+  u_int64_t full;		/* batches filled up to 'num' */
+};
+#endif
+
 /* prototypes */
 #if (!defined __XFLOW_STATUS_C)
 #define EXT extern
@@ -106,4 +126,11 @@ EXT u_int8_t smp_entry_status_table_memerr, class_entry_status_table_memerr;
 EXT void set_vector_f_status(struct packet_ptrs_vector *);
 EXT void set_vector_f_status_g(struct packet_ptrs_vector *);
 EXT void update_status_table(struct xflow_status_entry *, u_int32_t);
+EXT void (*print_status_table_ext)(time_t);
+
+#if defined HAVE_RECVMMSG
+EXT struct xflow_recv_batch xflow_recv_batch;
+EXT void xflow_recv_batch_init(struct xflow_recv_batch *, int, int);
+EXT int xflow_recv_batch_next(struct xflow_recv_batch *, int, unsigned char **, struct sockaddr *, int, struct packet_ptrs_vector *);
+#endif
 #undef EXT